@@ -42,6 +42,8 @@ _Analysis_mode_(_Analysis_code_type_user_code_)
 
 extern "C" {
     #include "..\inc\eclib.h"
+    #include "..\inc\ectsdb.h"
+    #include "..\inc\ecring.h"
 }
 
 #define EC_TEST_NOTIFICATIONS
@@ -50,10 +52,50 @@ extern "C" {
 #define ACPI_OUTPUT_BUFFER_SIZE 1024
 #define MAX_STRING_LEN 256
 #define CMD_MIN_ARG_COUNT 3  // Always need ectest.exe -acpi <method>
+#define WATCH_MIN_ARG_COUNT 6  // Always need ectest.exe -watch <file> <ms> <sec> <method>
+#define WATCH_MAX_METHODS 16
+#define WATCH_NO_SERIES 0xFFFFFFFF  // No latency series, the method path leaves no room for the suffix
+
+// EC management service {330c1273-fde5-4757-9819-5b6539037502}, target of -msg
+static const GUID EcManagementService = { 0x330c1273, 0xfde5, 0x4757, { 0x98, 0x19, 0x5b, 0x65, 0x39, 0x03, 0x75, 0x02 } };
+
+// Thermal service variables of THRM in thermal.asl, polled by -var
+static const struct {
+    const char *name;
+    GUID id;
+} EcThermalVars[] = {
+    { "OnTemp", { 0xba17b567, 0xc368, 0x48d5, { 0xbc, 0x6f, 0xa3, 0x12, 0xa4, 0x15, 0x83, 0xc1 } } },
+    { "RampTemp", { 0x3a62688c, 0xd95b, 0x4d2d, { 0xba, 0xcc, 0x90, 0xd7, 0xa5, 0x81, 0x6b, 0xcd } } },
+    { "MaxTemp", { 0xdcb758b1, 0xf0fd, 0x4ec7, { 0xb2, 0xc0, 0xef, 0x1e, 0x2a, 0x54, 0x7b, 0x76 } } },
+};
 
 // Global event handle
 static HANDLE gExitEvent = NULL;
 
+// Capture written by -watch, notifications are recorded into it while it is open
+static CRITICAL_SECTION gCaptureLock;
+static ECTS_WRITER *gCapture = NULL;
+static UINT32 gNotifySeries = 0;
+
+// Rollup windows recorded alongside every watched method
+static const struct {
+    const char *label;
+    INT64 window;
+} gWatchRollups[] = {
+    { "1s", ECTS_TICKS_PER_SECOND },
+    { "1m", 60LL * ECTS_TICKS_PER_SECOND },
+    { "1h", 3600LL * ECTS_TICKS_PER_SECOND },
+};
+#define WATCH_ROLLUP_COUNT ((int)(sizeof(gWatchRollups) / sizeof(gWatchRollups[0])))
+
+// eclib metrics exported by -watch, each counter and these percentiles of each histogram
+static const UINT32 gWatchPercentiles[] = { 50, 99 };
+#define WATCH_PERCENTILE_COUNT ((int)(sizeof(gWatchPercentiles) / sizeof(gWatchPercentiles[0])))
+#define WATCH_METRIC_COUNT (ECLIB_COUNTERS + ECLIB_HISTOGRAMS * WATCH_PERCENTILE_COUNT)
+
+// Set by -metrics, prints eclib metrics once the command finishes
+static BOOL gPrintMetrics = FALSE;
+
 /*
  * Function: void DumpAcpi
  *
@@ -194,6 +236,30 @@ int ParseCmdline(
         printf("               GUID - {xxxxxxxx-xxxx-xxxx-xxxx-xxxxxxxxxxxx}\n");
         printf("            Integer - 0x123ABC 1234 -1234\n");
         printf("             String - \'TestString\'\n");
+        printf("    ectest.exe -watch capture.ects 100 60 \\_SB.ECT0.RTMP [method ...]\n");
+        printf("               Sample integer methods every 100ms for 60s into a capture file\n");
+        printf("    ectest.exe -trace capture.ects trace.json\n");
+        printf("               Convert a capture into Chrome trace events\n");
+        printf("    ectest.exe -loopback on [delay us] | off | clear | add <method> <integer> | record <method>\n");
+        printf("               Answer evaluations from canned responses in the driver\n");
+        printf("    ectest.exe -msg echo <bytes> [count] | read <offset> <bytes>\n");
+        printf("               Time large messages through the FF-A RX/TX buffers\n");
+        printf("    ectest.exe -share <pages> [seconds]\n");
+        printf("    ectest.exe -var <OnTemp|RampTemp|MaxTemp> [count] [ms]\n");
+        printf("    ectest.exe -fan <on> <ramp> <max> <min_rpm> <max_rpm>\n");
+        printf("               Hand the fan to the EC with one fan profile\n");
+        printf("    ectest.exe -history <sensor> <period_us> <seconds> [fetch_ms]\n");
+        printf("    ectest.exe -subscribe <method> <period_ms> <deadband> <seconds>\n");
+        printf("    ectest.exe -notify class <value> <0-3> | stats [reset]\n");
+        printf("    ectest.exe -static\n");
+        printf("    ectest.exe -battery [seconds]\n");
+        printf("               Print the battery status the EC pushes as it changes\n");
+        printf("    ectest.exe -events <seconds>\n");
+        printf("               Print notifications from a single-threaded wait loop on a notification channel\n");
+        printf("    ectest.exe -rxmap [count]\n");
+        printf("               Map the RX window read-only, print it and read count EC_ASYNC responses in place\n");
+        printf("    ectest.exe -metrics <command> [arguments]\n");
+        printf("               Print eclib call, error, byte, cache and latency metrics after the command\n");
 
         return ERROR_INVALID_PARAMETER;
     } else if(argc > CMD_MIN_ARG_COUNT + 7) {
@@ -276,208 +342,1639 @@ int ParseCmdline(
     return DumpAcpi(params);
 }
 
+typedef struct {
+    INT64 systemTime;
+    LARGE_INTEGER counter;
+    LARGE_INTEGER frequency;
+} CAPTURE_CLOCK;
+
 /*
- * Function: int ReadRxBuffer
+ * Function: CAPTURE_CLOCK ReadCaptureClock
  *
  * Description:
- * The ReadRxBuffer function reads the receive buffer from a Kernel-Mode Driver Framework (KMDF) driver.
- * It sends a request to the driver and receives the buffer data.
+ * Reads the system time and the performance counter together, the base that
+ * GetCaptureTimestamp counts from.
  *
  * Parameters:
- * HANDLE hDevice: A handle to the device from which the receive buffer is to be read.
+ * None
  *
  * Return Value:
- * Returns ERROR_SUCCESS if the receive buffer is successfully read, otherwise returns ERROR_INVALID_PARAMETER.
+ * System time as a FILETIME value with the counter and its frequency.
  */
-#ifdef EC_TEST_SHARED_BUFFER
-int ReadRxBuffer(
-    _In_ HANDLE hDevice
-    )
+static CAPTURE_CLOCK ReadCaptureClock(void)
 {
-    BOOL bRc;
-    ULONG bytesReturned;
-    ULONG inbuf;
-    RxBufferRsp_t rxrsp;
+    CAPTURE_CLOCK clock;
+    FILETIME ft;
+
+    QueryPerformanceFrequency(&clock.frequency);
+    QueryPerformanceCounter(&clock.counter);
+    GetSystemTimePreciseAsFileTime(&ft);
+    clock.systemTime = ((INT64)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+    return clock;
+}
 
-    printf("\nCalling DeviceIoControl IOCTL_GET_RX_BUFFER\n");
+/*
+ * Function: INT64 GetCaptureTimestamp
+ *
+ * Description:
+ * Returns the current time in 100ns units, matching the timestamps reported by the driver.
+ * The system time is read once and the performance counter advances it, so an NTP or manual
+ * clock change during a capture cannot move samples backwards.
+ *
+ * Parameters:
+ * None
+ *
+ * Return Value:
+ * Current time as a FILETIME value.
+ */
+INT64 GetCaptureTimestamp(void)
+{
+    static const CAPTURE_CLOCK base = ReadCaptureClock();
+    LARGE_INTEGER now;
+
+    QueryPerformanceCounter(&now);
+    INT64 ticks = now.QuadPart - base.counter.QuadPart;
+    // Whole seconds first, ticks * 10000000 overflows after a day at a 10MHz counter
+    return base.systemTime + (ticks / base.frequency.QuadPart) * 10000000 +
+           (ticks % base.frequency.QuadPart) * 10000000 / base.frequency.QuadPart;
+}
 
-    bRc = DeviceIoControl ( hDevice,
-                            (DWORD) IOCTL_READ_RX_BUFFER,
-                            &inbuf,
-                            sizeof(inbuf),
-                            &rxrsp,
-                            sizeof(rxrsp),
-                            &bytesReturned,
-                            NULL
-                            );
+/*
+ * Function: int SampleMethod
+ *
+ * Description:
+ * Evaluates an ACPI method without arguments and returns its first integer result.
+ *
+ * Parameters:
+ * input: Prebuilt ACPI input buffer for the method
+ * value: Receives the integer value returned by the method
+ *
+ * Return Value:
+ * ERROR_SUCCESS or failure code
+ */
+int SampleMethod(ACPI_EVAL_INPUT_BUFFER_COMPLEX_V1_EX *input, INT64 *value)
+{
+    BYTE buffer[ACPI_OUTPUT_BUFFER_SIZE];
+    ACPI_EVAL_OUTPUT_BUFFER_V1 *AcpiOut = (ACPI_EVAL_OUTPUT_BUFFER_V1 *)buffer;
+    size_t buffer_size = sizeof(buffer);
 
-    if ( !bRc )
-    {
-        printf ( "***       Error in DeviceIoControl : %d \n", GetLastError());
-        return ERROR_INVALID_PARAMETER;
+    int status = EvaluateAcpi((void *)input, sizeof(ACPI_EVAL_INPUT_BUFFER_COMPLEX_V1_EX) + input->Size, buffer, &buffer_size);
+    if(status != ERROR_SUCCESS) {
+        return status;
     }
 
-    // Print out notification details
-    printf("***                 data: 0x%llx\n", rxrsp.data);
+    if(AcpiOut->Count < 1 || AcpiOut->Argument[0].Type != ACPI_METHOD_ARGUMENT_INTEGER) {
+        return ERROR_INVALID_DATA;
+    }
 
+    *value = AcpiOut->Argument[0].Argument;
     return ERROR_SUCCESS;
 }
-#endif // EC_TEST_SHARED_BUFFER
 
-#ifdef EC_TEST_NOTIFICATIONS
 /*
- * Function: DDWORD NotificationThread
+ * Function: int WatchMethods
  *
  * Description:
- * The NotificationThread function retrieves a notification from a Kernel-Mode Driver Framework (KMDF) driver.
- * It sends a request to the driver and receives the notification details.
+ * Periodically samples one or more integer ACPI methods and records the values into a
+ * compressed time-series capture along with 1s/1m/1h min/max/avg/last rollups and
+ * the evaluation latency of each sample.
+ * Notifications received while watching are recorded into an event series named NOTIFY.
  *
  * Parameters:
- * LPVOID lpParam: A handle to ready event we notfiy after sending IOCTL to wait for events
+ * int argc: The number of command line arguments.
+ * char **argv: ectest.exe -watch <file> <interval ms> <duration sec> <method> [method ...]
  *
  * Return Value:
- * Returns ERROR_SUCCESS if the notification is successfully retrieved, otherwise returns ERROR_INVALID_PARAMETER.
+ * Returns ERROR_SUCCESS if the capture completed, otherwise an error code.
  */
-DWORD WINAPI NotificationThread(LPVOID lpParam) 
+int WatchMethods(
+    _In_ int argc,
+    _In_ char ** argv
+    )
 {
-    UNREFERENCED_PARAMETER(lpParam);
+    ACPI_EVAL_INPUT_BUFFER_COMPLEX_V1_EX inputs[WATCH_MAX_METHODS] = {};
+    UINT32 series[WATCH_MAX_METHODS];
+    UINT32 latency[WATCH_MAX_METHODS];
+    UINT32 metricSeries[WATCH_METRIC_COUNT];
+    ECLIB_METRICS metrics;
+    char name[ECTS_MAX_NAME_LEN];
+    LARGE_INTEGER frequency;
+    ECTS_WRITER *writer = NULL;
+    int method_count = argc - (WATCH_MIN_ARG_COUNT - 1);
+    UINT64 samples = 0;
+    UINT64 failures = 0;
+
+    if(argc < WATCH_MIN_ARG_COUNT || method_count > WATCH_MAX_METHODS) {
+        printf("Usage: ectest.exe -watch <file> <interval ms> <duration sec> <method> [method ...]\n");
+        printf("       At most %d methods can be watched at once\n", WATCH_MAX_METHODS);
+        return ERROR_INVALID_PARAMETER;
+    }
 
-    // Main loop to wait for notifications
-    for(;;) {
-        UINT32 event = WaitForNotification(0);
-        printf("Received Notification Event: 0x%x\n", event);
-        // If we get exit event then break out of loop and exit thread
-        if( WaitForSingleObject(gExitEvent, 0) == WAIT_OBJECT_0) {
+    ULONG interval = strtoul(argv[3], NULL, 0);
+    ULONG duration = strtoul(argv[4], NULL, 0);
+    if(interval == 0 || duration == 0) {
+        printf("Interval and duration must be non-zero\n");
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    int status = EctsWriterOpen(argv[2], GetCaptureTimestamp(), &writer);
+    if(status != ECTS_STATUS_SUCCESS) {
+        printf("EctsWriterOpen failed, status: 0x%x\n", status);
+        return ERROR_OPEN_FAILED;
+    }
+
+    for(int i = 0; i < method_count; i++) {
+        char *method = argv[i + WATCH_MIN_ARG_COUNT - 1];
+        inputs[i].Signature = ACPI_EVAL_INPUT_BUFFER_COMPLEX_SIGNATURE_EX;
+        strncpy_s(inputs[i].MethodName, sizeof(inputs[i].MethodName), method, _TRUNCATE);
+        status = EctsDefineSeries(writer, method, ECTS_SERIES_SAMPLE, &series[i]);
+        if(status != ECTS_STATUS_SUCCESS) {
+            printf("EctsDefineSeries %s failed, status: 0x%x\n", method, status);
+            EctsWriterClose(writer);
+            return ERROR_INVALID_PARAMETER;
+        }
+
+        // Evaluation latency of every sample, used to correlate with notification bursts
+        latency[i] = WATCH_NO_SERIES;
+        if(_snprintf_s(name, sizeof(name), _TRUNCATE, "%s/latency", method) < 0) {
+            printf("%s is too long to record its latency, skipping it\n", method);
+        } else {
+            status = EctsDefineSeries(writer, name, ECTS_SERIES_SAMPLE, &latency[i]);
+            if(status != ECTS_STATUS_SUCCESS) {
+                printf("EctsDefineSeries %s failed, status: 0x%x\n", name, status);
+                EctsWriterClose(writer);
+                return ERROR_INVALID_PARAMETER;
+            }
+        }
+
+        // Pre-aggregated series for dashboards, updated as samples are appended
+        for(int j = 0; j < WATCH_ROLLUP_COUNT; j++) {
+            status = EctsDefineRollup(writer, series[i], gWatchRollups[j].window, gWatchRollups[j].label, NULL);
+            if(status != ECTS_STATUS_SUCCESS) {
+                printf("EctsDefineRollup %s/%s failed, status: 0x%x\n", method, gWatchRollups[j].label, status);
+                EctsWriterClose(writer);
+                return ERROR_INVALID_PARAMETER;
+            }
+        }
+    }
+
+    // eclib's own counters and latency percentiles, so time spent in the library
+    // can be told apart from time spent in the methods
+    for(int i = 0; i < WATCH_METRIC_COUNT; i++) {
+        if(i < ECLIB_COUNTERS) {
+            sprintf_s(name, sizeof(name), "eclib/%s", EcMetricsCounterName(i));
+        } else {
+            int h = (i - ECLIB_COUNTERS) / WATCH_PERCENTILE_COUNT;
+            int p = (i - ECLIB_COUNTERS) % WATCH_PERCENTILE_COUNT;
+            sprintf_s(name, sizeof(name), "eclib/%s/p%u", EcMetricsHistogramName(h), gWatchPercentiles[p]);
+        }
+        status = EctsDefineSeries(writer, name, ECTS_SERIES_SAMPLE, &metricSeries[i]);
+        if(status != ECTS_STATUS_SUCCESS) {
+            printf("EctsDefineSeries %s failed, status: 0x%x\n", name, status);
+            EctsWriterClose(writer);
+            return ERROR_INVALID_PARAMETER;
+        }
+    }
+
+    EnterCriticalSection(&gCaptureLock);
+    status = EctsDefineSeries(writer, "NOTIFY", ECTS_SERIES_EVENT, &gNotifySeries);
+    if(status == ECTS_STATUS_SUCCESS) {
+        gCapture = writer;
+    }
+    LeaveCriticalSection(&gCaptureLock);
+    if(status != ECTS_STATUS_SUCCESS) {
+        printf("EctsDefineSeries NOTIFY failed, status: 0x%x\n", status);
+        EctsWriterClose(writer);
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    printf("Watching %d methods every %lums for %lus into %s\n", method_count, interval, duration, argv[2]);
+
+    QueryPerformanceFrequency(&frequency);
+    ULONGLONG start = GetTickCount64();
+    ULONGLONG next = start;
+    int appended = ECTS_STATUS_SUCCESS;
+    while(appended == ECTS_STATUS_SUCCESS && GetTickCount64() - start < (ULONGLONG)duration * 1000) {
+        for(int i = 0; i < method_count && appended == ECTS_STATUS_SUCCESS; i++) {
+            INT64 value;
+            LARGE_INTEGER before, after;
+            QueryPerformanceCounter(&before);
+            if(SampleMethod(&inputs[i], &value) != ERROR_SUCCESS) {
+                failures++;
+                continue;
+            }
+            QueryPerformanceCounter(&after);
+
+            // Latency is recorded in the same 100ns units as the timestamps
+            INT64 ticks = (after.QuadPart - before.QuadPart) * ECTS_TICKS_PER_SECOND / frequency.QuadPart;
+            INT64 timestamp = GetCaptureTimestamp();
+            EnterCriticalSection(&gCaptureLock);
+            appended = EctsAppend(writer, series[i], timestamp, value);
+            if(appended == ECTS_STATUS_SUCCESS && latency[i] != WATCH_NO_SERIES) {
+                appended = EctsAppend(writer, latency[i], timestamp, ticks);
+            }
+            LeaveCriticalSection(&gCaptureLock);
+            samples += (appended == ECTS_STATUS_SUCCESS);
+        }
+
+        if(appended == ECTS_STATUS_SUCCESS && EcMetricsSnapshot(&metrics, FALSE) == ERROR_SUCCESS) {
+            INT64 timestamp = GetCaptureTimestamp();
+            EnterCriticalSection(&gCaptureLock);
+            for(int i = 0; i < WATCH_METRIC_COUNT && appended == ECTS_STATUS_SUCCESS; i++) {
+                INT64 value;
+                if(i < ECLIB_COUNTERS) {
+                    value = (INT64)metrics.counters[i];
+                } else {
+                    int h = (i - ECLIB_COUNTERS) / WATCH_PERCENTILE_COUNT;
+                    int p = (i - ECLIB_COUNTERS) % WATCH_PERCENTILE_COUNT;
+                    value = (INT64)EcMetricsPercentile(&metrics.histograms[h], gWatchPercentiles[p]);
+                }
+                appended = EctsAppend(writer, metricSeries[i], timestamp, value);
+            }
+            LeaveCriticalSection(&gCaptureLock);
+        }
+
+        // A failed write leaves the capture incomplete, stop instead of sampling into it
+        if(appended != ECTS_STATUS_SUCCESS) {
+            printf("EctsAppend failed, status: 0x%x, stopping the capture\n", appended);
             break;
         }
+
+        // Keep a fixed sampling rate rather than a fixed gap between samples
+        next += interval;
+        ULONGLONG now = GetTickCount64();
+        if(next > now) {
+            Sleep((DWORD)(next - now));
+        } else {
+            next = now;
+        }
     }
 
-    return 0;
+    EnterCriticalSection(&gCaptureLock);
+    gCapture = NULL;
+    status = EctsWriterClose(writer);
+    LeaveCriticalSection(&gCaptureLock);
+
+    printf("Captured %llu samples (%llu failed evaluations) into %s\n", samples, failures, argv[2]);
+    return (status == ECTS_STATUS_SUCCESS && appended == ECTS_STATUS_SUCCESS) ? ERROR_SUCCESS : ERROR_WRITE_FAULT;
 }
 
+// Writes one trace event per sample while converting a capture
+typedef struct {
+    FILE *out;
+    const char *name;       // Series being converted
+    INT64 base;             // Earliest timestamp in the capture, trace time 0
+    UINT32 tid;             // Track of the spans
+    UINT64 events;
+    BOOL span;              // Series holds latencies, written as spans ending at each sample
+} TRACE_CONTEXT;
 
 /*
- * Function: HANDLE StartNotificationListener
+ * Function: void TraceWriteString
  *
  * Description:
- * The StartNotificationListener function creates a thread to listen for notifications and returns a handle to the thread.
- * It creates an event to signal when the thread is ready and waits for the thread to be ready or terminated.
+ * Writes a JSON string, escaping the backslashes of ACPI paths.
  *
  * Parameters:
- * None
+ * out: The trace file
+ * value: The string
  *
  * Return Value:
- * Returns a handle to the notification listener thread if successful, otherwise returns NULL.
+ * None
  */
-HANDLE StartNotificationListener(void)
+void TraceWriteString(FILE *out, const char *value)
 {
-    HANDLE hThread;
-    DWORD dwThreadId;
-
-    // Initialize external notification lib
-    int status = InitializeNotification();
-    if(status != ERROR_SUCCESS) {
-        printf("InitializeNotification failed, status: 0x%x\n", status);
-        return NULL;
+    fputc('"', out);
+    for(; *value != '\0'; value++) {
+        if(*value == '"' || *value == '\\') {
+            fputc('\\', out);
+        }
+        fputc(*value, out);
     }
-
-    // Create the thread
-    hThread = CreateThread(
-        NULL,                   // Default security attributes
-        0,                      // Default stack size
-        NotificationThread,     // Thread routine
-        NULL,                   // Parameter to thread routine
-        0,                      // Default creation flags
-        &dwThreadId);           // Receive thread identifier
-
-    return hThread;
+    fputc('"', out);
 }
-#endif // EC_TEST_NOTIFICATIONS
 
+/*
+ * Function: void TraceSample
+ *
+ * Description:
+ * EctsScan callback writing one sample as a trace event. Latencies become
+ * complete events that end at the sample, event series become instant events
+ * and everything else becomes a counter. Timestamps are converted from 100ns
+ * units to the microseconds the trace format uses.
+ *
+ * Parameters:
+ * ctx: TRACE_CONTEXT of the series
+ * series: Series ID
+ * timestamp: Sample time
+ * value: Sample value
+ *
+ * Return Value:
+ * None
+ */
+void TraceSample(void *ctx, uint32_t series, int64_t timestamp, int64_t value)
+{
+    TRACE_CONTEXT *trace = (TRACE_CONTEXT *)ctx;
+    double ts = (double)(timestamp - trace->base) / 10.0;
+    char label[ECTS_MAX_NAME_LEN + 20];
+
+    UNREFERENCED_PARAMETER(series);
+
+    fputs(trace->events++ ? ",\n" : "\n", trace->out);
+    if(trace->span) {
+        // A span that would start before the first sample starts at trace time 0
+        double start = ts - (double)value / 10.0;
+        if(start < 0) {
+            start = 0;
+        }
+        fputs("{\"ph\":\"X\",\"name\":", trace->out);
+        TraceWriteString(trace->out, trace->name);
+        fprintf(trace->out, ",\"cat\":\"eval\",\"pid\":1,\"tid\":%u,\"ts\":%.1f,\"dur\":%.1f}",
+                trace->tid, start, ts - start);
+    } else if(trace->tid == 0) {
+        sprintf_s(label, sizeof(label), "%s 0x%llx", trace->name, (unsigned long long)value);
+        fputs("{\"ph\":\"i\",\"s\":\"g\",\"name\":", trace->out);
+        TraceWriteString(trace->out, label);
+        fprintf(trace->out, ",\"cat\":\"notify\",\"pid\":1,\"tid\":0,\"ts\":%.1f}", ts);
+    } else {
+        fputs("{\"ph\":\"C\",\"name\":", trace->out);
+        TraceWriteString(trace->out, trace->name);
+        fprintf(trace->out, ",\"pid\":1,\"ts\":%.1f,\"args\":{\"value\":%lld}}", ts, (long long)value);
+    }
+}
 
 /*
- * Function: int main
+ * Function: int TraceCommand
  *
  * Description:
- * The main function serves as the entry point for the program. It parses the command line arguments,
- * retrieves a handle to the KMDF driver, and evaluates an ACPI method on the device.
+ * Converts a capture written by -watch into Chrome trace event JSON, which
+ * chrome://tracing and Perfetto open. Each watched method gets a track of
+ * spans, one per evaluation, from its latency series. Notifications are
+ * instant events, and method values and eclib metrics are counters. Rollups
+ * are left out as the viewer aggregates on its own.
  *
  * Parameters:
  * int argc: The number of command line arguments.
- * char* argv[]: The array of command line arguments.
+ * char **argv: ectest.exe -trace <capture> <trace.json>
  *
  * Return Value:
- * Returns the status of the operations. Returns ERROR_SUCCESS if all operations are successful,
- * otherwise returns an error code.
+ * Returns ERROR_SUCCESS if the trace was written, otherwise an error code.
  */
-int __cdecl
-main(
+int TraceCommand(
     _In_ int argc,
-    _In_reads_(argc) char* argv[]
+    _In_ char ** argv
     )
 {
+    ECTS_READER *reader = NULL;
+    ECTS_SERIES_INFO info;
+    TRACE_CONTEXT trace = {};
+    FILE *out = NULL;
+    const char *suffix = "/latency";
+    size_t suffix_len = strlen(suffix);
+    UINT32 tracks = 0;
+
+    if(argc < 4) {
+        printf("Usage: ectest.exe -trace <capture> <trace.json>\n");
+        return ERROR_INVALID_PARAMETER;
+    }
 
-    HANDLE hThread = NULL;
-    int status = ERROR_SUCCESS;
-
-    // Keep only one instance of the application running
-    // This makes the App & Driver simple by not allowing multiple instances
-    //
-    HANDLE hMutex = CreateMutex(NULL, TRUE, L"Global\\ECTestAppMutex");
-    if (hMutex == NULL) {
-        status = GetLastError();
-        printf("CreateMutex failed, error: %d\n", status);
-        goto CleanUp;
+    int status = EctsReaderOpen(argv[2], &reader);
+    if(status != ECTS_STATUS_SUCCESS) {
+        printf("EctsReaderOpen %s failed, status: 0x%x\n", argv[2], status);
+        return ERROR_OPEN_FAILED;
+    }
+    if(fopen_s(&out, argv[3], "w") != 0 || out == NULL) {
+        printf("Cannot create %s\n", argv[3]);
+        EctsReaderClose(reader);
+        return ERROR_OPEN_FAILED;
     }
 
-    if (GetLastError() == ERROR_ALREADY_EXISTS) {
-        printf("Another instance of the application is already running.\n");
-        goto CleanUp;
+    // Trace time 0 is the first sample of any series converted, rollups are
+    // stamped with the start of their window which may come before it
+    trace.base = INT64_MAX;
+    UINT32 blocks = EctsBlockCount(reader);
+    for(UINT32 i = 0; i < blocks; i++) {
+        const ECTS_BLOCK_HEADER *block = EctsBlockInfo(reader, i);
+        if(EctsSeriesInfo(reader, block->series, &info) == ECTS_STATUS_SUCCESS && info.kind != ECTS_SERIES_ROLLUP) {
+            trace.base = min(trace.base, block->t_first);
+        }
+    }
+    if(trace.base == INT64_MAX) {
+        trace.base = 0;
     }
 
-#ifdef EC_TEST_NOTIFICATIONS
-    // Create the exit event
-    gExitEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
-    if (gExitEvent == NULL) {
-        status = GetLastError();
-        printf("CreateEvent failed, error: %d\n", status);
-        goto CleanUp;
+    trace.out = out;
+    fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", out);
+    for(UINT32 i = 0; i < EctsSeriesCount(reader) && status == ECTS_STATUS_SUCCESS; i++) {
+        if(EctsSeriesInfo(reader, i, &info) != ECTS_STATUS_SUCCESS || info.kind == ECTS_SERIES_ROLLUP) {
+            continue;
+        }
+
+        size_t len = strlen(info.name);
+        trace.name = info.name;
+        trace.span = info.kind == ECTS_SERIES_SAMPLE && len > suffix_len && strcmp(info.name + len - suffix_len, suffix) == 0;
+        trace.tid = info.kind == ECTS_SERIES_EVENT ? 0 : info.id + 1;
+        if(trace.span) {
+            // Name the track and the spans after the method
+            info.name[len - suffix_len] = '\0';
+            fputs(trace.events++ ? ",\n" : "\n", out);
+            fprintf(out, "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", trace.tid);
+            TraceWriteString(out, info.name);
+            fputs("}}", out);
+            tracks++;
+        }
+        status = EctsScan(reader, info.id, INT64_MIN, INT64_MAX, TraceSample, &trace);
+    }
+    fputs("\n]}\n", out);
+
+    BOOL written = ferror(out) == 0;
+    fclose(out);
+    EctsReaderClose(reader);
+    if(status != ECTS_STATUS_SUCCESS || !written) {
+        printf("Converting %s failed, status: 0x%x\n", argv[2], status);
+        return ERROR_WRITE_FAULT;
     }
 
-    // This creates a new thread and blocks until listener is running
-    hThread = StartNotificationListener();
-    if(hThread == NULL) {
-        goto CleanUp;
+    printf("Wrote %llu trace events on %u method tracks into %s\n", trace.events, tracks, argv[3]);
+    return ERROR_SUCCESS;
+}
+
+/*
+ * Function: int LoopbackCommand
+ *
+ * Description:
+ * Controls the driver's loopback mode, in which evaluations are answered from canned
+ * responses so benchmarks measure only the driver path.
+ *   on [delay us]            Enable loopback with an optional synthetic delay
+ *   off                      Disable loopback, evaluations go to ACPI again
+ *   clear                    Disable loopback and drop all responses
+ *   add <method> <integer>   Register an integer response for a method
+ *   record <method>          Evaluate a method without arguments and register its output
+ *
+ * Parameters:
+ * int argc: The number of command line arguments.
+ * char **argv: ectest.exe -loopback <command> [arguments]
+ *
+ * Return Value:
+ * Returns ERROR_SUCCESS if the driver accepted the command, otherwise an error code.
+ */
+int LoopbackCommand(
+    _In_ int argc,
+    _In_ char ** argv
+    )
+{
+    ECLIB_LOOPBACK_STATUS lbstatus;
+    int status = ERROR_INVALID_PARAMETER;
+
+    if(argc >= 3 && strcmp(argv[2], "on") == 0) {
+        ULONG delay = (argc > 3) ? strtoul(argv[3], NULL, 0) : 0;
+        status = EcLoopbackSet(ECLIB_LOOPBACK_ENABLE, delay, &lbstatus);
+    } else if(argc >= 3 && strcmp(argv[2], "off") == 0) {
+        status = EcLoopbackSet(0, 0, &lbstatus);
+    } else if(argc >= 3 && strcmp(argv[2], "clear") == 0) {
+        status = EcLoopbackSet(ECLIB_LOOPBACK_CLEAR, 0, &lbstatus);
+    } else if(argc >= 5 && strcmp(argv[2], "add") == 0) {
+        // ACPI_EVAL_OUTPUT_BUFFER_V1 with a single integer argument
+        BYTE response[sizeof(ACPI_EVAL_OUTPUT_BUFFER_V1)] = {};  // Argument[0] holds the ULONG
+        auto* out = reinterpret_cast<ACPI_EVAL_OUTPUT_BUFFER_V1*>(response);
+        out->Signature = ACPI_EVAL_OUTPUT_BUFFER_SIGNATURE_V1;
+        out->Length = sizeof(response);
+        out->Count = 1;
+        out->Argument[0].Type = ACPI_METHOD_ARGUMENT_INTEGER;
+        out->Argument[0].DataLength = sizeof(ULONG);
+        out->Argument[0].Argument = strtoul(argv[4], NULL, 0);
+        status = EcLoopbackAddResponse(argv[3], response, sizeof(response));
+    } else if(argc >= 4 && strcmp(argv[2], "record") == 0) {
+        ACPI_EVAL_INPUT_BUFFER_V1_EX input = {};
+        BYTE output[ACPI_OUTPUT_BUFFER_SIZE];
+        size_t output_len = sizeof(output);
+        input.Signature = ACPI_EVAL_INPUT_BUFFER_SIGNATURE_EX;
+        strncpy_s(input.MethodName, sizeof(input.MethodName), argv[3], _TRUNCATE);
+
+        // Loopback must be off or the recorded output would be a canned one
+        status = EvaluateAcpi(&input, sizeof(input), output, &output_len);
+        if(status == ERROR_SUCCESS) {
+            status = EcLoopbackAddResponse(argv[3], output, output_len);
+        }
+    } else {
+        printf("Usage: ectest.exe -loopback on [delay us] | off | clear | add <method> <integer> | record <method>\n");
+        return ERROR_INVALID_PARAMETER;
     }
-#endif // EC_TEST_NOTIFICATIONS
 
-    status = ParseCmdline(argc,argv);
     if(status != ERROR_SUCCESS) {
-        goto CleanUp;
+        printf("Loopback %s failed, error: %d\n", argv[2], status);
+        return status;
     }
 
-    // Loop until we hit "q to quit"
-    printf("Waiting for notification press 'q' to quit.\n");
-    int key;
-    for(;;) {
-        key = getchar();
-        if( key == 'q') {
-            break;
-        }
+    if(strcmp(argv[2], "add") == 0 || strcmp(argv[2], "record") == 0) {
+        printf("Registered loopback response for %s\n", argv[3]);
+        return ERROR_SUCCESS;
     }
 
-    printf("You pressed 'q'. Exiting...\n");
-CleanUp:
-
-    // Signal the exit event to stop the thread
-    if(gExitEvent) SetEvent(gExitEvent);
-    if(hThread) CancelSynchronousIo(hThread);
-    if(hThread) WaitForSingleObject(hThread, INFINITE);
-    if(hThread) CleanupNotification();
-    if(hThread) CloseHandle(hThread);
+    printf("Loopback %s, delay %luus, %lu responses, %llu hits, %llu misses\n",
+           lbstatus.enabled ? "enabled" : "disabled", lbstatus.delay_us, lbstatus.entries, lbstatus.hits, lbstatus.misses);
+    return ERROR_SUCCESS;
+}
 
-    if(gExitEvent) CloseHandle(gExitEvent);
-    if(hMutex) CloseHandle(hMutex);
+/*
+ * Function: int MessageCommand
+ *
+ * Description:
+ * Sends large messages to the EC management service through the FF-A RX/TX buffers
+ * and reports the round trip time.
+ *   echo <bytes> [count]     Send count messages of the given size and check the echoed payload
+ *   read <offset> <bytes>    Read a block of EC data in one message and dump its start
+ *
+ * Parameters:
+ * int argc: The number of command line arguments.
+ * char **argv: ectest.exe -msg <command> [arguments]
+ *
+ * Return Value:
+ * Returns ERROR_SUCCESS if every message succeeded, otherwise an error code.
+ */
+int MessageCommand(
+    _In_ int argc,
+    _In_ char ** argv
+    )
+{
+    std::unique_ptr<BYTE[]> input(new BYTE[ECLIB_MESSAGE_MAX_PAYLOAD]);
+    std::unique_ptr<BYTE[]> output(new BYTE[ECLIB_MESSAGE_MAX_PAYLOAD]);
+    LARGE_INTEGER frequency, before, after;
+    size_t input_len = 0;
+    size_t returned = 0;
+    UINT32 ec_status = 0;
+    ULONG count = 1;
+    UINT8 command;
+    int status = ERROR_SUCCESS;
+
+    if(argc >= 4 && strcmp(argv[2], "echo") == 0) {
+        command = EC_MSG_CMD_ECHO;
+        input_len = strtoul(argv[3], NULL, 0);
+        count = (argc > 4) ? strtoul(argv[4], NULL, 0) : 1;
+        for(size_t i = 0; i < input_len && i < ECLIB_MESSAGE_MAX_PAYLOAD; i++) {
+            input[i] = (BYTE)i;
+        }
+    } else if(argc >= 5 && strcmp(argv[2], "read") == 0) {
+        MsgBulkReq_t bulk;
+        bulk.offset = strtoul(argv[3], NULL, 0);
+        bulk.length = strtoul(argv[4], NULL, 0);
+        command = EC_MSG_CMD_READ_BULK;
+        input_len = sizeof(bulk);
+        memcpy(input.get(), &bulk, sizeof(bulk));
+    } else {
+        printf("Usage: ectest.exe -msg echo <bytes> [count] | read <offset> <bytes>\n");
+        return ERROR_INVALID_PARAMETER;
+    }
+    if(input_len > ECLIB_MESSAGE_MAX_PAYLOAD || count == 0) {
+        printf("Messages carry at most %u bytes\n", ECLIB_MESSAGE_MAX_PAYLOAD);
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&before);
+    for(ULONG i = 0; i < count && status == ERROR_SUCCESS; i++) {
+        status = EcMessageSend(&EcManagementService, command, input.get(), input_len,
+                               output.get(), ECLIB_MESSAGE_MAX_PAYLOAD, &returned, &ec_status);
+        if(status == ERROR_SUCCESS && ec_status != EC_MSG_STATUS_SUCCESS) {
+            printf("EC returned status %u\n", ec_status);
+            status = ERROR_INVALID_DATA;
+        } else if(status == ERROR_SUCCESS && command == EC_MSG_CMD_ECHO &&
+                  (returned != input_len || memcmp(input.get(), output.get(), input_len) != 0)) {
+            printf("Echo %lu returned different data\n", i);
+            status = ERROR_INVALID_DATA;
+        }
+    }
+    QueryPerformanceCounter(&after);
+
+    if(status != ERROR_SUCCESS) {
+        printf("Message %s failed, error: %d\n", argv[2], status);
+        return status;
+    }
+
+    double us = (double)(after.QuadPart - before.QuadPart) * 1000000.0 / frequency.QuadPart / count;
+    printf("%lu message(s), %zu bytes out, %zu bytes back, %.1fus per round trip\n", count, input_len, returned, us);
+    if(command == EC_MSG_CMD_READ_BULK) {
+        for(size_t i = 0; i < returned && i < 64; i++) {
+            printf("%02x%s", output[i], (i % 16 == 15) ? "\n" : " ");
+        }
+        printf("\n");
+    }
+    return ERROR_SUCCESS;
+}
+
+/*
+ * Function: int ShareCommand
+ *
+ * Description:
+ * Shares a driver allocated region of the given number of 4K pages with the EC,
+ * holds it for the given number of seconds and has the EC unmap it again before
+ * it is reclaimed and freed. Regions belong to the handle they were shared on,
+ * the driver reclaims them when the process exits.
+ *
+ * Parameters:
+ * int argc: The number of command line arguments.
+ * char **argv: ectest.exe -share <pages> [seconds]
+ *
+ * Return Value:
+ * Returns ERROR_SUCCESS if the region was shared and reclaimed, otherwise an error code.
+ */
+int ShareCommand(
+    _In_ int argc,
+    _In_ char ** argv
+    )
+{
+    ECLIB_SHARE share;
+    LARGE_INTEGER frequency, before, after;
+    UINT32 ec_status = 0;
+    int status;
+
+    if(argc < 3) {
+        printf("Usage: ectest.exe -share <pages> [seconds]\n");
+        return ERROR_INVALID_PARAMETER;
+    }
+    DWORD seconds = (argc >= 4) ? strtoul(argv[3], NULL, 0) : 0;
+
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&before);
+    status = EcMemShare(strtoul(argv[2], NULL, 0), &share, &ec_status);
+    QueryPerformanceCounter(&after);
+
+    if(status == ERROR_REQUEST_REFUSED) {
+        printf("EC declined the region, status %u\n", ec_status);
+        return status;
+    } else if(status != ERROR_SUCCESS) {
+        printf("Share failed, error: %d\n", status);
+        return status;
+    }
+
+    double us = (double)(after.QuadPart - before.QuadPart) * 1000000.0 / frequency.QuadPart;
+    printf("Shared %lu page(s) at 0x%llx, handle 0x%llx, %.1fus\n", share.pages, share.address, share.handle, us);
+    Sleep(seconds * 1000);
+
+    QueryPerformanceCounter(&before);
+    status = EcMemReclaim(share.handle);
+    QueryPerformanceCounter(&after);
+    if(status != ERROR_SUCCESS) {
+        printf("Reclaim failed, error: %d\n", status);
+        return status;
+    }
+
+    us = (double)(after.QuadPart - before.QuadPart) * 1000000.0 / frequency.QuadPart;
+    printf("Reclaimed handle 0x%llx, %.1fus\n", share.handle, us);
+    return ERROR_SUCCESS;
+}
+
+/*
+ * Function: int VarCommand
+ *
+ * Description:
+ * Polls a thermal service variable through the eclib variable cache and prints
+ * the value each time it changes, then how many reads were revalidated without
+ * a payload.
+ *
+ * Parameters:
+ * int argc: The number of command line arguments.
+ * char **argv: ectest.exe -var <name> [count] [ms]
+ *
+ * Return Value:
+ * Returns ERROR_SUCCESS if every read succeeded, otherwise an error code.
+ */
+int VarCommand(
+    _In_ int argc,
+    _In_ char ** argv
+    )
+{
+    ECLIB_VAR_CACHE *cache = NULL;
+    ECLIB_VAR_CACHE_STATS stats;
+    const GUID *variable = NULL;
+    UINT32 value = 0;
+    size_t returned = 0;
+    BOOL changed = FALSE;
+    ULONG count;
+    ULONG interval;
+    int status;
+
+    for(size_t i = 0; argc >= 3 && i < ARRAYSIZE(EcThermalVars); i++) {
+        if(_stricmp(argv[2], EcThermalVars[i].name) == 0) {
+            variable = &EcThermalVars[i].id;
+        }
+    }
+    if(variable == NULL) {
+        printf("Usage: ectest.exe -var <OnTemp|RampTemp|MaxTemp> [count] [ms]\n");
+        return ERROR_INVALID_PARAMETER;
+    }
+    count = (argc > 3) ? strtoul(argv[3], NULL, 0) : 10;
+    interval = (argc > 4) ? strtoul(argv[4], NULL, 0) : 100;
+
+    status = EcVarCacheCreate(4, &cache);
+    for(ULONG i = 0; i < count && status == ERROR_SUCCESS; i++) {
+        status = EcVarRead(cache, variable, 1, &value, sizeof(value), &returned, &changed);
+        if(status == ERROR_SUCCESS && changed) {
+            printf("%s = %u\n", argv[2], value);
+        }
+        if(i + 1 < count) {
+            Sleep(interval);
+        }
+    }
+
+    if(status != ERROR_SUCCESS) {
+        printf("Reading %s failed, error: %d\n", argv[2], status);
+    } else {
+        EcVarCacheGetStats(cache, &stats);
+        printf("%llu reads, %llu not modified, %llu refreshed\n", stats.reads, stats.not_modified, stats.refreshed);
+    }
+    EcVarCacheDestroy(cache);
+    return status;
+}
+
+/*
+ * Function: int FanCommand
+ *
+ * Description:
+ * Writes a fan curve as one fan profile so the EC runs the fan on its own,
+ * then reads the variables back through the same cache to show they were
+ * written together.
+ *
+ * Parameters:
+ * int argc: The number of command line arguments.
+ * char **argv: ectest.exe -fan <on> <ramp> <max> <min_rpm> <max_rpm>
+ *
+ * Return Value:
+ * Returns ERROR_SUCCESS if the profile was written, otherwise an error code.
+ */
+int FanCommand(
+    _In_ int argc,
+    _In_ char ** argv
+    )
+{
+    ECLIB_VAR_CACHE *cache = NULL;
+    ECLIB_VAR_CACHE_STATS stats;
+    ECLIB_FAN_PROFILE profile;
+    UINT32 value = 0;
+    size_t returned = 0;
+    int status;
+
+    if(argc < 7) {
+        printf("Usage: ectest.exe -fan <on> <ramp> <max> <min_rpm> <max_rpm>\n");
+        printf("       Temperatures in tenths of a Kelvin\n");
+        return ERROR_INVALID_PARAMETER;
+    }
+    profile.on_temp = strtoul(argv[2], NULL, 0);
+    profile.ramp_temp = strtoul(argv[3], NULL, 0);
+    profile.max_temp = strtoul(argv[4], NULL, 0);
+    profile.min_rpm = strtoul(argv[5], NULL, 0);
+    profile.max_rpm = strtoul(argv[6], NULL, 0);
+
+    status = EcVarCacheCreate(8, &cache);
+    if(status == ERROR_SUCCESS) {
+        status = EcFanProfileApply(cache, 1, &profile);
+    }
+    if(status != ERROR_SUCCESS) {
+        printf("Writing the fan profile failed, error: %d\n", status);
+        EcVarCacheDestroy(cache);
+        return status;
+    }
+
+    // Already cached, so each of these should come back not modified
+    for(size_t i = 0; i < ARRAYSIZE(EcThermalVars) && status == ERROR_SUCCESS; i++) {
+        status = EcVarRead(cache, &EcThermalVars[i].id, 1, &value, sizeof(value), &returned, NULL);
+        if(status == ERROR_SUCCESS) {
+            printf("%s = %u\n", EcThermalVars[i].name, value);
+        }
+    }
+    EcVarCacheGetStats(cache, &stats);
+    printf("Fan profile written, %llu of %llu reads not modified\n", stats.not_modified, stats.reads);
+    EcVarCacheDestroy(cache);
+    return status;
+}
+
+/*
+ * Function: int HistoryCommand
+ *
+ * Description:
+ * Has the EC sample a sensor at a high rate and fetches the history in bulk at
+ * a much lower rate, then reports the range seen and how many round trips it took.
+ *
+ * Parameters:
+ * int argc: The number of command line arguments.
+ * char **argv: ectest.exe -history <sensor> <period_us> <seconds> [fetch_ms]
+ *
+ * Return Value:
+ * Returns ERROR_SUCCESS if every fetch succeeded, otherwise an error code.
+ */
+int HistoryCommand(
+    _In_ int argc,
+    _In_ char ** argv
+    )
+{
+    std::unique_ptr<UINT32[]> samples(new UINT32[ECLIB_HISTORY_MAX_SAMPLES]);
+    ECLIB_HISTORY_INFO info;
+    UINT64 sequence = 0;
+    UINT64 total = 0;
+    UINT64 dropped = 0;
+    UINT32 low = MAXUINT32;
+    UINT32 high = 0;
+    ULONG fetches = 0;
+    int status;
+
+    if(argc < 5) {
+        printf("Usage: ectest.exe -history <sensor> <period_us> <seconds> [fetch_ms]\n");
+        return ERROR_INVALID_PARAMETER;
+    }
+    UINT8 sensor = (UINT8)strtoul(argv[2], NULL, 0);
+    UINT32 period = strtoul(argv[3], NULL, 0);
+    ULONGLONG end = GetTickCount64() + strtoul(argv[4], NULL, 0) * 1000ULL;
+    ULONG interval = (argc > 5) ? strtoul(argv[5], NULL, 0) : 100;
+
+    status = EcHistoryConfigure(sensor, period);
+    while(status == ERROR_SUCCESS && GetTickCount64() < end) {
+        Sleep(interval);
+        status = EcHistoryRead(sensor, sequence, samples.get(), ECLIB_HISTORY_MAX_SAMPLES, &info);
+        if(status != ERROR_SUCCESS) {
+            break;
+        }
+        for(UINT32 i = 0; i < info.count; i++) {
+            low = min(low, samples[i]);
+            high = max(high, samples[i]);
+        }
+        sequence = info.next;
+        total += info.count;
+        dropped += info.dropped;
+        fetches++;
+    }
+    EcHistoryConfigure(sensor, 0);
+
+    if(status != ERROR_SUCCESS) {
+        printf("History of sensor %u failed, error: %d\n", sensor, status);
+        return status;
+    }
+    printf("%llu samples in %lu fetches, %llu dropped, range %u..%u\n", total, fetches, dropped, low, high);
+    return ERROR_SUCCESS;
+}
+
+/*
+ * Function: int SubscribeCommand
+ *
+ * Description:
+ * Has the driver sample a method and subscribes to it with an event, printing
+ * each change beyond the deadband. Reports how many samples the driver took for
+ * every time this process was woken.
+ *
+ * Parameters:
+ * int argc: The number of command line arguments.
+ * char **argv: ectest.exe -subscribe <method> <period_ms> <deadband> <seconds>
+ *
+ * Return Value:
+ * Returns ERROR_SUCCESS if the subscription worked throughout, otherwise an error code.
+ */
+int SubscribeCommand(
+    _In_ int argc,
+    _In_ char ** argv
+    )
+{
+    ECLIB_SAMPLE sample;
+    UINT64 first = 0;
+    UINT32 sampler = 0;
+    ULONG wakeups = 0;
+    HANDLE event = NULL;
+    int status;
+
+    if(argc < 6) {
+        printf("Usage: ectest.exe -subscribe <method> <period_ms> <deadband> <seconds>\n");
+        return ERROR_INVALID_PARAMETER;
+    }
+    UINT32 period = strtoul(argv[3], NULL, 0);
+    UINT64 deadband = _strtoui64(argv[4], NULL, 0);
+    ULONGLONG end = GetTickCount64() + strtoul(argv[5], NULL, 0) * 1000ULL;
+
+    event = CreateEvent(NULL, FALSE, FALSE, NULL);
+    if(event == NULL) {
+        return GetLastError();
+    }
+
+    status = EcSamplerRegister(argv[2], period, &sampler);
+    if(status == ERROR_SUCCESS) {
+        status = EcSamplerRead(sampler, &sample);
+    }
+    if(status == ERROR_SUCCESS) {
+        first = sample.samples;
+        printf("%s = %llu\n", argv[2], sample.value);
+        status = EcSamplerSubscribeEvent(sampler, event, deadband, &sample);
+    }
+
+    while(status == ERROR_SUCCESS) {
+        ULONGLONG now = GetTickCount64();
+        if(now >= end || WaitForSingleObject(event, (DWORD)(end - now)) != WAIT_OBJECT_0) {
+            break;
+        }
+        wakeups++;
+        status = EcSamplerSubscribeEvent(sampler, event, deadband, &sample);
+        if(status == ERROR_SUCCESS) {
+            printf("%s = %llu\n", argv[2], sample.value);
+        }
+    }
+
+    if(status != ERROR_SUCCESS) {
+        printf("Subscribing to %s failed, error: %d\n", argv[2], status);
+    } else {
+        EcSamplerUnsubscribeEvent(sampler, event);
+        printf("%llu samples, %lu wakeups\n", sample.samples - first, wakeups);
+    }
+    EcSamplerUnregister(argv[2]);
+    CloseHandle(event);
+    return status;
+}
+
+/*
+ * Function: int NotifyCommand
+ *
+ * Description:
+ * Moves a notify value to a priority class, or prints the delivery statistics
+ * of every class.
+ *
+ * Parameters:
+ * int argc: The number of command line arguments.
+ * char **argv: ectest.exe -notify class <value> <0-3> | stats [reset]
+ *
+ * Return Value:
+ * Returns ERROR_SUCCESS if the driver accepted the request, otherwise an error code.
+ */
+int NotifyCommand(
+    _In_ int argc,
+    _In_ char ** argv
+    )
+{
+    ECLIB_NOTIFY_STATS stats[ECLIB_NOTIFY_CLASSES];
+    int status;
+
+    if(argc >= 5 && strcmp(argv[2], "class") == 0) {
+        ULONG value = strtoul(argv[3], NULL, 0);
+        ULONG priority = strtoul(argv[4], NULL, 0);
+        if(value > 0xFF || priority >= ECLIB_NOTIFY_CLASSES) {
+            printf("Notify values are 0-0xFF and classes 0-%u\n", ECLIB_NOTIFY_CLASSES - 1);
+            return ERROR_INVALID_PARAMETER;
+        }
+        status = EcNotifySetClass((UINT8)value, (UINT8)priority);
+        if(status != ERROR_SUCCESS) {
+            printf("EcNotifySetClass failed, error: %d\n", status);
+        }
+        return status;
+    }
+
+    if(argc >= 3 && strcmp(argv[2], "stats") == 0) {
+        status = EcNotifyGetStats(stats, argc >= 4 && strcmp(argv[3], "reset") == 0);
+        if(status != ERROR_SUCCESS) {
+            printf("EcNotifyGetStats failed, error: %d\n", status);
+            return status;
+        }
+        printf("class   received  delivered  coalesced    dropped  queued  peak  avg us  max us\n");
+        for(UINT32 i = 0; i < ECLIB_NOTIFY_CLASSES; i++) {
+            printf("%5u %10llu %10llu %10llu %10llu %7u %5u %7llu %7llu\n", i,
+                   stats[i].received, stats[i].delivered, stats[i].coalesced, stats[i].dropped,
+                   stats[i].queued, stats[i].peak, stats[i].latency_avg_us, stats[i].latency_max_us);
+        }
+        return ERROR_SUCCESS;
+    }
+
+    printf("Usage: ectest.exe -notify class <value> <0-3> | stats [reset]\n");
+    return ERROR_INVALID_PARAMETER;
+}
+
+/*
+ * Function: int StaticCommand
+ *
+ * Description:
+ * Prints the facts firmware published at boot and times the first read, which
+ * goes to the cache file or the driver, against the second, which eclib answers
+ * from its copy.
+ *
+ * Parameters:
+ * int argc: The number of command line arguments.
+ * char **argv: ectest.exe -static
+ *
+ * Return Value:
+ * Returns ERROR_SUCCESS if the snapshot was read, otherwise an error code.
+ */
+int StaticCommand(
+    _In_ int argc,
+    _In_ char ** argv
+    )
+{
+    ECLIB_STATIC facts;
+    LARGE_INTEGER frequency, before, middle, after;
+    int status;
+
+    UNREFERENCED_PARAMETER(argc);
+    UNREFERENCED_PARAMETER(argv);
+
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&before);
+    status = EcStaticRead(&facts);
+    QueryPerformanceCounter(&middle);
+    if(status != ERROR_SUCCESS) {
+        printf("EcStaticRead failed, error: %d\n", status);
+        return status;
+    }
+    EcStaticRead(&facts);
+    QueryPerformanceCounter(&after);
+
+    printf("Snapshot version %u, FW state 0x%x, driver version 0x%x, from the %s\n", facts.version,
+           facts.fw_state, facts.driver_version, facts.source == ECLIB_STATIC_SOURCE_CACHE ? "cache file" : "driver");
+    for(UINT32 i = 0; i < facts.service_count; i++) {
+        const GUID *g = &facts.services[i].service;
+        printf("  service {%08lx-%04x-%04x-%02x%02x-%02x%02x%02x%02x%02x%02x} partition 0x%x\n",
+               g->Data1, g->Data2, g->Data3, g->Data4[0], g->Data4[1], g->Data4[2], g->Data4[3],
+               g->Data4[4], g->Data4[5], g->Data4[6], g->Data4[7], facts.services[i].partition);
+    }
+    for(UINT32 i = 0; i < facts.dsm_count; i++) {
+        const GUID *g = &facts.dsm[i].uuid;
+        printf("  %s _DSM {%08lx-%04x-%04x-%02x%02x-%02x%02x%02x%02x%02x%02x} revision %u functions 0x%llx\n",
+               facts.dsm[i].device, g->Data1, g->Data2, g->Data3, g->Data4[0], g->Data4[1], g->Data4[2],
+               g->Data4[3], g->Data4[4], g->Data4[5], g->Data4[6], g->Data4[7], facts.dsm[i].revision,
+               facts.dsm[i].functions);
+    }
+    printf("First read %.1f us, cached read %.1f us\n",
+           (double)(middle.QuadPart - before.QuadPart) * 1e6 / frequency.QuadPart,
+           (double)(after.QuadPart - middle.QuadPart) * 1e6 / frequency.QuadPart);
+
+    // Facts loaded from the cache file are checked against the driver in the
+    // background, report whether they were still current
+    if(facts.source == ECLIB_STATIC_SOURCE_CACHE) {
+        UINT32 cachedState = facts.fw_state;
+        status = EcStaticWaitRefresh(5000);
+        if(status != ERROR_SUCCESS) {
+            printf("Refresh failed, error: %d\n", status);
+            return status;
+        }
+        EcStaticRead(&facts);
+        printf("Refreshed from the driver, FW state 0x%x %s\n", facts.fw_state,
+               facts.fw_state == cachedState ? "unchanged" : "replaces the cached one");
+    }
+    return ERROR_SUCCESS;
+}
+
+/*
+ * Function: int BatteryCommand
+ *
+ * Description:
+ * Prints the battery status, then every status the EC pushes while the
+ * command runs. The status is read from eclib's copy ten times a second, which
+ * costs no request, and the notification listener keeps it current.
+ *
+ * Parameters:
+ * int argc: The number of command line arguments.
+ * char **argv: ectest.exe -battery [seconds]
+ *
+ * Return Value:
+ * Returns ERROR_SUCCESS if a status was read, otherwise an error code.
+ */
+int BatteryCommand(
+    _In_ int argc,
+    _In_ char ** argv
+    )
+{
+    ECLIB_BATTERY_STATUS battery;
+    ULONGLONG end;
+    UINT32 seen = 0;
+    UINT32 reads = 0;
+    int status;
+
+    end = GetTickCount64() + ((argc > 2) ? strtoul(argv[2], NULL, 0) : 0) * 1000ull;
+    for(;;) {
+        status = EcBatteryGetStatus(&battery);
+        if(status != ERROR_SUCCESS) {
+            printf("EcBatteryGetStatus failed, error: %d\n", status);
+            return status;
+        }
+        reads++;
+        if(battery.sequence != seen) {
+            seen = battery.sequence;
+            printf("State 0x%x rate %u mW capacity %u mWh voltage %u mV, changed 0x%x at %llu us\n",
+                   battery.state, battery.rate_mw, battery.capacity_mwh, battery.voltage_mv,
+                   battery.changed, battery.timestamp_us);
+        }
+        if(GetTickCount64() >= end) {
+            break;
+        }
+        Sleep(100);
+    }
+    printf("%u reads, %llu statuses pushed\n", reads, battery.pushes);
+    return ERROR_SUCCESS;
+}
+
+/*
+ * Function: int RxMapCommand
+ *
+ * Description:
+ * Maps the shared window into the process, RX and the event page read-only,
+ * and prints the RX descriptors or stream offsets and the battery slot as they
+ * lie in it. With a count it then queues that many EC_ASYNC commands, rings
+ * TXDB once per batch and takes every response where the EC wrote it.
+ *
+ * Parameters:
+ * int argc: The number of command line arguments.
+ * char **argv: ectest.exe -rxmap [count]
+ *
+ * Return Value:
+ * Returns ERROR_SUCCESS if the window was mapped and every response read, otherwise an error code.
+ */
+int RxMapCommand(
+    _In_ int argc,
+    _In_ char ** argv
+    )
+{
+    ECLIB_SHARED_VIEWS views;
+    ECLIB_REQUEST *doorbell = NULL;
+    ECRING ring;
+    ECRING_MESSAGE messages[ECRING_SLOTS];
+    UINT16 sequences[ECRING_SLOTS];
+    BYTE command[20] = { 0 };
+    LARGE_INTEGER frequency, before, after;
+    UINT32 count, done = 0, submitted;
+    int status;
+
+    status = EcSharedMap(&views);
+    if(status != ERROR_SUCCESS) {
+        printf("EcSharedMap failed, error: %d\n", status);
+        return status;
+    }
+
+    const volatile BYTE *rx = (const volatile BYTE *)views.rx;
+    const volatile BatteryStatus_t *battery = (const volatile BatteryStatus_t *)views.events;
+    UINT32 layout = (*(const volatile UINT16 *)rx == ECRING_STREAM_VERSION) ? ECRING_LAYOUT_STREAM : ECRING_LAYOUT_SLOTS;
+
+    printf("TX at %p, RX at %p, events at %p\n", views.tx, views.rx, views.events);
+    if(layout == ECRING_LAYOUT_STREAM) {
+        printf("RX stream head 0x%x tail 0x%x\n", *(const volatile UINT32 *)(rx + ECRING_STREAM_HEAD),
+               *(const volatile UINT32 *)(rx + ECRING_STREAM_TAIL));
+    } else {
+        for(UINT32 i = 0; i < ECRING_SLOTS; i++) {
+            UINT64 slot = *(const volatile UINT64 *)(rx + ECRING_SLOT_OFFSET + i * 8);
+            printf("RX slot %u sequence %u length %u fill %u\n", i, ECRING_SLOT_SEQUENCE(slot),
+                   ECRING_SLOT_LENGTH(slot), ECRING_SLOT_FILL(slot));
+        }
+    }
+    printf("Battery sequence %u state 0x%x capacity %u mWh\n", battery->sequence, battery->state, battery->capacity);
+
+    count = (argc > 2) ? strtoul(argv[2], NULL, 0) : 0;
+    if(count == 0) {
+        return ERROR_SUCCESS;
+    }
+
+    status = EcRequestCreate("\\_SB.ECT0.TXDB", &doorbell);
+    if(status == ERROR_SUCCESS) {
+        status = EcRequestAddInteger(doorbell, 0);
+    }
+    if(status == ERROR_SUCCESS) {
+        status = EcRequestAddInteger(doorbell, 0);
+    }
+    if(status == ERROR_SUCCESS) {
+        status = EcRingInitReadOnly(&ring, views.tx, views.rx, layout, EcSharedDoorbell, doorbell) == ECRING_STATUS_SUCCESS ?
+                 ERROR_SUCCESS : ERROR_NOT_READY;
+    }
+    if(status != ERROR_SUCCESS) {
+        printf("Ring setup failed, error: %d\n", status);
+        EcRequestDestroy(doorbell);
+        return status;
+    }
+
+    // The command ASYC queues: LENG 20 and EC_ASYNC in CMDD, the EC fills in the rest
+    command[1] = sizeof(command);
+    for(UINT32 i = 0; i < ECRING_SLOTS; i++) {
+        messages[i].data = command;
+        messages[i].length = sizeof(command);
+    }
+
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&before);
+    while(done < count && status == ERROR_SUCCESS) {
+        UINT32 batch = min(count - done, (UINT32)ECRING_SLOTS);
+        if(EcRingSubmitBatch(&ring, messages, batch, sequences, &submitted) != ECRING_STATUS_SUCCESS || submitted == 0) {
+            printf("EcRingSubmitBatch failed after %u responses\n", done);
+            status = ERROR_IO_DEVICE;
+            break;
+        }
+        for(UINT32 i = 0; i < submitted; i++) {
+            const void *data;
+            UINT16 length;
+            if(EcRingPeek(&ring, sequences[i], &data, &length) != ECRING_STATUS_SUCCESS ||
+               EcRingRelease(&ring, sequences[i]) != ECRING_STATUS_SUCCESS) {
+                printf("No response to sequence %u\n", sequences[i]);
+                status = ERROR_NOT_READY;
+                break;
+            }
+            done++;
+        }
+    }
+    QueryPerformanceCounter(&after);
+
+    printf("%u responses read in place in %.1f us, %llu doorbells\n", done,
+           (double)(after.QuadPart - before.QuadPart) * 1e6 / frequency.QuadPart, ring.stats.doorbells);
+    EcRequestDestroy(doorbell);
+    return status;
+}
+
+#ifdef EC_TEST_NOTIFICATIONS
+/*
+ * Function: int EventsCommand
+ *
+ * Description:
+ * Prints notifications for a while from the main thread, the way an
+ * application with its own event loop would take them: it waits on the
+ * channel's event and drains whatever has arrived without blocking, so no
+ * listener thread is needed. Runs instead of the listener thread, which would
+ * hold the driver's only notification request.
+ *
+ * Parameters:
+ * int argc: The number of command line arguments.
+ * char **argv: ectest.exe -events <seconds>
+ *
+ * Return Value:
+ * Returns ERROR_SUCCESS if the channel ran for the whole time, otherwise an error code.
+ */
+int EventsCommand(
+    _In_ int argc,
+    _In_ char ** argv
+    )
+{
+    ECLIB_NOTIFY_CHANNEL *channel = NULL;
+    ECLIB_NOTIFICATION notifications[16];
+    ULONGLONG now, end;
+    UINT64 wakeups = 0;
+    UINT64 received = 0;
+    UINT32 count;
+    int status;
+
+    if(argc < 3) {
+        printf("Usage: ectest.exe -events <seconds>\n");
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    status = EcNotifyOpen(NULL, 0, &channel);
+    if(status != ERROR_SUCCESS) {
+        printf("EcNotifyOpen failed, error: %d\n", status);
+        return status;
+    }
+
+    end = GetTickCount64() + strtoul(argv[2], NULL, 0) * 1000ull;
+    for(now = GetTickCount64(); now < end; now = GetTickCount64()) {
+        // Anything queued before the channel opened is drained on the first pass
+        do {
+            status = EcNotifyDrain(channel, notifications, ARRAYSIZE(notifications), &count);
+            for(UINT32 i = 0; i < count; i++) {
+                printf("Notification 0x%x class %u, %u coalesced, #%llu\n", notifications[i].event,
+                       notifications[i].priority, notifications[i].coalesced, notifications[i].sequence);
+            }
+            received += count;
+        } while(status == ERROR_MORE_DATA);
+        if(status != ERROR_SUCCESS) {
+            printf("EcNotifyDrain failed, error: %d\n", status);
+            break;
+        }
+
+        if(WaitForSingleObject(EcNotifyGetEvent(channel), (DWORD)(end - now)) == WAIT_OBJECT_0) {
+            wakeups++;
+        }
+    }
+
+    printf("%llu notifications in %llu wakeups\n", received, wakeups);
+    EcNotifyClose(channel);
+    return status;
+}
+#endif // EC_TEST_NOTIFICATIONS
+
+/*
+ * Function: int ReadRxBuffer
+ *
+ * Description:
+ * The ReadRxBuffer function reads the receive buffer from a Kernel-Mode Driver Framework (KMDF) driver.
+ * It sends a request to the driver and receives the buffer data.
+ *
+ * Parameters:
+ * HANDLE hDevice: A handle to the device from which the receive buffer is to be read.
+ *
+ * Return Value:
+ * Returns ERROR_SUCCESS if the receive buffer is successfully read, otherwise returns ERROR_INVALID_PARAMETER.
+ */
+#ifdef EC_TEST_SHARED_BUFFER
+int ReadRxBuffer(
+    _In_ HANDLE hDevice
+    )
+{
+    BOOL bRc;
+    ULONG bytesReturned;
+    ULONG inbuf;
+    RxBufferRsp_t rxrsp;
+
+    printf("\nCalling DeviceIoControl IOCTL_GET_RX_BUFFER\n");
+
+    bRc = DeviceIoControl ( hDevice,
+                            (DWORD) IOCTL_READ_RX_BUFFER,
+                            &inbuf,
+                            sizeof(inbuf),
+                            &rxrsp,
+                            sizeof(rxrsp),
+                            &bytesReturned,
+                            NULL
+                            );
+
+    if ( !bRc )
+    {
+        printf ( "***       Error in DeviceIoControl : %d \n", GetLastError());
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    // Print out notification details
+    printf("***                 data: 0x%llx\n", rxrsp.data);
+
+    return ERROR_SUCCESS;
+}
+#endif // EC_TEST_SHARED_BUFFER
+
+#ifdef EC_TEST_NOTIFICATIONS
+/*
+ * Function: DDWORD NotificationThread
+ *
+ * Description:
+ * The NotificationThread function retrieves a notification from a Kernel-Mode Driver Framework (KMDF) driver.
+ * It sends a request to the driver and receives the notification details.
+ *
+ * Parameters:
+ * LPVOID lpParam: A handle to ready event we notfiy after sending IOCTL to wait for events
+ *
+ * Return Value:
+ * Returns ERROR_SUCCESS if the notification is successfully retrieved, otherwise returns ERROR_INVALID_PARAMETER.
+ */
+DWORD WINAPI NotificationThread(LPVOID lpParam) 
+{
+    UNREFERENCED_PARAMETER(lpParam);
+
+    // Main loop to wait for notifications
+    for(;;) {
+        UINT32 event = WaitForNotification(0);
+        printf("Received Notification Event: 0x%x\n", event);
+
+        // Record notification into the capture if -watch is running
+        EnterCriticalSection(&gCaptureLock);
+        if(gCapture != NULL && event != 0) {
+            EctsAppend(gCapture, gNotifySeries, GetCaptureTimestamp(), event);
+        }
+        LeaveCriticalSection(&gCaptureLock);
+
+        // If we get exit event then break out of loop and exit thread
+        if( WaitForSingleObject(gExitEvent, 0) == WAIT_OBJECT_0) {
+            break;
+        }
+    }
+
+    return 0;
+}
+
+
+/*
+ * Function: HANDLE StartNotificationListener
+ *
+ * Description:
+ * The StartNotificationListener function creates a thread to listen for notifications and returns a handle to the thread.
+ * It creates an event to signal when the thread is ready and waits for the thread to be ready or terminated.
+ *
+ * Parameters:
+ * None
+ *
+ * Return Value:
+ * Returns a handle to the notification listener thread if successful, otherwise returns NULL.
+ */
+HANDLE StartNotificationListener(void)
+{
+    HANDLE hThread;
+    DWORD dwThreadId;
+
+    // Initialize external notification lib
+    int status = InitializeNotification();
+    if(status != ERROR_SUCCESS) {
+        printf("InitializeNotification failed, status: 0x%x\n", status);
+        return NULL;
+    }
+
+    // Create the thread
+    hThread = CreateThread(
+        NULL,                   // Default security attributes
+        0,                      // Default stack size
+        NotificationThread,     // Thread routine
+        NULL,                   // Parameter to thread routine
+        0,                      // Default creation flags
+        &dwThreadId);           // Receive thread identifier
+
+    return hThread;
+}
+#endif // EC_TEST_NOTIFICATIONS
+
+/*
+ * Function: void PrintMetrics
+ *
+ * Description:
+ * Prints the counters and histograms eclib kept while the command ran.
+ *
+ * Parameters:
+ * None
+ *
+ * Return Value:
+ * None
+ */
+void PrintMetrics(void)
+{
+    ECLIB_METRICS metrics;
+
+    if(EcMetricsSnapshot(&metrics, FALSE) != ERROR_SUCCESS) {
+        return;
+    }
+
+    printf("\neclib metrics from %u threads\n", metrics.threads);
+    for(UINT32 i = 0; i < ECLIB_COUNTERS; i++) {
+        printf("  %-12s %12llu\n", EcMetricsCounterName(i), metrics.counters[i]);
+    }
+    printf("  histogram       count   avg us   p50 us   p99 us   max us\n");
+    for(UINT32 h = 0; h < ECLIB_HISTOGRAMS; h++) {
+        const ECLIB_HISTOGRAM *histogram = &metrics.histograms[h];
+        printf("  %-12s %8llu %8llu %8llu %8llu %8llu\n", EcMetricsHistogramName(h), histogram->count,
+               histogram->count ? histogram->sum_us / histogram->count : 0,
+               EcMetricsPercentile(histogram, 50), EcMetricsPercentile(histogram, 99), histogram->max_us);
+    }
+}
+
+
+/*
+ * Function: int main
+ *
+ * Description:
+ * The main function serves as the entry point for the program. It parses the command line arguments,
+ * retrieves a handle to the KMDF driver, and evaluates an ACPI method on the device.
+ *
+ * Parameters:
+ * int argc: The number of command line arguments.
+ * char* argv[]: The array of command line arguments.
+ *
+ * Return Value:
+ * Returns the status of the operations. Returns ERROR_SUCCESS if all operations are successful,
+ * otherwise returns an error code.
+ */
+int __cdecl
+main(
+    _In_ int argc,
+    _In_reads_(argc) char* argv[]
+    )
+{
+
+    HANDLE hThread = NULL;
+    int status = ERROR_SUCCESS;
+
+    InitializeCriticalSection(&gCaptureLock);
+
+    // -metrics may precede any command
+    if(argc > 1 && strcmp(argv[1], "-metrics") == 0) {
+        gPrintMetrics = TRUE;
+        argv++;
+        argc--;
+    }
+
+    // Keep only one instance of the application running
+    // This makes the App & Driver simple by not allowing multiple instances
+    //
+    HANDLE hMutex = CreateMutex(NULL, TRUE, L"Global\\ECTestAppMutex");
+    if (hMutex == NULL) {
+        status = GetLastError();
+        printf("CreateMutex failed, error: %d\n", status);
+        goto CleanUp;
+    }
+
+    if (GetLastError() == ERROR_ALREADY_EXISTS) {
+        printf("Another instance of the application is already running.\n");
+        goto CleanUp;
+    }
+
+    // Conversion only reads the capture
+    if(argc > 1 && strcmp(argv[1], "-trace") == 0) {
+        status = TraceCommand(argc, argv);
+        goto CleanUp;
+    }
+
+#ifdef EC_TEST_NOTIFICATIONS
+    // Takes notifications on the main thread instead of the listener
+    if(argc > 1 && strcmp(argv[1], "-events") == 0) {
+        status = EventsCommand(argc, argv);
+        goto CleanUp;
+    }
+
+    // Create the exit event
+    gExitEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (gExitEvent == NULL) {
+        status = GetLastError();
+        printf("CreateEvent failed, error: %d\n", status);
+        goto CleanUp;
+    }
+
+    // This creates a new thread and blocks until listener is running
+    hThread = StartNotificationListener();
+    if(hThread == NULL) {
+        goto CleanUp;
+    }
+#endif // EC_TEST_NOTIFICATIONS
+
+    // Watch mode runs for a fixed duration and exits
+    if(argc > 1 && strcmp(argv[1], "-watch") == 0) {
+        status = WatchMethods(argc, argv);
+        goto CleanUp;
+    }
+
+    if(argc > 1 && strcmp(argv[1], "-loopback") == 0) {
+        status = LoopbackCommand(argc, argv);
+        goto CleanUp;
+    }
+
+    if(argc > 1 && strcmp(argv[1], "-msg") == 0) {
+        status = MessageCommand(argc, argv);
+        goto CleanUp;
+    }
+
+    if(argc > 1 && strcmp(argv[1], "-share") == 0) {
+        status = ShareCommand(argc, argv);
+        goto CleanUp;
+    }
+
+    if(argc > 1 && strcmp(argv[1], "-var") == 0) {
+        status = VarCommand(argc, argv);
+        goto CleanUp;
+    }
+
+    if(argc > 1 && strcmp(argv[1], "-fan") == 0) {
+        status = FanCommand(argc, argv);
+        goto CleanUp;
+    }
+
+    if(argc > 1 && strcmp(argv[1], "-history") == 0) {
+        status = HistoryCommand(argc, argv);
+        goto CleanUp;
+    }
+
+    if(argc > 1 && strcmp(argv[1], "-subscribe") == 0) {
+        status = SubscribeCommand(argc, argv);
+        goto CleanUp;
+    }
+
+    if(argc > 1 && strcmp(argv[1], "-notify") == 0) {
+        status = NotifyCommand(argc, argv);
+        goto CleanUp;
+    }
+
+    if(argc > 1 && strcmp(argv[1], "-static") == 0) {
+        status = StaticCommand(argc, argv);
+        goto CleanUp;
+    }
+
+    if(argc > 1 && strcmp(argv[1], "-battery") == 0) {
+        status = BatteryCommand(argc, argv);
+        goto CleanUp;
+    }
+
+    if(argc > 1 && strcmp(argv[1], "-rxmap") == 0) {
+        status = RxMapCommand(argc, argv);
+        goto CleanUp;
+    }
+
+    status = ParseCmdline(argc,argv);
+    if(status != ERROR_SUCCESS) {
+        goto CleanUp;
+    }
+
+    // Loop until we hit "q to quit"
+    printf("Waiting for notification press 'q' to quit.\n");
+    int key;
+    for(;;) {
+        key = getchar();
+        if( key == 'q') {
+            break;
+        }
+    }
+
+    printf("You pressed 'q'. Exiting...\n");
+CleanUp:
+
+    // Signal the exit event to stop the thread
+    if(gExitEvent) SetEvent(gExitEvent);
+    if(hThread) CancelSynchronousIo(hThread);
+    if(hThread) WaitForSingleObject(hThread, INFINITE);
+    if(hThread) CleanupNotification();
+    if(hThread) CloseHandle(hThread);
+
+    if(gExitEvent) CloseHandle(gExitEvent);
+    if(hMutex) CloseHandle(hMutex);
+
+    // Notification thread has exited so nothing else can touch the capture
+    DeleteCriticalSection(&gCaptureLock);
+
+    if(gPrintMetrics) {
+        PrintMetrics();
+    }
 
     return status;
 }
@@ -45,4 +45,593 @@ ECLIB_API
 VOID CleanupNotification();
 
 ECLIB_API
-UINT32 WaitForNotification(UINT32 event);
\ No newline at end of file
+UINT32 WaitForNotification(UINT32 event);
+
+// Notification priority classes
+//
+// Every notify value belongs to one of ECLIB_NOTIFY_CLASSES classes, 0 being
+// routine and the default. Notifications that arrive while no one is waiting are
+// queued and WaitForNotification returns them highest class first. Routine ones
+// may be coalesced or dropped when they arrive faster than they are collected.
+// Higher classes are never coalesced and never pushed out by a lower class, a
+// higher class notification is only turned away when the queues are full of its
+// own class or above, and the ones already queued are kept.
+
+#define ECLIB_NOTIFY_CLASSES    4
+
+typedef struct {
+    UINT64 received;
+    UINT64 delivered;
+    UINT64 coalesced;       // Folded into a routine notification already queued
+    UINT64 dropped;         // Pushed out of the full queues, or turned away by them
+    UINT64 latency_avg_us;  // From arrival in the driver to delivery
+    UINT64 latency_max_us;
+    UINT32 queued;
+    UINT32 peak;
+} ECLIB_NOTIFY_STATS;
+
+ECLIB_API int EcNotifySetClass(
+    _In_ UINT8 value,
+    _In_ UINT8 priority
+);
+
+ECLIB_API int EcNotifyGetStats(
+    _Out_writes_(ECLIB_NOTIFY_CLASSES) ECLIB_NOTIFY_STATS *stats,
+    _In_ BOOL reset
+);
+
+// Battery status
+//
+// The EC pushes the battery state, rate, remaining capacity and voltage with
+// the ECLIB_NOTIFY_BATTERY notification whenever one of them changes, and eclib
+// keeps the newest status it has seen. EcBatteryGetStatus answers from that
+// copy without a request instead of evaluating _BST, the first call in the
+// process fetches it from the driver. The copy only stays current while some
+// thread collects notifications with WaitForNotification or drains a
+// notification channel. _BIX data does not change at runtime and is still
+// evaluated on demand. Fails with ERROR_NOT_READY if the EC has not reported a
+// status yet.
+
+#define ECLIB_NOTIFY_BATTERY            0x80
+
+#define ECLIB_BATTERY_DISCHARGING       0x1     // state bits, as _BST returns them
+#define ECLIB_BATTERY_CHARGING          0x2
+#define ECLIB_BATTERY_CRITICAL          0x4
+
+#define ECLIB_BATTERY_CHANGED_STATE     0x1
+#define ECLIB_BATTERY_CHANGED_RATE      0x2
+#define ECLIB_BATTERY_CHANGED_CAPACITY  0x4
+#define ECLIB_BATTERY_CHANGED_VOLTAGE   0x8
+
+typedef struct {
+    UINT32 state;
+    UINT32 rate_mw;
+    UINT32 capacity_mwh;    // Remaining
+    UINT32 voltage_mv;
+    UINT32 changed;         // ECLIB_BATTERY_CHANGED_* by the last update
+    UINT32 sequence;        // Of the EC status slot, grows with every update
+    UINT64 timestamp_us;    // EC time of the last update
+    UINT64 pushes;          // Statuses taken from notifications in this process
+} ECLIB_BATTERY_STATUS;
+
+ECLIB_API int EcBatteryGetStatus(
+    _Out_ ECLIB_BATTERY_STATUS *status
+);
+
+// Notification channels
+//
+// For applications with an event loop of their own, instead of a thread
+// blocked in WaitForNotification. A channel keeps one IOCTL_GET_NOTIFICATION
+// pending on a handle opened for overlapped I/O. Its manual reset event is
+// signalled when the request completes, so it can be waited on along with the
+// application's other handles. A channel opened on a completion port queues a
+// packet with the given key instead and has no event. EcNotifyDrain never
+// blocks: it returns the completed notification and every further one the
+// driver has queued, then leaves a request pending again. Drain once after
+// opening, then whenever the event is signalled, a packet arrives or the last
+// drain returned ERROR_MORE_DATA. Battery notifications drained keep the copy
+// EcBatteryGetStatus reads current.
+//
+// The driver holds one notification request at a time, so a channel replaces
+// WaitForNotification in a process rather than running beside it. A channel
+// must only be drained by one thread at a time. Closing a channel on a port
+// cancels its request, which still queues a packet with the key.
+
+typedef struct _ECLIB_NOTIFY_CHANNEL ECLIB_NOTIFY_CHANNEL;
+
+typedef struct {
+    UINT32 event;           // Notify value
+    UINT16 priority;        // Class of the notify value
+    UINT16 coalesced;       // Further notifications of the value folded into this one
+    UINT64 sequence;        // Notifications the driver had received when it arrived
+    UINT64 timestamp;       // System time it arrived at the driver
+} ECLIB_NOTIFICATION;
+
+ECLIB_API int EcNotifyOpen(
+    _In_opt_ HANDLE port,
+    _In_ ULONG_PTR key,
+    _Out_ ECLIB_NOTIFY_CHANNEL **channel
+);
+
+ECLIB_API HANDLE EcNotifyGetEvent(
+    _In_ ECLIB_NOTIFY_CHANNEL *channel
+);
+
+ECLIB_API int EcNotifyDrain(
+    _In_ ECLIB_NOTIFY_CHANNEL *channel,
+    _Out_writes_to_(max, *count) ECLIB_NOTIFICATION *notifications,
+    _In_ UINT32 max,
+    _Out_ UINT32 *count
+);
+
+ECLIB_API VOID EcNotifyClose(
+    _In_opt_ ECLIB_NOTIFY_CHANNEL *channel
+);
+
+// Shared memory views
+//
+// EcSharedMap maps the shared memory window into the process with IOCTL_MAP_RX
+// the first time it is called and returns the same views afterwards. The RX
+// window and the event page after it are read-only. A ring attached to them
+// with EcRingInitReadOnly (ecring.h) takes responses where the EC wrote them
+// with EcRingPeek and EcRingRelease, instead of copying them out through RXDB
+// or IOCTL_READ_RX_BUFFER. EcSharedDoorbell rings the EC for such a ring
+// through TXDB, its context is a request for \_SB.ECT0.TXDB made with
+// EcRequestCreate and two EcRequestAddInteger. Once the window is mapped,
+// EcBatteryGetStatus reads a status it has not been pushed from the event
+// page. The views last as long as the process, eclib keeps the handle they
+// were mapped on open. IOCTL_MAP_RX is only served by a driver built with
+// EC_TEST_MAP_RX, EcSharedMap fails otherwise.
+
+typedef struct {
+    void *tx;               // TX window, ECRING_WINDOW_SIZE bytes
+    const void *rx;         // RX window, read-only
+    const void *events;     // Event page, holds the battery status slot
+} ECLIB_SHARED_VIEWS;
+
+ECLIB_API int EcSharedMap(
+    _Out_ ECLIB_SHARED_VIEWS *views
+);
+
+ECLIB_API int EcSharedDoorbell(
+    _In_ void *context,
+    _In_ UINT64 argument
+);
+
+// Zero-copy evaluation interface
+//
+// A request is built once with EcRequestCreate and EcRequestAdd* and then
+// evaluated any number of times. Integer arguments can be changed in place with
+// EcRequestSetInteger between calls. The driver writes the ACPI output straight
+// into a caller supplied arena and EcRequestEvaluate describes it with a flat
+// array of views, packages followed by their elements, so no memory is allocated
+// per call. A request must only be used by one thread at a time.
+
+#define ECLIB_MAX_ARGUMENTS     7       // ACPI methods take at most 7 arguments
+#define ECLIB_MAX_REQUEST_SIZE  1024
+#define ECLIB_MAX_PACKAGE_DEPTH 8
+
+typedef struct _ECLIB_REQUEST ECLIB_REQUEST;
+
+typedef struct {
+    UINT16 type;        // ACPI_METHOD_ARGUMENT_* type of the element
+    UINT16 reserved;
+    UINT32 offset;      // Offset of the element data in the arena
+    UINT32 length;      // Length of the element data in bytes
+    UINT32 next;        // Index of the next view that is not part of this element
+} ECLIB_VIEW;
+
+ECLIB_API int EcRequestCreate(
+    _In_z_ const char *method,
+    _Out_ ECLIB_REQUEST **request
+);
+
+ECLIB_API int EcRequestAddInteger(
+    _Inout_ ECLIB_REQUEST *request,
+    _In_ UINT32 value
+);
+
+ECLIB_API int EcRequestAddString(
+    _Inout_ ECLIB_REQUEST *request,
+    _In_z_ const char *value
+);
+
+ECLIB_API int EcRequestAddBuffer(
+    _Inout_ ECLIB_REQUEST *request,
+    _In_reads_bytes_(length) const BYTE *data,
+    _In_ UINT16 length
+);
+
+ECLIB_API int EcRequestSetInteger(
+    _Inout_ ECLIB_REQUEST *request,
+    _In_ UINT32 index,
+    _In_ UINT32 value
+);
+
+ECLIB_API int EcRequestEvaluate(
+    _Inout_ ECLIB_REQUEST *request,
+    _Out_writes_bytes_(arena_len) BYTE *arena,
+    _In_ size_t arena_len,
+    _Out_writes_opt_(view_capacity) ECLIB_VIEW *views,
+    _In_ UINT32 view_capacity,
+    _Out_ UINT32 *view_count
+);
+
+ECLIB_API VOID EcRequestDestroy(
+    _In_opt_ ECLIB_REQUEST *request
+);
+
+// Loopback mode
+//
+// While enabled the driver answers evaluations from registered
+// ACPI_EVAL_OUTPUT_BUFFER_V1 responses instead of calling ACPI, on the same
+// queue, work item and completion path, so benchmarks can separate driver
+// overhead from AML and FF-A time. Unregistered methods fail while enabled.
+
+#define ECLIB_LOOPBACK_ENABLE   0x1     // Answer evaluations from the table
+#define ECLIB_LOOPBACK_CLEAR    0x2     // Drop all registered responses and counters
+
+typedef struct {
+    UINT32 enabled;
+    UINT32 delay_us;    // Synthetic delay added to every evaluation
+    UINT32 entries;     // Registered responses
+    UINT64 hits;        // Evaluations answered from the table
+    UINT64 misses;      // Evaluations of methods without a response
+} ECLIB_LOOPBACK_STATUS;
+
+ECLIB_API int EcLoopbackSet(
+    _In_ UINT32 flags,
+    _In_ UINT32 delay_us,
+    _Out_opt_ ECLIB_LOOPBACK_STATUS *status
+);
+
+ECLIB_API int EcLoopbackAddResponse(
+    _In_z_ const char *method,
+    _In_reads_bytes_(length) const void *response,
+    _In_ size_t length
+);
+
+// Large messages
+//
+// Sends one request of up to ECLIB_MESSAGE_MAX_PAYLOAD bytes to an EC service
+// through the FF-A RX/TX buffers (FFA_MSG_SEND2) and returns its response, so a
+// bulk transfer takes one round trip instead of many chunked direct requests.
+// Fails with ERROR_NOT_SUPPORTED where the platform has no indirect messaging.
+
+#define ECLIB_MESSAGE_MAX_PAYLOAD   0x3fc0
+
+ECLIB_API int EcMessageSend(
+    _In_ const GUID *service,
+    _In_ UINT8 command,
+    _In_reads_bytes_opt_(input_len) const void *input,
+    _In_ size_t input_len,
+    _Out_writes_bytes_opt_(output_len) void *output,
+    _In_ size_t output_len,
+    _Out_ size_t *returned,
+    _Out_opt_ UINT32 *ec_status
+);
+
+// Shared regions
+//
+// Has the driver allocate a physically contiguous region and share it with the
+// EC with FFA_MEM_SHARE through the driver's own RX/TX pair, for clients that
+// need a dedicated zero-copy area sized to their workload. The region stays
+// shared until EcMemReclaim or until the process closes its handle to the
+// driver, only the process that shared it can reclaim it. Fails with
+// ERROR_REQUEST_REFUSED if the EC declines the region.
+
+#define ECLIB_SHARE_MAX_PAGES   256     // 4K pages per region
+
+typedef struct {
+    UINT64 handle;      // FF-A memory handle, passed to EcMemReclaim
+    UINT64 address;     // Physical address of the region
+    UINT32 pages;
+} ECLIB_SHARE;
+
+ECLIB_API int EcMemShare(
+    _In_ UINT32 pages,
+    _Out_ ECLIB_SHARE *share,
+    _Out_opt_ UINT32 *ec_status
+);
+
+ECLIB_API int EcMemReclaim(
+    _In_ UINT64 handle
+);
+
+// Variable cache
+//
+// Keeps the last value and generation of thermal service variables read with
+// EcVarRead. Each read names the generation already held, so while a value is
+// unchanged the EC answers with a status and no payload and the cached copy is
+// returned. A cache can be shared by threads. When full the oldest entry is
+// replaced.
+
+#define ECLIB_VAR_MAX_LENGTH    64
+
+typedef struct _ECLIB_VAR_CACHE ECLIB_VAR_CACHE;
+
+typedef struct {
+    UINT64 reads;           // EcVarRead calls that reached the EC
+    UINT64 not_modified;    // Reads answered from the cache after revalidation
+    UINT64 refreshed;       // Reads that returned a new value
+} ECLIB_VAR_CACHE_STATS;
+
+ECLIB_API int EcVarCacheCreate(
+    _In_ UINT32 capacity,
+    _Out_ ECLIB_VAR_CACHE **cache
+);
+
+ECLIB_API int EcVarRead(
+    _Inout_ ECLIB_VAR_CACHE *cache,
+    _In_ const GUID *variable,
+    _In_ UINT16 instance,
+    _Out_writes_bytes_(value_len) void *value,
+    _In_ size_t value_len,
+    _Out_ size_t *returned,
+    _Out_opt_ BOOL *changed
+);
+
+ECLIB_API int EcVarWrite(
+    _Inout_ ECLIB_VAR_CACHE *cache,
+    _In_ const GUID *variable,
+    _In_ UINT16 instance,
+    _In_reads_bytes_(value_len) const void *value,
+    _In_ size_t value_len
+);
+
+ECLIB_API VOID EcVarCacheGetStats(
+    _In_ ECLIB_VAR_CACHE *cache,
+    _Out_ ECLIB_VAR_CACHE_STATS *stats
+);
+
+ECLIB_API VOID EcVarCacheDestroy(
+    _In_opt_ ECLIB_VAR_CACHE *cache
+);
+
+// Fan profile
+//
+// Writes FAN_ON_TEMP, FAN_RAMP_TEMP, FAN_MAX_TEMP, FAN_MIN_RPM and FAN_MAX_RPM
+// in one transaction and hands the fan to the EC, which runs the curve on its
+// own until FAN_CURRENT_RPM is written again. The host only calls this when the
+// policy changes instead of reading the temperature and writing the fan speed
+// in a loop. Temperatures are in tenths of a Kelvin. If a cache is passed the
+// values written are stored in it.
+
+typedef struct {
+    UINT32 on_temp;         // Fan stopped below
+    UINT32 ramp_temp;       // min_rpm from on_temp up to here
+    UINT32 max_temp;        // Rising linearly to max_rpm here
+    UINT32 min_rpm;
+    UINT32 max_rpm;
+} ECLIB_FAN_PROFILE;
+
+ECLIB_API int EcFanProfileApply(
+    _Inout_opt_ ECLIB_VAR_CACHE *cache,
+    _In_ UINT16 instance,
+    _In_ const ECLIB_FAN_PROFILE *profile
+);
+
+// Sensor history
+//
+// Has the EC sample a temperature sensor into a circular history every
+// period_us, so fast transients are captured without the host waking at the
+// sample rate. EcHistoryRead returns every sample recorded since a sequence
+// number in one message. Pass info.next as the sequence of the following read.
+
+#define ECLIB_HISTORY_MAX_SAMPLES   4070    // Samples returned per read
+
+typedef struct {
+    UINT64 sequence;        // Sequence of the first sample returned
+    UINT64 next;            // Sequence to pass to the next read
+    UINT64 timestamp_us;    // EC time of the first sample
+    UINT64 dropped;         // Samples overwritten before they could be read
+    UINT32 period_us;       // Samples are period_us apart
+    UINT32 count;           // Samples returned
+} ECLIB_HISTORY_INFO;
+
+ECLIB_API int EcHistoryConfigure(
+    _In_ UINT8 sensor,
+    _In_ UINT32 period_us
+);
+
+ECLIB_API int EcHistoryRead(
+    _In_ UINT8 sensor,
+    _In_ UINT64 sequence,
+    _Out_writes_(capacity) UINT32 *samples,
+    _In_ UINT32 capacity,
+    _Out_ ECLIB_HISTORY_INFO *info
+);
+
+// Sampler subscriptions
+//
+// The driver evaluates a registered integer method every period_ms on its own
+// timer. EcSamplerWait blocks until a sample moves more than deadband away from
+// the value the caller last saw, so an idle system wakes no one. An event
+// subscription is signalled instead; EcSamplerSubscribeEvent then returns the
+// latest sample and makes it the new baseline.
+
+typedef struct {
+    UINT64 value;           // Latest sample
+    UINT64 timestamp;       // System time the sample was taken
+    UINT64 samples;         // Evaluations of the method so far
+    UINT32 sampler;
+    UINT32 status;          // NTSTATUS of the latest evaluation
+} ECLIB_SAMPLE;
+
+ECLIB_API int EcSamplerRegister(
+    _In_z_ const char *method,
+    _In_ UINT32 period_ms,
+    _Out_opt_ UINT32 *sampler
+);
+
+ECLIB_API int EcSamplerUnregister(
+    _In_z_ const char *method
+);
+
+ECLIB_API int EcSamplerRead(
+    _In_ UINT32 sampler,
+    _Out_ ECLIB_SAMPLE *sample
+);
+
+ECLIB_API int EcSamplerWait(
+    _In_ UINT32 sampler,
+    _In_ UINT64 value,
+    _In_ UINT64 deadband,
+    _Out_ ECLIB_SAMPLE *sample
+);
+
+ECLIB_API int EcSamplerSubscribeEvent(
+    _In_ UINT32 sampler,
+    _In_ HANDLE event,
+    _In_ UINT64 deadband,
+    _Out_ ECLIB_SAMPLE *sample
+);
+
+ECLIB_API int EcSamplerUnsubscribeEvent(
+    _In_ UINT32 sampler,
+    _In_ HANDLE event
+);
+
+// Static facts
+//
+// Firmware writes a checksummed snapshot of facts that cannot change before the
+// next boot: the firmware state TFWS reports, which partition serves each EC
+// service and what function 0 of each _DSM returns. The first call fetches it
+// from the driver with one request and every later call in the process is
+// served from memory, so a client starting up makes no FF-A round trip or
+// method evaluation for them. Fails with ERROR_NOT_SUPPORTED if firmware wrote
+// no snapshot and ERROR_CRC if it does not check out.
+//
+// The snapshot is also kept in a cache file, by default
+// %LOCALAPPDATA%\ECTest\static.cache, along with the driver version and the
+// firmware state. When the file checks out, was written for the driver version
+// eclib was built against and TFWS still returns its firmware state, the first
+// call is answered from one mapping of it and a single TFWS evaluation instead
+// of reading the snapshot, and a thread pool callback fetches the snapshot from
+// the driver afterwards. It replaces the facts if the firmware state or driver version
+// moved on and rewrites the file. source tells which of the two the facts
+// came from.
+
+#define ECLIB_STATIC_MAX_SERVICES   4
+#define ECLIB_STATIC_MAX_DSM        4
+
+#define ECLIB_STATIC_SOURCE_DRIVER  0   // Fetched from the driver, or checked against it
+#define ECLIB_STATIC_SOURCE_CACHE   1   // Loaded from the cache file, refresh pending
+
+typedef struct {
+    GUID service;
+    UINT16 partition;       // FF-A ID of the partition serving it
+} ECLIB_STATIC_SERVICE;
+
+typedef struct {
+    GUID uuid;
+    char device[5];         // ACPI name under \_SB, terminated
+    UINT32 revision;
+    UINT64 functions;       // Bitmask returned by function 0
+} ECLIB_STATIC_DSM;
+
+typedef struct {
+    UINT32 version;         // Of the snapshot firmware wrote
+    UINT32 fw_state;        // As TFWS returns it, 0 if the EC did not answer at boot
+    UINT32 service_count;
+    UINT32 dsm_count;
+    UINT32 source;          // ECLIB_STATIC_SOURCE_*
+    UINT32 driver_version;  // EC_DRIVER_VERSION of the driver the facts were fetched through
+    ECLIB_STATIC_SERVICE services[ECLIB_STATIC_MAX_SERVICES];
+    ECLIB_STATIC_DSM dsm[ECLIB_STATIC_MAX_DSM];
+} ECLIB_STATIC;
+
+ECLIB_API int EcStaticRead(
+    _Out_ ECLIB_STATIC *facts
+);
+
+ECLIB_API int EcStaticGetFwState(
+    _Out_ UINT32 *fw_state
+);
+
+ECLIB_API int EcStaticGetDsmFunctions(
+    _In_z_ const char *device,
+    _In_ const GUID *uuid,
+    _Out_ UINT64 *functions
+);
+
+ECLIB_API int EcStaticGetPartition(
+    _In_ const GUID *service,
+    _Out_ UINT16 *partition
+);
+
+// Path of the cache file, NULL to stop using one. Takes effect on the next load
+// or refresh.
+ECLIB_API int EcStaticSetCacheFile(
+    _In_opt_z_ const char *path
+);
+
+// Waits for the refresh started by a load from the cache file, returns
+// ERROR_SUCCESS at once if none is pending and ERROR_TIMEOUT if it did not
+// finish in time. Otherwise returns the status of the refresh.
+ECLIB_API int EcStaticWaitRefresh(
+    _In_ DWORD timeout_ms
+);
+
+// Metrics
+//
+// eclib counts its own requests to the driver, their errors and bytes, cache
+// hits and how long requests and waits for notifications and samples take.
+// Each thread updates a shard of its own, created on its first update, and
+// EcMetricsSnapshot adds the shards up when asked. When a thread exits its
+// counts are folded into a total of exited threads and its shard goes to the
+// next new thread, so thread churn does not grow the shards. Nothing on the request path writes a cache line
+// another thread writes. A snapshot taken while other threads update their
+// shards sees each update or not, never part of one.
+//
+// Histograms count microseconds in power of two buckets: bucket 0 holds 0us
+// and bucket i values from 2^(i-1) to 2^i - 1, the last also everything above.
+
+#define ECLIB_COUNTER_CALLS         0   // Requests sent to the driver
+#define ECLIB_COUNTER_ERRORS        1   // Requests the driver failed
+#define ECLIB_COUNTER_BYTES_IN      2   // Bytes sent with requests
+#define ECLIB_COUNTER_BYTES_OUT     3   // Bytes the driver returned
+#define ECLIB_COUNTER_CACHE_HITS    4   // Variables not modified, static facts from memory or the cache file, battery status from memory or the event page
+#define ECLIB_COUNTER_CACHE_MISSES  5   // Variables refreshed, static facts or battery status fetched from the driver
+#define ECLIB_COUNTER_WAITS         6   // Notification and sampler waits
+#define ECLIB_COUNTERS              7
+
+#define ECLIB_HISTOGRAM_CALL_US     0   // Requests other than waits
+#define ECLIB_HISTOGRAM_WAIT_US     1   // Notification and sampler waits
+#define ECLIB_HISTOGRAMS            2
+#define ECLIB_HISTOGRAM_BUCKETS     32
+
+typedef struct {
+    UINT64 count;
+    UINT64 sum_us;
+    UINT64 max_us;          // Since the process started, resets do not clear it
+    UINT64 buckets[ECLIB_HISTOGRAM_BUCKETS];
+} ECLIB_HISTOGRAM;
+
+typedef struct {
+    UINT64 counters[ECLIB_COUNTERS];
+    ECLIB_HISTOGRAM histograms[ECLIB_HISTOGRAMS];
+    UINT32 threads;         // Running threads that have used eclib
+} ECLIB_METRICS;
+
+// Counts since the process started or the last reset, which only moves the
+// baseline later snapshots are taken against
+ECLIB_API int EcMetricsSnapshot(
+    _Out_ ECLIB_METRICS *metrics,
+    _In_ BOOL reset
+);
+
+ECLIB_API const char *EcMetricsCounterName(
+    _In_ UINT32 counter
+);
+
+ECLIB_API const char *EcMetricsHistogramName(
+    _In_ UINT32 histogram
+);
+
+// Upper bound in microseconds of the bucket holding the given percentile, 0 if
+// the histogram is empty
+ECLIB_API UINT64 EcMetricsPercentile(
+    _In_ const ECLIB_HISTOGRAM *histogram,
+    _In_ UINT32 percent
+);
@@ -0,0 +1,256 @@
+/*
+MIT License
+
+Copyright (c) 2025 Open Device Partnership
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Host side of the ASYNC slot queues in the shared memory window, the same
+// layout QTXB and RXDB use in ectest.asl.
+//
+// The TX and RX windows each start with a header holding ECRING_SLOTS 64-bit
+// slot descriptors, followed by ECRING_SLOTS entries of ECRING_ENTRY_SIZE bytes
+// from ECRING_ENTRY_OFFSET. A descriptor holds the sequence in bits 0-15, the
+// entry length in bits 16-31 and ECRING_SLOT_VALID, a sequence of 0 marks the
+// slot free. The host fills TX slots and the EC frees them once consumed, the
+// EC fills RX slots with the responses and the host frees them.
+//
+// ASYC in ectest.asl rings the EC with an EC_ASYNC direct request for every
+// entry it queues. Here queueing and ringing are separate: EcRingSubmitBatch
+// fills as many TX slots as it can and announces all of them with a single
+// doorbell carrying the count and the highest sequence queued. The EC only
+// consumes slots up to that sequence, so entries queued after a doorbell wait
+// for the next one.
+//
+// The same windows can instead hold a byte stream, selected by a version of
+// ECRING_STREAM_VERSION in the first 16 bits of each window (TVER and RVER).
+// Records are packed back to back in the data area from ECRING_STREAM_DATA,
+// each an 8-byte header with the length in bits 0-15, the sequence in bits
+// 16-31 and ECRING_STREAM_CONSUMED, followed by the payload padded to 8 bytes.
+// A record never wraps: when it does not fit before the end of the data area
+// a header with length ECRING_STREAM_WRAP is written and the record goes at
+// offset 0. The producer publishes records by advancing the head, the consumer
+// frees them by advancing the tail, and head == tail means the stream is
+// empty. Records can be taken out of order, they are marked consumed and the
+// tail moves once every record before it is. A doorbell has the EC take every
+// record published when it arrives. A 20-byte ASYNC command takes 32
+// bytes, so a window holds over a hundred in flight instead of eight.
+//
+// A consumer can also take responses from an RX window it maps read-only, as
+// IOCTL_MAP_RX maps it into a client process. It cannot free RX slots or move
+// the RX stream tail there, so EcRingInitReadOnly sets ECRING_TX_RX_READONLY in
+// the TX flags word (TRS0) and the consumer publishes its releases in the TX
+// window instead: the descriptor of each RX slot it took at
+// ECRING_RX_RELEASE_OFFSET, or the RX stream tail at ECRING_STREAM_RX_TAIL.
+// Before filling RX the EC calls EcRingApplyReleases, which frees those slots
+// and moves the tail, so the RX window keeps a single writer. The EC stamps RX
+// descriptors with a count of fills of their slot, so a released descriptor
+// never matches a later response. EcRingPeek returns a response where it lies
+// in the window and EcRingRelease hands its space back, so it is never copied.
+//
+// A ring must only be used by one thread at a time, and sequences are not
+// shared with the SEQN counter of ectest.asl. This header has no Windows
+// dependencies so the ring can be built on any host.
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef _WIN32
+#define ECRING_API __declspec(dllexport)
+#else
+#define ECRING_API
+#endif
+
+#define ECRING_WINDOW_SIZE      0x1000      // Each of TX and RX
+#define ECRING_SLOTS            8
+#define ECRING_SLOT_OFFSET      0x8         // Descriptors follow TVER, TCNT and TRS0
+#define ECRING_ENTRY_OFFSET     0x100
+#define ECRING_ENTRY_SIZE       256
+#define ECRING_SLOT_VALID       (1ull << 32)
+#define ECRING_TX_FLAGS         0x4         // TRS0
+#define ECRING_TX_RX_READONLY   0x1         // Releases of RX space are in the TX window
+#define ECRING_RX_RELEASE_OFFSET 0x48       // After the TX descriptors, one per RX slot
+
+// Stream layout, head and tail are byte offsets into the data area and sit on
+// separate cache lines as they are written by different sides
+#define ECRING_STREAM_VERSION       0x200
+#define ECRING_STREAM_HEAD          0x8
+#define ECRING_STREAM_RX_TAIL       0x10    // In the TX window, beside the head the host writes
+#define ECRING_STREAM_TAIL          0x40
+#define ECRING_STREAM_DATA          0x80
+#define ECRING_STREAM_SIZE          (ECRING_WINDOW_SIZE - ECRING_STREAM_DATA)
+#define ECRING_STREAM_MAX_PAYLOAD   1024
+#define ECRING_STREAM_MAX_BATCH     255     // BCNT is a byte
+#define ECRING_STREAM_WRAP          0xFFFF
+#define ECRING_STREAM_CONSUMED      (1ull << 32)
+#define ECRING_STREAM_UNITS         (ECRING_STREAM_SIZE / 8)
+
+#define ECRING_STREAM_RECORD(seq, length)   (((uint64_t)(uint16_t)(seq) << 16) | (uint16_t)(length))
+#define ECRING_STREAM_RECORD_SIZE(length)   (8 + (((uint32_t)(length) + 7) & ~7u))
+// Space a put may need, a wrap can waste up to a record less its header
+#define ECRING_STREAM_NEED(length)          (2 * ECRING_STREAM_RECORD_SIZE(length) - 8)
+
+#define ECRING_LAYOUT_SLOTS     0
+#define ECRING_LAYOUT_STREAM    1
+
+#define ECRING_SLOT(seq, length)    (ECRING_SLOT_VALID | ((uint64_t)(length) << 16) | (uint16_t)(seq))
+#define ECRING_SLOT_SEQUENCE(slot)  ((uint16_t)(slot))
+#define ECRING_SLOT_LENGTH(slot)    ((uint16_t)((slot) >> 16))
+// RX descriptor stamped with the number of times the EC filled its slot
+#define ECRING_SLOT_FILLED(seq, length, fill) \
+    (ECRING_SLOT(seq, length) | ((uint64_t)((fill) & 0xFFFFFF) << 40))
+#define ECRING_SLOT_FILL(slot)      ((uint32_t)((slot) >> 40))
+
+// The doorbell is an EC_ASYNC direct request to the EC management service. x4
+// holds the command, BSQN and BCNT at the byte offsets ASYC uses in its FFAC
+// buffer. A count of 0 comes from ASYC, which announces a single entry.
+#define ECRING_CMD_ASYNC        0x0
+#define ECRING_DOORBELL(seq, count) \
+    (ECRING_CMD_ASYNC | ((uint64_t)(uint16_t)(seq) << 8) | ((uint64_t)(uint8_t)(count) << 24))
+#define ECRING_DOORBELL_SEQUENCE(x4)    ((uint16_t)((x4) >> 8))
+#define ECRING_DOORBELL_COUNT(x4)       ((uint8_t)((x4) >> 24))
+
+#define ECRING_STATUS_SUCCESS           0
+#define ECRING_STATUS_INVALID_PARAMETER -1
+#define ECRING_STATUS_FULL              -2  // No free TX slot
+#define ECRING_STATUS_NOT_READY         -3  // No response with that sequence yet
+#define ECRING_STATUS_DOORBELL_FAILED   -4
+#define ECRING_STATUS_CORRUPT           -5  // Stream head, tail or a record is out of range
+
+// Performs the EC_ASYNC direct request with x4 set to argument, returns 0 on success
+typedef int (*ECRING_DOORBELL_CALLBACK)(void *context, uint64_t argument);
+
+typedef struct {
+    const void *data;
+    uint16_t length;        // At most ECRING_ENTRY_SIZE
+} ECRING_MESSAGE;
+
+typedef struct {
+    uint64_t queued;        // Entries written to TX slots
+    uint64_t doorbells;     // Doorbells rung
+    uint64_t received;      // Responses taken from RX slots
+    uint64_t full;          // Submissions that found no free TX slot
+} ECRING_STATS;
+
+typedef struct {
+    volatile uint8_t *tx;
+    volatile uint8_t *rx;
+    ECRING_DOORBELL_CALLBACK doorbell;
+    void *context;
+    uint32_t layout;        // ECRING_LAYOUT_*
+    uint16_t sequence;      // Last sequence used, 0 is never used
+    uint16_t readOnly;      // The RX window is never written
+    uint32_t rxTail;        // RX stream tail of a read-only ring
+    uint64_t rxConsumed[(ECRING_STREAM_UNITS + 63) / 64]; // Records taken ahead of rxTail, by 8-byte unit
+    ECRING_STATS stats;
+} ECRING;
+
+ECRING_API void EcRingInit(
+    ECRING *ring,
+    void *tx,
+    void *rx,
+    ECRING_DOORBELL_CALLBACK doorbell,
+    void *context
+);
+
+ECRING_API void EcRingInitStream(
+    ECRING *ring,
+    void *tx,
+    void *rx,
+    ECRING_DOORBELL_CALLBACK doorbell,
+    void *context
+);
+
+ECRING_API int EcRingInitReadOnly(
+    ECRING *ring,
+    void *tx,
+    const void *rx,
+    uint32_t layout,
+    ECRING_DOORBELL_CALLBACK doorbell,
+    void *context
+);
+
+ECRING_API int EcRingSubmit(
+    ECRING *ring,
+    const void *data,
+    uint16_t length,
+    uint16_t *sequence
+);
+
+ECRING_API int EcRingSubmitBatch(
+    ECRING *ring,
+    const ECRING_MESSAGE *messages,
+    uint32_t count,
+    uint16_t *sequences,
+    uint32_t *submitted
+);
+
+ECRING_API int EcRingReceive(
+    ECRING *ring,
+    uint16_t sequence,
+    void *buffer,
+    uint16_t size,
+    uint16_t *length
+);
+
+ECRING_API int EcRingPeek(
+    ECRING *ring,
+    uint16_t sequence,
+    const void **data,
+    uint16_t *length
+);
+
+ECRING_API int EcRingRelease(
+    ECRING *ring,
+    uint16_t sequence
+);
+
+// EC side of a read-only consumer, frees what it released in the TX window
+ECRING_API int EcRingApplyReleases(
+    void *tx,
+    void *rx
+);
+
+// Either side of a stream window, also used by the simulated EC
+ECRING_API void EcRingStreamFormat(
+    void *window
+);
+
+ECRING_API uint32_t EcRingStreamFree(
+    const void *window
+);
+
+ECRING_API int EcRingStreamPut(
+    void *window,
+    uint16_t sequence,
+    const void *data,
+    uint16_t length
+);
+
+ECRING_API int EcRingStreamGet(
+    void *window,
+    uint16_t sequence,
+    void *buffer,
+    uint16_t size,
+    uint16_t *length,
+    uint16_t *found
+);
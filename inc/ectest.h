@@ -1,20 +1,351 @@
 
-// Define IOCTL's and structures shared between KMDF and Application
+#pragma once
+
+// Define IOCTL's and structures shared between KMDF and Application. The low two
+// bits of a code are its transfer method and KMDF will not retrieve the buffers of
+// a METHOD_NEITHER request, so codes are spelled out CTL_CODE values that decode
+// to METHOD_BUFFERED or a direct method
 #define IOCTL_GET_NOTIFICATION 0x1
 #define IOCTL_READ_RX_BUFFER 0x2
+#define IOCTL_SET_LOOPBACK 0x0022200C      // CTL_CODE(FILE_DEVICE_UNKNOWN, 0x803, METHOD_BUFFERED, FILE_ANY_ACCESS)
+#define IOCTL_ADD_LOOPBACK_RESPONSE 0x4
+#define IOCTL_FFA_MSG_SEND2 0x5
+#define IOCTL_FFA_MEM_SHARE 0x6
+#define IOCTL_FFA_MEM_RECLAIM 0x0022201C   // CTL_CODE(FILE_DEVICE_UNKNOWN, 0x807, METHOD_BUFFERED, FILE_ANY_ACCESS)
+#define IOCTL_SAMPLER_REGISTER 0x8
+#define IOCTL_SAMPLER_SUBSCRIBE 0x9
+#define IOCTL_NOTIFY_CLASSES 0xA
+#define IOCTL_GET_STATIC 0x0022202C        // CTL_CODE(FILE_DEVICE_UNKNOWN, 0x80B, METHOD_BUFFERED, FILE_ANY_ACCESS)
+#define IOCTL_GET_VERSION 0xC
+#define IOCTL_GET_BATTERY 0xD
+#define IOCTL_MAP_RX 0x0022E038            // CTL_CODE(FILE_DEVICE_UNKNOWN, 0x80E, METHOD_BUFFERED, FILE_READ_ACCESS | FILE_WRITE_ACCESS)
 
 #define SBSAQEMU_SHARED_MEM_BASE 0x10060000000
 
+// The EC pushes battery status changes instead of having _BST polled. It writes
+// the status into a slot in the third page of the region shared with it, after
+// the TX and RX windows, and raises EC_NOTIFY_BATTERY. The driver copies the slot
+// into the notification, so a client holding the last one delivered knows the
+// current status without asking. IOCTL_GET_BATTERY reads the slot at any time.
+// The EC makes sequence odd while it writes and even once done, a reader that
+// sees it odd or changed across the copy reads again. _BIX data does not change
+// at runtime and is still evaluated on demand
+#define EC_BATTERY_STATUS_BASE (SBSAQEMU_SHARED_MEM_BASE + 0x2000)
+#define EC_NOTIFY_BATTERY 0x80              // ACPI battery status change
+
+#define EC_BATTERY_CHANGED_STATE    0x1
+#define EC_BATTERY_CHANGED_RATE     0x2
+#define EC_BATTERY_CHANGED_CAPACITY 0x4
+#define EC_BATTERY_CHANGED_VOLTAGE  0x8
+
+typedef struct {
+    UINT32 sequence;    // Bumped twice per update, 0 until the EC first writes
+    UINT32 changed;     // EC_BATTERY_CHANGED_* since the previous notification
+    UINT32 state;       // _BST state bits: 1 discharging, 2 charging, 4 critical
+    UINT32 rate;        // mW
+    UINT32 capacity;    // Remaining capacity, mWh
+    UINT32 voltage;     // mV
+    UINT64 timestamp;   // EC time of the update in microseconds
+} BatteryStatus_t;
+
 typedef struct {
     UINT64 count;
     UINT64 timestamp;
     UINT32  lastevent;
+    UINT16 priority;        // Class of lastevent
+    UINT16 coalesced;       // Further notifications of lastevent folded into this one
+    BatteryStatus_t battery; // Only set when lastevent is EC_NOTIFY_BATTERY
 } NotificationRsp_t;
 
 typedef struct {
     UINT8 type;
 } NotificationReq_t;
 
+// Notifications wait in one queue per priority class until IOCTL_GET_NOTIFICATION
+// collects them, highest class first. Notify values map to a class through a table
+// set with IOCTL_NOTIFY_CLASSES, values not in the table are routine. A routine
+// notification already queued with the same value is coalesced into it. Higher
+// classes are never coalesced. When the queues are full the oldest entry of the
+// lowest class below the new notification is dropped, routine first, so a burst
+// of lower classes cannot push out a higher one. A routine notification finding
+// only routine entries drops the oldest, a higher class one finding none below it
+// is turned away and counted as dropped, the entries already queued are kept.
+#define NOTIFY_MAX_CLASSES 4
+#define NOTIFY_MAX_VALUES 256
+#define NOTIFY_QUEUE_DEPTH 32       // Shared by all classes
+#define NOTIFY_CLASS_ROUTINE 0
+
+#define NOTIFY_CLASSES_SET   0x1    // Replace the table with classes
+#define NOTIFY_CLASSES_RESET 0x2    // Clear the statistics
+#define NOTIFY_CLASSES_FLUSH 0x4    // Drop every queued notification
+
+typedef struct {
+    UINT32 flags;
+    UINT32 reserved;
+    UINT8 classes[NOTIFY_MAX_VALUES];
+} NotifyClassesReq_t;
+
+typedef struct {
+    UINT64 received;
+    UINT64 delivered;
+    UINT64 coalesced;
+    UINT64 dropped;         // Pushed out by a higher class or a newer routine one, or turned away
+    UINT64 latency_total;   // Microseconds from arrival to delivery, summed
+    UINT64 latency_max;
+    UINT32 queued;
+    UINT32 peak;            // Deepest the queue has been
+} NotifyClassStats_t;
+
+typedef struct {
+    UINT8 classes[NOTIFY_MAX_VALUES];
+    NotifyClassStats_t stats[NOTIFY_MAX_CLASSES];
+} NotifyClassesRsp_t;
+
 typedef struct {
     UINT64 data;
 } RxBufferRsp_t;
+
+// IOCTL_MAP_RX maps the shared memory window into the calling process, so a ring
+// (inc/ecring.h) takes responses straight out of the RX window instead of a
+// UINT64 at a time through IOCTL_READ_RX_BUFFER. The RX window and the event
+// page after it, which holds the battery slot, are mapped read-only and the
+// process can neither make them writable nor unmap them. The TX window is mapped
+// read-write, the host fills it and publishes its RX releases there. The views
+// belong to the handle, a repeat request on it returns the same pair and they
+// are unmapped when its last handle is closed. The handle must be opened for
+// reading and writing, and the TX view is only writable when it was. Only served
+// when the driver is built with EC_TEST_MAP_RX, which also requires the device to
+// carry an SDDL that grants access to SYSTEM and administrators only
+#define EC_SHARED_RX_BASE (SBSAQEMU_SHARED_MEM_BASE + 0x1000)
+#define EC_MAP_TX_LENGTH 0x1000
+#define EC_MAP_RX_LENGTH 0x2000             // RX window and event page
+
+typedef struct {
+    UINT64 tx;          // Address of the TX view in the caller
+    UINT64 rx;          // Address of the read-only RX view, the event page follows
+    UINT32 txLength;
+    UINT32 rxLength;
+} MapRxRsp_t;
+
+// IOCTL_GET_STATIC returns the EC_STATIC snapshot firmware wrote at boot, see
+// SbsaQemuPlatformDxe/EcStaticSnapshot.h. It fails with STATUS_NOT_SUPPORTED if
+// there is none and STATUS_DEVICE_DATA_ERROR if it does not check out
+
+// IOCTL_GET_VERSION returns the EC_DRIVER_VERSION the driver was built with.
+// Bump it whenever an IOCTL code or a request or response layout in this file
+// changes, so data clients keep across driver updates can be told apart.
+#define EC_DRIVER_VERSION 0x00010004
+
+typedef struct {
+    UINT32 version;
+} VersionRsp_t;
+
+// Loopback mode answers IOCTL_ACPI_EVAL_METHOD_EX from a table of canned
+// ACPI_EVAL_OUTPUT_BUFFER_V1 responses instead of calling ACPI
+#define LOOPBACK_MAX_ENTRIES 16
+#define LOOPBACK_MAX_NAME 64
+#define LOOPBACK_MAX_RESPONSE 256
+
+#define LOOPBACK_ENABLE 0x1   // Answer evaluations from the table
+#define LOOPBACK_CLEAR  0x2   // Drop all registered responses
+
+typedef struct {
+    UINT32 flags;
+    UINT32 delay;       // Synthetic delay per evaluation in microseconds
+} LoopbackReq_t;
+
+typedef struct {
+    UINT32 enabled;
+    UINT32 delay;
+    UINT32 entries;
+    UINT32 reserved;
+    UINT64 hits;
+    UINT64 misses;
+} LoopbackRsp_t;
+
+typedef struct {
+    char method[LOOPBACK_MAX_NAME];     // Full path as passed in MethodName
+    UINT32 length;                      // Bytes of response used
+    UINT8 response[LOOPBACK_MAX_RESPONSE];
+} LoopbackResponseReq_t;
+
+// Large messages go through the FF-A RX/TX buffer pair in the reserved region and
+// are signalled with FFA_MSG_SEND2, so one request can carry up to EC_MSG_MAX_PAYLOAD
+// bytes instead of the 112 bytes of a direct request
+#define SBSAQEMU_MSG_TX_BASE 0x10060080000
+#define SBSAQEMU_MSG_RX_BASE 0x10060090000
+#define EC_MSG_PAGES 4                                  // Size of each buffer in 4K pages
+#define EC_MSG_MAX_PAYLOAD (EC_MSG_PAGES * 0x1000 - 0x40) // Less the FF-A and EC headers
+#define EC_HOST_VMID 0x0                                // FF-A ID of the OS
+#define EC_SERVICE_VMID 0x8002                          // FF-A ID of the EC partition
+
+typedef struct {
+    UINT8 service[16];  // Service UUID in GUID byte order
+    UINT8 command;
+    UINT8 reserved[3];
+    UINT32 length;      // Payload bytes following this header
+} MsgSend2Req_t;
+
+typedef struct {
+    UINT32 status;      // Status returned by the EC service
+    UINT32 length;      // Payload bytes following this header, or needed if the buffer was too small
+} MsgSend2Rsp_t;
+
+// Commands of the EC management service that take large messages
+#define EC_MSG_CMD_ECHO 0x20        // Return the payload unchanged
+#define EC_MSG_CMD_READ_BULK 0x21   // MsgBulkReq_t in, bytes of EC data out
+#define EC_MSG_CMD_WRITE_BULK 0x22  // MsgBulkReq_t followed by the bytes to write
+#define EC_MSG_CMD_MAP_SHARE 0x23   // FF-A retrieve descriptor for a region shared with FFA_MEM_SHARE
+#define EC_MSG_CMD_UNMAP_SHARE 0x24 // UINT64 handle, the EC relinquishes the region
+
+// Status returned by the service in MsgSend2Rsp_t
+#define EC_MSG_STATUS_SUCCESS 0x0
+#define EC_MSG_STATUS_UNKNOWN_SERVICE 0x1
+#define EC_MSG_STATUS_UNKNOWN_COMMAND 0x2
+#define EC_MSG_STATUS_INVALID_PARAMETER 0x3
+#define EC_MSG_STATUS_NOT_MODIFIED 0x4      // Conditional read of a value that has not changed, no payload
+
+typedef struct {
+    UINT32 offset;      // Offset in the EC data region
+    UINT32 length;
+} MsgBulkReq_t;
+
+// Commands of the EC thermal service 31f56da7-593c-4d72-a4b3-8fc7171ac073 that take
+// large messages. Every variable carries a generation the EC bumps whenever its
+// value changes, never reused and never 0. A read naming the generation the caller
+// already holds gets EC_MSG_STATUS_NOT_MODIFIED and no payload while it is current.
+#define EC_MSG_CMD_GET_VAR 0x25     // MsgVarReq_t in, MsgVarRsp_t and the value out
+#define EC_MSG_CMD_SET_VAR 0x26     // MsgVarReq_t and the value in, MsgVarRsp_t out
+#define EC_VAR_MAX_LENGTH 64
+
+typedef struct {
+    UINT8 variable[16]; // Variable UUID in GUID byte order
+    UINT16 instance;
+    UINT16 length;      // Bytes of value expected or supplied
+    UINT32 reserved;
+    UINT64 generation;  // GET_VAR only: generation held by the caller, 0 to always read
+} MsgVarReq_t;
+
+typedef struct {
+    UINT64 generation;  // Generation of the value returned or written
+    UINT16 length;      // Bytes of value following this header
+    UINT16 reserved[3];
+} MsgVarRsp_t;
+
+// The EC samples a temperature sensor into a circular history at a configured
+// period and the host fetches everything since a sequence number in one message,
+// instead of waking to poll _TMP at the sample rate
+#define EC_MSG_CMD_HISTORY_CONFIG 0x27  // MsgHistoryConfigReq_t in, nothing out
+#define EC_MSG_CMD_HISTORY_READ 0x28    // MsgHistoryReadReq_t in, MsgHistoryReadRsp_t and UINT32 samples out
+
+typedef struct {
+    UINT8 sensor;       // Temp sensor ID, as TZID in thermal.asl
+    UINT8 reserved[3];
+    UINT32 period_us;   // Sampling period, 0 stops sampling
+} MsgHistoryConfigReq_t;
+
+typedef struct {
+    UINT8 sensor;
+    UINT8 reserved[3];
+    UINT32 max_samples; // At most EC_HISTORY_MAX_SAMPLES are returned
+    UINT64 sequence;    // First sample wanted, the sequence returned by the previous read
+} MsgHistoryReadReq_t;
+
+typedef struct {
+    UINT64 sequence;    // Sequence of the first sample returned
+    UINT64 next;        // Sequence to ask for next time
+    UINT64 timestamp;   // EC time of the first sample in microseconds
+    UINT64 dropped;     // Samples between the requested sequence and the first returned that were overwritten
+    UINT32 period_us;   // Samples are period_us apart
+    UINT32 count;       // UINT32 samples following this header, in tenths of a Kelvin
+} MsgHistoryReadRsp_t;
+
+#define EC_HISTORY_MAX_SAMPLES ((EC_MSG_MAX_PAYLOAD - sizeof(MsgHistoryReadRsp_t)) / sizeof(UINT32))
+
+// Writes the five variables of a fan curve in one transaction and hands the fan to
+// the EC, which then sets FAN_CURRENT_RPM from the curve on its own: stopped below
+// on_temp, min_rpm up to ramp_temp, linear up to max_rpm at max_temp and max_rpm
+// above. Nothing is written unless on_temp < ramp_temp < max_temp and
+// 0 < min_rpm <= max_rpm. A later SET_VAR of FAN_CURRENT_RPM takes the fan back
+#define EC_MSG_CMD_SET_FAN_PROFILE 0x29 // MsgFanProfileReq_t in, MsgFanProfileRsp_t out
+#define EC_FAN_PROFILE_VARS 5
+
+typedef struct {
+    UINT16 instance;
+    UINT16 reserved;
+    UINT32 on_temp;     // FAN_ON_TEMP, tenths of a Kelvin
+    UINT32 ramp_temp;   // FAN_RAMP_TEMP
+    UINT32 max_temp;    // FAN_MAX_TEMP
+    UINT32 min_rpm;     // FAN_MIN_RPM
+    UINT32 max_rpm;     // FAN_MAX_RPM
+} MsgFanProfileReq_t;
+
+typedef struct {
+    UINT64 generation[EC_FAN_PROFILE_VARS]; // Of each variable after the write, in request order
+} MsgFanProfileRsp_t;
+
+// Buffers the driver allocates and shares with the EC at runtime through its
+// own RX/TX pair. A region belongs to the handle it was shared on and only that
+// handle can reclaim it with IOCTL_FFA_MEM_RECLAIM, the regions a handle still
+// holds are reclaimed when its last handle is closed or the device goes away
+#define EC_SHARE_MAX_REGIONS 8
+#define EC_SHARE_MAX_PAGES 256
+
+typedef struct {
+    UINT32 pages;       // 4K pages to allocate and share
+    UINT32 reserved;
+} MemShareReq_t;
+
+typedef struct {
+    UINT64 handle;      // FF-A memory handle, passed to IOCTL_FFA_MEM_RECLAIM
+    UINT64 address;     // Physical address of the region
+    UINT32 pages;
+    UINT32 status;      // EC_MSG_STATUS_* returned by the EC when it mapped the region
+} MemShareRsp_t;
+
+typedef struct {
+    UINT64 handle;
+} MemReclaimReq_t;
+
+// The driver evaluates registered integer methods on its own timer. A subscriber
+// names the value it last saw and a deadband, and its request is completed, or its
+// event signalled, only once a sample moves further than the deadband from it.
+// Subscriptions belong to the handle they were made on and are dropped, pended
+// requests cancelled and events released, when its last handle is closed
+#define SAMPLER_MAX_METHODS 8
+#define SAMPLER_MAX_SUBSCRIBERS 16
+#define SAMPLER_MIN_PERIOD_MS 1
+
+typedef struct {
+    char method[LOOPBACK_MAX_NAME]; // Full path of a method returning one integer
+    UINT32 period_ms;               // Sampling period, 0 unregisters the method
+    UINT32 reserved;
+} SamplerRegisterReq_t;
+
+typedef struct {
+    UINT32 sampler;     // Index passed to IOCTL_SAMPLER_SUBSCRIBE
+    UINT32 methods;     // Methods registered
+    UINT64 samples;     // Evaluations by all samplers so far
+    UINT64 wakeups;     // Requests completed and events signalled so far
+} SamplerRegisterRsp_t;
+
+#define SAMPLER_SUBSCRIBE_CURRENT 0x1   // Complete with the latest sample, value and deadband are ignored
+#define SAMPLER_SUBSCRIBE_EVENT   0x2   // Complete at once with the latest sample and signal event
+                                        // whenever a later one moves beyond the deadband from it
+#define SAMPLER_SUBSCRIBE_REMOVE  0x4   // Stop signalling event
+
+typedef struct {
+    UINT32 sampler;
+    UINT32 flags;
+    UINT64 value;       // Value the subscriber last saw, not used with SAMPLER_SUBSCRIBE_EVENT
+    UINT64 deadband;    // Changes of at most this much are not reported
+    UINT64 event;       // Event handle for SAMPLER_SUBSCRIBE_EVENT and SAMPLER_SUBSCRIBE_REMOVE
+} SamplerSubscribeReq_t;
+
+typedef struct {
+    UINT64 value;       // Latest sample
+    UINT64 timestamp;   // System time the sample was taken
+    UINT64 samples;     // Evaluations of the method so far
+    UINT32 sampler;
+    UINT32 status;      // NTSTATUS of the latest evaluation
+} SamplerSubscribeRsp_t;
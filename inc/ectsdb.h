@@ -0,0 +1,296 @@
+/*
+MIT License
+
+Copyright (c) 2025 Open Device Partnership
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Columnar time-series store for sampled ACPI method values.
+//
+// A capture file is a file header followed by 8-byte aligned chunks. SERS chunks
+// name a series, BLCK chunks hold up to ECTS_BLOCK_MAX_SAMPLES compressed samples
+// of a single series along with a min/max/count/sum summary. Timestamps are
+// delta-of-delta encoded and values are XOR encoded (Gorilla style).
+//
+// A cleanly closed capture ends with an INDX chunk and a fixed size TAIL chunk
+// pointing at it. Each index entry covers a run of blocks (every
+// ECTS_INDEX_BLOCKS blocks or ECTS_INDEX_BYTES bytes) and records its time range,
+// file range and which series and event IDs appear in it, so readers can binary
+// search to a time and skip ranges that cannot match without touching them.
+//
+// A rollup attached to a sample series keeps the min/max/avg/last of the current
+// time window and appends them to four derived series (named "<series>/<label>.min"
+// and so on) each time a window closes, so consumers can read pre-aggregated values
+// without scanning raw samples. Rollup samples are stamped with the window start.
+//
+// EctsScanBlocks hands out the blocks of a series in a time range through the index
+// without building the block directory that EctsBlockCount needs. Once either has
+// returned, a reader is only read from and can be shared by threads decoding
+// different blocks.
+//
+// This header has no Windows dependencies so readers can be built on any host.
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef _WIN32
+#define ECTS_API __declspec(dllexport)
+#else
+#define ECTS_API
+#endif
+
+#define ECTS_MAGIC              0x53544345  // 'ECTS'
+#define ECTS_VERSION            2
+
+#define ECTS_CHUNK_SERIES       0x53524553  // 'SERS'
+#define ECTS_CHUNK_BLOCK        0x4b434c42  // 'BLCK'
+#define ECTS_CHUNK_INDEX        0x58444e49  // 'INDX'
+#define ECTS_CHUNK_TAIL         0x4c494154  // 'TAIL'
+
+#define ECTS_BLOCK_MAX_SAMPLES  1024
+#define ECTS_MAX_SERIES         256
+#define ECTS_MAX_NAME_LEN       64
+#define ECTS_INDEX_BLOCKS       64
+#define ECTS_INDEX_BYTES        0x10000
+#define ECTS_MAX_ROLLUPS        4           // Rollup windows per source series
+#define ECTS_TICKS_PER_SECOND   10000000    // Timestamps are in 100ns units
+
+// Event values are tracked in 32-bit masks, bit (value % 32) set per event seen
+#define ECTS_EVENT_BIT(v)       (1u << ((uint64_t)(v) & 31))
+
+// Series kinds
+#define ECTS_SERIES_SAMPLE      0x0 // Periodically sampled method value
+#define ECTS_SERIES_EVENT       0x1 // Asynchronous event such as a notification
+#define ECTS_SERIES_ROLLUP      0x2 // Per-window aggregate derived from a sample series
+
+// Rollup fields, added to the first series ID returned by EctsDefineRollup
+#define ECTS_ROLLUP_MIN         0
+#define ECTS_ROLLUP_MAX         1
+#define ECTS_ROLLUP_AVG         2
+#define ECTS_ROLLUP_LAST        3
+#define ECTS_ROLLUP_FIELDS      4
+
+// Status codes
+#define ECTS_STATUS_SUCCESS             0
+#define ECTS_STATUS_INVALID_PARAMETER   1
+#define ECTS_STATUS_NO_MEMORY           2
+#define ECTS_STATUS_IO_ERROR            3
+#define ECTS_STATUS_BAD_FORMAT          4
+#define ECTS_STATUS_NOT_FOUND           5
+#define ECTS_STATUS_BUFFER_TOO_SMALL    6
+
+#pragma pack(push, 1)
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t header_size;
+    int64_t  created;
+} ECTS_FILE_HEADER;
+
+typedef struct {
+    uint32_t type;
+    uint32_t length;    // Bytes following this header, always a multiple of 8
+} ECTS_CHUNK_HEADER;
+
+typedef struct {
+    uint32_t id;
+    uint16_t kind;
+    uint16_t name_len;
+    // Followed by name_len bytes of name, no terminator
+} ECTS_SERIES_RECORD;
+
+typedef struct {
+    uint32_t series;
+    uint32_t count;
+    int64_t  t_first;
+    int64_t  t_last;
+    int64_t  v_first;
+    int64_t  v_min;
+    int64_t  v_max;
+    int64_t  v_sum;
+    uint32_t bit_count;
+    uint32_t event_mask;    // ECTS_EVENT_BIT of every value in an event series
+    // Followed by (bit_count + 7) / 8 bytes of payload padded to 8 bytes
+} ECTS_BLOCK_HEADER;
+
+typedef struct {
+    uint32_t entry_count;
+    uint32_t series_count;
+    // Followed by entry_count ECTS_INDEX_ENTRY then series_count
+    // ECTS_SERIES_RECORD each padded to 8 bytes
+} ECTS_INDEX_HEADER;
+
+typedef struct {
+    int64_t  t_min;         // Earliest sample in the covered blocks
+    int64_t  t_max;         // Latest sample so far, never decreases between entries
+    uint64_t offset;        // File offset of the first covered chunk
+    uint32_t length;        // Bytes covered starting at offset
+    uint32_t block_count;
+    uint32_t event_mask;
+    uint32_t reserved;
+    uint8_t  series_mask[ECTS_MAX_SERIES / 8];
+} ECTS_INDEX_ENTRY;
+
+typedef struct {
+    uint64_t index_offset;  // File offset of the INDX chunk header
+} ECTS_TAIL;
+#pragma pack(pop)
+
+typedef struct {
+    uint32_t id;
+    uint16_t kind;
+    char name[ECTS_MAX_NAME_LEN];
+} ECTS_SERIES_INFO;
+
+typedef struct _ECTS_WRITER ECTS_WRITER;
+typedef struct _ECTS_READER ECTS_READER;
+
+// Called once per decoded sample that falls inside the scan range
+typedef void (*ECTS_SCAN_CALLBACK)(void *ctx, uint32_t series, int64_t timestamp, int64_t value);
+
+// Called once per block overlapping the scan range, a status other than
+// ECTS_STATUS_SUCCESS stops the scan and is returned from it
+typedef int (*ECTS_BLOCK_CALLBACK)(void *ctx, const ECTS_BLOCK_HEADER *block);
+
+ECTS_API int EctsWriterOpen(
+    const char *path,
+    int64_t created,
+    ECTS_WRITER **writer
+);
+
+ECTS_API int EctsDefineSeries(
+    ECTS_WRITER *writer,
+    const char *name,
+    uint16_t kind,
+    uint32_t *series
+);
+
+ECTS_API int EctsDefineRollup(
+    ECTS_WRITER *writer,
+    uint32_t series,
+    int64_t window,
+    const char *label,
+    uint32_t *first
+);
+
+ECTS_API int EctsAppend(
+    ECTS_WRITER *writer,
+    uint32_t series,
+    int64_t timestamp,
+    int64_t value
+);
+
+ECTS_API int EctsFlush(
+    ECTS_WRITER *writer
+);
+
+ECTS_API int EctsWriterClose(
+    ECTS_WRITER *writer
+);
+
+ECTS_API int EctsReaderOpen(
+    const char *path,
+    ECTS_READER **reader
+);
+
+ECTS_API void EctsReaderClose(
+    ECTS_READER *reader
+);
+
+ECTS_API uint32_t EctsSeriesCount(
+    const ECTS_READER *reader
+);
+
+ECTS_API int EctsSeriesInfo(
+    const ECTS_READER *reader,
+    uint32_t index,
+    ECTS_SERIES_INFO *info
+);
+
+ECTS_API int EctsFindSeries(
+    const ECTS_READER *reader,
+    const char *name,
+    uint32_t *series
+);
+
+ECTS_API uint32_t EctsBlockCount(
+    ECTS_READER *reader
+);
+
+ECTS_API const ECTS_BLOCK_HEADER *EctsBlockInfo(
+    ECTS_READER *reader,
+    uint32_t index
+);
+
+ECTS_API int EctsDecodeBlock(
+    ECTS_READER *reader,
+    uint32_t index,
+    int64_t *timestamps,
+    int64_t *values,
+    uint32_t capacity,
+    uint32_t *count
+);
+
+ECTS_API int EctsScan(
+    const ECTS_READER *reader,
+    uint32_t series,
+    int64_t t_begin,
+    int64_t t_end,
+    ECTS_SCAN_CALLBACK callback,
+    void *ctx
+);
+
+ECTS_API int EctsScanEvent(
+    const ECTS_READER *reader,
+    uint32_t series,
+    int64_t event,
+    int64_t t_begin,
+    int64_t t_end,
+    ECTS_SCAN_CALLBACK callback,
+    void *ctx
+);
+
+ECTS_API int EctsScanBlocks(
+    const ECTS_READER *reader,
+    uint32_t series,
+    int64_t t_begin,
+    int64_t t_end,
+    ECTS_BLOCK_CALLBACK callback,
+    void *ctx
+);
+
+ECTS_API int EctsDecodeBlockData(
+    const ECTS_BLOCK_HEADER *block,
+    int64_t *timestamps,
+    int64_t *values,
+    uint32_t capacity,
+    uint32_t *count
+);
+
+ECTS_API uint32_t EctsIndexCount(
+    const ECTS_READER *reader
+);
+
+ECTS_API const ECTS_INDEX_ENTRY *EctsIndexEntry(
+    const ECTS_READER *reader,
+    uint32_t index
+);
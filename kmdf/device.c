@@ -45,7 +45,23 @@ Return Value:
 
     PAGED_CODE();
 
+    WDF_FILEOBJECT_CONFIG fileConfig;
+
+    // Subscriptions, shared regions and IOCTL_MAP_RX views belong to the handle they were requested on
+    WDF_FILEOBJECT_CONFIG_INIT(&fileConfig, WDF_NO_EVENT_CALLBACK, WDF_NO_EVENT_CALLBACK, ECTestEvtFileCleanup);
+#ifdef EC_TEST_MAP_RX
+    WDF_OBJECT_ATTRIBUTES fileAttributes;
+
+    WDF_OBJECT_ATTRIBUTES_INIT_CONTEXT_TYPE(&fileAttributes, FILE_CONTEXT);
+    WdfDeviceInitSetFileObjectConfig(DeviceInit, &fileConfig, &fileAttributes);
+#else
+    WdfDeviceInitSetFileObjectConfig(DeviceInit, &fileConfig, WDF_NO_OBJECT_ATTRIBUTES);
+#endif // EC_TEST_MAP_RX
+
     WDF_OBJECT_ATTRIBUTES_INIT_CONTEXT_TYPE(&deviceAttributes, DEVICE_CONTEXT);
+#if defined(EC_TEST_MSG_SEND2) || defined(EC_TEST_SAMPLER)
+    deviceAttributes.EvtCleanupCallback = ECTestEvtDeviceCleanup;
+#endif
     status = WdfDeviceCreate(&DeviceInit, &deviceAttributes, &device);
 
     if (NT_SUCCESS(status)) {
@@ -57,12 +73,81 @@ Return Value:
         // it will return NULL and assert if run under framework verifier mode.
         //
         deviceContext = DeviceContextGet(device);
-        deviceContext->PendingRequest = NULL;
+        EcCoreInitialize(&deviceContext->Core, device, NULL);
 
 #if defined(EC_TEST_NOTIFICATIONS) && defined(ENABLE_NOTIFICATION_SIMULATION)
         deviceContext->Timer = NULL;
 #endif
 
+#ifdef EC_TEST_LOOPBACK
+        WDF_OBJECT_ATTRIBUTES lockAttributes;
+        WDFWAITLOCK loopbackLock;
+
+        WDF_OBJECT_ATTRIBUTES_INIT(&lockAttributes);
+        lockAttributes.ParentObject = device;
+        status = WdfWaitLockCreate(&lockAttributes, &loopbackLock);
+        if (!NT_SUCCESS(status)) {
+            Trace(TRACE_LEVEL_ERROR, TRACE_DEVICE,"WdfWaitLockCreate failed %!STATUS!\n", status);
+            return status;
+        }
+        deviceContext->Core.Loopback.Lock = loopbackLock;
+#endif // EC_TEST_LOOPBACK
+
+#ifdef EC_TEST_MSG_SEND2
+        WDF_OBJECT_ATTRIBUTES messageAttributes;
+        WDFWAITLOCK messageLock;
+
+        deviceContext->MessageTx = NULL;
+        deviceContext->MessageRx = NULL;
+        WDF_OBJECT_ATTRIBUTES_INIT(&messageAttributes);
+        messageAttributes.ParentObject = device;
+        status = WdfWaitLockCreate(&messageAttributes, &messageLock);
+        if (!NT_SUCCESS(status)) {
+            Trace(TRACE_LEVEL_ERROR, TRACE_DEVICE,"WdfWaitLockCreate failed %!STATUS!\n", status);
+            return status;
+        }
+        deviceContext->Core.MessageLock = messageLock;
+#endif // EC_TEST_MSG_SEND2
+
+#ifdef EC_TEST_SAMPLER
+        WDF_OBJECT_ATTRIBUTES samplerAttributes;
+        WDF_TIMER_CONFIG samplerConfig;
+        WDFWAITLOCK samplingLock;
+
+        deviceContext->SamplerTimer = NULL;
+        WDF_OBJECT_ATTRIBUTES_INIT(&samplerAttributes);
+        samplerAttributes.ParentObject = device;
+        status = WdfWaitLockCreate(&samplerAttributes, &samplingLock);
+        if (!NT_SUCCESS(status)) {
+            Trace(TRACE_LEVEL_ERROR, TRACE_DEVICE,"WdfWaitLockCreate failed %!STATUS!\n", status);
+            return status;
+        }
+        deviceContext->Core.Sampling.Lock = samplingLock;
+
+        // Methods are evaluated from the callback, so it runs at passive level. Passive
+        // level timers cannot be periodic, the core arms it again after every pass
+        WDF_TIMER_CONFIG_INIT(&samplerConfig, ECTestSamplerTimer);
+        samplerConfig.AutomaticSerialization = FALSE;
+        samplerAttributes.ExecutionLevel = WdfExecutionLevelPassive;
+        status = WdfTimerCreate(&samplerConfig, &samplerAttributes, &deviceContext->SamplerTimer);
+        if (!NT_SUCCESS(status)) {
+            Trace(TRACE_LEVEL_ERROR, TRACE_DEVICE,"WdfTimerCreate failed %!STATUS!\n", status);
+            return status;
+        }
+#endif // EC_TEST_SAMPLER
+
+#ifdef EC_TEST_MAP_RX
+        WDF_OBJECT_ATTRIBUTES mapAttributes;
+
+        WDF_OBJECT_ATTRIBUTES_INIT(&mapAttributes);
+        mapAttributes.ParentObject = device;
+        status = WdfWaitLockCreate(&mapAttributes, &deviceContext->MapLock);
+        if (!NT_SUCCESS(status)) {
+            Trace(TRACE_LEVEL_ERROR, TRACE_DEVICE,"WdfWaitLockCreate failed %!STATUS!\n", status);
+            return status;
+        }
+#endif // EC_TEST_MAP_RX
+
 #ifdef EC_TEST_NOTIFICATIONS
         WDF_OBJECT_ATTRIBUTES attributes;
 
@@ -71,6 +156,7 @@ Return Value:
         status = WdfWaitLockCreate(&attributes, &deviceContext->NotificationLock);
 
         if (NT_SUCCESS(status)) {
+            deviceContext->Core.NotificationLock = deviceContext->NotificationLock;
 #endif // EC_TEST_NOTIFICATIONS
 
             //
@@ -115,3 +201,32 @@ Return Value:
 
     return status;
 }
+
+#if defined(EC_TEST_MSG_SEND2) || defined(EC_TEST_SAMPLER)
+VOID
+ECTestEvtDeviceCleanup(
+    WDFOBJECT Object
+    )
+/*++
+
+Routine Description:
+
+    Stops the sampler, reclaims buffers still shared with the EC and releases
+    the indirect message buffers when the device is removed.
+
+Arguments:
+
+    Object - The device object.
+
+Return Value:
+
+    VOID
+
+--*/
+{
+    EcCoreShutdown(&DeviceContextGet((WDFDEVICE)Object)->Core);
+#ifdef EC_TEST_MSG_SEND2
+    ECTestMessageCleanup((WDFDEVICE)Object);
+#endif
+}
+#endif // EC_TEST_MSG_SEND2 || EC_TEST_SAMPLER
@@ -8,9 +8,7 @@ Abstract:
 --*/
 
 #include "public.h"
-
-#define EC_TEST_NOTIFICATIONS  // Enable notification support
-//#define ENABLE_NOTIFICATION_SIMULATION // Enable notification simulation
+#include "eccore.h"   // Feature switches and the framework independent core
 
 //
 // The device context performs the same job as
@@ -18,13 +16,25 @@ Abstract:
 //
 typedef struct _DEVICE_CONTEXT
 {
-    WDFREQUEST PendingRequest; // Pending request for notification
+    EC_CORE Core; // Dispatch and notification state, see eccore.h
 #ifdef EC_TEST_NOTIFICATIONS
     WDFWAITLOCK  NotificationLock; // lock for notification
 #endif
 #if defined(EC_TEST_NOTIFICATIONS) && defined(ENABLE_NOTIFICATION_SIMULATION)
     WDFTIMER Timer; // Timer for notification simulation
 #endif
+#ifdef EC_TEST_MSG_SEND2
+    PVOID MessageTx; // Mapped SBSAQEMU_MSG_TX_BASE, NULL until the first message
+    PVOID MessageRx; // Mapped SBSAQEMU_MSG_RX_BASE
+    PVOID FfaRawSmcCall; // HAL routines, resolved with the buffers
+    PVOID FfaReleaseRxBuffer;
+#endif
+#ifdef EC_TEST_SAMPLER
+    WDFTIMER SamplerTimer; // One-shot passive level timer armed by EcFwSamplerSchedule
+#endif
+#ifdef EC_TEST_MAP_RX
+    WDFWAITLOCK MapLock; // Serializes IOCTL_MAP_RX with file cleanup
+#endif
 } DEVICE_CONTEXT, *PDEVICE_CONTEXT;
 
 //
@@ -34,11 +44,37 @@ typedef struct _DEVICE_CONTEXT
 //
 WDF_DECLARE_CONTEXT_TYPE_WITH_NAME(DEVICE_CONTEXT, DeviceContextGet)
 
+#ifdef EC_TEST_MAP_RX
+//
+// Views IOCTL_MAP_RX mapped for a handle, Tx is 0 until the first request
+//
+typedef struct _FILE_CONTEXT
+{
+    PEPROCESS Process; // Referenced, the views are in its address space
+    UINT64 Tx;
+    UINT64 Rx;
+} FILE_CONTEXT, *PFILE_CONTEXT;
+
+WDF_DECLARE_CONTEXT_TYPE_WITH_NAME(FILE_CONTEXT, FileContextGet)
+#endif
+
 //
 // Function to initialize the device and its callbacks
 //
 NTSTATUS ECTestDeviceCreate(PWDFDEVICE_INIT DeviceInit );
 
+#if defined(EC_TEST_MSG_SEND2) || defined(EC_TEST_SAMPLER)
+EVT_WDF_OBJECT_CONTEXT_CLEANUP ECTestEvtDeviceCleanup;
+#endif
+
+// Releases what a handle holds when it is closed
+EVT_WDF_FILE_CLEANUP ECTestEvtFileCleanup;
+
+#ifdef EC_TEST_SAMPLER
+// Timer routine that samples the registered methods
+EVT_WDF_TIMER ECTestSamplerTimer;
+#endif
+
 #if defined(EC_TEST_NOTIFICATIONS) && defined(ENABLE_NOTIFICATION_SIMULATION)
 // Timer routine to simulate receiving the Notification at the driver.
 VOID TimerCallback(WDFTIMER Timer);
@@ -0,0 +1,2364 @@
+/*++
+Module Name:
+    eccore.c
+
+Abstract:
+    Framework independent dispatch and notification handling for the ectest
+    driver. Everything here reaches the framework through the EcFw* services
+    declared in eccore.h so the same code runs under KMDF and under the
+    user-mode shim in tools/wdfshim.
+
+Environment:
+    Kernel mode, or user mode when EC_CORE_USER_MODE is defined
+
+--*/
+
+#include "eccore.h"
+#include "ecmsg.h"
+#ifdef EC_TEST_MEM_SHARE
+#include "../uefi/Platforms/QemuSbsaPkg/SbsaQemuPlatformDxe/FfaMemDescriptor.h"
+#endif
+#ifdef EC_TEST_STATIC
+#include "../uefi/Platforms/QemuSbsaPkg/SbsaQemuPlatformDxe/EcStaticSnapshot.h"
+#endif
+
+#ifdef EC_CORE_USER_MODE
+#define Trace(...) ((void)0)
+#else
+#include "trace.h"
+#include "eccore.tmh"
+#endif
+
+#define LOOPBACK_OUTPUT_SIGNATURE   0x426f6541  // 'BoeA', ACPI_EVAL_OUTPUT_BUFFER_SIGNATURE_V1
+#define LOOPBACK_OUTPUT_HEADER      12          // Signature, Length and Count
+
+#define SAMPLER_OUTPUT_SIZE         64          // ACPI_EVAL_OUTPUT_BUFFER_V1 with one integer argument
+#define SAMPLER_TICKS_PER_MS        10000       // System time is in 100ns units
+
+#define EC_MSG_POLL_US              10          // Interval between checks of the RX buffer
+#define EC_MSG_TIMEOUT_US           1000000     // Longest wait for the EC to respond
+
+#define EC_BATTERY_READ_RETRIES     16          // Reads of the battery slot while the EC rewrites it
+
+/*
+ * Function: VOID EcCoreInitialize
+ *
+ * Description:
+ * Initializes the core state for a device.
+ *
+ * Parameters:
+ * Core - The core state to initialize.
+ * Device - The framework device, passed back to the framework services.
+ * NotificationLock - The framework lock protecting the pending request.
+ *
+ * Return Value:
+ * VOID
+ *
+ */
+VOID EcCoreInitialize(PEC_CORE Core, EC_FW_HANDLE Device, EC_FW_HANDLE NotificationLock)
+{
+    Core->Device = Device;
+    Core->NotificationLock = NotificationLock;
+    Core->PendingRequest = NULL;
+    Core->NotifyStats.count = 0;
+    Core->NotifyStats.timestamp = 0;
+    Core->NotifyStats.lastevent = 0;
+#ifdef EC_TEST_LOOPBACK
+    RtlZeroMemory(&Core->Loopback, sizeof(Core->Loopback));
+#endif
+#ifdef EC_TEST_MSG_SEND2
+    Core->MessageLock = NULL;
+    Core->MessageSequence = 0;
+#endif
+#ifdef EC_TEST_MEM_SHARE
+    RtlZeroMemory(Core->Shares, sizeof(Core->Shares));
+#endif
+#ifdef EC_TEST_NOTIFICATIONS
+    RtlZeroMemory(Core->NotifyClass, sizeof(Core->NotifyClass));
+    RtlZeroMemory(Core->NotifyQueue, sizeof(Core->NotifyQueue));
+    RtlZeroMemory(Core->NotifyClassStats, sizeof(Core->NotifyClassStats));
+#endif
+#ifdef EC_TEST_SAMPLER
+    RtlZeroMemory(&Core->Sampling, sizeof(Core->Sampling));
+#endif
+}
+
+#ifdef EC_TEST_NOTIFICATIONS
+/*
+ * Function: VOID NotifyEnqueue
+ *
+ * Description:
+ * Queues a notification in the queue of its class. Called with the
+ * notification lock held.
+ *
+ * A routine notification already queued with the same value is coalesced into
+ * it. Higher classes are never coalesced. The queues share NOTIFY_QUEUE_DEPTH
+ * entries: when they are full the oldest entry of the lowest class below the
+ * new one is dropped to make room, routine first, so a burst of lower class
+ * notifications cannot push out a higher class. A routine notification that
+ * finds only routine entries drops the oldest of them, as it is the least
+ * current. A higher class one that finds no lower class entry is turned away
+ * instead, so the oldest critical event is never lost to a newer one.
+ *
+ * Parameters:
+ * Core - The core state of the device that received the notification.
+ * Value - The value associated with the ACPI notification.
+ * Timestamp - When the notification arrived.
+ *
+ * Return Value:
+ * The entry the notification was queued in or coalesced into, NULL if it was
+ * turned away.
+ *
+ */
+static EC_NOTIFY_ENTRY *NotifyEnqueue(PEC_CORE Core, ULONG Value, LONGLONG Timestamp)
+{
+    UINT32 priority = (Value < NOTIFY_MAX_VALUES) ? Core->NotifyClass[Value] : NOTIFY_CLASS_ROUTINE;
+    EC_NOTIFY_QUEUE *queue = &Core->NotifyQueue[priority];
+    NotifyClassStats_t *stats = &Core->NotifyClassStats[priority];
+    EC_NOTIFY_QUEUE *full;
+    EC_NOTIFY_ENTRY *entry;
+    UINT32 queued;
+    UINT32 victim;
+    UINT32 i;
+
+    stats->received++;
+    if (priority == NOTIFY_CLASS_ROUTINE) {
+        for (i = 0; i < queue->Count; i++) {
+            entry = &queue->Entries[(queue->Head + i) % NOTIFY_QUEUE_DEPTH];
+            if (entry->Value == Value) {
+                entry->Coalesced++;
+                stats->coalesced++;
+                return entry;
+            }
+        }
+    }
+
+    queued = 0;
+    for (i = 0; i < NOTIFY_MAX_CLASSES; i++) {
+        queued += Core->NotifyQueue[i].Count;
+    }
+    if (queued == NOTIFY_QUEUE_DEPTH) {
+        for (victim = 0; victim < priority; victim++) {
+            if (Core->NotifyQueue[victim].Count != 0) {
+                break;
+            }
+        }
+        if (victim == priority && (priority != NOTIFY_CLASS_ROUTINE || queue->Count == 0)) {
+            Trace(TRACE_LEVEL_ERROR, TRACE_QUEUE,"Queues full, turning away class %lu %lu\n", priority, Value);
+            stats->dropped++;
+            return NULL;
+        }
+
+        full = &Core->NotifyQueue[victim];
+        Trace(TRACE_LEVEL_ERROR, TRACE_QUEUE,"Queues full, dropping class %lu %lu\n", victim, full->Entries[full->Head].Value);
+        full->Head = (full->Head + 1) % NOTIFY_QUEUE_DEPTH;
+        full->Count--;
+        Core->NotifyClassStats[victim].dropped++;
+        Core->NotifyClassStats[victim].queued = full->Count;
+    }
+
+    entry = &queue->Entries[(queue->Head + queue->Count) % NOTIFY_QUEUE_DEPTH];
+    entry->Value = Value;
+    entry->Coalesced = 0;
+    entry->Sequence = Core->NotifyStats.count;
+    entry->Timestamp = Timestamp;
+#ifdef EC_TEST_BATTERY
+    RtlZeroMemory(&entry->Battery, sizeof(entry->Battery));
+#endif
+    queue->Count++;
+    stats->queued = queue->Count;
+    if (queue->Count > stats->peak) {
+        stats->peak = queue->Count;
+    }
+    return entry;
+}
+
+/*
+ * Function: int NotifyDequeue
+ *
+ * Description:
+ * Takes the oldest notification of the highest class that has one queued and
+ * records its delivery latency. Called with the notification lock held.
+ *
+ * Parameters:
+ * Core - The core state of the device.
+ * Rsp - Receives the notification.
+ *
+ * Return Value:
+ * Non-zero if a notification was queued.
+ *
+ */
+static int NotifyDequeue(PEC_CORE Core, NotificationRsp_t *Rsp)
+{
+    EC_NOTIFY_QUEUE *queue;
+    NotifyClassStats_t *stats;
+    EC_NOTIFY_ENTRY *entry;
+    LONGLONG now;
+    UINT64 latency;
+    UINT32 priority = NOTIFY_MAX_CLASSES;
+
+    while (priority > 0) {
+        priority--;
+        queue = &Core->NotifyQueue[priority];
+        if (queue->Count == 0) {
+            continue;
+        }
+
+        entry = &queue->Entries[queue->Head];
+        queue->Head = (queue->Head + 1) % NOTIFY_QUEUE_DEPTH;
+        queue->Count--;
+
+        now = EcFwQuerySystemTime();
+        latency = (now > entry->Timestamp) ? (UINT64)(now - entry->Timestamp) / 10 : 0;
+        stats = &Core->NotifyClassStats[priority];
+        stats->delivered++;
+        stats->latency_total += latency;
+        if (latency > stats->latency_max) {
+            stats->latency_max = latency;
+        }
+        stats->queued = queue->Count;
+
+        Rsp->count = entry->Sequence;
+        Rsp->timestamp = (UINT64)entry->Timestamp;
+        Rsp->lastevent = entry->Value;
+        Rsp->priority = (UINT16)priority;
+        Rsp->coalesced = (UINT16)((entry->Coalesced > 0xFFFF) ? 0xFFFF : entry->Coalesced);
+#ifdef EC_TEST_BATTERY
+        Rsp->battery = entry->Battery;
+#else
+        RtlZeroMemory(&Rsp->battery, sizeof(Rsp->battery));
+#endif
+        return 1;
+    }
+    return 0;
+}
+
+#ifdef EC_TEST_BATTERY
+/*
+ * Function: NTSTATUS BatteryRead
+ *
+ * Description:
+ * Reads a consistent copy of the battery status slot the EC writes. The EC
+ * makes the sequence odd while it rewrites the slot, so a copy taken then, or
+ * whose sequence has moved by the time it is read again, is read over.
+ *
+ * Parameters:
+ * Core - The core state of the device.
+ * Status - Receives the status, with a sequence of 0 if the EC never wrote it.
+ *
+ * Return Value:
+ * STATUS_DEVICE_BUSY if the EC kept rewriting the slot, otherwise the status of
+ * the reads.
+ *
+ */
+static NTSTATUS BatteryRead(PEC_CORE Core, BatteryStatus_t *Status)
+{
+    UINT32 sequence;
+    UINT32 i;
+    NTSTATUS status;
+
+    for (i = 0; i < EC_BATTERY_READ_RETRIES; i++) {
+        status = EcFwReadPhysical(Core, EC_BATTERY_STATUS_BASE, Status, sizeof(BatteryStatus_t));
+        if (!NT_SUCCESS(status)) {
+            return status;
+        }
+        if (Status->sequence & 1) {
+            continue;
+        }
+
+        status = EcFwReadPhysical(Core, EC_BATTERY_STATUS_BASE, &sequence, sizeof(sequence));
+        if (!NT_SUCCESS(status)) {
+            return status;
+        }
+        if (sequence == Status->sequence) {
+            return STATUS_SUCCESS;
+        }
+    }
+    return STATUS_DEVICE_BUSY;
+}
+#endif // EC_TEST_BATTERY
+
+/*
+ * Function: VOID EcCoreNotify
+ *
+ * Description:
+ * Handles an ACPI notification.
+ *
+ * Updates the notification statistics, queues the notification by its class
+ * and completes the pending notification request, if any, with the most
+ * urgent notification queued. A battery notification carries the status the
+ * EC wrote before raising it; coalesced ones keep the newest status and every
+ * field that changed since the entry was queued.
+ *
+ * Parameters:
+ * Core - The core state of the device that received the notification.
+ * NotifyValue - The value associated with the ACPI notification.
+ *
+ * Return Value:
+ * VOID
+ *
+ */
+VOID EcCoreNotify(PEC_CORE Core, ULONG NotifyValue)
+{
+    EC_FW_REQUEST request = NULL;
+    NotificationRsp_t *rsp = NULL;
+    NotificationRsp_t delivery;
+    EC_NOTIFY_ENTRY *entry;
+    size_t rspSize = 0;
+    NTSTATUS status = STATUS_SUCCESS;
+#ifdef EC_TEST_BATTERY
+    BatteryStatus_t battery;
+
+    // Read before taking the lock, the slot is mapped for the read
+    RtlZeroMemory(&battery, sizeof(battery));
+    if (NotifyValue == EC_NOTIFY_BATTERY) {
+        status = BatteryRead(Core, &battery);
+        if (!NT_SUCCESS(status)) {
+            Trace(TRACE_LEVEL_ERROR, TRACE_QUEUE,"Battery status read failed %!STATUS!\n", status);
+            RtlZeroMemory(&battery, sizeof(battery));
+        }
+    }
+#endif
+
+    Trace(TRACE_LEVEL_INFORMATION, TRACE_QUEUE, "Notification received: %lu\n", NotifyValue);
+
+    EcFwLockAcquire(Core->NotificationLock);
+    Core->NotifyStats.count++;
+    Core->NotifyStats.timestamp = EcFwQuerySystemTime();
+    Core->NotifyStats.lastevent = NotifyValue;
+    entry = NotifyEnqueue(Core, NotifyValue, (LONGLONG)Core->NotifyStats.timestamp);
+#ifdef EC_TEST_BATTERY
+    // A failed read leaves the status already queued, if any
+    if (entry != NULL && battery.sequence != 0) {
+        battery.changed |= entry->Battery.changed;
+        entry->Battery = battery;
+    }
+#else
+    (VOID)entry;
+#endif
+
+    if (Core->PendingRequest != NULL) {
+        request = Core->PendingRequest;
+        Core->PendingRequest = NULL;
+
+        // Unmarked under the lock, so the notification is only taken off the queue
+        // once the request is ours. A cancelled request leaves it for the next one
+        if (STATUS_CANCELLED == EcFwRequestUnmarkCancelable(request)) {
+            // The cancel routine owns the request and completes it
+            Trace(TRACE_LEVEL_ERROR, TRACE_QUEUE,"Request 0x%llx was cancelled\n", (UINT64)request);
+            request = NULL;
+        } else {
+            NotifyDequeue(Core, &delivery);
+        }
+    }
+    EcFwLockRelease(Core->NotificationLock);
+
+    if (request != NULL) {
+        // Retrieve the output buffer from the request
+        status = EcFwRetrieveOutputBuffer(request, sizeof(NotificationRsp_t), (PVOID *)&rsp, &rspSize);
+        if (NT_SUCCESS(status)) {
+            // Copy the notification data to the output buffer
+            RtlCopyMemory(rsp, &delivery, sizeof(NotificationRsp_t));
+
+            Trace(TRACE_LEVEL_INFORMATION, TRACE_QUEUE,"Completing 0x%llx with Success \n", (UINT64)request);
+            EcFwRequestComplete(request, STATUS_SUCCESS, sizeof(NotificationRsp_t));
+        } else {
+            Trace(TRACE_LEVEL_ERROR, TRACE_QUEUE,"Completing 0x%llx with status %!STATUS!\n", (UINT64)request, status);
+            EcFwRequestComplete(request, status, 0);
+        }
+    } else {
+        // If no request was pending, the notification waits in its queue
+        Trace(TRACE_LEVEL_INFORMATION, TRACE_QUEUE,"Queued for app : %lu \n", NotifyValue);
+    }
+}
+
+/*
+ * Function: VOID EcCoreCancelNotification
+ *
+ * Description:
+ * Handles the cancellation of a pending notification or subscription request.
+ * Called by the framework layer from its cancel routine.
+ *
+ * Parameters:
+ * Core - The core state of the device owning the request.
+ * Request - The request being cancelled.
+ *
+ * Return Value:
+ * VOID
+ *
+ */
+VOID EcCoreCancelNotification(PEC_CORE Core, EC_FW_REQUEST Request)
+{
+    Trace(TRACE_LEVEL_INFORMATION, TRACE_QUEUE,"Cancel Request received for Request 0x%llx \n", (UINT64)Request);
+
+    EcFwLockAcquire(Core->NotificationLock);
+    if (Core->PendingRequest == Request) {
+        Trace(TRACE_LEVEL_INFORMATION, TRACE_QUEUE,"Request found & cleared from pending list\n");
+        Core->PendingRequest = NULL;
+    } else {
+        Trace(TRACE_LEVEL_ERROR, TRACE_QUEUE,"Request not found in pending list\n");
+    }
+    EcFwLockRelease(Core->NotificationLock);
+
+#ifdef EC_TEST_SAMPLER
+    UINT32 i;
+
+    EcFwLockAcquire(Core->Sampling.Lock);
+    for (i = 0; i < SAMPLER_MAX_SUBSCRIBERS; i++) {
+        if (Core->Sampling.Subscribers[i].Request == Request) {
+            Core->Sampling.Subscribers[i].Request = NULL;
+            break;
+        }
+    }
+    EcFwLockRelease(Core->Sampling.Lock);
+#endif // EC_TEST_SAMPLER
+
+    Trace(TRACE_LEVEL_INFORMATION, TRACE_QUEUE,"Completing the request 0x%llx with STATUS_CANCELLED\n", (UINT64)Request);
+    EcFwRequestComplete(Request, STATUS_CANCELLED, 0);
+}
+
+/*
+ * Function: NTSTATUS NotificationGet
+ *
+ * Description:
+ * Completes a notification request with the most urgent queued notification,
+ * or pends it until the next notification arrives.
+ *
+ * Parameters:
+ * Core - The core state of the device.
+ * Request - The notification request.
+ * Information - Receives the number of bytes returned.
+ *
+ * Return Value:
+ * STATUS_SUCCESS if a notification was queued, STATUS_PENDING if the request
+ * was pended, STATUS_DEVICE_BUSY if another request is already pending,
+ * STATUS_CANCELLED if it was cancelled already.
+ *
+ */
+static NTSTATUS NotificationGet(PEC_CORE Core, EC_FW_REQUEST Request, size_t *Information)
+{
+    NotificationRsp_t *rsp = NULL;
+    size_t length = 0;
+    NTSTATUS status;
+
+    status = EcFwRetrieveOutputBuffer(Request, sizeof(NotificationRsp_t), (PVOID *)&rsp, &length);
+    if (!NT_SUCCESS(status)) {
+        return status;
+    }
+
+    EcFwLockAcquire(Core->NotificationLock);
+    if (Core->PendingRequest != NULL) {
+        EcFwLockRelease(Core->NotificationLock);
+
+        Trace(TRACE_LEVEL_ERROR, TRACE_QUEUE,"Request already pending\n");
+        // If a request is already pending, complete the new request with STATUS_DEVICE_BUSY
+        return STATUS_DEVICE_BUSY;
+    }
+
+    if (NotifyDequeue(Core, rsp)) {
+        EcFwLockRelease(Core->NotificationLock);
+        *Information = sizeof(NotificationRsp_t);
+        return STATUS_SUCCESS;
+    }
+
+    // Mark cancelable and publish under the same lock, so a notification never unmarks a
+    // request that is not cancelable yet and a cancel routine always finds it published
+    status = EcFwRequestMarkCancelable(Core, Request);
+    if (!NT_SUCCESS(status)) {
+        EcFwLockRelease(Core->NotificationLock);
+        Trace(TRACE_LEVEL_INFORMATION, TRACE_QUEUE,"Request 0x%llx cancelled before pending\n", (UINT64)Request);
+        return status;
+    }
+
+    // Keeping this simple. Only one request can be pended at a time (since only 1 app is supported at a time)
+    Core->PendingRequest = Request;
+    Trace(TRACE_LEVEL_INFORMATION, TRACE_QUEUE,"Saving Request 0x%llx to pending list\n", (UINT64)Request);
+    EcFwLockRelease(Core->NotificationLock);
+
+    return STATUS_PENDING;
+}
+
+/*
+ * Function: NTSTATUS NotifyClasses
+ *
+ * Description:
+ * Handles IOCTL_NOTIFY_CLASSES, optionally replacing the table that maps
+ * notify values to priority classes, dropping queued notifications and
+ * clearing the statistics, and returns the table and per class statistics.
+ *
+ * Parameters:
+ * Core - The core state of the device.
+ * Request - The IOCTL_NOTIFY_CLASSES request.
+ * Information - Receives the number of bytes returned.
+ *
+ * Return Value:
+ * NTSTATUS status code indicating the success or failure of the operation.
+ *
+ */
+static NTSTATUS NotifyClasses(PEC_CORE Core, EC_FW_REQUEST Request, size_t *Information)
+{
+    NotifyClassesReq_t *req = NULL;
+    NotifyClassesRsp_t *rsp = NULL;
+    size_t length = 0;
+    UINT32 flags;
+    UINT32 i;
+    NTSTATUS status;
+
+    status = EcFwRetrieveInputBuffer(Request, sizeof(NotifyClassesReq_t), (PVOID *)&req, &length);
+    if (NT_SUCCESS(status)) {
+        status = EcFwRetrieveOutputBuffer(Request, sizeof(NotifyClassesRsp_t), (PVOID *)&rsp, &length);
+    }
+    if (!NT_SUCCESS(status)) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    flags = req->flags;
+    if (flags & NOTIFY_CLASSES_SET) {
+        for (i = 0; i < NOTIFY_MAX_VALUES; i++) {
+            if (req->classes[i] >= NOTIFY_MAX_CLASSES) {
+                return STATUS_INVALID_PARAMETER;
+            }
+        }
+    }
+
+    // The request and response may share a buffer, the table is consumed before
+    // anything is written back
+    EcFwLockAcquire(Core->NotificationLock);
+    if (flags & NOTIFY_CLASSES_SET) {
+        RtlCopyMemory(Core->NotifyClass, req->classes, sizeof(Core->NotifyClass));
+    }
+    for (i = 0; i < NOTIFY_MAX_CLASSES; i++) {
+        NotifyClassStats_t *stats = &Core->NotifyClassStats[i];
+
+        if (flags & NOTIFY_CLASSES_FLUSH) {
+            stats->dropped += Core->NotifyQueue[i].Count;
+            Core->NotifyQueue[i].Head = 0;
+            Core->NotifyQueue[i].Count = 0;
+        }
+        if (flags & NOTIFY_CLASSES_RESET) {
+            RtlZeroMemory(stats, sizeof(*stats));
+            stats->peak = Core->NotifyQueue[i].Count;
+        }
+        stats->queued = Core->NotifyQueue[i].Count;
+    }
+    RtlCopyMemory(rsp->classes, Core->NotifyClass, sizeof(rsp->classes));
+    RtlCopyMemory(rsp->stats, Core->NotifyClassStats, sizeof(rsp->stats));
+    EcFwLockRelease(Core->NotificationLock);
+
+    *Information = sizeof(NotifyClassesRsp_t);
+    return STATUS_SUCCESS;
+}
+#endif // EC_TEST_NOTIFICATIONS
+
+#ifdef EC_TEST_LOOPBACK
+/*
+ * Function: int LoopbackNameMatches
+ *
+ * Description:
+ * Compares a registered method name with the MethodName of an ACPI input buffer.
+ *
+ * Parameters:
+ * Name - The registered, NUL terminated method name.
+ * Method - The MethodName field of the input buffer.
+ * MethodLength - Bytes of MethodName present in the input buffer.
+ *
+ * Return Value:
+ * Nonzero if the names are equal.
+ *
+ */
+static int LoopbackNameMatches(const CHAR *Name, const CHAR *Method, size_t MethodLength)
+{
+    size_t i;
+
+    for (i = 0; i < MethodLength && i < LOOPBACK_MAX_NAME; i++) {
+        if (Name[i] != Method[i]) {
+            return 0;
+        }
+        if (Name[i] == '\0') {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Function: int LoopbackEvaluate
+ *
+ * Description:
+ * Answers an evaluation from the canned response table if loopback is enabled.
+ * Runs on the same worker and completion path as a real ACPI evaluation so
+ * only the call to ACPI is replaced.
+ *
+ * Parameters:
+ * Core - The core state of the device.
+ * Input - The ACPI evaluation input buffer.
+ * InputLength - The length of the input buffer.
+ * Output - The buffer receiving the canned response.
+ * OutputLength - The length of the output buffer.
+ * BytesReturned - Receives the number of bytes written to the output buffer.
+ * Status - Receives the status of the evaluation.
+ *
+ * Return Value:
+ * Nonzero if loopback handled the evaluation, zero if it should go to ACPI.
+ *
+ */
+static int LoopbackEvaluate(
+    PEC_CORE Core,
+    PVOID Input,
+    size_t InputLength,
+    PVOID Output,
+    size_t OutputLength,
+    ULONG *BytesReturned,
+    NTSTATUS *Status
+    )
+{
+    EC_LOOPBACK *loopback = &Core->Loopback;
+    const LoopbackResponseReq_t *entry = NULL;
+    const CHAR *method = (const CHAR *)Input + sizeof(UINT32);    // Follows the Signature
+    size_t methodLength = (InputLength > sizeof(UINT32)) ? InputLength - sizeof(UINT32) : 0;
+    ULONG delay;
+    UINT32 i;
+
+    EcFwLockAcquire(loopback->Lock);
+    if (!loopback->Enabled) {
+        EcFwLockRelease(loopback->Lock);
+        return 0;
+    }
+
+    for (i = 0; i < loopback->Count; i++) {
+        if (LoopbackNameMatches(loopback->Entries[i].method, method, methodLength)) {
+            entry = &loopback->Entries[i];
+            break;
+        }
+    }
+
+    *BytesReturned = 0;
+    if (entry == NULL) {
+        loopback->Misses++;
+        *Status = STATUS_OBJECT_NAME_NOT_FOUND;
+    } else if (OutputLength < entry->length) {
+        // Like ACPI, return just the header so the caller learns the required Length
+        loopback->Hits++;
+        if (OutputLength >= LOOPBACK_OUTPUT_HEADER) {
+            RtlCopyMemory(Output, entry->response, LOOPBACK_OUTPUT_HEADER);
+            *BytesReturned = LOOPBACK_OUTPUT_HEADER;
+        }
+        *Status = STATUS_BUFFER_OVERFLOW;
+    } else {
+        loopback->Hits++;
+        RtlCopyMemory(Output, entry->response, entry->length);
+        *BytesReturned = entry->length;
+        *Status = STATUS_SUCCESS;
+    }
+    delay = loopback->Delay;
+    EcFwLockRelease(loopback->Lock);
+
+    if (delay) {
+        EcFwDelay(delay);
+    }
+    return 1;
+}
+
+/*
+ * Function: VOID LoopbackGetStatus
+ *
+ * Description:
+ * Fills in the loopback status returned by the loopback IOCTLs. Called with the loopback lock held.
+ *
+ * Parameters:
+ * Loopback - The loopback state.
+ * Rsp - Receives the status.
+ *
+ * Return Value:
+ * VOID
+ *
+ */
+static VOID LoopbackGetStatus(EC_LOOPBACK *Loopback, LoopbackRsp_t *Rsp)
+{
+    Rsp->enabled = Loopback->Enabled;
+    Rsp->delay = Loopback->Delay;
+    Rsp->entries = Loopback->Count;
+    Rsp->reserved = 0;
+    Rsp->hits = Loopback->Hits;
+    Rsp->misses = Loopback->Misses;
+}
+
+/*
+ * Function: NTSTATUS LoopbackSet
+ *
+ * Description:
+ * Handles IOCTL_SET_LOOPBACK, enabling or disabling loopback mode, setting the
+ * synthetic delay and optionally clearing the response table.
+ *
+ * Parameters:
+ * Core - The core state of the device.
+ * Request - The IOCTL_SET_LOOPBACK request.
+ * Information - Receives the number of bytes returned.
+ *
+ * Return Value:
+ * NTSTATUS status code indicating the success or failure of the operation.
+ *
+ */
+static NTSTATUS LoopbackSet(PEC_CORE Core, EC_FW_REQUEST Request, size_t *Information)
+{
+    EC_LOOPBACK *loopback = &Core->Loopback;
+    LoopbackReq_t *req = NULL;
+    LoopbackRsp_t *rsp = NULL;
+    size_t length = 0;
+    NTSTATUS status;
+
+    status = EcFwRetrieveInputBuffer(Request, sizeof(LoopbackReq_t), (PVOID *)&req, &length);
+    if (NT_SUCCESS(status)) {
+        status = EcFwRetrieveOutputBuffer(Request, sizeof(LoopbackRsp_t), (PVOID *)&rsp, &length);
+    }
+    if (!NT_SUCCESS(status)) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    EcFwLockAcquire(loopback->Lock);
+    if (req->flags & LOOPBACK_CLEAR) {
+        loopback->Count = 0;
+        loopback->Hits = 0;
+        loopback->Misses = 0;
+    }
+    loopback->Enabled = (req->flags & LOOPBACK_ENABLE) ? 1 : 0;
+    loopback->Delay = req->delay;
+    LoopbackGetStatus(loopback, rsp);
+    EcFwLockRelease(loopback->Lock);
+
+    Trace(TRACE_LEVEL_INFORMATION, TRACE_QUEUE,"Loopback %lu delay %luus entries %lu\n", rsp->enabled, rsp->delay, rsp->entries);
+    *Information = sizeof(LoopbackRsp_t);
+    return STATUS_SUCCESS;
+}
+
+/*
+ * Function: NTSTATUS LoopbackAddResponse
+ *
+ * Description:
+ * Handles IOCTL_ADD_LOOPBACK_RESPONSE, registering or replacing the canned
+ * response for a method. The response must be a complete ACPI_EVAL_OUTPUT_BUFFER_V1.
+ *
+ * Parameters:
+ * Core - The core state of the device.
+ * Request - The IOCTL_ADD_LOOPBACK_RESPONSE request.
+ * Information - Receives the number of bytes returned.
+ *
+ * Return Value:
+ * NTSTATUS status code indicating the success or failure of the operation.
+ *
+ */
+static NTSTATUS LoopbackAddResponse(PEC_CORE Core, EC_FW_REQUEST Request, size_t *Information)
+{
+    EC_LOOPBACK *loopback = &Core->Loopback;
+    LoopbackResponseReq_t *req = NULL;
+    LoopbackRsp_t *rsp = NULL;
+    size_t length = 0;
+    UINT32 header[LOOPBACK_OUTPUT_HEADER / sizeof(UINT32)];
+    UINT32 i;
+    NTSTATUS status;
+
+    status = EcFwRetrieveInputBuffer(Request, sizeof(LoopbackResponseReq_t), (PVOID *)&req, &length);
+    if (NT_SUCCESS(status)) {
+        status = EcFwRetrieveOutputBuffer(Request, sizeof(LoopbackRsp_t), (PVOID *)&rsp, &length);
+    }
+    if (!NT_SUCCESS(status)) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    // Name must be terminated and the response must describe itself correctly
+    if (req->method[0] == '\0' || req->method[LOOPBACK_MAX_NAME - 1] != '\0' ||
+        req->length < LOOPBACK_OUTPUT_HEADER || req->length > LOOPBACK_MAX_RESPONSE) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    RtlCopyMemory(header, req->response, sizeof(header));
+    if (header[0] != LOOPBACK_OUTPUT_SIGNATURE || header[1] != req->length) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    EcFwLockAcquire(loopback->Lock);
+    for (i = 0; i < loopback->Count; i++) {
+        if (LoopbackNameMatches(loopback->Entries[i].method, req->method, LOOPBACK_MAX_NAME)) {
+            break;
+        }
+    }
+    if (i == LOOPBACK_MAX_ENTRIES) {
+        status = STATUS_INSUFFICIENT_RESOURCES;
+    } else {
+        RtlCopyMemory(&loopback->Entries[i], req, sizeof(LoopbackResponseReq_t));
+        if (i == loopback->Count) {
+            loopback->Count++;
+        }
+        status = STATUS_SUCCESS;
+    }
+    LoopbackGetStatus(loopback, rsp);
+    EcFwLockRelease(loopback->Lock);
+
+    if (NT_SUCCESS(status)) {
+        Trace(TRACE_LEVEL_INFORMATION, TRACE_QUEUE,"Loopback response for %s, %lu bytes\n", req->method, req->length);
+        *Information = sizeof(LoopbackRsp_t);
+    }
+    return status;
+}
+#endif // EC_TEST_LOOPBACK
+
+/*
+ * Function: NTSTATUS EvaluateBuffer
+ *
+ * Description:
+ * Evaluates a method through ACPI, or from the loopback table when loopback is enabled.
+ *
+ * Parameters:
+ * Core - The core state of the device.
+ * Input - The ACPI evaluation input buffer.
+ * InputLength - The length of the input buffer.
+ * Output - The buffer receiving the evaluation output.
+ * OutputLength - The length of the output buffer.
+ * BytesReturned - Receives the number of bytes written to the output buffer.
+ *
+ * Return Value:
+ * NTSTATUS status code indicating the success or failure of the evaluation.
+ *
+ */
+static NTSTATUS EvaluateBuffer(
+    PEC_CORE Core,
+    PVOID Input,
+    size_t InputLength,
+    PVOID Output,
+    size_t OutputLength,
+    ULONG *BytesReturned
+    )
+{
+    NTSTATUS status;
+
+#ifdef EC_TEST_LOOPBACK
+    if (LoopbackEvaluate(Core, Input, InputLength, Output, OutputLength, BytesReturned, &status)) {
+        return status;
+    }
+#endif
+    status = EcFwEvaluateAcpi(Core, Input, InputLength, Output, OutputLength, BytesReturned);
+    return status;
+}
+
+/*
+ * Function: NTSTATUS Evaluate
+ *
+ * Description:
+ * Forwards an IOCTL_ACPI_EVAL_METHOD_EX request to ACPI, or answers it from
+ * the loopback table when loopback is enabled.
+ *
+ * Parameters:
+ * Core - The core state of the device.
+ * Request - The evaluation request.
+ * Information - Receives the number of bytes returned.
+ *
+ * Return Value:
+ * NTSTATUS status code indicating the success or failure of the operation.
+ *
+ */
+static NTSTATUS Evaluate(PEC_CORE Core, EC_FW_REQUEST Request, size_t *Information)
+{
+    // Input buffer should be one of the ACPI buffer types documented here
+    // https://learn.microsoft.com/en-us/windows-hardware/drivers/ddi/acpiioct/
+    PVOID inputBuffer = NULL;
+    PVOID outBuf = NULL;
+    size_t bufSize = 0;
+    size_t outSize = 0;
+    ULONG BytesReturned = 0;
+    NTSTATUS status = STATUS_SUCCESS;
+
+    status = EcFwRetrieveInputBuffer(Request, 0, &inputBuffer, &bufSize);
+    if (!NT_SUCCESS(status)) {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    // Determine the size of output buffer and only give this much space to ACPI request
+    status = EcFwRetrieveOutputBuffer(Request, 0, &outBuf, &outSize);
+    if (!NT_SUCCESS(status)) {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    status = EvaluateBuffer(Core, inputBuffer, bufSize, outBuf, outSize, &BytesReturned);
+
+    *Information = BytesReturned;
+    return status;
+}
+
+#ifdef EC_TEST_SAMPLER
+//
+// Layout of ACPI_EVAL_INPUT_BUFFER_V1_EX
+//
+typedef struct _SAMPLER_INPUT
+{
+    UINT32 Signature;
+    CHAR MethodName[256];
+} SAMPLER_INPUT;
+
+//
+// Subscription completed by EcCoreSample once the sampling lock is dropped
+//
+typedef struct _SAMPLER_COMPLETION
+{
+    EC_FW_REQUEST Request;
+    SamplerSubscribeRsp_t Rsp;
+} SAMPLER_COMPLETION;
+
+/*
+ * Function: NTSTATUS SamplerParseInteger
+ *
+ * Description:
+ * Extracts the integer from an ACPI_EVAL_OUTPUT_BUFFER_V1 holding one integer argument.
+ *
+ * Parameters:
+ * Output - The evaluation output.
+ * Length - Bytes of output returned.
+ * Value - Receives the integer.
+ *
+ * Return Value:
+ * STATUS_SUCCESS, or STATUS_INVALID_PARAMETER if the method did not return one integer.
+ *
+ */
+static NTSTATUS SamplerParseInteger(const UINT8 *Output, ULONG Length, UINT64 *Value)
+{
+    UINT32 header[LOOPBACK_OUTPUT_HEADER / sizeof(UINT32)];
+    UINT16 type;
+    UINT16 dataLength;
+    UINT32 value32;
+
+    if (Length < LOOPBACK_OUTPUT_HEADER + 2 * sizeof(UINT16) + sizeof(UINT32)) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    RtlCopyMemory(header, Output, sizeof(header));
+    RtlCopyMemory(&type, Output + LOOPBACK_OUTPUT_HEADER, sizeof(type));
+    RtlCopyMemory(&dataLength, Output + LOOPBACK_OUTPUT_HEADER + sizeof(type), sizeof(dataLength));
+    if (header[0] != LOOPBACK_OUTPUT_SIGNATURE || header[2] < 1 || type != 0) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    // ACPI_METHOD_ARGUMENT_INTEGER, 64-bit when the namespace uses 64-bit integers
+    Output += LOOPBACK_OUTPUT_HEADER + 2 * sizeof(UINT16);
+    if (dataLength == sizeof(UINT64) && Length >= LOOPBACK_OUTPUT_HEADER + 2 * sizeof(UINT16) + sizeof(UINT64)) {
+        RtlCopyMemory(Value, Output, sizeof(UINT64));
+    } else {
+        RtlCopyMemory(&value32, Output, sizeof(value32));
+        *Value = value32;
+    }
+    return STATUS_SUCCESS;
+}
+
+/*
+ * Function: int SamplerMoved
+ *
+ * Description:
+ * Tells whether a sample moved far enough to be reported.
+ *
+ * Parameters:
+ * Seen - The value the subscriber last saw.
+ * Deadband - The largest change that is not reported.
+ * Value - The new sample.
+ *
+ * Return Value:
+ * Nonzero if the sample is further than Deadband from Seen.
+ *
+ */
+static int SamplerMoved(UINT64 Seen, UINT64 Deadband, UINT64 Value)
+{
+    UINT64 delta = (Value > Seen) ? Value - Seen : Seen - Value;
+
+    return delta > Deadband;
+}
+
+/*
+ * Function: VOID SamplerGetSample
+ *
+ * Description:
+ * Fills in the response describing the latest sample. Called with the sampling lock held.
+ *
+ * Parameters:
+ * Sampling - The sampling state.
+ * Index - The sampler.
+ * Rsp - Receives the sample.
+ *
+ * Return Value:
+ * VOID
+ *
+ */
+static VOID SamplerGetSample(EC_SAMPLING *Sampling, UINT32 Index, SamplerSubscribeRsp_t *Rsp)
+{
+    const EC_SAMPLER *sampler = &Sampling->Samplers[Index];
+
+    Rsp->value = sampler->Value;
+    Rsp->timestamp = (UINT64)sampler->Timestamp;
+    Rsp->samples = sampler->Samples;
+    Rsp->sampler = Index;
+    Rsp->status = (UINT32)sampler->Status;
+}
+
+/*
+ * Function: VOID SamplerSchedule
+ *
+ * Description:
+ * Arms the timer for the earliest due sampler, if any. Called with the sampling lock held.
+ *
+ * Parameters:
+ * Core - The core state of the device.
+ * Now - The current system time.
+ *
+ * Return Value:
+ * VOID
+ *
+ */
+static VOID SamplerSchedule(PEC_CORE Core, LONGLONG Now)
+{
+    EC_SAMPLING *sampling = &Core->Sampling;
+    LONGLONG due = 0;
+    int armed = 0;
+    UINT32 i;
+
+    if (sampling->Stopping) {
+        return;
+    }
+    for (i = 0; i < SAMPLER_MAX_METHODS; i++) {
+        if (sampling->Samplers[i].Period != 0 && (!armed || sampling->Samplers[i].Due < due)) {
+            due = sampling->Samplers[i].Due;
+            armed = 1;
+        }
+    }
+    if (armed) {
+        EcFwSamplerSchedule(Core, (due > Now) ? (ULONG)((due - Now + SAMPLER_TICKS_PER_MS - 1) / SAMPLER_TICKS_PER_MS) : 0);
+    }
+}
+
+/*
+ * Function: VOID SamplerDrop
+ *
+ * Description:
+ * Removes the subscribers of a sampler, or of every sampler, optionally only
+ * those of one file object. Pended requests are unmarked cancelable and moved to
+ * Completions for the caller to complete once the lock is dropped, requests
+ * already being cancelled are left to the cancel routine. Events are
+ * dereferenced. Called with the sampling lock held.
+ *
+ * Parameters:
+ * Sampling - The sampling state.
+ * Index - The sampler, or SAMPLER_MAX_METHODS for all of them.
+ * File - The file object whose subscribers are removed, or NULL for all of them.
+ * Completions - Receives the requests to complete, SAMPLER_MAX_SUBSCRIBERS entries.
+ *
+ * Return Value:
+ * The number of requests placed in Completions.
+ *
+ */
+static UINT32 SamplerDrop(EC_SAMPLING *Sampling, UINT32 Index, EC_FW_HANDLE File, SAMPLER_COMPLETION *Completions)
+{
+    UINT32 count = 0;
+    UINT32 i;
+
+    for (i = 0; i < SAMPLER_MAX_SUBSCRIBERS; i++) {
+        EC_SUBSCRIBER *subscriber = &Sampling->Subscribers[i];
+
+        if ((Index != SAMPLER_MAX_METHODS && subscriber->Sampler != Index) ||
+            (File != NULL && subscriber->File != File) ||
+            (subscriber->Request == NULL && subscriber->Event == NULL)) {
+            continue;
+        }
+        // Unmarked under the lock like EcCoreNotify does, once the subscriber is
+        // gone the cancel routine completes the request without looking for it
+        if (subscriber->Request != NULL && STATUS_CANCELLED != EcFwRequestUnmarkCancelable(subscriber->Request)) {
+            Completions[count].Request = subscriber->Request;
+            SamplerGetSample(Sampling, subscriber->Sampler, &Completions[count].Rsp);
+            count++;
+        }
+        if (subscriber->Event != NULL) {
+            EcFwEventDereference(subscriber->Event);
+        }
+        RtlZeroMemory(subscriber, sizeof(*subscriber));
+    }
+    return count;
+}
+
+/*
+ * Function: VOID SamplerComplete
+ *
+ * Description:
+ * Completes subscriptions taken off the subscriber table, already unmarked
+ * cancelable under the sampling lock.
+ *
+ * Parameters:
+ * Completions - The requests and the samples to return.
+ * Count - The number of requests.
+ * Status - STATUS_SUCCESS to return the sample, otherwise the status to fail them with.
+ *
+ * Return Value:
+ * VOID
+ *
+ */
+static VOID SamplerComplete(SAMPLER_COMPLETION *Completions, UINT32 Count, NTSTATUS Status)
+{
+    SamplerSubscribeRsp_t *rsp = NULL;
+    size_t rspSize = 0;
+    NTSTATUS status;
+    UINT32 i;
+
+    for (i = 0; i < Count; i++) {
+        if (!NT_SUCCESS(Status)) {
+            EcFwRequestComplete(Completions[i].Request, Status, 0);
+            continue;
+        }
+        status = EcFwRetrieveOutputBuffer(Completions[i].Request, sizeof(SamplerSubscribeRsp_t), (PVOID *)&rsp, &rspSize);
+        if (NT_SUCCESS(status)) {
+            RtlCopyMemory(rsp, &Completions[i].Rsp, sizeof(SamplerSubscribeRsp_t));
+            EcFwRequestComplete(Completions[i].Request, STATUS_SUCCESS, sizeof(SamplerSubscribeRsp_t));
+        } else {
+            EcFwRequestComplete(Completions[i].Request, status, 0);
+        }
+    }
+}
+
+/*
+ * Function: VOID EcCoreSample
+ *
+ * Description:
+ * Evaluates every registered method that is due and wakes the subscribers whose
+ * deadband the result moved beyond, then arms the timer for the next due method.
+ * Methods are evaluated without the sampling lock held, so a method unregistered
+ * meanwhile has its result dropped.
+ *
+ * Parameters:
+ * Core - The core state of the device.
+ *
+ * Return Value:
+ * VOID
+ *
+ */
+VOID EcCoreSample(PEC_CORE Core)
+{
+    EC_SAMPLING *sampling = &Core->Sampling;
+    SAMPLER_INPUT input;
+    UINT8 output[SAMPLER_OUTPUT_SIZE];
+    SAMPLER_COMPLETION completions[SAMPLER_MAX_SUBSCRIBERS];
+    UINT32 generation[SAMPLER_MAX_METHODS];
+    UINT32 due[SAMPLER_MAX_METHODS];
+    UINT32 dueCount = 0;
+    UINT32 count = 0;
+    ULONG bytesReturned;
+    LONGLONG now = EcFwQuerySystemTime();
+    UINT64 value = 0;
+    NTSTATUS status;
+    UINT32 i;
+    UINT32 j;
+
+    EcFwLockAcquire(sampling->Lock);
+    if (sampling->Stopping) {
+        EcFwLockRelease(sampling->Lock);
+        return;
+    }
+    for (i = 0; i < SAMPLER_MAX_METHODS; i++) {
+        EC_SAMPLER *sampler = &sampling->Samplers[i];
+
+        if (sampler->Period != 0 && sampler->Due <= now) {
+            // Claimed here so an overlapping pass does not sample it twice
+            sampler->Due += (LONGLONG)sampler->Period * SAMPLER_TICKS_PER_MS;
+            if (sampler->Due <= now) {
+                sampler->Due = now + (LONGLONG)sampler->Period * SAMPLER_TICKS_PER_MS;
+            }
+            generation[dueCount] = sampler->Generation;
+            due[dueCount++] = i;
+        }
+    }
+    EcFwLockRelease(sampling->Lock);
+
+    for (i = 0; i < dueCount; i++) {
+        EC_SAMPLER *sampler = &sampling->Samplers[due[i]];
+
+        RtlZeroMemory(&input, sizeof(input));
+        input.Signature = ACPI_EVAL_INPUT_BUFFER_SIGNATURE_EX;
+        EcFwLockAcquire(sampling->Lock);
+        RtlCopyMemory(input.MethodName, sampler->Method, LOOPBACK_MAX_NAME);
+        EcFwLockRelease(sampling->Lock);
+
+        bytesReturned = 0;
+        status = EvaluateBuffer(Core, &input, sizeof(input), output, sizeof(output), &bytesReturned);
+        if (NT_SUCCESS(status)) {
+            status = SamplerParseInteger(output, bytesReturned, &value);
+        }
+
+        EcFwLockAcquire(sampling->Lock);
+        if (sampler->Period == 0 || sampler->Generation != generation[i]) {
+            EcFwLockRelease(sampling->Lock);
+            continue;
+        }
+        sampling->Samples++;
+        sampler->Samples++;
+        sampler->Status = status;
+        if (NT_SUCCESS(status)) {
+            sampler->Value = value;
+            sampler->Timestamp = EcFwQuerySystemTime();
+            sampler->Valid = 1;
+
+            for (j = 0; j < SAMPLER_MAX_SUBSCRIBERS; j++) {
+                EC_SUBSCRIBER *subscriber = &sampling->Subscribers[j];
+
+                if (subscriber->Sampler != due[i] || (subscriber->Request == NULL && subscriber->Event == NULL) ||
+                    (subscriber->HasValue && !SamplerMoved(subscriber->Value, subscriber->Deadband, value))) {
+                    continue;
+                }
+                sampling->Wakeups++;
+                if (subscriber->Request != NULL) {
+                    // A cancelled request is left to the cancel routine
+                    if (STATUS_CANCELLED != EcFwRequestUnmarkCancelable(subscriber->Request)) {
+                        completions[count].Request = subscriber->Request;
+                        SamplerGetSample(sampling, due[i], &completions[count].Rsp);
+                        count++;
+                    }
+                    RtlZeroMemory(subscriber, sizeof(*subscriber));
+                } else {
+                    subscriber->Value = value;
+                    subscriber->HasValue = 1;
+                    EcFwEventSignal(subscriber->Event);
+                }
+            }
+        }
+        EcFwLockRelease(sampling->Lock);
+    }
+
+    EcFwLockAcquire(sampling->Lock);
+    SamplerSchedule(Core, EcFwQuerySystemTime());
+    EcFwLockRelease(sampling->Lock);
+
+    SamplerComplete(completions, count, STATUS_SUCCESS);
+}
+
+/*
+ * Function: NTSTATUS SamplerRegister
+ *
+ * Description:
+ * Handles IOCTL_SAMPLER_REGISTER, registering a method to sample or changing its
+ * period. A period of 0 unregisters it and fails its pending subscriptions with
+ * STATUS_OBJECT_NAME_NOT_FOUND.
+ *
+ * Parameters:
+ * Core - The core state of the device.
+ * Request - The IOCTL_SAMPLER_REGISTER request.
+ * Information - Receives the number of bytes returned.
+ *
+ * Return Value:
+ * NTSTATUS status code indicating the success or failure of the operation.
+ *
+ */
+static NTSTATUS SamplerRegister(PEC_CORE Core, EC_FW_REQUEST Request, size_t *Information)
+{
+    EC_SAMPLING *sampling = &Core->Sampling;
+    SAMPLER_COMPLETION completions[SAMPLER_MAX_SUBSCRIBERS];
+    SamplerRegisterReq_t *req = NULL;
+    SamplerRegisterRsp_t *rsp = NULL;
+    size_t length = 0;
+    UINT32 count = 0;
+    UINT32 slot = SAMPLER_MAX_METHODS;
+    UINT32 i;
+    NTSTATUS status;
+
+    status = EcFwRetrieveInputBuffer(Request, sizeof(SamplerRegisterReq_t), (PVOID *)&req, &length);
+    if (NT_SUCCESS(status)) {
+        status = EcFwRetrieveOutputBuffer(Request, sizeof(SamplerRegisterRsp_t), (PVOID *)&rsp, &length);
+    }
+    if (!NT_SUCCESS(status)) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    if (req->method[0] == '\0' || req->method[LOOPBACK_MAX_NAME - 1] != '\0' ||
+        (req->period_ms != 0 && req->period_ms < SAMPLER_MIN_PERIOD_MS)) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    EcFwLockAcquire(sampling->Lock);
+    for (i = 0; i < SAMPLER_MAX_METHODS; i++) {
+        if (sampling->Samplers[i].Period != 0 &&
+            LoopbackNameMatches(sampling->Samplers[i].Method, req->method, LOOPBACK_MAX_NAME)) {
+            slot = i;
+            break;
+        }
+        if (sampling->Samplers[i].Period == 0 && slot == SAMPLER_MAX_METHODS) {
+            slot = i;
+        }
+    }
+
+    status = STATUS_SUCCESS;
+    if (req->period_ms == 0) {
+        if (slot == SAMPLER_MAX_METHODS || sampling->Samplers[slot].Period == 0) {
+            status = STATUS_OBJECT_NAME_NOT_FOUND;
+        } else {
+            count = SamplerDrop(sampling, slot, NULL, completions);
+            sampling->Samplers[slot].Period = 0;
+            sampling->Samplers[slot].Generation++;
+        }
+    } else if (slot == SAMPLER_MAX_METHODS) {
+        status = STATUS_INSUFFICIENT_RESOURCES;
+    } else {
+        EC_SAMPLER *sampler = &sampling->Samplers[slot];
+
+        if (sampler->Period == 0) {
+            UINT32 generation = sampler->Generation + 1;
+
+            RtlZeroMemory(sampler, sizeof(*sampler));
+            RtlCopyMemory(sampler->Method, req->method, LOOPBACK_MAX_NAME);
+            sampler->Generation = generation;
+        }
+        sampler->Period = req->period_ms;
+        sampler->Due = EcFwQuerySystemTime();
+        SamplerSchedule(Core, sampler->Due);
+    }
+
+    rsp->sampler = slot;
+    rsp->methods = 0;
+    for (i = 0; i < SAMPLER_MAX_METHODS; i++) {
+        rsp->methods += (sampling->Samplers[i].Period != 0) ? 1 : 0;
+    }
+    rsp->samples = sampling->Samples;
+    rsp->wakeups = sampling->Wakeups;
+    EcFwLockRelease(sampling->Lock);
+
+    SamplerComplete(completions, count, STATUS_OBJECT_NAME_NOT_FOUND);
+    if (NT_SUCCESS(status)) {
+        Trace(TRACE_LEVEL_INFORMATION, TRACE_QUEUE,"Sampler %lu %s every %lums\n", slot, req->method, req->period_ms);
+        *Information = sizeof(SamplerRegisterRsp_t);
+    }
+    return status;
+}
+
+/*
+ * Function: NTSTATUS SamplerSubscribe
+ *
+ * Description:
+ * Handles IOCTL_SAMPLER_SUBSCRIBE. The request is completed at once if the latest
+ * sample already moved beyond the deadband, otherwise it is pended until one does.
+ * Event subscriptions are added or updated and completed at once with the latest
+ * sample. The event handle is resolved here, in the context of the caller.
+ *
+ * Parameters:
+ * Core - The core state of the device.
+ * Request - The IOCTL_SAMPLER_SUBSCRIBE request.
+ * Information - Receives the number of bytes returned.
+ *
+ * Return Value:
+ * STATUS_PENDING if the request was pended, otherwise the status to complete it with.
+ *
+ */
+static NTSTATUS SamplerSubscribe(PEC_CORE Core, EC_FW_REQUEST Request, size_t *Information)
+{
+    EC_SAMPLING *sampling = &Core->Sampling;
+    SamplerSubscribeReq_t *req = NULL;
+    SamplerSubscribeRsp_t *rsp = NULL;
+    EC_SUBSCRIBER *subscriber = NULL;
+    EC_FW_HANDLE event = NULL;
+    EC_FW_HANDLE file = EcFwRequestFile(Request);
+    EC_SAMPLER *sampler;
+    size_t length = 0;
+    UINT32 i;
+    NTSTATUS status;
+
+    status = EcFwRetrieveInputBuffer(Request, sizeof(SamplerSubscribeReq_t), (PVOID *)&req, &length);
+    if (NT_SUCCESS(status)) {
+        status = EcFwRetrieveOutputBuffer(Request, sizeof(SamplerSubscribeRsp_t), (PVOID *)&rsp, &length);
+    }
+    if (!NT_SUCCESS(status) || req->sampler >= SAMPLER_MAX_METHODS) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    if (req->flags & (SAMPLER_SUBSCRIBE_EVENT | SAMPLER_SUBSCRIBE_REMOVE)) {
+        status = EcFwEventReference(Core, req->event, &event);
+        if (!NT_SUCCESS(status)) {
+            return status;
+        }
+    }
+
+    EcFwLockAcquire(sampling->Lock);
+    sampler = &sampling->Samplers[req->sampler];
+    if (sampler->Period == 0) {
+        status = STATUS_OBJECT_NAME_NOT_FOUND;
+        goto Exit;
+    }
+
+    if (event != NULL) {
+        for (i = 0; i < SAMPLER_MAX_SUBSCRIBERS; i++) {
+            if (sampling->Subscribers[i].Event == event && sampling->Subscribers[i].Sampler == req->sampler &&
+                sampling->Subscribers[i].File == file) {
+                subscriber = &sampling->Subscribers[i];
+                break;
+            }
+        }
+        if (req->flags & SAMPLER_SUBSCRIBE_REMOVE) {
+            if (subscriber == NULL) {
+                status = STATUS_OBJECT_NAME_NOT_FOUND;
+                goto Exit;
+            }
+            EcFwEventDereference(subscriber->Event);
+            RtlZeroMemory(subscriber, sizeof(*subscriber));
+            SamplerGetSample(sampling, req->sampler, rsp);
+            *Information = sizeof(SamplerSubscribeRsp_t);
+            goto Exit;
+        }
+    } else if (req->flags & SAMPLER_SUBSCRIBE_CURRENT) {
+        if (sampler->Valid) {
+            SamplerGetSample(sampling, req->sampler, rsp);
+            *Information = sizeof(SamplerSubscribeRsp_t);
+            goto Exit;
+        }
+    } else if (sampler->Valid && SamplerMoved(req->value, req->deadband, sampler->Value)) {
+        SamplerGetSample(sampling, req->sampler, rsp);
+        *Information = sizeof(SamplerSubscribeRsp_t);
+        goto Exit;
+    }
+
+    if (subscriber == NULL) {
+        for (i = 0; i < SAMPLER_MAX_SUBSCRIBERS; i++) {
+            if (sampling->Subscribers[i].Request == NULL && sampling->Subscribers[i].Event == NULL) {
+                subscriber = &sampling->Subscribers[i];
+                break;
+            }
+        }
+        if (subscriber == NULL) {
+            status = STATUS_DEVICE_BUSY;
+            goto Exit;
+        }
+    }
+
+    subscriber->Sampler = req->sampler;
+    subscriber->File = file;
+    subscriber->Value = req->value;
+    subscriber->Deadband = req->deadband;
+    subscriber->HasValue = (req->flags & SAMPLER_SUBSCRIBE_CURRENT) ? 0 : 1;
+    if (event != NULL) {
+        // The sample returned is what the subscriber has now seen. An existing
+        // subscription keeps its reference and only takes the new baseline and deadband
+        subscriber->Value = sampler->Value;
+        subscriber->HasValue = sampler->Valid;
+        if (subscriber->Event == NULL) {
+            subscriber->Event = event;
+            event = NULL;
+        }
+        SamplerGetSample(sampling, req->sampler, rsp);
+        *Information = sizeof(SamplerSubscribeRsp_t);
+        goto Exit;
+    }
+
+    // Mark cancelable and publish under the same lock, like NotificationGet
+    status = EcFwRequestMarkCancelable(Core, Request);
+    if (NT_SUCCESS(status)) {
+        subscriber->Request = Request;
+        status = STATUS_PENDING;
+    } else {
+        RtlZeroMemory(subscriber, sizeof(*subscriber));
+    }
+
+Exit:
+    EcFwLockRelease(sampling->Lock);
+
+    // Still set unless the reference was handed to a new subscriber
+    if (event != NULL) {
+        EcFwEventDereference(event);
+    }
+    return status;
+}
+#endif // EC_TEST_SAMPLER
+
+#ifdef EC_TEST_MSG_SEND2
+/*
+ * Function: NTSTATUS MessageExchange
+ *
+ * Description:
+ * Writes one indirect message into the TX buffer, signals it with
+ * FFA_MSG_SEND2 and waits for the EC to place the matching response in the RX
+ * buffer. Responses to earlier messages that timed out are dropped. Called with
+ * MessageLock held, on success the caller consumes the response and calls
+ * EcFwMessageRelease.
+ *
+ * Parameters:
+ * Core - The core state of the device.
+ * Tx - The TX buffer.
+ * Rx - The RX buffer.
+ * Size - The size of each buffer.
+ * Header - The message header, Sequence is filled in.
+ * Payload - Header->Length bytes sent after the header.
+ * Reply - Receives the response in the RX buffer.
+ *
+ * Return Value:
+ * NTSTATUS status code indicating the success or failure of the operation.
+ *
+ */
+static NTSTATUS MessageExchange(
+    PEC_CORE Core,
+    PVOID Tx,
+    PVOID Rx,
+    size_t Size,
+    EC_MSG_HEADER *Header,
+    const VOID *Payload,
+    const EC_MSG_HEADER **Reply
+    )
+{
+    const EC_MSG_HEADER *reply = NULL;
+    UINT16 sender;
+    UINT16 receiver;
+    ULONG waited;
+    NTSTATUS status;
+
+    Header->Sequence = ++Core->MessageSequence;
+    if (EcMsgBuild(Tx, Size, EC_HOST_VMID, EC_SERVICE_VMID, Header, Payload) == 0) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    status = EcFwMessageSend(Core);
+    if (!NT_SUCCESS(status)) {
+        Trace(TRACE_LEVEL_ERROR, TRACE_QUEUE,"FFA_MSG_SEND2 failed %!STATUS!\n", status);
+        return status;
+    }
+
+    for (waited = 0; ; waited += EC_MSG_POLL_US) {
+        reply = EcMsgParse(Rx, Size, &sender, &receiver);
+        if (reply != NULL) {
+            if (sender == EC_SERVICE_VMID && reply->Sequence == Header->Sequence) {
+                break;
+            }
+            // Late response to a message that timed out, drop it
+            Trace(TRACE_LEVEL_ERROR, TRACE_QUEUE,"Dropping message %u from 0x%x\n", reply->Sequence, sender);
+            EcFwMessageRelease(Core);
+            reply = NULL;
+        }
+        if (waited >= EC_MSG_TIMEOUT_US) {
+            return STATUS_IO_TIMEOUT;
+        }
+        EcFwDelay(EC_MSG_POLL_US);
+    }
+
+    *Reply = reply;
+    return STATUS_SUCCESS;
+}
+
+/*
+ * Function: NTSTATUS MessageSend2
+ *
+ * Description:
+ * Handles IOCTL_FFA_MSG_SEND2. Sends the request to the EC as one indirect
+ * message and returns its response, so a bulk operation costs one round trip
+ * instead of one direct request per 112 bytes.
+ *
+ * Parameters:
+ * Core - The core state of the device.
+ * Request - The IOCTL_FFA_MSG_SEND2 request, MsgSend2Req_t and payload in,
+ *           MsgSend2Rsp_t and payload out.
+ * Information - Receives the number of bytes returned.
+ *
+ * Return Value:
+ * NTSTATUS status code indicating the success or failure of the operation.
+ * STATUS_BUFFER_OVERFLOW returns only the MsgSend2Rsp_t, with the payload
+ * length the caller needs to allow for.
+ *
+ */
+static NTSTATUS MessageSend2(PEC_CORE Core, EC_FW_REQUEST Request, size_t *Information)
+{
+    MsgSend2Req_t *req = NULL;
+    MsgSend2Rsp_t *rsp = NULL;
+    size_t inSize = 0;
+    size_t outSize = 0;
+    EC_MSG_HEADER header;
+    const EC_MSG_HEADER *reply = NULL;
+    PVOID tx = NULL;
+    PVOID rx = NULL;
+    size_t size = 0;
+    NTSTATUS status;
+
+    status = EcFwRetrieveInputBuffer(Request, sizeof(MsgSend2Req_t), (PVOID *)&req, &inSize);
+    if (NT_SUCCESS(status)) {
+        status = EcFwRetrieveOutputBuffer(Request, sizeof(MsgSend2Rsp_t), (PVOID *)&rsp, &outSize);
+    }
+    if (!NT_SUCCESS(status) || req->length > inSize - sizeof(MsgSend2Req_t) || req->length > EC_MSG_MAX_PAYLOAD) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    RtlCopyMemory(header.Service, req->service, sizeof(header.Service));
+    header.Command = req->command;
+    header.Status = EC_MSG_STATUS_SUCCESS;
+    header.Length = req->length;
+
+    EcFwLockAcquire(Core->MessageLock);
+    status = EcFwMessageBuffers(Core, &tx, &rx, &size);
+    if (NT_SUCCESS(status)) {
+        status = MessageExchange(Core, tx, rx, size, &header, req + 1, &reply);
+    }
+    if (!NT_SUCCESS(status)) {
+        goto Exit;
+    }
+
+    rsp->status = reply->Status;
+    rsp->length = reply->Length;
+    if (reply->Length > outSize - sizeof(MsgSend2Rsp_t)) {
+        status = STATUS_BUFFER_OVERFLOW;
+        *Information = sizeof(MsgSend2Rsp_t);
+    } else {
+        RtlCopyMemory(rsp + 1, reply + 1, reply->Length);
+        *Information = sizeof(MsgSend2Rsp_t) + reply->Length;
+    }
+    EcFwMessageRelease(Core);
+
+Exit:
+    EcFwLockRelease(Core->MessageLock);
+    return status;
+}
+#endif // EC_TEST_MSG_SEND2
+
+#ifdef EC_TEST_MEM_SHARE
+/*
+ * Function: NTSTATUS ShareMessage
+ *
+ * Description:
+ * Sends a management message about a shared region and returns the status
+ * the EC answered with. Called with MessageLock held.
+ *
+ * Parameters:
+ * Core - The core state of the device.
+ * Command - EC_MSG_CMD_MAP_SHARE or EC_MSG_CMD_UNMAP_SHARE.
+ * Payload - The retrieve descriptor or the handle.
+ * Length - The length of the payload.
+ * EcStatus - Receives the EC_MSG_STATUS_* of the response.
+ *
+ * Return Value:
+ * NTSTATUS status code indicating the success or failure of the operation.
+ *
+ */
+static NTSTATUS ShareMessage(PEC_CORE Core, UINT8 Command, const VOID *Payload, UINT32 Length, UINT32 *EcStatus)
+{
+    EC_MSG_HEADER header;
+    const EC_MSG_HEADER *reply = NULL;
+    PVOID tx = NULL;
+    PVOID rx = NULL;
+    size_t size = 0;
+    NTSTATUS status;
+
+    RtlCopyMemory(header.Service, EcMsgManagementService, sizeof(header.Service));
+    header.Command = Command;
+    header.Status = EC_MSG_STATUS_SUCCESS;
+    header.Length = Length;
+
+    status = EcFwMessageBuffers(Core, &tx, &rx, &size);
+    if (NT_SUCCESS(status)) {
+        status = MessageExchange(Core, tx, rx, size, &header, Payload, &reply);
+    }
+    if (NT_SUCCESS(status)) {
+        *EcStatus = reply->Status;
+        EcFwMessageRelease(Core);
+    }
+    return status;
+}
+
+/*
+ * Function: NTSTATUS ShareRelease
+ *
+ * Description:
+ * Asks the EC to unmap a shared region, reclaims it and frees the memory.
+ * The memory is kept if the reclaim fails since the EC may still access it.
+ * Called with MessageLock held.
+ *
+ * Parameters:
+ * Core - The core state of the device.
+ * Share - The region to release.
+ * EcStatus - Receives the EC_MSG_STATUS_* of the unmap.
+ *
+ * Return Value:
+ * NTSTATUS status code indicating the success or failure of the operation.
+ *
+ */
+static NTSTATUS ShareRelease(PEC_CORE Core, EC_SHARE *Share, UINT32 *EcStatus)
+{
+    NTSTATUS status;
+
+    status = ShareMessage(Core, EC_MSG_CMD_UNMAP_SHARE, &Share->Handle, sizeof(Share->Handle), EcStatus);
+    if (!NT_SUCCESS(status)) {
+        Trace(TRACE_LEVEL_ERROR, TRACE_QUEUE,"Unmap of share 0x%llx failed %!STATUS!\n", Share->Handle, status);
+    }
+
+    // An EC that never mapped the region or lost track of it lets the reclaim succeed
+    status = EcFwMemReclaim(Core, Share->Handle);
+    if (!NT_SUCCESS(status)) {
+        Trace(TRACE_LEVEL_ERROR, TRACE_QUEUE,"FFA_MEM_RECLAIM 0x%llx failed %!STATUS!\n", Share->Handle, status);
+        return status;
+    }
+
+    EcFwShareFree(Core, Share->Buffer, Share->Pages);
+    RtlZeroMemory(Share, sizeof(*Share));
+    return STATUS_SUCCESS;
+}
+
+/*
+ * Function: NTSTATUS MemShare
+ *
+ * Description:
+ * Handles IOCTL_FFA_MEM_SHARE. Allocates a physically contiguous buffer,
+ * shares it with the EC with FFA_MEM_SHARE through the driver RX/TX pair and
+ * passes the retrieve descriptor to the EC in a MAP_SHARE message. If the EC
+ * declines the region is reclaimed and freed again and only the EC status is
+ * returned.
+ *
+ * Parameters:
+ * Core - The core state of the device.
+ * Request - The IOCTL_FFA_MEM_SHARE request, MemShareReq_t in, MemShareRsp_t out.
+ * Information - Receives the number of bytes returned.
+ *
+ * Return Value:
+ * NTSTATUS status code indicating the success or failure of the operation.
+ *
+ */
+static NTSTATUS MemShare(PEC_CORE Core, EC_FW_REQUEST Request, size_t *Information)
+{
+    MemShareReq_t *req = NULL;
+    MemShareRsp_t *rsp = NULL;
+    size_t inSize = 0;
+    size_t outSize = 0;
+    EC_SHARE *share = NULL;
+    FFA_MEM_RANGE range;
+    UINT8 descriptor[sizeof(FFA_MEM_REGION) + sizeof(FFA_MEM_ACCESS) + sizeof(FFA_MEM_COMPOSITE) + sizeof(FFA_MEM_RANGE)];
+    UINT32 length;
+    UINT32 ecStatus = EC_MSG_STATUS_SUCCESS;
+    PVOID tx = NULL;
+    PVOID rx = NULL;
+    size_t size = 0;
+    UINT32 i;
+    NTSTATUS status;
+
+    status = EcFwRetrieveInputBuffer(Request, sizeof(MemShareReq_t), (PVOID *)&req, &inSize);
+    if (NT_SUCCESS(status)) {
+        status = EcFwRetrieveOutputBuffer(Request, sizeof(MemShareRsp_t), (PVOID *)&rsp, &outSize);
+    }
+    if (!NT_SUCCESS(status) || req->pages == 0 || req->pages > EC_SHARE_MAX_PAGES) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    EcFwLockAcquire(Core->MessageLock);
+    for (i = 0; i < EC_SHARE_MAX_REGIONS; i++) {
+        if (Core->Shares[i].Pages == 0) {
+            share = &Core->Shares[i];
+            break;
+        }
+    }
+    if (share == NULL) {
+        status = STATUS_INSUFFICIENT_RESOURCES;
+        goto Exit;
+    }
+
+    status = EcFwMessageBuffers(Core, &tx, &rx, &size);
+    if (!NT_SUCCESS(status)) {
+        goto Exit;
+    }
+
+    status = EcFwShareAllocate(Core, req->pages, &share->Buffer, &share->Address);
+    if (!NT_SUCCESS(status)) {
+        goto Exit;
+    }
+    share->Pages = req->pages;
+    share->File = EcFwRequestFile(Request);
+
+    // The tag tells the EC which slot the region belongs to
+    range.Address = share->Address;
+    range.PageCount = share->Pages;
+    range.Reserved = 0;
+    length = FfaMemBuildShare(tx, (UINT32)size, EC_HOST_VMID, EC_SERVICE_VMID, FFA_MEM_ATTR_NORMAL_WB,
+                              FFA_MEM_PERM_RW, i, &range, 1);
+    if (length == 0 || length > sizeof(descriptor)) {
+        status = STATUS_INVALID_PARAMETER;
+        goto Free;
+    }
+    RtlCopyMemory(descriptor, tx, length);
+
+    status = EcFwMemShare(Core, length, &share->Handle);
+    if (!NT_SUCCESS(status)) {
+        Trace(TRACE_LEVEL_ERROR, TRACE_QUEUE,"FFA_MEM_SHARE failed %!STATUS!\n", status);
+        goto Free;
+    }
+
+    FfaMemBuildRetrieve(descriptor, share->Handle);
+    status = ShareMessage(Core, EC_MSG_CMD_MAP_SHARE, descriptor, length, &ecStatus);
+    if (!NT_SUCCESS(status) || ecStatus != EC_MSG_STATUS_SUCCESS) {
+        UINT32 unmapStatus;
+
+        Trace(TRACE_LEVEL_ERROR, TRACE_QUEUE,"Map of share 0x%llx failed %!STATUS! EC status %u\n",
+              share->Handle, status, ecStatus);
+        if (NT_SUCCESS(ShareRelease(Core, share, &unmapStatus))) {
+            RtlZeroMemory(rsp, sizeof(*rsp));
+            rsp->status = ecStatus;
+            *Information = sizeof(MemShareRsp_t);
+        } else {
+            // Still shared, keep the slot so it is reclaimed on shutdown
+            status = STATUS_DEVICE_BUSY;
+        }
+        goto Exit;
+    }
+
+    rsp->handle = share->Handle;
+    rsp->address = share->Address;
+    rsp->pages = share->Pages;
+    rsp->status = ecStatus;
+    *Information = sizeof(MemShareRsp_t);
+    goto Exit;
+
+Free:
+    EcFwShareFree(Core, share->Buffer, share->Pages);
+    RtlZeroMemory(share, sizeof(*share));
+
+Exit:
+    EcFwLockRelease(Core->MessageLock);
+    return status;
+}
+
+/*
+ * Function: NTSTATUS MemReclaim
+ *
+ * Description:
+ * Handles IOCTL_FFA_MEM_RECLAIM. Asks the EC to unmap the region, reclaims it
+ * with FFA_MEM_RECLAIM and frees the memory. Only the file object the region
+ * was shared on can reclaim it.
+ *
+ * Parameters:
+ * Core - The core state of the device.
+ * Request - The IOCTL_FFA_MEM_RECLAIM request, MemReclaimReq_t in, MemShareRsp_t
+ *           describing the released region out.
+ * Information - Receives the number of bytes returned.
+ *
+ * Return Value:
+ * NTSTATUS status code indicating the success or failure of the operation.
+ *
+ */
+static NTSTATUS MemReclaim(PEC_CORE Core, EC_FW_REQUEST Request, size_t *Information)
+{
+    MemReclaimReq_t *req = NULL;
+    MemShareRsp_t *rsp = NULL;
+    size_t inSize = 0;
+    size_t outSize = 0;
+    MemShareRsp_t released;
+    UINT32 ecStatus = EC_MSG_STATUS_SUCCESS;
+    EC_FW_HANDLE file;
+    UINT32 i;
+    NTSTATUS status;
+
+    status = EcFwRetrieveInputBuffer(Request, sizeof(MemReclaimReq_t), (PVOID *)&req, &inSize);
+    if (NT_SUCCESS(status)) {
+        status = EcFwRetrieveOutputBuffer(Request, sizeof(MemShareRsp_t), (PVOID *)&rsp, &outSize);
+    }
+    if (!NT_SUCCESS(status)) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    file = EcFwRequestFile(Request);
+    EcFwLockAcquire(Core->MessageLock);
+    status = STATUS_INVALID_PARAMETER;
+    for (i = 0; i < EC_SHARE_MAX_REGIONS; i++) {
+        if (Core->Shares[i].Pages != 0 && Core->Shares[i].Handle == req->handle && Core->Shares[i].File == file) {
+            released.handle = Core->Shares[i].Handle;
+            released.address = Core->Shares[i].Address;
+            released.pages = Core->Shares[i].Pages;
+
+            status = ShareRelease(Core, &Core->Shares[i], &ecStatus);
+            if (NT_SUCCESS(status)) {
+                released.status = ecStatus;
+                RtlCopyMemory(rsp, &released, sizeof(released));
+                *Information = sizeof(MemShareRsp_t);
+            }
+            break;
+        }
+    }
+    EcFwLockRelease(Core->MessageLock);
+
+    return status;
+}
+#endif // EC_TEST_MEM_SHARE
+
+/*
+ * Function: VOID EcCoreShutdown
+ *
+ * Description:
+ * Releases what the core still holds before the device goes away. The sampler
+ * timer is stopped and subscriptions are dropped. Regions still shared with the
+ * EC are unmapped, reclaimed and freed.
+ *
+ * Parameters:
+ * Core - The core state of the device.
+ *
+ * Return Value:
+ * VOID
+ *
+ */
+VOID EcCoreShutdown(PEC_CORE Core)
+{
+#ifdef EC_TEST_SAMPLER
+    SAMPLER_COMPLETION completions[SAMPLER_MAX_SUBSCRIBERS];
+    UINT32 count;
+
+    EcFwLockAcquire(Core->Sampling.Lock);
+    Core->Sampling.Stopping = 1;
+    EcFwLockRelease(Core->Sampling.Lock);
+    EcFwSamplerStop(Core);
+
+    EcFwLockAcquire(Core->Sampling.Lock);
+    count = SamplerDrop(&Core->Sampling, SAMPLER_MAX_METHODS, NULL, completions);
+    EcFwLockRelease(Core->Sampling.Lock);
+    SamplerComplete(completions, count, STATUS_CANCELLED);
+#endif // EC_TEST_SAMPLER
+#ifdef EC_TEST_MEM_SHARE
+    UINT32 ecStatus;
+    UINT32 i;
+
+    EcFwLockAcquire(Core->MessageLock);
+    for (i = 0; i < EC_SHARE_MAX_REGIONS; i++) {
+        if (Core->Shares[i].Pages != 0) {
+            // On failure the memory is leaked rather than freed under the EC
+            ShareRelease(Core, &Core->Shares[i], &ecStatus);
+        }
+    }
+    EcFwLockRelease(Core->MessageLock);
+#endif
+    (VOID)Core;
+}
+
+/*
+ * Function: VOID EcCoreFileCleanup
+ *
+ * Description:
+ * Releases what the core holds for a file object once its last handle is
+ * closed, so a client that exits without cleaning up does not keep it until
+ * the device goes away. Its sampler subscriptions are dropped, releasing their
+ * slots and event references, and pended ones are cancelled. Regions it still
+ * shares with the EC are unmapped, reclaimed and freed.
+ *
+ * Parameters:
+ * Core - The core state of the device.
+ * File - The file object being cleaned up.
+ *
+ * Return Value:
+ * VOID
+ *
+ */
+VOID EcCoreFileCleanup(PEC_CORE Core, EC_FW_HANDLE File)
+{
+#ifdef EC_TEST_SAMPLER
+    SAMPLER_COMPLETION completions[SAMPLER_MAX_SUBSCRIBERS];
+    UINT32 count;
+
+    EcFwLockAcquire(Core->Sampling.Lock);
+    count = SamplerDrop(&Core->Sampling, SAMPLER_MAX_METHODS, File, completions);
+    EcFwLockRelease(Core->Sampling.Lock);
+    SamplerComplete(completions, count, STATUS_CANCELLED);
+#endif // EC_TEST_SAMPLER
+#ifdef EC_TEST_MEM_SHARE
+    UINT32 ecStatus;
+    UINT32 i;
+
+    EcFwLockAcquire(Core->MessageLock);
+    for (i = 0; i < EC_SHARE_MAX_REGIONS; i++) {
+        if (Core->Shares[i].Pages != 0 && Core->Shares[i].File == File) {
+            // On failure the slot is kept and reclaimed on shutdown
+            ShareRelease(Core, &Core->Shares[i], &ecStatus);
+        }
+    }
+    EcFwLockRelease(Core->MessageLock);
+#endif
+    (VOID)Core;
+    (VOID)File;
+}
+
+/*
+ * Function: VOID EcCoreWork
+ *
+ * Description:
+ * Handles a request that blocks on ACPI or the EC and completes it. Runs on a
+ * worker queued by EcFwQueueWork.
+ *
+ * Parameters:
+ * Core - The core state of the device.
+ * Request - The request.
+ * IoControlCode - The I/O control code of the request.
+ *
+ * Return Value:
+ * VOID
+ *
+ */
+VOID EcCoreWork(PEC_CORE Core, EC_FW_REQUEST Request, ULONG IoControlCode)
+{
+    size_t information = 0;
+    NTSTATUS status;
+
+    switch (IoControlCode)
+    {
+    case IOCTL_ACPI_EVAL_METHOD_EX:
+        status = Evaluate(Core, Request, &information);
+        break;
+#ifdef EC_TEST_MSG_SEND2
+    case IOCTL_FFA_MSG_SEND2:
+        status = MessageSend2(Core, Request, &information);
+        break;
+#endif // EC_TEST_MSG_SEND2
+#ifdef EC_TEST_MEM_SHARE
+    case IOCTL_FFA_MEM_SHARE:
+        status = MemShare(Core, Request, &information);
+        break;
+    case IOCTL_FFA_MEM_RECLAIM:
+        status = MemReclaim(Core, Request, &information);
+        break;
+#endif // EC_TEST_MEM_SHARE
+    default:
+        status = STATUS_INVALID_PARAMETER;
+        break;
+    }
+
+    EcFwRequestComplete(Request, status, information);
+}
+
+#ifdef EC_TEST_SHARED_BUFFER
+/*
+ * Function: NTSTATUS ReadRxBuffer
+ *
+ * Description:
+ * Reads the first 64 bits of the shared receive buffer into the request.
+ *
+ * Parameters:
+ * Core - The core state of the device.
+ * Request - The IOCTL_READ_RX_BUFFER request.
+ * Information - Receives the number of bytes returned.
+ *
+ * Return Value:
+ * NTSTATUS status code indicating the success or failure of the operation.
+ *
+ */
+static NTSTATUS ReadRxBuffer(PEC_CORE Core, EC_FW_REQUEST Request, size_t *Information)
+{
+    RxBufferRsp_t *rxrsp = NULL;
+    size_t rxSize = 0;
+    UINT64 value = 0;
+    NTSTATUS status;
+
+    status = EcFwRetrieveOutputBuffer(Request, sizeof(RxBufferRsp_t), (PVOID *)&rxrsp, &rxSize);
+    if (!NT_SUCCESS(status)) {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    status = EcFwReadPhysical64(Core, SBSAQEMU_SHARED_MEM_BASE, &value);
+    if (NT_SUCCESS(status)) {
+        rxrsp->data = value;
+        *Information = sizeof(RxBufferRsp_t);
+    }
+    return status;
+}
+#endif // EC_TEST_SHARED_BUFFER
+
+#ifdef EC_TEST_STATIC
+/*
+ * Function: NTSTATUS GetStatic
+ *
+ * Description:
+ * Copies the static snapshot firmware wrote at boot into the request and checks
+ * it there, so a snapshot changing underneath is never returned as valid.
+ *
+ * Parameters:
+ * Core - The core state of the device.
+ * Request - The IOCTL_GET_STATIC request.
+ * Information - Receives the number of bytes returned.
+ *
+ * Return Value:
+ * STATUS_NOT_SUPPORTED if firmware wrote no snapshot, STATUS_DEVICE_DATA_ERROR if
+ * it is corrupt, otherwise the status of the read.
+ *
+ */
+static NTSTATUS GetStatic(PEC_CORE Core, EC_FW_REQUEST Request, size_t *Information)
+{
+    EC_STATIC *snapshot = NULL;
+    size_t length = 0;
+    NTSTATUS status;
+
+    status = EcFwRetrieveOutputBuffer(Request, sizeof(EC_STATIC), (PVOID *)&snapshot, &length);
+    if (!NT_SUCCESS(status)) {
+        return status;
+    }
+
+    status = EcFwReadPhysical(Core, EC_STATIC_BASE, snapshot, sizeof(EC_STATIC));
+    if (!NT_SUCCESS(status)) {
+        return status;
+    }
+
+    switch (EcStaticCheck(snapshot)) {
+    case EC_STATIC_VALID:
+        *Information = sizeof(EC_STATIC);
+        return STATUS_SUCCESS;
+    case EC_STATIC_MISSING:
+        return STATUS_NOT_SUPPORTED;
+    default:
+        Trace(TRACE_LEVEL_ERROR, TRACE_QUEUE,"Static snapshot failed its checks\n");
+        return STATUS_DEVICE_DATA_ERROR;
+    }
+}
+
+/*
+ * Function: NTSTATUS GetVersion
+ *
+ * Description:
+ * Returns the version the driver was built with, which clients caching the
+ * static snapshot keep alongside it.
+ *
+ * Parameters:
+ * Request - The IOCTL_GET_VERSION request.
+ * Information - Receives the number of bytes returned.
+ *
+ * Return Value:
+ * STATUS_SUCCESS or the status of retrieving the output buffer.
+ *
+ */
+static NTSTATUS GetVersion(EC_FW_REQUEST Request, size_t *Information)
+{
+    VersionRsp_t *rsp = NULL;
+    size_t length = 0;
+    NTSTATUS status;
+
+    status = EcFwRetrieveOutputBuffer(Request, sizeof(VersionRsp_t), (PVOID *)&rsp, &length);
+    if (!NT_SUCCESS(status)) {
+        return status;
+    }
+
+    rsp->version = EC_DRIVER_VERSION;
+    *Information = sizeof(VersionRsp_t);
+    return STATUS_SUCCESS;
+}
+#endif // EC_TEST_STATIC
+
+#ifdef EC_TEST_BATTERY
+/*
+ * Function: NTSTATUS GetBattery
+ *
+ * Description:
+ * Returns the battery status the EC last pushed, for clients that have not
+ * seen a battery notification yet.
+ *
+ * Parameters:
+ * Core - The core state of the device.
+ * Request - The IOCTL_GET_BATTERY request.
+ * Information - Receives the number of bytes returned.
+ *
+ * Return Value:
+ * NTSTATUS status code indicating the success or failure of the operation.
+ *
+ */
+static NTSTATUS GetBattery(PEC_CORE Core, EC_FW_REQUEST Request, size_t *Information)
+{
+    BatteryStatus_t *rsp = NULL;
+    size_t length = 0;
+    NTSTATUS status;
+
+    status = EcFwRetrieveOutputBuffer(Request, sizeof(BatteryStatus_t), (PVOID *)&rsp, &length);
+    if (!NT_SUCCESS(status)) {
+        return status;
+    }
+
+    status = BatteryRead(Core, rsp);
+    if (NT_SUCCESS(status)) {
+        *Information = sizeof(BatteryStatus_t);
+    }
+    return status;
+}
+#endif // EC_TEST_BATTERY
+
+#ifdef EC_TEST_MAP_RX
+/*
+ * Function: NTSTATUS MapRx
+ *
+ * Description:
+ * Maps the shared memory window into the requesting process, the RX side
+ * read-only, so responses are read where the EC wrote them. Every handle gets
+ * one pair of views, asking again returns the same pair.
+ *
+ * Parameters:
+ * Core - The core state of the device.
+ * Request - The IOCTL_MAP_RX request.
+ * Information - Receives the number of bytes returned.
+ *
+ * Return Value:
+ * NTSTATUS status code indicating the success or failure of the operation.
+ *
+ */
+static NTSTATUS MapRx(PEC_CORE Core, EC_FW_REQUEST Request, size_t *Information)
+{
+    MapRxRsp_t *rsp = NULL;
+    size_t length = 0;
+    NTSTATUS status;
+
+    status = EcFwRetrieveOutputBuffer(Request, sizeof(MapRxRsp_t), (PVOID *)&rsp, &length);
+    if (!NT_SUCCESS(status)) {
+        return status;
+    }
+
+    status = EcFwMapShared(Core, Request, &rsp->tx, &rsp->rx);
+    if (!NT_SUCCESS(status)) {
+        Trace(TRACE_LEVEL_ERROR, TRACE_QUEUE,"EcFwMapShared failed %!STATUS!\n", status);
+        return status;
+    }
+
+    rsp->txLength = EC_MAP_TX_LENGTH;
+    rsp->rxLength = EC_MAP_RX_LENGTH;
+    *Information = sizeof(MapRxRsp_t);
+    return STATUS_SUCCESS;
+}
+#endif // EC_TEST_MAP_RX
+
+/*
+ * Function: VOID EcCoreDeviceControl
+ *
+ * Description:
+ * Handles device control requests. Evaluation and message requests are forwarded to a
+ * worker, notification requests are pended and everything else is completed
+ * before returning.
+ *
+ * Parameters:
+ * Core - The core state of the device.
+ * Request - The framework request.
+ * OutputBufferLength - The length of the output buffer.
+ * InputBufferLength - The length of the input buffer.
+ * IoControlCode - The I/O control code specifying the operation to perform.
+ *
+ * Return Value:
+ * VOID
+ *
+ */
+VOID EcCoreDeviceControl(
+    PEC_CORE Core,
+    EC_FW_REQUEST Request,
+    size_t OutputBufferLength,
+    size_t InputBufferLength,
+    ULONG IoControlCode
+    )
+{
+    NTSTATUS status = STATUS_SUCCESS;
+    size_t information = 0;
+    int completeRequest = 1;
+
+    if (!OutputBufferLength || !InputBufferLength) {
+        EcFwRequestComplete(Request, STATUS_INVALID_PARAMETER, 0);
+        return;
+    }
+
+    switch (IoControlCode)
+    {
+    case IOCTL_ACPI_EVAL_METHOD_EX:
+        Trace(TRACE_LEVEL_INFORMATION, TRACE_QUEUE,"IOCTL_ACPI_EVAL_METHOD_EX\n");
+
+        // Request is retrieved and handled on the worker
+        status = EcFwQueueWork(Core, Request, IoControlCode);
+        // If we enqueue it successfully it will be completed later, otherwise complete with status
+        if (NT_SUCCESS(status)) {
+            Trace(TRACE_LEVEL_INFORMATION, TRACE_QUEUE,"EVAL request 0x%llx pended\n", (UINT64)Request);
+            completeRequest = 0;
+        } else {
+            Trace(TRACE_LEVEL_ERROR, TRACE_QUEUE,"EcFwQueueWork failed\n");
+        }
+        break;
+#ifdef EC_TEST_MSG_SEND2
+    case IOCTL_FFA_MSG_SEND2:
+        Trace(TRACE_LEVEL_INFORMATION, TRACE_QUEUE,"IOCTL_FFA_MSG_SEND2\n");
+
+        // Waits for the EC, so it runs on the worker like an evaluation
+        status = EcFwQueueWork(Core, Request, IoControlCode);
+        if (NT_SUCCESS(status)) {
+            completeRequest = 0;
+        }
+        break;
+#endif // EC_TEST_MSG_SEND2
+#ifdef EC_TEST_MEM_SHARE
+    case IOCTL_FFA_MEM_SHARE:
+    case IOCTL_FFA_MEM_RECLAIM:
+        Trace(TRACE_LEVEL_INFORMATION, TRACE_QUEUE,"IOCTL_FFA_MEM_SHARE/RECLAIM 0x%x\n", IoControlCode);
+
+        // Talks to the EC through the RX/TX buffers, so it runs on the worker
+        status = EcFwQueueWork(Core, Request, IoControlCode);
+        if (NT_SUCCESS(status)) {
+            completeRequest = 0;
+        }
+        break;
+#endif // EC_TEST_MEM_SHARE
+#ifdef EC_TEST_NOTIFICATIONS
+    case IOCTL_GET_NOTIFICATION:
+        Trace(TRACE_LEVEL_INFORMATION, TRACE_QUEUE,"IOCTL_GET_NOTIFICATION \n");
+        status = NotificationGet(Core, Request, &information);
+
+        // If we pend it successfully it will be completed later, otherwise complete with status
+        if (status == STATUS_PENDING) {
+            completeRequest = 0;
+        }
+        break;
+
+    case IOCTL_NOTIFY_CLASSES:
+        Trace(TRACE_LEVEL_INFORMATION, TRACE_QUEUE,"IOCTL_NOTIFY_CLASSES\n");
+        status = NotifyClasses(Core, Request, &information);
+        break;
+#endif // EC_TEST_NOTIFICATIONS
+
+#ifdef EC_TEST_SHARED_BUFFER
+    case IOCTL_READ_RX_BUFFER:
+        status = ReadRxBuffer(Core, Request, &information);
+        break;
+#endif // EC_TEST_SHARED_BUFFER
+
+#ifdef EC_TEST_STATIC
+    case IOCTL_GET_STATIC:
+        Trace(TRACE_LEVEL_INFORMATION, TRACE_QUEUE,"IOCTL_GET_STATIC\n");
+        status = GetStatic(Core, Request, &information);
+        break;
+
+    case IOCTL_GET_VERSION:
+        Trace(TRACE_LEVEL_INFORMATION, TRACE_QUEUE,"IOCTL_GET_VERSION\n");
+        status = GetVersion(Request, &information);
+        break;
+#endif // EC_TEST_STATIC
+
+#ifdef EC_TEST_BATTERY
+    case IOCTL_GET_BATTERY:
+        Trace(TRACE_LEVEL_INFORMATION, TRACE_QUEUE,"IOCTL_GET_BATTERY\n");
+        status = GetBattery(Core, Request, &information);
+        break;
+#endif // EC_TEST_BATTERY
+
+#ifdef EC_TEST_MAP_RX
+    case IOCTL_MAP_RX:
+        Trace(TRACE_LEVEL_INFORMATION, TRACE_QUEUE,"IOCTL_MAP_RX\n");
+
+        // Maps into the caller, so it is not handed to the worker
+        status = MapRx(Core, Request, &information);
+        break;
+#endif // EC_TEST_MAP_RX
+
+#ifdef EC_TEST_LOOPBACK
+    case IOCTL_SET_LOOPBACK:
+        Trace(TRACE_LEVEL_INFORMATION, TRACE_QUEUE,"IOCTL_SET_LOOPBACK\n");
+        status = LoopbackSet(Core, Request, &information);
+        break;
+
+    case IOCTL_ADD_LOOPBACK_RESPONSE:
+        Trace(TRACE_LEVEL_INFORMATION, TRACE_QUEUE,"IOCTL_ADD_LOOPBACK_RESPONSE\n");
+        status = LoopbackAddResponse(Core, Request, &information);
+        break;
+#endif // EC_TEST_LOOPBACK
+
+#ifdef EC_TEST_SAMPLER
+    case IOCTL_SAMPLER_REGISTER:
+        Trace(TRACE_LEVEL_INFORMATION, TRACE_QUEUE,"IOCTL_SAMPLER_REGISTER\n");
+        status = SamplerRegister(Core, Request, &information);
+        break;
+
+    case IOCTL_SAMPLER_SUBSCRIBE:
+        status = SamplerSubscribe(Core, Request, &information);
+
+        // Pended subscriptions are completed by EcCoreSample
+        if (status == STATUS_PENDING) {
+            completeRequest = 0;
+        }
+        break;
+#endif // EC_TEST_SAMPLER
+
+    default:
+        status = STATUS_INVALID_PARAMETER;
+        break;
+    }
+
+    if (completeRequest) {
+        EcFwRequestComplete(Request, status, information);
+    }
+}
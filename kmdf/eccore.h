@@ -0,0 +1,318 @@
+/*++
+Module Name:
+    eccore.h
+
+Abstract:
+    Framework independent core of the ectest driver. IOCTL dispatch, forwarding
+    of ACPI evaluations to a worker, notification queueing and pend/complete/cancel and the
+    shared buffer read live in eccore.c and only reach the framework through the
+    EcFw* services declared here. queue.c implements them on KMDF and
+    tools/wdfshim implements them in user mode so the same dispatch code can be
+    benchmarked and stress tested on any host. Large messages through the FF-A
+    RX/TX buffers are framed by ecmsg.c. Buffers shared with the EC at runtime
+    are described with the FF-A descriptor builder shared with the UEFI code.
+    Registered methods are sampled on a framework timer and subscribers are
+    woken only when a result moves beyond their deadband. Battery notifications
+    carry the status the EC wrote into its slot before raising them. The
+    shared memory window can be mapped into a client, its RX side read-only.
+
+Environment:
+    Kernel mode, or user mode when EC_CORE_USER_MODE is defined
+
+--*/
+
+#pragma once
+
+#define EC_TEST_NOTIFICATIONS  // Enable notification support
+//#define ENABLE_NOTIFICATION_SIMULATION // Enable notification simulation
+//#define EC_TEST_SHARED_BUFFER // Enable IOCTL_READ_RX_BUFFER
+#define EC_TEST_LOOPBACK       // Enable IOCTL_SET_LOOPBACK, off until enabled at runtime
+#define EC_TEST_MSG_SEND2      // Enable IOCTL_FFA_MSG_SEND2 through the FF-A RX/TX buffers
+#define EC_TEST_MEM_SHARE      // Enable IOCTL_FFA_MEM_SHARE/RECLAIM, requires EC_TEST_MSG_SEND2
+#define EC_TEST_SAMPLER        // Enable IOCTL_SAMPLER_REGISTER/SUBSCRIBE, requires EC_TEST_NOTIFICATIONS
+#define EC_TEST_STATIC         // Enable IOCTL_GET_STATIC, the snapshot firmware writes at boot
+#define EC_TEST_BATTERY        // Enable IOCTL_GET_BATTERY and battery status in notifications, requires EC_TEST_NOTIFICATIONS
+//#define EC_TEST_MAP_RX       // Enable IOCTL_MAP_RX, writable user views of the shared memory window, only with the admin-only SDDL in ectest.inx
+
+#ifdef EC_CORE_USER_MODE
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+typedef int32_t NTSTATUS;
+typedef void VOID;
+typedef void *PVOID;
+typedef char CHAR;
+typedef uint8_t UINT8;
+typedef uint16_t UINT16;
+typedef uint32_t UINT32;
+typedef uint64_t UINT64;
+typedef uint32_t ULONG;
+typedef int64_t LONGLONG;
+
+#define NT_SUCCESS(Status)              (((NTSTATUS)(Status)) >= 0)
+#define STATUS_SUCCESS                  ((NTSTATUS)0x00000000L)
+#define STATUS_PENDING                  ((NTSTATUS)0x00000103L)
+#define STATUS_BUFFER_OVERFLOW          ((NTSTATUS)0x80000005L)
+#define STATUS_DEVICE_BUSY              ((NTSTATUS)0x80000011L)
+#define STATUS_INVALID_PARAMETER        ((NTSTATUS)0xC000000DL)
+#define STATUS_INVALID_DEVICE_REQUEST   ((NTSTATUS)0xC0000010L)
+#define STATUS_OBJECT_NAME_NOT_FOUND    ((NTSTATUS)0xC0000034L)
+#define STATUS_INSUFFICIENT_RESOURCES   ((NTSTATUS)0xC000009AL)
+#define STATUS_DEVICE_DATA_ERROR        ((NTSTATUS)0xC000009CL)
+#define STATUS_NOT_SUPPORTED            ((NTSTATUS)0xC00000BBL)
+#define STATUS_IO_TIMEOUT               ((NTSTATUS)0xC00000B5L)
+#define STATUS_CANCELLED                ((NTSTATUS)0xC0000120L)
+
+// CTL_CODE(FILE_DEVICE_ACPI, 6, METHOD_BUFFERED, FILE_READ_ACCESS | FILE_WRITE_ACCESS)
+#define IOCTL_ACPI_EVAL_METHOD_EX       0x0032C018
+#define ACPI_EVAL_INPUT_BUFFER_SIGNATURE_EX 0x41696541  // 'AieA'
+
+#define RtlCopyMemory memcpy
+#define RtlZeroMemory(Destination, Length) memset((Destination), 0, (Length))
+#else
+#include <ntddk.h>
+#include <acpiioct.h>
+#endif // EC_CORE_USER_MODE
+
+#include "../inc/ectest.h"
+
+typedef PVOID EC_FW_HANDLE;     // Framework object such as WDFDEVICE or WDFWAITLOCK
+typedef PVOID EC_FW_REQUEST;    // Framework request, WDFREQUEST in the driver
+
+#ifdef EC_TEST_LOOPBACK
+//
+// Canned responses used instead of ACPI while loopback is enabled
+//
+typedef struct _EC_LOOPBACK
+{
+    EC_FW_HANDLE Lock;              // Protects everything below
+    UINT32 Enabled;
+    UINT32 Delay;                   // Microseconds added to every evaluation
+    UINT32 Count;
+    UINT64 Hits;
+    UINT64 Misses;
+    LoopbackResponseReq_t Entries[LOOPBACK_MAX_ENTRIES];
+} EC_LOOPBACK;
+#endif // EC_TEST_LOOPBACK
+
+#ifdef EC_TEST_MEM_SHARE
+//
+// Buffer shared with the EC with FFA_MEM_SHARE, free while Pages is 0
+//
+typedef struct _EC_SHARE
+{
+    UINT64 Handle;                  // FF-A memory handle
+    UINT64 Address;                 // Physical address
+    PVOID Buffer;                   // Driver mapping
+    EC_FW_HANDLE File;              // File object it was shared on, only it can reclaim it
+    UINT32 Pages;
+} EC_SHARE;
+#endif // EC_TEST_MEM_SHARE
+
+#ifdef EC_TEST_SAMPLER
+//
+// Integer method evaluated every Period milliseconds, free while Period is 0
+//
+typedef struct _EC_SAMPLER
+{
+    CHAR Method[LOOPBACK_MAX_NAME];
+    UINT32 Period;
+    UINT32 Generation;              // Bumped when the slot is reused so late results are dropped
+    UINT32 Valid;                   // Value holds a sample
+    NTSTATUS Status;                // Status of the latest evaluation
+    LONGLONG Due;                   // System time the next sample is taken
+    LONGLONG Timestamp;             // System time of the latest sample
+    UINT64 Value;
+    UINT64 Samples;
+} EC_SAMPLER;
+
+//
+// Waiter on a sampler, free while both Request and Event are NULL
+//
+typedef struct _EC_SUBSCRIBER
+{
+    EC_FW_REQUEST Request;          // Pended IOCTL_SAMPLER_SUBSCRIBE
+    EC_FW_HANDLE Event;             // Or a referenced event signalled on every change
+    EC_FW_HANDLE File;              // File object it subscribed through, dropped when it is cleaned up
+    UINT32 Sampler;
+    UINT32 HasValue;                // Zero until the subscriber has seen a value
+    UINT64 Value;                   // Value the subscriber last saw
+    UINT64 Deadband;
+} EC_SUBSCRIBER;
+
+typedef struct _EC_SAMPLING
+{
+    EC_FW_HANDLE Lock;              // Protects everything below
+    UINT32 Stopping;                // Set on shutdown, the timer is not armed again
+    UINT64 Samples;
+    UINT64 Wakeups;
+    EC_SAMPLER Samplers[SAMPLER_MAX_METHODS];
+    EC_SUBSCRIBER Subscribers[SAMPLER_MAX_SUBSCRIBERS];
+} EC_SAMPLING;
+#endif // EC_TEST_SAMPLER
+
+#ifdef EC_TEST_NOTIFICATIONS
+typedef struct _EC_NOTIFY_ENTRY
+{
+    ULONG Value;
+    UINT32 Coalesced;               // Further notifications folded into this one
+    UINT64 Sequence;                // NotifyStats.count when it arrived
+    LONGLONG Timestamp;
+#ifdef EC_TEST_BATTERY
+    BatteryStatus_t Battery;        // Status read when an EC_NOTIFY_BATTERY arrived
+#endif
+} EC_NOTIFY_ENTRY;
+
+typedef struct _EC_NOTIFY_QUEUE
+{
+    UINT32 Head;
+    UINT32 Count;
+    EC_NOTIFY_ENTRY Entries[NOTIFY_QUEUE_DEPTH];
+} EC_NOTIFY_QUEUE;
+#endif // EC_TEST_NOTIFICATIONS
+
+//
+// Per device state owned by the core
+//
+typedef struct _EC_CORE
+{
+    EC_FW_HANDLE Device;            // Passed back to the framework services
+    EC_FW_HANDLE NotificationLock;  // Protects PendingRequest
+    EC_FW_REQUEST PendingRequest;   // Pending request for notification
+    NotificationRsp_t NotifyStats;  // Returned with every notification
+#ifdef EC_TEST_NOTIFICATIONS
+    UINT8 NotifyClass[NOTIFY_MAX_VALUES];               // Protected by NotificationLock
+    EC_NOTIFY_QUEUE NotifyQueue[NOTIFY_MAX_CLASSES];    // Likewise
+    NotifyClassStats_t NotifyClassStats[NOTIFY_MAX_CLASSES];
+#endif
+#ifdef EC_TEST_LOOPBACK
+    EC_LOOPBACK Loopback;
+#endif
+#ifdef EC_TEST_MSG_SEND2
+    EC_FW_HANDLE MessageLock;       // Serializes use of the RX/TX buffers
+    UINT16 MessageSequence;         // Sequence of the last message sent
+#endif
+#ifdef EC_TEST_MEM_SHARE
+    EC_SHARE Shares[EC_SHARE_MAX_REGIONS]; // Protected by MessageLock
+#endif
+#ifdef EC_TEST_SAMPLER
+    EC_SAMPLING Sampling;
+#endif
+} EC_CORE, *PEC_CORE;
+
+//
+// Core entry points, called by the framework layer
+//
+VOID EcCoreInitialize(PEC_CORE Core, EC_FW_HANDLE Device, EC_FW_HANDLE NotificationLock);
+
+VOID EcCoreDeviceControl(
+    PEC_CORE Core,
+    EC_FW_REQUEST Request,
+    size_t OutputBufferLength,
+    size_t InputBufferLength,
+    ULONG IoControlCode
+    );
+
+// Runs on a worker for requests handed to EcFwQueueWork
+VOID EcCoreWork(PEC_CORE Core, EC_FW_REQUEST Request, ULONG IoControlCode);
+
+// Releases what the core still holds before the device goes away
+VOID EcCoreShutdown(PEC_CORE Core);
+
+// Releases what the core holds for a file object once its last handle is closed
+VOID EcCoreFileCleanup(PEC_CORE Core, EC_FW_HANDLE File);
+
+#ifdef EC_TEST_NOTIFICATIONS
+VOID EcCoreNotify(PEC_CORE Core, ULONG NotifyValue);
+
+// Cancel routine for every request the core pends, notifications and subscriptions
+VOID EcCoreCancelNotification(PEC_CORE Core, EC_FW_REQUEST Request);
+#endif
+
+#ifdef EC_TEST_SAMPLER
+// Runs at passive level when the timer armed by EcFwSamplerSchedule fires
+VOID EcCoreSample(PEC_CORE Core);
+#endif
+
+//
+// Framework services, implemented by queue.c or the user-mode shim
+//
+VOID EcFwLockAcquire(EC_FW_HANDLE Lock);
+VOID EcFwLockRelease(EC_FW_HANDLE Lock);
+
+NTSTATUS EcFwRetrieveInputBuffer(EC_FW_REQUEST Request, size_t MinimumRequiredSize, PVOID *Buffer, size_t *Length);
+NTSTATUS EcFwRetrieveOutputBuffer(EC_FW_REQUEST Request, size_t MinimumRequiredSize, PVOID *Buffer, size_t *Length);
+VOID EcFwRequestComplete(EC_FW_REQUEST Request, NTSTATUS Status, size_t Information);
+
+// File object the request was sent on, WDFFILEOBJECT in the driver
+EC_FW_HANDLE EcFwRequestFile(EC_FW_REQUEST Request);
+
+// Returns STATUS_CANCELLED if the request was already cancelled, otherwise the framework
+// calls EcCoreCancelNotification if the request is cancelled while cancelable
+NTSTATUS EcFwRequestMarkCancelable(PEC_CORE Core, EC_FW_REQUEST Request);
+NTSTATUS EcFwRequestUnmarkCancelable(EC_FW_REQUEST Request);
+
+// Runs EcCoreWork for the request on a worker thread
+NTSTATUS EcFwQueueWork(PEC_CORE Core, EC_FW_REQUEST Request, ULONG IoControlCode);
+
+NTSTATUS EcFwEvaluateAcpi(
+    PEC_CORE Core,
+    PVOID Input,
+    size_t InputLength,
+    PVOID Output,
+    size_t OutputLength,
+    ULONG *BytesReturned
+    );
+
+NTSTATUS EcFwReadPhysical64(PEC_CORE Core, UINT64 Address, UINT64 *Value);
+#if defined(EC_TEST_STATIC) || defined(EC_TEST_BATTERY)
+NTSTATUS EcFwReadPhysical(PEC_CORE Core, UINT64 Address, PVOID Buffer, ULONG Length);
+#endif
+LONGLONG EcFwQuerySystemTime(VOID);
+VOID EcFwDelay(ULONG Microseconds);
+
+#ifdef EC_TEST_MSG_SEND2
+// RX/TX buffer pair registered for indirect messages, Size bytes each. Called with
+// MessageLock held, the framework maps and registers the buffers on first use
+NTSTATUS EcFwMessageBuffers(PEC_CORE Core, PVOID *Tx, PVOID *Rx, size_t *Size);
+
+// FFA_MSG_SEND2 for the message just written to the TX buffer
+NTSTATUS EcFwMessageSend(PEC_CORE Core);
+
+// FFA_RX_RELEASE once the message in the RX buffer has been consumed
+VOID EcFwMessageRelease(PEC_CORE Core);
+#endif // EC_TEST_MSG_SEND2
+
+#ifdef EC_TEST_SAMPLER
+// Arms the one-shot sampler timer to fire in Milliseconds, replacing any earlier
+// due time. Called with the sampling lock held
+VOID EcFwSamplerSchedule(PEC_CORE Core, ULONG Milliseconds);
+
+// Cancels the timer and waits for a running EcCoreSample to return
+VOID EcFwSamplerStop(PEC_CORE Core);
+
+// Resolves an event handle of the requesting process, called from EcCoreDeviceControl
+NTSTATUS EcFwEventReference(PEC_CORE Core, UINT64 Handle, EC_FW_HANDLE *Event);
+VOID EcFwEventSignal(EC_FW_HANDLE Event);
+VOID EcFwEventDereference(EC_FW_HANDLE Event);
+#endif // EC_TEST_SAMPLER
+
+#ifdef EC_TEST_MAP_RX
+// Maps the TX window, read-write if the handle was opened for write, and the RX
+// window with the event page read-only into the requesting process, called from EcCoreDeviceControl in its context.
+// The views belong to the file object of Request: a repeat call returns them
+// again and they are unmapped when the file object is cleaned up
+NTSTATUS EcFwMapShared(PEC_CORE Core, EC_FW_REQUEST Request, UINT64 *Tx, UINT64 *Rx);
+#endif
+
+#ifdef EC_TEST_MEM_SHARE
+// Physically contiguous, page aligned and cacheable memory to share with the EC
+NTSTATUS EcFwShareAllocate(PEC_CORE Core, UINT32 Pages, PVOID *Buffer, UINT64 *Address);
+VOID EcFwShareFree(PEC_CORE Core, PVOID Buffer, UINT32 Pages);
+
+// FFA_MEM_SHARE for the Length byte descriptor just written to the TX buffer and
+// FFA_MEM_RECLAIM once the EC has relinquished the region. Called with MessageLock held
+NTSTATUS EcFwMemShare(PEC_CORE Core, UINT32 Length, UINT64 *Handle);
+NTSTATUS EcFwMemReclaim(PEC_CORE Core, UINT64 Handle);
+#endif // EC_TEST_MEM_SHARE
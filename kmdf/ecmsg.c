@@ -0,0 +1,125 @@
+/*++
+Module Name:
+    ecmsg.c
+
+Abstract:
+    Builds and validates indirect messages in FF-A RX/TX buffers, see ecmsg.h.
+
+Environment:
+    Kernel mode, or user mode when EC_CORE_USER_MODE is defined
+
+--*/
+
+#include "ecmsg.h"
+
+const UINT8 EcMsgManagementService[16] = {
+    0x73, 0x12, 0x0c, 0x33, 0xe5, 0xfd, 0x57, 0x47, 0x98, 0x19, 0x5b, 0x65, 0x39, 0x03, 0x75, 0x02
+};
+
+const UINT8 EcMsgThermalService[16] = {
+    0xa7, 0x6d, 0xf5, 0x31, 0x3c, 0x59, 0x72, 0x4d, 0xa4, 0xb3, 0x8f, 0xc7, 0x17, 0x1a, 0xc0, 0x73
+};
+
+/*
+ * Function: UINT32 EcMsgBuild
+ *
+ * Description:
+ * Writes a complete message into an RX/TX buffer. The FF-A header Size is
+ * written last so a reader polling it never sees a partial message.
+ *
+ * Parameters:
+ * Buffer - The RX or TX buffer.
+ * BufferSize - The size of the buffer.
+ * Sender - FF-A ID of the sending endpoint.
+ * Receiver - FF-A ID of the receiving endpoint.
+ * Header - The EC header, Length gives the number of payload bytes.
+ * Payload - The payload, may be NULL when Header->Length is zero.
+ *
+ * Return Value:
+ * Bytes of EC header and payload written, zero if the message does not fit.
+ *
+ */
+UINT32 EcMsgBuild(
+    PVOID Buffer,
+    size_t BufferSize,
+    UINT16 Sender,
+    UINT16 Receiver,
+    const EC_MSG_HEADER *Header,
+    const VOID *Payload
+    )
+{
+    volatile EC_MSG_RXTX_HEADER *rxtx = (volatile EC_MSG_RXTX_HEADER *)Buffer;
+    UINT8 *body = (UINT8 *)Buffer + EC_MSG_RXTX_HEADER_SIZE;
+    UINT32 size;
+
+    if (BufferSize < EC_MSG_RXTX_HEADER_SIZE + sizeof(EC_MSG_HEADER) ||
+        Header->Length > BufferSize - EC_MSG_RXTX_HEADER_SIZE - sizeof(EC_MSG_HEADER)) {
+        return 0;
+    }
+    size = (UINT32)sizeof(EC_MSG_HEADER) + Header->Length;
+
+    RtlCopyMemory(body, Header, sizeof(EC_MSG_HEADER));
+    if (Header->Length != 0) {
+        RtlCopyMemory(body + sizeof(EC_MSG_HEADER), Payload, Header->Length);
+    }
+
+    rxtx->Flags = 0;
+    rxtx->Reserved = 0;
+    rxtx->Offset = EC_MSG_RXTX_HEADER_SIZE;
+    rxtx->Endpoints = ((UINT32)Sender << 16) | Receiver;
+    rxtx->Size = size;
+    return size;
+}
+
+/*
+ * Function: const EC_MSG_HEADER *EcMsgParse
+ *
+ * Description:
+ * Validates the message in an RX/TX buffer and locates its EC header.
+ *
+ * Parameters:
+ * Buffer - The RX or TX buffer.
+ * BufferSize - The size of the buffer.
+ * Sender - Receives the FF-A ID of the sending endpoint.
+ * Receiver - Receives the FF-A ID of the receiving endpoint.
+ *
+ * Return Value:
+ * The EC header, followed by Length bytes of payload, or NULL if the buffer
+ * is empty or the message does not fit in it.
+ *
+ */
+const EC_MSG_HEADER *EcMsgParse(
+    const VOID *Buffer,
+    size_t BufferSize,
+    UINT16 *Sender,
+    UINT16 *Receiver
+    )
+{
+    const volatile EC_MSG_RXTX_HEADER *rxtx = (const volatile EC_MSG_RXTX_HEADER *)Buffer;
+    const EC_MSG_HEADER *header;
+    UINT32 offset;
+    UINT32 size;
+    UINT32 endpoints;
+
+    if (BufferSize < EC_MSG_RXTX_HEADER_SIZE) {
+        return NULL;
+    }
+
+    // Read each field once, the other side may still be writing
+    size = rxtx->Size;
+    offset = rxtx->Offset;
+    endpoints = rxtx->Endpoints;
+    if (size < sizeof(EC_MSG_HEADER) || offset < sizeof(EC_MSG_RXTX_HEADER) ||
+        offset > BufferSize || size > BufferSize - offset) {
+        return NULL;
+    }
+
+    header = (const EC_MSG_HEADER *)((const UINT8 *)Buffer + offset);
+    if (header->Length != size - sizeof(EC_MSG_HEADER)) {
+        return NULL;
+    }
+
+    *Sender = (UINT16)(endpoints >> 16);
+    *Receiver = (UINT16)endpoints;
+    return header;
+}
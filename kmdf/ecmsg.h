@@ -0,0 +1,67 @@
+/*++
+Module Name:
+    ecmsg.h
+
+Abstract:
+    Indirect (FFA_MSG_SEND2) messages exchanged with the EC service through the
+    FF-A RX/TX buffers. Each buffer holds one message: the FF-A partition message
+    header, then an EC header naming the service and command, then up to
+    EC_MSG_MAX_PAYLOAD bytes of payload, far beyond the 112 bytes a direct
+    request can carry. Used by the driver core and the EC simulator in tools/ecsim.
+
+Environment:
+    Kernel mode, or user mode when EC_CORE_USER_MODE is defined
+
+--*/
+
+#pragma once
+
+#include "eccore.h"
+
+#define EC_MSG_RXTX_HEADER_SIZE 0x20        // FF-A header padded so the EC header is aligned
+#define EC_MSG_BUFFER_SIZE      (EC_MSG_PAGES * 0x1000)
+
+#pragma pack(push, 1)
+//
+// FF-A partition RX/TX buffer message header
+//
+typedef struct _EC_MSG_RXTX_HEADER
+{
+    UINT32 Flags;
+    UINT32 Reserved;
+    UINT32 Offset;          // Offset of the EC header from the start of the buffer
+    UINT32 Endpoints;       // Sender ID in bits [31:16], receiver ID in bits [15:0]
+    UINT32 Size;            // Bytes of EC header and payload, zero when the buffer is free
+} EC_MSG_RXTX_HEADER;
+
+typedef struct _EC_MSG_HEADER
+{
+    UINT8 Service[16];      // Service UUID in GUID byte order, as ToUUID stores it
+    UINT16 Sequence;        // Echoed in the response
+    UINT8 Command;
+    UINT8 Status;           // EC_MSG_STATUS_* in responses, see ectest.h
+    UINT32 Length;          // Payload bytes following this header
+} EC_MSG_HEADER;
+#pragma pack(pop)
+
+// EC management service 330c1273-fde5-4757-9819-5b6539037502
+extern const UINT8 EcMsgManagementService[16];
+
+// EC thermal service 31f56da7-593c-4d72-a4b3-8fc7171ac073
+extern const UINT8 EcMsgThermalService[16];
+
+UINT32 EcMsgBuild(
+    PVOID Buffer,
+    size_t BufferSize,
+    UINT16 Sender,
+    UINT16 Receiver,
+    const EC_MSG_HEADER *Header,
+    const VOID *Payload
+    );
+
+const EC_MSG_HEADER *EcMsgParse(
+    const VOID *Buffer,
+    size_t BufferSize,
+    UINT16 *Sender,
+    UINT16 *Receiver
+    );
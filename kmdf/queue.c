@@ -13,28 +13,38 @@ Abstract:
 #include <acpiioct.h>
 #include "wdm.h"
 #include "wdmguid.h"
-#include "..\inc\ectest.h"
 #include "trace.h"
 #include "queue.tmh"
 #include "ffainterface.h"
+#include "ffa.h"
+#include "ecmsg.h"
+#ifdef EC_TEST_MEM_SHARE
+#include "../uefi/Platforms/QemuSbsaPkg/SbsaQemuPlatformDxe/FfaMemDescriptor.h"
+#endif
+
+#define EC_FW_MAX_STALL_US 50  // Longest delay KeStallExecutionProcessor should be used for
+
+#ifdef EC_TEST_MSG_SEND2
+// HAL FF-A routines used for indirect messages, see ffa.h
+typedef NTSTATUS (*PFFA_RAW_SMC_CALL)(PFFA_PARAMETERS InputParameters, PFFA_PARAMETERS OutputParameters);
+typedef NTSTATUS (*PFFA_REGISTER_RXTX_BUFFER)(ULONGLONG RxVa, ULONGLONG TxVa, ULONGLONG RxPa, ULONGLONG TxPa, ULONGLONG PageCount);
+typedef NTSTATUS (*PFFA_RXTX_ROUTINE)(VOID);
+#endif
 
 #ifdef ALLOC_PRAGMA
 #pragma alloc_text (PAGE, ECTestQueueInitialize)
 #endif
 
 #ifdef EC_TEST_NOTIFICATIONS
-// Globals
-NotificationRsp_t m_NotifyStats = {0};
-
 /**
  * Function: NTSTATUS NotificationCallback
  *
  * Description: 
  * Callback function for handling ACPI notifications.
  *
- * This function is called when an ACPI notification is received. It updates
- * the notification statistics with the current timestamp and the notification
- * value.
+ * This function is called when an ACPI notification is received and hands it
+ * to the core, which updates the notification statistics and completes the
+ * pending notification request.
  *
  * Parameters:
  * Context - A pointer to the context information for the callback.
@@ -49,54 +59,10 @@ VOID NotificationCallback(
     ULONG NotifyValue
     )
 {
-    LARGE_INTEGER timestamp;
-    WDFREQUEST request = NULL;
-    size_t rspSize = 0;
-    NotificationRsp_t *rsp = NULL;
-    NTSTATUS status = STATUS_SUCCESS;
-
-    Trace(TRACE_LEVEL_INFORMATION, TRACE_QUEUE, "Notification received: %lu\n", NotifyValue);
-
-    KeQuerySystemTimePrecise(&timestamp);
-
-    m_NotifyStats.count++;
-    m_NotifyStats.timestamp = timestamp.QuadPart;
-    m_NotifyStats.lastevent = NotifyValue;
-
     WDFDEVICE device = (WDFDEVICE)Context;
     PDEVICE_CONTEXT deviceContext = DeviceContextGet(device);
 
-    WdfWaitLockAcquire(deviceContext->NotificationLock, NULL);
-    if (deviceContext->PendingRequest != NULL) {
-        request = deviceContext->PendingRequest;
-        deviceContext->PendingRequest = NULL;
-    }
-    WdfWaitLockRelease(deviceContext->NotificationLock);
-
-    if (request != NULL) {
-        // Proceed only if the request is not cancelled
-        if (STATUS_CANCELLED != WdfRequestUnmarkCancelable(request)) {
-            // Retrieve the output buffer from the request
-            status = WdfRequestRetrieveOutputBuffer(request, sizeof(NotificationRsp_t), &rsp, &rspSize);
-            if (NT_SUCCESS(status)) {
-                // Copy the notification data to the output buffer
-                RtlCopyMemory(rsp, &m_NotifyStats, sizeof(NotificationRsp_t));
-
-                Trace(TRACE_LEVEL_INFORMATION, TRACE_QUEUE,"Completing 0x%llx with Success \n", (UINT64)request);
-                WdfRequestCompleteWithInformation(request, STATUS_SUCCESS, sizeof(NotificationRsp_t));
-            } else {
-                Trace(TRACE_LEVEL_ERROR, TRACE_QUEUE,"Completing 0x%llx with status %!STATUS!\n", (UINT64)request, status);
-                WdfRequestComplete(request, status);
-            }
-        } else {
-            Trace(TRACE_LEVEL_ERROR, TRACE_QUEUE,"Request 0x%llx was cancelled\n", (UINT64)request);
-            // If no request available, just log the notification
-            Trace(TRACE_LEVEL_ERROR, TRACE_QUEUE,"Not delivered to app : %lu \n", NotifyValue);
-        }
-    } else {
-        // If no request was pending, just log the notification
-        Trace(TRACE_LEVEL_ERROR, TRACE_QUEUE,"Not delivered to app : %lu \n", NotifyValue);
-    }
+    EcCoreNotify(&deviceContext->Core, NotifyValue);
 }
 
 #ifdef ENABLE_NOTIFICATION_SIMULATION
@@ -181,56 +147,7 @@ VOID ECTestEvtRequestCancel(WDFREQUEST Request)
     WDFDEVICE device = WdfIoQueueGetDevice(WdfRequestGetIoQueue(Request));
     PDEVICE_CONTEXT deviceContext = DeviceContextGet(device);
 
-    Trace(TRACE_LEVEL_INFORMATION, TRACE_QUEUE,"Cancel Request received for Request 0x%llx \n", (UINT64)Request);
-
-    WdfWaitLockAcquire(deviceContext->NotificationLock, NULL);
-    if (deviceContext->PendingRequest == Request) {
-        Trace(TRACE_LEVEL_INFORMATION, TRACE_QUEUE,"Request found & cleared from pending list\n");
-        deviceContext->PendingRequest = NULL;
-    } else {
-        Trace(TRACE_LEVEL_ERROR, TRACE_QUEUE,"Request not found in pending list\n");
-    }
-    WdfWaitLockRelease(deviceContext->NotificationLock);
-
-    Trace(TRACE_LEVEL_INFORMATION, TRACE_QUEUE,"Completing the request 0x%llx with STATUS_CANCELLED\n", (UINT64)Request);
-    WdfRequestComplete(Request,
-                       STATUS_CANCELLED);
-}
-
-/*
- * Function: NTSTATUS NotificationGet
- *
- * Description:
- * Handles the NotificationGet request.
- *
- * Parameters:
- * DeviceObject - The WDFDEVICE object representing the device.
- * Request - The WDFREQUEST object representing the request.
- *
- * Return Value:
- * NTSTATUS status code indicating the success or failure of the operation.
- *
- */
-NTSTATUS NotificationGet(WDFDEVICE Device, WDFREQUEST Request)
-{
-    PDEVICE_CONTEXT deviceContext = DeviceContextGet(Device);
-
-    WdfWaitLockAcquire(deviceContext->NotificationLock, NULL);
-    if (deviceContext->PendingRequest != NULL) {
-        WdfWaitLockRelease(deviceContext->NotificationLock);
-
-        Trace(TRACE_LEVEL_ERROR, TRACE_QUEUE,"Request 0x%llx already pending\n", (UINT64)deviceContext->PendingRequest);
-        // If a request is already pending, complete the new request with STATUS_DEVICE_BUSY
-        return STATUS_DEVICE_BUSY;
-    }
-
-    // Keeping this simple. Only one request can be pended at a time (since only 1 app is supported at a time)
-    deviceContext->PendingRequest = Request;
-    Trace(TRACE_LEVEL_INFORMATION, TRACE_QUEUE,"Saving Request 0x%llx to pending list\n", (UINT64)deviceContext->PendingRequest);
-    WdfWaitLockRelease(deviceContext->NotificationLock);
-
-    WdfRequestMarkCancelable(Request, ECTestEvtRequestCancel);
-    return STATUS_PENDING;
+    EcCoreCancelNotification(&deviceContext->Core, Request);
 }
 #endif // EC_TEST_NOTIFICATIONS
 /*
@@ -339,8 +256,7 @@ FfaDrvTestDirectCall(VOID)
  *
  * Description:
  * The WorkItemCallback function is a callback function that processes a work item in a KMDF driver.
- * It retrieves the output buffer, creates a preallocated memory object, and sends an internal IOCTL request to the device.
- * The function then completes the request with the appropriate status and information.
+ * It hands the request to the core, which forwards it to ACPI or the EC and completes it.
  *
  * Parameters:
  * WDFWORKITEM WorkItem: A handle to the work item being processed.
@@ -354,68 +270,131 @@ WorkItemCallback(
     )
 {
     PWORKITEM_CONTEXT context = WorkItemGetContext(WorkItem);
+    PDEVICE_CONTEXT deviceContext = DeviceContextGet(context->Device);
 
-    // Input buffer should be one of the ACPI buffer types documented here
-    // https://learn.microsoft.com/en-us/windows-hardware/drivers/ddi/acpiioct/
-    void *inputBuffer = NULL;
+    EcCoreWork(&deviceContext->Core, context->Request, context->IoControlCode);
+}
+
+/*
+ * Function: NTSTATUS EcFwQueueWork
+ *
+ * Description:
+ * Creates a work item and enqueues it to run EcCoreWork for the request.
+ * It initializes the work item configuration and context, and sets the callback function for the work item.
+ *
+ * Parameters:
+ * PEC_CORE Core: The core state of the device.
+ * EC_FW_REQUEST Request: A handle to the framework request object.
+ * ULONG IoControlCode: The I/O control code of the request.
+ *
+ * Return Value:
+ * Returns an NTSTATUS value indicating the success or failure of the work item creation and enqueueing.
+ * If the work item is successfully created and enqueued, it returns STATUS_SUCCESS. Otherwise, it returns an appropriate error code.
+ */
+NTSTATUS
+EcFwQueueWork(
+    _In_ PEC_CORE Core,
+    _In_ EC_FW_REQUEST Request,
+    _In_ ULONG IoControlCode
+    )
+{
+    NTSTATUS status;
+    WDF_OBJECT_ATTRIBUTES attributes;
+    WDF_WORKITEM_CONFIG workitemConfig;
+    WDFWORKITEM workItem;
+    PWORKITEM_CONTEXT context;
+
+    WDF_WORKITEM_CONFIG_INIT(&workitemConfig, WorkItemCallback);
+
+    WDF_OBJECT_ATTRIBUTES_INIT_CONTEXT_TYPE(&attributes, WORKITEM_CONTEXT);
+    attributes.ParentObject = (WDFDEVICE)Core->Device;
+
+    status = WdfWorkItemCreate(&workitemConfig, &attributes, &workItem);
+    if (!NT_SUCCESS(status)) {
+        Trace(TRACE_LEVEL_ERROR, TRACE_QUEUE,"WdfWorkItemCreate failed: %!STATUS!\n", status);
+        return status;
+    }
+
+    context = WorkItemGetContext(workItem);
+    context->Device = (WDFDEVICE)Core->Device;
+    context->Request = (WDFREQUEST)Request;
+    context->IoControlCode = IoControlCode;
+
+    WdfWorkItemEnqueue(workItem);
+
+    return status;
+}
+
+/*
+ * Function: NTSTATUS EcFwEvaluateAcpi
+ *
+ * Description:
+ * Sends IOCTL_ACPI_EVAL_METHOD_EX to the ACPI driver below us and waits for it to complete.
+ * The output buffer is wrapped in a preallocated memory object so ACPI writes the result in place.
+ *
+ * Parameters:
+ * PEC_CORE Core: The core state of the device.
+ * PVOID Input: The ACPI evaluation input buffer.
+ * size_t InputLength: The length of the input buffer.
+ * PVOID Output: The buffer receiving the ACPI evaluation output.
+ * size_t OutputLength: The length of the output buffer.
+ * ULONG *BytesReturned: Receives the number of bytes written to the output buffer.
+ *
+ * Return Value:
+ * Returns an NTSTATUS value indicating the success or failure of the evaluation.
+ */
+NTSTATUS
+EcFwEvaluateAcpi(
+    _In_ PEC_CORE Core,
+    _In_ PVOID Input,
+    _In_ size_t InputLength,
+    _Out_ PVOID Output,
+    _In_ size_t OutputLength,
+    _Out_ ULONG *BytesReturned
+    )
+{
+    WDFDEVICE device = (WDFDEVICE)Core->Device;
     WDF_MEMORY_DESCRIPTOR inputMemDesc;
     WDF_MEMORY_DESCRIPTOR outputMemDesc;
     WDFMEMORY outputMemory = WDF_NO_HANDLE;
     WDF_OBJECT_ATTRIBUTES attributes;
-    ULONG BytesReturned = 0;
-    NTSTATUS status = STATUS_SUCCESS;
-    PCHAR outBuf = NULL;
-    size_t outSize = 0;
-    size_t bufSize = 0;
-
-    status = WdfRequestRetrieveInputBuffer(context->Request, 0, &inputBuffer, &bufSize);
-    if(!NT_SUCCESS(status)) {
-        status = STATUS_INSUFFICIENT_RESOURCES;
-        goto Cleanup;
-    }
+    LARGE_INTEGER timestamp;
+    NTSTATUS status;
 
-    // Determine the size of output buffer and only give this much space to ACPI request
-    status = WdfRequestRetrieveOutputBuffer(context->Request, 0, &outBuf, &outSize);
-    if(!NT_SUCCESS(status)) {
-        status = STATUS_INSUFFICIENT_RESOURCES;
-        goto Cleanup;
-    }
+    *BytesReturned = 0;
 
     WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
-    attributes.ParentObject = context->Device;
+    attributes.ParentObject = device;
     status = WdfMemoryCreatePreallocated(&attributes,
-                                        outBuf,
-                                        outSize,
+                                        Output,
+                                        OutputLength,
                                         &outputMemory);
 
     if(!NT_SUCCESS(status)) {
-        status = STATUS_INSUFFICIENT_RESOURCES;
-        goto Cleanup;
+        return STATUS_INSUFFICIENT_RESOURCES;
     }
 
-
-
-    WDF_MEMORY_DESCRIPTOR_INIT_BUFFER(&inputMemDesc, inputBuffer, (ULONG)bufSize);
+    WDF_MEMORY_DESCRIPTOR_INIT_BUFFER(&inputMemDesc, Input, (ULONG)InputLength);
     WDF_MEMORY_DESCRIPTOR_INIT_HANDLE(&outputMemDesc, outputMemory, NULL);
-    
-    LARGE_INTEGER timestamp;
+
     KeQuerySystemTimePrecise(&timestamp);
     Trace(TRACE_LEVEL_ERROR, TRACE_QUEUE,"Before ACPI Call: %llu\n", timestamp.QuadPart);
     status = WdfIoTargetSendInternalIoctlSynchronously(
-                 WdfDeviceGetIoTarget(context->Device),
+                 WdfDeviceGetIoTarget(device),
                  NULL,
                  IOCTL_ACPI_EVAL_METHOD_EX,
                  &inputMemDesc,
                  &outputMemDesc,
                  NULL,
-                 (PULONG_PTR)&BytesReturned);
+                 (PULONG_PTR)BytesReturned);
     KeQuerySystemTimePrecise(&timestamp);
     Trace(TRACE_LEVEL_ERROR, TRACE_QUEUE,"After ACPI Call: %llu\n", timestamp.QuadPart);
 
-             
+    WdfObjectDelete(outputMemory);
+
 #if defined(EC_TEST_NOTIFICATIONS) && defined(ENABLE_NOTIFICATION_SIMULATION)
     if (NT_SUCCESS(status)) {
-        PDEVICE_CONTEXT deviceContext = DeviceContextGet(context->Device);
+        PDEVICE_CONTEXT deviceContext = DeviceContextGet(device);
         if(deviceContext->Timer != NULL) {
             // Toggle the timer
             if (FALSE == WdfTimerStart(deviceContext->Timer, WDF_REL_TIMEOUT_IN_MS(200))) {
@@ -428,171 +407,711 @@ WorkItemCallback(
     }
 #endif
 
-Cleanup:
-    WdfRequestSetInformation(context->Request,BytesReturned);
-    WdfRequestComplete( context->Request, status);
+    return status;
 }
 
+#ifdef EC_TEST_MSG_SEND2
 /*
- * Function: NTSTATUS CreateAndEnqueueWorkItem
+ * Function: PVOID GetHalRoutine
  *
  * Description:
- * The CreateAndEnqueueWorkItem function creates a work item and enqueues it for execution.
- * It initializes the work item configuration and context, and sets the callback function for the work item.
+ * Looks up an FF-A routine exported by the HAL. Indirect messaging is not part of
+ * FFA_INTERFACE_V1, so it is only available where the HAL exports these routines.
  *
  * Parameters:
- * WDFDEVICE Device: A handle to the framework device object.
- * WDFREQUEST Request: A handle to the framework request object.
+ * PCWSTR Name: The name of the routine.
  *
  * Return Value:
- * Returns an NTSTATUS value indicating the success or failure of the work item creation and enqueueing.
- * If the work item is successfully created and enqueued, it returns STATUS_SUCCESS. Otherwise, it returns an appropriate error code.
+ * The routine, or NULL if it is not exported.
+ */
+static PVOID GetHalRoutine(PCWSTR Name)
+{
+    UNICODE_STRING routineName;
+
+    RtlInitUnicodeString(&routineName, Name);
+    return MmGetSystemRoutineAddress(&routineName);
+}
+
+/*
+ * Function: NTSTATUS EcFwMessageBuffers
+ *
+ * Description:
+ * Returns the RX/TX buffers used for indirect messages. On first use maps the
+ * pair in the reserved region and registers it with FFA_RXTX_MAP through the HAL.
+ * Called with the message lock held.
+ *
+ * Parameters:
+ * PEC_CORE Core: The core state of the device.
+ * PVOID *Tx: Receives the TX buffer.
+ * PVOID *Rx: Receives the RX buffer.
+ * size_t *Size: Receives the size of each buffer.
+ *
+ * Return Value:
+ * STATUS_NOT_SUPPORTED if the HAL does not export FF-A indirect messaging,
+ * otherwise the status of mapping and registering the buffers.
  */
 NTSTATUS
-CreateAndEnqueueWorkItem(
-    _In_ WDFDEVICE Device,
-    _In_ WDFREQUEST Request
+EcFwMessageBuffers(
+    _In_ PEC_CORE Core,
+    _Out_ PVOID *Tx,
+    _Out_ PVOID *Rx,
+    _Out_ size_t *Size
     )
 {
+    PDEVICE_CONTEXT deviceContext = DeviceContextGet((WDFDEVICE)Core->Device);
+    PFFA_REGISTER_RXTX_BUFFER registerRxTx;
+    PHYSICAL_ADDRESS txAddress;
+    PHYSICAL_ADDRESS rxAddress;
+    PVOID tx = NULL;
+    PVOID rx = NULL;
     NTSTATUS status;
-    WDF_OBJECT_ATTRIBUTES attributes;
-    WDF_WORKITEM_CONFIG workitemConfig;
-    WDFWORKITEM workItem;
-    PWORKITEM_CONTEXT context;
 
-    WDF_WORKITEM_CONFIG_INIT(&workitemConfig, WorkItemCallback);
+    if (deviceContext->MessageTx == NULL) {
+        registerRxTx = (PFFA_REGISTER_RXTX_BUFFER)GetHalRoutine(L"FfaRegisterRxTxBuffer");
+        deviceContext->FfaRawSmcCall = GetHalRoutine(L"FfaRawSmcCall");
+        deviceContext->FfaReleaseRxBuffer = GetHalRoutine(L"FfaReleaseRxBuffer");
+        if (registerRxTx == NULL || deviceContext->FfaRawSmcCall == NULL || deviceContext->FfaReleaseRxBuffer == NULL) {
+            Trace(TRACE_LEVEL_ERROR, TRACE_QUEUE,"HAL does not export FF-A indirect messaging\n");
+            return STATUS_NOT_SUPPORTED;
+        }
 
-    WDF_OBJECT_ATTRIBUTES_INIT_CONTEXT_TYPE(&attributes, WORKITEM_CONTEXT);
-    attributes.ParentObject = Device;
+        txAddress.QuadPart = SBSAQEMU_MSG_TX_BASE;
+        rxAddress.QuadPart = SBSAQEMU_MSG_RX_BASE;
+        tx = MmMapIoSpaceEx(txAddress, EC_MSG_BUFFER_SIZE, PAGE_READWRITE);
+        rx = MmMapIoSpaceEx(rxAddress, EC_MSG_BUFFER_SIZE, PAGE_READWRITE);
+        if (tx == NULL || rx == NULL) {
+            status = STATUS_INSUFFICIENT_RESOURCES;
+            goto Failed;
+        }
+        RtlZeroMemory(rx, sizeof(EC_MSG_RXTX_HEADER));
 
-    status = WdfWorkItemCreate(&workitemConfig, &attributes, &workItem);
-    if (!NT_SUCCESS(status)) {
-        Trace(TRACE_LEVEL_ERROR, TRACE_QUEUE,"WdfWorkItemCreate failed: %!STATUS!\n", status);
-        return status;
+        // Fails if the OS already registered its own pair for this endpoint
+        status = registerRxTx((ULONGLONG)rx, (ULONGLONG)tx, SBSAQEMU_MSG_RX_BASE, SBSAQEMU_MSG_TX_BASE, EC_MSG_PAGES);
+        if (!NT_SUCCESS(status)) {
+            Trace(TRACE_LEVEL_ERROR, TRACE_QUEUE,"FfaRegisterRxTxBuffer failed %!STATUS!\n", status);
+            goto Failed;
+        }
+
+        deviceContext->MessageTx = tx;
+        deviceContext->MessageRx = rx;
     }
 
-    context = WorkItemGetContext(workItem);
-    context->Device = Device;
-    context->Request = Request;
+    *Tx = deviceContext->MessageTx;
+    *Rx = deviceContext->MessageRx;
+    *Size = EC_MSG_BUFFER_SIZE;
+    return STATUS_SUCCESS;
 
-    WdfWorkItemEnqueue(workItem);
+Failed:
+    if (tx != NULL) {
+        MmUnmapIoSpace(tx, EC_MSG_BUFFER_SIZE);
+    }
+    if (rx != NULL) {
+        MmUnmapIoSpace(rx, EC_MSG_BUFFER_SIZE);
+    }
+    return status;
+}
 
+/*
+ * Function: NTSTATUS EcFwMessageSend
+ *
+ * Description:
+ * Signals the message in the TX buffer to the EC with FFA_MSG_SEND2. The receiver
+ * is taken from the message header.
+ *
+ * Parameters:
+ * PEC_CORE Core: The core state of the device.
+ *
+ * Return Value:
+ * Returns an NTSTATUS value indicating whether the SPMC accepted the message.
+ */
+NTSTATUS
+EcFwMessageSend(
+    _In_ PEC_CORE Core
+    )
+{
+    PDEVICE_CONTEXT deviceContext = DeviceContextGet((WDFDEVICE)Core->Device);
+    FFA_PARAMETERS input;
+    FFA_PARAMETERS output;
+    NTSTATUS status;
+
+    RtlZeroMemory(&input, sizeof(input));
+    input.Arg0 = FFA_MSG_SEND2;
+    input.Arg1 = (ULONGLONG)EC_HOST_VMID << 16;
+    status = ((PFFA_RAW_SMC_CALL)deviceContext->FfaRawSmcCall)(&input, &output);
+    if (NT_SUCCESS(status) && output.Arg0 != FFA_SUCCESS_AARCH32 && output.Arg0 != FFA_SUCCESS_AARCH64) {
+        Trace(TRACE_LEVEL_ERROR, TRACE_QUEUE,"FFA_MSG_SEND2 returned 0x%llx error %lld\n", output.Arg0, (LONGLONG)output.Arg2);
+        status = STATUS_UNSUCCESSFUL;
+    }
     return status;
 }
 
 /*
- * Function: VOID ECTestEvtIoDeviceControl
+ * Function: VOID EcFwMessageRelease
  *
  * Description:
- * The ECTestEvtIoDeviceControl function handles device control requests for a KMDF driver.
- * It processes the specified I/O control code and enqueues a work item for ACPI method evaluation if applicable.
+ * Marks the RX buffer empty and hands it back to the SPMC with FFA_RX_RELEASE
+ * so the EC can send the next message.
  *
  * Parameters:
- * WDFQUEUE Queue: A handle to the framework queue object.
- * WDFREQUEST Request: A handle to the framework request object.
- * size_t OutputBufferLength: The length of the output buffer.
- * size_t InputBufferLength: The length of the input buffer.
- * ULONG IoControlCode: The I/O control code specifying the operation to perform.
+ * PEC_CORE Core: The core state of the device.
  *
  * Return Value:
- * This function does not return a value.
+ * VOID
  */
 VOID
-ECTestEvtIoDeviceControl(
-    IN WDFQUEUE         Queue,
-    IN WDFREQUEST       Request,
-    IN size_t           OutputBufferLength,
-    IN size_t           InputBufferLength,
-    IN ULONG            IoControlCode
+EcFwMessageRelease(
+    _In_ PEC_CORE Core
     )
 {
-    NTSTATUS            status = STATUS_SUCCESS;// Assume success
-    BOOLEAN             completeRequest = TRUE;
+    PDEVICE_CONTEXT deviceContext = DeviceContextGet((WDFDEVICE)Core->Device);
+    volatile EC_MSG_RXTX_HEADER *rx = (volatile EC_MSG_RXTX_HEADER *)deviceContext->MessageRx;
+
+    rx->Size = 0;
+    ((PFFA_RXTX_ROUTINE)deviceContext->FfaReleaseRxBuffer)();
+}
+
+#ifdef EC_TEST_MEM_SHARE
+/*
+ * Function: NTSTATUS EcFwShareAllocate
+ *
+ * Description:
+ * Allocates physically contiguous, cached memory to share with the EC.
+ *
+ * Parameters:
+ * PEC_CORE Core: The core state of the device.
+ * UINT32 Pages: The number of 4K pages.
+ * PVOID *Buffer: Receives the driver mapping.
+ * UINT64 *Address: Receives the physical address.
+ *
+ * Return Value:
+ * STATUS_INSUFFICIENT_RESOURCES if no contiguous range is available.
+ */
+NTSTATUS
+EcFwShareAllocate(
+    _In_ PEC_CORE Core,
+    _In_ UINT32 Pages,
+    _Out_ PVOID *Buffer,
+    _Out_ UINT64 *Address
+    )
+{
+    PHYSICAL_ADDRESS lowest;
+    PHYSICAL_ADDRESS highest;
+    PHYSICAL_ADDRESS boundary;
+    PVOID buffer;
+
+    UNREFERENCED_PARAMETER(Core);
+
+    lowest.QuadPart = 0;
+    highest.QuadPart = -1;
+    boundary.QuadPart = 0;
+    buffer = MmAllocateContiguousMemorySpecifyCache((SIZE_T)Pages * FFA_MEM_PAGE_SIZE, lowest, highest, boundary, MmCached);
+    if (buffer == NULL) {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
 
-    if(!OutputBufferLength || !InputBufferLength)
-    {
-        WdfRequestComplete(Request, STATUS_INVALID_PARAMETER);
+    RtlZeroMemory(buffer, (SIZE_T)Pages * FFA_MEM_PAGE_SIZE);
+    *Buffer = buffer;
+    *Address = (UINT64)MmGetPhysicalAddress(buffer).QuadPart;
+    return STATUS_SUCCESS;
+}
+
+/*
+ * Function: VOID EcFwShareFree
+ *
+ * Description:
+ * Frees memory from EcFwShareAllocate once it has been reclaimed.
+ *
+ * Parameters:
+ * PEC_CORE Core: The core state of the device.
+ * PVOID Buffer: The driver mapping.
+ * UINT32 Pages: The number of 4K pages.
+ *
+ * Return Value:
+ * VOID
+ */
+VOID
+EcFwShareFree(
+    _In_ PEC_CORE Core,
+    _In_ PVOID Buffer,
+    _In_ UINT32 Pages
+    )
+{
+    UNREFERENCED_PARAMETER(Core);
+
+    MmFreeContiguousMemorySpecifyCache(Buffer, (SIZE_T)Pages * FFA_MEM_PAGE_SIZE, MmCached);
+}
+
+/*
+ * Function: NTSTATUS EcFwMemShare
+ *
+ * Description:
+ * Shares memory with FFA_MEM_SHARE, using the transaction descriptor already
+ * written to the driver TX buffer. Called with the message lock held.
+ *
+ * Parameters:
+ * PEC_CORE Core: The core state of the device.
+ * UINT32 Length: The length of the descriptor.
+ * UINT64 *Handle: Receives the memory handle.
+ *
+ * Return Value:
+ * Returns an NTSTATUS value indicating whether the SPMC accepted the share.
+ */
+NTSTATUS
+EcFwMemShare(
+    _In_ PEC_CORE Core,
+    _In_ UINT32 Length,
+    _Out_ UINT64 *Handle
+    )
+{
+    PDEVICE_CONTEXT deviceContext = DeviceContextGet((WDFDEVICE)Core->Device);
+    FFA_PARAMETERS input;
+    FFA_PARAMETERS output;
+    NTSTATUS status;
+
+    // Descriptor fits in the TX buffer, so total and fragment length are the same
+    RtlZeroMemory(&input, sizeof(input));
+    input.Arg0 = FFA_MEM_SHARE_SMC;
+    input.Arg1 = Length;
+    input.Arg2 = Length;
+    status = ((PFFA_RAW_SMC_CALL)deviceContext->FfaRawSmcCall)(&input, &output);
+    if (NT_SUCCESS(status) && output.Arg0 != FFA_SUCCESS_AARCH32 && output.Arg0 != FFA_SUCCESS_AARCH64) {
+        Trace(TRACE_LEVEL_ERROR, TRACE_QUEUE,"FFA_MEM_SHARE returned 0x%llx error %lld\n", output.Arg0, (LONGLONG)output.Arg2);
+        status = STATUS_UNSUCCESSFUL;
+    }
+    if (NT_SUCCESS(status)) {
+        *Handle = (output.Arg2 & 0xFFFFFFFF) | (output.Arg3 << 32);
+    }
+    return status;
+}
+
+/*
+ * Function: NTSTATUS EcFwMemReclaim
+ *
+ * Description:
+ * Takes back memory shared with EcFwMemShare with FFA_MEM_RECLAIM. Fails while
+ * the EC still has the region retrieved. Called with the message lock held.
+ *
+ * Parameters:
+ * PEC_CORE Core: The core state of the device.
+ * UINT64 Handle: The memory handle.
+ *
+ * Return Value:
+ * Returns an NTSTATUS value indicating whether the memory was reclaimed.
+ */
+NTSTATUS
+EcFwMemReclaim(
+    _In_ PEC_CORE Core,
+    _In_ UINT64 Handle
+    )
+{
+    PDEVICE_CONTEXT deviceContext = DeviceContextGet((WDFDEVICE)Core->Device);
+    FFA_PARAMETERS input;
+    FFA_PARAMETERS output;
+    NTSTATUS status;
+
+    RtlZeroMemory(&input, sizeof(input));
+    input.Arg0 = FFA_MEM_RECLAIM_SMC;
+    input.Arg1 = Handle & 0xFFFFFFFF;
+    input.Arg2 = Handle >> 32;
+    status = ((PFFA_RAW_SMC_CALL)deviceContext->FfaRawSmcCall)(&input, &output);
+    if (NT_SUCCESS(status) && output.Arg0 != FFA_SUCCESS_AARCH32 && output.Arg0 != FFA_SUCCESS_AARCH64) {
+        Trace(TRACE_LEVEL_ERROR, TRACE_QUEUE,"FFA_MEM_RECLAIM returned 0x%llx error %lld\n", output.Arg0, (LONGLONG)output.Arg2);
+        status = STATUS_UNSUCCESSFUL;
+    }
+    return status;
+}
+#endif // EC_TEST_MEM_SHARE
+
+/*
+ * Function: VOID ECTestMessageCleanup
+ *
+ * Description:
+ * Unregisters the RX/TX buffers with FFA_RXTX_UNMAP and unmaps them, if the
+ * device ever sent a message.
+ *
+ * Parameters:
+ * WDFDEVICE Device: The device being removed.
+ *
+ * Return Value:
+ * VOID
+ */
+VOID
+ECTestMessageCleanup(
+    WDFDEVICE Device
+    )
+{
+    PDEVICE_CONTEXT deviceContext = DeviceContextGet(Device);
+    PFFA_RXTX_ROUTINE unregisterRxTx;
+
+    if (deviceContext->MessageTx == NULL) {
         return;
     }
 
-    WDFDEVICE device = WdfIoQueueGetDevice(Queue);
+    unregisterRxTx = (PFFA_RXTX_ROUTINE)GetHalRoutine(L"FfaUnregisterRxTxBuffer");
+    if (unregisterRxTx != NULL) {
+        unregisterRxTx();
+    }
+    MmUnmapIoSpace(deviceContext->MessageTx, EC_MSG_BUFFER_SIZE);
+    MmUnmapIoSpace(deviceContext->MessageRx, EC_MSG_BUFFER_SIZE);
+    deviceContext->MessageTx = NULL;
+    deviceContext->MessageRx = NULL;
+}
+#endif // EC_TEST_MSG_SEND2
 
-    //
-    // Determine which I/O control code was specified.
-    //
+#ifdef EC_TEST_SAMPLER
+/*
+ * Function: VOID ECTestSamplerTimer
+ *
+ * Description:
+ * Passive level timer routine that hands the sampling pass to the core, which
+ * arms the timer again for the next due method.
+ *
+ * Parameters:
+ * WDFTIMER Timer: The sampler timer of the device.
+ *
+ * Return Value:
+ * VOID
+ */
+VOID
+ECTestSamplerTimer(
+    _In_ WDFTIMER Timer
+    )
+{
+    WDFDEVICE device = WdfTimerGetParentObject(Timer);
+
+    EcCoreSample(&DeviceContextGet(device)->Core);
+}
+
+VOID EcFwSamplerSchedule(PEC_CORE Core, ULONG Milliseconds)
+{
+    PDEVICE_CONTEXT deviceContext = DeviceContextGet((WDFDEVICE)Core->Device);
+
+    // Restarting a timer that is already queued replaces its due time
+    WdfTimerStart(deviceContext->SamplerTimer, WDF_REL_TIMEOUT_IN_MS(Milliseconds));
+}
+
+VOID EcFwSamplerStop(PEC_CORE Core)
+{
+    PDEVICE_CONTEXT deviceContext = DeviceContextGet((WDFDEVICE)Core->Device);
+
+    if (deviceContext->SamplerTimer != NULL) {
+        WdfTimerStop(deviceContext->SamplerTimer, TRUE);
+    }
+}
+
+NTSTATUS EcFwEventReference(PEC_CORE Core, UINT64 Handle, EC_FW_HANDLE *Event)
+{
+    UNREFERENCED_PARAMETER(Core);
+
+    // EvtIoDeviceControl of the top level parallel queue runs in the caller's context
+    return ObReferenceObjectByHandle((HANDLE)(ULONG_PTR)Handle,
+                                     EVENT_MODIFY_STATE,
+                                     *ExEventObjectType,
+                                     UserMode,
+                                     Event,
+                                     NULL);
+}
+
+VOID EcFwEventSignal(EC_FW_HANDLE Event)
+{
+    KeSetEvent((PKEVENT)Event, IO_NO_INCREMENT, FALSE);
+}
+
+VOID EcFwEventDereference(EC_FW_HANDLE Event)
+{
+    ObDereferenceObject(Event);
+}
+#endif // EC_TEST_SAMPLER
+
+//
+// Remaining framework services used by the core, see eccore.h
+//
+
+VOID EcFwLockAcquire(EC_FW_HANDLE Lock)
+{
+    WdfWaitLockAcquire((WDFWAITLOCK)Lock, NULL);
+}
+
+VOID EcFwLockRelease(EC_FW_HANDLE Lock)
+{
+    WdfWaitLockRelease((WDFWAITLOCK)Lock);
+}
+
+NTSTATUS EcFwRetrieveInputBuffer(EC_FW_REQUEST Request, size_t MinimumRequiredSize, PVOID *Buffer, size_t *Length)
+{
+    return WdfRequestRetrieveInputBuffer((WDFREQUEST)Request, MinimumRequiredSize, Buffer, Length);
+}
+
+NTSTATUS EcFwRetrieveOutputBuffer(EC_FW_REQUEST Request, size_t MinimumRequiredSize, PVOID *Buffer, size_t *Length)
+{
+    return WdfRequestRetrieveOutputBuffer((WDFREQUEST)Request, MinimumRequiredSize, Buffer, Length);
+}
+
+VOID EcFwRequestComplete(EC_FW_REQUEST Request, NTSTATUS Status, size_t Information)
+{
+    WdfRequestCompleteWithInformation((WDFREQUEST)Request, Status, Information);
+}
+
+EC_FW_HANDLE EcFwRequestFile(EC_FW_REQUEST Request)
+{
+    return WdfRequestGetFileObject((WDFREQUEST)Request);
+}
 
-    switch (IoControlCode)
-    {
-    case IOCTL_ACPI_EVAL_METHOD_EX:
-        Trace(TRACE_LEVEL_INFORMATION, TRACE_QUEUE,"IOCTL_ACPI_EVAL_METHOD_EX\n");
-
-        // Request is retrieved and handled in the callback
-        status = CreateAndEnqueueWorkItem(device, Request);
-        // If we enqueue it successfully it will be completed later, otherwise complete with status
-        if (NT_SUCCESS(status)) {
-            Trace(TRACE_LEVEL_INFORMATION, TRACE_QUEUE,"EVAL request 0x%llx pended\n", (UINT64)Request);
-            // Request will be completed later in work item callback
-
-            completeRequest = FALSE;
-        } else {
-            Trace(TRACE_LEVEL_ERROR, TRACE_QUEUE,"CreateAndEnqueueWorkItem failed\n");
-        }
-        break;
 #ifdef EC_TEST_NOTIFICATIONS
-    case IOCTL_GET_NOTIFICATION:
-        Trace(TRACE_LEVEL_INFORMATION, TRACE_QUEUE,"IOCTL_GET_NOTIFICATION \n");
-        status = NotificationGet(device, Request);
+NTSTATUS EcFwRequestMarkCancelable(PEC_CORE Core, EC_FW_REQUEST Request)
+{
+    UNREFERENCED_PARAMETER(Core);
+    return WdfRequestMarkCancelableEx((WDFREQUEST)Request, ECTestEvtRequestCancel);
+}
 
-        // If we enqueue it successfully it will be completed later, otherwise complete with status
-        if (NT_SUCCESS(status)) {
-            completeRequest = FALSE;
-        }
-        break;
+NTSTATUS EcFwRequestUnmarkCancelable(EC_FW_REQUEST Request)
+{
+    return WdfRequestUnmarkCancelable((WDFREQUEST)Request);
+}
 #endif // EC_TEST_NOTIFICATIONS
 
-#ifdef EC_TEST_SHARED_BUFFER
-    case IOCTL_READ_RX_BUFFER:
-        size_t rxSize = 0;
-        RxBufferRsp_t *rxrsp = NULL;
+NTSTATUS EcFwReadPhysical64(PEC_CORE Core, UINT64 Address, UINT64 *Value)
+{
+    UNREFERENCED_PARAMETER(Core);
+    PHYSICAL_ADDRESS physicalAddress;
+    PVOID virtualAddress;
 
-        // Determine the size of output buffer and only give this much space to ACPI request
-        status = WdfRequestRetrieveOutputBuffer(Request, 0, &rxrsp, &rxSize);
-        if(!NT_SUCCESS(status)) {
-            status = STATUS_INSUFFICIENT_RESOURCES;
-            break;
-        }
+    physicalAddress.QuadPart = Address;
 
-        PHYSICAL_ADDRESS physicalAddress;
-        PVOID virtualAddress;
-        ULONG64 value;
+    // Map the physical address to a virtual address
+    virtualAddress = MmMapIoSpaceEx(physicalAddress, sizeof(ULONG64), PAGE_READONLY);
+    if (virtualAddress == NULL) {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
 
-        // Set the physical address
-        physicalAddress.QuadPart = SBSAQEMU_SHARED_MEM_BASE;
+    *Value = *(volatile ULONG64*)virtualAddress;
 
-        // Map the physical address to a virtual address
-        virtualAddress = MmMapIoSpaceEx(physicalAddress, sizeof(ULONG64), PAGE_READONLY);
+    MmUnmapIoSpace(virtualAddress, sizeof(ULONG64));
+    return STATUS_SUCCESS;
+}
 
-        if (virtualAddress == NULL) {
-            status = STATUS_INSUFFICIENT_RESOURCES;
-            break;
+#if defined(EC_TEST_STATIC) || defined(EC_TEST_BATTERY)
+NTSTATUS EcFwReadPhysical(PEC_CORE Core, UINT64 Address, PVOID Buffer, ULONG Length)
+{
+    UNREFERENCED_PARAMETER(Core);
+    PHYSICAL_ADDRESS physicalAddress;
+    PVOID virtualAddress;
+
+    physicalAddress.QuadPart = Address;
+    virtualAddress = MmMapIoSpaceEx(physicalAddress, Length, PAGE_READONLY);
+    if (virtualAddress == NULL) {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    RtlCopyMemory(Buffer, virtualAddress, Length);
+
+    MmUnmapIoSpace(virtualAddress, Length);
+    return STATUS_SUCCESS;
+}
+#endif // EC_TEST_STATIC || EC_TEST_BATTERY
+
+#ifdef EC_TEST_MAP_RX
+// From ntifs.h, which cannot be included after ntddk.h
+_IRQL_requires_max_(PASSIVE_LEVEL)
+NTKERNELAPI
+NTSTATUS
+MmUnmapViewOfSection (
+    _In_ PEPROCESS Process,
+    _In_ PVOID BaseAddress
+    );
+
+/*
+ * Function: NTSTATUS MapPhysicalView
+ *
+ * Description:
+ * Maps physical memory into the current process through \Device\PhysicalMemory.
+ * The view is mapped SEC_NO_CHANGE, so the process can neither change its
+ * protection nor unmap it, the driver unmaps it when the handle is cleaned up.
+ *
+ * Parameters:
+ * UINT64 Address: Page aligned physical address.
+ * ULONG Length: Bytes to map, a multiple of the page size.
+ * ULONG Protect: PAGE_READONLY or PAGE_READWRITE.
+ * UINT64 *View: Receives the user address of the view.
+ *
+ * Return Value:
+ * NTSTATUS status code indicating the success or failure of the operation.
+ */
+static NTSTATUS MapPhysicalView(UINT64 Address, ULONG Length, ULONG Protect, UINT64 *View)
+{
+    UNICODE_STRING name = RTL_CONSTANT_STRING(L"\\Device\\PhysicalMemory");
+    OBJECT_ATTRIBUTES attributes;
+    LARGE_INTEGER offset;
+    SIZE_T size = Length;
+    PVOID base = NULL;
+    HANDLE section;
+    NTSTATUS status;
+
+    InitializeObjectAttributes(&attributes, &name, OBJ_CASE_INSENSITIVE | OBJ_KERNEL_HANDLE, NULL, NULL);
+    status = ZwOpenSection(&section,
+                           Protect == PAGE_READONLY ? SECTION_MAP_READ : SECTION_MAP_READ | SECTION_MAP_WRITE,
+                           &attributes);
+    if (!NT_SUCCESS(status)) {
+        return status;
+    }
+
+    offset.QuadPart = (LONGLONG)Address;
+    status = ZwMapViewOfSection(section, ZwCurrentProcess(), &base, 0, Length, &offset, &size,
+                                ViewUnmap, SEC_NO_CHANGE, Protect);
+    ZwClose(section);
+    if (NT_SUCCESS(status)) {
+        *View = (UINT64)(ULONG_PTR)base;
+    }
+    return status;
+}
+
+NTSTATUS EcFwMapShared(PEC_CORE Core, EC_FW_REQUEST Request, UINT64 *Tx, UINT64 *Rx)
+{
+    PDEVICE_CONTEXT deviceContext = DeviceContextGet((WDFDEVICE)Core->Device);
+    WDFFILEOBJECT fileObject = WdfRequestGetFileObject((WDFREQUEST)Request);
+    PFILE_CONTEXT fileContext;
+    ULONG txProtect;
+    NTSTATUS status = STATUS_SUCCESS;
+
+    if (fileObject == NULL) {
+        return STATUS_INVALID_DEVICE_REQUEST;
+    }
+    fileContext = FileContextGet(fileObject);
+
+    // The I/O manager checks the access the IOCTL code asks for, the TX view is
+    // tied to the handle's own write access as well
+    txProtect = WdfFileObjectWdmGetFileObject(fileObject)->WriteAccess ? PAGE_READWRITE : PAGE_READONLY;
+
+    WdfWaitLockAcquire(deviceContext->MapLock, NULL);
+    if (fileContext->Tx != 0) {
+        // The views only exist in the process that asked for them first
+        if (fileContext->Process != PsGetCurrentProcess()) {
+            status = STATUS_ACCESS_DENIED;
         }
+        goto Exit;
+    }
 
-        // Read the value from the virtual address
-        value = *(volatile ULONG64*)virtualAddress;
+    // EvtIoDeviceControl of the top level parallel queue runs in the caller's context
+    status = MapPhysicalView(SBSAQEMU_SHARED_MEM_BASE, EC_MAP_TX_LENGTH, txProtect, &fileContext->Tx);
+    if (!NT_SUCCESS(status)) {
+        Trace(TRACE_LEVEL_ERROR, TRACE_QUEUE,"Mapping the TX window failed %!STATUS!\n", status);
+        fileContext->Tx = 0;
+        goto Exit;
+    }
 
-        // Unmap the virtual address
-        MmUnmapIoSpace(virtualAddress, sizeof(ULONG64));
-        
-        rxrsp->data = value;
-        break;
-#endif // EC_TEST_SHARED_BUFFER
+    status = MapPhysicalView(EC_SHARED_RX_BASE, EC_MAP_RX_LENGTH, PAGE_READONLY, &fileContext->Rx);
+    if (!NT_SUCCESS(status)) {
+        Trace(TRACE_LEVEL_ERROR, TRACE_QUEUE,"Mapping the RX window failed %!STATUS!\n", status);
+        ZwUnmapViewOfSection(ZwCurrentProcess(), (PVOID)(ULONG_PTR)fileContext->Tx);
+        fileContext->Tx = 0;
+        fileContext->Rx = 0;
+        goto Exit;
+    }
 
-    default:
-        status = STATUS_INVALID_PARAMETER;
-        break;
+    fileContext->Process = PsGetCurrentProcess();
+    ObReferenceObject(fileContext->Process);
+
+Exit:
+    if (NT_SUCCESS(status)) {
+        *Tx = fileContext->Tx;
+        *Rx = fileContext->Rx;
+    }
+    WdfWaitLockRelease(deviceContext->MapLock);
+    return status;
+}
+#endif // EC_TEST_MAP_RX
+
+/*
+ * Function: VOID ECTestEvtFileCleanup
+ *
+ * Description:
+ * Releases what the core holds for a handle once its last handle is closed and
+ * unmaps the views IOCTL_MAP_RX mapped for it. Cleanup can run in another
+ * process than the one holding the views if the handle was duplicated, so they
+ * are unmapped from that process.
+ *
+ * Parameters:
+ * WDFFILEOBJECT FileObject: The file object of the handle.
+ *
+ * Return Value:
+ * VOID
+ */
+VOID ECTestEvtFileCleanup(WDFFILEOBJECT FileObject)
+{
+    PDEVICE_CONTEXT deviceContext = DeviceContextGet(WdfFileObjectGetDevice(FileObject));
+
+    EcCoreFileCleanup(&deviceContext->Core, FileObject);
+
+#ifdef EC_TEST_MAP_RX
+    PFILE_CONTEXT fileContext = FileContextGet(FileObject);
+
+    WdfWaitLockAcquire(deviceContext->MapLock, NULL);
+    if (fileContext->Tx != 0) {
+        MmUnmapViewOfSection(fileContext->Process, (PVOID)(ULONG_PTR)fileContext->Tx);
+        MmUnmapViewOfSection(fileContext->Process, (PVOID)(ULONG_PTR)fileContext->Rx);
+        ObDereferenceObject(fileContext->Process);
+        fileContext->Process = NULL;
+        fileContext->Tx = 0;
+        fileContext->Rx = 0;
     }
+    WdfWaitLockRelease(deviceContext->MapLock);
+#endif // EC_TEST_MAP_RX
+}
 
-    if (completeRequest) {
-        WdfRequestComplete(Request, status);
+LONGLONG EcFwQuerySystemTime(VOID)
+{
+    LARGE_INTEGER timestamp;
+
+    KeQuerySystemTimePrecise(&timestamp);
+    return timestamp.QuadPart;
+}
+
+VOID EcFwDelay(ULONG Microseconds)
+{
+    LARGE_INTEGER interval;
+
+    // Short delays spin so they are not rounded up to the timer resolution
+    if (Microseconds <= EC_FW_MAX_STALL_US) {
+        KeStallExecutionProcessor(Microseconds);
+        return;
     }
+
+    interval.QuadPart = -(LONGLONG)Microseconds * 10;
+    KeDelayExecutionThread(KernelMode, FALSE, &interval);
+}
+
+/*
+ * Function: VOID ECTestEvtIoDeviceControl
+ *
+ * Description:
+ * The ECTestEvtIoDeviceControl function handles device control requests for a KMDF driver.
+ * Dispatch itself lives in EcCoreDeviceControl so it can also run under the user-mode shim.
+ *
+ * Parameters:
+ * WDFQUEUE Queue: A handle to the framework queue object.
+ * WDFREQUEST Request: A handle to the framework request object.
+ * size_t OutputBufferLength: The length of the output buffer.
+ * size_t InputBufferLength: The length of the input buffer.
+ * ULONG IoControlCode: The I/O control code specifying the operation to perform.
+ *
+ * Return Value:
+ * This function does not return a value.
+ */
+VOID
+ECTestEvtIoDeviceControl(
+    IN WDFQUEUE         Queue,
+    IN WDFREQUEST       Request,
+    IN size_t           OutputBufferLength,
+    IN size_t           InputBufferLength,
+    IN ULONG            IoControlCode
+    )
+{
+    WDFDEVICE device = WdfIoQueueGetDevice(Queue);
+    PDEVICE_CONTEXT deviceContext = DeviceContextGet(device);
+
+    EcCoreDeviceControl(&deviceContext->Core,
+                        Request,
+                        OutputBufferLength,
+                        InputBufferLength,
+                        IoControlCode);
 }
@@ -18,6 +18,7 @@ typedef struct _WORKITEM_CONTEXT {
     WDFDEVICE Device;
     WDFQUEUE Queue;
     WDFREQUEST Request;
+    ULONG IoControlCode;
     ACPI_EVAL_INPUT_BUFFER_V1_EX *Buffer;
 } WORKITEM_CONTEXT, *PWORKITEM_CONTEXT;
 
@@ -38,3 +39,11 @@ ECTestEvtIoDeviceControl(
     IN size_t           InputBufferLength,
     IN ULONG            IoControlCode
     );
+
+#ifdef EC_TEST_MSG_SEND2
+// Unregisters and unmaps the indirect message buffers of a device being removed
+VOID
+ECTestMessageCleanup(
+    WDFDEVICE Device
+    );
+#endif
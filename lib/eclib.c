@@ -28,6 +28,7 @@ SOFTWARE.
 #include <cfgmgr32.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <malloc.h>
 #include <errno.h>
 #include <SetupAPI.h>
 #include <Devpkey.h>
@@ -35,6 +36,8 @@ SOFTWARE.
 #include <devioctl.h>
 #include "..\inc\eclib.h"
 #include "..\inc\ectest.h"
+#include "..\inc\ecring.h"
+#include "..\uefi\Platforms\QemuSbsaPkg\SbsaQemuPlatformDxe\EcStaticSnapshot.h"
 
 #define MAX_DEVPATH_LENGTH  64
 
@@ -53,6 +56,260 @@ typedef struct {
 
 static NotificationState g_notify;
 
+// Newest battery status seen, pushed with EC_NOTIFY_BATTERY or fetched
+typedef struct {
+    SRWLOCK lock;
+    BOOL valid;
+    BatteryStatus_t status;
+    UINT64 pushes;
+} BatteryState;
+
+static BatteryState g_battery = { SRWLOCK_INIT };
+
+#define BATTERY_READ_RETRIES    16      // Reads of the event page slot while the EC rewrites it
+
+// Views of the shared memory window, mapped once per process. The driver
+// unmaps them when the handle they were mapped on is closed, so it stays open
+typedef struct {
+    SRWLOCK lock;
+    BOOL mapped;
+    HANDLE handle;
+    ECLIB_SHARED_VIEWS views;
+} SharedState;
+
+static SharedState g_shared = { SRWLOCK_INIT };
+
+// One per thread, only ever written by its thread and aligned so no two shards
+// share a cache line
+typedef struct _MetricsShard {
+    volatile UINT64 counters[ECLIB_COUNTERS];
+    struct {
+        volatile UINT64 count;
+        volatile UINT64 sum_us;
+        volatile UINT64 max_us;
+        volatile UINT64 buckets[ECLIB_HISTOGRAM_BUCKETS];
+    } histograms[ECLIB_HISTOGRAMS];
+    struct _MetricsShard *next;
+} MetricsShard;
+
+typedef struct {
+    SRWLOCK lock;
+    MetricsShard *shards;       // Of the threads still running
+    MetricsShard *free;         // Of exited threads, handed to new ones
+    ECLIB_METRICS retired;      // Counts of exited threads, threads is unused
+    ECLIB_METRICS baseline;     // Totals at the last reset
+    INIT_ONCE once;
+    DWORD fls;                  // Holds the shard of each thread, retired when it exits
+} MetricsState;
+
+static MetricsState g_metrics = { SRWLOCK_INIT };
+
+/*
+ * Function: AddShard
+ * ------------------
+ * Adds the counts of a shard to a total, the caller holds the metrics lock.
+ *
+ * Parameters:
+ *   ECLIB_METRICS* total   - Total to add to.
+ *   MetricsShard* shard    - The shard.
+ */
+static void AddShard(ECLIB_METRICS *total, const MetricsShard *shard)
+{
+    for (UINT32 i = 0; i < ECLIB_COUNTERS; i++) {
+        total->counters[i] += shard->counters[i];
+    }
+    for (UINT32 h = 0; h < ECLIB_HISTOGRAMS; h++) {
+        ECLIB_HISTOGRAM *sum = &total->histograms[h];
+        sum->count += shard->histograms[h].count;
+        sum->sum_us += shard->histograms[h].sum_us;
+        sum->max_us = max(sum->max_us, shard->histograms[h].max_us);
+        for (UINT32 b = 0; b < ECLIB_HISTOGRAM_BUCKETS; b++) {
+            sum->buckets[b] += shard->histograms[h].buckets[b];
+        }
+    }
+}
+
+/*
+ * Function: RetireShard
+ * ---------------------
+ * FLS callback run as a thread that used eclib exits. Folds its counts into
+ * the retired total and keeps the shard for the next new thread, so threadpool
+ * churn does not grow the shard list.
+ *
+ * Parameters:
+ *   PVOID data             - The shard of the exiting thread.
+ */
+static VOID WINAPI RetireShard(PVOID data)
+{
+    MetricsShard *shard = (MetricsShard *)data;
+    MetricsShard **link;
+
+    AcquireSRWLockExclusive(&g_metrics.lock);
+    AddShard(&g_metrics.retired, shard);
+    for (link = &g_metrics.shards; *link != shard; link = &(*link)->next) {
+    }
+    *link = shard->next;
+    memset((void *)shard, 0, sizeof(*shard));
+    shard->next = g_metrics.free;
+    g_metrics.free = shard;
+    ReleaseSRWLockExclusive(&g_metrics.lock);
+}
+
+/*
+ * Function: AllocShardIndex
+ * -------------------------
+ * InitOnce callback that allocates the FLS index holding each thread's shard.
+ *
+ * Returns:
+ *   BOOL - FALSE if no FLS index is left, metrics are then not counted.
+ */
+static BOOL CALLBACK AllocShardIndex(PINIT_ONCE once, PVOID parameter, PVOID *context)
+{
+    UNREFERENCED_PARAMETER(once);
+    UNREFERENCED_PARAMETER(parameter);
+    UNREFERENCED_PARAMETER(context);
+
+    g_metrics.fls = FlsAlloc(RetireShard);
+    return g_metrics.fls != FLS_OUT_OF_INDEXES;
+}
+
+/*
+ * Function: GetShard
+ * ------------------
+ * Returns the metrics shard of the calling thread, taking a retired one or
+ * creating one on first use.
+ *
+ * Returns:
+ *   MetricsShard* - The shard, NULL if it could not be allocated.
+ */
+static MetricsShard *GetShard(void)
+{
+    MetricsShard *shard;
+
+    if (!InitOnceExecuteOnce(&g_metrics.once, AllocShardIndex, NULL, NULL)) {
+        return NULL;
+    }
+    shard = (MetricsShard *)FlsGetValue(g_metrics.fls);
+    if (shard != NULL) {
+        return shard;
+    }
+
+    AcquireSRWLockExclusive(&g_metrics.lock);
+    shard = g_metrics.free;
+    if (shard != NULL) {
+        g_metrics.free = shard->next;
+    }
+    ReleaseSRWLockExclusive(&g_metrics.lock);
+    if (shard == NULL) {
+        shard = (MetricsShard *)_aligned_malloc(sizeof(MetricsShard), SYSTEM_CACHE_ALIGNMENT_SIZE);
+        if (shard == NULL) {
+            return NULL;
+        }
+        memset(shard, 0, sizeof(*shard));
+    }
+
+    AcquireSRWLockExclusive(&g_metrics.lock);
+    shard->next = g_metrics.shards;
+    g_metrics.shards = shard;
+    ReleaseSRWLockExclusive(&g_metrics.lock);
+    if (!FlsSetValue(g_metrics.fls, shard)) {
+        RetireShard(shard);
+        return NULL;
+    }
+    return shard;
+}
+
+/*
+ * Function: MetricsCount
+ * ----------------------
+ * Adds to a counter of the calling thread.
+ *
+ * Parameters:
+ *   UINT32 counter         - ECLIB_COUNTER_*.
+ *   UINT64 value           - Amount to add.
+ */
+static void MetricsCount(UINT32 counter, UINT64 value)
+{
+    MetricsShard *shard = GetShard();
+
+    if (shard != NULL) {
+        shard->counters[counter] += value;
+    }
+}
+
+/*
+ * Function: MetricsRecord
+ * -----------------------
+ * Adds a duration to a histogram of the calling thread.
+ *
+ * Parameters:
+ *   UINT32 histogram       - ECLIB_HISTOGRAM_*.
+ *   UINT64 us              - The duration in microseconds.
+ */
+static void MetricsRecord(UINT32 histogram, UINT64 us)
+{
+    MetricsShard *shard = GetShard();
+    DWORD index = 0;
+    UINT32 bucket = 0;
+
+    if (shard == NULL) {
+        return;
+    }
+    if (us != 0) {
+        BitScanReverse64(&index, us);
+        bucket = min(index + 1, ECLIB_HISTOGRAM_BUCKETS - 1);
+    }
+    shard->histograms[histogram].count++;
+    shard->histograms[histogram].sum_us += us;
+    if (us > shard->histograms[histogram].max_us) {
+        shard->histograms[histogram].max_us = us;
+    }
+    shard->histograms[histogram].buckets[bucket]++;
+}
+
+/*
+ * Function: MeteredIoctl
+ * ----------------------
+ * DeviceIoControl for every synchronous request eclib sends, counting it and
+ * timing it into the call histogram, or the wait histogram for requests that
+ * block until a notification or sample arrives.
+ *
+ * Returns:
+ *   BOOL - What DeviceIoControl returned, GetLastError is preserved.
+ */
+static BOOL MeteredIoctl(
+    HANDLE hDevice,
+    DWORD ioctl,
+    void *input,
+    DWORD input_len,
+    void *output,
+    DWORD output_len,
+    DWORD *returned
+)
+{
+    LARGE_INTEGER frequency, before, after;
+    BOOL wait = ioctl == (DWORD)IOCTL_GET_NOTIFICATION || ioctl == (DWORD)IOCTL_SAMPLER_SUBSCRIBE;
+
+    QueryPerformanceCounter(&before);
+    BOOL ok = DeviceIoControl(hDevice, ioctl, input, input_len, output, output_len, returned, NULL);
+    QueryPerformanceCounter(&after);
+    DWORD error = GetLastError();
+
+    QueryPerformanceFrequency(&frequency);
+    MetricsCount(wait ? ECLIB_COUNTER_WAITS : ECLIB_COUNTER_CALLS, 1);
+    MetricsCount(ECLIB_COUNTER_BYTES_IN, input_len);
+    if (ok) {
+        MetricsCount(ECLIB_COUNTER_BYTES_OUT, *returned);
+    } else {
+        MetricsCount(ECLIB_COUNTER_ERRORS, 1);
+    }
+    MetricsRecord(wait ? ECLIB_HISTOGRAM_WAIT_US : ECLIB_HISTOGRAM_CALL_US,
+                  (UINT64)(after.QuadPart - before.QuadPart) * 1000000 / frequency.QuadPart);
+
+    SetLastError(error);
+    return ok;
+}
+
 /*
  * Function: GetGUIDPath
  * ---------------------
@@ -208,14 +465,13 @@ int EvaluateAcpi(
         NULL);
 
     if (hDevice != INVALID_HANDLE_VALUE) {
-        if( DeviceIoControl(hDevice,
+        if( MeteredIoctl(hDevice,
             (DWORD)IOCTL_ACPI_EVAL_METHOD_EX,
             acpi_input,
             (DWORD)input_len,
             buffer,
             (DWORD)*buf_len,
-            &bytesReturned,
-            NULL) == TRUE ) 
+            &bytesReturned) == TRUE ) 
         {
             *buf_len = bytesReturned;
             return ERROR_SUCCESS;
@@ -292,6 +548,34 @@ VOID CleanupNotification()
     g_notify.initialized = FALSE;
 }
 
+/*
+ * Function: BatteryUpdate
+ * -----------------------
+ * Replaces the battery status kept for EcBatteryGetStatus if the EC wrote the
+ * new one later, so a fetch racing a notification cannot bring back an older
+ * status.
+ *
+ * Parameters:
+ *   const BatteryStatus_t* status - Status from a notification or IOCTL_GET_BATTERY.
+ *   BOOL pushed                   - It came with a notification.
+ */
+static void BatteryUpdate(const BatteryStatus_t *status, BOOL pushed)
+{
+    if (status->sequence == 0) {
+        return;
+    }
+
+    AcquireSRWLockExclusive(&g_battery.lock);
+    if (!g_battery.valid || (INT32)(status->sequence - g_battery.status.sequence) > 0) {
+        g_battery.status = *status;
+        g_battery.valid = TRUE;
+    }
+    if (pushed) {
+        g_battery.pushes++;
+    }
+    ReleaseSRWLockExclusive(&g_battery.lock);
+}
+
 /*
  * Function: WaitForNotification
  * -----------------------------
@@ -328,17 +612,19 @@ UINT32 WaitForNotification(UINT32 event)
 
             ULONG bytesReturned;
             notify_request.type = 0x1;
-            if(DeviceIoControl ( g_notify.handle,
+            if(MeteredIoctl ( g_notify.handle,
                                 (DWORD) IOCTL_GET_NOTIFICATION,
                                 &notify_request,
                                 sizeof(notify_request),
                                 &notify_response,
                                 sizeof( notify_response),
-                                &bytesReturned,
-                                NULL
+                                &bytesReturned
                                 ) == TRUE )
             {
                 g_notify.event = notify_response.lastevent;               
+                if (notify_response.lastevent == EC_NOTIFY_BATTERY) {
+                    BatteryUpdate(&notify_response.battery, TRUE);
+                }
             } else {
                 g_notify.event = 0;
             }
@@ -360,4 +646,2625 @@ UINT32 WaitForNotification(UINT32 event)
 
     // Return no event
     return ievent;
-}
\ No newline at end of file
+}
+
+struct _ECLIB_REQUEST {
+    HANDLE handle;
+    UINT32 offsets[ECLIB_MAX_ARGUMENTS];    // Offset of each argument in input
+    union {
+        ACPI_EVAL_INPUT_BUFFER_COMPLEX_V1_EX input;
+        BYTE raw[ECLIB_MAX_REQUEST_SIZE];
+    };
+};
+
+/*
+ * Function: EcRequestCreate
+ * -------------------------
+ * Creates a reusable request for an ACPI method and opens the driver handle it
+ * is sent on. Arguments are appended with the EcRequestAdd* functions.
+ *
+ * Parameters:
+ *   const char* method        - Full path of the ACPI method, e.g. \_SB.ECT0.RTMP.
+ *   ECLIB_REQUEST** request   - Receives the request, free with EcRequestDestroy.
+ *
+ * Returns:
+ *   int - ERROR_SUCCESS on success, or an error code on failure.
+ */
+ECLIB_API
+int EcRequestCreate(
+    _In_z_ const char *method,
+    _Out_ ECLIB_REQUEST **request
+)
+{
+    if (method == NULL || request == NULL) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    *request = NULL;
+    ECLIB_REQUEST *req = (ECLIB_REQUEST *)calloc(1, sizeof(ECLIB_REQUEST));
+    if (req == NULL) {
+        return ERROR_OUTOFMEMORY;
+    }
+
+    req->input.Signature = ACPI_EVAL_INPUT_BUFFER_COMPLEX_SIGNATURE_EX;
+    if (FAILED(StringCchCopyA(req->input.MethodName, sizeof(req->input.MethodName), method))) {
+        free(req);
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    int status = GetKMDFDriverHandle(0, &req->handle);
+    if (status != ERROR_SUCCESS) {
+        free(req);
+        return status;
+    }
+
+    *request = req;
+    return ERROR_SUCCESS;
+}
+
+/*
+ * Function: AddArgument
+ * ---------------------
+ * Appends an argument to the request input buffer.
+ *
+ * Returns:
+ *   int - ERROR_SUCCESS on success, ERROR_INSUFFICIENT_BUFFER if the request is full.
+ */
+static int AddArgument(
+    _Inout_ ECLIB_REQUEST *request,
+    _In_ USHORT type,
+    _In_reads_bytes_(length) const void *data,
+    _In_ USHORT length
+)
+{
+    ULONG offset = FIELD_OFFSET(ACPI_EVAL_INPUT_BUFFER_COMPLEX_V1_EX, Argument) + request->input.Size;
+    ULONG size = ACPI_METHOD_ARGUMENT_LENGTH(length);
+
+    if (request->input.ArgumentCount >= ECLIB_MAX_ARGUMENTS || offset + size > sizeof(request->raw)) {
+        return ERROR_INSUFFICIENT_BUFFER;
+    }
+
+    ACPI_METHOD_ARGUMENT_V1 *arg = (ACPI_METHOD_ARGUMENT_V1 *)(request->raw + offset);
+    arg->Type = type;
+    arg->DataLength = length;
+    memcpy(arg->Data, data, length);
+
+    request->offsets[request->input.ArgumentCount++] = offset;
+    request->input.Size += size;
+    return ERROR_SUCCESS;
+}
+
+/*
+ * Function: EcRequestAddInteger
+ * -----------------------------
+ * Appends a 32-bit integer argument to the request.
+ *
+ * Parameters:
+ *   ECLIB_REQUEST* request  - Request returned by EcRequestCreate.
+ *   UINT32 value            - Integer value.
+ *
+ * Returns:
+ *   int - ERROR_SUCCESS on success, or an error code on failure.
+ */
+ECLIB_API
+int EcRequestAddInteger(
+    _Inout_ ECLIB_REQUEST *request,
+    _In_ UINT32 value
+)
+{
+    if (request == NULL) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    return AddArgument(request, ACPI_METHOD_ARGUMENT_INTEGER, &value, sizeof(value));
+}
+
+/*
+ * Function: EcRequestAddString
+ * ----------------------------
+ * Appends a null terminated string argument to the request.
+ *
+ * Parameters:
+ *   ECLIB_REQUEST* request  - Request returned by EcRequestCreate.
+ *   const char* value       - String value.
+ *
+ * Returns:
+ *   int - ERROR_SUCCESS on success, or an error code on failure.
+ */
+ECLIB_API
+int EcRequestAddString(
+    _Inout_ ECLIB_REQUEST *request,
+    _In_z_ const char *value
+)
+{
+    if (request == NULL || value == NULL) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    size_t length = strlen(value) + 1;
+    if (length > ECLIB_MAX_REQUEST_SIZE) {
+        return ERROR_INSUFFICIENT_BUFFER;
+    }
+
+    return AddArgument(request, ACPI_METHOD_ARGUMENT_STRING, value, (USHORT)length);
+}
+
+/*
+ * Function: EcRequestAddBuffer
+ * ----------------------------
+ * Appends a buffer argument, such as a GUID, to the request.
+ *
+ * Parameters:
+ *   ECLIB_REQUEST* request  - Request returned by EcRequestCreate.
+ *   const BYTE* data        - Buffer contents.
+ *   UINT16 length           - Buffer length in bytes.
+ *
+ * Returns:
+ *   int - ERROR_SUCCESS on success, or an error code on failure.
+ */
+ECLIB_API
+int EcRequestAddBuffer(
+    _Inout_ ECLIB_REQUEST *request,
+    _In_reads_bytes_(length) const BYTE *data,
+    _In_ UINT16 length
+)
+{
+    if (request == NULL || (data == NULL && length > 0)) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    return AddArgument(request, ACPI_METHOD_ARGUMENT_BUFFER, data, length);
+}
+
+/*
+ * Function: EcRequestSetInteger
+ * -----------------------------
+ * Replaces the value of an integer argument in place so the request can be
+ * reused with a different value.
+ *
+ * Parameters:
+ *   ECLIB_REQUEST* request  - Request returned by EcRequestCreate.
+ *   UINT32 index            - Zero based argument index.
+ *   UINT32 value            - New integer value.
+ *
+ * Returns:
+ *   int - ERROR_SUCCESS on success, ERROR_INVALID_PARAMETER if the argument does
+ *         not exist or is not an integer.
+ */
+ECLIB_API
+int EcRequestSetInteger(
+    _Inout_ ECLIB_REQUEST *request,
+    _In_ UINT32 index,
+    _In_ UINT32 value
+)
+{
+    if (request == NULL || index >= request->input.ArgumentCount) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    ACPI_METHOD_ARGUMENT_V1 *arg = (ACPI_METHOD_ARGUMENT_V1 *)(request->raw + request->offsets[index]);
+    if (arg->Type != ACPI_METHOD_ARGUMENT_INTEGER) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    arg->Argument = value;
+    return ERROR_SUCCESS;
+}
+
+/*
+ * Function: AddViews
+ * ------------------
+ * Walks a run of ACPI_METHOD_ARGUMENT entries in the arena and appends a view for
+ * each one, recursing into packages so their elements directly follow them. Views
+ * past the capacity are counted but not written.
+ *
+ * Parameters:
+ *   BYTE* arena          - Output arena filled by the driver.
+ *   ULONG offset         - Offset of the first argument.
+ *   ULONG end            - Offset just past the last byte of this run.
+ *   ULONG count          - Number of arguments, or MAXULONG to walk until end.
+ *   ULONG depth          - Current package nesting depth.
+ *   ECLIB_VIEW* views    - Output views, may be NULL.
+ *   UINT32 capacity      - Number of entries in views.
+ *   UINT32* used         - Number of views produced so far.
+ *
+ * Returns:
+ *   int - ERROR_SUCCESS on success, ERROR_INVALID_DATA if the output is malformed.
+ */
+static int AddViews(
+    _In_ const BYTE *arena,
+    _In_ ULONG offset,
+    _In_ ULONG end,
+    _In_ ULONG count,
+    _In_ ULONG depth,
+    _Out_writes_opt_(capacity) ECLIB_VIEW *views,
+    _In_ UINT32 capacity,
+    _Inout_ UINT32 *used
+)
+{
+    if (depth > ECLIB_MAX_PACKAGE_DEPTH) {
+        return ERROR_INVALID_DATA;
+    }
+
+    for (ULONG i = 0; i < count && offset < end; i++) {
+        const ACPI_METHOD_ARGUMENT_V1 *arg = (const ACPI_METHOD_ARGUMENT_V1 *)(arena + offset);
+        ULONG data = offset + FIELD_OFFSET(ACPI_METHOD_ARGUMENT_V1, Data);
+
+        if (data > end || arg->DataLength > end - data) {
+            return ERROR_INVALID_DATA;
+        }
+
+        UINT32 index = (*used)++;
+        if (arg->Type == ACPI_METHOD_ARGUMENT_PACKAGE || arg->Type == ACPI_METHOD_ARGUMENT_PACKAGE_EX) {
+            int status = AddViews(arena, data, data + arg->DataLength, MAXULONG, depth + 1, views, capacity, used);
+            if (status != ERROR_SUCCESS) {
+                return status;
+            }
+        }
+
+        if (views != NULL && index < capacity) {
+            views[index].type = arg->Type;
+            views[index].reserved = 0;
+            views[index].offset = data;
+            views[index].length = arg->DataLength;
+            views[index].next = *used;
+        }
+
+        offset += ACPI_METHOD_ARGUMENT_LENGTH(arg->DataLength);
+    }
+
+    return ERROR_SUCCESS;
+}
+
+/*
+ * Function: EcRequestEvaluate
+ * ---------------------------
+ * Evaluates a prebuilt request. The driver writes the ACPI_EVAL_OUTPUT_BUFFER_V1
+ * directly into the arena and the results are described by views into it, in
+ * order, with package elements following their package.
+ *
+ * Parameters:
+ *   ECLIB_REQUEST* request  - Request returned by EcRequestCreate.
+ *   BYTE* arena             - Caller owned output arena.
+ *   size_t arena_len        - Size of the arena in bytes.
+ *   ECLIB_VIEW* views       - Caller owned view array.
+ *   UINT32 view_capacity    - Number of entries in views.
+ *   UINT32* view_count      - Receives the number of views, or the number needed
+ *                             if ERROR_INSUFFICIENT_BUFFER is returned.
+ *
+ * Returns:
+ *   int - ERROR_SUCCESS on success, ERROR_INSUFFICIENT_BUFFER if the arena or
+ *         views are too small, or another error code on failure.
+ */
+ECLIB_API
+int EcRequestEvaluate(
+    _Inout_ ECLIB_REQUEST *request,
+    _Out_writes_bytes_(arena_len) BYTE *arena,
+    _In_ size_t arena_len,
+    _Out_writes_opt_(view_capacity) ECLIB_VIEW *views,
+    _In_ UINT32 view_capacity,
+    _Out_ UINT32 *view_count
+)
+{
+    ULONG bytesReturned;
+
+    if (request == NULL || arena == NULL || view_count == NULL || arena_len > MAXULONG) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    *view_count = 0;
+    if (MeteredIoctl(request->handle,
+                        (DWORD)IOCTL_ACPI_EVAL_METHOD_EX,
+                        request->raw,
+                        FIELD_OFFSET(ACPI_EVAL_INPUT_BUFFER_COMPLEX_V1_EX, Argument) + request->input.Size,
+                        arena,
+                        (DWORD)arena_len,
+                        &bytesReturned) == FALSE)
+    {
+        DWORD error = GetLastError();
+        return (error == ERROR_MORE_DATA || error == ERROR_BUFFER_OVERFLOW) ? ERROR_INSUFFICIENT_BUFFER : (int)error;
+    }
+
+    const ACPI_EVAL_OUTPUT_BUFFER_V1 *output = (const ACPI_EVAL_OUTPUT_BUFFER_V1 *)arena;
+    if (bytesReturned < FIELD_OFFSET(ACPI_EVAL_OUTPUT_BUFFER_V1, Argument) ||
+        output->Signature != ACPI_EVAL_OUTPUT_BUFFER_SIGNATURE_V1 || output->Length > bytesReturned) {
+        return ERROR_INVALID_DATA;
+    }
+
+    int status = AddViews(arena, FIELD_OFFSET(ACPI_EVAL_OUTPUT_BUFFER_V1, Argument), output->Length,
+                          output->Count, 0, views, view_capacity, view_count);
+    if (status == ERROR_SUCCESS && *view_count > view_capacity) {
+        status = ERROR_INSUFFICIENT_BUFFER;
+    }
+
+    return status;
+}
+
+/*
+ * Function: EcRequestDestroy
+ * --------------------------
+ * Closes the driver handle of a request and frees it.
+ *
+ * Parameters:
+ *   ECLIB_REQUEST* request  - Request returned by EcRequestCreate, may be NULL.
+ *
+ * Returns:
+ *   VOID
+ */
+ECLIB_API
+VOID EcRequestDestroy(
+    _In_opt_ ECLIB_REQUEST *request
+)
+{
+    if (request == NULL) {
+        return;
+    }
+
+    CloseHandle(request->handle);
+    free(request);
+}
+
+/*
+ * Function: LoopbackControl
+ * -------------------------
+ * Sends a loopback control IOCTL to the driver and returns its status.
+ *
+ * Returns:
+ *   int - ERROR_SUCCESS on success, or an error code on failure.
+ */
+static int LoopbackControl(
+    _In_ DWORD ioctl,
+    _In_reads_bytes_(input_len) void *input,
+    _In_ DWORD input_len,
+    _Out_ LoopbackRsp_t *rsp
+)
+{
+    HANDLE hDevice;
+    DWORD bytesReturned = 0;
+    int status = GetKMDFDriverHandle(0, &hDevice);
+
+    if (status != ERROR_SUCCESS) {
+        return status;
+    }
+
+    if (!MeteredIoctl(hDevice, ioctl, input, input_len, rsp, sizeof(*rsp), &bytesReturned)) {
+        status = GetLastError();
+    } else if (bytesReturned < sizeof(*rsp)) {
+        status = ERROR_NOT_SUPPORTED;
+    }
+
+    CloseHandle(hDevice);
+    return status;
+}
+
+/*
+ * Function: EcLoopbackSet
+ * -----------------------
+ * Enables or disables loopback mode and sets its synthetic delay.
+ *
+ * Parameters:
+ *   UINT32 flags                    - ECLIB_LOOPBACK_* flags.
+ *   UINT32 delay_us                 - Delay added to every loopback evaluation in microseconds.
+ *   ECLIB_LOOPBACK_STATUS* status   - Receives the loopback state after the change, may be NULL.
+ *
+ * Returns:
+ *   int - ERROR_SUCCESS on success, or an error code on failure.
+ */
+ECLIB_API
+int EcLoopbackSet(
+    _In_ UINT32 flags,
+    _In_ UINT32 delay_us,
+    _Out_opt_ ECLIB_LOOPBACK_STATUS *status
+)
+{
+    LoopbackReq_t req;
+    LoopbackRsp_t rsp;
+
+    req.flags = 0;
+    if (flags & ECLIB_LOOPBACK_ENABLE) {
+        req.flags |= LOOPBACK_ENABLE;
+    }
+    if (flags & ECLIB_LOOPBACK_CLEAR) {
+        req.flags |= LOOPBACK_CLEAR;
+    }
+    req.delay = delay_us;
+
+    int result = LoopbackControl((DWORD)IOCTL_SET_LOOPBACK, &req, sizeof(req), &rsp);
+    if (result == ERROR_SUCCESS && status != NULL) {
+        status->enabled = rsp.enabled;
+        status->delay_us = rsp.delay;
+        status->entries = rsp.entries;
+        status->hits = rsp.hits;
+        status->misses = rsp.misses;
+    }
+
+    return result;
+}
+
+/*
+ * Function: EcLoopbackAddResponse
+ * -------------------------------
+ * Registers the response returned for a method while loopback is enabled,
+ * replacing any earlier response for the same method.
+ *
+ * Parameters:
+ *   const char* method     - Full path of the ACPI method, as passed to EcRequestCreate.
+ *   const void* response   - Complete ACPI_EVAL_OUTPUT_BUFFER_V1 to return.
+ *   size_t length          - Length of the response, its Length field must match.
+ *
+ * Returns:
+ *   int - ERROR_SUCCESS on success, or an error code on failure.
+ */
+ECLIB_API
+int EcLoopbackAddResponse(
+    _In_z_ const char *method,
+    _In_reads_bytes_(length) const void *response,
+    _In_ size_t length
+)
+{
+    LoopbackResponseReq_t *req;
+    LoopbackRsp_t rsp;
+
+    if (method == NULL || response == NULL || length > LOOPBACK_MAX_RESPONSE) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    req = (LoopbackResponseReq_t *)calloc(1, sizeof(LoopbackResponseReq_t));
+    if (req == NULL) {
+        return ERROR_OUTOFMEMORY;
+    }
+
+    int status = ERROR_INVALID_PARAMETER;
+    if (SUCCEEDED(StringCchCopyA(req->method, sizeof(req->method), method))) {
+        req->length = (UINT32)length;
+        memcpy(req->response, response, length);
+        status = LoopbackControl((DWORD)IOCTL_ADD_LOOPBACK_RESPONSE, req, sizeof(*req), &rsp);
+    }
+
+    free(req);
+    return status;
+}
+
+/*
+ * Function: EcMessageSend
+ * -----------------------
+ * Sends one indirect message to an EC service and waits for its response.
+ *
+ * Parameters:
+ *   const GUID* service    - UUID of the EC service.
+ *   UINT8 command          - Service command.
+ *   const void* input      - Request payload, may be NULL if input_len is zero.
+ *   size_t input_len       - Length of the request payload, at most ECLIB_MESSAGE_MAX_PAYLOAD.
+ *   void* output           - Buffer receiving the response payload.
+ *   size_t output_len      - Length of the output buffer.
+ *   size_t* returned       - Receives the length of the response payload, or the length
+ *                            needed when ERROR_INSUFFICIENT_BUFFER is returned.
+ *   UINT32* ec_status      - Receives the status reported by the service, may be NULL.
+ *
+ * Returns:
+ *   int - ERROR_SUCCESS on success, or an error code on failure.
+ */
+ECLIB_API
+int EcMessageSend(
+    _In_ const GUID *service,
+    _In_ UINT8 command,
+    _In_reads_bytes_opt_(input_len) const void *input,
+    _In_ size_t input_len,
+    _Out_writes_bytes_opt_(output_len) void *output,
+    _In_ size_t output_len,
+    _Out_ size_t *returned,
+    _Out_opt_ UINT32 *ec_status
+)
+{
+    MsgSend2Req_t *req;
+    MsgSend2Rsp_t *rsp;
+    HANDLE hDevice;
+    DWORD bytesReturned = 0;
+    size_t output_max = min(output_len, (size_t)EC_MSG_MAX_PAYLOAD);
+
+    if (service == NULL || returned == NULL || input_len > EC_MSG_MAX_PAYLOAD ||
+        (input == NULL && input_len != 0) || (output == NULL && output_len != 0)) {
+        return ERROR_INVALID_PARAMETER;
+    }
+    *returned = 0;
+
+    req = (MsgSend2Req_t *)calloc(1, sizeof(MsgSend2Req_t) + input_len);
+    rsp = (MsgSend2Rsp_t *)malloc(sizeof(MsgSend2Rsp_t) + output_max);
+    if (req == NULL || rsp == NULL) {
+        free(req);
+        free(rsp);
+        return ERROR_OUTOFMEMORY;
+    }
+
+    memcpy(req->service, service, sizeof(req->service));
+    req->command = command;
+    req->length = (UINT32)input_len;
+    if (input_len) {
+        memcpy(req + 1, input, input_len);
+    }
+
+    int status = GetKMDFDriverHandle(0, &hDevice);
+    if (status == ERROR_SUCCESS) {
+        if (!MeteredIoctl(hDevice, (DWORD)IOCTL_FFA_MSG_SEND2,
+                          req, (DWORD)(sizeof(MsgSend2Req_t) + input_len),
+                          rsp, (DWORD)(sizeof(MsgSend2Rsp_t) + output_max),
+                          &bytesReturned)) {
+            status = GetLastError();
+            if (status == ERROR_MORE_DATA && bytesReturned >= sizeof(MsgSend2Rsp_t)) {
+                // Only the header came back, report the length the caller needs
+                *returned = rsp->length;
+                status = ERROR_INSUFFICIENT_BUFFER;
+            }
+        } else if (bytesReturned < sizeof(MsgSend2Rsp_t) || rsp->length > bytesReturned - sizeof(MsgSend2Rsp_t)) {
+            status = ERROR_NOT_SUPPORTED;
+        } else {
+            if (rsp->length) {
+                memcpy(output, rsp + 1, rsp->length);
+            }
+            *returned = rsp->length;
+        }
+        CloseHandle(hDevice);
+    }
+
+    if (ec_status != NULL) {
+        *ec_status = (status == ERROR_SUCCESS) ? rsp->status : 0;
+    }
+    free(req);
+    free(rsp);
+    return status;
+}
+
+/*
+ * Function: MemShareControl
+ * -------------------------
+ * Sends IOCTL_FFA_MEM_SHARE or IOCTL_FFA_MEM_RECLAIM to the driver.
+ *
+ * Returns:
+ *   int - ERROR_SUCCESS on success, or an error code on failure.
+ */
+static int MemShareControl(DWORD ioctl, void *input, DWORD input_len, MemShareRsp_t *rsp)
+{
+    HANDLE hDevice;
+    DWORD bytesReturned = 0;
+
+    int status = GetKMDFDriverHandle(0, &hDevice);
+    if (status != ERROR_SUCCESS) {
+        return status;
+    }
+
+    if (!MeteredIoctl(hDevice, ioctl, input, input_len, rsp, sizeof(*rsp), &bytesReturned)) {
+        status = GetLastError();
+    } else if (bytesReturned != sizeof(*rsp)) {
+        status = ERROR_NOT_SUPPORTED;
+    }
+    CloseHandle(hDevice);
+    return status;
+}
+
+/*
+ * Function: EcMemShare
+ * --------------------
+ * Allocates a region in the driver and shares it with the EC.
+ *
+ * Parameters:
+ *   UINT32 pages           - Size of the region in 4K pages, at most ECLIB_SHARE_MAX_PAGES.
+ *   ECLIB_SHARE* share     - Receives the handle and location of the region.
+ *   UINT32* ec_status      - Receives the status the EC mapped the region with, may be NULL.
+ *
+ * Returns:
+ *   int - ERROR_SUCCESS on success, ERROR_REQUEST_REFUSED if the EC declined the
+ *         region, or an error code on failure.
+ */
+ECLIB_API
+int EcMemShare(
+    _In_ UINT32 pages,
+    _Out_ ECLIB_SHARE *share,
+    _Out_opt_ UINT32 *ec_status
+)
+{
+    MemShareReq_t req;
+    MemShareRsp_t rsp;
+
+    if (share == NULL || pages == 0 || pages > EC_SHARE_MAX_PAGES) {
+        return ERROR_INVALID_PARAMETER;
+    }
+    memset(share, 0, sizeof(*share));
+    memset(&rsp, 0, sizeof(rsp));
+
+    req.pages = pages;
+    req.reserved = 0;
+    int status = MemShareControl((DWORD)IOCTL_FFA_MEM_SHARE, &req, sizeof(req), &rsp);
+    if (status == ERROR_SUCCESS && rsp.status != EC_MSG_STATUS_SUCCESS) {
+        status = ERROR_REQUEST_REFUSED;
+    } else if (status == ERROR_SUCCESS) {
+        share->handle = rsp.handle;
+        share->address = rsp.address;
+        share->pages = rsp.pages;
+    }
+
+    if (ec_status != NULL) {
+        *ec_status = rsp.status;
+    }
+    return status;
+}
+
+/*
+ * Function: EcMemReclaim
+ * ----------------------
+ * Has the EC unmap a region from EcMemShare, reclaims it and frees it.
+ *
+ * Parameters:
+ *   UINT64 handle          - Handle returned by EcMemShare.
+ *
+ * Returns:
+ *   int - ERROR_SUCCESS on success, or an error code on failure.
+ */
+ECLIB_API
+int EcMemReclaim(
+    _In_ UINT64 handle
+)
+{
+    MemReclaimReq_t req;
+    MemShareRsp_t rsp;
+
+    req.handle = handle;
+    return MemShareControl((DWORD)IOCTL_FFA_MEM_RECLAIM, &req, sizeof(req), &rsp);
+}
+
+// EC thermal service {31f56da7-593c-4d72-a4b3-8fc7171ac073}
+static const GUID EcThermalService = { 0x31f56da7, 0x593c, 0x4d72, { 0xa4, 0xb3, 0x8f, 0xc7, 0x17, 0x1a, 0xc0, 0x73 } };
+
+// Variables written by EC_MSG_CMD_SET_FAN_PROFILE, in MsgFanProfileReq_t order
+static const GUID EcFanProfileVars[EC_FAN_PROFILE_VARS] = {
+    { 0xba17b567, 0xc368, 0x48d5, { 0xbc, 0x6f, 0xa3, 0x12, 0xa4, 0x15, 0x83, 0xc1 } },    // FAN_ON_TEMP
+    { 0x3a62688c, 0xd95b, 0x4d2d, { 0xba, 0xcc, 0x90, 0xd7, 0xa5, 0x81, 0x6b, 0xcd } },    // FAN_RAMP_TEMP
+    { 0xdcb758b1, 0xf0fd, 0x4ec7, { 0xb2, 0xc0, 0xef, 0x1e, 0x2a, 0x54, 0x7b, 0x76 } },    // FAN_MAX_TEMP
+    { 0xdb261c77, 0x934b, 0x45e2, { 0x97, 0x42, 0x25, 0x6c, 0x62, 0xba, 0xdb, 0x7a } },    // FAN_MIN_RPM
+    { 0x5cf839df, 0x8be7, 0x42b9, { 0x9a, 0xc5, 0x34, 0x03, 0xca, 0x2c, 0x8a, 0x6a } },    // FAN_MAX_RPM
+};
+
+typedef struct {
+    GUID variable;
+    UINT16 instance;
+    UINT16 length;
+    UINT64 generation;      // 0 while the entry is unused
+    BYTE value[EC_VAR_MAX_LENGTH];
+} VarCacheEntry;
+
+struct _ECLIB_VAR_CACHE {
+    SRWLOCK lock;
+    UINT32 capacity;
+    UINT32 next;            // Entry replaced when the cache is full
+    ECLIB_VAR_CACHE_STATS stats;
+    VarCacheEntry entries[1];
+};
+
+/*
+ * Function: EcVarCacheCreate
+ * --------------------------
+ * Creates a cache for thermal service variables.
+ *
+ * Parameters:
+ *   UINT32 capacity            - Number of variables kept.
+ *   ECLIB_VAR_CACHE** cache    - Receives the cache, free with EcVarCacheDestroy.
+ *
+ * Returns:
+ *   int - ERROR_SUCCESS on success, or an error code on failure.
+ */
+ECLIB_API
+int EcVarCacheCreate(
+    _In_ UINT32 capacity,
+    _Out_ ECLIB_VAR_CACHE **cache
+)
+{
+    if (cache == NULL || capacity == 0 || capacity > 0x10000) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    *cache = (ECLIB_VAR_CACHE *)calloc(1, sizeof(ECLIB_VAR_CACHE) + (capacity - 1) * sizeof(VarCacheEntry));
+    if (*cache == NULL) {
+        return ERROR_OUTOFMEMORY;
+    }
+    InitializeSRWLock(&(*cache)->lock);
+    (*cache)->capacity = capacity;
+    return ERROR_SUCCESS;
+}
+
+/*
+ * Function: FindVarEntry
+ * ----------------------
+ * Looks up a variable in the cache. Called with the cache lock held.
+ *
+ * Returns:
+ *   VarCacheEntry* - The entry, or NULL if the variable is not cached.
+ */
+static VarCacheEntry *FindVarEntry(
+    _In_ ECLIB_VAR_CACHE *cache,
+    _In_ const GUID *variable,
+    _In_ UINT16 instance
+)
+{
+    for (UINT32 i = 0; i < cache->capacity; i++) {
+        VarCacheEntry *entry = &cache->entries[i];
+        if (entry->generation != 0 && entry->instance == instance && IsEqualGUID(&entry->variable, variable)) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Function: StoreVarEntry
+ * -----------------------
+ * Records a value unless the cache already holds a newer one. Called with the
+ * cache lock held exclusively.
+ */
+static void StoreVarEntry(
+    _Inout_ ECLIB_VAR_CACHE *cache,
+    _In_ const GUID *variable,
+    _In_ UINT16 instance,
+    _In_ UINT64 generation,
+    _In_reads_bytes_(length) const void *value,
+    _In_ UINT16 length
+)
+{
+    VarCacheEntry *entry = FindVarEntry(cache, variable, instance);
+
+    if (entry == NULL) {
+        entry = &cache->entries[cache->next];
+        cache->next = (cache->next + 1) % cache->capacity;
+    } else if (entry->generation >= generation) {
+        return;
+    }
+
+    entry->variable = *variable;
+    entry->instance = instance;
+    entry->length = length;
+    entry->generation = generation;
+    memcpy(entry->value, value, length);
+}
+
+/*
+ * Function: EcVarRead
+ * -------------------
+ * Reads a thermal service variable, revalidating the cached value if there is one.
+ *
+ * Parameters:
+ *   ECLIB_VAR_CACHE* cache     - The cache.
+ *   const GUID* variable       - UUID of the variable.
+ *   UINT16 instance            - Instance of the variable.
+ *   void* value                - Buffer receiving the value.
+ *   size_t value_len           - Length of the buffer.
+ *   size_t* returned           - Receives the length of the value.
+ *   BOOL* changed              - Set if the EC returned a value the cache did not hold, may be NULL.
+ *
+ * Returns:
+ *   int - ERROR_SUCCESS on success, ERROR_INSUFFICIENT_BUFFER if the value does not
+ *         fit, or an error code on failure.
+ */
+ECLIB_API
+int EcVarRead(
+    _Inout_ ECLIB_VAR_CACHE *cache,
+    _In_ const GUID *variable,
+    _In_ UINT16 instance,
+    _Out_writes_bytes_(value_len) void *value,
+    _In_ size_t value_len,
+    _Out_ size_t *returned,
+    _Out_opt_ BOOL *changed
+)
+{
+    BYTE output[sizeof(MsgVarRsp_t) + EC_VAR_MAX_LENGTH];
+    MsgVarRsp_t rsp;
+    MsgVarReq_t req;
+    VarCacheEntry *entry;
+    VarCacheEntry cached;
+    size_t length = 0;
+    UINT32 ec_status = 0;
+
+    if (cache == NULL || variable == NULL || value == NULL || returned == NULL) {
+        return ERROR_INVALID_PARAMETER;
+    }
+    *returned = 0;
+    if (changed != NULL) {
+        *changed = FALSE;
+    }
+
+    memset(&req, 0, sizeof(req));
+    memset(&cached, 0, sizeof(cached));
+    AcquireSRWLockShared(&cache->lock);
+    entry = FindVarEntry(cache, variable, instance);
+    if (entry != NULL) {
+        cached = *entry;
+    }
+    ReleaseSRWLockShared(&cache->lock);
+
+    memcpy(req.variable, variable, sizeof(req.variable));
+    req.instance = instance;
+    req.length = EC_VAR_MAX_LENGTH;
+    req.generation = cached.generation;
+    int status = EcMessageSend(&EcThermalService, EC_MSG_CMD_GET_VAR, &req, sizeof(req),
+                               output, sizeof(output), &length, &ec_status);
+    if (status != ERROR_SUCCESS) {
+        return status;
+    }
+
+    if (ec_status == EC_MSG_STATUS_NOT_MODIFIED && cached.generation != 0) {
+        AcquireSRWLockExclusive(&cache->lock);
+        cache->stats.reads++;
+        cache->stats.not_modified++;
+        ReleaseSRWLockExclusive(&cache->lock);
+        MetricsCount(ECLIB_COUNTER_CACHE_HITS, 1);
+    } else if (ec_status == EC_MSG_STATUS_SUCCESS && length >= sizeof(rsp)) {
+        memcpy(&rsp, output, sizeof(rsp));
+        if (rsp.length > length - sizeof(rsp) || rsp.generation == 0) {
+            return ERROR_INVALID_DATA;
+        }
+        cached.length = rsp.length;
+        cached.generation = rsp.generation;
+        memcpy(cached.value, output + sizeof(rsp), rsp.length);
+
+        AcquireSRWLockExclusive(&cache->lock);
+        cache->stats.reads++;
+        cache->stats.refreshed++;
+        StoreVarEntry(cache, variable, instance, rsp.generation, cached.value, cached.length);
+        ReleaseSRWLockExclusive(&cache->lock);
+        MetricsCount(ECLIB_COUNTER_CACHE_MISSES, 1);
+        if (changed != NULL) {
+            *changed = TRUE;
+        }
+    } else {
+        return ERROR_INVALID_DATA;
+    }
+
+    *returned = cached.length;
+    if (cached.length > value_len) {
+        return ERROR_INSUFFICIENT_BUFFER;
+    }
+    memcpy(value, cached.value, cached.length);
+    return ERROR_SUCCESS;
+}
+
+/*
+ * Function: EcVarWrite
+ * --------------------
+ * Writes a thermal service variable and caches the value written.
+ *
+ * Parameters:
+ *   ECLIB_VAR_CACHE* cache     - The cache.
+ *   const GUID* variable       - UUID of the variable.
+ *   UINT16 instance            - Instance of the variable.
+ *   const void* value          - The value.
+ *   size_t value_len           - Length of the value, at most ECLIB_VAR_MAX_LENGTH.
+ *
+ * Returns:
+ *   int - ERROR_SUCCESS on success, or an error code on failure.
+ */
+ECLIB_API
+int EcVarWrite(
+    _Inout_ ECLIB_VAR_CACHE *cache,
+    _In_ const GUID *variable,
+    _In_ UINT16 instance,
+    _In_reads_bytes_(value_len) const void *value,
+    _In_ size_t value_len
+)
+{
+    BYTE input[sizeof(MsgVarReq_t) + EC_VAR_MAX_LENGTH];
+    MsgVarReq_t *req = (MsgVarReq_t *)input;
+    MsgVarRsp_t rsp;
+    size_t length = 0;
+    UINT32 ec_status = 0;
+
+    if (cache == NULL || variable == NULL || value == NULL || value_len == 0 || value_len > EC_VAR_MAX_LENGTH) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    memset(req, 0, sizeof(*req));
+    memcpy(req->variable, variable, sizeof(req->variable));
+    req->instance = instance;
+    req->length = (UINT16)value_len;
+    memcpy(req + 1, value, value_len);
+    int status = EcMessageSend(&EcThermalService, EC_MSG_CMD_SET_VAR, input, sizeof(*req) + value_len,
+                               &rsp, sizeof(rsp), &length, &ec_status);
+    if (status != ERROR_SUCCESS) {
+        return status;
+    }
+    if (ec_status != EC_MSG_STATUS_SUCCESS || length != sizeof(rsp)) {
+        return ERROR_INVALID_DATA;
+    }
+
+    AcquireSRWLockExclusive(&cache->lock);
+    StoreVarEntry(cache, variable, instance, rsp.generation, value, (UINT16)value_len);
+    ReleaseSRWLockExclusive(&cache->lock);
+    return ERROR_SUCCESS;
+}
+
+/*
+ * Function: EcFanProfileApply
+ * ---------------------------
+ * Writes a fan curve in one transaction and leaves the fan to the EC. The EC
+ * writes all five variables or none of them.
+ *
+ * Parameters:
+ *   ECLIB_VAR_CACHE* cache         - Receives the values written, may be NULL.
+ *   UINT16 instance                - Instance of the variables.
+ *   const ECLIB_FAN_PROFILE* profile - The curve.
+ *
+ * Returns:
+ *   int - ERROR_SUCCESS on success, ERROR_INVALID_PARAMETER if the curve does not
+ *         rise, or an error code on failure.
+ */
+ECLIB_API
+int EcFanProfileApply(
+    _Inout_opt_ ECLIB_VAR_CACHE *cache,
+    _In_ UINT16 instance,
+    _In_ const ECLIB_FAN_PROFILE *profile
+)
+{
+    MsgFanProfileReq_t req;
+    MsgFanProfileRsp_t rsp;
+    size_t length = 0;
+    UINT32 ec_status = 0;
+
+    // The EC checks the same, this saves the round trip
+    if (profile == NULL || profile->on_temp >= profile->ramp_temp || profile->ramp_temp >= profile->max_temp ||
+        profile->min_rpm == 0 || profile->min_rpm > profile->max_rpm) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    memset(&req, 0, sizeof(req));
+    req.instance = instance;
+    req.on_temp = profile->on_temp;
+    req.ramp_temp = profile->ramp_temp;
+    req.max_temp = profile->max_temp;
+    req.min_rpm = profile->min_rpm;
+    req.max_rpm = profile->max_rpm;
+    int status = EcMessageSend(&EcThermalService, EC_MSG_CMD_SET_FAN_PROFILE, &req, sizeof(req),
+                               &rsp, sizeof(rsp), &length, &ec_status);
+    if (status != ERROR_SUCCESS) {
+        return status;
+    }
+    if (ec_status != EC_MSG_STATUS_SUCCESS || length != sizeof(rsp)) {
+        return ERROR_INVALID_DATA;
+    }
+
+    if (cache != NULL) {
+        const UINT32 *values = &req.on_temp;
+
+        AcquireSRWLockExclusive(&cache->lock);
+        for (UINT32 i = 0; i < EC_FAN_PROFILE_VARS; i++) {
+            StoreVarEntry(cache, &EcFanProfileVars[i], instance, rsp.generation[i], &values[i], sizeof(values[i]));
+        }
+        ReleaseSRWLockExclusive(&cache->lock);
+    }
+    return ERROR_SUCCESS;
+}
+
+/*
+ * Function: EcVarCacheGetStats
+ * ----------------------------
+ * Returns how many reads the cache revalidated without a payload.
+ *
+ * Parameters:
+ *   ECLIB_VAR_CACHE* cache         - The cache.
+ *   ECLIB_VAR_CACHE_STATS* stats   - Receives the counters.
+ */
+ECLIB_API
+VOID EcVarCacheGetStats(
+    _In_ ECLIB_VAR_CACHE *cache,
+    _Out_ ECLIB_VAR_CACHE_STATS *stats
+)
+{
+    AcquireSRWLockShared(&cache->lock);
+    *stats = cache->stats;
+    ReleaseSRWLockShared(&cache->lock);
+}
+
+/*
+ * Function: EcVarCacheDestroy
+ * ---------------------------
+ * Frees a cache created by EcVarCacheCreate.
+ *
+ * Parameters:
+ *   ECLIB_VAR_CACHE* cache     - The cache, may be NULL.
+ */
+ECLIB_API
+VOID EcVarCacheDestroy(
+    _In_opt_ ECLIB_VAR_CACHE *cache
+)
+{
+    free(cache);
+}
+
+C_ASSERT(ECLIB_HISTORY_MAX_SAMPLES == EC_HISTORY_MAX_SAMPLES);
+
+/*
+ * Function: EcHistoryConfigure
+ * ----------------------------
+ * Starts or stops sampling a sensor into the EC history.
+ *
+ * Parameters:
+ *   UINT8 sensor           - Temp sensor ID.
+ *   UINT32 period_us       - Sampling period in microseconds, 0 to stop.
+ *
+ * Returns:
+ *   int - ERROR_SUCCESS on success, or an error code on failure.
+ */
+ECLIB_API
+int EcHistoryConfigure(
+    _In_ UINT8 sensor,
+    _In_ UINT32 period_us
+)
+{
+    MsgHistoryConfigReq_t req;
+    size_t returned = 0;
+    UINT32 ec_status = 0;
+
+    memset(&req, 0, sizeof(req));
+    req.sensor = sensor;
+    req.period_us = period_us;
+    int status = EcMessageSend(&EcThermalService, EC_MSG_CMD_HISTORY_CONFIG, &req, sizeof(req),
+                               NULL, 0, &returned, &ec_status);
+    if (status == ERROR_SUCCESS && ec_status != EC_MSG_STATUS_SUCCESS) {
+        status = ERROR_INVALID_PARAMETER;
+    }
+    return status;
+}
+
+/*
+ * Function: EcHistoryRead
+ * -----------------------
+ * Fetches the samples of a sensor recorded since a sequence number.
+ *
+ * Parameters:
+ *   UINT8 sensor               - Temp sensor ID.
+ *   UINT64 sequence            - First sample wanted, info.next of the previous read or 0.
+ *   UINT32* samples            - Receives the samples in tenths of a Kelvin.
+ *   UINT32 capacity            - Number of samples the buffer holds.
+ *   ECLIB_HISTORY_INFO* info   - Receives where the samples start and how many were returned.
+ *
+ * Returns:
+ *   int - ERROR_SUCCESS on success, or an error code on failure.
+ */
+ECLIB_API
+int EcHistoryRead(
+    _In_ UINT8 sensor,
+    _In_ UINT64 sequence,
+    _Out_writes_(capacity) UINT32 *samples,
+    _In_ UINT32 capacity,
+    _Out_ ECLIB_HISTORY_INFO *info
+)
+{
+    MsgHistoryReadReq_t req;
+    MsgHistoryReadRsp_t rsp;
+    size_t returned = 0;
+    UINT32 ec_status = 0;
+
+    if (samples == NULL || capacity == 0 || info == NULL) {
+        return ERROR_INVALID_PARAMETER;
+    }
+    memset(info, 0, sizeof(*info));
+    capacity = min(capacity, (UINT32)EC_HISTORY_MAX_SAMPLES);
+
+    BYTE *output = (BYTE *)malloc(sizeof(rsp) + capacity * sizeof(UINT32));
+    if (output == NULL) {
+        return ERROR_OUTOFMEMORY;
+    }
+
+    memset(&req, 0, sizeof(req));
+    req.sensor = sensor;
+    req.max_samples = capacity;
+    req.sequence = sequence;
+    int status = EcMessageSend(&EcThermalService, EC_MSG_CMD_HISTORY_READ, &req, sizeof(req),
+                               output, sizeof(rsp) + capacity * sizeof(UINT32), &returned, &ec_status);
+    if (status == ERROR_SUCCESS && (ec_status != EC_MSG_STATUS_SUCCESS || returned < sizeof(rsp))) {
+        status = ERROR_INVALID_DATA;
+    }
+    if (status == ERROR_SUCCESS) {
+        memcpy(&rsp, output, sizeof(rsp));
+        if (rsp.count > capacity || returned != sizeof(rsp) + rsp.count * sizeof(UINT32)) {
+            status = ERROR_INVALID_DATA;
+        } else {
+            memcpy(samples, output + sizeof(rsp), rsp.count * sizeof(UINT32));
+            info->sequence = rsp.sequence;
+            info->next = rsp.next;
+            info->timestamp_us = rsp.timestamp;
+            info->dropped = rsp.dropped;
+            info->period_us = rsp.period_us;
+            info->count = rsp.count;
+        }
+    }
+
+    free(output);
+    return status;
+}
+
+/*
+ * Function: SamplerControl
+ * ------------------------
+ * Sends IOCTL_SAMPLER_REGISTER or IOCTL_SAMPLER_SUBSCRIBE to the driver and
+ * waits for it to complete.
+ *
+ * Returns:
+ *   int - ERROR_SUCCESS on success, or an error code on failure.
+ */
+static int SamplerControl(DWORD ioctl, void *input, DWORD input_len, void *output, DWORD output_len)
+{
+    HANDLE hDevice;
+    DWORD bytesReturned = 0;
+
+    int status = GetKMDFDriverHandle(0, &hDevice);
+    if (status != ERROR_SUCCESS) {
+        return status;
+    }
+
+    if (!MeteredIoctl(hDevice, ioctl, input, input_len, output, output_len, &bytesReturned)) {
+        status = GetLastError();
+    } else if (bytesReturned != output_len) {
+        status = ERROR_NOT_SUPPORTED;
+    }
+    CloseHandle(hDevice);
+    return status;
+}
+
+/*
+ * Function: SamplerRegister
+ * -------------------------
+ * Registers, changes the period of or, with a period of 0, unregisters a method.
+ *
+ * Returns:
+ *   int - ERROR_SUCCESS on success, or an error code on failure.
+ */
+static int SamplerRegister(const char *method, UINT32 period_ms, UINT32 *sampler)
+{
+    SamplerRegisterReq_t req;
+    SamplerRegisterRsp_t rsp;
+
+    if (method == NULL) {
+        return ERROR_INVALID_PARAMETER;
+    }
+    memset(&req, 0, sizeof(req));
+    if (FAILED(StringCchCopyA(req.method, sizeof(req.method), method))) {
+        return ERROR_INVALID_PARAMETER;
+    }
+    req.period_ms = period_ms;
+
+    int status = SamplerControl((DWORD)IOCTL_SAMPLER_REGISTER, &req, sizeof(req), &rsp, sizeof(rsp));
+    if (status == ERROR_SUCCESS && sampler != NULL) {
+        *sampler = rsp.sampler;
+    }
+    return status;
+}
+
+/*
+ * Function: SamplerSubscribe
+ * --------------------------
+ * Sends one IOCTL_SAMPLER_SUBSCRIBE and returns the sample it completes with.
+ *
+ * Returns:
+ *   int - ERROR_SUCCESS on success, or an error code on failure.
+ */
+static int SamplerSubscribe(UINT32 sampler, UINT32 flags, UINT64 value, UINT64 deadband, HANDLE event, ECLIB_SAMPLE *sample)
+{
+    SamplerSubscribeReq_t req;
+    SamplerSubscribeRsp_t rsp;
+
+    if (sample == NULL) {
+        return ERROR_INVALID_PARAMETER;
+    }
+    memset(sample, 0, sizeof(*sample));
+    req.sampler = sampler;
+    req.flags = flags;
+    req.value = value;
+    req.deadband = deadband;
+    req.event = (UINT64)(ULONG_PTR)event;
+
+    int status = SamplerControl((DWORD)IOCTL_SAMPLER_SUBSCRIBE, &req, sizeof(req), &rsp, sizeof(rsp));
+    if (status == ERROR_SUCCESS) {
+        sample->value = rsp.value;
+        sample->timestamp = rsp.timestamp;
+        sample->samples = rsp.samples;
+        sample->sampler = rsp.sampler;
+        sample->status = rsp.status;
+    }
+    return status;
+}
+
+/*
+ * Function: EcSamplerRegister
+ * ---------------------------
+ * Has the driver evaluate an integer method every period_ms, or changes the
+ * period of a method already registered.
+ *
+ * Parameters:
+ *   const char* method     - Full path of a method returning one integer.
+ *   UINT32 period_ms       - Sampling period in milliseconds.
+ *   UINT32* sampler        - Receives the sampler to subscribe to, may be NULL.
+ *
+ * Returns:
+ *   int - ERROR_SUCCESS on success, or an error code on failure.
+ */
+ECLIB_API
+int EcSamplerRegister(
+    _In_z_ const char *method,
+    _In_ UINT32 period_ms,
+    _Out_opt_ UINT32 *sampler
+)
+{
+    if (period_ms == 0) {
+        return ERROR_INVALID_PARAMETER;
+    }
+    return SamplerRegister(method, period_ms, sampler);
+}
+
+/*
+ * Function: EcSamplerUnregister
+ * -----------------------------
+ * Stops sampling a method. Waits still pending fail with ERROR_FILE_NOT_FOUND.
+ *
+ * Parameters:
+ *   const char* method     - The method passed to EcSamplerRegister.
+ *
+ * Returns:
+ *   int - ERROR_SUCCESS on success, or an error code on failure.
+ */
+ECLIB_API
+int EcSamplerUnregister(
+    _In_z_ const char *method
+)
+{
+    return SamplerRegister(method, 0, NULL);
+}
+
+/*
+ * Function: EcSamplerRead
+ * -----------------------
+ * Returns the latest sample, waiting for the first one after registration.
+ *
+ * Parameters:
+ *   UINT32 sampler         - Sampler returned by EcSamplerRegister.
+ *   ECLIB_SAMPLE* sample   - Receives the sample.
+ *
+ * Returns:
+ *   int - ERROR_SUCCESS on success, or an error code on failure.
+ */
+ECLIB_API
+int EcSamplerRead(
+    _In_ UINT32 sampler,
+    _Out_ ECLIB_SAMPLE *sample
+)
+{
+    return SamplerSubscribe(sampler, SAMPLER_SUBSCRIBE_CURRENT, 0, 0, NULL, sample);
+}
+
+/*
+ * Function: EcSamplerWait
+ * -----------------------
+ * Blocks until a sample is more than deadband away from value. Returns at once
+ * if the latest sample already is.
+ *
+ * Parameters:
+ *   UINT32 sampler         - Sampler returned by EcSamplerRegister.
+ *   UINT64 value           - Value the caller last saw, usually sample->value of the previous call.
+ *   UINT64 deadband        - Largest change to ignore.
+ *   ECLIB_SAMPLE* sample   - Receives the sample that moved.
+ *
+ * Returns:
+ *   int - ERROR_SUCCESS on success, or an error code on failure.
+ */
+ECLIB_API
+int EcSamplerWait(
+    _In_ UINT32 sampler,
+    _In_ UINT64 value,
+    _In_ UINT64 deadband,
+    _Out_ ECLIB_SAMPLE *sample
+)
+{
+    return SamplerSubscribe(sampler, 0, value, deadband, NULL, sample);
+}
+
+/*
+ * Function: EcSamplerSubscribeEvent
+ * ---------------------------------
+ * Has the driver signal an event whenever a sample moves more than deadband
+ * away from the one returned. Call again after each signal to read the sample
+ * and move the baseline to it. The driver holds a reference to the event until
+ * EcSamplerUnsubscribeEvent or until the method is unregistered.
+ *
+ * Parameters:
+ *   UINT32 sampler         - Sampler returned by EcSamplerRegister.
+ *   HANDLE event           - Event to signal, auto-reset events suit best.
+ *   UINT64 deadband        - Largest change to ignore.
+ *   ECLIB_SAMPLE* sample   - Receives the latest sample.
+ *
+ * Returns:
+ *   int - ERROR_SUCCESS on success, or an error code on failure.
+ */
+ECLIB_API
+int EcSamplerSubscribeEvent(
+    _In_ UINT32 sampler,
+    _In_ HANDLE event,
+    _In_ UINT64 deadband,
+    _Out_ ECLIB_SAMPLE *sample
+)
+{
+    return SamplerSubscribe(sampler, SAMPLER_SUBSCRIBE_EVENT, 0, deadband, event, sample);
+}
+
+/*
+ * Function: EcSamplerUnsubscribeEvent
+ * -----------------------------------
+ * Stops signalling an event subscribed with EcSamplerSubscribeEvent.
+ *
+ * Parameters:
+ *   UINT32 sampler         - Sampler returned by EcSamplerRegister.
+ *   HANDLE event           - The subscribed event.
+ *
+ * Returns:
+ *   int - ERROR_SUCCESS on success, or an error code on failure.
+ */
+ECLIB_API
+int EcSamplerUnsubscribeEvent(
+    _In_ UINT32 sampler,
+    _In_ HANDLE event
+)
+{
+    ECLIB_SAMPLE sample;
+
+    return SamplerSubscribe(sampler, SAMPLER_SUBSCRIBE_REMOVE, 0, 0, event, &sample);
+}
+
+C_ASSERT(ECLIB_NOTIFY_CLASSES == NOTIFY_MAX_CLASSES);
+
+/*
+ * Function: NotifyClassesControl
+ * ------------------------------
+ * Sends IOCTL_NOTIFY_CLASSES to the driver.
+ *
+ * Returns:
+ *   int - ERROR_SUCCESS on success, or an error code on failure.
+ */
+static int NotifyClassesControl(NotifyClassesReq_t *req, NotifyClassesRsp_t *rsp)
+{
+    HANDLE hDevice;
+    DWORD bytesReturned = 0;
+
+    int status = GetKMDFDriverHandle(0, &hDevice);
+    if (status != ERROR_SUCCESS) {
+        return status;
+    }
+
+    if (!MeteredIoctl(hDevice, (DWORD)IOCTL_NOTIFY_CLASSES, req, sizeof(*req), rsp, sizeof(*rsp), &bytesReturned)) {
+        status = GetLastError();
+    } else if (bytesReturned != sizeof(*rsp)) {
+        status = ERROR_NOT_SUPPORTED;
+    }
+    CloseHandle(hDevice);
+    return status;
+}
+
+/*
+ * Function: EcNotifySetClass
+ * --------------------------
+ * Moves a notify value to a priority class. The table is read and written back
+ * with two requests, so callers changing it concurrently must serialize.
+ *
+ * Parameters:
+ *   UINT8 value            - The notify value.
+ *   UINT8 priority         - Class below ECLIB_NOTIFY_CLASSES, 0 for routine.
+ *
+ * Returns:
+ *   int - ERROR_SUCCESS on success, or an error code on failure.
+ */
+ECLIB_API
+int EcNotifySetClass(
+    _In_ UINT8 value,
+    _In_ UINT8 priority
+)
+{
+    NotifyClassesReq_t req;
+    NotifyClassesRsp_t rsp;
+
+    if (priority >= ECLIB_NOTIFY_CLASSES) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    memset(&req, 0, sizeof(req));
+    int status = NotifyClassesControl(&req, &rsp);
+    if (status == ERROR_SUCCESS) {
+        req.flags = NOTIFY_CLASSES_SET;
+        memcpy(req.classes, rsp.classes, sizeof(req.classes));
+        req.classes[value] = priority;
+        status = NotifyClassesControl(&req, &rsp);
+    }
+    return status;
+}
+
+/*
+ * Function: EcNotifyGetStats
+ * --------------------------
+ * Returns the delivery statistics of every priority class.
+ *
+ * Parameters:
+ *   ECLIB_NOTIFY_STATS* stats - Receives ECLIB_NOTIFY_CLASSES entries, routine first.
+ *   BOOL reset             - Clear the statistics once read.
+ *
+ * Returns:
+ *   int - ERROR_SUCCESS on success, or an error code on failure.
+ */
+ECLIB_API
+int EcNotifyGetStats(
+    _Out_writes_(ECLIB_NOTIFY_CLASSES) ECLIB_NOTIFY_STATS *stats,
+    _In_ BOOL reset
+)
+{
+    NotifyClassesReq_t req;
+    NotifyClassesRsp_t rsp;
+
+    if (stats == NULL) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    memset(&req, 0, sizeof(req));
+    req.flags = reset ? NOTIFY_CLASSES_RESET : 0;
+    int status = NotifyClassesControl(&req, &rsp);
+    if (status != ERROR_SUCCESS) {
+        return status;
+    }
+
+    for (UINT32 i = 0; i < ECLIB_NOTIFY_CLASSES; i++) {
+        stats[i].received = rsp.stats[i].received;
+        stats[i].delivered = rsp.stats[i].delivered;
+        stats[i].coalesced = rsp.stats[i].coalesced;
+        stats[i].dropped = rsp.stats[i].dropped;
+        stats[i].latency_avg_us = rsp.stats[i].delivered ? rsp.stats[i].latency_total / rsp.stats[i].delivered : 0;
+        stats[i].latency_max_us = rsp.stats[i].latency_max;
+        stats[i].queued = rsp.stats[i].queued;
+        stats[i].peak = rsp.stats[i].peak;
+    }
+    return ERROR_SUCCESS;
+}
+
+C_ASSERT(ECLIB_NOTIFY_BATTERY == EC_NOTIFY_BATTERY);
+C_ASSERT(ECLIB_BATTERY_CHANGED_STATE == EC_BATTERY_CHANGED_STATE);
+C_ASSERT(ECLIB_BATTERY_CHANGED_RATE == EC_BATTERY_CHANGED_RATE);
+C_ASSERT(ECLIB_BATTERY_CHANGED_CAPACITY == EC_BATTERY_CHANGED_CAPACITY);
+C_ASSERT(ECLIB_BATTERY_CHANGED_VOLTAGE == EC_BATTERY_CHANGED_VOLTAGE);
+
+/*
+ * Function: BatteryReadShared
+ * ---------------------------
+ * Reads the battery slot from the event page if the process mapped the shared
+ * window. The EC makes the sequence odd while it writes, so the slot is read
+ * again until it is even and did not move across the copy.
+ *
+ * Parameters:
+ *   BatteryStatus_t* status - Receives the slot.
+ *
+ * Returns:
+ *   BOOL - TRUE if a status the EC finished writing was read.
+ */
+static BOOL BatteryReadShared(BatteryStatus_t *status)
+{
+    const volatile BatteryStatus_t *slot;
+
+    AcquireSRWLockShared(&g_shared.lock);
+    slot = g_shared.mapped ? (const volatile BatteryStatus_t *)g_shared.views.events : NULL;
+    ReleaseSRWLockShared(&g_shared.lock);
+    if (slot == NULL) {
+        return FALSE;
+    }
+
+    for (UINT32 i = 0; i < BATTERY_READ_RETRIES; i++) {
+        UINT32 sequence = slot->sequence;
+
+        MemoryBarrier();
+        status->changed = slot->changed;
+        status->state = slot->state;
+        status->rate = slot->rate;
+        status->capacity = slot->capacity;
+        status->voltage = slot->voltage;
+        status->timestamp = slot->timestamp;
+        MemoryBarrier();
+        if ((sequence & 1) == 0 && slot->sequence == sequence) {
+            status->sequence = sequence;
+            return sequence != 0;
+        }
+    }
+    return FALSE;
+}
+
+/*
+ * Function: EcBatteryGetStatus
+ * ----------------------------
+ * Returns the newest battery status the EC pushed. Only the first call, or one
+ * made before the EC reported anything, reads the slot, from the event page if
+ * the shared window is mapped and otherwise with a request to the driver.
+ *
+ * Parameters:
+ *   ECLIB_BATTERY_STATUS* status - Receives the status.
+ *
+ * Returns:
+ *   int - ERROR_SUCCESS on success, ERROR_NOT_READY if the EC has not reported
+ *         a status yet, or an error code on failure.
+ */
+ECLIB_API
+int EcBatteryGetStatus(
+    _Out_ ECLIB_BATTERY_STATUS *status
+)
+{
+    BatteryStatus_t rsp = { 0 };
+    UINT32 input = 0;
+    HANDLE hDevice;
+    DWORD bytesReturned = 0;
+    int result = ERROR_SUCCESS;
+
+    if (status == NULL) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    AcquireSRWLockShared(&g_battery.lock);
+    BOOL valid = g_battery.valid;
+    ReleaseSRWLockShared(&g_battery.lock);
+
+    if (valid) {
+        MetricsCount(ECLIB_COUNTER_CACHE_HITS, 1);
+    } else if (BatteryReadShared(&rsp)) {
+        MetricsCount(ECLIB_COUNTER_CACHE_HITS, 1);
+        BatteryUpdate(&rsp, FALSE);
+    } else {
+        MetricsCount(ECLIB_COUNTER_CACHE_MISSES, 1);
+        result = GetKMDFDriverHandle(0, &hDevice);
+        if (result != ERROR_SUCCESS) {
+            return result;
+        }
+        if (!MeteredIoctl(hDevice, (DWORD)IOCTL_GET_BATTERY, &input, sizeof(input), &rsp, sizeof(rsp), &bytesReturned)) {
+            result = GetLastError();
+        } else if (bytesReturned != sizeof(rsp)) {
+            result = ERROR_NOT_SUPPORTED;
+        } else if (rsp.sequence == 0) {
+            result = ERROR_NOT_READY;
+        }
+        CloseHandle(hDevice);
+        if (result != ERROR_SUCCESS) {
+            return result;
+        }
+        BatteryUpdate(&rsp, FALSE);
+    }
+
+    AcquireSRWLockShared(&g_battery.lock);
+    status->state = g_battery.status.state;
+    status->rate_mw = g_battery.status.rate;
+    status->capacity_mwh = g_battery.status.capacity;
+    status->voltage_mv = g_battery.status.voltage;
+    status->changed = g_battery.status.changed;
+    status->sequence = g_battery.status.sequence;
+    status->timestamp_us = g_battery.status.timestamp;
+    status->pushes = g_battery.pushes;
+    ReleaseSRWLockShared(&g_battery.lock);
+    return ERROR_SUCCESS;
+}
+
+struct _ECLIB_NOTIFY_CHANNEL {
+    HANDLE handle;              // Opened for overlapped I/O
+    HANDLE event;               // Set when the request completes, NULL on a port
+    OVERLAPPED overlapped;
+    BOOL pending;               // The request has been sent and not collected
+    BOOL ready;                 // response holds a notification not returned yet
+    NotificationReq_t request;
+    NotificationRsp_t response;
+};
+
+/*
+ * Function: ChannelIssue
+ * ----------------------
+ * Sends the channel's notification request. A notification already queued in
+ * the driver completes it at once, otherwise it stays pending.
+ *
+ * Parameters:
+ *   ECLIB_NOTIFY_CHANNEL* channel - The channel, with no request pending.
+ *
+ * Returns:
+ *   int - ERROR_SUCCESS on success, or an error code on failure.
+ */
+static int ChannelIssue(ECLIB_NOTIFY_CHANNEL *channel)
+{
+    DWORD bytesReturned = 0;
+
+    // The system clears the event when the request is sent
+    memset(&channel->overlapped, 0, sizeof(channel->overlapped));
+    channel->overlapped.hEvent = channel->event;
+    channel->request.type = 0x1;
+    MetricsCount(ECLIB_COUNTER_WAITS, 1);
+    MetricsCount(ECLIB_COUNTER_BYTES_IN, sizeof(channel->request));
+    if (DeviceIoControl(channel->handle, (DWORD)IOCTL_GET_NOTIFICATION, &channel->request, sizeof(channel->request),
+                        &channel->response, sizeof(channel->response), &bytesReturned, &channel->overlapped)) {
+        MetricsCount(ECLIB_COUNTER_BYTES_OUT, bytesReturned);
+        channel->ready = TRUE;
+        return ERROR_SUCCESS;
+    }
+
+    int status = GetLastError();
+    if (status == ERROR_IO_PENDING) {
+        channel->pending = TRUE;
+        return ERROR_SUCCESS;
+    }
+    MetricsCount(ECLIB_COUNTER_ERRORS, 1);
+    return status;
+}
+
+/*
+ * Function: EcNotifyOpen
+ * ----------------------
+ * Opens a notification channel and pends its first request.
+ *
+ * Parameters:
+ *   HANDLE port                     - Completion port to queue packets on, NULL to signal an event.
+ *   ULONG_PTR key                   - Completion key of the packets, ignored without a port.
+ *   ECLIB_NOTIFY_CHANNEL** channel  - Receives the channel, close with EcNotifyClose.
+ *
+ * Returns:
+ *   int - ERROR_SUCCESS on success, or an error code on failure.
+ */
+ECLIB_API
+int EcNotifyOpen(
+    _In_opt_ HANDLE port,
+    _In_ ULONG_PTR key,
+    _Out_ ECLIB_NOTIFY_CHANNEL **channel
+)
+{
+    if (channel == NULL) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    *channel = NULL;
+    ECLIB_NOTIFY_CHANNEL *ch = (ECLIB_NOTIFY_CHANNEL *)calloc(1, sizeof(ECLIB_NOTIFY_CHANNEL));
+    if (ch == NULL) {
+        return ERROR_OUTOFMEMORY;
+    }
+
+    int status = GetKMDFDriverHandle(FILE_FLAG_OVERLAPPED, &ch->handle);
+    if (status != ERROR_SUCCESS) {
+        free(ch);
+        return status;
+    }
+
+    if (port != NULL) {
+        // Requests completed at once are drained on the spot and need no packet
+        if (CreateIoCompletionPort(ch->handle, port, key, 0) == NULL ||
+            !SetFileCompletionNotificationModes(ch->handle, FILE_SKIP_COMPLETION_PORT_ON_SUCCESS)) {
+            status = GetLastError();
+        }
+    } else {
+        ch->event = CreateEvent(NULL, TRUE, FALSE, NULL);
+        if (ch->event == NULL) {
+            status = GetLastError();
+        }
+    }
+    if (status == ERROR_SUCCESS) {
+        status = ChannelIssue(ch);
+    }
+    if (status != ERROR_SUCCESS) {
+        EcNotifyClose(ch);
+        return status;
+    }
+
+    *channel = ch;
+    return ERROR_SUCCESS;
+}
+
+/*
+ * Function: EcNotifyGetEvent
+ * --------------------------
+ * Returns the event signalled when the channel has notifications to drain.
+ *
+ * Parameters:
+ *   ECLIB_NOTIFY_CHANNEL* channel - The channel.
+ *
+ * Returns:
+ *   HANDLE - Manual reset event owned by the channel, NULL on a completion port.
+ */
+ECLIB_API
+HANDLE EcNotifyGetEvent(
+    _In_ ECLIB_NOTIFY_CHANNEL *channel
+)
+{
+    return channel->event;
+}
+
+/*
+ * Function: EcNotifyDrain
+ * -----------------------
+ * Collects the notifications that have arrived without blocking and leaves a
+ * request pending for the next one.
+ *
+ * Parameters:
+ *   ECLIB_NOTIFY_CHANNEL* channel      - The channel.
+ *   ECLIB_NOTIFICATION* notifications  - Receives the notifications, oldest of the highest class first.
+ *   UINT32 max                         - Entries in notifications.
+ *   UINT32* count                      - Receives the number returned, possibly 0.
+ *
+ * Returns:
+ *   int - ERROR_SUCCESS once nothing more is queued, ERROR_MORE_DATA if
+ *         notifications filled up first, or an error code on failure.
+ */
+ECLIB_API
+int EcNotifyDrain(
+    _In_ ECLIB_NOTIFY_CHANNEL *channel,
+    _Out_writes_to_(max, *count) ECLIB_NOTIFICATION *notifications,
+    _In_ UINT32 max,
+    _Out_ UINT32 *count
+)
+{
+    DWORD bytesReturned = 0;
+
+    if (count == NULL || (notifications == NULL && max != 0)) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    *count = 0;
+    for (;;) {
+        if (channel->pending) {
+            if (!GetOverlappedResult(channel->handle, &channel->overlapped, &bytesReturned, FALSE)) {
+                int status = GetLastError();
+                if (status == ERROR_IO_INCOMPLETE) {
+                    return ERROR_SUCCESS;
+                }
+                channel->pending = FALSE;
+                MetricsCount(ECLIB_COUNTER_ERRORS, 1);
+                return status;
+            }
+            MetricsCount(ECLIB_COUNTER_BYTES_OUT, bytesReturned);
+            channel->pending = FALSE;
+            channel->ready = TRUE;
+        }
+
+        if (channel->ready) {
+            if (*count == max) {
+                return ERROR_MORE_DATA;
+            }
+
+            const NotificationRsp_t *rsp = &channel->response;
+            ECLIB_NOTIFICATION *notification = &notifications[(*count)++];
+            notification->event = rsp->lastevent;
+            notification->priority = rsp->priority;
+            notification->coalesced = rsp->coalesced;
+            notification->sequence = rsp->count;
+            notification->timestamp = rsp->timestamp;
+            if (rsp->lastevent == EC_NOTIFY_BATTERY) {
+                BatteryUpdate(&rsp->battery, TRUE);
+            }
+            channel->ready = FALSE;
+        }
+
+        int status = ChannelIssue(channel);
+        if (status != ERROR_SUCCESS) {
+            return status;
+        }
+    }
+}
+
+/*
+ * Function: EcNotifyClose
+ * -----------------------
+ * Cancels the channel's pending request, waits for it to finish and frees the
+ * channel.
+ *
+ * Parameters:
+ *   ECLIB_NOTIFY_CHANNEL* channel - Channel returned by EcNotifyOpen, may be NULL.
+ *
+ * Returns:
+ *   VOID
+ */
+ECLIB_API
+VOID EcNotifyClose(
+    _In_opt_ ECLIB_NOTIFY_CHANNEL *channel
+)
+{
+    DWORD bytesReturned = 0;
+
+    if (channel == NULL) {
+        return;
+    }
+
+    if (channel->pending) {
+        CancelIoEx(channel->handle, &channel->overlapped);
+        GetOverlappedResult(channel->handle, &channel->overlapped, &bytesReturned, TRUE);
+    }
+    if (channel->handle != NULL && channel->handle != INVALID_HANDLE_VALUE) {
+        CloseHandle(channel->handle);
+    }
+    if (channel->event != NULL) {
+        CloseHandle(channel->event);
+    }
+    free(channel);
+}
+
+/*
+ * Function: EcSharedMap
+ * ---------------------
+ * Maps the shared memory window into the process with IOCTL_MAP_RX on the
+ * first call, the RX window and event page read-only, and returns the views.
+ * The handle the views belong to is kept open for the life of the process.
+ *
+ * Parameters:
+ *   ECLIB_SHARED_VIEWS* views - Receives the views.
+ *
+ * Returns:
+ *   int - ERROR_SUCCESS on success, or an error code on failure.
+ */
+ECLIB_API
+int EcSharedMap(
+    _Out_ ECLIB_SHARED_VIEWS *views
+)
+{
+    MapRxRsp_t rsp = { 0 };
+    UINT32 input = 0;
+    HANDLE hDevice;
+    DWORD bytesReturned = 0;
+    int result = ERROR_SUCCESS;
+
+    if (views == NULL) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    // Held across the request, so racing first calls map the window once
+    AcquireSRWLockExclusive(&g_shared.lock);
+    if (!g_shared.mapped) {
+        result = GetKMDFDriverHandle(0, &hDevice);
+        if (result == ERROR_SUCCESS) {
+            if (!MeteredIoctl(hDevice, (DWORD)IOCTL_MAP_RX, &input, sizeof(input), &rsp, sizeof(rsp), &bytesReturned)) {
+                result = GetLastError();
+            } else if (bytesReturned != sizeof(rsp) || rsp.txLength < ECRING_WINDOW_SIZE ||
+                       rsp.rxLength < EC_BATTERY_STATUS_BASE - EC_SHARED_RX_BASE + sizeof(BatteryStatus_t)) {
+                result = ERROR_NOT_SUPPORTED;
+            }
+            if (result != ERROR_SUCCESS) {
+                CloseHandle(hDevice);
+            }
+        }
+        if (result == ERROR_SUCCESS) {
+            g_shared.handle = hDevice;
+            g_shared.views.tx = (void *)(ULONG_PTR)rsp.tx;
+            g_shared.views.rx = (const void *)(ULONG_PTR)rsp.rx;
+            g_shared.views.events = (const BYTE *)g_shared.views.rx + (EC_BATTERY_STATUS_BASE - EC_SHARED_RX_BASE);
+            g_shared.mapped = TRUE;
+        }
+    }
+    if (result == ERROR_SUCCESS) {
+        *views = g_shared.views;
+    }
+    ReleaseSRWLockExclusive(&g_shared.lock);
+    return result;
+}
+
+/*
+ * Function: EcSharedDoorbell
+ * --------------------------
+ * Rings the EC for a ring on the shared views by evaluating TXDB with the
+ * sequence and count of the doorbell. Matches ECRING_DOORBELL_CALLBACK.
+ *
+ * Parameters:
+ *   void* context    - Request for \_SB.ECT0.TXDB with two integer arguments.
+ *   UINT64 argument  - The doorbell, as built by ECRING_DOORBELL.
+ *
+ * Returns:
+ *   int - 0 if the EC accepted the doorbell, otherwise an error code.
+ */
+ECLIB_API
+int EcSharedDoorbell(
+    _In_ void *context,
+    _In_ UINT64 argument
+)
+{
+    ECLIB_REQUEST *request = (ECLIB_REQUEST *)context;
+    BYTE arena[64];
+    ECLIB_VIEW view;
+    UINT32 count = 0;
+    UINT64 status = 0;
+    int result;
+
+    result = EcRequestSetInteger(request, 0, ECRING_DOORBELL_SEQUENCE(argument));
+    if (result == ERROR_SUCCESS) {
+        result = EcRequestSetInteger(request, 1, ECRING_DOORBELL_COUNT(argument));
+    }
+    if (result == ERROR_SUCCESS) {
+        result = EcRequestEvaluate(request, arena, sizeof(arena), &view, 1, &count);
+    }
+    if (result != ERROR_SUCCESS) {
+        return result;
+    }
+
+    // TXDB returns the STAT byte of the direct request
+    if (count != 1 || view.type != ACPI_METHOD_ARGUMENT_INTEGER || view.length > sizeof(status)) {
+        return ERROR_INVALID_DATA;
+    }
+    memcpy(&status, arena + view.offset, view.length);
+    return status == 0 ? ERROR_SUCCESS : ERROR_IO_DEVICE;
+}
+
+C_ASSERT(ECLIB_STATIC_MAX_SERVICES == EC_STATIC_MAX_SERVICES);
+C_ASSERT(ECLIB_STATIC_MAX_DSM == EC_STATIC_MAX_DSM);
+C_ASSERT(sizeof(GUID) == sizeof(((EC_STATIC_SERVICE *)0)->Uuid));
+
+#define STATIC_CACHE_SIGNATURE  0x43534345      // 'ECSC'
+#define STATIC_CACHE_DIRECTORY  "\\ECTest"
+#define STATIC_CACHE_NAME       "\\static.cache"
+#define STATIC_FW_STATE_METHOD  "\\_SB.ECT0.TFWS"
+
+// Contents of the cache file, the snapshot as the driver returned it
+typedef struct {
+    UINT32 signature;
+    UINT32 driver_version;
+    UINT32 fw_state;            // TFWS at boot, the cache only holds while TFWS still returns it
+    EC_STATIC snapshot;
+} StaticCacheFile;
+
+typedef struct {
+    SRWLOCK lock;
+    BOOL loaded;
+    BOOL path_set;              // path was defaulted or chosen with EcStaticSetCacheFile
+    char path[MAX_PATH];        // Empty for no cache file
+    ECLIB_STATIC facts;
+    StaticCacheFile file;       // What the facts were converted from
+    HANDLE refreshed;           // Manual reset, set while no refresh is pending
+    int refresh_status;
+} StaticState;
+
+static StaticState g_static = { SRWLOCK_INIT };
+
+/*
+ * Function: StaticCachePath
+ * -------------------------
+ * Returns the cache file path, defaulting it on first use. Called with the
+ * lock held exclusively.
+ *
+ * Returns:
+ *   const char* - The path, NULL if no cache file is used.
+ */
+static const char *StaticCachePath(void)
+{
+    if (!g_static.path_set) {
+        char base[MAX_PATH];
+        DWORD length = GetEnvironmentVariableA("LOCALAPPDATA", base, sizeof(base));
+
+        g_static.path_set = TRUE;
+        if (length == 0 || length >= sizeof(base) ||
+            FAILED(StringCchPrintfA(g_static.path, sizeof(g_static.path), "%s" STATIC_CACHE_DIRECTORY STATIC_CACHE_NAME, base))) {
+            g_static.path[0] = '\0';
+        }
+    }
+    return g_static.path[0] != '\0' ? g_static.path : NULL;
+}
+
+/*
+ * Function: ReadStaticCache
+ * -------------------------
+ * Maps the cache file and copies it out if it checks out.
+ *
+ * Parameters:
+ *   const char* path       - The cache file.
+ *   StaticCacheFile* file  - Receives its contents.
+ *
+ * Returns:
+ *   BOOL - TRUE if the file holds a valid snapshot.
+ */
+static BOOL ReadStaticCache(const char *path, StaticCacheFile *file)
+{
+    LARGE_INTEGER size;
+    BOOL valid = FALSE;
+
+    HANDLE hFile = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE) {
+        return FALSE;
+    }
+    if (GetFileSizeEx(hFile, &size) && size.QuadPart == sizeof(StaticCacheFile)) {
+        HANDLE hMapping = CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (hMapping != NULL) {
+            const StaticCacheFile *view = (const StaticCacheFile *)MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+            if (view != NULL) {
+                *file = *view;
+                UnmapViewOfFile(view);
+                valid = file->signature == STATIC_CACHE_SIGNATURE && EcStaticCheck(&file->snapshot) == EC_STATIC_VALID &&
+                        file->fw_state == file->snapshot.FwState;
+            }
+            CloseHandle(hMapping);
+        }
+    }
+    CloseHandle(hFile);
+    return valid;
+}
+
+/*
+ * Function: WriteStaticCache
+ * --------------------------
+ * Replaces the cache file, writing a temporary file first so a reader never
+ * sees a partial one. Failures are ignored, the cache only saves time.
+ *
+ * Parameters:
+ *   const char* path       - The cache file.
+ *   const StaticCacheFile* file - The contents.
+ */
+static void WriteStaticCache(const char *path, const StaticCacheFile *file)
+{
+    char temp[MAX_PATH];
+    char directory[MAX_PATH];
+    DWORD written = 0;
+
+    if (FAILED(StringCchPrintfA(temp, sizeof(temp), "%s.tmp", path)) ||
+        FAILED(StringCchCopyA(directory, sizeof(directory), path))) {
+        return;
+    }
+    char *separator = strrchr(directory, '\\');
+    if (separator != NULL) {
+        *separator = '\0';
+        CreateDirectoryA(directory, NULL);
+    }
+
+    HANDLE hFile = CreateFileA(temp, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE) {
+        return;
+    }
+    BOOL ok = WriteFile(hFile, file, sizeof(*file), &written, NULL) && written == sizeof(*file);
+    CloseHandle(hFile);
+    if (!ok || !MoveFileExA(temp, path, MOVEFILE_REPLACE_EXISTING)) {
+        DeleteFileA(temp);
+    }
+}
+
+/*
+ * Function: FetchStatic
+ * ---------------------
+ * Reads the driver version and the snapshot from the driver.
+ *
+ * Parameters:
+ *   StaticCacheFile* file  - Receives both.
+ *
+ * Returns:
+ *   int - ERROR_SUCCESS on success, ERROR_CRC if the snapshot does not check
+ *         out, or an error code on failure.
+ */
+static int FetchStatic(StaticCacheFile *file)
+{
+    VersionRsp_t version = { 0 };
+    UINT32 input = 0;
+    HANDLE hDevice;
+    DWORD bytesReturned = 0;
+    int status;
+
+    status = GetKMDFDriverHandle(0, &hDevice);
+    if (status != ERROR_SUCCESS) {
+        return status;
+    }
+    if (!MeteredIoctl(hDevice, (DWORD)IOCTL_GET_VERSION, &input, sizeof(input), &version, sizeof(version), &bytesReturned)) {
+        status = GetLastError();
+    } else if (!MeteredIoctl(hDevice, (DWORD)IOCTL_GET_STATIC, &input, sizeof(input), &file->snapshot, sizeof(file->snapshot), &bytesReturned)) {
+        status = GetLastError();
+    } else if (bytesReturned != sizeof(file->snapshot) || EcStaticCheck(&file->snapshot) != EC_STATIC_VALID) {
+        status = ERROR_CRC;
+    }
+    CloseHandle(hDevice);
+
+    file->signature = STATIC_CACHE_SIGNATURE;
+    file->driver_version = version.version;
+    file->fw_state = file->snapshot.FwState;
+    return status;
+}
+
+/*
+ * Function: ReadFwState
+ * ---------------------
+ * Evaluates TFWS for the firmware state the EC reports now.
+ *
+ * Parameters:
+ *   UINT32* fw_state       - Receives the state.
+ *
+ * Returns:
+ *   int - ERROR_SUCCESS on success, or an error code on failure.
+ */
+static int ReadFwState(UINT32 *fw_state)
+{
+    ECLIB_REQUEST *request = NULL;
+    BYTE arena[64];
+    ECLIB_VIEW view;
+    UINT32 count = 0;
+    UINT64 value = 0;
+
+    int status = EcRequestCreate(STATIC_FW_STATE_METHOD, &request);
+    if (status == ERROR_SUCCESS) {
+        status = EcRequestEvaluate(request, arena, sizeof(arena), &view, 1, &count);
+        EcRequestDestroy(request);
+    }
+    if (status != ERROR_SUCCESS) {
+        return status;
+    }
+    if (count != 1 || view.type != ACPI_METHOD_ARGUMENT_INTEGER || view.length > sizeof(value)) {
+        return ERROR_INVALID_DATA;
+    }
+    memcpy(&value, arena + view.offset, view.length);
+    *fw_state = (UINT32)value;
+    return ERROR_SUCCESS;
+}
+
+/*
+ * Function: SetStatic
+ * -------------------
+ * Converts a snapshot into the facts handed to callers. Called with the lock
+ * held exclusively.
+ *
+ * Parameters:
+ *   const StaticCacheFile* file - The snapshot and driver version.
+ *   UINT32 source          - ECLIB_STATIC_SOURCE_*.
+ */
+static void SetStatic(const StaticCacheFile *file, UINT32 source)
+{
+    const EC_STATIC *snapshot = &file->snapshot;
+    ECLIB_STATIC *facts = &g_static.facts;
+
+    g_static.file = *file;
+    memset(facts, 0, sizeof(*facts));
+    facts->version = snapshot->Version;
+    facts->fw_state = snapshot->FwState;
+    facts->service_count = snapshot->ServiceCount;
+    facts->dsm_count = snapshot->DsmCount;
+    facts->source = source;
+    facts->driver_version = file->driver_version;
+    for (UINT32 i = 0; i < snapshot->ServiceCount; i++) {
+        memcpy(&facts->services[i].service, snapshot->Services[i].Uuid, sizeof(GUID));
+        facts->services[i].partition = snapshot->Services[i].PartitionId;
+    }
+    for (UINT32 i = 0; i < snapshot->DsmCount; i++) {
+        memcpy(&facts->dsm[i].uuid, snapshot->Dsm[i].Uuid, sizeof(GUID));
+        memcpy(facts->dsm[i].device, snapshot->Dsm[i].Device, sizeof(snapshot->Dsm[i].Device));
+        facts->dsm[i].revision = snapshot->Dsm[i].Revision;
+        facts->dsm[i].functions = snapshot->Dsm[i].Functions;
+    }
+}
+
+/*
+ * Function: RefreshStatic
+ * -----------------------
+ * Thread pool callback queued after the facts were loaded from the cache file.
+ * Fetches the snapshot from the driver, takes it in place of the cached one and
+ * rewrites the file if the firmware state or driver version moved on.
+ */
+static VOID CALLBACK RefreshStatic(PTP_CALLBACK_INSTANCE instance, PVOID context)
+{
+    StaticCacheFile file;
+    char path[MAX_PATH] = { 0 };
+
+    UNREFERENCED_PARAMETER(instance);
+    UNREFERENCED_PARAMETER(context);
+
+    int status = FetchStatic(&file);
+
+    AcquireSRWLockExclusive(&g_static.lock);
+    BOOL changed = status == ERROR_SUCCESS && memcmp(&file, &g_static.file, sizeof(file)) != 0;
+    if (status == ERROR_SUCCESS) {
+        SetStatic(&file, ECLIB_STATIC_SOURCE_DRIVER);
+    }
+    if (changed && StaticCachePath() != NULL) {
+        StringCchCopyA(path, sizeof(path), g_static.path);
+    }
+    g_static.refresh_status = status;
+    ReleaseSRWLockExclusive(&g_static.lock);
+
+    if (path[0] != '\0') {
+        WriteStaticCache(path, &file);
+    }
+    SetEvent(g_static.refreshed);
+}
+
+/*
+ * Function: LoadStatic
+ * --------------------
+ * Loads the facts from the cache file if it was written for this driver
+ * version and TFWS still returns the firmware state it was written with,
+ * queueing a refresh, otherwise fetches them from the driver and writes the
+ * file. Called with the lock held exclusively.
+ *
+ * Returns:
+ *   int - ERROR_SUCCESS on success, or an error code on failure.
+ */
+static int LoadStatic(void)
+{
+    StaticCacheFile file;
+    const char *path = StaticCachePath();
+    UINT32 fwState = 0;
+    int status;
+
+    if (g_static.refreshed == NULL) {
+        g_static.refreshed = CreateEvent(NULL, TRUE, TRUE, NULL);
+        if (g_static.refreshed == NULL) {
+            return GetLastError();
+        }
+    }
+
+    // Checked before anything from the file is published, a firmware update
+    // without a driver update would otherwise serve stale facts until the refresh
+    if (path != NULL && ReadStaticCache(path, &file) && file.driver_version == EC_DRIVER_VERSION &&
+        ReadFwState(&fwState) == ERROR_SUCCESS && fwState == file.fw_state) {
+        SetStatic(&file, ECLIB_STATIC_SOURCE_CACHE);
+        MetricsCount(ECLIB_COUNTER_CACHE_HITS, 1);
+        g_static.loaded = TRUE;
+        g_static.refresh_status = ERROR_SUCCESS;
+        ResetEvent(g_static.refreshed);
+        if (!TrySubmitThreadpoolCallback(RefreshStatic, NULL, NULL)) {
+            g_static.refresh_status = GetLastError();
+            SetEvent(g_static.refreshed);
+        }
+        return ERROR_SUCCESS;
+    }
+
+    status = FetchStatic(&file);
+    if (status != ERROR_SUCCESS) {
+        return status;
+    }
+    SetStatic(&file, ECLIB_STATIC_SOURCE_DRIVER);
+    MetricsCount(ECLIB_COUNTER_CACHE_MISSES, 1);
+    g_static.loaded = TRUE;
+    if (path != NULL) {
+        WriteStaticCache(path, &file);
+    }
+    return ERROR_SUCCESS;
+}
+
+/*
+ * Function: GetStatic
+ * -------------------
+ * Copies the facts, loading them the first time. A failed load is not
+ * remembered, so the next call tries again.
+ *
+ * Parameters:
+ *   ECLIB_STATIC* facts    - Receives the facts.
+ *
+ * Returns:
+ *   int - ERROR_SUCCESS on success, or an error code on failure.
+ */
+static int GetStatic(ECLIB_STATIC *facts)
+{
+    int status = ERROR_SUCCESS;
+
+    AcquireSRWLockShared(&g_static.lock);
+    if (g_static.loaded) {
+        *facts = g_static.facts;
+        ReleaseSRWLockShared(&g_static.lock);
+        MetricsCount(ECLIB_COUNTER_CACHE_HITS, 1);
+        return ERROR_SUCCESS;
+    }
+    ReleaseSRWLockShared(&g_static.lock);
+
+    AcquireSRWLockExclusive(&g_static.lock);
+    if (!g_static.loaded) {
+        status = LoadStatic();
+    }
+    if (status == ERROR_SUCCESS) {
+        *facts = g_static.facts;
+    }
+    ReleaseSRWLockExclusive(&g_static.lock);
+    return status;
+}
+
+/*
+ * Function: EcStaticRead
+ * ----------------------
+ * Returns every fact of the static snapshot.
+ *
+ * Parameters:
+ *   ECLIB_STATIC* facts    - Receives the facts.
+ *
+ * Returns:
+ *   int - ERROR_SUCCESS on success, or an error code on failure.
+ */
+ECLIB_API
+int EcStaticRead(
+    _Out_ ECLIB_STATIC *facts
+)
+{
+    if (facts == NULL) {
+        return ERROR_INVALID_PARAMETER;
+    }
+    return GetStatic(facts);
+}
+
+/*
+ * Function: EcStaticGetFwState
+ * ----------------------------
+ * Returns the firmware state TFWS would, as recorded at boot.
+ *
+ * Parameters:
+ *   UINT32* fw_state       - Receives the state.
+ *
+ * Returns:
+ *   int - ERROR_SUCCESS on success, or an error code on failure.
+ */
+ECLIB_API
+int EcStaticGetFwState(
+    _Out_ UINT32 *fw_state
+)
+{
+    ECLIB_STATIC facts;
+
+    if (fw_state == NULL) {
+        return ERROR_INVALID_PARAMETER;
+    }
+    int status = GetStatic(&facts);
+    if (status == ERROR_SUCCESS) {
+        *fw_state = facts.fw_state;
+    }
+    return status;
+}
+
+/*
+ * Function: EcStaticGetDsmFunctions
+ * ---------------------------------
+ * Returns what function 0 of a _DSM reports without evaluating it.
+ *
+ * Parameters:
+ *   const char* device     - ACPI name of the device under \_SB, such as "SKIN".
+ *   const GUID* uuid       - The _DSM UUID.
+ *   UINT64* functions      - Receives the bitmask of supported functions.
+ *
+ * Returns:
+ *   int - ERROR_SUCCESS on success, ERROR_NOT_FOUND if the snapshot does not
+ *         list the _DSM, or an error code on failure.
+ */
+ECLIB_API
+int EcStaticGetDsmFunctions(
+    _In_z_ const char *device,
+    _In_ const GUID *uuid,
+    _Out_ UINT64 *functions
+)
+{
+    ECLIB_STATIC facts;
+
+    if (device == NULL || uuid == NULL || functions == NULL) {
+        return ERROR_INVALID_PARAMETER;
+    }
+    int status = GetStatic(&facts);
+    if (status != ERROR_SUCCESS) {
+        return status;
+    }
+    for (UINT32 i = 0; i < facts.dsm_count; i++) {
+        if (_stricmp(facts.dsm[i].device, device) == 0 && IsEqualGUID(&facts.dsm[i].uuid, uuid)) {
+            *functions = facts.dsm[i].functions;
+            return ERROR_SUCCESS;
+        }
+    }
+    return ERROR_NOT_FOUND;
+}
+
+/*
+ * Function: EcStaticGetPartition
+ * ------------------------------
+ * Returns the FF-A partition that serves an EC service.
+ *
+ * Parameters:
+ *   const GUID* service    - The service UUID.
+ *   UINT16* partition      - Receives the FF-A ID of the partition.
+ *
+ * Returns:
+ *   int - ERROR_SUCCESS on success, ERROR_NOT_FOUND if the snapshot does not
+ *         list the service, or an error code on failure.
+ */
+ECLIB_API
+int EcStaticGetPartition(
+    _In_ const GUID *service,
+    _Out_ UINT16 *partition
+)
+{
+    ECLIB_STATIC facts;
+
+    if (service == NULL || partition == NULL) {
+        return ERROR_INVALID_PARAMETER;
+    }
+    int status = GetStatic(&facts);
+    if (status != ERROR_SUCCESS) {
+        return status;
+    }
+    for (UINT32 i = 0; i < facts.service_count; i++) {
+        if (IsEqualGUID(&facts.services[i].service, service)) {
+            *partition = facts.services[i].partition;
+            return ERROR_SUCCESS;
+        }
+    }
+    return ERROR_NOT_FOUND;
+}
+
+/*
+ * Function: EcStaticSetCacheFile
+ * ------------------------------
+ * Chooses the cache file used by the next load or refresh.
+ *
+ * Parameters:
+ *   const char* path       - The file, NULL to use none.
+ *
+ * Returns:
+ *   int - ERROR_SUCCESS on success, ERROR_INVALID_PARAMETER if the path is too long.
+ */
+ECLIB_API
+int EcStaticSetCacheFile(
+    _In_opt_z_ const char *path
+)
+{
+    int status = ERROR_SUCCESS;
+
+    AcquireSRWLockExclusive(&g_static.lock);
+    if (path == NULL) {
+        g_static.path[0] = '\0';
+    } else if (FAILED(StringCchCopyA(g_static.path, sizeof(g_static.path), path))) {
+        g_static.path[0] = '\0';
+        status = ERROR_INVALID_PARAMETER;
+    }
+    g_static.path_set = TRUE;
+    ReleaseSRWLockExclusive(&g_static.lock);
+    return status;
+}
+
+/*
+ * Function: EcStaticWaitRefresh
+ * -----------------------------
+ * Waits for the refresh queued when the facts were loaded from the cache file.
+ *
+ * Parameters:
+ *   DWORD timeout_ms       - How long to wait, INFINITE to wait for ever.
+ *
+ * Returns:
+ *   int - ERROR_SUCCESS if no refresh is pending or it succeeded, ERROR_TIMEOUT
+ *         if it is still running, or the error the refresh failed with.
+ */
+ECLIB_API
+int EcStaticWaitRefresh(
+    _In_ DWORD timeout_ms
+)
+{
+    AcquireSRWLockShared(&g_static.lock);
+    HANDLE refreshed = g_static.refreshed;
+    ReleaseSRWLockShared(&g_static.lock);
+
+    // The event is never closed once created, so it can be waited on unlocked
+    if (refreshed == NULL) {
+        return ERROR_SUCCESS;
+    }
+    if (WaitForSingleObject(refreshed, timeout_ms) != WAIT_OBJECT_0) {
+        return ERROR_TIMEOUT;
+    }
+
+    AcquireSRWLockShared(&g_static.lock);
+    int status = g_static.refresh_status;
+    ReleaseSRWLockShared(&g_static.lock);
+    return status;
+}
+
+static const char *g_counter_names[ECLIB_COUNTERS] = {
+    "calls", "errors", "bytes_in", "bytes_out", "cache_hits", "cache_misses", "waits"
+};
+
+static const char *g_histogram_names[ECLIB_HISTOGRAMS] = {
+    "call_us", "wait_us"
+};
+
+/*
+ * Function: EcMetricsSnapshot
+ * ---------------------------
+ * Adds up the shards of the running threads that have used eclib and the
+ * counts of those that exited.
+ *
+ * Parameters:
+ *   ECLIB_METRICS* metrics - Receives the totals since the process started or
+ *                            the last reset.
+ *   BOOL reset             - Whether later snapshots start from this one.
+ *
+ * Returns:
+ *   int - ERROR_SUCCESS on success, or an error code on failure.
+ */
+ECLIB_API
+int EcMetricsSnapshot(
+    _Out_ ECLIB_METRICS *metrics,
+    _In_ BOOL reset
+)
+{
+    ECLIB_METRICS total;
+
+    if (metrics == NULL) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    AcquireSRWLockExclusive(&g_metrics.lock);
+    total = g_metrics.retired;
+    for (MetricsShard *shard = g_metrics.shards; shard != NULL; shard = shard->next) {
+        AddShard(&total, shard);
+        total.threads++;
+    }
+
+    *metrics = total;
+    for (UINT32 i = 0; i < ECLIB_COUNTERS; i++) {
+        metrics->counters[i] -= g_metrics.baseline.counters[i];
+    }
+    for (UINT32 h = 0; h < ECLIB_HISTOGRAMS; h++) {
+        ECLIB_HISTOGRAM *out = &metrics->histograms[h];
+        const ECLIB_HISTOGRAM *base = &g_metrics.baseline.histograms[h];
+        out->count -= base->count;
+        out->sum_us -= base->sum_us;
+        for (UINT32 b = 0; b < ECLIB_HISTOGRAM_BUCKETS; b++) {
+            out->buckets[b] -= base->buckets[b];
+        }
+    }
+    if (reset) {
+        g_metrics.baseline = total;
+    }
+    ReleaseSRWLockExclusive(&g_metrics.lock);
+    return ERROR_SUCCESS;
+}
+
+/*
+ * Function: EcMetricsCounterName
+ * ------------------------------
+ * Returns the name of a counter, for printing and export.
+ *
+ * Parameters:
+ *   UINT32 counter         - ECLIB_COUNTER_*.
+ *
+ * Returns:
+ *   const char* - The name, NULL for an unknown counter.
+ */
+ECLIB_API
+const char *EcMetricsCounterName(
+    _In_ UINT32 counter
+)
+{
+    return counter < ECLIB_COUNTERS ? g_counter_names[counter] : NULL;
+}
+
+/*
+ * Function: EcMetricsHistogramName
+ * --------------------------------
+ * Returns the name of a histogram, for printing and export.
+ *
+ * Parameters:
+ *   UINT32 histogram       - ECLIB_HISTOGRAM_*.
+ *
+ * Returns:
+ *   const char* - The name, NULL for an unknown histogram.
+ */
+ECLIB_API
+const char *EcMetricsHistogramName(
+    _In_ UINT32 histogram
+)
+{
+    return histogram < ECLIB_HISTOGRAMS ? g_histogram_names[histogram] : NULL;
+}
+
+/*
+ * Function: EcMetricsPercentile
+ * -----------------------------
+ * Finds the bucket holding a percentile of a histogram.
+ *
+ * Parameters:
+ *   const ECLIB_HISTOGRAM* histogram - The histogram.
+ *   UINT32 percent         - 0 to 100.
+ *
+ * Returns:
+ *   UINT64 - The largest value the bucket holds in microseconds, 0 if the
+ *            histogram is empty.
+ */
+ECLIB_API
+UINT64 EcMetricsPercentile(
+    _In_ const ECLIB_HISTOGRAM *histogram,
+    _In_ UINT32 percent
+)
+{
+    UINT64 seen = 0;
+
+    if (histogram == NULL || histogram->count == 0) {
+        return 0;
+    }
+
+    UINT64 rank = (histogram->count * min(percent, 100) + 99) / 100;
+    for (UINT32 b = 0; b < ECLIB_HISTOGRAM_BUCKETS; b++) {
+        seen += histogram->buckets[b];
+        if (seen >= rank && seen != 0) {
+            return b == ECLIB_HISTOGRAM_BUCKETS - 1 ? histogram->max_us : (1ull << b) - 1;
+        }
+    }
+    return histogram->max_us;
+}
@@ -0,0 +1,851 @@
+/*
+MIT License
+
+Copyright (c) 2025 Open Device Partnership
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <string.h>
+#include "../inc/ecring.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#if defined(_M_ARM64)
+#define ECRING_FENCE()  __dmb(_ARM64_BARRIER_ISH)
+#else
+#define ECRING_FENCE()  _mm_mfence()
+#endif
+#else
+#define ECRING_FENCE()  __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#endif
+
+static volatile uint64_t *Slot(volatile uint8_t *window, uint32_t index)
+{
+    return (volatile uint64_t *)(window + ECRING_SLOT_OFFSET + index * sizeof(uint64_t));
+}
+
+static void *Entry(volatile uint8_t *window, uint32_t index)
+{
+    return (void *)(window + ECRING_ENTRY_OFFSET + index * ECRING_ENTRY_SIZE);
+}
+
+static volatile uint32_t *TxFlags(volatile uint8_t *tx)
+{
+    return (volatile uint32_t *)(tx + ECRING_TX_FLAGS);
+}
+
+// Descriptor of RX slot index last released by a read-only consumer
+static volatile uint64_t *Release(volatile uint8_t *tx, uint32_t index)
+{
+    return (volatile uint64_t *)(tx + ECRING_RX_RELEASE_OFFSET + index * sizeof(uint64_t));
+}
+
+static volatile uint32_t *StreamRxTail(volatile uint8_t *tx)
+{
+    return (volatile uint32_t *)(tx + ECRING_STREAM_RX_TAIL);
+}
+
+static volatile uint16_t *StreamVersion(volatile uint8_t *window)
+{
+    return (volatile uint16_t *)window;
+}
+
+static volatile uint32_t *StreamHead(volatile uint8_t *window)
+{
+    return (volatile uint32_t *)(window + ECRING_STREAM_HEAD);
+}
+
+static volatile uint32_t *StreamTail(volatile uint8_t *window)
+{
+    return (volatile uint32_t *)(window + ECRING_STREAM_TAIL);
+}
+
+static volatile uint64_t *StreamRecord(volatile uint8_t *window, uint32_t offset)
+{
+    return (volatile uint64_t *)(window + ECRING_STREAM_DATA + offset);
+}
+
+// Head and tail are 8-byte aligned offsets inside the data area
+static int StreamOffsetValid(uint32_t offset)
+{
+    return offset < ECRING_STREAM_SIZE && (offset & 7) == 0;
+}
+
+// Offset of the record after one of a given length
+static uint32_t StreamNext(uint32_t offset, uint16_t length)
+{
+    offset += ECRING_STREAM_RECORD_SIZE(length);
+    return offset == ECRING_STREAM_SIZE ? 0 : offset;
+}
+
+// A record is consumed when marked in the window, or for a read-only window
+// when its unit is set in consumed
+static int StreamConsumed(uint64_t record, uint32_t offset, const uint64_t *consumed)
+{
+    if (consumed == NULL) {
+        return (record & ECRING_STREAM_CONSUMED) != 0;
+    }
+    return (consumed[offset / 8 / 64] >> (offset / 8 % 64)) & 1;
+}
+
+/*
+ * Function: StreamFind
+ * --------------------
+ * Walks the records published between tail and head for the one with a given
+ * sequence, or the oldest one, that is not consumed yet. The caller has read
+ * head before calling.
+ *
+ * Parameters:
+ *   volatile uint8_t *stream - The window.
+ *   uint32_t tail          - Offset of the oldest record.
+ *   uint32_t head          - Offset after the newest record.
+ *   uint16_t sequence      - Sequence to find, 0 for the oldest.
+ *   const uint64_t *consumed - Records taken from a read-only window, or NULL.
+ *   uint32_t *offset       - Receives the offset of the record.
+ *
+ * Returns:
+ *   int - ECRING_STATUS_SUCCESS, ECRING_STATUS_NOT_READY if there is no such
+ *         record, or ECRING_STATUS_CORRUPT.
+ */
+static int StreamFind(
+    volatile uint8_t *stream,
+    uint32_t tail,
+    uint32_t head,
+    uint16_t sequence,
+    const uint64_t *consumed,
+    uint32_t *offset
+)
+{
+    uint32_t current = tail;
+
+    if (!StreamOffsetValid(head) || !StreamOffsetValid(tail)) {
+        return ECRING_STATUS_CORRUPT;
+    }
+
+    // Read the records only after the head that published them. A stream
+    // cannot hold more records than it has 8-byte units
+    ECRING_FENCE();
+    for (uint32_t records = 0; current != head; records++) {
+        uint64_t record = *StreamRecord(stream, current);
+        uint16_t recordLength = (uint16_t)record;
+
+        if (records == ECRING_STREAM_UNITS) {
+            return ECRING_STATUS_CORRUPT;
+        }
+        if (recordLength == ECRING_STREAM_WRAP && current != 0) {
+            current = 0;
+            continue;
+        }
+        if (recordLength == 0 || recordLength > ECRING_STREAM_MAX_PAYLOAD ||
+            current + ECRING_STREAM_RECORD_SIZE(recordLength) > ECRING_STREAM_SIZE) {
+            return ECRING_STATUS_CORRUPT;
+        }
+        if (!StreamConsumed(record, current, consumed) &&
+            (sequence == 0 || (uint16_t)(record >> 16) == sequence)) {
+            *offset = current;
+            return ECRING_STATUS_SUCCESS;
+        }
+        current = StreamNext(current, recordLength);
+    }
+    return ECRING_STATUS_NOT_READY;
+}
+
+/*
+ * Function: StreamAdvance
+ * -----------------------
+ * Moves a tail past every consumed record at the front of a stream. Units of
+ * a read-only window are cleared as the tail passes them.
+ *
+ * Parameters:
+ *   volatile uint8_t *stream - The window.
+ *   uint32_t tail          - The current tail.
+ *   uint32_t head          - Offset after the newest record.
+ *   uint64_t *consumed     - Records taken from a read-only window, or NULL.
+ *
+ * Returns:
+ *   uint32_t - The new tail.
+ */
+static uint32_t StreamAdvance(volatile uint8_t *stream, uint32_t tail, uint32_t head, uint64_t *consumed)
+{
+    while (tail != head) {
+        uint64_t record = *StreamRecord(stream, tail);
+
+        if ((uint16_t)record == ECRING_STREAM_WRAP && tail != 0) {
+            tail = 0;
+        } else if (StreamConsumed(record, tail, consumed) && (uint16_t)record <= ECRING_STREAM_MAX_PAYLOAD &&
+                   tail + ECRING_STREAM_RECORD_SIZE((uint16_t)record) <= ECRING_STREAM_SIZE) {
+            if (consumed != NULL) {
+                consumed[tail / 8 / 64] &= ~(1ull << (tail / 8 % 64));
+            }
+            tail = StreamNext(tail, (uint16_t)record);
+        } else {
+            break;
+        }
+    }
+    return tail;
+}
+
+/*
+ * Function: EcRingInit
+ * --------------------
+ * Attaches a ring to the TX and RX windows. The windows are not cleared, slots
+ * the EC still owns stay owned.
+ *
+ * Parameters:
+ *   ECRING *ring           - The ring to initialize.
+ *   void *tx               - The TX window, ECRING_WINDOW_SIZE bytes.
+ *   void *rx               - The RX window, ECRING_WINDOW_SIZE bytes.
+ *   ECRING_DOORBELL_CALLBACK doorbell - Rings the EC.
+ *   void *context          - Passed to doorbell.
+ */
+ECRING_API
+void EcRingInit(
+    ECRING *ring,
+    void *tx,
+    void *rx,
+    ECRING_DOORBELL_CALLBACK doorbell,
+    void *context
+)
+{
+    memset(ring, 0, sizeof(*ring));
+    ring->tx = (volatile uint8_t *)tx;
+    ring->rx = (volatile uint8_t *)rx;
+    ring->doorbell = doorbell;
+    ring->context = context;
+    ring->layout = ECRING_LAYOUT_SLOTS;
+}
+
+/*
+ * Function: EcRingInitStream
+ * --------------------------
+ * Attaches a ring to the TX and RX windows and formats both as empty byte
+ * streams. Must be done before the EC is rung, while neither side has data
+ * in flight.
+ *
+ * Parameters:
+ *   ECRING *ring           - The ring to initialize.
+ *   void *tx               - The TX window, ECRING_WINDOW_SIZE bytes.
+ *   void *rx               - The RX window, ECRING_WINDOW_SIZE bytes.
+ *   ECRING_DOORBELL_CALLBACK doorbell - Rings the EC.
+ *   void *context          - Passed to doorbell.
+ */
+ECRING_API
+void EcRingInitStream(
+    ECRING *ring,
+    void *tx,
+    void *rx,
+    ECRING_DOORBELL_CALLBACK doorbell,
+    void *context
+)
+{
+    EcRingInit(ring, tx, rx, doorbell, context);
+    ring->layout = ECRING_LAYOUT_STREAM;
+    *TxFlags(ring->tx) &= ~ECRING_TX_RX_READONLY;
+    EcRingStreamFormat(tx);
+    EcRingStreamFormat(rx);
+}
+
+/*
+ * Function: EcRingInitReadOnly
+ * ----------------------------
+ * Attaches a ring to a TX window and an RX window it may only read, such as
+ * the view IOCTL_MAP_RX maps. Responses already in the RX window were for an
+ * earlier consumer and are released. The TX window is formatted for the
+ * layout and marked ECRING_TX_RX_READONLY, so the EC takes releases from it.
+ *
+ * Parameters:
+ *   ECRING *ring           - The ring to initialize.
+ *   void *tx               - The TX window, ECRING_WINDOW_SIZE bytes.
+ *   const void *rx         - The RX window, ECRING_WINDOW_SIZE bytes.
+ *   uint32_t layout        - ECRING_LAYOUT_SLOTS or ECRING_LAYOUT_STREAM.
+ *   ECRING_DOORBELL_CALLBACK doorbell - Rings the EC.
+ *   void *context          - Passed to doorbell.
+ *
+ * Returns:
+ *   int - ECRING_STATUS_SUCCESS on success, ECRING_STATUS_NOT_READY if the EC
+ *         has not formatted the RX stream yet, or an error code.
+ */
+ECRING_API
+int EcRingInitReadOnly(
+    ECRING *ring,
+    void *tx,
+    const void *rx,
+    uint32_t layout,
+    ECRING_DOORBELL_CALLBACK doorbell,
+    void *context
+)
+{
+    volatile uint8_t *window = (volatile uint8_t *)rx;
+
+    if (layout != ECRING_LAYOUT_SLOTS && layout != ECRING_LAYOUT_STREAM) {
+        return ECRING_STATUS_INVALID_PARAMETER;
+    }
+
+    EcRingInit(ring, tx, (void *)rx, doorbell, context);
+    ring->layout = layout;
+    ring->readOnly = 1;
+    if (layout == ECRING_LAYOUT_STREAM) {
+        if (*StreamVersion(window) != ECRING_STREAM_VERSION) {
+            return ECRING_STATUS_NOT_READY;
+        }
+        ring->rxTail = *StreamHead(window);
+        if (!StreamOffsetValid(ring->rxTail)) {
+            return ECRING_STATUS_CORRUPT;
+        }
+        EcRingStreamFormat(tx);
+        *StreamRxTail(ring->tx) = ring->rxTail;
+    } else {
+        for (uint32_t slot = 0; slot < ECRING_SLOTS; slot++) {
+            *Release(ring->tx, slot) = *Slot(ring->rx, slot);
+        }
+    }
+
+    // The releases are in place before the EC looks for them
+    ECRING_FENCE();
+    *TxFlags(ring->tx) |= ECRING_TX_RX_READONLY;
+    return ECRING_STATUS_SUCCESS;
+}
+
+/*
+ * Function: EcRingApplyReleases
+ * -----------------------------
+ * EC side of a read-only consumer. Frees the RX slots whose descriptors the
+ * consumer released in the TX window, or moves the RX stream tail to the one
+ * it published there. Does nothing unless the TX window is marked
+ * ECRING_TX_RX_READONLY. Call before looking for free RX space.
+ *
+ * Parameters:
+ *   void *tx               - The TX window.
+ *   void *rx               - The RX window.
+ *
+ * Returns:
+ *   int - ECRING_STATUS_SUCCESS, or ECRING_STATUS_CORRUPT if the published
+ *         tail is out of range.
+ */
+ECRING_API
+int EcRingApplyReleases(
+    void *tx,
+    void *rx
+)
+{
+    volatile uint8_t *txWindow = (volatile uint8_t *)tx;
+    volatile uint8_t *rxWindow = (volatile uint8_t *)rx;
+
+    if (!(*TxFlags(txWindow) & ECRING_TX_RX_READONLY)) {
+        return ECRING_STATUS_SUCCESS;
+    }
+
+    if (*StreamVersion(rxWindow) == ECRING_STREAM_VERSION) {
+        uint32_t tail = *StreamRxTail(txWindow);
+
+        if (!StreamOffsetValid(tail)) {
+            return ECRING_STATUS_CORRUPT;
+        }
+
+        // The consumer read the records before it published the tail past them
+        ECRING_FENCE();
+        *StreamTail(rxWindow) = tail;
+        return ECRING_STATUS_SUCCESS;
+    }
+
+    for (uint32_t slot = 0; slot < ECRING_SLOTS; slot++) {
+        uint64_t descriptor = *Slot(rxWindow, slot);
+
+        if ((descriptor & ECRING_SLOT_VALID) && *Release(txWindow, slot) == descriptor) {
+            ECRING_FENCE();
+            *Slot(rxWindow, slot) = 0;
+        }
+    }
+    return ECRING_STATUS_SUCCESS;
+}
+
+/*
+ * Function: EcRingStreamFormat
+ * ----------------------------
+ * Marks a window as an empty byte stream.
+ *
+ * Parameters:
+ *   void *window           - The window, ECRING_WINDOW_SIZE bytes.
+ */
+ECRING_API
+void EcRingStreamFormat(
+    void *window
+)
+{
+    *StreamHead((volatile uint8_t *)window) = 0;
+    *StreamTail((volatile uint8_t *)window) = 0;
+    ECRING_FENCE();
+    *StreamVersion((volatile uint8_t *)window) = ECRING_STREAM_VERSION;
+}
+
+/*
+ * Function: EcRingStreamFree
+ * --------------------------
+ * Returns the bytes a producer can still write to a stream window, of which
+ * a record of length bytes takes ECRING_STREAM_RECORD_SIZE(length) and, when
+ * it has to wrap, whatever is left before the end of the data area.
+ *
+ * Parameters:
+ *   const void *window     - The window.
+ *
+ * Returns:
+ *   uint32_t - Free bytes, 0 if the head or tail is out of range.
+ */
+ECRING_API
+uint32_t EcRingStreamFree(
+    const void *window
+)
+{
+    uint32_t head = *StreamHead((volatile uint8_t *)window);
+    uint32_t tail = *StreamTail((volatile uint8_t *)window);
+
+    if (!StreamOffsetValid(head) || !StreamOffsetValid(tail)) {
+        return 0;
+    }
+
+    // 8 bytes are always left so a full stream never looks empty
+    return ECRING_STREAM_SIZE - (head - tail + ECRING_STREAM_SIZE) % ECRING_STREAM_SIZE - 8;
+}
+
+/*
+ * Function: EcRingStreamPut
+ * -------------------------
+ * Appends a record to a stream window and publishes it by advancing the head.
+ * Only the producer side of the window may call this.
+ *
+ * Parameters:
+ *   void *window           - The window.
+ *   uint16_t sequence      - Sequence of the record, not 0.
+ *   const void *data       - The payload.
+ *   uint16_t length        - Bytes of data, 1 to ECRING_STREAM_MAX_PAYLOAD.
+ *
+ * Returns:
+ *   int - ECRING_STATUS_SUCCESS on success, ECRING_STATUS_FULL if the record
+ *         does not fit until the consumer frees space, or an error code.
+ */
+ECRING_API
+int EcRingStreamPut(
+    void *window,
+    uint16_t sequence,
+    const void *data,
+    uint16_t length
+)
+{
+    volatile uint8_t *stream = (volatile uint8_t *)window;
+    uint32_t head = *StreamHead(stream);
+    uint32_t size = ECRING_STREAM_RECORD_SIZE(length);
+    uint32_t need = size;
+
+    if (sequence == 0 || length == 0 || length > ECRING_STREAM_MAX_PAYLOAD) {
+        return ECRING_STATUS_INVALID_PARAMETER;
+    }
+    if (!StreamOffsetValid(head)) {
+        return ECRING_STATUS_CORRUPT;
+    }
+    if (head + size > ECRING_STREAM_SIZE) {
+        need += ECRING_STREAM_SIZE - head;
+    }
+    if (EcRingStreamFree(window) < need) {
+        return ECRING_STATUS_FULL;
+    }
+
+    // Space is only known free once the tail was read, order that before the writes
+    ECRING_FENCE();
+    if (head + size > ECRING_STREAM_SIZE) {
+        *StreamRecord(stream, head) = ECRING_STREAM_RECORD(0, ECRING_STREAM_WRAP);
+        head = 0;
+    }
+    memcpy((void *)StreamRecord(stream, head + 8), data, length);
+    *StreamRecord(stream, head) = ECRING_STREAM_RECORD(sequence, length);
+    ECRING_FENCE();
+    *StreamHead(stream) = StreamNext(head, length);
+    return ECRING_STATUS_SUCCESS;
+}
+
+/*
+ * Function: EcRingStreamGet
+ * -------------------------
+ * Takes a record out of a stream window, the one with a given sequence or the
+ * oldest one not yet taken. The record is marked consumed and the tail moves
+ * past every consumed record at the front of the stream. Only the consumer
+ * side of the window may call this.
+ *
+ * Parameters:
+ *   void *window           - The window.
+ *   uint16_t sequence      - Sequence to take, 0 for the oldest.
+ *   void *buffer           - Receives the payload.
+ *   uint16_t size          - Size of buffer, longer payloads are truncated.
+ *   uint16_t *length       - Receives the length of the payload.
+ *   uint16_t *found        - Receives the sequence taken, may be NULL.
+ *
+ * Returns:
+ *   int - ECRING_STATUS_SUCCESS on success, ECRING_STATUS_NOT_READY if there
+ *         is no such record yet, or ECRING_STATUS_CORRUPT.
+ */
+ECRING_API
+int EcRingStreamGet(
+    void *window,
+    uint16_t sequence,
+    void *buffer,
+    uint16_t size,
+    uint16_t *length,
+    uint16_t *found
+)
+{
+    volatile uint8_t *stream = (volatile uint8_t *)window;
+    uint32_t head = *StreamHead(stream);
+    uint32_t tail = *StreamTail(stream);
+    uint32_t offset;
+    uint64_t record;
+    int status;
+
+    status = StreamFind(stream, tail, head, sequence, NULL, &offset);
+    if (status != ECRING_STATUS_SUCCESS) {
+        return status;
+    }
+
+    record = *StreamRecord(stream, offset);
+    *length = (uint16_t)record;
+    if (found != NULL) {
+        *found = (uint16_t)(record >> 16);
+    }
+    memcpy(buffer, (const void *)StreamRecord(stream, offset + 8), *length < size ? *length : size);
+    *StreamRecord(stream, offset) = record | ECRING_STREAM_CONSUMED;
+
+    // Free everything consumed at the front, the producer may reuse it at once
+    tail = StreamAdvance(stream, tail, head, NULL);
+    ECRING_FENCE();
+    *StreamTail(stream) = tail;
+    return ECRING_STATUS_SUCCESS;
+}
+
+/*
+ * Function: EcRingSubmitBatch
+ * ---------------------------
+ * Copies messages into free TX slots, or appends them to the TX stream, in
+ * order, until the messages or the free space run out and then rings the EC
+ * once for all of them. Each entry is published after it is written, so the
+ * EC never sees a partial entry.
+ *
+ * Parameters:
+ *   ECRING *ring           - The ring.
+ *   const ECRING_MESSAGE *messages - Messages to send.
+ *   uint32_t count         - Number of messages, at most ECRING_SLOTS, or
+ *                            ECRING_STREAM_MAX_BATCH for a stream.
+ *   uint16_t *sequences    - Receives the sequence of every message submitted.
+ *   uint32_t *submitted    - Receives how many were submitted.
+ *
+ * Returns:
+ *   int - ECRING_STATUS_SUCCESS if at least one message was submitted,
+ *         ECRING_STATUS_FULL if there was no room for any, or an error code.
+ */
+ECRING_API
+int EcRingSubmitBatch(
+    ECRING *ring,
+    const ECRING_MESSAGE *messages,
+    uint32_t count,
+    uint16_t *sequences,
+    uint32_t *submitted
+)
+{
+    int stream = ring->layout == ECRING_LAYOUT_STREAM;
+    uint32_t queued = 0;
+
+    *submitted = 0;
+    if (count == 0 || count > (stream ? ECRING_STREAM_MAX_BATCH : ECRING_SLOTS)) {
+        return ECRING_STATUS_INVALID_PARAMETER;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        if (messages[i].length == 0 ||
+            messages[i].length > (stream ? ECRING_STREAM_MAX_PAYLOAD : ECRING_ENTRY_SIZE)) {
+            return ECRING_STATUS_INVALID_PARAMETER;
+        }
+    }
+
+    if (stream) {
+        while (queued < count) {
+            uint16_t sequence = (uint16_t)(ring->sequence + 1);
+            int status;
+
+            if (sequence == 0) {
+                sequence = 1;
+            }
+            status = EcRingStreamPut((void *)ring->tx, sequence, messages[queued].data, messages[queued].length);
+            if (status == ECRING_STATUS_FULL) {
+                break;
+            }
+            if (status != ECRING_STATUS_SUCCESS) {
+                return status;
+            }
+            ring->sequence = sequence;
+            sequences[queued++] = sequence;
+        }
+    } else {
+        for (uint32_t slot = 0; queued < count && slot < ECRING_SLOTS; slot++) {
+            if (ECRING_SLOT_SEQUENCE(*Slot(ring->tx, slot)) != 0) {
+                continue;
+            }
+
+            // The slot was freed by the EC, order its reads before our writes
+            ECRING_FENCE();
+            if (++ring->sequence == 0) {
+                ring->sequence = 1;
+            }
+            memcpy(Entry(ring->tx, slot), messages[queued].data, messages[queued].length);
+            ECRING_FENCE();
+            *Slot(ring->tx, slot) = ECRING_SLOT(ring->sequence, messages[queued].length);
+            sequences[queued++] = ring->sequence;
+        }
+    }
+
+    ring->stats.queued += queued;
+    if (queued == 0) {
+        ring->stats.full++;
+        return ECRING_STATUS_FULL;
+    }
+
+    // One doorbell announces every entry up to the last sequence
+    ECRING_FENCE();
+    ring->stats.doorbells++;
+    *submitted = queued;
+    if (ring->doorbell(ring->context, ECRING_DOORBELL(ring->sequence, queued)) != 0) {
+        return ECRING_STATUS_DOORBELL_FAILED;
+    }
+    return ECRING_STATUS_SUCCESS;
+}
+
+/*
+ * Function: EcRingSubmit
+ * ----------------------
+ * Sends one message and rings the EC, the equivalent of ASYC.
+ *
+ * Parameters:
+ *   ECRING *ring           - The ring.
+ *   const void *data       - The entry.
+ *   uint16_t length        - Bytes of data, at most ECRING_ENTRY_SIZE, or
+ *                            ECRING_STREAM_MAX_PAYLOAD for a stream.
+ *   uint16_t *sequence     - Receives the sequence to pass to EcRingReceive.
+ *
+ * Returns:
+ *   int - ECRING_STATUS_SUCCESS on success, or an error code on failure.
+ */
+ECRING_API
+int EcRingSubmit(
+    ECRING *ring,
+    const void *data,
+    uint16_t length,
+    uint16_t *sequence
+)
+{
+    ECRING_MESSAGE message;
+    uint32_t submitted;
+
+    message.data = data;
+    message.length = length;
+    return EcRingSubmitBatch(ring, &message, 1, sequence, &submitted);
+}
+
+/*
+ * Function: FindResponse
+ * ----------------------
+ * Locates the response with a given sequence in the RX window, skipping those
+ * already released.
+ *
+ * Parameters:
+ *   ECRING *ring           - The ring.
+ *   uint16_t sequence      - Sequence returned when the message was submitted.
+ *   uint32_t *where        - Receives the RX slot, or the record offset.
+ *   uint64_t *descriptor   - Receives the slot descriptor, or the record header.
+ *   uint32_t *head         - Receives the RX stream head that was searched.
+ *
+ * Returns:
+ *   int - ECRING_STATUS_SUCCESS on success, ECRING_STATUS_NOT_READY if the EC
+ *         has not responded yet, or an error code.
+ */
+static int FindResponse(ECRING *ring, uint16_t sequence, uint32_t *where, uint64_t *descriptor, uint32_t *head)
+{
+    if (sequence == 0) {
+        return ECRING_STATUS_INVALID_PARAMETER;
+    }
+    if (ring->layout == ECRING_LAYOUT_STREAM) {
+        uint32_t tail = ring->readOnly ? ring->rxTail : *StreamTail(ring->rx);
+        int status;
+
+        *head = *StreamHead(ring->rx);
+        status = StreamFind(ring->rx, tail, *head, sequence, ring->readOnly ? ring->rxConsumed : NULL, where);
+        if (status == ECRING_STATUS_SUCCESS) {
+            *descriptor = *StreamRecord(ring->rx, *where);
+        }
+        return status;
+    }
+
+    for (uint32_t slot = 0; slot < ECRING_SLOTS; slot++) {
+        uint64_t current = *Slot(ring->rx, slot);
+
+        if (!(current & ECRING_SLOT_VALID) || ECRING_SLOT_SEQUENCE(current) != sequence ||
+            (ring->readOnly && *Release(ring->tx, slot) == current)) {
+            continue;
+        }
+
+        // Read the entry only after the descriptor that published it
+        ECRING_FENCE();
+        *where = slot;
+        *descriptor = current;
+        return ECRING_STATUS_SUCCESS;
+    }
+    return ECRING_STATUS_NOT_READY;
+}
+
+/*
+ * Function: EcRingPeek
+ * --------------------
+ * Returns the response with a given sequence where it lies in the RX window.
+ * It stays there, owned by the host, until EcRingRelease. Does not wait, the
+ * caller polls as RXDB does.
+ *
+ * Parameters:
+ *   ECRING *ring           - The ring.
+ *   uint16_t sequence      - Sequence returned when the message was submitted.
+ *   const void **data      - Receives the response in the RX window.
+ *   uint16_t *length       - Receives the length of the response.
+ *
+ * Returns:
+ *   int - ECRING_STATUS_SUCCESS on success, ECRING_STATUS_NOT_READY if the EC
+ *         has not responded yet, or an error code.
+ */
+ECRING_API
+int EcRingPeek(
+    ECRING *ring,
+    uint16_t sequence,
+    const void **data,
+    uint16_t *length
+)
+{
+    uint64_t descriptor;
+    uint32_t where;
+    uint32_t head;
+    int status;
+
+    status = FindResponse(ring, sequence, &where, &descriptor, &head);
+    if (status != ECRING_STATUS_SUCCESS) {
+        return status;
+    }
+    if (ring->layout == ECRING_LAYOUT_STREAM) {
+        *length = (uint16_t)descriptor;
+        *data = (const void *)StreamRecord(ring->rx, where + 8);
+    } else {
+        *length = ECRING_SLOT_LENGTH(descriptor);
+        if (*length > ECRING_ENTRY_SIZE) {
+            *length = ECRING_ENTRY_SIZE;
+        }
+        *data = Entry(ring->rx, where);
+    }
+    return ECRING_STATUS_SUCCESS;
+}
+
+/*
+ * Function: EcRingRelease
+ * -----------------------
+ * Hands the space of a response back to the EC once the host is done with it.
+ * A read-only ring publishes the release in the TX window, otherwise the RX
+ * slot is freed or the record marked consumed in place.
+ *
+ * Parameters:
+ *   ECRING *ring           - The ring.
+ *   uint16_t sequence      - Sequence of the response.
+ *
+ * Returns:
+ *   int - ECRING_STATUS_SUCCESS on success, ECRING_STATUS_NOT_READY if there
+ *         is no such response, or an error code.
+ */
+ECRING_API
+int EcRingRelease(
+    ECRING *ring,
+    uint16_t sequence
+)
+{
+    uint64_t descriptor;
+    uint32_t where;
+    uint32_t head;
+    int status;
+
+    status = FindResponse(ring, sequence, &where, &descriptor, &head);
+    if (status != ECRING_STATUS_SUCCESS) {
+        return status;
+    }
+
+    // The response is read before its space is handed back
+    ECRING_FENCE();
+    if (ring->layout == ECRING_LAYOUT_STREAM && ring->readOnly) {
+        ring->rxConsumed[where / 8 / 64] |= 1ull << (where / 8 % 64);
+        ring->rxTail = StreamAdvance(ring->rx, ring->rxTail, head, ring->rxConsumed);
+        *StreamRxTail(ring->tx) = ring->rxTail;
+    } else if (ring->layout == ECRING_LAYOUT_STREAM) {
+        uint32_t tail;
+
+        *StreamRecord(ring->rx, where) = descriptor | ECRING_STREAM_CONSUMED;
+        tail = StreamAdvance(ring->rx, *StreamTail(ring->rx), head, NULL);
+        ECRING_FENCE();
+        *StreamTail(ring->rx) = tail;
+    } else if (ring->readOnly) {
+        *Release(ring->tx, where) = descriptor;
+    } else {
+        *Slot(ring->rx, where) = 0;
+    }
+    ring->stats.received++;
+    return ECRING_STATUS_SUCCESS;
+}
+
+/*
+ * Function: EcRingReceive
+ * -----------------------
+ * Copies the response with a given sequence out of the RX window and releases
+ * it. Does not wait, the caller polls as RXDB does.
+ *
+ * Parameters:
+ *   ECRING *ring           - The ring.
+ *   uint16_t sequence      - Sequence returned when the message was submitted.
+ *   void *buffer           - Receives the response.
+ *   uint16_t size          - Size of buffer, longer responses are truncated.
+ *   uint16_t *length       - Receives the length of the response.
+ *
+ * Returns:
+ *   int - ECRING_STATUS_SUCCESS on success, ECRING_STATUS_NOT_READY if the EC
+ *         has not responded yet, or an error code.
+ */
+ECRING_API
+int EcRingReceive(
+    ECRING *ring,
+    uint16_t sequence,
+    void *buffer,
+    uint16_t size,
+    uint16_t *length
+)
+{
+    const void *data;
+    int status;
+
+    status = EcRingPeek(ring, sequence, &data, length);
+    if (status != ECRING_STATUS_SUCCESS) {
+        return status;
+    }
+    memcpy(buffer, data, *length < size ? *length : size);
+    return EcRingRelease(ring, sequence);
+}
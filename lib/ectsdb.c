@@ -0,0 +1,1667 @@
+/*
+MIT License
+
+Copyright (c) 2025 Open Device Partnership
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#define _CRT_SECURE_NO_WARNINGS
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../inc/ectsdb.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Worst case sample is a 64-bit delta-of-delta plus a full XOR window
+#define ECTS_MAX_SAMPLE_BITS    (4 + 64 + 2 + 12 + 64)
+#define ECTS_BLOCK_MAX_BYTES    ((ECTS_BLOCK_MAX_SAMPLES * ECTS_MAX_SAMPLE_BITS + 7) / 8)
+#define ECTS_ALIGN8(x)          (((x) + 7) & ~(size_t)7)
+#define ECTS_NO_WINDOW          0xFF
+
+typedef struct {
+    int64_t window;
+    uint32_t first;         // Series ID of the min field, the others follow
+    uint32_t count;         // Samples in the current window, 0 before the first
+    int64_t start;
+    int64_t min;
+    int64_t max;
+    int64_t sum;
+    int64_t last;
+} ECTS_ROLLUP_STATE;
+
+typedef struct {
+    uint32_t id;
+    uint16_t kind;
+    char name[ECTS_MAX_NAME_LEN];
+    uint32_t rollup_count;
+    ECTS_ROLLUP_STATE rollups[ECTS_MAX_ROLLUPS];
+    ECTS_BLOCK_HEADER hdr;
+    uint64_t appended;      // Samples so far, prev_ts outlives the block it was in
+    int64_t prev_ts;
+    int64_t prev_delta;
+    int64_t prev_val;
+    uint8_t lead;
+    uint8_t trail;
+    uint8_t bits[ECTS_BLOCK_MAX_BYTES];
+} ECTS_SERIES_STATE;
+
+struct _ECTS_WRITER {
+    FILE *file;
+    uint64_t offset;
+    uint32_t series_count;
+    ECTS_SERIES_STATE *series[ECTS_MAX_SERIES];
+    ECTS_INDEX_ENTRY group;
+    uint32_t entry_count;
+    uint32_t entry_capacity;
+    ECTS_INDEX_ENTRY *entries;
+};
+
+struct _ECTS_READER {
+    const uint8_t *base;
+    size_t size;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#endif
+    uint16_t version;
+    uint32_t series_count;
+    ECTS_SERIES_INFO series[ECTS_MAX_SERIES];
+    int walked;
+    uint32_t block_count;
+    uint32_t block_capacity;
+    const ECTS_BLOCK_HEADER **blocks;
+    uint32_t entry_count;
+    const ECTS_INDEX_ENTRY *entries;
+    int64_t *min_after;     // Smallest t_min of entry i and every entry after it
+};
+
+typedef struct {
+    const uint8_t *data;
+    uint32_t pos;
+    uint32_t end;
+} ECTS_BIT_READER;
+
+static uint32_t CountLeadingZeros(uint64_t x)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse64(&index, x);
+    return 63 - index;
+#else
+    return (uint32_t)__builtin_clzll(x);
+#endif
+}
+
+static uint32_t CountTrailingZeros(uint64_t x)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, x);
+    return index;
+#else
+    return (uint32_t)__builtin_ctzll(x);
+#endif
+}
+
+static int64_t SignExtend(uint64_t value, uint32_t bits)
+{
+    uint64_t sign = 1ull << (bits - 1);
+    value &= (bits == 64) ? ~0ull : ((1ull << bits) - 1);
+    return (int64_t)((value ^ sign) - sign);
+}
+
+static void PutBits(uint8_t *buf, uint32_t *pos, uint64_t value, uint32_t n)
+{
+    while (n > 0) {
+        uint32_t room = 8 - (*pos & 7);
+        uint32_t take = n < room ? n : room;
+        uint8_t chunk = (uint8_t)((value >> (n - take)) & ((1u << take) - 1));
+        buf[*pos >> 3] |= (uint8_t)(chunk << (room - take));
+        *pos += take;
+        n -= take;
+    }
+}
+
+static int GetBits(ECTS_BIT_READER *br, uint32_t n, uint64_t *out)
+{
+    uint64_t value = 0;
+
+    if (br->end - br->pos < n) {
+        return ECTS_STATUS_BAD_FORMAT;
+    }
+
+    while (n > 0) {
+        uint32_t avail = 8 - (br->pos & 7);
+        uint32_t take = n < avail ? n : avail;
+        uint8_t byte = br->data[br->pos >> 3];
+        value = (value << take) | ((byte >> (avail - take)) & ((1u << take) - 1));
+        br->pos += take;
+        n -= take;
+    }
+
+    *out = value;
+    return ECTS_STATUS_SUCCESS;
+}
+
+static int FitsSigned(int64_t value, uint32_t bits)
+{
+    int64_t limit = (int64_t)1 << (bits - 1);
+    return value >= -limit && value < limit;
+}
+
+/*
+ * Function: EncodeTimestamp
+ * -------------------------
+ * Appends the delta-of-delta of a timestamp using variable size buckets. Timestamps
+ * are in 100ns units so the smallest bucket covers jitter of about +/-0.8ms.
+ */
+static void EncodeTimestamp(ECTS_SERIES_STATE *s, int64_t dod)
+{
+    uint32_t *pos = &s->hdr.bit_count;
+
+    if (dod == 0) {
+        PutBits(s->bits, pos, 0x0, 1);
+    } else if (FitsSigned(dod, 14)) {
+        PutBits(s->bits, pos, 0x2, 2);
+        PutBits(s->bits, pos, (uint64_t)dod, 14);
+    } else if (FitsSigned(dod, 20)) {
+        PutBits(s->bits, pos, 0x6, 3);
+        PutBits(s->bits, pos, (uint64_t)dod, 20);
+    } else if (FitsSigned(dod, 32)) {
+        PutBits(s->bits, pos, 0xE, 4);
+        PutBits(s->bits, pos, (uint64_t)dod, 32);
+    } else {
+        PutBits(s->bits, pos, 0xF, 4);
+        PutBits(s->bits, pos, (uint64_t)dod, 64);
+    }
+}
+
+/*
+ * Function: EncodeValue
+ * ---------------------
+ * Appends the XOR of a value against the previous one. Unchanged values cost one bit,
+ * values whose XOR fits in the previous leading/trailing zero window reuse it.
+ */
+static void EncodeValue(ECTS_SERIES_STATE *s, int64_t value)
+{
+    uint32_t *pos = &s->hdr.bit_count;
+    uint64_t x = (uint64_t)value ^ (uint64_t)s->prev_val;
+
+    if (x == 0) {
+        PutBits(s->bits, pos, 0x0, 1);
+        return;
+    }
+
+    uint32_t lead = CountLeadingZeros(x);
+    uint32_t trail = CountTrailingZeros(x);
+
+    if (s->lead != ECTS_NO_WINDOW && lead >= s->lead && trail >= s->trail) {
+        uint32_t len = 64 - s->lead - s->trail;
+        PutBits(s->bits, pos, 0x2, 2);
+        PutBits(s->bits, pos, x >> s->trail, len);
+    } else {
+        uint32_t len = 64 - lead - trail;
+        PutBits(s->bits, pos, 0x3, 2);
+        PutBits(s->bits, pos, lead, 6);
+        PutBits(s->bits, pos, len - 1, 6);
+        PutBits(s->bits, pos, x >> trail, len);
+        s->lead = (uint8_t)lead;
+        s->trail = (uint8_t)trail;
+    }
+}
+
+static int WriteChunk(ECTS_WRITER *writer, uint32_t type, const void *a, size_t a_len, const void *b, size_t b_len)
+{
+    static const uint8_t pad[8] = {0};
+    FILE *file = writer->file;
+    ECTS_CHUNK_HEADER chunk;
+    size_t len = ECTS_ALIGN8(a_len + b_len);
+
+    chunk.type = type;
+    chunk.length = (uint32_t)len;
+
+    if (fwrite(&chunk, sizeof(chunk), 1, file) != 1 ||
+        fwrite(a, 1, a_len, file) != a_len ||
+        (b_len && fwrite(b, 1, b_len, file) != b_len) ||
+        (len != a_len + b_len && fwrite(pad, 1, len - a_len - b_len, file) != len - a_len - b_len)) {
+        return ECTS_STATUS_IO_ERROR;
+    }
+
+    writer->offset += sizeof(chunk) + len;
+    return ECTS_STATUS_SUCCESS;
+}
+
+/*
+ * Function: CloseIndexEntry
+ * -------------------------
+ * Moves the index entry being built into the index. The entry t_max is raised to the
+ * previous entry's t_max if needed so readers can binary search on it.
+ */
+static int CloseIndexEntry(ECTS_WRITER *writer)
+{
+    ECTS_INDEX_ENTRY *group = &writer->group;
+
+    if (group->block_count == 0) {
+        return ECTS_STATUS_SUCCESS;
+    }
+
+    if (writer->entry_count == writer->entry_capacity) {
+        uint32_t capacity = writer->entry_capacity ? writer->entry_capacity * 2 : 64;
+        ECTS_INDEX_ENTRY *entries = (ECTS_INDEX_ENTRY *)realloc(writer->entries, capacity * sizeof(*entries));
+        if (entries == NULL) {
+            return ECTS_STATUS_NO_MEMORY;
+        }
+        writer->entries = entries;
+        writer->entry_capacity = capacity;
+    }
+
+    if (writer->entry_count > 0 && group->t_max < writer->entries[writer->entry_count - 1].t_max) {
+        group->t_max = writer->entries[writer->entry_count - 1].t_max;
+    }
+
+    writer->entries[writer->entry_count++] = *group;
+    memset(group, 0, sizeof(*group));
+    return ECTS_STATUS_SUCCESS;
+}
+
+static int IndexBlock(ECTS_WRITER *writer, const ECTS_BLOCK_HEADER *block, uint64_t offset)
+{
+    ECTS_INDEX_ENTRY *group = &writer->group;
+
+    if (group->block_count == 0) {
+        group->offset = offset;
+        group->t_min = block->t_first;
+        group->t_max = block->t_last;
+    } else {
+        if (block->t_first < group->t_min) group->t_min = block->t_first;
+        if (block->t_last > group->t_max) group->t_max = block->t_last;
+    }
+
+    group->length = (uint32_t)(writer->offset - group->offset);
+    group->block_count++;
+    group->event_mask |= block->event_mask;
+    group->series_mask[block->series >> 3] |= (uint8_t)(1u << (block->series & 7));
+
+    if (group->block_count >= ECTS_INDEX_BLOCKS || group->length >= ECTS_INDEX_BYTES) {
+        return CloseIndexEntry(writer);
+    }
+
+    return ECTS_STATUS_SUCCESS;
+}
+
+/*
+ * Function: WriteIndex
+ * --------------------
+ * Writes the INDX chunk with all index entries and a copy of the series table,
+ * followed by the TAIL chunk that lets readers find it from the end of the file.
+ */
+static int WriteIndex(ECTS_WRITER *writer)
+{
+    ECTS_INDEX_HEADER *header;
+    ECTS_TAIL tail;
+    size_t len = sizeof(*header) + writer->entry_count * sizeof(ECTS_INDEX_ENTRY);
+    uint8_t *body, *pos;
+    uint32_t i;
+
+    for (i = 0; i < writer->series_count; i++) {
+        len += ECTS_ALIGN8(sizeof(ECTS_SERIES_RECORD) + strlen(writer->series[i]->name));
+    }
+
+    body = (uint8_t *)calloc(1, len);
+    if (body == NULL) {
+        return ECTS_STATUS_NO_MEMORY;
+    }
+
+    header = (ECTS_INDEX_HEADER *)body;
+    header->entry_count = writer->entry_count;
+    header->series_count = writer->series_count;
+    pos = (uint8_t *)(header + 1);
+
+    if (writer->entry_count > 0) {
+        memcpy(pos, writer->entries, writer->entry_count * sizeof(ECTS_INDEX_ENTRY));
+        pos += writer->entry_count * sizeof(ECTS_INDEX_ENTRY);
+    }
+
+    for (i = 0; i < writer->series_count; i++) {
+        ECTS_SERIES_RECORD *record = (ECTS_SERIES_RECORD *)pos;
+        record->id = writer->series[i]->id;
+        record->kind = writer->series[i]->kind;
+        record->name_len = (uint16_t)strlen(writer->series[i]->name);
+        memcpy(record + 1, writer->series[i]->name, record->name_len);
+        pos += ECTS_ALIGN8(sizeof(*record) + record->name_len);
+    }
+
+    tail.index_offset = writer->offset;
+
+    int status = WriteChunk(writer, ECTS_CHUNK_INDEX, body, len, NULL, 0);
+    if (status == ECTS_STATUS_SUCCESS) {
+        status = WriteChunk(writer, ECTS_CHUNK_TAIL, &tail, sizeof(tail), NULL, 0);
+    }
+
+    free(body);
+    return status;
+}
+
+static int FlushSeries(ECTS_WRITER *writer, ECTS_SERIES_STATE *s)
+{
+    int status = ECTS_STATUS_SUCCESS;
+
+    if (s->hdr.count > 0) {
+        uint64_t offset = writer->offset;
+        status = WriteChunk(writer, ECTS_CHUNK_BLOCK,
+                            &s->hdr, sizeof(s->hdr),
+                            s->bits, (s->hdr.bit_count + 7) / 8);
+        if (status == ECTS_STATUS_SUCCESS) {
+            status = IndexBlock(writer, &s->hdr, offset);
+        }
+    }
+
+    // Start a fresh block, the first sample of each block is stored in the header
+    memset(&s->hdr, 0, sizeof(s->hdr));
+    memset(s->bits, 0, sizeof(s->bits));
+    s->hdr.series = s->id;
+    s->lead = ECTS_NO_WINDOW;
+    s->trail = 0;
+    s->prev_delta = 0;
+
+    return status;
+}
+
+/*
+ * Function: EctsWriterOpen
+ * ------------------------
+ * Creates a new capture file and writes the file header.
+ *
+ * Parameters:
+ *   const char *path       - Path of the capture file to create.
+ *   int64_t created        - Creation timestamp recorded in the header.
+ *   ECTS_WRITER **writer   - Receives the writer handle.
+ *
+ * Returns:
+ *   int - ECTS_STATUS_SUCCESS on success, or an error code on failure.
+ */
+ECTS_API
+int EctsWriterOpen(
+    const char *path,
+    int64_t created,
+    ECTS_WRITER **writer
+)
+{
+    ECTS_FILE_HEADER header;
+
+    if (path == NULL || writer == NULL) {
+        return ECTS_STATUS_INVALID_PARAMETER;
+    }
+
+    ECTS_WRITER *w = (ECTS_WRITER *)calloc(1, sizeof(ECTS_WRITER));
+    if (w == NULL) {
+        return ECTS_STATUS_NO_MEMORY;
+    }
+
+    w->file = fopen(path, "wb");
+    if (w->file == NULL) {
+        free(w);
+        return ECTS_STATUS_IO_ERROR;
+    }
+
+    header.magic = ECTS_MAGIC;
+    header.version = ECTS_VERSION;
+    header.header_size = sizeof(header);
+    header.created = created;
+
+    if (fwrite(&header, sizeof(header), 1, w->file) != 1) {
+        fclose(w->file);
+        free(w);
+        return ECTS_STATUS_IO_ERROR;
+    }
+
+    w->offset = sizeof(header);
+
+    *writer = w;
+    return ECTS_STATUS_SUCCESS;
+}
+
+/*
+ * Function: EctsDefineSeries
+ * --------------------------
+ * Registers a new series in the capture and writes its definition chunk.
+ *
+ * Parameters:
+ *   ECTS_WRITER *writer  - Writer returned by EctsWriterOpen.
+ *   const char *name     - Name of the series, usually the ACPI method path.
+ *   uint16_t kind        - ECTS_SERIES_SAMPLE, ECTS_SERIES_EVENT or ECTS_SERIES_ROLLUP.
+ *   uint32_t *series     - Receives the series ID used with EctsAppend.
+ *
+ * Returns:
+ *   int - ECTS_STATUS_SUCCESS on success, or an error code on failure.
+ */
+ECTS_API
+int EctsDefineSeries(
+    ECTS_WRITER *writer,
+    const char *name,
+    uint16_t kind,
+    uint32_t *series
+)
+{
+    ECTS_SERIES_RECORD record;
+    size_t name_len;
+
+    if (writer == NULL || name == NULL || series == NULL) {
+        return ECTS_STATUS_INVALID_PARAMETER;
+    }
+
+    name_len = strlen(name);
+    if (name_len == 0 || name_len >= ECTS_MAX_NAME_LEN || writer->series_count >= ECTS_MAX_SERIES) {
+        return ECTS_STATUS_INVALID_PARAMETER;
+    }
+
+    ECTS_SERIES_STATE *s = (ECTS_SERIES_STATE *)calloc(1, sizeof(ECTS_SERIES_STATE));
+    if (s == NULL) {
+        return ECTS_STATUS_NO_MEMORY;
+    }
+
+    s->id = writer->series_count;
+    s->kind = kind;
+    memcpy(s->name, name, name_len + 1);
+    s->hdr.series = s->id;
+    s->lead = ECTS_NO_WINDOW;
+
+    record.id = s->id;
+    record.kind = kind;
+    record.name_len = (uint16_t)name_len;
+
+    int status = WriteChunk(writer, ECTS_CHUNK_SERIES, &record, sizeof(record), name, name_len);
+    if (status != ECTS_STATUS_SUCCESS) {
+        free(s);
+        return status;
+    }
+
+    writer->series[writer->series_count++] = s;
+    *series = s->id;
+    return ECTS_STATUS_SUCCESS;
+}
+
+/*
+ * Function: EctsDefineRollup
+ * --------------------------
+ * Attaches a streaming rollup to a sample series. Four rollup series named
+ * "<series>/<label>.min", ".max", ".avg" and ".last" are defined with consecutive
+ * IDs and receive one sample per window, stamped with the window start. Windows
+ * are aligned to multiples of the window length.
+ *
+ * Parameters:
+ *   ECTS_WRITER *writer  - Writer returned by EctsWriterOpen.
+ *   uint32_t series      - Sample series to aggregate.
+ *   int64_t window       - Window length in timestamp units.
+ *   const char *label    - Window label used in the rollup series names, e.g. "1s".
+ *   uint32_t *first      - Receives the ID of the min series, the others follow in
+ *                          ECTS_ROLLUP_* order. May be NULL.
+ *
+ * Returns:
+ *   int - ECTS_STATUS_SUCCESS on success, or an error code on failure.
+ */
+ECTS_API
+int EctsDefineRollup(
+    ECTS_WRITER *writer,
+    uint32_t series,
+    int64_t window,
+    const char *label,
+    uint32_t *first
+)
+{
+    static const char *fields[ECTS_ROLLUP_FIELDS] = { "min", "max", "avg", "last" };
+    char name[ECTS_MAX_NAME_LEN];
+    uint32_t id;
+
+    if (writer == NULL || series >= writer->series_count || window <= 0 || label == NULL) {
+        return ECTS_STATUS_INVALID_PARAMETER;
+    }
+
+    ECTS_SERIES_STATE *s = writer->series[series];
+    if (s->kind != ECTS_SERIES_SAMPLE || s->rollup_count >= ECTS_MAX_ROLLUPS ||
+        writer->series_count + ECTS_ROLLUP_FIELDS > ECTS_MAX_SERIES) {
+        return ECTS_STATUS_INVALID_PARAMETER;
+    }
+
+    ECTS_ROLLUP_STATE *rollup = &s->rollups[s->rollup_count];
+    memset(rollup, 0, sizeof(*rollup));
+    rollup->window = window;
+
+    for (uint32_t i = 0; i < ECTS_ROLLUP_FIELDS; i++) {
+        int len = snprintf(name, sizeof(name), "%s/%s.%s", s->name, label, fields[i]);
+        if (len < 0 || (size_t)len >= sizeof(name)) {
+            return ECTS_STATUS_INVALID_PARAMETER;
+        }
+
+        int status = EctsDefineSeries(writer, name, ECTS_SERIES_ROLLUP, &id);
+        if (status != ECTS_STATUS_SUCCESS) {
+            return status;
+        }
+
+        if (i == 0) {
+            rollup->first = id;
+        }
+    }
+
+    s->rollup_count++;
+    if (first != NULL) {
+        *first = rollup->first;
+    }
+    return ECTS_STATUS_SUCCESS;
+}
+
+/*
+ * Function: EmitRollup
+ * --------------------
+ * Appends the aggregates of the current window to the rollup series.
+ */
+static int EmitRollup(ECTS_WRITER *writer, const ECTS_ROLLUP_STATE *rollup)
+{
+    const int64_t values[ECTS_ROLLUP_FIELDS] = {
+        rollup->min, rollup->max, rollup->sum / (int64_t)rollup->count, rollup->last
+    };
+
+    for (uint32_t i = 0; i < ECTS_ROLLUP_FIELDS; i++) {
+        int status = EctsAppend(writer, rollup->first + i, rollup->start, values[i]);
+        if (status != ECTS_STATUS_SUCCESS) {
+            return status;
+        }
+    }
+
+    return ECTS_STATUS_SUCCESS;
+}
+
+/*
+ * Function: UpdateRollups
+ * -----------------------
+ * Feeds a sample into every rollup of a series, emitting a window when the sample
+ * falls past its end. Only the running min/max/sum/last are kept per window.
+ */
+static int UpdateRollups(ECTS_WRITER *writer, ECTS_SERIES_STATE *s, int64_t timestamp, int64_t value)
+{
+    for (uint32_t i = 0; i < s->rollup_count; i++) {
+        ECTS_ROLLUP_STATE *rollup = &s->rollups[i];
+        int64_t start = timestamp - timestamp % rollup->window;
+        if (timestamp % rollup->window < 0) {
+            start -= rollup->window;
+        }
+
+        if (rollup->count > 0 && start != rollup->start) {
+            int status = EmitRollup(writer, rollup);
+            if (status != ECTS_STATUS_SUCCESS) {
+                return status;
+            }
+            rollup->count = 0;
+        }
+
+        if (rollup->count == 0) {
+            rollup->start = start;
+            rollup->min = value;
+            rollup->max = value;
+            rollup->sum = 0;
+        }
+
+        if (value < rollup->min) rollup->min = value;
+        if (value > rollup->max) rollup->max = value;
+        rollup->sum += value;
+        rollup->last = value;
+        rollup->count++;
+    }
+
+    return ECTS_STATUS_SUCCESS;
+}
+
+/*
+ * Function: EctsAppend
+ * --------------------
+ * Appends a sample to a series. Samples of a series must be appended in timestamp
+ * order. Full blocks are written out automatically.
+ *
+ * Parameters:
+ *   ECTS_WRITER *writer  - Writer returned by EctsWriterOpen.
+ *   uint32_t series      - Series ID returned by EctsDefineSeries.
+ *   int64_t timestamp    - Sample time in 100ns units.
+ *   int64_t value        - Sample value.
+ *
+ * Returns:
+ *   int - ECTS_STATUS_SUCCESS on success, or an error code on failure.
+ */
+ECTS_API
+int EctsAppend(
+    ECTS_WRITER *writer,
+    uint32_t series,
+    int64_t timestamp,
+    int64_t value
+)
+{
+    if (writer == NULL || series >= writer->series_count) {
+        return ECTS_STATUS_INVALID_PARAMETER;
+    }
+
+    ECTS_SERIES_STATE *s = writer->series[series];
+    ECTS_BLOCK_HEADER *hdr = &s->hdr;
+
+    // Also across a flush, blocks of a series must not overlap
+    if (s->appended > 0 && timestamp < s->prev_ts) {
+        return ECTS_STATUS_INVALID_PARAMETER;
+    }
+
+    if (hdr->count == 0) {
+        hdr->t_first = timestamp;
+        hdr->v_first = value;
+        hdr->v_min = value;
+        hdr->v_max = value;
+    } else {
+        int64_t delta = timestamp - s->prev_ts;
+        EncodeTimestamp(s, delta - s->prev_delta);
+        EncodeValue(s, value);
+        s->prev_delta = delta;
+
+        if (value < hdr->v_min) hdr->v_min = value;
+        if (value > hdr->v_max) hdr->v_max = value;
+    }
+
+    if (s->kind == ECTS_SERIES_EVENT) {
+        hdr->event_mask |= ECTS_EVENT_BIT(value);
+    }
+
+    hdr->t_last = timestamp;
+    hdr->v_sum += value;
+    hdr->count++;
+    s->appended++;
+    s->prev_ts = timestamp;
+    s->prev_val = value;
+
+    if (hdr->count == ECTS_BLOCK_MAX_SAMPLES) {
+        int status = FlushSeries(writer, s);
+        if (status != ECTS_STATUS_SUCCESS) {
+            return status;
+        }
+    }
+
+    return UpdateRollups(writer, s, timestamp, value);
+}
+
+/*
+ * Function: EctsFlush
+ * -------------------
+ * Writes out all partially filled blocks so the data is visible to readers.
+ *
+ * Parameters:
+ *   ECTS_WRITER *writer  - Writer returned by EctsWriterOpen.
+ *
+ * Returns:
+ *   int - ECTS_STATUS_SUCCESS on success, or an error code on failure.
+ */
+ECTS_API
+int EctsFlush(
+    ECTS_WRITER *writer
+)
+{
+    int status = ECTS_STATUS_SUCCESS;
+
+    if (writer == NULL) {
+        return ECTS_STATUS_INVALID_PARAMETER;
+    }
+
+    for (uint32_t i = 0; i < writer->series_count; i++) {
+        int ret = FlushSeries(writer, writer->series[i]);
+        if (ret != ECTS_STATUS_SUCCESS) {
+            status = ret;
+        }
+    }
+
+    if (fflush(writer->file) != 0) {
+        status = ECTS_STATUS_IO_ERROR;
+    }
+
+    return status;
+}
+
+/*
+ * Function: EctsWriterClose
+ * -------------------------
+ * Emits the partial rollup windows, flushes any pending samples, writes the index
+ * footer, closes the capture file and frees the writer.
+ *
+ * Parameters:
+ *   ECTS_WRITER *writer  - Writer returned by EctsWriterOpen.
+ *
+ * Returns:
+ *   int - ECTS_STATUS_SUCCESS on success, or an error code on failure.
+ */
+ECTS_API
+int EctsWriterClose(
+    ECTS_WRITER *writer
+)
+{
+    if (writer == NULL) {
+        return ECTS_STATUS_INVALID_PARAMETER;
+    }
+
+    int status = ECTS_STATUS_SUCCESS;
+
+    for (uint32_t i = 0; i < writer->series_count && status == ECTS_STATUS_SUCCESS; i++) {
+        ECTS_SERIES_STATE *s = writer->series[i];
+        for (uint32_t j = 0; j < s->rollup_count && status == ECTS_STATUS_SUCCESS; j++) {
+            if (s->rollups[j].count > 0) {
+                status = EmitRollup(writer, &s->rollups[j]);
+            }
+        }
+    }
+
+    if (status == ECTS_STATUS_SUCCESS) {
+        status = EctsFlush(writer);
+    }
+
+    if (status == ECTS_STATUS_SUCCESS) {
+        status = CloseIndexEntry(writer);
+    }
+
+    if (status == ECTS_STATUS_SUCCESS) {
+        status = WriteIndex(writer);
+    }
+
+    if (fclose(writer->file) != 0) {
+        status = ECTS_STATUS_IO_ERROR;
+    }
+
+    for (uint32_t i = 0; i < writer->series_count; i++) {
+        free(writer->series[i]);
+    }
+    free(writer->entries);
+    free(writer);
+
+    return status;
+}
+
+static int MapFile(ECTS_READER *r, const char *path)
+{
+#ifdef _WIN32
+    LARGE_INTEGER size;
+
+    r->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (r->file == INVALID_HANDLE_VALUE) {
+        return ECTS_STATUS_IO_ERROR;
+    }
+
+    if (!GetFileSizeEx(r->file, &size) || size.QuadPart < (LONGLONG)sizeof(ECTS_FILE_HEADER)) {
+        return ECTS_STATUS_BAD_FORMAT;
+    }
+
+    r->mapping = CreateFileMappingA(r->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (r->mapping == NULL) {
+        return ECTS_STATUS_IO_ERROR;
+    }
+
+    r->base = (const uint8_t *)MapViewOfFile(r->mapping, FILE_MAP_READ, 0, 0, 0);
+    r->size = (size_t)size.QuadPart;
+#else
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return ECTS_STATUS_IO_ERROR;
+    }
+
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(ECTS_FILE_HEADER)) {
+        close(fd);
+        return ECTS_STATUS_BAD_FORMAT;
+    }
+
+    void *base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    r->base = (base == MAP_FAILED) ? NULL : (const uint8_t *)base;
+    r->size = (size_t)st.st_size;
+#endif
+
+    return (r->base != NULL) ? ECTS_STATUS_SUCCESS : ECTS_STATUS_IO_ERROR;
+}
+
+static int AddBlock(ECTS_READER *r, const ECTS_BLOCK_HEADER *block)
+{
+    if (r->block_count == r->block_capacity) {
+        uint32_t capacity = r->block_capacity ? r->block_capacity * 2 : 64;
+        const ECTS_BLOCK_HEADER **blocks = (const ECTS_BLOCK_HEADER **)realloc((void *)r->blocks, capacity * sizeof(*blocks));
+        if (blocks == NULL) {
+            return ECTS_STATUS_NO_MEMORY;
+        }
+        r->blocks = blocks;
+        r->block_capacity = capacity;
+    }
+
+    r->blocks[r->block_count++] = block;
+    return ECTS_STATUS_SUCCESS;
+}
+
+static int ParseChunks(ECTS_READER *r)
+{
+    const ECTS_FILE_HEADER *header = (const ECTS_FILE_HEADER *)r->base;
+    size_t offset;
+
+    // Only chunk headers are touched here, block payloads stay unmapped until scanned
+    r->walked = 1;
+    offset = header->header_size;
+    while (offset + sizeof(ECTS_CHUNK_HEADER) <= r->size) {
+        const ECTS_CHUNK_HEADER *chunk = (const ECTS_CHUNK_HEADER *)(r->base + offset);
+        const uint8_t *body = (const uint8_t *)(chunk + 1);
+
+        if (chunk->length > r->size - offset - sizeof(*chunk)) {
+            // Truncated tail from an interrupted capture
+            break;
+        }
+
+        if (chunk->type == ECTS_CHUNK_SERIES && chunk->length >= sizeof(ECTS_SERIES_RECORD)) {
+            const ECTS_SERIES_RECORD *record = (const ECTS_SERIES_RECORD *)body;
+            if (record->id > r->series_count || record->id >= ECTS_MAX_SERIES || record->name_len >= ECTS_MAX_NAME_LEN ||
+                sizeof(*record) + record->name_len > chunk->length) {
+                return ECTS_STATUS_BAD_FORMAT;
+            }
+
+            // Series already loaded from the index footer are skipped
+            if (record->id == r->series_count) {
+                ECTS_SERIES_INFO *info = &r->series[r->series_count++];
+                info->id = record->id;
+                info->kind = record->kind;
+                memcpy(info->name, record + 1, record->name_len);
+                info->name[record->name_len] = '\0';
+            }
+        } else if (chunk->type == ECTS_CHUNK_BLOCK && chunk->length >= sizeof(ECTS_BLOCK_HEADER)) {
+            const ECTS_BLOCK_HEADER *block = (const ECTS_BLOCK_HEADER *)body;
+            if (block->series >= r->series_count || block->count == 0 || block->count > ECTS_BLOCK_MAX_SAMPLES ||
+                sizeof(*block) + (block->bit_count + 7) / 8 > chunk->length) {
+                return ECTS_STATUS_BAD_FORMAT;
+            }
+
+            int status = AddBlock(r, block);
+            if (status != ECTS_STATUS_SUCCESS) {
+                return status;
+            }
+        }
+
+        offset += sizeof(*chunk) + chunk->length;
+    }
+
+    return ECTS_STATUS_SUCCESS;
+}
+
+/*
+ * Function: LoadIndex
+ * -------------------
+ * Locates the index footer through the TAIL chunk at the end of the file and loads
+ * the series table from it. Only the footer pages are touched.
+ *
+ * Returns:
+ *   int - ECTS_STATUS_SUCCESS if an index was loaded, ECTS_STATUS_NOT_FOUND if the
+ *         capture has no footer, or ECTS_STATUS_BAD_FORMAT if it is corrupt.
+ */
+static int LoadIndex(ECTS_READER *r)
+{
+    const ECTS_FILE_HEADER *header = (const ECTS_FILE_HEADER *)r->base;
+    const size_t tail_len = sizeof(ECTS_CHUNK_HEADER) + sizeof(ECTS_TAIL);
+    const ECTS_CHUNK_HEADER *chunk;
+    const ECTS_INDEX_HEADER *index;
+    const uint8_t *pos, *end;
+
+    if (r->size < header->header_size + tail_len) {
+        return ECTS_STATUS_NOT_FOUND;
+    }
+
+    chunk = (const ECTS_CHUNK_HEADER *)(r->base + r->size - tail_len);
+    if (chunk->type != ECTS_CHUNK_TAIL || chunk->length != sizeof(ECTS_TAIL)) {
+        return ECTS_STATUS_NOT_FOUND;
+    }
+
+    uint64_t index_offset = ((const ECTS_TAIL *)(chunk + 1))->index_offset;
+    if (index_offset < header->header_size || index_offset + sizeof(ECTS_CHUNK_HEADER) + sizeof(ECTS_INDEX_HEADER) > r->size - tail_len) {
+        return ECTS_STATUS_BAD_FORMAT;
+    }
+
+    chunk = (const ECTS_CHUNK_HEADER *)(r->base + index_offset);
+    if (chunk->type != ECTS_CHUNK_INDEX || chunk->length < sizeof(ECTS_INDEX_HEADER) ||
+        chunk->length > r->size - tail_len - index_offset - sizeof(*chunk)) {
+        return ECTS_STATUS_BAD_FORMAT;
+    }
+
+    index = (const ECTS_INDEX_HEADER *)(chunk + 1);
+    end = (const uint8_t *)index + chunk->length;
+    if (index->series_count > ECTS_MAX_SERIES ||
+        (uint64_t)index->entry_count * sizeof(ECTS_INDEX_ENTRY) > (uint64_t)(end - (const uint8_t *)(index + 1))) {
+        return ECTS_STATUS_BAD_FORMAT;
+    }
+
+    r->entries = (const ECTS_INDEX_ENTRY *)(index + 1);
+    r->entry_count = index->entry_count;
+
+    for (uint32_t i = 0; i < r->entry_count; i++) {
+        if (r->entries[i].offset < header->header_size || r->entries[i].offset + r->entries[i].length > index_offset) {
+            return ECTS_STATUS_BAD_FORMAT;
+        }
+    }
+
+    pos = (const uint8_t *)(r->entries + r->entry_count);
+    for (uint32_t i = 0; i < index->series_count; i++) {
+        const ECTS_SERIES_RECORD *record = (const ECTS_SERIES_RECORD *)pos;
+        if ((size_t)(end - pos) < sizeof(*record) || record->id != i || record->name_len >= ECTS_MAX_NAME_LEN ||
+            (size_t)(end - pos) < sizeof(*record) + record->name_len) {
+            return ECTS_STATUS_BAD_FORMAT;
+        }
+
+        ECTS_SERIES_INFO *info = &r->series[r->series_count++];
+        info->id = record->id;
+        info->kind = record->kind;
+        memcpy(info->name, record + 1, record->name_len);
+        info->name[record->name_len] = '\0';
+        pos += ECTS_ALIGN8(sizeof(*record) + record->name_len);
+    }
+
+    // Entry t_min is not ordered, keep a suffix minimum to know when a scan can stop
+    if (r->entry_count > 0) {
+        r->min_after = (int64_t *)malloc(r->entry_count * sizeof(int64_t));
+        if (r->min_after == NULL) {
+            return ECTS_STATUS_NO_MEMORY;
+        }
+
+        int64_t min = INT64_MAX;
+        for (uint32_t i = r->entry_count; i-- > 0; ) {
+            if (r->entries[i].t_min < min) min = r->entries[i].t_min;
+            r->min_after[i] = min;
+        }
+    }
+
+    return ECTS_STATUS_SUCCESS;
+}
+
+static int EnsureBlocks(ECTS_READER *r)
+{
+    return r->walked ? ECTS_STATUS_SUCCESS : ParseChunks(r);
+}
+
+/*
+ * Function: EctsReaderOpen
+ * ------------------------
+ * Maps a capture file read-only and loads the series table. If the capture has an
+ * index footer only the footer is read, otherwise all chunk headers are walked.
+ *
+ * Parameters:
+ *   const char *path       - Path of the capture file.
+ *   ECTS_READER **reader   - Receives the reader handle.
+ *
+ * Returns:
+ *   int - ECTS_STATUS_SUCCESS on success, or an error code on failure.
+ */
+ECTS_API
+int EctsReaderOpen(
+    const char *path,
+    ECTS_READER **reader
+)
+{
+    if (path == NULL || reader == NULL) {
+        return ECTS_STATUS_INVALID_PARAMETER;
+    }
+
+    ECTS_READER *r = (ECTS_READER *)calloc(1, sizeof(ECTS_READER));
+    if (r == NULL) {
+        return ECTS_STATUS_NO_MEMORY;
+    }
+
+#ifdef _WIN32
+    r->file = INVALID_HANDLE_VALUE;
+#endif
+
+    int status = MapFile(r, path);
+    if (status == ECTS_STATUS_SUCCESS) {
+        const ECTS_FILE_HEADER *header = (const ECTS_FILE_HEADER *)r->base;
+        if (header->magic != ECTS_MAGIC || header->version < 1 || header->version > ECTS_VERSION ||
+            header->header_size < sizeof(*header) || header->header_size > r->size) {
+            status = ECTS_STATUS_BAD_FORMAT;
+        } else {
+            r->version = header->version;
+            status = LoadIndex(r);
+        }
+    }
+
+    // Captures that were not closed cleanly have no footer, walk all chunks instead
+    if (status == ECTS_STATUS_NOT_FOUND) {
+        status = ParseChunks(r);
+    }
+
+    if (status != ECTS_STATUS_SUCCESS) {
+        EctsReaderClose(r);
+        return status;
+    }
+
+    *reader = r;
+    return ECTS_STATUS_SUCCESS;
+}
+
+/*
+ * Function: EctsReaderClose
+ * -------------------------
+ * Unmaps the capture file and frees the reader.
+ *
+ * Parameters:
+ *   ECTS_READER *reader  - Reader returned by EctsReaderOpen.
+ *
+ * Returns:
+ *   VOID
+ */
+ECTS_API
+void EctsReaderClose(
+    ECTS_READER *reader
+)
+{
+    if (reader == NULL) {
+        return;
+    }
+
+#ifdef _WIN32
+    if (reader->base) UnmapViewOfFile(reader->base);
+    if (reader->mapping) CloseHandle(reader->mapping);
+    if (reader->file != INVALID_HANDLE_VALUE) CloseHandle(reader->file);
+#else
+    if (reader->base) munmap((void *)reader->base, reader->size);
+#endif
+
+    free((void *)reader->blocks);
+    free(reader->min_after);
+    free(reader);
+}
+
+ECTS_API
+uint32_t EctsSeriesCount(
+    const ECTS_READER *reader
+)
+{
+    return reader ? reader->series_count : 0;
+}
+
+ECTS_API
+int EctsSeriesInfo(
+    const ECTS_READER *reader,
+    uint32_t index,
+    ECTS_SERIES_INFO *info
+)
+{
+    if (reader == NULL || info == NULL || index >= reader->series_count) {
+        return ECTS_STATUS_INVALID_PARAMETER;
+    }
+
+    *info = reader->series[index];
+    return ECTS_STATUS_SUCCESS;
+}
+
+/*
+ * Function: EctsFindSeries
+ * ------------------------
+ * Looks up a series ID by name.
+ *
+ * Parameters:
+ *   const ECTS_READER *reader  - Reader returned by EctsReaderOpen.
+ *   const char *name           - Name of the series.
+ *   uint32_t *series           - Receives the series ID.
+ *
+ * Returns:
+ *   int - ECTS_STATUS_SUCCESS if found, ECTS_STATUS_NOT_FOUND otherwise.
+ */
+ECTS_API
+int EctsFindSeries(
+    const ECTS_READER *reader,
+    const char *name,
+    uint32_t *series
+)
+{
+    if (reader == NULL || name == NULL || series == NULL) {
+        return ECTS_STATUS_INVALID_PARAMETER;
+    }
+
+    for (uint32_t i = 0; i < reader->series_count; i++) {
+        if (strcmp(reader->series[i].name, name) == 0) {
+            *series = reader->series[i].id;
+            return ECTS_STATUS_SUCCESS;
+        }
+    }
+
+    return ECTS_STATUS_NOT_FOUND;
+}
+
+
+/*
+ * Function: EctsBlockCount
+ * ------------------------
+ * Returns the number of blocks in the capture. For indexed captures the first
+ * call walks the chunk headers to build the block directory.
+ *
+ * Parameters:
+ *   ECTS_READER *reader  - Reader returned by EctsReaderOpen.
+ *
+ * Returns:
+ *   uint32_t - Number of blocks.
+ */
+ECTS_API
+uint32_t EctsBlockCount(
+    ECTS_READER *reader
+)
+{
+    if (reader == NULL || EnsureBlocks(reader) != ECTS_STATUS_SUCCESS) {
+        return 0;
+    }
+
+    return reader->block_count;
+}
+
+/*
+ * Function: EctsBlockInfo
+ * -----------------------
+ * Returns the summary header of a block without decoding its samples.
+ *
+ * Parameters:
+ *   ECTS_READER *reader  - Reader returned by EctsReaderOpen.
+ *   uint32_t index       - Block index in file order.
+ *
+ * Returns:
+ *   const ECTS_BLOCK_HEADER * - Block summary, or NULL if index is out of range.
+ */
+ECTS_API
+const ECTS_BLOCK_HEADER *EctsBlockInfo(
+    ECTS_READER *reader,
+    uint32_t index
+)
+{
+    if (reader == NULL || EnsureBlocks(reader) != ECTS_STATUS_SUCCESS || index >= reader->block_count) {
+        return NULL;
+    }
+
+    return reader->blocks[index];
+}
+
+/*
+ * Function: DecodeBlock
+ * ---------------------
+ * Decompresses all samples of a block into the output arrays, which must hold at
+ * least block->count entries.
+ *
+ * Returns:
+ *   int - ECTS_STATUS_SUCCESS on success, or ECTS_STATUS_BAD_FORMAT if the payload
+ *         is corrupt.
+ */
+static int DecodeBlock(
+    const ECTS_BLOCK_HEADER *block,
+    int64_t *timestamps,
+    int64_t *values
+)
+{
+    ECTS_BIT_READER br;
+    uint64_t bits;
+    int64_t ts, delta = 0, val;
+    uint32_t lead = 0, len = 0;
+    int status = ECTS_STATUS_SUCCESS;
+
+    br.data = (const uint8_t *)(block + 1);
+    br.pos = 0;
+    br.end = block->bit_count;
+
+    ts = block->t_first;
+    val = block->v_first;
+    timestamps[0] = ts;
+    values[0] = val;
+
+    for (uint32_t i = 1; i < block->count && status == ECTS_STATUS_SUCCESS; i++) {
+        // Timestamp: count the prefix ones to pick the bucket size
+        uint32_t prefix = 0;
+        while (prefix < 4 && (status = GetBits(&br, 1, &bits)) == ECTS_STATUS_SUCCESS && bits) {
+            prefix++;
+        }
+        if (status != ECTS_STATUS_SUCCESS) {
+            break;
+        }
+
+        if (prefix > 0) {
+            static const uint32_t widths[] = { 0, 14, 20, 32, 64 };
+            status = GetBits(&br, widths[prefix], &bits);
+            delta += SignExtend(bits, widths[prefix]);
+        }
+        ts += delta;
+
+        // Value: '0' unchanged, '10' reuse window, '11' new window
+        status = (status == ECTS_STATUS_SUCCESS) ? GetBits(&br, 1, &bits) : status;
+        if (status == ECTS_STATUS_SUCCESS && bits) {
+            status = GetBits(&br, 1, &bits);
+            if (status == ECTS_STATUS_SUCCESS && bits) {
+                uint64_t l = 0, n = 0;
+                status = GetBits(&br, 6, &l);
+                status = (status == ECTS_STATUS_SUCCESS) ? GetBits(&br, 6, &n) : status;
+                lead = (uint32_t)l;
+                len = (uint32_t)n + 1;
+                if (lead + len > 64) {
+                    status = ECTS_STATUS_BAD_FORMAT;
+                }
+            } else if (status == ECTS_STATUS_SUCCESS && len == 0) {
+                status = ECTS_STATUS_BAD_FORMAT;
+            }
+
+            if (status == ECTS_STATUS_SUCCESS) {
+                status = GetBits(&br, len, &bits);
+                val = (int64_t)((uint64_t)val ^ (bits << (64 - lead - len)));
+            }
+        }
+
+        timestamps[i] = ts;
+        values[i] = val;
+    }
+
+    return status;
+}
+
+/*
+ * Function: EctsDecodeBlock
+ * -------------------------
+ * Decompresses all samples of a block.
+ *
+ * Parameters:
+ *   ECTS_READER *reader  - Reader returned by EctsReaderOpen.
+ *   uint32_t index       - Block index in file order.
+ *   int64_t *timestamps  - Output array of sample timestamps.
+ *   int64_t *values      - Output array of sample values.
+ *   uint32_t capacity    - Number of entries in each output array.
+ *   uint32_t *count      - Receives the number of decoded samples.
+ *
+ * Returns:
+ *   int - ECTS_STATUS_SUCCESS on success, or an error code on failure.
+ */
+ECTS_API
+int EctsDecodeBlock(
+    ECTS_READER *reader,
+    uint32_t index,
+    int64_t *timestamps,
+    int64_t *values,
+    uint32_t capacity,
+    uint32_t *count
+)
+{
+    if (reader == NULL || timestamps == NULL || values == NULL || count == NULL) {
+        return ECTS_STATUS_INVALID_PARAMETER;
+    }
+
+    int status = EnsureBlocks(reader);
+    if (status != ECTS_STATUS_SUCCESS) {
+        return status;
+    }
+
+    if (index >= reader->block_count) {
+        return ECTS_STATUS_INVALID_PARAMETER;
+    }
+
+    return EctsDecodeBlockData(reader->blocks[index], timestamps, values, capacity, count);
+}
+
+/*
+ * Function: ScanBlock
+ * -------------------
+ * Decodes one block and reports the samples inside [t_begin, t_end], optionally
+ * only those equal to event.
+ */
+static int ScanBlock(
+    const ECTS_BLOCK_HEADER *block,
+    const int64_t *event,
+    int64_t t_begin,
+    int64_t t_end,
+    ECTS_SCAN_CALLBACK callback,
+    void *ctx
+)
+{
+    int64_t timestamps[ECTS_BLOCK_MAX_SAMPLES];
+    int64_t values[ECTS_BLOCK_MAX_SAMPLES];
+
+    int status = DecodeBlock(block, timestamps, values);
+    if (status != ECTS_STATUS_SUCCESS) {
+        return status;
+    }
+
+    for (uint32_t j = 0; j < block->count; j++) {
+        if (timestamps[j] >= t_begin && timestamps[j] <= t_end && (event == NULL || values[j] == *event)) {
+            callback(ctx, block->series, timestamps[j], values[j]);
+        }
+    }
+
+    return ECTS_STATUS_SUCCESS;
+}
+
+/*
+ * Function: VisitRange
+ * --------------------
+ * Common block walk used by the scans and EctsScanBlocks. With an index the first
+ * entry that can overlap t_begin is found by binary search and entries are skipped
+ * on their time range, series mask and event mask; only the chunks of the remaining
+ * entries are touched. Without an index the block directory is filtered instead.
+ * The visitor gets every block of the series overlapping [t_begin, t_end].
+ */
+static int VisitRange(
+    const ECTS_READER *r,
+    uint32_t series,
+    const int64_t *event,
+    int64_t t_begin,
+    int64_t t_end,
+    ECTS_BLOCK_CALLBACK visit,
+    void *ctx
+)
+{
+    uint32_t event_mask = event ? ECTS_EVENT_BIT(*event) : 0;
+
+    if (r->entries == NULL) {
+        for (uint32_t i = 0; i < r->block_count; i++) {
+            const ECTS_BLOCK_HEADER *block = r->blocks[i];
+            if (block->series != series || block->t_last < t_begin || block->t_first > t_end ||
+                (event && r->version >= 2 && !(block->event_mask & event_mask))) {
+                continue;
+            }
+
+            int status = visit(ctx, block);
+            if (status != ECTS_STATUS_SUCCESS) {
+                return status;
+            }
+        }
+
+        return ECTS_STATUS_SUCCESS;
+    }
+
+    // Entry t_max never decreases, find the first entry that reaches t_begin
+    uint32_t lo = 0, hi = r->entry_count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (r->entries[mid].t_max < t_begin) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    for (uint32_t i = lo; i < r->entry_count && r->min_after[i] <= t_end; i++) {
+        const ECTS_INDEX_ENTRY *entry = &r->entries[i];
+        if (entry->t_min > t_end || !(entry->series_mask[series / 8] & (1u << (series % 8))) ||
+            (event && !(entry->event_mask & event_mask))) {
+            continue;
+        }
+
+        size_t offset = (size_t)entry->offset;
+        size_t end = offset + entry->length;
+        while (offset + sizeof(ECTS_CHUNK_HEADER) <= end) {
+            const ECTS_CHUNK_HEADER *chunk = (const ECTS_CHUNK_HEADER *)(r->base + offset);
+            const ECTS_BLOCK_HEADER *block = (const ECTS_BLOCK_HEADER *)(chunk + 1);
+
+            if (chunk->length > end - offset - sizeof(*chunk)) {
+                return ECTS_STATUS_BAD_FORMAT;
+            }
+            offset += sizeof(*chunk) + chunk->length;
+
+            if (chunk->type != ECTS_CHUNK_BLOCK) {
+                continue;
+            }
+
+            if (chunk->length < sizeof(*block) || block->count == 0 || block->count > ECTS_BLOCK_MAX_SAMPLES ||
+                sizeof(*block) + (block->bit_count + 7) / 8 > chunk->length) {
+                return ECTS_STATUS_BAD_FORMAT;
+            }
+
+            if (block->series != series || block->t_last < t_begin || block->t_first > t_end ||
+                (event && !(block->event_mask & event_mask))) {
+                continue;
+            }
+
+            int status = visit(ctx, block);
+            if (status != ECTS_STATUS_SUCCESS) {
+                return status;
+            }
+        }
+    }
+
+    return ECTS_STATUS_SUCCESS;
+}
+
+typedef struct {
+    const int64_t *event;
+    int64_t t_begin;
+    int64_t t_end;
+    ECTS_SCAN_CALLBACK callback;
+    void *ctx;
+} ECTS_SCAN_CONTEXT;
+
+static int ScanVisit(void *ctx, const ECTS_BLOCK_HEADER *block)
+{
+    const ECTS_SCAN_CONTEXT *scan = (const ECTS_SCAN_CONTEXT *)ctx;
+    return ScanBlock(block, scan->event, scan->t_begin, scan->t_end, scan->callback, scan->ctx);
+}
+
+/*
+ * Function: ScanRange
+ * -------------------
+ * Common scan used by EctsScan and EctsScanEvent, decodes the blocks VisitRange
+ * finds and reports their samples inside [t_begin, t_end].
+ */
+static int ScanRange(
+    const ECTS_READER *r,
+    uint32_t series,
+    const int64_t *event,
+    int64_t t_begin,
+    int64_t t_end,
+    ECTS_SCAN_CALLBACK callback,
+    void *ctx
+)
+{
+    ECTS_SCAN_CONTEXT scan = { event, t_begin, t_end, callback, ctx };
+    return VisitRange(r, series, event, t_begin, t_end, ScanVisit, &scan);
+}
+
+/*
+ * Function: EctsScan
+ * ------------------
+ * Calls the callback for every sample of a series within [t_begin, t_end]. Index
+ * entries and blocks whose summary does not overlap the range are skipped without
+ * being decoded.
+ *
+ * Parameters:
+ *   const ECTS_READER *reader    - Reader returned by EctsReaderOpen.
+ *   uint32_t series              - Series ID to scan.
+ *   int64_t t_begin              - First timestamp of interest.
+ *   int64_t t_end                - Last timestamp of interest.
+ *   ECTS_SCAN_CALLBACK callback  - Called once per matching sample.
+ *   void *ctx                    - Passed through to the callback.
+ *
+ * Returns:
+ *   int - ECTS_STATUS_SUCCESS on success, or an error code on failure.
+ */
+ECTS_API
+int EctsScan(
+    const ECTS_READER *reader,
+    uint32_t series,
+    int64_t t_begin,
+    int64_t t_end,
+    ECTS_SCAN_CALLBACK callback,
+    void *ctx
+)
+{
+    if (reader == NULL || callback == NULL || series >= reader->series_count) {
+        return ECTS_STATUS_INVALID_PARAMETER;
+    }
+
+    return ScanRange(reader, series, NULL, t_begin, t_end, callback, ctx);
+}
+
+/*
+ * Function: EctsScanEvent
+ * -----------------------
+ * Calls the callback for every occurrence of one event value in an event series
+ * within [t_begin, t_end]. Index entries and blocks whose event mask shows the
+ * value cannot be present are skipped.
+ *
+ * Parameters:
+ *   const ECTS_READER *reader    - Reader returned by EctsReaderOpen.
+ *   uint32_t series              - Event series ID to scan.
+ *   int64_t event                - Event value to match.
+ *   int64_t t_begin              - First timestamp of interest.
+ *   int64_t t_end                - Last timestamp of interest.
+ *   ECTS_SCAN_CALLBACK callback  - Called once per matching event.
+ *   void *ctx                    - Passed through to the callback.
+ *
+ * Returns:
+ *   int - ECTS_STATUS_SUCCESS on success, or an error code on failure.
+ */
+ECTS_API
+int EctsScanEvent(
+    const ECTS_READER *reader,
+    uint32_t series,
+    int64_t event,
+    int64_t t_begin,
+    int64_t t_end,
+    ECTS_SCAN_CALLBACK callback,
+    void *ctx
+)
+{
+    if (reader == NULL || callback == NULL || series >= reader->series_count) {
+        return ECTS_STATUS_INVALID_PARAMETER;
+    }
+
+    return ScanRange(reader, series, &event, t_begin, t_end, callback, ctx);
+}
+
+/*
+ * Function: EctsScanBlocks
+ * ------------------------
+ * Calls the callback with the summary of every block of a series overlapping
+ * [t_begin, t_end], in file order, without decoding them. Indexed captures are
+ * located through the index so the block directory is never built. Returning
+ * anything but ECTS_STATUS_SUCCESS from the callback stops the walk.
+ *
+ * Parameters:
+ *   const ECTS_READER *reader     - Reader returned by EctsReaderOpen.
+ *   uint32_t series               - Series ID to look up.
+ *   int64_t t_begin               - First timestamp of interest.
+ *   int64_t t_end                 - Last timestamp of interest.
+ *   ECTS_BLOCK_CALLBACK callback  - Called once per overlapping block.
+ *   void *ctx                     - Passed through to the callback.
+ *
+ * Returns:
+ *   int - ECTS_STATUS_SUCCESS on success, the callback status, or an error code.
+ */
+ECTS_API
+int EctsScanBlocks(
+    const ECTS_READER *reader,
+    uint32_t series,
+    int64_t t_begin,
+    int64_t t_end,
+    ECTS_BLOCK_CALLBACK callback,
+    void *ctx
+)
+{
+    if (reader == NULL || callback == NULL || series >= reader->series_count) {
+        return ECTS_STATUS_INVALID_PARAMETER;
+    }
+
+    return VisitRange(reader, series, NULL, t_begin, t_end, callback, ctx);
+}
+
+/*
+ * Function: EctsDecodeBlockData
+ * -----------------------------
+ * Decompresses all samples of a block handed out by EctsScanBlocks or
+ * EctsBlockInfo.
+ *
+ * Parameters:
+ *   const ECTS_BLOCK_HEADER *block - Block summary from the same reader.
+ *   int64_t *timestamps            - Output array of sample timestamps.
+ *   int64_t *values                - Output array of sample values.
+ *   uint32_t capacity              - Number of entries in each output array.
+ *   uint32_t *count                - Receives the number of decoded samples.
+ *
+ * Returns:
+ *   int - ECTS_STATUS_SUCCESS on success, or an error code on failure.
+ */
+ECTS_API
+int EctsDecodeBlockData(
+    const ECTS_BLOCK_HEADER *block,
+    int64_t *timestamps,
+    int64_t *values,
+    uint32_t capacity,
+    uint32_t *count
+)
+{
+    if (block == NULL || timestamps == NULL || values == NULL || count == NULL) {
+        return ECTS_STATUS_INVALID_PARAMETER;
+    }
+
+    if (capacity < block->count) {
+        return ECTS_STATUS_BUFFER_TOO_SMALL;
+    }
+
+    int status = DecodeBlock(block, timestamps, values);
+    *count = (status == ECTS_STATUS_SUCCESS) ? block->count : 0;
+    return status;
+}
+
+/*
+ * Function: EctsIndexCount
+ * ------------------------
+ * Returns the number of index entries, or 0 if the capture has no index footer.
+ *
+ * Parameters:
+ *   const ECTS_READER *reader  - Reader returned by EctsReaderOpen.
+ *
+ * Returns:
+ *   uint32_t - Number of index entries.
+ */
+ECTS_API
+uint32_t EctsIndexCount(
+    const ECTS_READER *reader
+)
+{
+    return reader ? reader->entry_count : 0;
+}
+
+/*
+ * Function: EctsIndexEntry
+ * ------------------------
+ * Returns an index entry straight from the mapped footer.
+ *
+ * Parameters:
+ *   const ECTS_READER *reader  - Reader returned by EctsReaderOpen.
+ *   uint32_t index             - Entry index, ordered by file offset.
+ *
+ * Returns:
+ *   const ECTS_INDEX_ENTRY * - Index entry, or NULL if index is out of range.
+ */
+ECTS_API
+const ECTS_INDEX_ENTRY *EctsIndexEntry(
+    const ECTS_READER *reader,
+    uint32_t index
+)
+{
+    if (reader == NULL || index >= reader->entry_count) {
+        return NULL;
+    }
+
+    return &reader->entries[index];
+}
@@ -1,10 +1,46 @@
 use crate::{Source, Threshold, common};
 use color_eyre::{Result, eyre::eyre};
+use std::cell::RefCell;
+use std::collections::HashMap;
+use std::collections::hash_map::Entry;
 use std::ffi;
+use std::rc::Rc;
 
 // This module maps the data returned from call into the C-Library to RUST structures
+//
+// Requests are built once by eclib and reused, and results are read in place from
+// an arena owned by `Acpi` through the views eclib returns, so polling does not
+// allocate.
+#[repr(C)]
+struct EcRequest {
+    _private: [u8; 0],
+}
+
+#[repr(C)]
+#[derive(Debug, Default, Copy, Clone)]
+struct EcView {
+    type_: u16,
+    reserved: u16,
+    offset: u32,
+    length: u32,
+    next: u32,
+}
+
 unsafe extern "C" {
-    fn EvaluateAcpi(input: *const i8, input_len: usize, buffer: *mut u8, buf_len: &mut usize) -> i32;
+    fn EcRequestCreate(method: *const ffi::c_char, request: *mut *mut EcRequest) -> i32;
+    fn EcRequestAddInteger(request: *mut EcRequest, value: u32) -> i32;
+    fn EcRequestAddString(request: *mut EcRequest, value: *const ffi::c_char) -> i32;
+    fn EcRequestAddBuffer(request: *mut EcRequest, data: *const u8, length: u16) -> i32;
+    fn EcRequestSetInteger(request: *mut EcRequest, index: u32, value: u32) -> i32;
+    fn EcRequestEvaluate(
+        request: *mut EcRequest,
+        arena: *mut u8,
+        arena_len: usize,
+        views: *mut EcView,
+        view_capacity: u32,
+        view_count: *mut u32,
+    ) -> i32;
+    fn EcRequestDestroy(request: *mut EcRequest);
 }
 
 mod guid {
@@ -18,19 +54,13 @@ mod guid {
     pub const FAN_CURRENT_RPM: uuid::Uuid = uuid::uuid!("adf95492-0776-4ffc-84f3-b6c8b5269683");
 }
 
-fn cstr_bytes_to_string(raw: &[u8]) -> Result<String> {
-    Ok(ffi::CStr::from_bytes_until_nul(raw)
-        .map_err(|_| color_eyre::eyre::eyre!("Invalid byte slice"))?
-        .to_str()
-        .map_err(|_| color_eyre::eyre::eyre!("String contains invalid characters"))?
-        .to_owned())
-}
+// Output arena and view array sizes, large enough for _BIX
+const ARENA_SIZE: usize = 1024;
+const MAX_VIEWS: usize = 64;
 
-// A user-friendly ACPI input method containing a name and optional arguments
-struct AcpiMethodInput<'a, 'b> {
-    name: &'a str,
-    args: Option<&'b [AcpiMethodArgument]>,
-}
+const ACPI_METHOD_ARGUMENT_INTEGER: u16 = 0;
+const ACPI_METHOD_ARGUMENT_PACKAGE: u16 = 3;
+const ACPI_METHOD_ARGUMENT_PACKAGE_EX: u16 = 4;
 
 /// A user-friendly ACPI method argument
 #[derive(Debug, Copy, Clone)]
@@ -43,72 +73,14 @@ pub enum AcpiMethodArgument {
     Guid(uuid::Bytes),
 }
 
-// Convert a user-friendly ACPI method argument to format expected by driver
-impl TryFrom<AcpiMethodArgument> for AcpiMethodArgumentV1 {
-    type Error = AcpiParseError;
-    fn try_from(arg: AcpiMethodArgument) -> Result<Self, AcpiParseError> {
-        Ok(match arg {
-            AcpiMethodArgument::Guid(g) => Self {
-                type_: 2,
-                data_length: 16,
-                data_32: 0,
-                data: g.to_vec(),
-            },
-            AcpiMethodArgument::Str(s) => {
-                let cstr = ffi::CString::new(s).map_err(|_| AcpiParseError::InvalidFormat)?;
-                Self {
-                    type_: 1,
-                    data_length: cstr.count_bytes() as u16 + 1,
-                    data_32: 0,
-                    data: cstr.as_bytes_with_nul().to_vec(),
-                }
-            }
-            AcpiMethodArgument::Int(i) => Self {
-                type_: 0,
-                data_length: 4,
-                data_32: i,
-                data: i.to_le_bytes().to_vec(),
-            },
-        })
-    }
-}
-
-#[repr(C)]
-#[derive(Debug)]
-pub struct AcpiEvalInputBufferComplexV1Ex {
-    pub signature: u32,
-    pub methodname: [u8; 256],
-    pub size: u32,
-    pub argumentcount: u32,
-    pub arguments: Vec<AcpiMethodArgumentV1>,
-}
-
-#[repr(C)]
-#[derive(Debug, Default)]
-pub struct AcpiEvalOutputBufferV1 {
-    pub signature: u32,
-    pub length: u32,
-    pub count: u32,
-    pub arguments: Vec<AcpiMethodArgumentV1>,
-}
-
-#[repr(C)]
-#[derive(Debug, Default)]
-pub struct AcpiMethodArgumentV1 {
-    pub type_: u16,
-    pub data_length: u16,
-    pub data_32: u32,
-    pub data: Vec<u8>,
-}
-
 #[derive(Debug)]
 pub enum AcpiParseError {
     InsufficientLength,
     InvalidFormat,
+    /// eclib returned a Win32 error code
+    Eclib(i32),
 }
 
-pub const ACPI_EVAL_INPUT_BUFFER_COMPLEX_SIGNATURE_EX: u32 = u32::from_le_bytes(*b"AeiF");
-
 impl std::error::Error for AcpiParseError {}
 impl std::fmt::Display for AcpiParseError {
     fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
@@ -116,157 +88,241 @@ impl std::fmt::Display for AcpiParseError {
     }
 }
 
-// Convert a user-friendly ACPI input method to format expected by driver
-impl TryFrom<AcpiMethodInput<'_, '_>> for AcpiEvalInputBufferComplexV1Ex {
-    type Error = AcpiParseError;
-    fn try_from(method: AcpiMethodInput) -> Result<Self, AcpiParseError> {
-        let mut buffer = [0u8; 256];
-        let bytes = method.name.as_bytes();
-        let len = bytes.len().min(256);
-        buffer[..len].copy_from_slice(&bytes[..len]);
-
-        let arguments = if let Some(args) = method.args {
-            args.iter()
-                .map(|&arg| AcpiMethodArgumentV1::try_from(arg))
-                .collect::<Result<Vec<_>, _>>()?
-        } else {
-            Vec::default()
-        };
-        let size = arguments.iter().map(|arg| arg.data_length as u32).sum();
-
-        Ok(AcpiEvalInputBufferComplexV1Ex {
-            signature: ACPI_EVAL_INPUT_BUFFER_COMPLEX_SIGNATURE_EX,
-            methodname: buffer,
-            size,
-            argumentcount: arguments.len() as u32,
-            arguments,
-        })
+fn check(status: i32) -> Result<(), AcpiParseError> {
+    if status == 0 {
+        Ok(())
+    } else {
+        Err(AcpiParseError::Eclib(status))
     }
 }
 
-// Convert ACPI input struct to a raw, packed byte buffer
-impl From<AcpiEvalInputBufferComplexV1Ex> for Vec<u8> {
-    fn from(input: AcpiEvalInputBufferComplexV1Ex) -> Self {
-        let mut buf = Vec::new();
-        buf.extend(&input.signature.to_le_bytes());
-        buf.extend(&input.methodname);
-        buf.extend(&input.size.to_le_bytes());
-        buf.extend(&input.argumentcount.to_le_bytes());
-
-        for arg in input.arguments.iter() {
-            buf.extend(&arg.type_.to_le_bytes());
-            buf.extend(&arg.data_length.to_le_bytes());
-            buf.extend(&arg.data);
+// A prebuilt eclib request, destroyed when dropped
+struct Request(*mut EcRequest);
+
+impl Request {
+    fn new(name: &str, args: &[AcpiMethodArgument]) -> Result<Self, AcpiParseError> {
+        // Maximum number of arguments allowed is 7 as per spec
+        if args.len() > 7 {
+            return Err(AcpiParseError::InsufficientLength);
         }
 
-        buf
+        let name = ffi::CString::new(name).map_err(|_| AcpiParseError::InvalidFormat)?;
+        let mut raw = std::ptr::null_mut();
+        check(unsafe { EcRequestCreate(name.as_ptr(), &mut raw) })?;
+        let request = Request(raw);
+
+        for arg in args {
+            let status = match arg {
+                AcpiMethodArgument::Int(i) => unsafe { EcRequestAddInteger(request.0, *i) },
+                AcpiMethodArgument::Str(s) => {
+                    let cstr = ffi::CString::new(*s).map_err(|_| AcpiParseError::InvalidFormat)?;
+                    unsafe { EcRequestAddString(request.0, cstr.as_ptr()) }
+                }
+                AcpiMethodArgument::Guid(g) => unsafe { EcRequestAddBuffer(request.0, g.as_ptr(), g.len() as u16) },
+            };
+            check(status)?;
+        }
+
+        Ok(request)
     }
 }
 
-// Convert vec[u8] into AcpiEvalOutputBufferV1
-impl TryFrom<Vec<u8>> for AcpiEvalOutputBufferV1 {
-    type Error = AcpiParseError;
-    fn try_from(value: Vec<u8>) -> Result<Self, AcpiParseError> {
-        let signature = u32::from_le_bytes(value[0..4].try_into().map_err(|_| AcpiParseError::InvalidFormat)?);
-        let length = u32::from_le_bytes(value[4..8].try_into().map_err(|_| AcpiParseError::InvalidFormat)?);
-        let count = u32::from_le_bytes(value[8..12].try_into().map_err(|_| AcpiParseError::InvalidFormat)?);
+impl Drop for Request {
+    fn drop(&mut self) {
+        unsafe { EcRequestDestroy(self.0) };
+    }
+}
 
-        let mut offset = 12;
-        let mut arguments = Vec::new();
+// Requests are keyed by method and the arguments that cannot be patched in place
+#[derive(PartialEq, Eq, Hash)]
+struct RequestKey {
+    name: &'static str,
+    guid: Option<uuid::Bytes>,
+    string: Option<&'static str>,
+}
 
-        for _ in 0..count {
-            if offset + 8 > value.len() {
-                return Err(AcpiParseError::InsufficientLength);
+impl RequestKey {
+    fn new(name: &'static str, args: &[AcpiMethodArgument]) -> Self {
+        let mut key = RequestKey {
+            name,
+            guid: None,
+            string: None,
+        };
+        for arg in args {
+            match arg {
+                AcpiMethodArgument::Guid(g) => key.guid = Some(*g),
+                AcpiMethodArgument::Str(s) => key.string = Some(s),
+                AcpiMethodArgument::Int(_) => {}
             }
+        }
+        key
+    }
+}
 
-            let type_ = u16::from_le_bytes(value[offset..offset + 2].try_into().unwrap());
-            let data_length = u16::from_le_bytes(value[offset + 2..offset + 4].try_into().unwrap()) as usize;
-            let data_32 = if type_ == 0 {
-                u32::from_le_bytes(value[offset + 4..offset + 8].try_into().unwrap())
-            } else {
-                0
-            };
-            offset += 4;
+struct Scratch {
+    arena: Box<[u8]>,
+    views: Box<[EcView]>,
+}
 
-            if offset + data_length > value.len() {
-                return Err(AcpiParseError::InsufficientLength);
-            }
+impl Default for Scratch {
+    fn default() -> Self {
+        Self {
+            arena: vec![0u8; ARENA_SIZE].into_boxed_slice(),
+            views: vec![EcView::default(); MAX_VIEWS].into_boxed_slice(),
+        }
+    }
+}
+
+/// Results of an evaluation, borrowed from the output arena
+///
+/// Elements are addressed by their index at this level. Package elements can be
+/// opened with `package` to read their contents.
+pub struct AcpiOutput<'a> {
+    arena: &'a [u8],
+    views: &'a [EcView],
+    start: usize,
+    end: usize,
+}
+
+impl<'a> AcpiOutput<'a> {
+    // Views of this level, skipping over the contents of nested packages
+    fn elements(&self) -> impl Iterator<Item = (usize, &'a EcView)> + '_ {
+        let views = self.views;
+        let end = self.end;
+        std::iter::successors(Some(self.start), move |&i| Some(views[i].next as usize))
+            .take_while(move |&i| i < end)
+            .map(move |i| (i, &views[i]))
+    }
 
-            let data = value[offset..offset + data_length].to_vec();
-            offset += data_length;
+    fn element(&self, index: usize) -> Result<(usize, &'a EcView), AcpiParseError> {
+        self.elements().nth(index).ok_or(AcpiParseError::InsufficientLength)
+    }
 
-            arguments.push(AcpiMethodArgumentV1 {
-                type_,
-                data_length: data_length as u16,
-                data_32,
-                data,
-            });
+    /// Number of elements at this level
+    pub fn count(&self) -> usize {
+        self.elements().count()
+    }
+
+    /// Raw data of an element
+    pub fn data(&self, index: usize) -> Result<&'a [u8], AcpiParseError> {
+        let (_, view) = self.element(index)?;
+        let start = view.offset as usize;
+        self.arena
+            .get(start..start + view.length as usize)
+            .ok_or(AcpiParseError::InsufficientLength)
+    }
+
+    /// Low 32 bits of an integer element
+    pub fn int(&self, index: usize) -> Result<u32, AcpiParseError> {
+        let (_, view) = self.element(index)?;
+        if view.type_ != ACPI_METHOD_ARGUMENT_INTEGER {
+            return Err(AcpiParseError::InvalidFormat);
         }
+        let data = self.data(index)?;
+        Ok(u32::from_le_bytes(
+            data.get(0..4)
+                .ok_or(AcpiParseError::InsufficientLength)?
+                .try_into()
+                .unwrap(),
+        ))
+    }
+
+    /// String element, up to the first null
+    pub fn string(&self, index: usize) -> Result<String, AcpiParseError> {
+        Ok(ffi::CStr::from_bytes_until_nul(self.data(index)?)
+            .map_err(|_| AcpiParseError::InvalidFormat)?
+            .to_str()
+            .map_err(|_| AcpiParseError::InvalidFormat)?
+            .to_owned())
+    }
 
-        // Now return generated content
-        Ok(AcpiEvalOutputBufferV1 {
-            signature,
-            length,
-            count,
-            arguments,
+    /// Contents of a package element
+    pub fn package(&self, index: usize) -> Result<AcpiOutput<'a>, AcpiParseError> {
+        let (i, view) = self.element(index)?;
+        if view.type_ != ACPI_METHOD_ARGUMENT_PACKAGE && view.type_ != ACPI_METHOD_ARGUMENT_PACKAGE_EX {
+            return Err(AcpiParseError::InvalidFormat);
+        }
+        Ok(AcpiOutput {
+            arena: self.arena,
+            views: self.views,
+            start: i + 1,
+            end: view.next as usize,
         })
     }
 }
 
-#[derive(Default, Copy, Clone)]
-pub struct Acpi {}
+#[derive(Default, Clone)]
+pub struct Acpi {
+    requests: Rc<RefCell<HashMap<RequestKey, Request>>>,
+    scratch: Rc<RefCell<Scratch>>,
+}
 
 impl Acpi {
     pub fn new() -> Self {
         Default::default()
     }
 
-    pub fn evaluate(name: &str, args: Option<&[AcpiMethodArgument]>) -> Result<AcpiEvalOutputBufferV1, AcpiParseError> {
-        // Maximum number of arguments allowed is 7 as per spec
-        if let Some(args) = args
-            && args.len() > 7
-        {
-            return Err(AcpiParseError::InsufficientLength);
-        }
-
-        let method = AcpiMethodInput { name, args };
-        let input = AcpiEvalInputBufferComplexV1Ex::try_from(method)?;
-
-        // Input buffer
-        let in_buf: Vec<u8> = input.into();
-        let in_buf_len = in_buf.len();
-
-        // Output buffer
-        let mut out_buf_len = 1024;
-        let mut out_buf = vec![0u8; out_buf_len];
+    /// Evaluate a method and pass the output to `parse`
+    ///
+    /// The request is built on first use and reused afterwards, only integer
+    /// arguments are rewritten between calls.
+    pub fn evaluate<T>(
+        &self,
+        name: &'static str,
+        args: &[AcpiMethodArgument],
+        parse: impl FnOnce(&AcpiOutput<'_>) -> Result<T>,
+    ) -> Result<T> {
+        let mut requests = self.requests.borrow_mut();
+        let request = match requests.entry(RequestKey::new(name, args)) {
+            Entry::Occupied(entry) => {
+                let request = entry.into_mut();
+                for (index, arg) in args.iter().enumerate() {
+                    if let AcpiMethodArgument::Int(i) = arg {
+                        check(unsafe { EcRequestSetInteger(request.0, index as u32, *i) })?;
+                    }
+                }
+                request
+            }
+            Entry::Vacant(entry) => entry.insert(Request::new(name, args)?),
+        };
 
-        let _res = unsafe {
-            EvaluateAcpi(
-                in_buf.as_ptr() as *const i8,
-                in_buf_len,
-                out_buf.as_mut_ptr(),
-                &mut out_buf_len,
+        let mut scratch = self.scratch.borrow_mut();
+        let Scratch { arena, views } = &mut *scratch;
+        let mut count = 0u32;
+        check(unsafe {
+            EcRequestEvaluate(
+                request.0,
+                arena.as_mut_ptr(),
+                arena.len(),
+                views.as_mut_ptr(),
+                views.len() as u32,
+                &mut count,
             )
-        };
+        })?;
 
-        AcpiEvalOutputBufferV1::try_from(out_buf)
+        parse(&AcpiOutput {
+            arena,
+            views,
+            start: 0,
+            end: count as usize,
+        })
     }
 }
 
-fn acpi_get_var(guid: uuid::Uuid) -> Result<f64> {
+fn acpi_get_var(acpi: &Acpi, guid: uuid::Uuid) -> Result<f64> {
     let args = [AcpiMethodArgument::Int(1), AcpiMethodArgument::Guid(guid.to_bytes_le())];
-    let output = Acpi::evaluate("\\_SB.ECT0.TGVR", Some(&args))?;
-
-    if output.count != 2 {
-        Err(eyre!("GET_VAR({guid}) unrecognized output"))
-    } else if output.arguments[0].data_32 != 0 {
-        Err(eyre!("GET_VAR({guid}) unknown failure"))
-    } else {
-        Ok(f64::from(output.arguments[1].data_32))
-    }
+    acpi.evaluate("\\_SB.ECT0.TGVR", &args, |output| {
+        if output.count() != 2 {
+            Err(eyre!("GET_VAR({guid}) unrecognized output"))
+        } else if output.int(0)? != 0 {
+            Err(eyre!("GET_VAR({guid}) unknown failure"))
+        } else {
+            Ok(f64::from(output.int(1)?))
+        }
+    })
 }
 
-fn acpi_set_var(guid: uuid::Uuid, value: f64) -> Result<()> {
+fn acpi_set_var(acpi: &Acpi, guid: uuid::Uuid, value: f64) -> Result<()> {
     let value = value as u32;
 
     let args = [
@@ -274,102 +330,103 @@ fn acpi_set_var(guid: uuid::Uuid, value: f64) -> Result<()> {
         AcpiMethodArgument::Guid(guid.to_bytes_le()),
         AcpiMethodArgument::Int(value),
     ];
-    let output = Acpi::evaluate("\\_SB.ECT0.TSVR", Some(&args))?;
-
-    if output.count != 1 {
-        Err(eyre!("SET_VAR({guid}, {value}) unrecognized output"))
-    } else if output.arguments[0].data_32 != 0 {
-        Err(eyre!("SET_VAR({guid}, {value}) unknown failure"))
-    } else {
-        Ok(())
-    }
+    acpi.evaluate("\\_SB.ECT0.TSVR", &args, |output| {
+        if output.count() != 1 {
+            Err(eyre!("SET_VAR({guid}, {value}) unrecognized output"))
+        } else if output.int(0)? != 0 {
+            Err(eyre!("SET_VAR({guid}, {value}) unknown failure"))
+        } else {
+            Ok(())
+        }
+    })
 }
 
 impl Source for Acpi {
     fn get_temperature(&self) -> Result<f64> {
-        let output = Acpi::evaluate("\\_SB.ECT0.RTMP", None)?;
-        if output.count != 1 {
-            Err(eyre!("GET_TMP unrecognized output"))
-        } else {
-            Ok(common::dk_to_c(output.arguments[0].data_32))
-        }
+        self.evaluate("\\_SB.ECT0.RTMP", &[], |output| {
+            if output.count() != 1 {
+                Err(eyre!("GET_TMP unrecognized output"))
+            } else {
+                Ok(common::dk_to_c(output.int(0)?))
+            }
+        })
     }
 
     fn get_rpm(&self) -> Result<f64> {
-        acpi_get_var(guid::FAN_CURRENT_RPM)
+        acpi_get_var(self, guid::FAN_CURRENT_RPM)
     }
 
     fn get_min_rpm(&self) -> Result<f64> {
-        acpi_get_var(guid::FAN_MIN_RPM)
+        acpi_get_var(self, guid::FAN_MIN_RPM)
     }
 
     fn get_max_rpm(&self) -> Result<f64> {
-        acpi_get_var(guid::FAN_MAX_RPM)
+        acpi_get_var(self, guid::FAN_MAX_RPM)
     }
 
     fn get_threshold(&self, threshold: Threshold) -> Result<f64> {
         match threshold {
-            Threshold::On => Ok(common::dk_to_c(acpi_get_var(guid::FAN_ON_TEMP)? as u32)),
-            Threshold::Ramping => Ok(common::dk_to_c(acpi_get_var(guid::FAN_RAMP_TEMP)? as u32)),
-            Threshold::Max => Ok(common::dk_to_c(acpi_get_var(guid::FAN_MAX_TEMP)? as u32)),
+            Threshold::On => Ok(common::dk_to_c(acpi_get_var(self, guid::FAN_ON_TEMP)? as u32)),
+            Threshold::Ramping => Ok(common::dk_to_c(acpi_get_var(self, guid::FAN_RAMP_TEMP)? as u32)),
+            Threshold::Max => Ok(common::dk_to_c(acpi_get_var(self, guid::FAN_MAX_TEMP)? as u32)),
         }
     }
 
     fn set_rpm(&self, rpm: f64) -> Result<()> {
-        acpi_set_var(guid::FAN_CURRENT_RPM, rpm)
+        acpi_set_var(self, guid::FAN_CURRENT_RPM, rpm)
     }
 
     fn get_bst(&self) -> Result<crate::battery::BstData> {
-        let data = Acpi::evaluate("\\_SB.ECT0.TBST", None)?;
-
-        // We are expecting 4 32-bit values
-        if data.count != 4 {
-            Err(eyre!("GET_BST unrecognized output"))
-        } else {
-            Ok(crate::battery::BstData {
-                state: crate::battery::ChargeState::try_from(data.arguments[0].data_32)?,
-                rate: data.arguments[1].data_32,
-                capacity: data.arguments[2].data_32,
-                voltage: data.arguments[3].data_32,
-            })
-        }
+        self.evaluate("\\_SB.ECT0.TBST", &[], |data| {
+            // We are expecting 4 32-bit values
+            if data.count() != 4 {
+                Err(eyre!("GET_BST unrecognized output"))
+            } else {
+                Ok(crate::battery::BstData {
+                    state: crate::battery::ChargeState::try_from(data.int(0)?)?,
+                    rate: data.int(1)?,
+                    capacity: data.int(2)?,
+                    voltage: data.int(3)?,
+                })
+            }
+        })
     }
 
     fn get_bix(&self) -> Result<crate::battery::BixData> {
-        let data = Acpi::evaluate("\\_SB.ECT0.TBIX", None)?;
-        // We are expecting 21 arguments
-        if data.count != 21 {
-            Err(eyre!("GET_BIX unrecognized output"))
-        } else {
-            Ok(crate::battery::BixData {
-                revision: data.arguments[0].data_32,
-                power_unit: crate::battery::PowerUnit::try_from(data.arguments[1].data_32)?,
-                design_capacity: data.arguments[2].data_32,
-                last_full_capacity: data.arguments[3].data_32,
-                battery_technology: crate::battery::BatteryTechnology::try_from(data.arguments[4].data_32)?,
-                design_voltage: data.arguments[5].data_32,
-                warning_capacity: data.arguments[6].data_32,
-                low_capacity: data.arguments[7].data_32,
-                cycle_count: data.arguments[8].data_32,
-                accuracy: data.arguments[9].data_32,
-                max_sample_time: data.arguments[10].data_32,
-                min_sample_time: data.arguments[11].data_32,
-                max_average_interval: data.arguments[12].data_32,
-                min_average_interval: data.arguments[13].data_32,
-                capacity_gran1: data.arguments[14].data_32,
-                capacity_gran2: data.arguments[15].data_32,
-                model_number: cstr_bytes_to_string(&data.arguments[16].data)?,
-                serial_number: cstr_bytes_to_string(&data.arguments[17].data)?,
-                battery_type: cstr_bytes_to_string(&data.arguments[18].data)?,
-                oem_info: cstr_bytes_to_string(&data.arguments[19].data)?,
-                swap_cap: crate::battery::SwapCap::try_from(data.arguments[20].data_32)?,
-            })
-        }
+        self.evaluate("\\_SB.ECT0.TBIX", &[], |data| {
+            // We are expecting 21 arguments
+            if data.count() != 21 {
+                Err(eyre!("GET_BIX unrecognized output"))
+            } else {
+                Ok(crate::battery::BixData {
+                    revision: data.int(0)?,
+                    power_unit: crate::battery::PowerUnit::try_from(data.int(1)?)?,
+                    design_capacity: data.int(2)?,
+                    last_full_capacity: data.int(3)?,
+                    battery_technology: crate::battery::BatteryTechnology::try_from(data.int(4)?)?,
+                    design_voltage: data.int(5)?,
+                    warning_capacity: data.int(6)?,
+                    low_capacity: data.int(7)?,
+                    cycle_count: data.int(8)?,
+                    accuracy: data.int(9)?,
+                    max_sample_time: data.int(10)?,
+                    min_sample_time: data.int(11)?,
+                    max_average_interval: data.int(12)?,
+                    min_average_interval: data.int(13)?,
+                    capacity_gran1: data.int(14)?,
+                    capacity_gran2: data.int(15)?,
+                    model_number: data.string(16)?,
+                    serial_number: data.string(17)?,
+                    battery_type: data.string(18)?,
+                    oem_info: data.string(19)?,
+                    swap_cap: crate::battery::SwapCap::try_from(data.int(20)?)?,
+                })
+            }
+        })
     }
 
     fn set_btp(&self, trippoint: u32) -> Result<()> {
         // No return value is expected according to ACPI spec
-        let _ = Acpi::evaluate("\\_SB.ECT0.TBTP", Some(&[AcpiMethodArgument::Int(trippoint)]))?;
-        Ok(())
+        self.evaluate("\\_SB.ECT0.TBTP", &[AcpiMethodArgument::Int(trippoint)], |_| Ok(()))
     }
 }
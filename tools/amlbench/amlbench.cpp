@@ -0,0 +1,750 @@
+/*
+MIT License
+
+Copyright (c) 2025 Open Device Partnership
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Measures the cost of the mailbox and thermal methods of ectest.asl and
+// thermal.asl in the ACPICA AML interpreter, the one acpiexec and the Linux
+// kernel use. The AML is compiled with iasl into a DSDT (amlbench.asl), loaded
+// from tables built in memory and evaluated with AcpiEvaluateObject. Stand-ins
+// for the two address spaces the methods touch are installed at the root:
+//
+//   SystemMemory  The SMTX and SMRX windows at 0x10060000000 are backed by host
+//                 memory attached to ecsim as the ASYNC slot queues.
+//   FFixedHw      FFAC writes are decoded as the FF-A direct request they carry,
+//                 service UUID from byte 2 and x4..x17 from byte 18, and served
+//                 by ecsim. The FF-A status is returned in STAT.
+//
+// The EC is scripted with -latency: doorbells, and for RXDB the response, are
+// only answered after that many Sleep() calls, so the polling loops run more
+// than once. -occupied fills slots ahead of the one QTXB and RXDB look for.
+// Sleep() is counted rather than taken unless -sleep is given, so times are
+// those of the interpreter and the EC model alone.
+//
+//   amlbench <amlbench.aml> [QTXB|RXDB|ASYC|ASYB|_TMP|THRS|GVAR|SVAR|SPRF|all] [-iterations N] [-occupied K] [-latency P] [-sleep]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+#include "amlbench.h"
+#include "../ecsim/ecsim.h"
+
+extern "C" {
+    #include "../../inc/ecring.h"
+}
+
+#define AMLB_WINDOW_BASE        0x10060000000ull    // SMTX in ectest.asl, SMRX follows
+#define AMLB_WINDOW_SIZE        (2 * ECRING_WINDOW_SIZE)
+#define AMLB_RX_SLOT0           (ECRING_WINDOW_SIZE + ECRING_SLOT_OFFSET)
+#define AMLB_FFH_UUID           2                   // Byte offsets in the FFAC buffer
+#define AMLB_FFH_REGS           18
+#define AMLB_FFH_SIZE           256                 // ACPI_FFH_INPUT_BUFFER_SIZE
+#define AMLB_ENTRY_LENGTH       20                  // Entries ASYC queues
+#define AMLB_FOREIGN_SEQUENCE   0x8000              // Sequences of occupied slots, never looked for
+#define AMLB_MAX_POLLS          100                 // Passes before QTXB and RXDB give up
+#define AMLB_BATCH              8                   // Entries per ASYB
+#define AMLB_MAX_TABLES         16
+#define AMLB_SENSOR             2                   // TZID of SKIN
+#define AMLB_ON_TEMP            3130                // Initial OnTemp in ecsim
+#define AMLB_PROFILE_VARS       5                   // Integers in the SPRF package
+
+typedef std::chrono::steady_clock CLOCK;
+
+typedef struct {
+    const char *method;
+    uint32_t iterations;
+    uint32_t occupied;      // Slots ahead of the one QTXB and RXDB find
+    uint32_t latency;       // Sleep() calls before the EC answers
+    bool sleep;             // Take the sleeps the AML asks for
+} AMLB_OPTIONS;
+
+// What one evaluation did, reset before each
+typedef struct {
+    uint64_t reads;         // SystemMemory accesses
+    uint64_t writes;
+    uint64_t txPasses;      // Passes of the QTXB and RXDB loops over the slots
+    uint64_t rxPasses;
+    uint64_t sleeps;        // Sleep() calls
+    uint64_t sleepMs;
+    uint64_t ffaCalls;      // FFAC writes
+    uint64_t ecNs;          // Time spent in the EC model
+} AMLB_COUNTERS;
+
+// ACPICA fills in the offset and length of the region for FFixedHw handlers
+typedef struct {
+    UINT64 offset;
+    UINT64 length;
+} AMLB_FFH_CONTEXT;
+
+enum {
+    AMLB_QTXB,
+    AMLB_RXDB,
+    AMLB_ASYC,
+    AMLB_ASYB,
+    AMLB_TMP,
+    AMLB_THRS,
+    AMLB_GVAR,
+    AMLB_SVAR,
+    AMLB_SPRF,
+    AMLB_METHODS
+};
+
+static const struct {
+    const char *name;
+    const char *path;
+} gMethods[AMLB_METHODS] = {
+    { "QTXB", "\\_SB.ECT0.QTXB" },
+    { "RXDB", "\\_SB.ECT0.RXDB" },
+    { "ASYC", "\\_SB.ECT0.ASYC" },
+    { "ASYB", "\\_SB.ECT0.ASYB" },
+    { "_TMP", "\\_SB.SKIN._TMP" },
+    { "THRS", "\\_SB.SKIN.THRS" },
+    { "GVAR", "\\_SB.THRM.GVAR" },
+    { "SVAR", "\\_SB.THRM.SVAR" },
+    { "SPRF", "\\_SB.THRM.SPRF" },
+};
+
+// EC_SVC_MANAGEMENT 330c1273-fde5-4757-9819-5b6539037502, as ToUUID lays it out
+static const uint8_t gManagementService[16] = {
+    0x73, 0x12, 0x0c, 0x33, 0xe5, 0xfd, 0x57, 0x47, 0x98, 0x19, 0x5b, 0x65, 0x39, 0x03, 0x75, 0x02
+};
+
+// OnTemp ba17b567-c368-48d5-bc6f-a312a41583c1
+static const uint8_t gVarOnTemp[16] = {
+    0x67, 0xb5, 0x17, 0xba, 0x68, 0xc3, 0xd5, 0x48, 0xbc, 0x6f, 0xa3, 0x12, 0xa4, 0x15, 0x83, 0xc1
+};
+
+static struct {
+    const AMLB_OPTIONS *options;
+    ECSIM *sim;
+    AMLB_COUNTERS counters;
+    uint64_t lastRead;          // Window offset of the last SystemMemory read
+    AMLB_FFH_CONTEXT ffh;
+
+    // EC work held back until options->latency sleeps have passed
+    bool pending;
+    uint32_t pendingSleeps;
+    bool doorbell;
+    uint64_t doorbellRegs[ECSIM_DIRECT_REGS];
+    uint64_t *publishSlot;
+    uint64_t publishValue;
+
+    ACPI_TABLE_RSDP rsdp;
+    ACPI_TABLE_XSDT xsdt;
+    ACPI_TABLE_FADT fadt;
+    ACPI_TABLE_HEADER *dsdt;
+} gBench;
+
+alignas(8) static uint8_t gWindow[AMLB_WINDOW_SIZE];
+
+ACPI_PHYSICAL_ADDRESS AmlBenchRootPointer(void)
+{
+    return gBench.dsdt != NULL ? (ACPI_PHYSICAL_ADDRESS)(uintptr_t)&gBench.rsdp : 0;
+}
+
+/*
+ * Function: DirectRequest
+ * ----------------------------
+ *  Passes a direct request to the EC model and accounts the time it took.
+ *
+ *  Returns: the FF-A status
+ */
+static int DirectRequest(const uint8_t service[16], uint64_t regs[ECSIM_DIRECT_REGS])
+{
+    CLOCK::time_point start = CLOCK::now();
+    int status = EcSimDirectReq2(gBench.sim, service, regs);
+
+    gBench.counters.ecNs += (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(CLOCK::now() - start).count();
+    return status;
+}
+
+/*
+ * Function: RunPending
+ * ----------------------------
+ *  Does the EC work that was held back: answers the doorbell or publishes the
+ *  RX slot RXDB is waiting for.
+ */
+static void RunPending(void)
+{
+    gBench.pending = false;
+    if (gBench.doorbell) {
+        gBench.doorbell = false;
+        DirectRequest(gManagementService, gBench.doorbellRegs);
+    }
+    if (gBench.publishSlot != NULL) {
+        *gBench.publishSlot = gBench.publishValue;
+        gBench.publishSlot = NULL;
+    }
+}
+
+/*
+ * Function: Schedule
+ * ----------------------------
+ *  Runs the pending EC work now, or after options->latency sleeps.
+ */
+static void Schedule(void)
+{
+    if (gBench.options->latency == 0) {
+        RunPending();
+        return;
+    }
+    gBench.pending = true;
+    gBench.pendingSleeps = gBench.options->latency;
+}
+
+void AmlBenchSleep(UINT64 milliseconds)
+{
+    gBench.counters.sleeps++;
+    gBench.counters.sleepMs += milliseconds;
+    if (gBench.options->sleep) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(milliseconds));
+    }
+    if (gBench.pending && --gBench.pendingSleeps == 0) {
+        RunPending();
+    }
+}
+
+static ACPI_STATUS RegionSetup(ACPI_HANDLE RegionHandle, UINT32 Function, void *HandlerContext, void **RegionContext)
+{
+    (void)RegionHandle;
+    *RegionContext = Function == ACPI_REGION_DEACTIVATE ? NULL : HandlerContext;
+    return AE_OK;
+}
+
+/*
+ * Function: MemoryHandler
+ * ----------------------------
+ *  SystemMemory stand-in for the SMTX and SMRX windows. A read of the first
+ *  slot descriptor starts a pass of the QTXB or RXDB loop, unless it follows a
+ *  read of the same descriptor, which is RXDB taking the length of a match.
+ */
+static ACPI_STATUS MemoryHandler(UINT32 Function, ACPI_PHYSICAL_ADDRESS Address, UINT32 BitWidth, UINT64 *Value, void *HandlerContext, void *RegionContext)
+{
+    uint64_t offset = Address - AMLB_WINDOW_BASE;
+    uint32_t bytes = BitWidth / 8;
+
+    (void)HandlerContext;
+    (void)RegionContext;
+    if (Address < AMLB_WINDOW_BASE || bytes == 0 || bytes > sizeof(*Value) || offset > AMLB_WINDOW_SIZE - bytes) {
+        return AE_AML_ILLEGAL_ADDRESS;
+    }
+
+    if ((Function & ACPI_IO_MASK) == ACPI_WRITE) {
+        memcpy(&gWindow[offset], Value, bytes);
+        gBench.counters.writes++;
+        return AE_OK;
+    }
+
+    *Value = 0;
+    memcpy(Value, &gWindow[offset], bytes);
+    gBench.counters.reads++;
+    if (offset == ECRING_SLOT_OFFSET &&
+        !(gBench.lastRead >= ECRING_SLOT_OFFSET && gBench.lastRead < ECRING_SLOT_OFFSET + sizeof(uint64_t))) {
+        gBench.counters.txPasses++;
+    } else if (offset == AMLB_RX_SLOT0 &&
+        !(gBench.lastRead >= AMLB_RX_SLOT0 && gBench.lastRead < AMLB_RX_SLOT0 + sizeof(uint64_t))) {
+        gBench.counters.rxPasses++;
+    }
+    gBench.lastRead = offset;
+    return AE_OK;
+}
+
+/*
+ * Function: FfhHandler
+ * ----------------------------
+ *  FFixedHw stand-in for FFAC. ACPICA passes the written buffer, padded to
+ *  AMLB_FFH_SIZE bytes, and returns it to the Store as the result. EC_ASYNC
+ *  doorbells are acknowledged at once and answered after the scripted latency,
+ *  every other request is answered before returning, as an SMC would be.
+ */
+static ACPI_STATUS FfhHandler(UINT32 Function, ACPI_PHYSICAL_ADDRESS Address, UINT32 BitWidth, UINT64 *Value, void *HandlerContext, void *RegionContext)
+{
+    uint8_t *buffer = (uint8_t *)Value;
+    uint64_t regs[ECSIM_DIRECT_REGS];
+    int status;
+
+    (void)Address;
+    (void)BitWidth;
+    (void)HandlerContext;
+    (void)RegionContext;
+    if ((Function & ACPI_IO_MASK) != ACPI_WRITE) {
+        return AE_SUPPORT;
+    }
+
+    gBench.counters.ffaCalls++;
+    memcpy(regs, &buffer[AMLB_FFH_REGS], sizeof(regs));
+    if (memcmp(&buffer[AMLB_FFH_UUID], gManagementService, 16) == 0 && (uint8_t)regs[0] == ECRING_CMD_ASYNC) {
+        memcpy(gBench.doorbellRegs, regs, sizeof(regs));
+        gBench.doorbell = true;
+        Schedule();
+        memset(regs, 0, sizeof(regs));
+        status = ECSIM_FFA_SUCCESS;
+    } else {
+        status = DirectRequest(&buffer[AMLB_FFH_UUID], regs);
+    }
+
+    buffer[0] = (uint8_t)status;
+    if (status == ECSIM_FFA_SUCCESS) {
+        memcpy(&buffer[AMLB_FFH_REGS], regs, sizeof(regs));
+    }
+    return AE_OK;
+}
+
+static UINT8 Checksum(const void *data, size_t length)
+{
+    const uint8_t *bytes = (const uint8_t *)data;
+    uint8_t sum = 0;
+
+    for (size_t i = 0; i < length; i++) {
+        sum = (uint8_t)(sum + bytes[i]);
+    }
+    return (UINT8)(0 - sum);
+}
+
+/*
+ * Function: BuildTables
+ * ----------------------------
+ *  Loads the DSDT iasl produced and builds an RSDP, XSDT and hardware reduced
+ *  FADT around it, so no FACS or fixed hardware registers are needed.
+ *
+ *  Returns: true if the DSDT was loaded
+ */
+static bool BuildTables(const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    long size;
+
+    if (file == NULL) {
+        printf("Cannot open %s\n", path);
+        return false;
+    }
+    fseek(file, 0, SEEK_END);
+    size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    if (size < (long)sizeof(ACPI_TABLE_HEADER)) {
+        printf("%s is not a DSDT\n", path);
+        fclose(file);
+        return false;
+    }
+    gBench.dsdt = (ACPI_TABLE_HEADER *)malloc((size_t)size);
+    if (gBench.dsdt == NULL || fread(gBench.dsdt, 1, (size_t)size, file) != (size_t)size ||
+        memcmp(gBench.dsdt->Signature, "DSDT", 4) != 0 || gBench.dsdt->Length != (UINT32)size) {
+        printf("%s is not a DSDT\n", path);
+        free(gBench.dsdt);
+        gBench.dsdt = NULL;
+        fclose(file);
+        return false;
+    }
+    fclose(file);
+
+    memset(&gBench.fadt, 0, sizeof(gBench.fadt));
+    memcpy(gBench.fadt.Header.Signature, "FACP", 4);
+    gBench.fadt.Header.Length = sizeof(gBench.fadt);
+    gBench.fadt.Header.Revision = 6;
+    gBench.fadt.Flags = ACPI_FADT_HW_REDUCED;
+    gBench.fadt.XDsdt = (UINT64)(uintptr_t)gBench.dsdt;
+    gBench.fadt.Header.Checksum = Checksum(&gBench.fadt, sizeof(gBench.fadt));
+
+    memset(&gBench.xsdt, 0, sizeof(gBench.xsdt));
+    memcpy(gBench.xsdt.Header.Signature, "XSDT", 4);
+    gBench.xsdt.Header.Length = sizeof(gBench.xsdt);
+    gBench.xsdt.Header.Revision = 1;
+    gBench.xsdt.TableOffsetEntry[0] = (UINT64)(uintptr_t)&gBench.fadt;
+    gBench.xsdt.Header.Checksum = Checksum(&gBench.xsdt, sizeof(gBench.xsdt));
+
+    memset(&gBench.rsdp, 0, sizeof(gBench.rsdp));
+    memcpy(gBench.rsdp.Signature, "RSD PTR ", 8);
+    gBench.rsdp.Revision = 2;
+    gBench.rsdp.Length = sizeof(gBench.rsdp);
+    gBench.rsdp.XsdtPhysicalAddress = (UINT64)(uintptr_t)&gBench.xsdt;
+    gBench.rsdp.Checksum = Checksum(&gBench.rsdp, ACPI_RSDP_CHECKSUM_LENGTH);
+    gBench.rsdp.ExtendedChecksum = Checksum(&gBench.rsdp, ACPI_RSDP_XCHECKSUM_LENGTH);
+    return true;
+}
+
+/*
+ * Function: Initialize
+ * ----------------------------
+ *  Brings up ACPICA the way acpiexec does, with the stand-ins installed before
+ *  the tables are loaded so they take the place of the default handlers.
+ *
+ *  Returns: true on success
+ */
+static bool Initialize(const char *path)
+{
+    ACPI_STATUS status;
+    const char *step;
+
+    if (!BuildTables(path)) {
+        return false;
+    }
+
+    step = "AcpiInitializeSubsystem";
+    status = AcpiInitializeSubsystem();
+    if (ACPI_SUCCESS(status)) {
+        step = "AcpiInitializeTables";
+        status = AcpiInitializeTables(NULL, AMLB_MAX_TABLES, TRUE);
+    }
+    if (ACPI_SUCCESS(status)) {
+        step = "SystemMemory handler";
+        status = AcpiInstallAddressSpaceHandler(ACPI_ROOT_OBJECT, ACPI_ADR_SPACE_SYSTEM_MEMORY,
+                                                MemoryHandler, RegionSetup, NULL);
+    }
+    if (ACPI_SUCCESS(status)) {
+        step = "FFixedHw handler";
+        status = AcpiInstallAddressSpaceHandler(ACPI_ROOT_OBJECT, ACPI_ADR_SPACE_FIXED_HARDWARE,
+                                                FfhHandler, RegionSetup, &gBench.ffh);
+    }
+    if (ACPI_SUCCESS(status)) {
+        step = "AcpiLoadTables";
+        status = AcpiLoadTables();
+    }
+    if (ACPI_SUCCESS(status)) {
+        step = "AcpiEnableSubsystem";
+        status = AcpiEnableSubsystem(ACPI_FULL_INITIALIZATION);
+    }
+    if (ACPI_SUCCESS(status)) {
+        step = "AcpiInitializeObjects";
+        status = AcpiInitializeObjects(ACPI_FULL_INITIALIZATION);
+    }
+    if (ACPI_FAILURE(status)) {
+        printf("%s failed %s\n", step, AcpiFormatException(status));
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Function: ResetRing
+ * ----------------------------
+ *  Frees every slot of both windows, then fills the first options->occupied
+ *  slots of the one the method searches with entries it will not match.
+ */
+static void ResetRing(uint32_t method)
+{
+    uint64_t *tx = (uint64_t *)&gWindow[ECRING_SLOT_OFFSET];
+    uint64_t *rx = (uint64_t *)&gWindow[AMLB_RX_SLOT0];
+
+    for (uint32_t i = 0; i < ECRING_SLOTS; i++) {
+        tx[i] = 0;
+        rx[i] = 0;
+    }
+    for (uint32_t i = 0; i < gBench.options->occupied; i++) {
+        if (method == AMLB_QTXB) {
+            tx[i] = ECRING_SLOT(AMLB_FOREIGN_SEQUENCE + i, AMLB_ENTRY_LENGTH);
+        } else if (method == AMLB_RXDB) {
+            rx[i] = ECRING_SLOT(AMLB_FOREIGN_SEQUENCE + i, AMLB_ENTRY_LENGTH);
+        }
+    }
+}
+
+/*
+ * Function: PostResponse
+ * ----------------------------
+ *  Writes the response RXDB will look for into the first free RX slot and
+ *  schedules the EC to publish it.
+ *
+ *  Returns: the sequence of the response
+ */
+static uint16_t PostResponse(uint32_t iteration)
+{
+    uint32_t slot = gBench.options->occupied;
+    uint16_t sequence = (uint16_t)(iteration % (AMLB_FOREIGN_SEQUENCE - 1) + 1);
+    uint8_t *entry = &gWindow[ECRING_WINDOW_SIZE + ECRING_ENTRY_OFFSET + slot * ECRING_ENTRY_SIZE];
+
+    for (uint32_t i = 0; i < AMLB_ENTRY_LENGTH; i++) {
+        entry[i] = (uint8_t)(sequence + i);
+    }
+    gBench.publishSlot = (uint64_t *)&gWindow[AMLB_RX_SLOT0 + slot * sizeof(uint64_t)];
+    gBench.publishValue = ECRING_SLOT(sequence, AMLB_ENTRY_LENGTH);
+    Schedule();
+    return sequence;
+}
+
+static bool CheckEntry(const ACPI_OBJECT *object)
+{
+    return object->Type == ACPI_TYPE_BUFFER && object->Buffer.Length == AMLB_ENTRY_LENGTH;
+}
+
+/*
+ * Function: CheckResult
+ * ----------------------------
+ *  Returns: true if a method returned what the stand-ins should make it return
+ */
+static bool CheckResult(uint32_t method, const ACPI_OBJECT *result, uint16_t sequence)
+{
+    if (result == NULL) {
+        return false;
+    }
+
+    switch (method) {
+    case AMLB_QTXB:
+        return result->Type == ACPI_TYPE_INTEGER && result->Integer.Value != 0 && result->Integer.Value <= 0xFFFF;
+    case AMLB_RXDB:
+        return CheckEntry(result) && result->Buffer.Pointer[0] == (uint8_t)sequence;
+    case AMLB_ASYC:
+        // The entry ASYC queued comes back with LENG in byte 1
+        return CheckEntry(result) && result->Buffer.Pointer[1] == AMLB_ENTRY_LENGTH;
+    case AMLB_ASYB:
+        if (result->Type != ACPI_TYPE_PACKAGE || result->Package.Count != AMLB_BATCH) {
+            return false;
+        }
+        for (uint32_t i = 0; i < AMLB_BATCH; i++) {
+            if (!CheckEntry(&result->Package.Elements[i])) {
+                return false;
+            }
+        }
+        return true;
+    case AMLB_TMP:
+        // ECSIM_HISTORY_VALUE stays within 200 of 298.0K
+        return result->Type == ACPI_TYPE_INTEGER && result->Integer.Value >= 2980 && result->Integer.Value < 3180;
+    case AMLB_GVAR:
+        return result->Type == ACPI_TYPE_INTEGER && result->Integer.Value == AMLB_ON_TEMP;
+    default:
+        // THRS, SVAR and SPRF return the EC status
+        return result->Type == ACPI_TYPE_INTEGER && result->Integer.Value == 0;
+    }
+}
+
+/*
+ * Function: RunMethod
+ * ----------------------------
+ *  Evaluates a method options->iterations times and reports the time per call
+ *  and what each call did. The ring is reset before every call so each one
+ *  starts from the same state.
+ *
+ *  Returns: true if every call returned the expected result
+ */
+static bool RunMethod(uint32_t method)
+{
+    const AMLB_OPTIONS *options = gBench.options;
+    uint8_t entry[AMLB_ENTRY_LENGTH];
+    uint8_t variable[16];
+    ACPI_OBJECT thresholds[3];
+    ACPI_OBJECT profile[AMLB_PROFILE_VARS];
+    ACPI_OBJECT args[3];
+    ACPI_OBJECT_LIST list;
+    AMLB_COUNTERS total;
+    uint64_t totalNs = 0;
+    uint64_t minNs = UINT64_MAX;
+    uint64_t maxNs = 0;
+    uint32_t failed = 0;
+
+    memset(entry, 0, sizeof(entry));
+    memcpy(variable, gVarOnTemp, sizeof(variable));
+    memset(args, 0, sizeof(args));
+    memset(thresholds, 0, sizeof(thresholds));
+    memset(profile, 0, sizeof(profile));
+    memset(&total, 0, sizeof(total));
+    list.Count = 0;
+    list.Pointer = args;
+
+    switch (method) {
+    case AMLB_QTXB:
+        args[0].Type = ACPI_TYPE_BUFFER;
+        args[0].Buffer.Length = sizeof(entry);
+        args[0].Buffer.Pointer = entry;
+        args[1].Type = ACPI_TYPE_INTEGER;
+        args[1].Integer.Value = AMLB_ENTRY_LENGTH;
+        list.Count = 2;
+        break;
+    case AMLB_RXDB:
+        args[0].Type = ACPI_TYPE_INTEGER;
+        list.Count = 1;
+        break;
+    case AMLB_ASYB:
+        args[0].Type = ACPI_TYPE_INTEGER;
+        args[0].Integer.Value = AMLB_BATCH;
+        list.Count = 1;
+        break;
+    case AMLB_THRS:
+        // No timeout, 290.0K to 310.0K
+        for (uint32_t i = 0; i < 3; i++) {
+            thresholds[i].Type = ACPI_TYPE_INTEGER;
+        }
+        thresholds[1].Integer.Value = 2900;
+        thresholds[2].Integer.Value = 3100;
+        args[0].Type = ACPI_TYPE_INTEGER;
+        args[0].Integer.Value = AMLB_SENSOR;
+        args[1].Type = ACPI_TYPE_PACKAGE;
+        args[1].Package.Count = 3;
+        args[1].Package.Elements = thresholds;
+        list.Count = 2;
+        break;
+    case AMLB_GVAR:
+    case AMLB_SVAR:
+        // Instance 1 of OnTemp, written back with the value GVAR expects
+        args[0].Type = ACPI_TYPE_INTEGER;
+        args[0].Integer.Value = 1;
+        args[1].Type = ACPI_TYPE_BUFFER;
+        args[1].Buffer.Length = sizeof(variable);
+        args[1].Buffer.Pointer = variable;
+        args[2].Type = ACPI_TYPE_INTEGER;
+        args[2].Integer.Value = AMLB_ON_TEMP;
+        list.Count = method == AMLB_SVAR ? 3 : 2;
+        break;
+    case AMLB_SPRF:
+        // The curve ecsim starts with, so every call writes the same values
+        for (uint32_t i = 0; i < AMLB_PROFILE_VARS; i++) {
+            profile[i].Type = ACPI_TYPE_INTEGER;
+        }
+        profile[0].Integer.Value = AMLB_ON_TEMP;
+        profile[1].Integer.Value = 3330;
+        profile[2].Integer.Value = 3630;
+        profile[3].Integer.Value = 1000;
+        profile[4].Integer.Value = 5000;
+        args[0].Type = ACPI_TYPE_INTEGER;
+        args[0].Integer.Value = 1;
+        args[1].Type = ACPI_TYPE_PACKAGE;
+        args[1].Package.Count = AMLB_PROFILE_VARS;
+        args[1].Package.Elements = profile;
+        list.Count = 2;
+        break;
+    default:
+        break;
+    }
+
+    for (uint32_t i = 0; i < options->iterations; i++) {
+        ACPI_BUFFER result = { ACPI_ALLOCATE_BUFFER, NULL };
+        uint16_t sequence = 0;
+        ACPI_STATUS status;
+
+        gBench.pending = false;
+        gBench.doorbell = false;
+        gBench.publishSlot = NULL;
+        ResetRing(method);
+        if (method == AMLB_RXDB) {
+            sequence = PostResponse(i);
+            args[0].Integer.Value = sequence;
+        }
+        memset(&gBench.counters, 0, sizeof(gBench.counters));
+        gBench.lastRead = AMLB_WINDOW_SIZE;
+
+        CLOCK::time_point start = CLOCK::now();
+        status = AcpiEvaluateObject(NULL, (ACPI_STRING)gMethods[method].path, list.Count ? &list : NULL, &result);
+        uint64_t ns = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(CLOCK::now() - start).count();
+
+        if (ACPI_FAILURE(status) || !CheckResult(method, (ACPI_OBJECT *)result.Pointer, sequence)) {
+            if (failed++ == 0) {
+                printf("%s call %u failed %s\n", gMethods[method].name, i, AcpiFormatException(status));
+            }
+        }
+        if (result.Pointer != NULL) {
+            AcpiOsFree(result.Pointer);
+        }
+
+        totalNs += ns;
+        minNs = ns < minNs ? ns : minNs;
+        maxNs = ns > maxNs ? ns : maxNs;
+        total.reads += gBench.counters.reads;
+        total.writes += gBench.counters.writes;
+        total.txPasses += gBench.counters.txPasses;
+        total.rxPasses += gBench.counters.rxPasses;
+        total.sleeps += gBench.counters.sleeps;
+        total.sleepMs += gBench.counters.sleepMs;
+        total.ffaCalls += gBench.counters.ffaCalls;
+        total.ecNs += gBench.counters.ecNs;
+    }
+
+    double calls = options->iterations;
+    printf("%-5s %8u calls %9.2f us avg %9.2f min %9.2f max  aml %9.2f us  ec %7.2f us  failed %u\n",
+           gMethods[method].name, options->iterations, totalNs / 1000.0 / calls, minNs / 1000.0, maxNs / 1000.0,
+           (totalNs - total.ecNs) / 1000.0 / calls, total.ecNs / 1000.0 / calls, failed);
+    printf("      %6.2f loop passes (tx %.2f rx %.2f)  %6.2f sleeps (%.1f ms%s)  %6.1f reads %6.1f writes  %4.2f FF-A calls\n",
+           (total.txPasses + total.rxPasses) / calls, total.txPasses / calls, total.rxPasses / calls,
+           total.sleeps / calls, total.sleepMs / calls, options->sleep ? "" : " not taken",
+           total.reads / calls, total.writes / calls, total.ffaCalls / calls);
+    return failed == 0;
+}
+
+static void Usage(void)
+{
+    printf("Usage: amlbench <amlbench.aml> [QTXB|RXDB|ASYC|ASYB|_TMP|THRS|GVAR|SVAR|SPRF|all] [-iterations N] [-occupied K] [-latency P] [-sleep]\n");
+    printf("  -iterations N  Calls per method, default 1000\n");
+    printf("  -occupied K    Slots ahead of the one QTXB and RXDB find, 0-%u\n", ECRING_SLOTS - 1);
+    printf("  -latency P     Sleep() calls before the EC answers a doorbell or RXDB, 0-%u\n", AMLB_MAX_POLLS - 1);
+    printf("  -sleep         Take the sleeps instead of counting them\n");
+}
+
+int main(int argc, char **argv)
+{
+    AMLB_OPTIONS options;
+    const char *path = NULL;
+    bool ok = true;
+    bool found = false;
+
+    options.method = "all";
+    options.iterations = 1000;
+    options.occupied = 0;
+    options.latency = 0;
+    options.sleep = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-iterations") == 0 && i + 1 < argc) {
+            options.iterations = (uint32_t)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-occupied") == 0 && i + 1 < argc) {
+            options.occupied = (uint32_t)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-latency") == 0 && i + 1 < argc) {
+            options.latency = (uint32_t)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-sleep") == 0) {
+            options.sleep = true;
+        } else if (argv[i][0] != '-' && path == NULL) {
+            path = argv[i];
+        } else if (argv[i][0] != '-') {
+            options.method = argv[i];
+        } else {
+            Usage();
+            return 1;
+        }
+    }
+    if (path == NULL || options.iterations == 0 || options.occupied >= ECRING_SLOTS ||
+        options.latency >= AMLB_MAX_POLLS) {
+        Usage();
+        return 1;
+    }
+
+    gBench.options = &options;
+    gBench.sim = EcSimCreate();
+    EcSimAttachRing(gBench.sim, gWindow, gWindow + ECRING_WINDOW_SIZE);
+    if (!Initialize(path)) {
+        EcSimDestroy(gBench.sim);
+        return 1;
+    }
+
+    for (uint32_t i = 0; i < AMLB_METHODS; i++) {
+        if (strcmp(options.method, "all") == 0 || strcmp(options.method, gMethods[i].name) == 0) {
+            ok = RunMethod(i) && ok;
+            found = true;
+        }
+    }
+
+    AcpiTerminate();
+    EcSimDestroy(gBench.sim);
+    if (!found) {
+        Usage();
+        return 1;
+    }
+    printf("%s\n", ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+}
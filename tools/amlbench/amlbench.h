@@ -0,0 +1,41 @@
+/*
+MIT License
+
+Copyright (c) 2025 Open Device Partnership
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Glue between the ACPICA OS services layer in amlosl.cpp and the AML
+// benchmark. Physical addresses are host pointers, as in ecsim, so the tables
+// the benchmark builds in memory are mapped by returning the address itself.
+
+#pragma once
+
+#include <stdint.h>
+
+extern "C" {
+    #include "acpi.h"
+}
+
+// Root pointer of the RSDP the benchmark built, 0 until it has
+ACPI_PHYSICAL_ADDRESS AmlBenchRootPointer(void);
+
+// Called for every Sleep() the AML makes, polling loops sleep between passes
+void AmlBenchSleep(UINT64 milliseconds);
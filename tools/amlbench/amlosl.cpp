@@ -0,0 +1,342 @@
+/*
+MIT License
+
+Copyright (c) 2025 Open Device Partnership
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Minimal ACPICA OS services layer for amlbench. The benchmark evaluates
+// methods from a single thread, so deferred work runs inline and interrupts
+// never arrive. Semaphores and locks are still real so the interpreter's own
+// locking is exercised as it would be under acpiexec. Only what the core needs
+// with ACPI_USE_LOCAL_CACHE and without the debugger is implemented.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <pthread.h>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "amlbench.h"
+
+struct AML_SEMAPHORE {
+    std::mutex lock;
+    std::condition_variable available;
+    UINT32 units;
+    UINT32 maxUnits;
+};
+
+static const std::chrono::steady_clock::time_point gEpoch = std::chrono::steady_clock::now();
+
+ACPI_STATUS AcpiOsInitialize(void)
+{
+    return AE_OK;
+}
+
+ACPI_STATUS AcpiOsTerminate(void)
+{
+    return AE_OK;
+}
+
+ACPI_PHYSICAL_ADDRESS AcpiOsGetRootPointer(void)
+{
+    return AmlBenchRootPointer();
+}
+
+ACPI_STATUS AcpiOsPredefinedOverride(const ACPI_PREDEFINED_NAMES *InitVal, ACPI_STRING *NewVal)
+{
+    (void)InitVal;
+    *NewVal = NULL;
+    return AE_OK;
+}
+
+ACPI_STATUS AcpiOsTableOverride(ACPI_TABLE_HEADER *ExistingTable, ACPI_TABLE_HEADER **NewTable)
+{
+    (void)ExistingTable;
+    *NewTable = NULL;
+    return AE_OK;
+}
+
+ACPI_STATUS AcpiOsPhysicalTableOverride(ACPI_TABLE_HEADER *ExistingTable, ACPI_PHYSICAL_ADDRESS *NewAddress, UINT32 *NewTableLength)
+{
+    (void)ExistingTable;
+    *NewAddress = 0;
+    *NewTableLength = 0;
+    return AE_OK;
+}
+
+ACPI_STATUS AcpiOsCreateLock(ACPI_SPINLOCK *OutHandle)
+{
+    *OutHandle = new std::mutex();
+    return AE_OK;
+}
+
+void AcpiOsDeleteLock(ACPI_SPINLOCK Handle)
+{
+    delete (std::mutex *)Handle;
+}
+
+ACPI_CPU_FLAGS AcpiOsAcquireLock(ACPI_SPINLOCK Handle)
+{
+    ((std::mutex *)Handle)->lock();
+    return 0;
+}
+
+void AcpiOsReleaseLock(ACPI_SPINLOCK Handle, ACPI_CPU_FLAGS Flags)
+{
+    (void)Flags;
+    ((std::mutex *)Handle)->unlock();
+}
+
+ACPI_STATUS AcpiOsCreateSemaphore(UINT32 MaxUnits, UINT32 InitialUnits, ACPI_SEMAPHORE *OutHandle)
+{
+    AML_SEMAPHORE *semaphore;
+
+    if (OutHandle == NULL || InitialUnits > MaxUnits) {
+        return AE_BAD_PARAMETER;
+    }
+    semaphore = new AML_SEMAPHORE();
+    semaphore->units = InitialUnits;
+    semaphore->maxUnits = MaxUnits;
+    *OutHandle = semaphore;
+    return AE_OK;
+}
+
+ACPI_STATUS AcpiOsDeleteSemaphore(ACPI_SEMAPHORE Handle)
+{
+    if (Handle == NULL) {
+        return AE_BAD_PARAMETER;
+    }
+    delete (AML_SEMAPHORE *)Handle;
+    return AE_OK;
+}
+
+ACPI_STATUS AcpiOsWaitSemaphore(ACPI_SEMAPHORE Handle, UINT32 Units, UINT16 Timeout)
+{
+    AML_SEMAPHORE *semaphore = (AML_SEMAPHORE *)Handle;
+    std::unique_lock<std::mutex> lock(semaphore->lock);
+    auto ready = [&] { return semaphore->units >= Units; };
+
+    if (Timeout == ACPI_WAIT_FOREVER) {
+        semaphore->available.wait(lock, ready);
+    } else if (!semaphore->available.wait_for(lock, std::chrono::milliseconds(Timeout), ready)) {
+        return AE_TIME;
+    }
+    semaphore->units -= Units;
+    return AE_OK;
+}
+
+ACPI_STATUS AcpiOsSignalSemaphore(ACPI_SEMAPHORE Handle, UINT32 Units)
+{
+    AML_SEMAPHORE *semaphore = (AML_SEMAPHORE *)Handle;
+    std::lock_guard<std::mutex> lock(semaphore->lock);
+
+    if (semaphore->units + Units > semaphore->maxUnits) {
+        return AE_LIMIT;
+    }
+    semaphore->units += Units;
+    semaphore->available.notify_all();
+    return AE_OK;
+}
+
+#if (ACPI_MUTEX_TYPE != ACPI_BINARY_SEMAPHORE)
+ACPI_STATUS AcpiOsCreateMutex(ACPI_MUTEX *OutHandle)
+{
+    return AcpiOsCreateSemaphore(1, 1, OutHandle);
+}
+
+void AcpiOsDeleteMutex(ACPI_MUTEX Handle)
+{
+    AcpiOsDeleteSemaphore(Handle);
+}
+
+ACPI_STATUS AcpiOsAcquireMutex(ACPI_MUTEX Handle, UINT16 Timeout)
+{
+    return AcpiOsWaitSemaphore(Handle, 1, Timeout);
+}
+
+void AcpiOsReleaseMutex(ACPI_MUTEX Handle)
+{
+    AcpiOsSignalSemaphore(Handle, 1);
+}
+#endif
+
+void *AcpiOsAllocate(ACPI_SIZE Size)
+{
+    return malloc((size_t)Size);
+}
+
+void AcpiOsFree(void *Memory)
+{
+    free(Memory);
+}
+
+void *AcpiOsMapMemory(ACPI_PHYSICAL_ADDRESS Where, ACPI_SIZE Length)
+{
+    (void)Length;
+    return ACPI_TO_POINTER((ACPI_SIZE)Where);
+}
+
+void AcpiOsUnmapMemory(void *LogicalAddress, ACPI_SIZE Size)
+{
+    (void)LogicalAddress;
+    (void)Size;
+}
+
+ACPI_STATUS AcpiOsGetPhysicalAddress(void *LogicalAddress, ACPI_PHYSICAL_ADDRESS *PhysicalAddress)
+{
+    *PhysicalAddress = (ACPI_PHYSICAL_ADDRESS)ACPI_TO_INTEGER(LogicalAddress);
+    return AE_OK;
+}
+
+ACPI_STATUS AcpiOsInstallInterruptHandler(UINT32 InterruptNumber, ACPI_OSD_HANDLER ServiceRoutine, void *Context)
+{
+    (void)InterruptNumber;
+    (void)ServiceRoutine;
+    (void)Context;
+    return AE_OK;
+}
+
+ACPI_STATUS AcpiOsRemoveInterruptHandler(UINT32 InterruptNumber, ACPI_OSD_HANDLER ServiceRoutine)
+{
+    (void)InterruptNumber;
+    (void)ServiceRoutine;
+    return AE_OK;
+}
+
+ACPI_THREAD_ID AcpiOsGetThreadId(void)
+{
+    return (ACPI_THREAD_ID)(uintptr_t)pthread_self();
+}
+
+ACPI_STATUS AcpiOsExecute(ACPI_EXECUTE_TYPE Type, ACPI_OSD_EXEC_CALLBACK Function, void *Context)
+{
+    // Notify handlers and GPE work run inline, nothing else is running
+    (void)Type;
+    Function(Context);
+    return AE_OK;
+}
+
+void AcpiOsWaitEventsComplete(void)
+{
+}
+
+void AcpiOsSleep(UINT64 Milliseconds)
+{
+    AmlBenchSleep(Milliseconds);
+}
+
+void AcpiOsStall(UINT32 Microseconds)
+{
+    std::this_thread::sleep_for(std::chrono::microseconds(Microseconds));
+}
+
+ACPI_STATUS AcpiOsReadPort(ACPI_IO_ADDRESS Address, UINT32 *Value, UINT32 Width)
+{
+    (void)Address;
+    (void)Width;
+    *Value = 0;
+    return AE_OK;
+}
+
+ACPI_STATUS AcpiOsWritePort(ACPI_IO_ADDRESS Address, UINT32 Value, UINT32 Width)
+{
+    (void)Address;
+    (void)Value;
+    (void)Width;
+    return AE_OK;
+}
+
+// Only reached through FADT registers, which a hardware reduced FADT has none of
+ACPI_STATUS AcpiOsReadMemory(ACPI_PHYSICAL_ADDRESS Address, UINT64 *Value, UINT32 Width)
+{
+    (void)Address;
+    (void)Width;
+    *Value = 0;
+    return AE_BAD_ADDRESS;
+}
+
+ACPI_STATUS AcpiOsWriteMemory(ACPI_PHYSICAL_ADDRESS Address, UINT64 Value, UINT32 Width)
+{
+    (void)Address;
+    (void)Value;
+    (void)Width;
+    return AE_BAD_ADDRESS;
+}
+
+ACPI_STATUS AcpiOsReadPciConfiguration(ACPI_PCI_ID *PciId, UINT32 Reg, UINT64 *Value, UINT32 Width)
+{
+    (void)PciId;
+    (void)Reg;
+    (void)Width;
+    *Value = 0;
+    return AE_OK;
+}
+
+ACPI_STATUS AcpiOsWritePciConfiguration(ACPI_PCI_ID *PciId, UINT32 Reg, UINT64 Value, UINT32 Width)
+{
+    (void)PciId;
+    (void)Reg;
+    (void)Value;
+    (void)Width;
+    return AE_OK;
+}
+
+UINT64 AcpiOsGetTimer(void)
+{
+    // 100ns units
+    return (UINT64)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - gEpoch).count() / 100;
+}
+
+ACPI_STATUS AcpiOsSignal(UINT32 Function, void *Info)
+{
+    if (Function == ACPI_SIGNAL_FATAL) {
+        ACPI_SIGNAL_FATAL_INFO *fatal = (ACPI_SIGNAL_FATAL_INFO *)Info;
+
+        fprintf(stderr, "AML Fatal: type %X code %X argument %X\n", fatal->Type, fatal->Code, fatal->Argument);
+    }
+    return AE_OK;
+}
+
+ACPI_STATUS AcpiOsEnterSleep(UINT8 SleepState, UINT32 RegaValue, UINT32 RegbValue)
+{
+    (void)SleepState;
+    (void)RegaValue;
+    (void)RegbValue;
+    return AE_OK;
+}
+
+// Interpreter messages go to stderr so they do not mix with the results
+void ACPI_INTERNAL_VAR_XFACE AcpiOsPrintf(const char *Format, ...)
+{
+    va_list args;
+
+    va_start(args, Format);
+    AcpiOsVprintf(Format, args);
+    va_end(args);
+}
+
+void AcpiOsVprintf(const char *Format, va_list Args)
+{
+    vfprintf(stderr, Format, Args);
+}
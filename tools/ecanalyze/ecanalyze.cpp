@@ -0,0 +1,683 @@
+/*
+MIT License
+
+Copyright (c) 2025 Open Device Partnership
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Offline analysis of ectest -watch captures. Blocks of a series are decoded in
+// parallel and reduced with vector kernels, so a day of 10Hz samples takes well
+// under a second per query. Builds on any host with a C++11 compiler.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define ECA_AVX2
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define ECA_NEON
+#endif
+
+extern "C" {
+    #include "../../inc/ectsdb.h"
+}
+
+#define ECA_MIN_ARG_COUNT 3  // Always need ecanalyze <file> <command>
+
+// Decoded samples of one block, trimmed to the requested time range
+typedef struct {
+    std::vector<int64_t> timestamps;
+    std::vector<int64_t> values;
+} BLOCK_SAMPLES;
+
+// Threshold crossings counted within one block
+typedef struct {
+    uint64_t up;
+    uint64_t down;
+    uint64_t above;
+} CROSSINGS;
+
+static int64_t gBegin = INT64_MIN;
+static int64_t gEnd = INT64_MAX;
+
+/*
+ * Function: void MinMaxSum
+ *
+ * Description:
+ * Vector reduction of min, max and sum over an array of samples. The caller seeds
+ * min/max/sum and the results are merged into them.
+ *
+ * Parameters:
+ * v: Sample values
+ * n: Number of samples
+ * min, max, sum: Running results
+ *
+ * Return Value:
+ * None
+ */
+static void MinMaxSum(const int64_t *v, size_t n, int64_t *min, int64_t *max, int64_t *sum)
+{
+    size_t i = 0;
+    int64_t lo = *min, hi = *max, total = *sum;
+
+#if defined(ECA_AVX2)
+    if (n >= 4) {
+        __m256i vmin = _mm256_set1_epi64x(lo);
+        __m256i vmax = _mm256_set1_epi64x(hi);
+        __m256i vsum = _mm256_setzero_si256();
+        for (; i + 4 <= n; i += 4) {
+            __m256i x = _mm256_loadu_si256((const __m256i *)(v + i));
+            vmin = _mm256_blendv_epi8(vmin, x, _mm256_cmpgt_epi64(vmin, x));
+            vmax = _mm256_blendv_epi8(vmax, x, _mm256_cmpgt_epi64(x, vmax));
+            vsum = _mm256_add_epi64(vsum, x);
+        }
+
+        int64_t lanes[3][4];
+        _mm256_storeu_si256((__m256i *)lanes[0], vmin);
+        _mm256_storeu_si256((__m256i *)lanes[1], vmax);
+        _mm256_storeu_si256((__m256i *)lanes[2], vsum);
+        for (int j = 0; j < 4; j++) {
+            lo = std::min(lo, lanes[0][j]);
+            hi = std::max(hi, lanes[1][j]);
+            total += lanes[2][j];
+        }
+    }
+#elif defined(ECA_NEON)
+    if (n >= 2) {
+        int64x2_t vmin = vdupq_n_s64(lo);
+        int64x2_t vmax = vdupq_n_s64(hi);
+        int64x2_t vsum = vdupq_n_s64(0);
+        for (; i + 2 <= n; i += 2) {
+            int64x2_t x = vld1q_s64(v + i);
+            vmin = vbslq_s64(vcgtq_s64(vmin, x), x, vmin);
+            vmax = vbslq_s64(vcgtq_s64(x, vmax), x, vmax);
+            vsum = vaddq_s64(vsum, x);
+        }
+
+        lo = std::min(lo, std::min(vgetq_lane_s64(vmin, 0), vgetq_lane_s64(vmin, 1)));
+        hi = std::max(hi, std::max(vgetq_lane_s64(vmax, 0), vgetq_lane_s64(vmax, 1)));
+        total += vaddvq_s64(vsum);
+    }
+#endif
+
+    for (; i < n; i++) {
+        lo = std::min(lo, v[i]);
+        hi = std::max(hi, v[i]);
+        total += v[i];
+    }
+
+    *min = lo;
+    *max = hi;
+    *sum = total;
+}
+
+/*
+ * Function: CROSSINGS CountCrossings
+ *
+ * Description:
+ * Counts upward and downward crossings of a threshold and the number of samples at
+ * or above it. A crossing is counted between v[i-1] and v[i], so crossings between
+ * blocks are left to the caller.
+ *
+ * Parameters:
+ * v: Sample values
+ * n: Number of samples
+ * threshold: Value compared against with >=
+ *
+ * Return Value:
+ * Crossing counts for the array
+ */
+static CROSSINGS CountCrossings(const int64_t *v, size_t n, int64_t threshold)
+{
+    CROSSINGS c = { 0, 0, 0 };
+    size_t i = 1;
+
+    if (n == 0) {
+        return c;
+    }
+
+    c.above = (v[0] >= threshold);
+
+#if defined(ECA_AVX2)
+    // AVX2 only has a signed greater-than, threshold > x means x is below
+    const __m256i limit = _mm256_set1_epi64x(threshold);
+    for (; i + 4 <= n; i += 4) {
+        __m256i cur = _mm256_loadu_si256((const __m256i *)(v + i));
+        __m256i prev = _mm256_loadu_si256((const __m256i *)(v + i - 1));
+        int below_cur = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(limit, cur)));
+        int below_prev = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(limit, prev)));
+        c.up += _mm_popcnt_u32(below_prev & ~below_cur & 0xF);
+        c.down += _mm_popcnt_u32(~below_prev & below_cur & 0xF);
+        c.above += 4 - _mm_popcnt_u32(below_cur);
+    }
+#elif defined(ECA_NEON)
+    const int64x2_t limit = vdupq_n_s64(threshold);
+    uint64x2_t up = vdupq_n_u64(0), down = vdupq_n_u64(0), above = vdupq_n_u64(0);
+    for (; i + 2 <= n; i += 2) {
+        uint64x2_t cur = vcgeq_s64(vld1q_s64(v + i), limit);
+        uint64x2_t prev = vcgeq_s64(vld1q_s64(v + i - 1), limit);
+        // Masks are all ones, shift down to 0/1 and accumulate
+        up = vaddq_u64(up, vshrq_n_u64(vbicq_u64(cur, prev), 63));
+        down = vaddq_u64(down, vshrq_n_u64(vbicq_u64(prev, cur), 63));
+        above = vaddq_u64(above, vshrq_n_u64(cur, 63));
+    }
+    c.up += vaddvq_u64(up);
+    c.down += vaddvq_u64(down);
+    c.above += vaddvq_u64(above);
+#endif
+
+    for (; i < n; i++) {
+        bool cur = v[i] >= threshold;
+        bool prev = v[i - 1] >= threshold;
+        c.up += (cur && !prev);
+        c.down += (!cur && prev);
+        c.above += cur;
+    }
+
+    return c;
+}
+
+/*
+ * Function: int CollectBlock
+ *
+ * Description:
+ * EctsScanBlocks callback appending each overlapping block to a vector.
+ *
+ * Parameters:
+ * ctx: std::vector of block headers
+ * block: Block overlapping the range
+ *
+ * Return Value:
+ * ECTS_STATUS_SUCCESS
+ */
+static int CollectBlock(void *ctx, const ECTS_BLOCK_HEADER *block)
+{
+    ((std::vector<const ECTS_BLOCK_HEADER *> *)ctx)->push_back(block);
+    return ECTS_STATUS_SUCCESS;
+}
+
+/*
+ * Function: int LoadSeries
+ *
+ * Description:
+ * Decodes every block of a series that overlaps [gBegin, gEnd] using one worker
+ * per hardware thread. Blocks are claimed from a shared counter and results are
+ * kept in file order, which is time order for a single series.
+ *
+ * Parameters:
+ * reader: Open capture reader
+ * series: Series ID to load
+ * out: Receives one entry per overlapping block
+ *
+ * Return Value:
+ * ECTS_STATUS_SUCCESS or failure code
+ */
+static int LoadSeries(ECTS_READER *reader, uint32_t series, std::vector<BLOCK_SAMPLES> &out)
+{
+    std::vector<const ECTS_BLOCK_HEADER *> blocks;
+
+    // The index leads straight to the first overlapping block, after that the reader is shared read-only
+    int found = EctsScanBlocks(reader, series, gBegin, gEnd, CollectBlock, &blocks);
+    if (found != ECTS_STATUS_SUCCESS) {
+        return found;
+    }
+
+    out.assign(blocks.size(), BLOCK_SAMPLES());
+
+    std::atomic<size_t> next(0);
+    std::atomic<int> status(ECTS_STATUS_SUCCESS);
+    auto worker = [&]() {
+        int64_t timestamps[ECTS_BLOCK_MAX_SAMPLES];
+        int64_t values[ECTS_BLOCK_MAX_SAMPLES];
+        uint32_t n;
+
+        for (size_t k = next++; k < blocks.size(); k = next++) {
+            int s = EctsDecodeBlockData(blocks[k], timestamps, values, ECTS_BLOCK_MAX_SAMPLES, &n);
+            if (s != ECTS_STATUS_SUCCESS) {
+                status = s;
+                return;
+            }
+
+            // Timestamps are sorted within a block, trim to the range
+            const int64_t *first = std::lower_bound(timestamps, timestamps + n, gBegin);
+            const int64_t *last = std::upper_bound(first, (const int64_t *)timestamps + n, gEnd);
+            size_t lo = first - timestamps, hi = last - timestamps;
+            out[k].timestamps.assign(timestamps + lo, timestamps + hi);
+            out[k].values.assign(values + lo, values + hi);
+        }
+    };
+
+    unsigned workers = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::thread> threads;
+    for (unsigned i = 1; i < workers; i++) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto &t : threads) {
+        t.join();
+    }
+
+    return status;
+}
+
+/*
+ * Function: int PrintStats
+ *
+ * Description:
+ * Prints count, min, max, mean and percentiles of a series over the time range.
+ *
+ * Parameters:
+ * reader: Open capture reader
+ * series: Series ID to summarize
+ *
+ * Return Value:
+ * ECTS_STATUS_SUCCESS or failure code
+ */
+static int PrintStats(ECTS_READER *reader, uint32_t series)
+{
+    static const double percentiles[] = { 50.0, 90.0, 99.0, 99.9 };
+    std::vector<BLOCK_SAMPLES> blocks;
+    std::vector<int64_t> values;
+    int64_t min = INT64_MAX, max = INT64_MIN, sum = 0;
+
+    int status = LoadSeries(reader, series, blocks);
+    if (status != ECTS_STATUS_SUCCESS) {
+        return status;
+    }
+
+    for (const auto &b : blocks) {
+        MinMaxSum(b.values.data(), b.values.size(), &min, &max, &sum);
+        values.insert(values.end(), b.values.begin(), b.values.end());
+    }
+
+    if (values.empty()) {
+        printf("No samples in range\n");
+        return ECTS_STATUS_SUCCESS;
+    }
+
+    printf("count %zu\n", values.size());
+    printf("min   %lld\n", (long long)min);
+    printf("max   %lld\n", (long long)max);
+    printf("mean  %.3f\n", (double)sum / values.size());
+
+    // Percentiles are increasing, each selection only needs the tail left by the previous one
+    auto from = values.begin();
+    for (double p : percentiles) {
+        auto nth = values.begin() + (size_t)((p / 100.0) * (values.size() - 1));
+        std::nth_element(from, nth, values.end());
+        printf("p%-4g %lld\n", p, (long long)*nth);
+        from = nth;
+    }
+
+    return ECTS_STATUS_SUCCESS;
+}
+
+/*
+ * Function: int PrintCrossings
+ *
+ * Description:
+ * Counts threshold crossings of a temperature series against the fan thresholds.
+ * Blocks are counted in parallel and the boundaries between blocks are stitched
+ * afterwards.
+ *
+ * Parameters:
+ * reader: Open capture reader
+ * series: Series ID of the temperature
+ * thresholds: FAN_ON, RAMP and MAX temperatures in the series units
+ *
+ * Return Value:
+ * ECTS_STATUS_SUCCESS or failure code
+ */
+static int PrintCrossings(ECTS_READER *reader, uint32_t series, const int64_t thresholds[3])
+{
+    static const char *names[] = { "FAN_ON", "RAMP", "MAX" };
+    std::vector<BLOCK_SAMPLES> blocks;
+    uint64_t total = 0;
+
+    int status = LoadSeries(reader, series, blocks);
+    if (status != ECTS_STATUS_SUCCESS) {
+        return status;
+    }
+
+    for (const auto &b : blocks) {
+        total += b.values.size();
+    }
+
+    if (total == 0) {
+        printf("No samples in range\n");
+        return ECTS_STATUS_SUCCESS;
+    }
+
+    for (int t = 0; t < 3; t++) {
+        std::vector<CROSSINGS> counts(blocks.size());
+        std::atomic<size_t> next(0);
+        auto worker = [&]() {
+            for (size_t k = next++; k < blocks.size(); k = next++) {
+                counts[k] = CountCrossings(blocks[k].values.data(), blocks[k].values.size(), thresholds[t]);
+            }
+        };
+
+        unsigned workers = std::max(1u, std::thread::hardware_concurrency());
+        std::vector<std::thread> threads;
+        for (unsigned i = 1; i < workers; i++) {
+            threads.emplace_back(worker);
+        }
+        worker();
+        for (auto &th : threads) {
+            th.join();
+        }
+
+        CROSSINGS c = { 0, 0, 0 };
+        const int64_t *prev = NULL;
+        for (size_t k = 0; k < blocks.size(); k++) {
+            if (blocks[k].values.empty()) {
+                continue;
+            }
+
+            if (prev != NULL) {
+                bool cur_above = blocks[k].values.front() >= thresholds[t];
+                bool prev_above = *prev >= thresholds[t];
+                c.up += (cur_above && !prev_above);
+                c.down += (!cur_above && prev_above);
+            }
+
+            c.up += counts[k].up;
+            c.down += counts[k].down;
+            c.above += counts[k].above;
+            prev = &blocks[k].values.back();
+        }
+
+        printf("%-6s %lld: %llu up, %llu down, %.2f%% of samples at or above\n", names[t], (long long)thresholds[t],
+               (unsigned long long)c.up, (unsigned long long)c.down, 100.0 * c.above / total);
+    }
+
+    return ECTS_STATUS_SUCCESS;
+}
+
+/*
+ * Function: int PrintCorrelation
+ *
+ * Description:
+ * Buckets a latency series and a notification series into fixed windows and
+ * reports the Pearson correlation between notifications per window and mean
+ * latency, along with the mean latency of burst and quiet windows.
+ *
+ * Parameters:
+ * reader: Open capture reader
+ * latency: Series ID of the per-request latency
+ * events: Series ID of the notifications
+ * window: Window length in timestamp units
+ * burst: Notifications per window that count as a burst
+ *
+ * Return Value:
+ * ECTS_STATUS_SUCCESS or failure code
+ */
+static int PrintCorrelation(ECTS_READER *reader, uint32_t latency, uint32_t events, int64_t window, uint32_t burst)
+{
+    std::vector<BLOCK_SAMPLES> lat, evt;
+
+    int status = LoadSeries(reader, latency, lat);
+    if (status == ECTS_STATUS_SUCCESS) {
+        status = LoadSeries(reader, events, evt);
+    }
+    if (status != ECTS_STATUS_SUCCESS) {
+        return status;
+    }
+
+    int64_t t0 = INT64_MAX, t1 = INT64_MIN;
+    for (const auto &b : lat) {
+        if (!b.timestamps.empty()) {
+            t0 = std::min(t0, b.timestamps.front());
+            t1 = std::max(t1, b.timestamps.back());
+        }
+    }
+
+    if (t0 > t1) {
+        printf("No latency samples in range\n");
+        return ECTS_STATUS_SUCCESS;
+    }
+
+    size_t windows = (size_t)((t1 - t0) / window) + 1;
+    std::vector<uint32_t> notify(windows, 0), samples(windows, 0);
+    std::vector<int64_t> latency_sum(windows, 0);
+
+    for (const auto &b : lat) {
+        for (size_t i = 0; i < b.timestamps.size(); i++) {
+            size_t w = (size_t)((b.timestamps[i] - t0) / window);
+            samples[w]++;
+            latency_sum[w] += b.values[i];
+        }
+    }
+
+    for (const auto &b : evt) {
+        for (int64_t ts : b.timestamps) {
+            if (ts >= t0 && ts <= t1) {
+                notify[(size_t)((ts - t0) / window)]++;
+            }
+        }
+    }
+
+    double sx = 0, sy = 0, sxx = 0, syy = 0, sxy = 0;
+    double burst_sum = 0, quiet_sum = 0;
+    uint64_t n = 0, burst_n = 0, quiet_n = 0;
+    for (size_t w = 0; w < windows; w++) {
+        if (samples[w] == 0) {
+            continue;
+        }
+
+        double x = notify[w];
+        double y = (double)latency_sum[w] / samples[w];
+        sx += x; sy += y; sxx += x * x; syy += y * y; sxy += x * y;
+        n++;
+
+        if (notify[w] >= burst) {
+            burst_sum += y;
+            burst_n++;
+        } else {
+            quiet_sum += y;
+            quiet_n++;
+        }
+    }
+
+    double cov = sxy - sx * sy / n;
+    double var = (sxx - sx * sx / n) * (syy - sy * sy / n);
+    printf("windows  %llu with latency samples\n", (unsigned long long)n);
+    if (var > 0) {
+        printf("pearson  %.4f\n", cov / sqrt(var));
+    } else {
+        printf("pearson  n/a (no variation)\n");
+    }
+    if (burst_n > 0) {
+        printf("burst    %llu windows, mean latency %.1f\n", (unsigned long long)burst_n, burst_sum / burst_n);
+    }
+    if (quiet_n > 0) {
+        printf("quiet    %llu windows, mean latency %.1f\n", (unsigned long long)quiet_n, quiet_sum / quiet_n);
+    }
+
+    return ECTS_STATUS_SUCCESS;
+}
+
+/*
+ * Function: int FindSeries
+ *
+ * Description:
+ * Looks up a series by name and prints an error if it does not exist.
+ *
+ * Return Value:
+ * ECTS_STATUS_SUCCESS or ECTS_STATUS_NOT_FOUND
+ */
+static int FindSeries(ECTS_READER *reader, const char *name, uint32_t *series)
+{
+    int status = EctsFindSeries(reader, name, series);
+    if (status != ECTS_STATUS_SUCCESS) {
+        printf("Series %s not found, use 'list' to see the captured series\n", name);
+    }
+    return status;
+}
+
+/*
+ * Function: int FirstBlock
+ *
+ * Description:
+ * EctsScanBlocks callback that keeps the earliest first sample seen and stops
+ * the scan at the first block, which holds the earliest samples of its series.
+ *
+ * Parameters:
+ * ctx: int64_t earliest timestamp so far
+ * block: First block of the series
+ *
+ * Return Value:
+ * ECTS_STATUS_NOT_FOUND, which stops the scan
+ */
+static int FirstBlock(void *ctx, const ECTS_BLOCK_HEADER *block)
+{
+    *(int64_t *)ctx = std::min(*(int64_t *)ctx, block->t_first);
+    return ECTS_STATUS_NOT_FOUND;
+}
+
+/*
+ * Function: int ParseRange
+ *
+ * Description:
+ * Consumes optional -from <sec> and -to <sec> arguments. Times are seconds from the
+ * first sample in the capture, rollups aside.
+ *
+ * Parameters:
+ * reader: Open capture reader
+ * argc, argv: Remaining arguments, options are removed
+ *
+ * Return Value:
+ * ECTS_STATUS_SUCCESS or ECTS_STATUS_INVALID_PARAMETER
+ */
+static int ParseRange(ECTS_READER *reader, int *argc, char **argv)
+{
+    int64_t base = INT64_MAX;
+    ECTS_SERIES_INFO info;
+
+    // Rollups are stamped with the start of their window, which may come long
+    // before the first sample, so only the first block of every other series
+    // counts. A series that cannot be read fails later when it is loaded
+    for (uint32_t i = 0; EctsSeriesInfo(reader, i, &info) == ECTS_STATUS_SUCCESS; i++) {
+        if (info.kind != ECTS_SERIES_ROLLUP) {
+            EctsScanBlocks(reader, info.id, INT64_MIN, INT64_MAX, FirstBlock, &base);
+        }
+    }
+    if (base == INT64_MAX) {
+        base = 0;
+    }
+
+    int out = 0;
+    for (int i = 0; i < *argc; i++) {
+        if ((strcmp(argv[i], "-from") == 0 || strcmp(argv[i], "-to") == 0) && i + 1 < *argc) {
+            int64_t t = base + (int64_t)(strtod(argv[i + 1], NULL) * ECTS_TICKS_PER_SECOND);
+            if (argv[i][1] == 'f') {
+                gBegin = t;
+            } else {
+                gEnd = t;
+            }
+            i++;
+        } else {
+            argv[out++] = argv[i];
+        }
+    }
+
+    *argc = out;
+    return (gBegin <= gEnd) ? ECTS_STATUS_SUCCESS : ECTS_STATUS_INVALID_PARAMETER;
+}
+
+static void Usage(void)
+{
+    printf("Usage: ecanalyze <file> list\n");
+    printf("       ecanalyze <file> stats <series> [-from sec] [-to sec]\n");
+    printf("       ecanalyze <file> crossings <series> <fan on> <ramp> <max> [-from sec] [-to sec]\n");
+    printf("       ecanalyze <file> correlate <latency series> <event series> <window ms> <burst> [-from sec] [-to sec]\n");
+}
+
+int main(int argc, char **argv)
+{
+    ECTS_READER *reader = NULL;
+    uint32_t series, events;
+
+    if (argc < ECA_MIN_ARG_COUNT) {
+        Usage();
+        return 1;
+    }
+
+    int status = EctsReaderOpen(argv[1], &reader);
+    if (status != ECTS_STATUS_SUCCESS) {
+        printf("EctsReaderOpen %s failed, status: 0x%x\n", argv[1], status);
+        return 1;
+    }
+
+    const char *command = argv[2];
+    argc -= ECA_MIN_ARG_COUNT;
+    argv += ECA_MIN_ARG_COUNT;
+    status = ParseRange(reader, &argc, argv);
+
+    if (status != ECTS_STATUS_SUCCESS) {
+        printf("-from must not be after -to\n");
+    } else if (strcmp(command, "list") == 0) {
+        ECTS_SERIES_INFO info;
+        for (uint32_t i = 0; EctsSeriesInfo(reader, i, &info) == ECTS_STATUS_SUCCESS; i++) {
+            printf("%3u %-6s %s\n", info.id,
+                   info.kind == ECTS_SERIES_EVENT ? "event" : info.kind == ECTS_SERIES_ROLLUP ? "rollup" : "sample",
+                   info.name);
+        }
+    } else if (strcmp(command, "stats") == 0 && argc == 1) {
+        status = FindSeries(reader, argv[0], &series);
+        if (status == ECTS_STATUS_SUCCESS) {
+            status = PrintStats(reader, series);
+        }
+    } else if (strcmp(command, "crossings") == 0 && argc == 4) {
+        int64_t thresholds[3] = { strtoll(argv[1], NULL, 0), strtoll(argv[2], NULL, 0), strtoll(argv[3], NULL, 0) };
+        status = FindSeries(reader, argv[0], &series);
+        if (status == ECTS_STATUS_SUCCESS) {
+            status = PrintCrossings(reader, series, thresholds);
+        }
+    } else if (strcmp(command, "correlate") == 0 && argc == 4) {
+        int64_t window = strtoll(argv[2], NULL, 0) * (ECTS_TICKS_PER_SECOND / 1000);
+        uint32_t burst = strtoul(argv[3], NULL, 0);
+        status = FindSeries(reader, argv[0], &series);
+        if (status == ECTS_STATUS_SUCCESS) {
+            status = FindSeries(reader, argv[1], &events);
+        }
+        if (status == ECTS_STATUS_SUCCESS && window <= 0) {
+            printf("Window must be at least 1ms\n");
+            status = ECTS_STATUS_INVALID_PARAMETER;
+        }
+        if (status == ECTS_STATUS_SUCCESS) {
+            status = PrintCorrelation(reader, series, events, window, burst);
+        }
+    } else {
+        Usage();
+        status = ECTS_STATUS_INVALID_PARAMETER;
+    }
+
+    EctsReaderClose(reader);
+    return (status == ECTS_STATUS_SUCCESS) ? 0 : 1;
+}
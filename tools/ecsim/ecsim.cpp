@@ -0,0 +1,1250 @@
+/*
+MIT License
+
+Copyright (c) 2025 Open Device Partnership
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// EC secure partition model, see ecsim.h
+
+#include <math.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include "ecsim.h"
+
+extern "C" {
+    #include "../../inc/ecring.h"
+    #include "../../kmdf/ecmsg.h"
+    #include "../../uefi/Platforms/QemuSbsaPkg/SbsaQemuPlatformDxe/FfaMemDescriptor.h"
+    #include "../../uefi/Platforms/QemuSbsaPkg/SbsaQemuPlatformDxe/EcStaticSnapshot.h"
+}
+
+// Direct request commands of the EC management service, command in x4
+#define ECSIM_CMD_GET_FW_STATE  0x1
+
+// Direct request commands of the thermal service, as thermal.asl builds them
+#define ECSIM_THM_GET_TMP       0x1
+#define ECSIM_THM_SET_THRS      0x2
+#define ECSIM_THM_GET_VAR       0x5
+#define ECSIM_THM_SET_VAR       0x6
+#define ECSIM_THM_SET_PROFILE   0x7
+
+// Handles carry bits above 32 so both halves of the SMC arguments are exercised
+#define ECSIM_HANDLE_BASE       0x100000000ull
+
+// A region shared with FFA_MEM_SHARE, free while handle is 0
+struct ECSIM_SHARE {
+    uint64_t handle;
+    uint64_t tag;
+    uint16_t sender;
+    uint8_t permissions;
+    bool retrieved;             // Set by MAP_SHARE, cleared by UNMAP_SHARE
+    uint32_t rangeCount;
+    FFA_MEM_RANGE ranges[FFA_MEM_MAX_RANGES];
+};
+
+// A thermal service variable, ordered by creation
+struct ECSIM_VAR {
+    uint8_t id[16];
+    uint16_t instance;
+    uint16_t length;
+    uint64_t generation;
+    uint8_t value[EC_VAR_MAX_LENGTH];
+};
+
+// Variables of thermal.asl, instance 1, in tenths of a Kelvin
+static const struct {
+    uint8_t id[16];
+    uint32_t value;
+} gDefaultVars[] = {
+    // OnTemp ba17b567-c368-48d5-bc6f-a312a41583c1
+    { { 0x67, 0xb5, 0x17, 0xba, 0x68, 0xc3, 0xd5, 0x48, 0xbc, 0x6f, 0xa3, 0x12, 0xa4, 0x15, 0x83, 0xc1 }, 3130 },
+    // RampTemp 3a62688c-d95b-4d2d-bacc-90d7a5816bcd
+    { { 0x8c, 0x68, 0x62, 0x3a, 0x5b, 0xd9, 0x2d, 0x4d, 0xba, 0xcc, 0x90, 0xd7, 0xa5, 0x81, 0x6b, 0xcd }, 3330 },
+    // MaxTemp dcb758b1-f0fd-4ec7-b2c0-ef1e2a547b76
+    { { 0xb1, 0x58, 0xb7, 0xdc, 0xfd, 0xf0, 0xc7, 0x4e, 0xb2, 0xc0, 0xef, 0x1e, 0x2a, 0x54, 0x7b, 0x76 }, 3630 },
+};
+
+// Fan variables of the thermal service, instance 1, in RPM
+// FAN_CURRENT_RPM adf95492-0776-4ffc-84f3-b6c8b5269683
+static const uint8_t gFanCurrentRpm[16] = { 0x92, 0x54, 0xf9, 0xad, 0x76, 0x07, 0xfc, 0x4f, 0x84, 0xf3, 0xb6, 0xc8, 0xb5, 0x26, 0x96, 0x83 };
+// FAN_MIN_RPM db261c77-934b-45e2-9742-256c62badb7a
+static const uint8_t gFanMinRpm[16] = { 0x77, 0x1c, 0x26, 0xdb, 0x4b, 0x93, 0xe2, 0x45, 0x97, 0x42, 0x25, 0x6c, 0x62, 0xba, 0xdb, 0x7a };
+// FAN_MAX_RPM 5cf839df-8be7-42b9-9ac5-3403ca2c8a6a
+static const uint8_t gFanMaxRpm[16] = { 0xdf, 0x39, 0xf8, 0x5c, 0xe7, 0x8b, 0xb9, 0x42, 0x9a, 0xc5, 0x34, 0x03, 0xca, 0x2c, 0x8a, 0x6a };
+
+// Variables EC_MSG_CMD_SET_FAN_PROFILE writes, in MsgFanProfileReq_t order
+static const uint8_t *const gFanProfileVars[EC_FAN_PROFILE_VARS] = {
+    gDefaultVars[0].id, gDefaultVars[1].id, gDefaultVars[2].id, gFanMinRpm, gFanMaxRpm
+};
+
+// Longest step the thermal model integrates at once
+#define ECSIM_PLANT_STEP_US     100000
+
+// Thermal model of ECSIM_PLANT_ZONE, see EcSimPlantStart
+struct ECSIM_PLANT {
+    bool running;
+    ECSIM_PLANT_CONFIG config;
+    double heat;                // W
+    double skin;                // K
+    double sensor;              // K
+    double fan;                 // Actual RPM
+    double command;             // Commanded RPM
+    uint64_t time;              // Model microseconds integrated so far
+    uint64_t advanced;          // Added by EcSimPlantAdvance
+    uint64_t start;             // EcTime of EcSimPlantStart
+    uint32_t low;               // THRS range in tenths of a Kelvin, empty if low > high
+    uint32_t high;
+    bool outside;               // Sensor was outside the range at the last step
+    uint64_t thresholdEvents;
+    bool automatic;             // The EC runs the fan from curve
+    uint32_t curve[EC_FAN_PROFILE_VARS];    // Fan profile in MsgFanProfileReq_t order
+};
+
+// Circular sample history of one sensor
+struct ECSIM_HISTORY {
+    uint32_t period;            // Microseconds, 0 while stopped
+    uint64_t baseTime;          // EC time of sample baseSequence
+    uint64_t baseSequence;      // First sample since the last configuration
+    uint64_t next;              // Sequence of the next sample to record
+    uint32_t values[ECSIM_HISTORY_SIZE];
+};
+
+struct _ECSIM {
+    std::mutex lock;
+    bool hostRxFull;            // Set by a response, cleared by FFA_RX_RELEASE
+    uint64_t nextHandle;
+    ECSIM_SHARE shares[ECSIM_MAX_SHARES];
+    uint64_t nextGeneration;
+    uint32_t varCount;
+    ECSIM_VAR vars[ECSIM_MAX_VARS];
+    std::chrono::steady_clock::time_point epoch;
+    ECSIM_HISTORY history[ECSIM_HISTORY_SENSORS];
+    uint8_t scratch[EC_MSG_MAX_PAYLOAD];
+    uint8_t data[ECSIM_DATA_SIZE];
+    uint8_t *ringTx;            // Windows attached with EcSimAttachRing
+    uint8_t *ringRx;
+    uint32_t ringFills[ECRING_SLOTS]; // Responses written to each RX slot
+    uint16_t streamSequence;    // Record taken from the TX stream, 0 if none
+    uint16_t streamLength;      // waiting for room in the RX stream
+    uint8_t streamEntry[ECRING_STREAM_MAX_PAYLOAD];
+    ECSIM_PLANT plant;
+    BatteryStatus_t *battery;   // Slot attached with EcSimAttachBattery
+    BatteryStatus_t batteryStatus; // Last status written to it
+    ECSIM_STATS stats;
+};
+
+ECSIM *EcSimCreate(void)
+{
+    ECSIM *sim = new ECSIM();
+
+    sim->hostRxFull = false;
+    sim->nextHandle = ECSIM_HANDLE_BASE;
+    memset(sim->shares, 0, sizeof(sim->shares));
+    sim->nextGeneration = 1;
+    sim->epoch = std::chrono::steady_clock::now();
+    memset(sim->history, 0, sizeof(sim->history));
+    sim->varCount = 0;
+    for (uint32_t i = 0; i < sizeof(gDefaultVars) / sizeof(gDefaultVars[0]); i++) {
+        EcSimSetVar(sim, gDefaultVars[i].id, 1, &gDefaultVars[i].value, sizeof(gDefaultVars[i].value));
+    }
+    for (uint32_t i = 0; i < ECSIM_DATA_SIZE; i++) {
+        sim->data[i] = ECSIM_DATA_PATTERN(i);
+    }
+    sim->ringTx = NULL;
+    sim->ringRx = NULL;
+    memset(sim->ringFills, 0, sizeof(sim->ringFills));
+    sim->streamSequence = 0;
+    memset(&sim->plant, 0, sizeof(sim->plant));
+    sim->battery = NULL;
+    memset(&sim->batteryStatus, 0, sizeof(sim->batteryStatus));
+    memset(&sim->stats, 0, sizeof(sim->stats));
+    return sim;
+}
+
+void EcSimDestroy(ECSIM *sim)
+{
+    delete sim;
+}
+
+/*
+ * Function: BulkRange
+ * ----------------------------
+ *  Checks that a bulk command stays inside the EC data region.
+ */
+static bool BulkRange(uint64_t offset, uint64_t length)
+{
+    return offset <= ECSIM_DATA_SIZE && length <= ECSIM_DATA_SIZE - offset;
+}
+
+/*
+ * Function: RingSlot
+ * ----------------------------
+ *  Returns: the descriptor of a slot in a ring window
+ */
+static uint64_t *RingSlot(uint8_t *window, uint32_t index)
+{
+    return (uint64_t *)(window + ECRING_SLOT_OFFSET + index * sizeof(uint64_t));
+}
+
+/*
+ * Function: HandleDoorbell
+ * ----------------------------
+ *  Consumes the TX slots announced by an EC_ASYNC doorbell, oldest sequence
+ *  first, and echoes each entry into a free RX slot under the same sequence.
+ *  Slots queued after the doorbell was rung are left alone. Called with the
+ *  simulator lock held.
+ *
+ *  Returns: the number of TX slots consumed
+ */
+static uint32_t HandleDoorbell(ECSIM *sim, uint16_t last)
+{
+    uint32_t consumed = 0;
+
+    sim->stats.doorbells++;
+    for (;;) {
+        uint32_t oldest = ECRING_SLOTS;
+        uint32_t rx = ECRING_SLOTS;
+        int16_t oldestAge = 0;
+
+        // Sequences wrap, age is the distance back from the announced one
+        for (uint32_t i = 0; i < ECRING_SLOTS; i++) {
+            uint64_t slot = *RingSlot(sim->ringTx, i);
+            int16_t age = (int16_t)(last - ECRING_SLOT_SEQUENCE(slot));
+
+            if ((slot & ECRING_SLOT_VALID) && ECRING_SLOT_SEQUENCE(slot) != 0 && age >= 0 &&
+                (oldest == ECRING_SLOTS || age > oldestAge)) {
+                oldest = i;
+                oldestAge = age;
+            }
+        }
+        for (uint32_t i = 0; i < ECRING_SLOTS && oldest != ECRING_SLOTS; i++) {
+            if (ECRING_SLOT_SEQUENCE(*RingSlot(sim->ringRx, i)) == 0) {
+                rx = i;
+                break;
+            }
+        }
+        if (oldest == ECRING_SLOTS || rx == ECRING_SLOTS) {
+            break;
+        }
+
+        uint64_t slot = *RingSlot(sim->ringTx, oldest);
+        uint16_t length = ECRING_SLOT_LENGTH(slot);
+        if (length > ECRING_ENTRY_SIZE) {
+            length = ECRING_ENTRY_SIZE;
+        }
+        memcpy(sim->ringRx + ECRING_ENTRY_OFFSET + rx * ECRING_ENTRY_SIZE,
+               sim->ringTx + ECRING_ENTRY_OFFSET + oldest * ECRING_ENTRY_SIZE, length);
+        *RingSlot(sim->ringRx, rx) = ECRING_SLOT_FILLED(ECRING_SLOT_SEQUENCE(slot), length, ++sim->ringFills[rx]);
+        *RingSlot(sim->ringTx, oldest) = 0;
+        consumed++;
+    }
+    sim->stats.asyncMessages += consumed;
+    return consumed;
+}
+
+/*
+ * Function: HandleStreamDoorbell
+ * ----------------------------
+ *  Takes every record published in the TX stream, oldest first, and echoes
+ *  each into the RX stream under the same sequence. A record taken when the RX
+ *  stream has no room for its response is held and answered first on the next
+ *  doorbell, the records behind it stay in the TX stream. Called with the
+ *  simulator lock held.
+ *
+ *  Returns: the number of records consumed
+ */
+static uint32_t HandleStreamDoorbell(ECSIM *sim)
+{
+    uint32_t consumed = 0;
+
+    sim->stats.doorbells++;
+    for (;;) {
+        if (sim->streamSequence == 0) {
+            if (EcRingStreamGet(sim->ringTx, 0, sim->streamEntry, sizeof(sim->streamEntry),
+                                &sim->streamLength, &sim->streamSequence) != ECRING_STATUS_SUCCESS) {
+                sim->streamSequence = 0;
+                break;
+            }
+            consumed++;
+        }
+        if (EcRingStreamPut(sim->ringRx, sim->streamSequence, sim->streamEntry,
+                            sim->streamLength) != ECRING_STATUS_SUCCESS) {
+            break;
+        }
+        sim->streamSequence = 0;
+    }
+    sim->stats.asyncMessages += consumed;
+    return consumed;
+}
+
+static ECSIM_VAR *FindVar(ECSIM *sim, const uint8_t id[16], uint16_t instance, bool create);
+static void StoreVar(ECSIM *sim, ECSIM_VAR *var, const void *value, uint16_t length);
+static uint64_t EcTime(ECSIM *sim);
+
+/*
+ * Function: PlantStep
+ * ----------------------------
+ *  Integrates the thermal model up to the current model time, in steps of at
+ *  most ECSIM_PLANT_STEP_US. The lags are solved exactly for each step and the
+ *  skin with a forward Euler step, which is stable while a step is well below
+ *  capacity / conductance. Called with the simulator lock held.
+ */
+static void PlantStep(ECSIM *sim)
+{
+    ECSIM_PLANT *plant = &sim->plant;
+    const ECSIM_PLANT_CONFIG *config = &plant->config;
+    uint64_t target = plant->advanced + (EcTime(sim) - plant->start) * config->acceleration;
+
+    while (plant->time < target) {
+        uint64_t stepUs = target - plant->time < ECSIM_PLANT_STEP_US ? target - plant->time : ECSIM_PLANT_STEP_US;
+        double dt = (double)stepUs / 1e6;
+
+        if (plant->automatic) {
+            // The EC applies the fan profile to its own reading every step
+            const uint32_t *curve = plant->curve;
+            double reading = plant->sensor * 10.0;
+            double rpm;
+
+            if (reading < curve[0]) {
+                rpm = 0.0;
+            } else if (reading < curve[1]) {
+                rpm = curve[3];
+            } else if (reading < curve[2]) {
+                rpm = curve[3] + (double)(curve[4] - curve[3]) * (reading - curve[1]) / (curve[2] - curve[1]);
+            } else {
+                rpm = curve[4];
+            }
+            plant->command = rpm == 0.0 ? 0.0 : fmin(fmax(rpm, config->fanMinRpm), config->fanMaxRpm);
+        }
+        plant->fan += (plant->command - plant->fan) * (1.0 - exp(-dt / config->fanTauS));
+        double conductance = config->naturalWK + config->fanWK * pow(plant->fan / config->fanMaxRpm, config->fanExponent);
+        plant->skin += dt * (plant->heat - conductance * (plant->skin - config->ambientK)) / config->capacityJK;
+        plant->sensor += (plant->skin - plant->sensor) * (1.0 - exp(-dt / config->sensorTauS));
+        plant->time += stepUs;
+
+        // The EC notifies once each time the reading leaves the THRS range
+        double reading = plant->sensor * 10.0;
+        bool outside = plant->low <= plant->high && (reading < plant->low || reading > plant->high);
+        if (outside && !plant->outside) {
+            plant->thresholdEvents++;
+        }
+        plant->outside = outside;
+    }
+}
+
+/*
+ * Function: PlantCommand
+ * ----------------------------
+ *  Takes a host write of FAN_CURRENT_RPM as the fan command, which also takes
+ *  the fan back from the EC, and a write of one of the fan profile variables
+ *  as a change to the curve the EC runs. Called with the simulator lock held.
+ */
+static void PlantCommand(ECSIM *sim, const ECSIM_VAR *var)
+{
+    ECSIM_PLANT *plant = &sim->plant;
+    uint32_t rpm = 0;
+
+    if (!plant->running || var->instance != 1) {
+        return;
+    }
+    memcpy(&rpm, var->value, var->length < sizeof(rpm) ? var->length : sizeof(rpm));
+    if (memcmp(var->id, gFanCurrentRpm, 16) == 0) {
+        PlantStep(sim);
+        plant->automatic = false;
+        plant->command = rpm == 0 ? 0.0 : fmin(fmax((double)rpm, plant->config.fanMinRpm), plant->config.fanMaxRpm);
+        return;
+    }
+    for (uint32_t i = 0; i < EC_FAN_PROFILE_VARS; i++) {
+        if (memcmp(var->id, gFanProfileVars[i], 16) == 0) {
+            PlantStep(sim);
+            plant->curve[i] = rpm;
+        }
+    }
+}
+
+/*
+ * Function: ApplyFanProfile
+ * ----------------------------
+ *  Checks a fan profile and writes all of its variables, or none of them.
+ *  Once written the plant runs the fan from it. Called with the simulator
+ *  lock held.
+ *
+ *  Returns: EC_MSG_STATUS_SUCCESS or EC_MSG_STATUS_INVALID_PARAMETER
+ */
+static uint8_t ApplyFanProfile(ECSIM *sim, uint16_t instance, const uint32_t values[EC_FAN_PROFILE_VARS],
+                               uint64_t generations[EC_FAN_PROFILE_VARS])
+{
+    ECSIM_VAR *vars[EC_FAN_PROFILE_VARS];
+
+    if (values[0] >= values[1] || values[1] >= values[2] || values[3] == 0 || values[3] > values[4]) {
+        return EC_MSG_STATUS_INVALID_PARAMETER;
+    }
+    // Find every slot before writing any, so a full table cannot leave half a profile
+    for (uint32_t i = 0; i < EC_FAN_PROFILE_VARS; i++) {
+        vars[i] = FindVar(sim, gFanProfileVars[i], instance, true);
+        if (vars[i] == NULL) {
+            return EC_MSG_STATUS_INVALID_PARAMETER;
+        }
+    }
+    for (uint32_t i = 0; i < EC_FAN_PROFILE_VARS; i++) {
+        StoreVar(sim, vars[i], &values[i], sizeof(values[i]));
+        generations[i] = vars[i]->generation;
+    }
+
+    sim->stats.fanProfiles++;
+    if (sim->plant.running && instance == 1) {
+        PlantStep(sim);
+        memcpy(sim->plant.curve, values, sizeof(sim->plant.curve));
+        sim->plant.automatic = true;
+    }
+    return EC_MSG_STATUS_SUCCESS;
+}
+
+/*
+ * Function: PlantPublishFan
+ * ----------------------------
+ *  Replaces FAN_CURRENT_RPM with the actual speed before the host reads it.
+ *  Called with the simulator lock held.
+ */
+static void PlantPublishFan(ECSIM *sim, ECSIM_VAR *var)
+{
+    uint32_t rpm;
+
+    if (!sim->plant.running || var == NULL || var->instance != 1 || memcmp(var->id, gFanCurrentRpm, 16) != 0) {
+        return;
+    }
+    PlantStep(sim);
+    rpm = (uint32_t)lround(sim->plant.fan);
+    StoreVar(sim, var, &rpm, sizeof(rpm));
+}
+
+/*
+ * Function: HandleThermalDirect
+ * ----------------------------
+ *  Serves the direct requests _TMP, THRS, GVAR and SVAR of thermal.asl make.
+ *  Their fields are packed at byte offsets of x4 onwards rather than in whole
+ *  registers, so the registers are handled as the bytes of the FFAC buffer
+ *  that follow the service UUID. Called with the simulator lock held.
+ */
+static void HandleThermalDirect(ECSIM *sim, uint64_t regs[ECSIM_DIRECT_REGS])
+{
+    uint8_t in[ECSIM_DIRECT_REGS * sizeof(uint64_t)];
+    uint32_t profile[EC_FAN_PROFILE_VARS];
+    uint64_t generations[EC_FAN_PROFILE_VARS];
+    uint32_t value = 0;
+    uint32_t low, high;
+    uint16_t length;
+    ECSIM_VAR *var;
+
+    memcpy(in, regs, sizeof(in));
+    memset(regs, 0, ECSIM_DIRECT_REGS * sizeof(uint64_t));
+    switch (in[0]) {
+    case ECSIM_THM_GET_TMP:
+        // TZID in byte 1, RTMP from x5. One reading per millisecond
+        regs[0] = EC_MSG_STATUS_SUCCESS;
+        if (sim->plant.running && in[1] == ECSIM_PLANT_ZONE) {
+            PlantStep(sim);
+            regs[1] = (uint32_t)lround(sim->plant.sensor * 10.0);
+            break;
+        }
+        regs[1] = ECSIM_HISTORY_VALUE(in[1], EcTime(sim) / 1000);
+        break;
+    case ECSIM_THM_SET_THRS:
+        // Timeout, low and high thresholds at bytes 2, 6 and 10, TSTS in x4
+        memcpy(&low, &in[6], sizeof(low));
+        memcpy(&high, &in[10], sizeof(high));
+        regs[0] = low <= high ? EC_MSG_STATUS_SUCCESS : EC_MSG_STATUS_INVALID_PARAMETER;
+        if (low <= high && sim->plant.running && in[1] == ECSIM_PLANT_ZONE) {
+            // A reading already outside the new range notifies at the next step
+            PlantStep(sim);
+            sim->plant.low = low;
+            sim->plant.high = high;
+            sim->plant.outside = false;
+        }
+        break;
+    case ECSIM_THM_GET_VAR:
+    case ECSIM_THM_SET_VAR:
+        // INST in byte 1, VLEN in bytes 2-3, variable UUID from byte 4 and
+        // the value of SET_VAR from byte 20. The result is returned from x5
+        memcpy(&length, &in[2], sizeof(length));
+        if (length == 0 || length > sizeof(value)) {
+            regs[0] = regs[1] = EC_MSG_STATUS_INVALID_PARAMETER;
+            break;
+        }
+        if (in[0] == ECSIM_THM_SET_VAR) {
+            var = FindVar(sim, &in[4], in[1], true);
+            if (var == NULL) {
+                regs[0] = regs[1] = EC_MSG_STATUS_INVALID_PARAMETER;
+                break;
+            }
+            StoreVar(sim, var, &in[20], length);
+            PlantCommand(sim, var);
+            regs[0] = regs[1] = EC_MSG_STATUS_SUCCESS;
+            break;
+        }
+        sim->stats.varReads++;
+        var = FindVar(sim, &in[4], in[1], false);
+        PlantPublishFan(sim, var);
+        if (var == NULL || var->length > length) {
+            regs[0] = EC_MSG_STATUS_INVALID_PARAMETER;
+            break;
+        }
+        memcpy(&value, var->value, var->length);
+        regs[0] = EC_MSG_STATUS_SUCCESS;
+        regs[1] = value;
+        break;
+    case ECSIM_THM_SET_PROFILE:
+        // INST in byte 1, OnTemp, RampTemp, MaxTemp, MinRpm and MaxRpm from
+        // byte 2. The status is returned from x5 as well
+        memcpy(profile, &in[2], sizeof(profile));
+        regs[0] = regs[1] = ApplyFanProfile(sim, in[1], profile, generations);
+        break;
+    default:
+        regs[0] = EC_MSG_STATUS_UNKNOWN_COMMAND;
+        break;
+    }
+}
+
+int EcSimDirectReq2(ECSIM *sim, const uint8_t service[16], uint64_t regs[ECSIM_DIRECT_REGS])
+{
+    std::lock_guard<std::mutex> lock(sim->lock);
+    uint64_t command = regs[0];
+    uint64_t offset = regs[1];
+    uint64_t length = regs[2];
+
+    if (memcmp(service, EcMsgThermalService, 16) == 0) {
+        sim->stats.directRequests++;
+        HandleThermalDirect(sim, regs);
+        return ECSIM_FFA_SUCCESS;
+    }
+    if (memcmp(service, EcMsgManagementService, 16) != 0) {
+        return ECSIM_FFA_INVALID_PARAMETERS;
+    }
+    sim->stats.directRequests++;
+
+    memset(regs, 0, ECSIM_DIRECT_REGS * sizeof(uint64_t));
+    if ((uint8_t)command == ECRING_CMD_ASYNC) {
+        // BSQN and BCNT ride in the upper bytes of x4
+        if (sim->ringTx == NULL) {
+            regs[0] = EC_MSG_STATUS_INVALID_PARAMETER;
+            return ECSIM_FFA_SUCCESS;
+        }
+        // A host reading RX from a read-only view hands space back in TX
+        if (EcRingApplyReleases(sim->ringTx, sim->ringRx) != ECRING_STATUS_SUCCESS) {
+            regs[0] = EC_MSG_STATUS_INVALID_PARAMETER;
+            return ECSIM_FFA_SUCCESS;
+        }
+        regs[0] = EC_MSG_STATUS_SUCCESS;
+        if (*(uint16_t *)sim->ringTx == ECRING_STREAM_VERSION) {
+            regs[1] = HandleStreamDoorbell(sim);
+        } else {
+            regs[1] = HandleDoorbell(sim, ECRING_DOORBELL_SEQUENCE(command));
+        }
+        return ECSIM_FFA_SUCCESS;
+    }
+
+    switch (command) {
+    case ECSIM_CMD_GET_FW_STATE:
+        regs[0] = EC_MSG_STATUS_SUCCESS;
+        regs[1] = 1;    // Running
+        break;
+    case EC_MSG_CMD_READ_BULK:
+        // At most ECSIM_DIRECT_DATA bytes per request, returned from x6
+        if (length > ECSIM_DIRECT_DATA || !BulkRange(offset, length)) {
+            regs[0] = EC_MSG_STATUS_INVALID_PARAMETER;
+            break;
+        }
+        regs[0] = EC_MSG_STATUS_SUCCESS;
+        regs[1] = length;
+        memcpy(&regs[2], sim->data + offset, (size_t)length);
+        sim->stats.bytesOut += length;
+        break;
+    default:
+        regs[0] = EC_MSG_STATUS_UNKNOWN_COMMAND;
+        break;
+    }
+    return ECSIM_FFA_SUCCESS;
+}
+
+/*
+ * Function: FindShare
+ * ----------------------------
+ *  Looks up a shared region by handle. Called with the simulator lock held.
+ */
+static ECSIM_SHARE *FindShare(ECSIM *sim, uint64_t handle)
+{
+    for (uint32_t i = 0; handle != 0 && i < ECSIM_MAX_SHARES; i++) {
+        if (sim->shares[i].handle == handle) {
+            return &sim->shares[i];
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Function: MapShare
+ * ----------------------------
+ *  Retrieves a shared region on MAP_SHARE, as the EC would with
+ *  FFA_MEM_RETRIEVE_REQ, and fills it with ECSIM_DATA_PATTERN so the host can
+ *  see the EC wrote it. Called with the simulator lock held.
+ *
+ *  Returns: EC_MSG_STATUS_* for the response
+ */
+static uint8_t MapShare(ECSIM *sim, const uint8_t *payload, uint32_t length)
+{
+    FFA_MEM_REGION region;
+    FFA_MEM_ACCESS access;
+    ECSIM_SHARE *share;
+    uint32_t offset = 0;
+
+    if (length < sizeof(region) + sizeof(access)) {
+        return EC_MSG_STATUS_INVALID_PARAMETER;
+    }
+    memcpy(&region, payload, sizeof(region));
+    if (region.ReceiverCount != 1 || region.ReceiversOffset > length - sizeof(access)) {
+        return EC_MSG_STATUS_INVALID_PARAMETER;
+    }
+    memcpy(&access, payload + region.ReceiversOffset, sizeof(access));
+
+    // A retrieve request names the share exactly as it was made, without composite offsets
+    share = FindShare(sim, region.Handle);
+    if (share == NULL || share->retrieved || region.Tag != share->tag || region.SenderId != share->sender ||
+        access.ReceiverId != EC_SERVICE_VMID || access.Permissions != share->permissions ||
+        access.CompositeOffset != 0) {
+        return EC_MSG_STATUS_INVALID_PARAMETER;
+    }
+
+    share->retrieved = true;
+    for (uint32_t i = 0; i < share->rangeCount; i++) {
+        uint8_t *base = (uint8_t *)(uintptr_t)share->ranges[i].Address;
+
+        for (uint32_t j = 0; j < share->ranges[i].PageCount * FFA_MEM_PAGE_SIZE; j++, offset++) {
+            base[j] = ECSIM_DATA_PATTERN(offset);
+        }
+    }
+    return EC_MSG_STATUS_SUCCESS;
+}
+
+/*
+ * Function: UnmapShare
+ * ----------------------------
+ *  Relinquishes a retrieved region on UNMAP_SHARE, as the EC would with
+ *  FFA_MEM_RELINQUISH. Called with the simulator lock held.
+ *
+ *  Returns: EC_MSG_STATUS_* for the response
+ */
+static uint8_t UnmapShare(ECSIM *sim, const uint8_t *payload, uint32_t length)
+{
+    ECSIM_SHARE *share;
+    uint64_t handle;
+
+    if (length != sizeof(handle)) {
+        return EC_MSG_STATUS_INVALID_PARAMETER;
+    }
+    memcpy(&handle, payload, sizeof(handle));
+    share = FindShare(sim, handle);
+    if (share == NULL || !share->retrieved) {
+        return EC_MSG_STATUS_INVALID_PARAMETER;
+    }
+    share->retrieved = false;
+    return EC_MSG_STATUS_SUCCESS;
+}
+
+/*
+ * Function: FindVar
+ * ----------------------------
+ *  Looks up a thermal variable, optionally creating it. Called with the
+ *  simulator lock held.
+ */
+static ECSIM_VAR *FindVar(ECSIM *sim, const uint8_t id[16], uint16_t instance, bool create)
+{
+    for (uint32_t i = 0; i < sim->varCount; i++) {
+        if (sim->vars[i].instance == instance && memcmp(sim->vars[i].id, id, 16) == 0) {
+            return &sim->vars[i];
+        }
+    }
+    if (!create || sim->varCount == ECSIM_MAX_VARS) {
+        return NULL;
+    }
+
+    ECSIM_VAR *var = &sim->vars[sim->varCount++];
+    memcpy(var->id, id, 16);
+    var->instance = instance;
+    var->length = 0;
+    var->generation = 0;
+    return var;
+}
+
+/*
+ * Function: StoreVar
+ * ----------------------------
+ *  Writes a variable and moves it to a new generation if the value changed.
+ *  Called with the simulator lock held.
+ */
+static void StoreVar(ECSIM *sim, ECSIM_VAR *var, const void *value, uint16_t length)
+{
+    if (var->generation != 0 && var->length == length && memcmp(var->value, value, length) == 0) {
+        return;
+    }
+    memcpy(var->value, value, length);
+    var->length = length;
+    var->generation = sim->nextGeneration++;
+}
+
+/*
+ * Function: EcTime
+ * ----------------------------
+ *  Returns: microseconds since the simulator was created
+ */
+static uint64_t EcTime(ECSIM *sim)
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - sim->epoch).count();
+}
+
+/*
+ * Function: AdvanceHistory
+ * ----------------------------
+ *  Records the samples of a sensor that fell due since the last call. Only
+ *  the last ECSIM_HISTORY_SIZE are kept, so older ones are not generated.
+ *  Called with the simulator lock held.
+ */
+static void AdvanceHistory(ECSIM *sim, uint32_t sensor)
+{
+    ECSIM_HISTORY *history = &sim->history[sensor];
+    uint64_t due;
+
+    if (history->period == 0) {
+        return;
+    }
+    due = history->baseSequence + (EcTime(sim) - history->baseTime) / history->period + 1;
+    if (due > history->next + ECSIM_HISTORY_SIZE) {
+        history->next = due - ECSIM_HISTORY_SIZE;
+    }
+    for (; history->next < due; history->next++) {
+        history->values[history->next % ECSIM_HISTORY_SIZE] = ECSIM_HISTORY_VALUE(sensor, history->next);
+        sim->stats.samples++;
+    }
+}
+
+/*
+ * Function: HandleHistory
+ * ----------------------------
+ *  Runs the history commands of the thermal service. Called with the
+ *  simulator lock held.
+ *
+ *  Returns: the payload of the response, built in scratch
+ */
+static const uint8_t *HandleHistory(ECSIM *sim, const EC_MSG_HEADER *request, EC_MSG_HEADER *response, uint8_t *scratch)
+{
+    const uint8_t *payload = (const uint8_t *)(request + 1);
+    MsgHistoryConfigReq_t config;
+    MsgHistoryReadReq_t read;
+    MsgHistoryReadRsp_t rsp;
+    ECSIM_HISTORY *history;
+    uint64_t oldest;
+
+    if (request->Command == EC_MSG_CMD_HISTORY_CONFIG) {
+        if (request->Length != sizeof(config)) {
+            response->Status = EC_MSG_STATUS_INVALID_PARAMETER;
+            return NULL;
+        }
+        memcpy(&config, payload, sizeof(config));
+        if (config.sensor >= ECSIM_HISTORY_SENSORS) {
+            response->Status = EC_MSG_STATUS_INVALID_PARAMETER;
+            return NULL;
+        }
+
+        // Sequences keep counting across configurations, the samples before are discarded
+        history = &sim->history[config.sensor];
+        AdvanceHistory(sim, config.sensor);
+        history->period = config.period_us;
+        history->baseTime = EcTime(sim);
+        history->baseSequence = history->next;
+        return NULL;
+    }
+
+    if (request->Length != sizeof(read)) {
+        response->Status = EC_MSG_STATUS_INVALID_PARAMETER;
+        return NULL;
+    }
+    memcpy(&read, payload, sizeof(read));
+    if (read.sensor >= ECSIM_HISTORY_SENSORS) {
+        response->Status = EC_MSG_STATUS_INVALID_PARAMETER;
+        return NULL;
+    }
+
+    history = &sim->history[read.sensor];
+    AdvanceHistory(sim, read.sensor);
+    oldest = history->next > ECSIM_HISTORY_SIZE ? history->next - ECSIM_HISTORY_SIZE : 0;
+    if (oldest < history->baseSequence) {
+        oldest = history->baseSequence;
+    }
+
+    memset(&rsp, 0, sizeof(rsp));
+    rsp.sequence = read.sequence < oldest ? oldest : read.sequence;
+    if (rsp.sequence > history->next) {
+        rsp.sequence = history->next;
+    }
+    rsp.dropped = rsp.sequence - (read.sequence < rsp.sequence ? read.sequence : rsp.sequence);
+    rsp.count = (uint32_t)(history->next - rsp.sequence);
+    if (rsp.count > read.max_samples) {
+        rsp.count = read.max_samples;
+    }
+    if (rsp.count > EC_HISTORY_MAX_SAMPLES) {
+        rsp.count = EC_HISTORY_MAX_SAMPLES;
+    }
+    rsp.next = rsp.sequence + rsp.count;
+    rsp.period_us = history->period;
+    rsp.timestamp = history->baseTime + (rsp.sequence - history->baseSequence) * history->period;
+
+    uint32_t *samples = (uint32_t *)(scratch + sizeof(rsp));
+    for (uint32_t i = 0; i < rsp.count; i++) {
+        samples[i] = history->values[(rsp.sequence + i) % ECSIM_HISTORY_SIZE];
+    }
+    memcpy(scratch, &rsp, sizeof(rsp));
+    response->Length = sizeof(rsp) + rsp.count * sizeof(uint32_t);
+    sim->stats.samplesRead += rsp.count;
+    return scratch;
+}
+
+/*
+ * Function: HandleThermal
+ * ----------------------------
+ *  Runs one indirect message to the thermal service. Called with the
+ *  simulator lock held.
+ *
+ *  Returns: the payload of the response, built in scratch
+ */
+static const uint8_t *HandleThermal(ECSIM *sim, const EC_MSG_HEADER *request, EC_MSG_HEADER *response, uint8_t *scratch)
+{
+    const uint8_t *payload = (const uint8_t *)(request + 1);
+    MsgVarRsp_t rsp;
+    MsgVarReq_t req;
+    ECSIM_VAR *var;
+
+    if (request->Command == EC_MSG_CMD_HISTORY_CONFIG || request->Command == EC_MSG_CMD_HISTORY_READ) {
+        return HandleHistory(sim, request, response, scratch);
+    }
+    if (request->Command == EC_MSG_CMD_SET_FAN_PROFILE) {
+        MsgFanProfileReq_t profile;
+        MsgFanProfileRsp_t written;
+        uint32_t values[EC_FAN_PROFILE_VARS];
+
+        if (request->Length != sizeof(profile)) {
+            response->Status = EC_MSG_STATUS_INVALID_PARAMETER;
+            return NULL;
+        }
+        memcpy(&profile, payload, sizeof(profile));
+        values[0] = profile.on_temp;
+        values[1] = profile.ramp_temp;
+        values[2] = profile.max_temp;
+        values[3] = profile.min_rpm;
+        values[4] = profile.max_rpm;
+        response->Status = ApplyFanProfile(sim, profile.instance, values, written.generation);
+        if (response->Status != EC_MSG_STATUS_SUCCESS) {
+            return NULL;
+        }
+        response->Length = sizeof(written);
+        memcpy(scratch, &written, sizeof(written));
+        return scratch;
+    }
+    if (request->Command != EC_MSG_CMD_GET_VAR && request->Command != EC_MSG_CMD_SET_VAR) {
+        response->Status = EC_MSG_STATUS_UNKNOWN_COMMAND;
+        return NULL;
+    }
+    if (request->Length < sizeof(req)) {
+        response->Status = EC_MSG_STATUS_INVALID_PARAMETER;
+        return NULL;
+    }
+    memcpy(&req, payload, sizeof(req));
+
+    memset(&rsp, 0, sizeof(rsp));
+    if (request->Command == EC_MSG_CMD_SET_VAR) {
+        var = FindVar(sim, req.variable, req.instance, true);
+        if (var == NULL || req.length == 0 || req.length > EC_VAR_MAX_LENGTH ||
+            req.length != request->Length - sizeof(req)) {
+            response->Status = EC_MSG_STATUS_INVALID_PARAMETER;
+            return NULL;
+        }
+        StoreVar(sim, var, payload + sizeof(req), req.length);
+        PlantCommand(sim, var);
+        rsp.generation = var->generation;
+        response->Length = sizeof(rsp);
+        memcpy(scratch, &rsp, sizeof(rsp));
+        return scratch;
+    }
+
+    sim->stats.varReads++;
+    var = FindVar(sim, req.variable, req.instance, false);
+    PlantPublishFan(sim, var);
+    if (var == NULL || req.length < var->length) {
+        response->Status = EC_MSG_STATUS_INVALID_PARAMETER;
+        return NULL;
+    }
+    if (req.generation == var->generation) {
+        sim->stats.notModified++;
+        response->Status = EC_MSG_STATUS_NOT_MODIFIED;
+        return NULL;
+    }
+    rsp.generation = var->generation;
+    rsp.length = var->length;
+    memcpy(scratch, &rsp, sizeof(rsp));
+    memcpy(scratch + sizeof(rsp), var->value, var->length);
+    response->Length = sizeof(rsp) + var->length;
+    return scratch;
+}
+
+/*
+ * Function: HandleMessage
+ * ----------------------------
+ *  Runs one indirect message to the management or thermal service and builds
+ *  the header and payload of the response. Called with the simulator lock held.
+ *
+ *  Returns: the payload of the response, which may point into the request or scratch
+ */
+static const uint8_t *HandleMessage(ECSIM *sim, const EC_MSG_HEADER *request, EC_MSG_HEADER *response, uint8_t *scratch)
+{
+    const uint8_t *payload = (const uint8_t *)(request + 1);
+    MsgBulkReq_t bulk;
+
+    memcpy(response, request, sizeof(*response));
+    response->Status = EC_MSG_STATUS_SUCCESS;
+    response->Length = 0;
+    if (memcmp(request->Service, EcMsgThermalService, 16) == 0) {
+        return HandleThermal(sim, request, response, scratch);
+    }
+    if (memcmp(request->Service, EcMsgManagementService, 16) != 0) {
+        response->Status = EC_MSG_STATUS_UNKNOWN_SERVICE;
+        return NULL;
+    }
+
+    switch (request->Command) {
+    case EC_MSG_CMD_ECHO:
+        response->Length = request->Length;
+        return payload;
+    case EC_MSG_CMD_READ_BULK:
+    case EC_MSG_CMD_WRITE_BULK:
+        if (request->Length < sizeof(bulk)) {
+            break;
+        }
+        memcpy(&bulk, payload, sizeof(bulk));
+        if (request->Command == EC_MSG_CMD_READ_BULK) {
+            if (!BulkRange(bulk.offset, bulk.length) || bulk.length > EC_MSG_MAX_PAYLOAD) {
+                break;
+            }
+            response->Length = bulk.length;
+            return sim->data + bulk.offset;
+        }
+        if (bulk.length != request->Length - sizeof(bulk) || !BulkRange(bulk.offset, bulk.length)) {
+            break;
+        }
+        memcpy(sim->data + bulk.offset, payload + sizeof(bulk), bulk.length);
+        return NULL;
+    case EC_MSG_CMD_MAP_SHARE:
+        response->Status = MapShare(sim, payload, request->Length);
+        return NULL;
+    case EC_MSG_CMD_UNMAP_SHARE:
+        response->Status = UnmapShare(sim, payload, request->Length);
+        return NULL;
+    default:
+        response->Status = EC_MSG_STATUS_UNKNOWN_COMMAND;
+        return NULL;
+    }
+
+    response->Status = EC_MSG_STATUS_INVALID_PARAMETER;
+    return NULL;
+}
+
+int EcSimMsgSend2(ECSIM *sim, const void *tx, void *rx, size_t size)
+{
+    std::lock_guard<std::mutex> lock(sim->lock);
+    const EC_MSG_HEADER *request;
+    const uint8_t *payload;
+    EC_MSG_HEADER response;
+    UINT16 sender;
+    UINT16 receiver;
+
+    request = EcMsgParse(tx, size, &sender, &receiver);
+    if (request == NULL || receiver != EC_SERVICE_VMID) {
+        return ECSIM_FFA_INVALID_PARAMETERS;
+    }
+    if (sim->hostRxFull) {
+        sim->stats.busy++;
+        return ECSIM_FFA_BUSY;
+    }
+    sim->stats.messages++;
+    sim->stats.bytesIn += request->Length;
+
+    // The response goes straight back, the SPMC would schedule the EC to produce it
+    payload = HandleMessage(sim, request, &response, sim->scratch);
+    if (EcMsgBuild(rx, size, EC_SERVICE_VMID, sender, &response, payload) == 0) {
+        return ECSIM_FFA_INVALID_PARAMETERS;
+    }
+    sim->stats.bytesOut += response.Length;
+    sim->hostRxFull = true;
+    return ECSIM_FFA_SUCCESS;
+}
+
+int EcSimMemShare(ECSIM *sim, const void *tx, uint32_t length, uint64_t *handle)
+{
+    std::lock_guard<std::mutex> lock(sim->lock);
+    const FFA_MEM_REGION *region = (const FFA_MEM_REGION *)tx;
+    const FFA_MEM_COMPOSITE *composite;
+    ECSIM_SHARE *share = NULL;
+    uint8_t permissions;
+
+    composite = FfaMemParseShare(tx, length, EC_SERVICE_VMID, &permissions);
+    if (composite == NULL || region->SenderId != EC_HOST_VMID || region->Handle != 0) {
+        return ECSIM_FFA_INVALID_PARAMETERS;
+    }
+
+    for (uint32_t i = 0; i < ECSIM_MAX_SHARES; i++) {
+        if (sim->shares[i].handle == 0) {
+            share = &sim->shares[i];
+            break;
+        }
+    }
+    if (share == NULL) {
+        return ECSIM_FFA_NO_MEMORY;
+    }
+
+    share->handle = sim->nextHandle++;
+    share->tag = region->Tag;
+    share->sender = region->SenderId;
+    share->permissions = permissions;
+    share->retrieved = false;
+    share->rangeCount = composite->RangeCount;
+    memcpy(share->ranges, composite + 1, composite->RangeCount * sizeof(FFA_MEM_RANGE));
+    sim->stats.shares++;
+    sim->stats.liveShares++;
+
+    *handle = share->handle;
+    return ECSIM_FFA_SUCCESS;
+}
+
+int EcSimMemReclaim(ECSIM *sim, uint64_t handle)
+{
+    std::lock_guard<std::mutex> lock(sim->lock);
+    ECSIM_SHARE *share = FindShare(sim, handle);
+
+    if (share == NULL) {
+        return ECSIM_FFA_INVALID_PARAMETERS;
+    }
+    if (share->retrieved) {
+        sim->stats.denied++;
+        return ECSIM_FFA_DENIED;
+    }
+    memset(share, 0, sizeof(*share));
+    sim->stats.reclaims++;
+    sim->stats.liveShares--;
+    return ECSIM_FFA_SUCCESS;
+}
+
+int EcSimSetVar(ECSIM *sim, const uint8_t variable[16], uint16_t instance, const void *value, uint16_t length)
+{
+    std::lock_guard<std::mutex> lock(sim->lock);
+    ECSIM_VAR *var;
+
+    if (length == 0 || length > EC_VAR_MAX_LENGTH) {
+        return ECSIM_FFA_INVALID_PARAMETERS;
+    }
+    var = FindVar(sim, variable, instance, true);
+    if (var == NULL) {
+        return ECSIM_FFA_NO_MEMORY;
+    }
+    StoreVar(sim, var, value, length);
+    return ECSIM_FFA_SUCCESS;
+}
+
+void EcSimAttachRing(ECSIM *sim, void *tx, void *rx)
+{
+    std::lock_guard<std::mutex> lock(sim->lock);
+
+    sim->ringTx = (uint8_t *)tx;
+    sim->ringRx = (uint8_t *)rx;
+    memset(sim->ringFills, 0, sizeof(sim->ringFills));
+    sim->streamSequence = 0;
+}
+
+void EcSimRxRelease(ECSIM *sim)
+{
+    std::lock_guard<std::mutex> lock(sim->lock);
+
+    sim->hostRxFull = false;
+}
+
+void EcSimPublishStatic(ECSIM *sim, void *page)
+{
+    uint64_t regs[ECSIM_DIRECT_REGS] = { ECSIM_CMD_GET_FW_STATE };
+    uint32_t fwState = 0;
+
+    // Firmware asks the EC like TFWS does and records 0 if it does not answer
+    if (EcSimDirectReq2(sim, EcMsgManagementService, regs) == ECSIM_FFA_SUCCESS &&
+        regs[0] == EC_MSG_STATUS_SUCCESS) {
+        fwState = (uint32_t)regs[1];
+    }
+    EcStaticBuild((EC_STATIC *)page, fwState);
+}
+
+void EcSimAttachBattery(ECSIM *sim, void *page)
+{
+    std::lock_guard<std::mutex> lock(sim->lock);
+
+    sim->battery = (BatteryStatus_t *)page;
+    memset(&sim->batteryStatus, 0, sizeof(sim->batteryStatus));
+    memset(page, 0, sizeof(BatteryStatus_t));
+}
+
+uint32_t EcSimBatteryUpdate(ECSIM *sim, uint32_t state, uint32_t rate, uint32_t capacity, uint32_t voltage)
+{
+    std::lock_guard<std::mutex> lock(sim->lock);
+    BatteryStatus_t *status = &sim->batteryStatus;
+    volatile BatteryStatus_t *slot = sim->battery;
+    uint32_t changed = 0;
+
+    sim->stats.batteryUpdates++;
+    changed |= (status->state != state) ? EC_BATTERY_CHANGED_STATE : 0;
+    changed |= (status->rate != rate) ? EC_BATTERY_CHANGED_RATE : 0;
+    changed |= (status->capacity != capacity) ? EC_BATTERY_CHANGED_CAPACITY : 0;
+    changed |= (status->voltage != voltage) ? EC_BATTERY_CHANGED_VOLTAGE : 0;
+    if (slot == NULL || (changed == 0 && status->sequence != 0)) {
+        return 0;
+    }
+
+    // The first update is always pushed, readers take sequence 0 as no status yet
+    status->sequence += 2;
+    status->changed = (changed != 0) ? changed : EC_BATTERY_CHANGED_STATE;
+    status->state = state;
+    status->rate = rate;
+    status->capacity = capacity;
+    status->voltage = voltage;
+    status->timestamp = EcTime(sim);
+
+    // Odd while the fields are rewritten, the same protocol the driver reads with
+    slot->sequence = status->sequence - 1;
+    std::atomic_thread_fence(std::memory_order_release);
+    slot->changed = status->changed;
+    slot->state = state;
+    slot->rate = rate;
+    slot->capacity = capacity;
+    slot->voltage = voltage;
+    slot->timestamp = status->timestamp;
+    std::atomic_thread_fence(std::memory_order_release);
+    slot->sequence = status->sequence;
+    sim->stats.batteryPushes++;
+    return status->changed;
+}
+
+void EcSimPlantDefaults(ECSIM_PLANT_CONFIG *config)
+{
+    config->ambientK = 298.15;
+    config->heatW = 15.0;
+    config->capacityJK = 60.0;
+    config->naturalWK = 0.3;
+    config->fanWK = 1.2;
+    config->fanExponent = 0.8;
+    config->fanMinRpm = 1000.0;
+    config->fanMaxRpm = 5000.0;
+    config->fanTauS = 2.0;
+    config->sensorTauS = 5.0;
+    config->acceleration = 1;
+}
+
+void EcSimPlantStart(ECSIM *sim, const ECSIM_PLANT_CONFIG *config)
+{
+    std::lock_guard<std::mutex> lock(sim->lock);
+    ECSIM_PLANT *plant = &sim->plant;
+    uint32_t minRpm = (uint32_t)config->fanMinRpm;
+    uint32_t maxRpm = (uint32_t)config->fanMaxRpm;
+    uint32_t stopped = 0;
+    ECSIM_VAR *var;
+
+    memset(plant, 0, sizeof(*plant));
+    plant->config = *config;
+    plant->heat = config->heatW;
+    plant->skin = config->ambientK;
+    plant->sensor = config->ambientK;
+    plant->start = EcTime(sim);
+    plant->low = 1;             // No range until THRS sets one
+    plant->running = true;
+
+    // The fan limits and speed are read through the variables as from the EC
+    if ((var = FindVar(sim, gFanMinRpm, 1, true)) != NULL) {
+        StoreVar(sim, var, &minRpm, sizeof(minRpm));
+    }
+    if ((var = FindVar(sim, gFanMaxRpm, 1, true)) != NULL) {
+        StoreVar(sim, var, &maxRpm, sizeof(maxRpm));
+    }
+    if ((var = FindVar(sim, gFanCurrentRpm, 1, true)) != NULL) {
+        StoreVar(sim, var, &stopped, sizeof(stopped));
+    }
+}
+
+void EcSimPlantSetHeat(ECSIM *sim, double watts)
+{
+    std::lock_guard<std::mutex> lock(sim->lock);
+
+    // Heat applied so far stays at the old load
+    PlantStep(sim);
+    sim->plant.heat = watts;
+}
+
+void EcSimPlantAdvance(ECSIM *sim, uint64_t microseconds)
+{
+    std::lock_guard<std::mutex> lock(sim->lock);
+
+    sim->plant.advanced += microseconds;
+    if (sim->plant.running) {
+        PlantStep(sim);
+    }
+}
+
+void EcSimPlantGetState(ECSIM *sim, ECSIM_PLANT_STATE *state)
+{
+    std::lock_guard<std::mutex> lock(sim->lock);
+    ECSIM_PLANT *plant = &sim->plant;
+
+    if (plant->running) {
+        PlantStep(sim);
+    }
+    state->timeUs = plant->time;
+    state->skinK = plant->skin;
+    state->sensorK = plant->sensor;
+    state->fanRpm = plant->fan;
+    state->commandRpm = plant->command;
+    state->heatW = plant->heat;
+    state->thresholdEvents = plant->thresholdEvents;
+    state->automatic = plant->automatic;
+}
+
+void EcSimGetStats(ECSIM *sim, ECSIM_STATS *stats)
+{
+    std::lock_guard<std::mutex> lock(sim->lock);
+
+    *stats = sim->stats;
+    stats->mappedShares = 0;
+    for (uint32_t i = 0; i < ECSIM_MAX_SHARES; i++) {
+        stats->mappedShares += sim->shares[i].retrieved ? 1 : 0;
+    }
+}
@@ -0,0 +1,242 @@
+/*
+MIT License
+
+Copyright (c) 2025 Open Device Partnership
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Host model of the EC secure partition as the OS sees it over FF-A. Direct
+// requests arrive as the 14 argument registers of FFA_MSG_SEND_DIRECT_REQ2
+// (x4..x17), thermal service direct requests are served as _TMP, THRS, GVAR and
+// SVAR in thermal.asl build them, indirect messages arrive in the host TX buffer with FFA_MSG_SEND2
+// and are answered in the host RX buffer, with the SPMC rule that the EC cannot
+// send again until the host releases its RX buffer. Thermal service variables
+// carry generations for conditional reads and can also be changed from the EC
+// side with EcSimSetVar, standing in for firmware. Sensor history is sampled
+// lazily: each history command first records every sample that fell due since
+// the last one, so the ring looks as if a timer filled it. Memory shared with
+// FFA_MEM_SHARE is validated with the descriptor parser shared with the UEFI
+// code, retrieved by the EC when the host sends MAP_SHARE and cannot be
+// reclaimed until the EC relinquishes it on UNMAP_SHARE. Physical addresses in
+// the descriptors are host pointers. EC_ASYNC doorbells consume the TX slots of
+// the windows attached with EcSimAttachRing up to the announced sequence and
+// answer each in an RX slot, entries left for lack of a free RX slot wait for
+// the next doorbell. Releases a host reading RX read-only published in the TX
+// window are applied first. EcSimPublishStatic stands in for the firmware that writes
+// the static snapshot at boot. When the windows hold streams (ECRING_STREAM_VERSION) a
+// doorbell takes every published record instead and echoes it into the RX
+// stream. EcSimPlantStart replaces the readings of ECSIM_PLANT_ZONE with a
+// thermal model of the skin: a heat source with one heat capacity, cooled
+// through a conductance that grows with the fan speed, read by a sensor that
+// lags the real temperature. Writes to the FAN_CURRENT_RPM variable command
+// the fan, which spins up and down with its own lag, reads return the actual
+// speed, and THRS thresholds count crossings where the EC would notify. Once a
+// fan profile is written the EC sets the fan from it at every step until the
+// host writes FAN_CURRENT_RPM again. Model time runs at a multiple of real
+// time, or only when EcSimPlantAdvance moves it so policies can be run over
+// hours of model time in a fraction of a second. EcSimBatteryUpdate stands
+// in for the battery service pushing its status: it rewrites the slot attached
+// with EcSimAttachBattery under its sequence and tells the caller to raise
+// EC_NOTIFY_BATTERY when anything changed. Used by the user-mode WDF shim so
+// the driver core can be exercised end to end without QEMU.
+//
+// All entry points are thread safe.
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define ECSIM_DIRECT_REGS       14          // x4..x17
+#define ECSIM_DIRECT_DATA       ((ECSIM_DIRECT_REGS - 2) * 8) // Bulk bytes per direct response
+#define ECSIM_DATA_SIZE         0x10000     // EC data region served by the bulk commands
+
+// Initial contents of the EC data region
+#define ECSIM_DATA_PATTERN(offset)  ((uint8_t)((offset) * 7 + 3))
+
+// FF-A status codes returned by the entry points
+#define ECSIM_FFA_SUCCESS               0
+#define ECSIM_FFA_NOT_SUPPORTED         -1
+#define ECSIM_FFA_INVALID_PARAMETERS    -2
+#define ECSIM_FFA_NO_MEMORY             -3
+#define ECSIM_FFA_BUSY                  -4
+#define ECSIM_FFA_DENIED                -6
+
+#define ECSIM_MAX_SHARES        32          // Memory regions the SPMC tracks at once
+#define ECSIM_MAX_VARS          32          // Thermal service variables
+#define ECSIM_HISTORY_SENSORS   4           // Sensors that can keep a history
+#define ECSIM_HISTORY_SIZE      8192        // Samples kept per sensor
+
+// Value of history sample seq of a sensor, in tenths of a Kelvin
+#define ECSIM_HISTORY_VALUE(sensor, seq) ((uint32_t)(2980 + ((seq) * 13 + (sensor) * 7) % 200))
+
+// Thermal zone _TMP of thermal.asl reads, and the one the plant model serves
+#define ECSIM_PLANT_ZONE        2
+
+typedef struct _ECSIM ECSIM;
+
+typedef struct {
+    double ambientK;            // Temperature the skin cools towards
+    double heatW;               // Initial heat input, see EcSimPlantSetHeat
+    double capacityJK;          // Heat capacity of the skin and what it is bonded to
+    double naturalWK;           // Conductance to ambient with the fan stopped
+    double fanWK;               // Added conductance at fanMaxRpm
+    double fanExponent;         // Conductance grows with (rpm / fanMaxRpm) to this power
+    double fanMinRpm;           // Slowest the fan turns, lower commands other than 0 are raised to it
+    double fanMaxRpm;
+    double fanTauS;             // Time constant of the fan spinning up or down
+    double sensorTauS;          // Time constant of the sensor following the skin
+    uint32_t acceleration;      // Model seconds per real second, 0 to move only with EcSimPlantAdvance
+} ECSIM_PLANT_CONFIG;
+
+typedef struct {
+    uint64_t timeUs;            // Model time since EcSimPlantStart
+    double skinK;               // Real temperature
+    double sensorK;             // What _TMP reports, in Kelvin rather than tenths
+    double fanRpm;              // Actual speed
+    double commandRpm;          // Last speed commanded
+    double heatW;
+    uint64_t thresholdEvents;   // Times the sensor left the THRS range
+    bool automatic;             // The EC is running the fan from a fan profile
+} ECSIM_PLANT_STATE;
+
+typedef struct {
+    uint64_t directRequests;    // FFA_MSG_SEND_DIRECT_REQ2 calls
+    uint64_t messages;          // FFA_MSG_SEND2 calls accepted
+    uint64_t busy;              // FFA_MSG_SEND2 calls refused while the host RX was full
+    uint64_t bytesIn;           // Payload bytes received
+    uint64_t bytesOut;          // Payload bytes returned
+    uint64_t shares;            // FFA_MEM_SHARE calls accepted
+    uint64_t reclaims;          // FFA_MEM_RECLAIM calls accepted
+    uint64_t denied;            // FFA_MEM_RECLAIM calls refused while the EC held the region
+    uint32_t liveShares;        // Regions shared and not yet reclaimed
+    uint32_t mappedShares;      // Regions the EC currently has retrieved
+    uint64_t varReads;          // GET_VAR messages
+    uint64_t notModified;       // GET_VAR answered with EC_MSG_STATUS_NOT_MODIFIED
+    uint64_t samples;           // History samples recorded
+    uint64_t samplesRead;       // History samples returned to the host
+    uint64_t doorbells;         // EC_ASYNC direct requests
+    uint64_t asyncMessages;     // TX slots or stream records consumed by them
+    uint64_t fanProfiles;       // Fan profiles written, by message or direct request
+    uint64_t batteryUpdates;    // EcSimBatteryUpdate calls
+    uint64_t batteryPushes;     // Of those, the ones that changed the slot
+} ECSIM_STATS;
+
+ECSIM *EcSimCreate(void);
+
+void EcSimDestroy(
+    ECSIM *sim
+);
+
+int EcSimDirectReq2(
+    ECSIM *sim,
+    const uint8_t service[16],
+    uint64_t regs[ECSIM_DIRECT_REGS]
+);
+
+int EcSimMsgSend2(
+    ECSIM *sim,
+    const void *tx,
+    void *rx,
+    size_t size
+);
+
+int EcSimMemShare(
+    ECSIM *sim,
+    const void *tx,
+    uint32_t length,
+    uint64_t *handle
+);
+
+int EcSimMemReclaim(
+    ECSIM *sim,
+    uint64_t handle
+);
+
+int EcSimSetVar(
+    ECSIM *sim,
+    const uint8_t variable[16],
+    uint16_t instance,
+    const void *value,
+    uint16_t length
+);
+
+void EcSimAttachRing(
+    ECSIM *sim,
+    void *tx,
+    void *rx
+);
+
+void EcSimRxRelease(
+    ECSIM *sim
+);
+
+// Writes the EC_STATIC snapshot into page as SbsaQemuPlatformDxe does at boot
+void EcSimPublishStatic(
+    ECSIM *sim,
+    void *page
+);
+
+// Page holding the BatteryStatus_t slot at EC_BATTERY_STATUS_BASE
+void EcSimAttachBattery(
+    ECSIM *sim,
+    void *page
+);
+
+// Writes the battery status into the slot if it differs from the last one.
+// Returns: the EC_BATTERY_CHANGED_* bits, 0 when there is nothing to notify
+uint32_t EcSimBatteryUpdate(
+    ECSIM *sim,
+    uint32_t state,
+    uint32_t rate,
+    uint32_t capacity,
+    uint32_t voltage
+);
+
+// Fills config with the defaults, a 15W load on a 60J/K skin and a 5000rpm fan
+void EcSimPlantDefaults(
+    ECSIM_PLANT_CONFIG *config
+);
+
+// Starts or restarts the model at ambient with the fan stopped
+void EcSimPlantStart(
+    ECSIM *sim,
+    const ECSIM_PLANT_CONFIG *config
+);
+
+void EcSimPlantSetHeat(
+    ECSIM *sim,
+    double watts
+);
+
+void EcSimPlantAdvance(
+    ECSIM *sim,
+    uint64_t microseconds
+);
+
+void EcSimPlantGetState(
+    ECSIM *sim,
+    ECSIM_PLANT_STATE *state
+);
+
+void EcSimGetStats(
+    ECSIM *sim,
+    ECSIM_STATS *stats
+);
@@ -0,0 +1,2025 @@
+/*
+MIT License
+
+Copyright (c) 2025 Open Device Partnership
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Benchmarks and stress tests the driver's dispatch and notification paths
+// (kmdf/eccore.c) on top of the user-mode WDF shim. Every request must complete
+// exactly once and the shim must not see any contract violation, otherwise the
+// run fails.
+//
+//   ecbench [eval|loopback|notify|priority|reactor|rx|send2|share|var|history|subscribe|doorbell|stream|rxmap|static|battery|thermal|capture|all] [-threads N] [-seconds S] [-delay US]
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#ifdef __linux__
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#endif
+#include "wdfshim.h"
+
+extern "C" {
+    #include "../../kmdf/ecmsg.h"
+    #include "../../inc/ecring.h"
+    #include "../../uefi/Platforms/QemuSbsaPkg/SbsaQemuPlatformDxe/EcStaticSnapshot.h"
+    #include "../../inc/ectsdb.h"
+}
+
+#define ECB_MAX_THREADS         64
+#define ECB_NOTIFY_CLIENTS      2   // More than one so STATUS_DEVICE_BUSY is exercised
+#define ECB_METHOD              "\\_SB.ECT0.TEST"
+#define ECB_BUFFER_SIZE         (sizeof(MsgSend2Req_t) + EC_MSG_MAX_PAYLOAD)
+#define ECB_STREAM_BATCH        64  // Records per doorbell in the stream test
+#define ECB_STREAM_MESSAGE      48  // Largest of them, an ASYNC command is 20 bytes
+#define ECB_PLANT_STEP          50  // The sampled value moves this much every ECB_PLANT_STEP_MS
+#define ECB_PLANT_STEP_MS       20
+#define ECB_PLANT_NOISE         2   // Noise on every sample, inside ECB_DEADBAND
+#define ECB_DEADBAND            5
+#define ECB_ROUTINE_VALUES      48  // More than NOTIFY_QUEUE_DEPTH, so routine ones coalesce and drop
+#define ECB_URGENT_VALUE        0xE0
+#define ECB_CRITICAL_VALUE      0xF0
+#define ECB_THERMAL_HOURS       4   // Model time of each thermal policy run
+#define ECB_THERMAL_TICK_US     100000
+#define ECB_THERMAL_PHASE_S     600 // The heat load changes this often
+#define ECB_THERMAL_BAND        20  // THRS range around the last reading, tenths of a Kelvin
+#define ECB_BATTERY_PERIOD_US   50  // The EC reads the battery this often
+#define ECB_REACTOR_BURST       8   // Notifications raised together in the reactor test
+#define ECB_MAP_PHASE           256 // Batches before the rxmap test switches layout
+#define ECB_MAP_STREAM_BATCH    2   // Largest responses per doorbell, both always fit the RX stream
+#define ECB_CAPTURE_SAMPLES     1000 // Samples in the capture the loader test damages
+
+typedef std::chrono::steady_clock CLOCK;
+
+typedef struct {
+    const char *test;
+    uint32_t threads;
+    double seconds;
+    uint32_t delayUs;       // Simulated ACPI evaluation time
+} ECB_OPTIONS;
+
+typedef struct {
+    uint64_t submitted;
+    uint64_t succeeded;
+    uint64_t cancelled;
+    uint64_t busy;
+    uint64_t failed;
+    uint64_t lastCount;     // Notification count of the last delivered notification
+    uint64_t outOfOrder;
+    uint64_t latencyNs;
+    uint64_t bytes;         // Payload bytes moved by send2
+    uint64_t samples;       // History samples fetched
+    uint64_t dropped;       // History samples overwritten before they were fetched
+    uint64_t wakeups;       // Subscriptions completed or events signalled
+    uint64_t priority[NOTIFY_MAX_CLASSES]; // Notifications delivered per class
+    uint64_t loopWakeups;   // Returns from the reactor's poll with completions to drain
+} ECB_STATS;
+
+// One submitting thread, keeps a single request in flight
+struct ECB_CLIENT {
+    SHIM_REQUEST request;
+    std::atomic<uint32_t> done;
+    size_t inputLength;
+    size_t outputLength;
+    uint8_t input[ECB_BUFFER_SIZE];
+    uint8_t output[ECB_BUFFER_SIZE];
+    ECB_STATS stats;
+};
+
+static std::atomic<bool> gStop(false);
+
+static void OnComplete(SHIM_REQUEST *request, void *context)
+{
+    (void)request;
+    ((ECB_CLIENT *)context)->done.fetch_add(1, std::memory_order_release);
+}
+
+/*
+ * Function: SubmitAndWait
+ * ----------------------------
+ *  Submits the client's request and spins until it completes.
+ */
+static void SubmitAndWait(SHIM_DEVICE *device, ECB_CLIENT *client, ULONG ioctl)
+{
+    CLOCK::time_point start = CLOCK::now();
+
+    client->done.store(0, std::memory_order_relaxed);
+    ShimRequestInit(&client->request, ioctl, client->input, client->inputLength,
+                    client->output, client->outputLength, OnComplete, client);
+    client->request.file = client;  // Each client stands for its own handle
+    ShimSubmit(device, &client->request);
+    while (client->done.load(std::memory_order_acquire) == 0) {
+        std::this_thread::yield();
+    }
+
+    client->stats.submitted++;
+    client->stats.latencyNs += (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(CLOCK::now() - start).count();
+    switch (client->request.status) {
+    case STATUS_SUCCESS:
+        client->stats.succeeded++;
+        break;
+    case STATUS_CANCELLED:
+        client->stats.cancelled++;
+        break;
+    case STATUS_DEVICE_BUSY:
+        client->stats.busy++;
+        break;
+    default:
+        client->stats.failed++;
+        break;
+    }
+}
+
+static NTSTATUS DelayedEvaluate(
+    void *context,
+    const void *input,
+    size_t inputLength,
+    void *output,
+    size_t outputLength,
+    ULONG *bytesReturned
+)
+{
+    uint32_t delayUs = *(uint32_t *)context;
+    CLOCK::time_point end = CLOCK::now() + std::chrono::microseconds(delayUs);
+    static std::atomic<uint64_t> value(0);
+
+    (void)input;
+    (void)inputLength;
+
+    while (CLOCK::now() < end) {
+    }
+    if (outputLength < sizeof(uint64_t)) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    *(uint64_t *)output = value.fetch_add(1, std::memory_order_relaxed);
+    *bytesReturned = sizeof(uint64_t);
+    return STATUS_SUCCESS;
+}
+
+static void Report(const char *name, ECB_CLIENT *clients, uint32_t count, double seconds)
+{
+    ECB_STATS total;
+
+    memset(&total, 0, sizeof(total));
+    for (uint32_t i = 0; i < count; i++) {
+        total.submitted += clients[i].stats.submitted;
+        total.succeeded += clients[i].stats.succeeded;
+        total.cancelled += clients[i].stats.cancelled;
+        total.busy += clients[i].stats.busy;
+        total.failed += clients[i].stats.failed;
+        total.outOfOrder += clients[i].stats.outOfOrder;
+        total.latencyNs += clients[i].stats.latencyNs;
+        total.bytes += clients[i].stats.bytes;
+        total.samples += clients[i].stats.samples;
+        total.dropped += clients[i].stats.dropped;
+        total.wakeups += clients[i].stats.wakeups;
+    }
+
+    printf("%-8s %2u threads %12llu ops %8.2f Mops/s %8.2f us avg  ok %llu cancelled %llu busy %llu failed %llu\n",
+           name, count, (unsigned long long)total.submitted, total.submitted / seconds / 1e6,
+           total.submitted ? total.latencyNs / 1000.0 / total.submitted : 0.0,
+           (unsigned long long)total.succeeded, (unsigned long long)total.cancelled,
+           (unsigned long long)total.busy, (unsigned long long)total.failed);
+    if (total.bytes) {
+        printf("        %8.2f MB/s of payload\n", total.bytes / seconds / 1e6);
+    }
+    if (total.samples) {
+        printf("        %8.2f samples/s, %.1f samples per round trip, %llu dropped\n", total.samples / seconds,
+               (double)total.samples / (total.succeeded ? total.succeeded : 1), (unsigned long long)total.dropped);
+    }
+    if (total.wakeups) {
+        printf("        %8.2f wakeups/s, %llu value changes\n", total.wakeups / seconds, (unsigned long long)total.wakeups);
+    }
+    if (total.outOfOrder) {
+        printf("        %llu notifications delivered out of order\n", (unsigned long long)total.outOfOrder);
+    }
+}
+
+static void EvalClient(SHIM_DEVICE *device, ECB_CLIENT *client)
+{
+    // MethodName follows the Signature of an ACPI_EVAL_INPUT_BUFFER_V1_EX
+    memcpy(client->input + sizeof(UINT32), ECB_METHOD, sizeof(ECB_METHOD));
+    while (!gStop.load(std::memory_order_relaxed)) {
+        SubmitAndWait(device, client, IOCTL_ACPI_EVAL_METHOD_EX);
+    }
+}
+
+static void LoopbackClient(SHIM_DEVICE *device, ECB_CLIENT *client, const LoopbackResponseReq_t *canned)
+{
+    memcpy(client->input + sizeof(UINT32), ECB_METHOD, sizeof(ECB_METHOD));
+    while (!gStop.load(std::memory_order_relaxed)) {
+        SubmitAndWait(device, client, IOCTL_ACPI_EVAL_METHOD_EX);
+        if (client->request.status == STATUS_SUCCESS &&
+            (client->request.information != canned->length ||
+             memcmp(client->output, canned->response, canned->length) != 0)) {
+            client->stats.failed++;
+        }
+    }
+}
+
+/*
+ * Function: Control
+ * ----------------------------
+ *  Sends a control IOCTL that the core completes inline.
+ *
+ *  Returns: the completion status
+ */
+static NTSTATUS Control(SHIM_DEVICE *device, ULONG ioctl, void *input, size_t inputLength, void *output, size_t outputLength)
+{
+    SHIM_REQUEST request;
+
+    ShimRequestInit(&request, ioctl, input, inputLength, output, outputLength, NULL, NULL);
+    ShimSubmit(device, &request);
+    return ShimRequestCompleted(&request) ? request.status : STATUS_PENDING;
+}
+
+/*
+ * Function: OrphanSubscriptions
+ * ----------------------------
+ *  Fills every subscriber slot with event subscriptions from handles that are
+ *  then closed without removing them, as clients that exit or crash would.
+ *  Closing the handles must release the slots and the event references.
+ *
+ *  Returns: true if the slots and references came back
+ */
+static bool OrphanSubscriptions(SHIM_DEVICE *device, uint32_t sampler)
+{
+    static SHIM_EVENT events[SAMPLER_MAX_SUBSCRIBERS];
+    SamplerSubscribeReq_t req;
+    SamplerSubscribeRsp_t rsp;
+    SHIM_REQUEST request;
+    bool ok = true;
+
+    memset(&req, 0, sizeof(req));
+    req.sampler = sampler;
+    req.flags = SAMPLER_SUBSCRIBE_EVENT;
+    for (uint32_t i = 0; i < SAMPLER_MAX_SUBSCRIBERS; i++) {
+        ShimEventInit(&events[i]);
+        req.event = (UINT64)(uintptr_t)&events[i];
+        ShimRequestInit(&request, IOCTL_SAMPLER_SUBSCRIBE, &req, sizeof(req), &rsp, sizeof(rsp), NULL, NULL);
+        request.file = &events[i];
+        ShimSubmit(device, &request);
+        ok = ok && ShimRequestCompleted(&request) && request.status == STATUS_SUCCESS;
+    }
+    for (uint32_t i = 0; i < SAMPLER_MAX_SUBSCRIBERS; i++) {
+        ShimFileCleanup(device, &events[i]);
+        ok = ok && events[i].references.load() == 0;
+    }
+
+    // Every slot is free again
+    req.event = (UINT64)(uintptr_t)&events[0];
+    ok = ok && Control(device, IOCTL_SAMPLER_SUBSCRIBE, &req, sizeof(req), &rsp, sizeof(rsp)) == STATUS_SUCCESS;
+    req.flags = SAMPLER_SUBSCRIBE_REMOVE;
+    ok = ok && Control(device, IOCTL_SAMPLER_SUBSCRIBE, &req, sizeof(req), &rsp, sizeof(rsp)) == STATUS_SUCCESS;
+    return ok && events[0].references.load() == 0;
+}
+
+/*
+ * Function: SetupLoopback
+ * ----------------------------
+ *  Registers a canned integer response for ECB_METHOD and enables loopback.
+ *
+ *  Returns: true if the driver accepted both requests
+ */
+static bool SetupLoopback(SHIM_DEVICE *device, uint32_t delayUs, LoopbackResponseReq_t *canned)
+{
+    LoopbackReq_t req;
+    LoopbackRsp_t rsp;
+    // ACPI_EVAL_OUTPUT_BUFFER_V1 with one ACPI_METHOD_ARGUMENT_INTEGER
+    uint32_t output[] = { 0x426f6541, 24, 1, 0x00080000, 0x12345678, 0 };
+
+    memset(canned, 0, sizeof(*canned));
+    memcpy(canned->method, ECB_METHOD, sizeof(ECB_METHOD));
+    canned->length = sizeof(output);
+    memcpy(canned->response, output, sizeof(output));
+    if (Control(device, IOCTL_ADD_LOOPBACK_RESPONSE, canned, sizeof(*canned), &rsp, sizeof(rsp)) != STATUS_SUCCESS) {
+        return false;
+    }
+
+    req.flags = LOOPBACK_ENABLE;
+    req.delay = delayUs;
+    return Control(device, IOCTL_SET_LOOPBACK, &req, sizeof(req), &rsp, sizeof(rsp)) == STATUS_SUCCESS &&
+           rsp.enabled && rsp.entries == 1;
+}
+
+static void NotifyClient(SHIM_DEVICE *device, ECB_CLIENT *client)
+{
+    while (!gStop.load(std::memory_order_relaxed)) {
+        SubmitAndWait(device, client, IOCTL_GET_NOTIFICATION);
+        if (client->request.status == STATUS_SUCCESS) {
+            NotificationRsp_t rsp;
+            memcpy(&rsp, client->output, sizeof(rsp));
+            if (client->request.information != sizeof(rsp) || rsp.count <= client->stats.lastCount) {
+                client->stats.outOfOrder++;
+            }
+            client->stats.lastCount = rsp.count;
+        }
+    }
+}
+
+#ifdef __linux__
+// Signalled by every completion in the reactor test
+static int gReactorFd = -1;
+
+static void OnReactorComplete(SHIM_REQUEST *request, void *context)
+{
+    uint64_t one = 1;
+
+    OnComplete(request, context);
+    if (write(gReactorFd, &one, sizeof(one)) != sizeof(one)) {
+        ((ECB_CLIENT *)context)->stats.failed++;
+    }
+}
+
+/*
+ * Function: ReactorClient
+ * ----------------------------
+ *  Takes notifications the way EcNotifyDrain lets an event loop take them:
+ *  one thread that only blocks in poll() on an eventfd the completion
+ *  signals. Each wakeup collects the completed request and submits again
+ *  until a request stays pending, so everything queued meanwhile is taken
+ *  without blocking.
+ */
+static void ReactorClient(SHIM_DEVICE *device, ECB_CLIENT *client)
+{
+    struct pollfd fd = { gReactorFd, POLLIN, 0 };
+    uint64_t signals;
+
+    client->done.store(0, std::memory_order_relaxed);
+    ShimRequestInit(&client->request, IOCTL_GET_NOTIFICATION, client->input, client->inputLength,
+                    client->output, client->outputLength, OnReactorComplete, client);
+    ShimSubmit(device, &client->request);
+    while (!gStop.load(std::memory_order_relaxed)) {
+        if (poll(&fd, 1, 10) <= 0 || read(gReactorFd, &signals, sizeof(signals)) != sizeof(signals)) {
+            continue;
+        }
+        client->stats.loopWakeups++;
+
+        while (client->done.load(std::memory_order_acquire) != 0) {
+            NotificationRsp_t rsp;
+
+            client->stats.submitted++;
+            memcpy(&rsp, client->output, sizeof(rsp));
+            if (client->request.status != STATUS_SUCCESS) {
+                client->stats.failed++;
+            } else {
+                client->stats.succeeded++;
+                if (client->request.information != sizeof(rsp) || rsp.count <= client->stats.lastCount) {
+                    client->stats.outOfOrder++;
+                }
+                client->stats.lastCount = rsp.count;
+            }
+
+            client->done.store(0, std::memory_order_relaxed);
+            ShimRequestInit(&client->request, IOCTL_GET_NOTIFICATION, client->input, client->inputLength,
+                            client->output, client->outputLength, OnReactorComplete, client);
+            ShimSubmit(device, &client->request);
+        }
+    }
+
+    // As EcNotifyClose does, the last request is cancelled unless it already completed
+    ShimCancel(&client->request);
+    while (client->done.load(std::memory_order_acquire) == 0) {
+        std::this_thread::yield();
+    }
+    client->stats.cancelled += client->request.status == STATUS_CANCELLED;
+}
+#endif // __linux__
+
+/*
+ * Function: PriorityClient
+ * ----------------------------
+ *  Collects notifications slower than they arrive, so the routine queue
+ *  overflows, and checks that higher classes are never coalesced and arrive
+ *  in order.
+ */
+static void PriorityClient(SHIM_DEVICE *device, ECB_CLIENT *client)
+{
+    uint64_t last[NOTIFY_MAX_CLASSES] = { 0 };
+
+    while (!gStop.load(std::memory_order_relaxed)) {
+        SubmitAndWait(device, client, IOCTL_GET_NOTIFICATION);
+        if (client->request.status == STATUS_SUCCESS) {
+            NotificationRsp_t rsp;
+            memcpy(&rsp, client->output, sizeof(rsp));
+            if (client->request.information != sizeof(rsp) || rsp.priority >= NOTIFY_MAX_CLASSES) {
+                client->stats.failed++;
+                continue;
+            }
+            if (rsp.count <= last[rsp.priority] || (rsp.priority != NOTIFY_CLASS_ROUTINE && rsp.coalesced != 0)) {
+                client->stats.outOfOrder++;
+            }
+            last[rsp.priority] = rsp.count;
+            client->stats.priority[rsp.priority]++;
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(20));
+    }
+}
+
+static void RxClient(SHIM_DEVICE *device, ECB_CLIENT *client)
+{
+    while (!gStop.load(std::memory_order_relaxed)) {
+        SubmitAndWait(device, client, IOCTL_READ_RX_BUFFER);
+    }
+}
+
+/*
+ * Function: StaticClient
+ * ----------------------------
+ *  Reads the static snapshot back to back and checks every copy, as each
+ *  client of the driver would once at startup.
+ */
+static void StaticClient(SHIM_DEVICE *device, ECB_CLIENT *client)
+{
+    const EC_STATIC *snapshot = (const EC_STATIC *)client->output;
+
+    while (!gStop.load(std::memory_order_relaxed)) {
+        SubmitAndWait(device, client, IOCTL_GET_STATIC);
+        if (client->request.status != STATUS_SUCCESS) {
+            continue;
+        }
+        if (client->request.information != sizeof(EC_STATIC) || EcStaticCheck(snapshot) != EC_STATIC_VALID ||
+            snapshot->FwState != 1 || snapshot->ServiceCount != 2 || snapshot->DsmCount != 3) {
+            client->stats.failed++;
+            continue;
+        }
+        client->stats.bytes += sizeof(EC_STATIC);
+    }
+}
+
+// Newest battery status the clients have collected, as eclib keeps it
+static std::mutex gBatteryLock;
+static BatteryStatus_t gBattery;
+
+/*
+ * Function: BatteryCollect
+ * ----------------------------
+ *  Checks a delivered battery notification and keeps its status if it is newer
+ *  than the one held. Each client must see the sequence grow and never a status
+ *  caught half written.
+ */
+static void BatteryCollect(ECB_CLIENT *client, uint32_t *last)
+{
+    NotificationRsp_t rsp;
+
+    memcpy(&rsp, client->output, sizeof(rsp));
+    if (client->request.information != sizeof(rsp) || rsp.lastevent != EC_NOTIFY_BATTERY ||
+        rsp.battery.sequence == 0 || (rsp.battery.sequence & 1) || rsp.battery.changed == 0 ||
+        (int32_t)(rsp.battery.sequence - *last) <= 0) {
+        client->stats.outOfOrder++;
+        return;
+    }
+    *last = rsp.battery.sequence;
+    client->stats.wakeups++;
+
+    std::lock_guard<std::mutex> lock(gBatteryLock);
+    if ((int32_t)(rsp.battery.sequence - gBattery.sequence) > 0) {
+        gBattery = rsp.battery;
+    }
+}
+
+static void BatteryClient(SHIM_DEVICE *device, ECB_CLIENT *client)
+{
+    uint32_t last = 0;
+
+    while (!gStop.load(std::memory_order_relaxed)) {
+        SubmitAndWait(device, client, IOCTL_GET_NOTIFICATION);
+        if (client->request.status == STATUS_SUCCESS) {
+            BatteryCollect(client, &last);
+        }
+    }
+}
+
+/*
+ * Function: Send2Client
+ * ----------------------------
+ *  Alternates echo and bulk read messages of random size up to the largest
+ *  payload and checks every byte that comes back.
+ */
+static void Send2Client(SHIM_DEVICE *device, ECB_CLIENT *client, uint32_t seed)
+{
+    MsgSend2Req_t *req = (MsgSend2Req_t *)client->input;
+    MsgSend2Rsp_t *rsp = (MsgSend2Rsp_t *)client->output;
+    uint8_t *payload = client->input + sizeof(*req);
+    uint8_t *returned = client->output + sizeof(*rsp);
+    MsgBulkReq_t bulk;
+    bool echo = false;
+
+    memcpy(req->service, EcMsgManagementService, sizeof(req->service));
+    while (!gStop.load(std::memory_order_relaxed)) {
+        seed = seed * 1103515245 + 12345;
+        echo = !echo;
+        if (echo) {
+            req->command = EC_MSG_CMD_ECHO;
+            req->length = (seed >> 8) % EC_MSG_MAX_PAYLOAD + 1;
+            memset(payload, (int)seed, req->length);
+        } else {
+            bulk.length = (seed >> 8) % EC_MSG_MAX_PAYLOAD + 1;
+            bulk.offset = (seed >> 4) % (ECSIM_DATA_SIZE - bulk.length);
+            req->command = EC_MSG_CMD_READ_BULK;
+            req->length = sizeof(bulk);
+            memcpy(payload, &bulk, sizeof(bulk));
+        }
+        client->inputLength = sizeof(*req) + req->length;
+
+        SubmitAndWait(device, client, IOCTL_FFA_MSG_SEND2);
+        if (client->request.status != STATUS_SUCCESS) {
+            continue;
+        }
+
+        bool match = rsp->status == EC_MSG_STATUS_SUCCESS &&
+                     client->request.information == sizeof(*rsp) + rsp->length;
+        if (match && echo) {
+            match = rsp->length == req->length && memcmp(returned, payload, req->length) == 0;
+        } else if (match) {
+            match = rsp->length == bulk.length;
+            for (uint32_t i = 0; match && i < bulk.length; i++) {
+                match = returned[i] == ECSIM_DATA_PATTERN(bulk.offset + i);
+            }
+        }
+        if (match) {
+            client->stats.bytes += req->length + rsp->length;
+        } else {
+            client->stats.failed++;
+        }
+    }
+}
+
+/*
+ * Function: ShareClient
+ * ----------------------------
+ *  Shares regions of random size with the EC, checks the EC filled them and
+ *  reclaims them again. The last region is left shared for the device to
+ *  reclaim when the client's handle is closed. Every other region is first
+ *  offered to reclaim through another handle, which must be refused.
+ */
+static void ShareClient(SHIM_DEVICE *device, ECB_CLIENT *client, uint32_t seed)
+{
+    MemShareReq_t *req = (MemShareReq_t *)client->input;
+    MemReclaimReq_t *reclaim = (MemReclaimReq_t *)client->input;
+    MemShareRsp_t rsp;
+
+    client->outputLength = sizeof(rsp);
+    while (!gStop.load(std::memory_order_relaxed)) {
+        seed = seed * 1103515245 + 12345;
+        req->pages = (seed >> 8) % 16 + 1;
+        req->reserved = 0;
+        client->inputLength = sizeof(*req);
+        SubmitAndWait(device, client, IOCTL_FFA_MEM_SHARE);
+        if (client->request.status == STATUS_INSUFFICIENT_RESOURCES) {
+            // More clients than EC_SHARE_MAX_REGIONS
+            client->stats.failed--;
+            client->stats.busy++;
+            continue;
+        }
+        if (client->request.status != STATUS_SUCCESS) {
+            continue;
+        }
+
+        // Addresses are host pointers in the simulator
+        memcpy(&rsp, client->output, sizeof(rsp));
+        const uint8_t *region = (const uint8_t *)(uintptr_t)rsp.address;
+        uint32_t last = req->pages * 0x1000 - 1;
+        if (client->request.information != sizeof(rsp) || rsp.status != EC_MSG_STATUS_SUCCESS ||
+            rsp.pages != req->pages || region[0] != ECSIM_DATA_PATTERN(0) ||
+            region[last] != ECSIM_DATA_PATTERN(last)) {
+            client->stats.failed++;
+            continue;
+        }
+        client->stats.bytes += rsp.pages * 0x1000;
+        if (gStop.load(std::memory_order_relaxed)) {
+            break;
+        }
+
+        reclaim->handle = rsp.handle;
+        client->inputLength = sizeof(*reclaim);
+        if (seed & 0x10000) {
+            // Regions belong to the handle they were shared on
+            ShimRequestInit(&client->request, IOCTL_FFA_MEM_RECLAIM, client->input, client->inputLength,
+                            client->output, client->outputLength, NULL, NULL);
+            client->request.file = &gStop;
+            ShimSubmit(device, &client->request);
+            while (!ShimRequestCompleted(&client->request)) {
+                std::this_thread::yield();
+            }
+            if (client->request.status != STATUS_INVALID_PARAMETER) {
+                client->stats.failed++;
+            }
+        }
+        SubmitAndWait(device, client, IOCTL_FFA_MEM_RECLAIM);
+        memcpy(&rsp, client->output, sizeof(rsp));
+        if (client->request.status == STATUS_SUCCESS &&
+            (rsp.handle != reclaim->handle || rsp.status != EC_MSG_STATUS_SUCCESS)) {
+            client->stats.failed++;
+        }
+    }
+}
+
+// OnTemp in the simulator, changed by VarWriter while the var test runs
+static const uint8_t gVarOnTemp[16] = {
+    0x67, 0xb5, 0x17, 0xba, 0x68, 0xc3, 0xd5, 0x48, 0xbc, 0x6f, 0xa3, 0x12, 0xa4, 0x15, 0x83, 0xc1
+};
+
+/*
+ * Function: VarClient
+ * ----------------------------
+ *  Polls a thermal variable with conditional reads, keeping the value and
+ *  generation like the eclib cache, and checks generations only move forward.
+ */
+static void VarClient(SHIM_DEVICE *device, ECB_CLIENT *client)
+{
+    MsgSend2Req_t *req = (MsgSend2Req_t *)client->input;
+    MsgVarReq_t *var = (MsgVarReq_t *)(req + 1);
+    MsgSend2Rsp_t *rsp = (MsgSend2Rsp_t *)client->output;
+    MsgVarRsp_t value;
+
+    memcpy(req->service, EcMsgThermalService, sizeof(req->service));
+    req->command = EC_MSG_CMD_GET_VAR;
+    req->length = sizeof(*var);
+    memcpy(var->variable, gVarOnTemp, sizeof(var->variable));
+    var->instance = 1;
+    var->length = EC_VAR_MAX_LENGTH;
+    var->generation = 0;
+    client->inputLength = sizeof(*req) + sizeof(*var);
+    client->outputLength = sizeof(*rsp) + sizeof(value) + EC_VAR_MAX_LENGTH;
+
+    while (!gStop.load(std::memory_order_relaxed)) {
+        SubmitAndWait(device, client, IOCTL_FFA_MSG_SEND2);
+        if (client->request.status != STATUS_SUCCESS) {
+            continue;
+        }
+
+        client->stats.bytes += rsp->length;
+        if (rsp->status == EC_MSG_STATUS_NOT_MODIFIED && rsp->length == 0 && var->generation != 0) {
+            continue;
+        }
+        memcpy(&value, rsp + 1, sizeof(value));
+        if (rsp->status != EC_MSG_STATUS_SUCCESS || rsp->length != sizeof(value) + sizeof(UINT32) ||
+            value.generation <= var->generation) {
+            client->stats.failed++;
+            continue;
+        }
+        var->generation = value.generation;
+    }
+}
+
+/*
+ * Function: HistoryClient
+ * ----------------------------
+ *  Wakes every few milliseconds and fetches every sample of its sensor recorded
+ *  since the last fetch in one message, checking values and sequence continuity.
+ */
+static void HistoryClient(SHIM_DEVICE *device, ECB_CLIENT *client, uint8_t sensor)
+{
+    MsgSend2Req_t *req = (MsgSend2Req_t *)client->input;
+    MsgHistoryReadReq_t *read = (MsgHistoryReadReq_t *)(req + 1);
+    MsgSend2Rsp_t *rsp = (MsgSend2Rsp_t *)client->output;
+    MsgHistoryReadRsp_t history;
+    const uint32_t *samples = (const uint32_t *)(client->output + sizeof(*rsp) + sizeof(history));
+
+    memcpy(req->service, EcMsgThermalService, sizeof(req->service));
+    req->command = EC_MSG_CMD_HISTORY_READ;
+    req->length = sizeof(*read);
+    memset(read, 0, sizeof(*read));
+    read->sensor = sensor;
+    read->max_samples = EC_HISTORY_MAX_SAMPLES;
+    client->inputLength = sizeof(*req) + sizeof(*read);
+    client->outputLength = sizeof(client->output);
+
+    while (!gStop.load(std::memory_order_relaxed)) {
+        SubmitAndWait(device, client, IOCTL_FFA_MSG_SEND2);
+        if (client->request.status != STATUS_SUCCESS) {
+            continue;
+        }
+
+        memcpy(&history, rsp + 1, sizeof(history));
+        bool match = rsp->status == EC_MSG_STATUS_SUCCESS &&
+                     rsp->length == sizeof(history) + history.count * sizeof(uint32_t) &&
+                     history.sequence == read->sequence + history.dropped &&
+                     history.next == history.sequence + history.count;
+        for (uint32_t i = 0; match && i < history.count; i++) {
+            match = samples[i] == ECSIM_HISTORY_VALUE(sensor, history.sequence + i);
+        }
+        if (!match) {
+            client->stats.failed++;
+            continue;
+        }
+        client->stats.bytes += rsp->length;
+        client->stats.samples += history.count;
+        client->stats.dropped += history.dropped;
+        read->sequence = history.next;
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+}
+
+/*
+ * Function: ConfigureHistory
+ * ----------------------------
+ *  Starts sampling a sensor every periodUs through a HISTORY_CONFIG message.
+ *
+ *  Returns: true if the EC accepted the configuration
+ */
+static bool ConfigureHistory(SHIM_DEVICE *device, uint8_t sensor, uint32_t periodUs)
+{
+    uint8_t input[sizeof(MsgSend2Req_t) + sizeof(MsgHistoryConfigReq_t)];
+    MsgSend2Req_t *req = (MsgSend2Req_t *)input;
+    MsgHistoryConfigReq_t *config = (MsgHistoryConfigReq_t *)(req + 1);
+    MsgSend2Rsp_t rsp;
+    SHIM_REQUEST request;
+
+    memset(input, 0, sizeof(input));
+    memcpy(req->service, EcMsgThermalService, sizeof(req->service));
+    req->command = EC_MSG_CMD_HISTORY_CONFIG;
+    req->length = sizeof(*config);
+    config->sensor = sensor;
+    config->period_us = periodUs;
+
+    // Runs on a worker, so wait for it like a client would
+    std::atomic<uint32_t> done(0);
+    ShimRequestInit(&request, IOCTL_FFA_MSG_SEND2, input, sizeof(input), &rsp, sizeof(rsp),
+                    [](SHIM_REQUEST *, void *context) { ((std::atomic<uint32_t> *)context)->store(1); }, &done);
+    ShimSubmit(device, &request);
+    while (done.load() == 0) {
+        std::this_thread::yield();
+    }
+    return request.status == STATUS_SUCCESS && rsp.status == EC_MSG_STATUS_SUCCESS;
+}
+
+/*
+ * Function: PlantEvaluate
+ * ----------------------------
+ *  Evaluator for the subscribe test. Returns a value that steps up every
+ *  ECB_PLANT_STEP_MS with noise inside the deadband on every evaluation.
+ */
+static NTSTATUS PlantEvaluate(
+    void *context,
+    const void *input,
+    size_t inputLength,
+    void *output,
+    size_t outputLength,
+    ULONG *bytesReturned
+)
+{
+    const CLOCK::time_point *start = (const CLOCK::time_point *)context;
+    static std::atomic<uint32_t> evaluations(0);
+    uint64_t ms = (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(CLOCK::now() - *start).count();
+    uint64_t value = 3000 + (ms / ECB_PLANT_STEP_MS) * ECB_PLANT_STEP +
+                     evaluations.fetch_add(1, std::memory_order_relaxed) % (2 * ECB_PLANT_NOISE + 1);
+    // ACPI_EVAL_OUTPUT_BUFFER_V1 with one ACPI_METHOD_ARGUMENT_INTEGER
+    uint32_t rsp[] = { 0x426f6541, 24, 1, 0x00080000, (uint32_t)value, (uint32_t)(value >> 32) };
+
+    (void)input;
+    (void)inputLength;
+    if (outputLength < sizeof(rsp)) {
+        return STATUS_BUFFER_OVERFLOW;
+    }
+    memcpy(output, rsp, sizeof(rsp));
+    *bytesReturned = sizeof(rsp);
+    return STATUS_SUCCESS;
+}
+
+/*
+ * Function: SubscribeClient
+ * ----------------------------
+ *  Reads the current value, then keeps a subscription pended and checks that
+ *  every completion moved further than the deadband from the value it named.
+ *  Requests cancelled by the canceller are simply resubmitted.
+ */
+static void SubscribeClient(SHIM_DEVICE *device, ECB_CLIENT *client, uint32_t sampler)
+{
+    SamplerSubscribeReq_t *req = (SamplerSubscribeReq_t *)client->input;
+    SamplerSubscribeRsp_t rsp;
+
+    memset(req, 0, sizeof(*req));
+    req->sampler = sampler;
+    req->flags = SAMPLER_SUBSCRIBE_CURRENT;
+    req->deadband = ECB_DEADBAND;
+    client->inputLength = sizeof(*req);
+    client->outputLength = sizeof(rsp);
+
+    while (!gStop.load(std::memory_order_relaxed)) {
+        SubmitAndWait(device, client, IOCTL_SAMPLER_SUBSCRIBE);
+        if (client->request.status != STATUS_SUCCESS) {
+            continue;
+        }
+
+        memcpy(&rsp, client->output, sizeof(rsp));
+        if (client->request.information != sizeof(rsp) || rsp.sampler != sampler || rsp.status != STATUS_SUCCESS ||
+            (req->flags == 0 && (rsp.value <= req->value + ECB_DEADBAND))) {
+            client->stats.failed++;
+        }
+        if (req->flags == 0) {
+            client->stats.wakeups++;
+        }
+        req->flags = 0;
+        req->value = rsp.value;
+    }
+}
+
+/*
+ * Function: EventClient
+ * ----------------------------
+ *  Subscribes with an event and reads the value each time it is signalled,
+ *  then removes the subscription.
+ */
+static void EventClient(SHIM_DEVICE *device, ECB_CLIENT *client, uint32_t sampler, SHIM_EVENT *event)
+{
+    SamplerSubscribeReq_t req;
+    SamplerSubscribeRsp_t rsp;
+    uint64_t last;
+
+    memset(&req, 0, sizeof(req));
+    req.sampler = sampler;
+    req.flags = SAMPLER_SUBSCRIBE_EVENT;
+    req.deadband = ECB_DEADBAND;
+    req.event = (UINT64)(uintptr_t)event;
+    if (Control(device, IOCTL_SAMPLER_SUBSCRIBE, &req, sizeof(req), &rsp, sizeof(rsp)) != STATUS_SUCCESS) {
+        client->stats.failed++;
+        return;
+    }
+
+    last = rsp.value;
+    while (!gStop.load(std::memory_order_relaxed)) {
+        if (!ShimEventWait(event, 1000)) {
+            continue;
+        }
+
+        // Subscribing again returns the latest sample and moves the baseline to it
+        client->stats.submitted++;
+        if (Control(device, IOCTL_SAMPLER_SUBSCRIBE, &req, sizeof(req), &rsp, sizeof(rsp)) != STATUS_SUCCESS ||
+            rsp.value <= last + ECB_DEADBAND) {
+            client->stats.failed++;
+            continue;
+        }
+        client->stats.succeeded++;
+        client->stats.wakeups++;
+        last = rsp.value;
+    }
+
+    req.flags = SAMPLER_SUBSCRIBE_REMOVE;
+    if (Control(device, IOCTL_SAMPLER_SUBSCRIBE, &req, sizeof(req), &rsp, sizeof(rsp)) != STATUS_SUCCESS) {
+        client->stats.failed++;
+    }
+}
+
+/*
+ * Function: RegisterSampler
+ * ----------------------------
+ *  Registers or, with a period of 0, unregisters ECB_METHOD with the driver's sampler.
+ *
+ *  Returns: true if the driver accepted the request
+ */
+static bool RegisterSampler(SHIM_DEVICE *device, uint32_t periodMs, SamplerRegisterRsp_t *rsp)
+{
+    SamplerRegisterReq_t req;
+
+    memset(&req, 0, sizeof(req));
+    memcpy(req.method, ECB_METHOD, sizeof(ECB_METHOD));
+    req.period_ms = periodMs;
+    return Control(device, IOCTL_SAMPLER_REGISTER, &req, sizeof(req), rsp, sizeof(*rsp)) == STATUS_SUCCESS;
+}
+
+static int RingDoorbell(void *context, uint64_t argument)
+{
+    uint64_t regs[ECSIM_DIRECT_REGS] = { argument };
+
+    if (EcSimDirectReq2((ECSIM *)context, EcMsgManagementService, regs) != ECSIM_FFA_SUCCESS) {
+        return -1;
+    }
+    return regs[0] == EC_MSG_STATUS_SUCCESS ? 0 : -1;
+}
+
+/*
+ * Function: DoorbellClient
+ * ----------------------------
+ *  Submits batches of 1 to ECRING_SLOTS random sized entries through the
+ *  shared memory slot queues with one doorbell each and checks every response
+ *  the simulated EC echoes back.
+ */
+static void DoorbellClient(SHIM_DEVICE *device, ECB_CLIENT *client, uint8_t *window)
+{
+    ECRING_MESSAGE messages[ECRING_SLOTS];
+    uint16_t sequences[ECRING_SLOTS];
+    uint8_t response[ECRING_ENTRY_SIZE];
+    uint32_t seed = 1;
+    uint32_t submitted;
+    uint16_t length;
+    ECRING ring;
+
+    EcSimAttachRing(device->sim, window, window + ECRING_WINDOW_SIZE);
+    EcRingInit(&ring, window, window + ECRING_WINDOW_SIZE, RingDoorbell, device->sim);
+    while (!gStop.load(std::memory_order_relaxed)) {
+        seed = seed * 1103515245 + 12345;
+        uint32_t count = 1 + (seed >> 16) % ECRING_SLOTS;
+
+        for (uint32_t i = 0; i < count; i++) {
+            seed = seed * 1103515245 + 12345;
+            messages[i].data = client->input + i * ECRING_ENTRY_SIZE;
+            messages[i].length = (uint16_t)(1 + (seed >> 16) % ECRING_ENTRY_SIZE);
+            memset(client->input + i * ECRING_ENTRY_SIZE, (int)(seed >> 8), messages[i].length);
+        }
+        if (EcRingSubmitBatch(&ring, messages, count, sequences, &submitted) != ECRING_STATUS_SUCCESS ||
+            submitted != count) {
+            client->stats.failed++;
+            continue;
+        }
+
+        // The simulator answers before the doorbell returns
+        for (uint32_t i = 0; i < count; i++) {
+            client->stats.submitted++;
+            if (EcRingReceive(&ring, sequences[i], response, sizeof(response), &length) != ECRING_STATUS_SUCCESS ||
+                length != messages[i].length || memcmp(response, messages[i].data, length) != 0) {
+                client->stats.failed++;
+                continue;
+            }
+            client->stats.succeeded++;
+            client->stats.bytes += length;
+        }
+    }
+}
+
+/*
+ * Function: StreamClient
+ * ----------------------------
+ *  Submits batches of 1 to ECB_STREAM_BATCH small random sized commands packed
+ *  into the shared memory streams with one doorbell each and checks every
+ *  response the simulated EC echoes back.
+ */
+static void StreamClient(SHIM_DEVICE *device, ECB_CLIENT *client, uint8_t *window)
+{
+    ECRING_MESSAGE messages[ECB_STREAM_BATCH];
+    uint16_t sequences[ECB_STREAM_BATCH];
+    uint8_t response[ECB_STREAM_MESSAGE];
+    uint32_t seed = 1;
+    uint32_t submitted;
+    uint16_t length;
+    ECRING ring;
+
+    EcSimAttachRing(device->sim, window, window + ECRING_WINDOW_SIZE);
+    EcRingInitStream(&ring, window, window + ECRING_WINDOW_SIZE, RingDoorbell, device->sim);
+    while (!gStop.load(std::memory_order_relaxed)) {
+        seed = seed * 1103515245 + 12345;
+        uint32_t count = 1 + (seed >> 16) % ECB_STREAM_BATCH;
+
+        for (uint32_t i = 0; i < count; i++) {
+            seed = seed * 1103515245 + 12345;
+            messages[i].data = client->input + i * ECB_STREAM_MESSAGE;
+            messages[i].length = (uint16_t)(1 + (seed >> 16) % ECB_STREAM_MESSAGE);
+            memset(client->input + i * ECB_STREAM_MESSAGE, (int)(seed >> 8), messages[i].length);
+        }
+        if (EcRingSubmitBatch(&ring, messages, count, sequences, &submitted) != ECRING_STATUS_SUCCESS ||
+            submitted != count) {
+            client->stats.failed++;
+            continue;
+        }
+
+        // Newest first, so records are consumed out of order and the tail only
+        // moves once the whole batch is read
+        for (uint32_t i = count; i-- > 0;) {
+            client->stats.submitted++;
+            if (EcRingReceive(&ring, sequences[i], response, sizeof(response), &length) != ECRING_STATUS_SUCCESS ||
+                length != messages[i].length || memcmp(response, messages[i].data, length) != 0) {
+                client->stats.failed++;
+                continue;
+            }
+            client->stats.succeeded++;
+            client->stats.bytes += length;
+        }
+    }
+}
+
+/*
+ * Function: MapClient
+ * ----------------------------
+ *  Maps the shared memory window with IOCTL_MAP_RX and takes every response
+ *  where the simulated EC wrote it in the read-only RX view, checking it in
+ *  place before releasing it. Alternates between slots, up to ECRING_SLOTS
+ *  entries per doorbell, and streams with responses of up to
+ *  ECRING_STREAM_MAX_PAYLOAD bytes, formatted again from the EC side at each
+ *  switch. A write by the ring to the RX view would fault. Mapping again on
+ *  the same handle must return the same views, which go at cleanup.
+ */
+static void MapClient(SHIM_DEVICE *device, ECB_CLIENT *client)
+{
+    ECRING_MESSAGE messages[ECRING_SLOTS];
+    uint16_t sequences[ECRING_SLOTS];
+    MapRxRsp_t map;
+    BatteryStatus_t battery;
+    uint8_t *ecTx = device->window;
+    uint8_t *ecRx = device->window + EC_MAP_TX_LENGTH;
+    uint32_t seed = 1;
+    uint32_t submitted;
+    ECRING ring;
+
+    client->outputLength = sizeof(MapRxRsp_t);
+    SubmitAndWait(device, client, IOCTL_MAP_RX);
+    if (client->request.status != STATUS_SUCCESS || client->request.information != sizeof(map)) {
+        return;
+    }
+    memcpy(&map, client->output, sizeof(map));
+    SubmitAndWait(device, client, IOCTL_MAP_RX);
+    if (client->request.status != STATUS_SUCCESS || memcmp(client->output, &map, sizeof(map)) != 0) {
+        client->stats.failed++;
+        ShimFileCleanup(device, client);
+        return;
+    }
+
+    // The event page follows RX in the view and shows what the EC writes
+    EcSimBatteryUpdate(device->sim, 0x1, 8000, 42000, 11400);
+    memcpy(&battery, (const uint8_t *)(uintptr_t)map.rx + (EC_BATTERY_STATUS_BASE - EC_SHARED_RX_BASE), sizeof(battery));
+    if (map.rxLength != EC_MAP_RX_LENGTH || battery.sequence == 0 || battery.capacity != 42000) {
+        client->stats.failed++;
+        ShimFileCleanup(device, client);
+        return;
+    }
+    memset(&client->stats, 0, sizeof(client->stats));
+
+    for (uint32_t phase = 0; !gStop.load(std::memory_order_relaxed); phase++) {
+        bool stream = (phase & 1) != 0;
+        uint32_t maxBatch = stream ? ECB_MAP_STREAM_BATCH : ECRING_SLOTS;
+        uint32_t maxLength = stream ? ECRING_STREAM_MAX_PAYLOAD : ECRING_ENTRY_SIZE;
+
+        memset(ecTx, 0, ECRING_WINDOW_SIZE);
+        memset(ecRx, 0, ECRING_WINDOW_SIZE);
+        if (stream) {
+            EcRingStreamFormat(ecRx);
+        }
+        EcSimAttachRing(device->sim, ecTx, ecRx);
+        if (EcRingInitReadOnly(&ring, (void *)(uintptr_t)map.tx, (const void *)(uintptr_t)map.rx,
+                               stream ? ECRING_LAYOUT_STREAM : ECRING_LAYOUT_SLOTS,
+                               RingDoorbell, device->sim) != ECRING_STATUS_SUCCESS) {
+            client->stats.failed++;
+            break;
+        }
+
+        for (uint32_t batch = 0; batch < ECB_MAP_PHASE && !gStop.load(std::memory_order_relaxed); batch++) {
+            seed = seed * 1103515245 + 12345;
+            uint32_t count = 1 + (seed >> 16) % maxBatch;
+
+            for (uint32_t i = 0; i < count; i++) {
+                seed = seed * 1103515245 + 12345;
+                messages[i].data = client->input + i * maxLength;
+                messages[i].length = (uint16_t)(1 + (seed >> 16) % maxLength);
+                memset(client->input + i * maxLength, (int)(seed >> 8), messages[i].length);
+            }
+            if (EcRingSubmitBatch(&ring, messages, count, sequences, &submitted) != ECRING_STATUS_SUCCESS ||
+                submitted != count) {
+                client->stats.failed++;
+                continue;
+            }
+
+            // Newest first, so a stream tail only moves once the batch is released
+            for (uint32_t i = count; i-- > 0;) {
+                const void *data;
+                uint16_t length;
+
+                client->stats.submitted++;
+                if (EcRingPeek(&ring, sequences[i], &data, &length) != ECRING_STATUS_SUCCESS ||
+                    length != messages[i].length || memcmp(data, messages[i].data, length) != 0 ||
+                    EcRingRelease(&ring, sequences[i]) != ECRING_STATUS_SUCCESS) {
+                    client->stats.failed++;
+                    continue;
+                }
+                client->stats.succeeded++;
+                client->stats.bytes += length;
+            }
+        }
+    }
+    ShimFileCleanup(device, client);
+}
+
+static void VarWriter(void *context)
+{
+    SHIM_DEVICE *device = (SHIM_DEVICE *)context;
+    static uint32_t value = 3000;
+
+    value++;
+    EcSimSetVar(device->sim, gVarOnTemp, 1, &value, sizeof(value));
+}
+
+/*
+ * Function: BatteryWriter
+ * ----------------------------
+ *  Stands in for the EC battery service reading a discharging battery. The
+ *  capacity drops every 4th read, the rate moves every 8th, the voltage every
+ *  16th and the charger comes and goes every 1024th, so most reads change
+ *  nothing and only the others are pushed.
+ */
+static void BatteryWriter(void *context)
+{
+    SHIM_DEVICE *device = (SHIM_DEVICE *)context;
+    static uint32_t tick = 0;
+
+    tick++;
+    if (EcSimBatteryUpdate(device->sim, ((tick / 1024) & 1) ? 0x2 : 0x1, 8000 + (tick / 8) % 16 * 100,
+                           50000 - (tick / 4) % 40000, 11400 + (tick / 16) % 32) != 0) {
+        EcCoreNotify(&device->core, EC_NOTIFY_BATTERY);
+    }
+}
+
+static void Notify(void *context)
+{
+    SHIM_DEVICE *device = (SHIM_DEVICE *)context;
+    static ULONG value = 0;
+
+    EcCoreNotify(&device->core, value++);
+}
+
+static void ReactorNotify(void *context)
+{
+    SHIM_DEVICE *device = (SHIM_DEVICE *)context;
+    static ULONG value = 0;
+
+    for (uint32_t i = 0; i < ECB_REACTOR_BURST; i++) {
+        EcCoreNotify(&device->core, value++ % ECB_ROUTINE_VALUES);
+    }
+}
+
+static void PriorityNotify(void *context)
+{
+    SHIM_DEVICE *device = (SHIM_DEVICE *)context;
+    static ULONG tick = 0;
+    static uint32_t seed = 1;
+
+    // A burst of routine notifications every tick with a critical or an urgent one
+    // in the middle of every fourth burst
+    tick++;
+    for (uint32_t i = 0; i < NOTIFY_QUEUE_DEPTH; i++) {
+        if (i == NOTIFY_QUEUE_DEPTH / 2 && tick % 8 == 0) {
+            EcCoreNotify(&device->core, ECB_CRITICAL_VALUE);
+        } else if (i == NOTIFY_QUEUE_DEPTH / 2 && tick % 8 == 4) {
+            EcCoreNotify(&device->core, ECB_URGENT_VALUE);
+        }
+        seed = seed * 1103515245 + 12345;
+        EcCoreNotify(&device->core, (seed >> 16) % ECB_ROUTINE_VALUES);
+    }
+}
+
+/*
+ * Function: ConfigureClasses
+ * ----------------------------
+ *  Makes ECB_CRITICAL_VALUE the highest class and ECB_URGENT_VALUE the next,
+ *  or only returns the statistics if set is false.
+ *
+ *  Returns: true if the driver accepted the request
+ */
+static bool ConfigureClasses(SHIM_DEVICE *device, bool set, NotifyClassesRsp_t *rsp)
+{
+    NotifyClassesReq_t req;
+
+    memset(&req, 0, sizeof(req));
+    if (set) {
+        req.flags = NOTIFY_CLASSES_SET | NOTIFY_CLASSES_RESET;
+        req.classes[ECB_URGENT_VALUE] = NOTIFY_MAX_CLASSES - 2;
+        req.classes[ECB_CRITICAL_VALUE] = NOTIFY_MAX_CLASSES - 1;
+    }
+    return Control(device, IOCTL_NOTIFY_CLASSES, &req, sizeof(req), rsp, sizeof(*rsp)) == STATUS_SUCCESS;
+}
+
+static void RxWriter(void *context)
+{
+    ((SHIM_DEVICE *)context)->sharedBuffer.fetch_add(1, std::memory_order_release);
+}
+
+/*
+ * Function: RunTest
+ * ----------------------------
+ *  Runs one test for the configured time and reports its throughput.
+ *
+ *  Returns: true if every request completed exactly once without violations
+ */
+static bool RunTest(const char *test, const ECB_OPTIONS *options)
+{
+    uint32_t delayUs = options->delayUs;
+    bool shimDelay = delayUs && strcmp(test, "eval") == 0;
+    bool subscribe = strcmp(test, "subscribe") == 0;
+    CLOCK::time_point plantStart = CLOCK::now();
+    SHIM_DEVICE *device = subscribe ? ShimDeviceCreate(options->threads, PlantEvaluate, &plantStart) :
+                                      ShimDeviceCreate(options->threads, shimDelay ? DelayedEvaluate : NULL, &delayUs);
+    bool priority = strcmp(test, "priority") == 0;
+    bool doorbell = strcmp(test, "doorbell") == 0;
+    bool stream = strcmp(test, "stream") == 0;
+    bool battery = strcmp(test, "battery") == 0;
+    bool reactor = strcmp(test, "reactor") == 0;
+    bool rxmap = strcmp(test, "rxmap") == 0;
+    uint32_t clientCount = (strcmp(test, "notify") == 0 || priority || battery) ? ECB_NOTIFY_CLIENTS :
+                           (doorbell || stream || reactor || rxmap) ? 1 : options->threads;
+    LoopbackResponseReq_t canned;
+    ECB_CLIENT *clients = new ECB_CLIENT[clientCount];
+    std::vector<std::thread> threads;
+    std::thread canceller;
+    SHIM_TIMER timer;
+    SHIM_EVENT event;
+    SamplerRegisterRsp_t sampler;
+    NotifyClassesRsp_t classes;
+    std::vector<uint8_t> window;
+    uint64_t violations = ShimViolations();
+    bool ok = true;
+
+    for (uint32_t i = 0; i < clientCount; i++) {
+        memset(clients[i].input, 0, sizeof(clients[i].input));
+        memset(&clients[i].stats, 0, sizeof(clients[i].stats));
+        clients[i].inputLength = 32;
+        clients[i].outputLength = strcmp(test, "send2") == 0 ? sizeof(clients[i].output) :
+                                  strcmp(test, "static") == 0 ? sizeof(EC_STATIC) : 64;
+    }
+
+    gStop = false;
+    if (strcmp(test, "eval") == 0) {
+        for (uint32_t i = 0; i < clientCount; i++) {
+            threads.emplace_back(EvalClient, device, &clients[i]);
+        }
+    } else if (strcmp(test, "loopback") == 0) {
+        // Delay is applied by the driver instead of the shim evaluator
+        if (!SetupLoopback(device, options->delayUs, &canned)) {
+            printf("loopback setup failed\n");
+            ok = false;
+        }
+        for (uint32_t i = 0; i < clientCount; i++) {
+            threads.emplace_back(LoopbackClient, device, &clients[i], &canned);
+        }
+    } else if (strcmp(test, "notify") == 0) {
+        // Notifications back to back while a third thread keeps cancelling
+        ShimTimerStart(&timer, 0, Notify, device);
+        for (uint32_t i = 0; i < clientCount; i++) {
+            threads.emplace_back(NotifyClient, device, &clients[i]);
+        }
+        canceller = std::thread([clients, clientCount] {
+            uint32_t seed = 1;
+            while (!gStop.load(std::memory_order_relaxed)) {
+                seed = seed * 1103515245 + 12345;
+                ShimCancel(&clients[(seed >> 16) % clientCount].request);
+                std::this_thread::sleep_for(std::chrono::microseconds((seed >> 8) & 0x3f));
+            }
+        });
+    } else if (priority) {
+        // Notifications arrive faster than they are collected, with the requests
+        // cancelled at random as in notify
+        if (!ConfigureClasses(device, true, &classes)) {
+            printf("notification class setup failed\n");
+            ok = false;
+        }
+        ShimTimerStart(&timer, 2, PriorityNotify, device);
+        for (uint32_t i = 0; i < clientCount; i++) {
+            threads.emplace_back(PriorityClient, device, &clients[i]);
+        }
+        canceller = std::thread([clients, clientCount] {
+            uint32_t seed = 1;
+            while (!gStop.load(std::memory_order_relaxed)) {
+                seed = seed * 1103515245 + 12345;
+                ShimCancel(&clients[(seed >> 16) % clientCount].request);
+                std::this_thread::sleep_for(std::chrono::microseconds((seed >> 8) & 0x3f));
+            }
+        });
+    } else if (reactor) {
+#ifdef __linux__
+        // Bursts every millisecond taken by a single thread with no request
+        // blocking it, only poll()
+        gReactorFd = eventfd(0, EFD_NONBLOCK);
+        ShimTimerStart(&timer, 1000, ReactorNotify, device);
+        threads.emplace_back(ReactorClient, device, &clients[0]);
+#else
+        printf("reactor   needs eventfd, skipped on this host\n");
+#endif
+    } else if (battery) {
+        // The EC pushes every change, the clients only collect notifications
+        memset(&gBattery, 0, sizeof(gBattery));
+        ShimTimerStart(&timer, ECB_BATTERY_PERIOD_US, BatteryWriter, device);
+        for (uint32_t i = 0; i < clientCount; i++) {
+            threads.emplace_back(BatteryClient, device, &clients[i]);
+        }
+    } else if (doorbell) {
+        // A single producer, like the ASL methods serialized on the slot queues
+        window.assign(2 * ECRING_WINDOW_SIZE, 0);
+        threads.emplace_back(DoorbellClient, device, &clients[0], window.data());
+    } else if (stream) {
+        window.assign(2 * ECRING_WINDOW_SIZE, 0);
+        threads.emplace_back(StreamClient, device, &clients[0], window.data());
+    } else if (rxmap) {
+        if (device->windowFile < 0) {
+            printf("rxmap     needs memfd, skipped on this host\n");
+        } else {
+            threads.emplace_back(MapClient, device, &clients[0]);
+        }
+    } else if (strcmp(test, "static") == 0) {
+        for (uint32_t i = 0; i < clientCount; i++) {
+            threads.emplace_back(StaticClient, device, &clients[i]);
+        }
+    } else if (strcmp(test, "send2") == 0) {
+        for (uint32_t i = 0; i < clientCount; i++) {
+            threads.emplace_back(Send2Client, device, &clients[i], i + 1);
+        }
+    } else if (strcmp(test, "share") == 0) {
+        for (uint32_t i = 0; i < clientCount; i++) {
+            threads.emplace_back(ShareClient, device, &clients[i], i + 1);
+        }
+    } else if (strcmp(test, "history") == 0) {
+        // Each client fetches its own sensor, sampled at 10kHz
+        for (uint32_t i = 0; i < clientCount; i++) {
+            uint8_t sensor = (uint8_t)(i % ECSIM_HISTORY_SENSORS);
+            if (i < ECSIM_HISTORY_SENSORS && !ConfigureHistory(device, sensor, 100)) {
+                printf("history setup failed\n");
+                ok = false;
+            }
+            threads.emplace_back(HistoryClient, device, &clients[i], sensor);
+        }
+    } else if (subscribe) {
+        // Sampled every millisecond, the value only moves every ECB_PLANT_STEP_MS. One
+        // client waits on an event, the others pend requests that are cancelled at random
+        ShimEventInit(&event);
+        if (!RegisterSampler(device, 1, &sampler)) {
+            printf("sampler setup failed\n");
+            ok = false;
+        }
+        threads.emplace_back(EventClient, device, &clients[0], sampler.sampler, &event);
+        for (uint32_t i = 1; i < clientCount; i++) {
+            threads.emplace_back(SubscribeClient, device, &clients[i], sampler.sampler);
+        }
+        canceller = std::thread([clients, clientCount] {
+            uint32_t seed = 1;
+            while (!gStop.load(std::memory_order_relaxed) && clientCount > 1) {
+                seed = seed * 1103515245 + 12345;
+                ShimCancel(&clients[1 + (seed >> 16) % (clientCount - 1)].request);
+                std::this_thread::sleep_for(std::chrono::milliseconds(1 + (seed >> 8) % 50));
+            }
+        });
+    } else if (strcmp(test, "var") == 0) {
+        // The value changes every millisecond, far slower than it is polled
+        ShimTimerStart(&timer, 1000, VarWriter, device);
+        for (uint32_t i = 0; i < clientCount; i++) {
+            threads.emplace_back(VarClient, device, &clients[i]);
+        }
+    } else {
+        ShimTimerStart(&timer, 0, RxWriter, device);
+        for (uint32_t i = 0; i < clientCount; i++) {
+            threads.emplace_back(RxClient, device, &clients[i]);
+        }
+    }
+
+    CLOCK::time_point start = CLOCK::now();
+    std::this_thread::sleep_for(std::chrono::duration<double>(options->seconds));
+    gStop = true;
+    for (size_t i = 0; i < threads.size(); i++) {
+        threads[i].join();
+    }
+    double elapsed = std::chrono::duration<double>(CLOCK::now() - start).count();
+    if (canceller.joinable()) {
+        canceller.join();
+    }
+    if (strcmp(test, "notify") == 0 || priority || battery || strcmp(test, "rx") == 0 || strcmp(test, "var") == 0) {
+        ShimTimerStop(&timer);
+    }
+#ifdef __linux__
+    if (reactor) {
+        ShimTimerStop(&timer);
+        close(gReactorFd);
+    }
+#endif
+
+    Report(test, clients, clientCount, elapsed);
+    if (strcmp(test, "send2") == 0) {
+        ECSIM_STATS sim;
+
+        // What the same transfers would cost as direct requests
+        EcSimGetStats(device->sim, &sim);
+        printf("        %llu FFA_MSG_SEND2 calls, %llu busy, direct requests would need %llu\n",
+               (unsigned long long)sim.messages, (unsigned long long)sim.busy,
+               (unsigned long long)((sim.bytesIn + sim.bytesOut + ECSIM_DIRECT_DATA - 1) / ECSIM_DIRECT_DATA));
+    } else if (doorbell) {
+        ECSIM_STATS sim;
+
+        EcSimGetStats(device->sim, &sim);
+        printf("        %llu doorbells for %llu messages, %.3f SMCs per message, ASYC needs 1.000\n",
+               (unsigned long long)sim.doorbells, (unsigned long long)sim.asyncMessages,
+               (double)sim.doorbells / (sim.asyncMessages ? sim.asyncMessages : 1));
+        if (sim.asyncMessages != clients[0].stats.submitted) {
+            ok = false;
+        }
+    } else if (stream) {
+        ECSIM_STATS sim;
+
+        EcSimGetStats(device->sim, &sim);
+        printf("        %llu doorbells for %llu messages, %.1f messages per doorbell, slots allow %u\n",
+               (unsigned long long)sim.doorbells, (unsigned long long)sim.asyncMessages,
+               (double)sim.asyncMessages / (sim.doorbells ? sim.doorbells : 1), ECRING_SLOTS);
+        if (sim.asyncMessages != clients[0].stats.submitted) {
+            ok = false;
+        }
+    } else if (rxmap && device->windowFile >= 0) {
+        ECSIM_STATS sim;
+
+        EcSimGetStats(device->sim, &sim);
+        printf("        %llu responses, %llu bytes read in place from the read-only view, IOCTL_READ_RX_BUFFER needs %llu calls\n",
+               (unsigned long long)clients[0].stats.succeeded, (unsigned long long)clients[0].stats.bytes,
+               (unsigned long long)((clients[0].stats.bytes + sizeof(UINT64) - 1) / sizeof(UINT64)));
+        if (sim.asyncMessages != clients[0].stats.submitted || clients[0].stats.succeeded == 0) {
+            ok = false;
+        }
+    } else if (strcmp(test, "var") == 0) {
+        ECSIM_STATS sim;
+
+        EcSimGetStats(device->sim, &sim);
+        printf("        %llu of %llu reads not modified, %llu payload bytes saved\n",
+               (unsigned long long)sim.notModified, (unsigned long long)sim.varReads,
+               (unsigned long long)(sim.notModified * (sizeof(MsgVarRsp_t) + sizeof(UINT32))));
+    } else if (subscribe) {
+        if (!OrphanSubscriptions(device, sampler.sampler)) {
+            printf("        subscriptions of closed handles were not released\n");
+            ok = false;
+        }
+
+        // Unregistering reports the totals and must leave no subscriber behind
+        if (RegisterSampler(device, 0, &sampler)) {
+            printf("        %llu samples, %llu wakeups, %.1f samples per wakeup\n",
+                   (unsigned long long)sampler.samples, (unsigned long long)sampler.wakeups,
+                   (double)sampler.samples / (sampler.wakeups ? sampler.wakeups : 1));
+        } else {
+            ok = false;
+        }
+        if (sampler.methods != 0 || event.references.load() != 0) {
+            ok = false;
+        }
+    } else if (priority) {
+        // Everything above routine must be accounted for, delivered or still queued
+        ok = ConfigureClasses(device, false, &classes) && ok;
+        for (uint32_t c = 0; c < NOTIFY_MAX_CLASSES; c++) {
+            NotifyClassStats_t *stats = &classes.stats[c];
+            uint64_t seen = 0;
+
+            for (uint32_t i = 0; i < clientCount; i++) {
+                seen += clients[i].stats.priority[c];
+            }
+            if (stats->received == 0) {
+                continue;
+            }
+            printf("        class %u: %llu received %llu delivered %llu coalesced %llu dropped, latency %.1f us avg %llu us max\n",
+                   c, (unsigned long long)stats->received, (unsigned long long)stats->delivered,
+                   (unsigned long long)stats->coalesced, (unsigned long long)stats->dropped,
+                   stats->delivered ? (double)stats->latency_total / stats->delivered : 0.0,
+                   (unsigned long long)stats->latency_max);
+            if (seen != stats->delivered ||
+                (c != NOTIFY_CLASS_ROUTINE &&
+                 (stats->coalesced != 0 || stats->dropped != 0 || stats->received != stats->delivered + stats->queued))) {
+                ok = false;
+            }
+        }
+    } else if (reactor) {
+        // A thread blocked in IOCTL_GET_NOTIFICATION wakes once per notification
+        printf("        %llu notifications in %llu wakeups, %.1f per wakeup, bursts of %u\n",
+               (unsigned long long)clients[0].stats.succeeded, (unsigned long long)clients[0].stats.loopWakeups,
+               (double)clients[0].stats.succeeded / (clients[0].stats.loopWakeups ? clients[0].stats.loopWakeups : 1),
+               ECB_REACTOR_BURST);
+    } else if (battery) {
+        BatteryStatus_t slot;
+        ECSIM_STATS sim;
+        uint32_t input = 0;
+        uint32_t last = gBattery.sequence;
+
+        // The last push may still be queued, coalesced into one notification
+        if (Control(device, IOCTL_GET_BATTERY, &input, sizeof(input), &slot, sizeof(slot)) != STATUS_SUCCESS ||
+            !ConfigureClasses(device, false, &classes)) {
+            ok = false;
+        } else if (classes.stats[NOTIFY_CLASS_ROUTINE].queued != 0) {
+            SubmitAndWait(device, &clients[0], IOCTL_GET_NOTIFICATION);
+            BatteryCollect(&clients[0], &last);
+        }
+
+        // Whoever holds the last notification knows the status without asking
+        EcSimGetStats(device->sim, &sim);
+        ConfigureClasses(device, false, &classes);
+        printf("        %llu battery reads, %llu pushed, %llu delivered, %llu coalesced\n",
+               (unsigned long long)sim.batteryUpdates, (unsigned long long)sim.batteryPushes,
+               (unsigned long long)classes.stats[NOTIFY_CLASS_ROUTINE].delivered,
+               (unsigned long long)classes.stats[NOTIFY_CLASS_ROUTINE].coalesced);
+        printf("        polling _BST as often as the EC reads the battery takes %.1f times the requests\n",
+               (double)sim.batteryUpdates / (classes.stats[NOTIFY_CLASS_ROUTINE].delivered ?
+                                             classes.stats[NOTIFY_CLASS_ROUTINE].delivered : 1));
+        if (ok && (gBattery.sequence != slot.sequence || gBattery.state != slot.state || gBattery.rate != slot.rate ||
+                   gBattery.capacity != slot.capacity || gBattery.voltage != slot.voltage)) {
+            printf("        collected status %u is not the EC's %u\n", gBattery.sequence, slot.sequence);
+            ok = false;
+        }
+    } else if (strcmp(test, "static") == 0) {
+        EC_STATIC snapshot;
+        VersionRsp_t version = { 0 };
+        uint32_t input = 0;
+        NTSTATUS corrupt;
+        NTSTATUS missing;
+
+        // Clients keep the snapshot on disk next to the driver version
+        if (Control(device, IOCTL_GET_VERSION, &input, sizeof(input), &version, sizeof(version)) != STATUS_SUCCESS ||
+            version.version != EC_DRIVER_VERSION) {
+            printf("        driver version 0x%x\n", version.version);
+            ok = false;
+        }
+
+        // Each read stands for the TFWS request and _DSM function 0 evaluations a
+        // client would otherwise make. A flipped bit must be caught, and a page
+        // firmware never wrote must not be mistaken for a snapshot
+        printf("        each read replaces 1 FF-A request and %u _DSM evaluations\n",
+               (unsigned)(sizeof(mEcStaticDsm) / sizeof(mEcStaticDsm[0])));
+
+        // The snapshot reaches the caller through the system buffer the shim copies
+        // back, as the I/O manager does for METHOD_BUFFERED, and a failed read must
+        // leave the caller's copy alone
+        memset(&snapshot, 0, sizeof(snapshot));
+        if (Control(device, IOCTL_GET_STATIC, &input, sizeof(input), &snapshot, sizeof(snapshot)) != STATUS_SUCCESS ||
+            EcStaticCheck(&snapshot) != EC_STATIC_VALID) {
+            printf("        snapshot not returned through the system buffer\n");
+            ok = false;
+        }
+        device->staticPage[offsetof(EC_STATIC, Dsm)] ^= 0x10;
+        corrupt = Control(device, IOCTL_GET_STATIC, &input, sizeof(input), &snapshot, sizeof(snapshot));
+        memset(device->staticPage, 0, sizeof(EC_STATIC));
+        missing = Control(device, IOCTL_GET_STATIC, &input, sizeof(input), &snapshot, sizeof(snapshot));
+        if (corrupt != STATUS_DEVICE_DATA_ERROR || missing != STATUS_NOT_SUPPORTED) {
+            printf("        corrupt snapshot 0x%x, missing snapshot 0x%x\n", (unsigned)corrupt, (unsigned)missing);
+            ok = false;
+        }
+        if (EcStaticCheck(&snapshot) != EC_STATIC_VALID) {
+            printf("        failed reads overwrote the caller's snapshot\n");
+            ok = false;
+        }
+    } else if (strcmp(test, "share") == 0) {
+        ECSIM_STATS sim;
+
+        // Regions the clients left shared must all come back when their handles close
+        for (uint32_t i = 0; i < clientCount; i++) {
+            ShimFileCleanup(device, &clients[i]);
+        }
+        EcSimGetStats(device->sim, &sim);
+        printf("        %llu FFA_MEM_SHARE, %llu FFA_MEM_RECLAIM, %llu denied, %u still shared\n",
+               (unsigned long long)sim.shares, (unsigned long long)sim.reclaims,
+               (unsigned long long)sim.denied, sim.liveShares);
+        if (sim.liveShares != 0 || sim.mappedShares != 0 || sim.denied != 0 || sim.shares != sim.reclaims) {
+            ok = false;
+        }
+    }
+
+    for (uint32_t i = 0; i < clientCount; i++) {
+        if (clients[i].stats.failed || clients[i].stats.outOfOrder) {
+            ok = false;
+        }
+    }
+    ShimDeviceDestroy(device);
+    if (ShimViolations() != violations) {
+        printf("        %llu framework contract violations\n", (unsigned long long)(ShimViolations() - violations));
+        ok = false;
+    }
+
+    delete[] clients;
+    return ok;
+}
+
+// RampTemp and MaxTemp of the thermal policy, next to OnTemp above
+static const uint8_t gVarRampTemp[16] = {
+    0x8c, 0x68, 0x62, 0x3a, 0x5b, 0xd9, 0x2d, 0x4d, 0xba, 0xcc, 0x90, 0xd7, 0xa5, 0x81, 0x6b, 0xcd
+};
+static const uint8_t gVarMaxTemp[16] = {
+    0xb1, 0x58, 0xb7, 0xdc, 0xfd, 0xf0, 0xc7, 0x4e, 0xb2, 0xc0, 0xef, 0x1e, 0x2a, 0x54, 0x7b, 0x76
+};
+// FAN_CURRENT_RPM, FAN_MIN_RPM and FAN_MAX_RPM
+static const uint8_t gVarFanRpm[16] = {
+    0x92, 0x54, 0xf9, 0xad, 0x76, 0x07, 0xfc, 0x4f, 0x84, 0xf3, 0xb6, 0xc8, 0xb5, 0x26, 0x96, 0x83
+};
+static const uint8_t gVarFanMinRpm[16] = {
+    0x77, 0x1c, 0x26, 0xdb, 0x4b, 0x93, 0xe2, 0x45, 0x97, 0x42, 0x25, 0x6c, 0x62, 0xba, 0xdb, 0x7a
+};
+static const uint8_t gVarFanMaxRpm[16] = {
+    0xdf, 0x39, 0xf8, 0x5c, 0xe7, 0x8b, 0xb9, 0x42, 0x9a, 0xc5, 0x34, 0x03, 0xca, 0x2c, 0x8a, 0x6a
+};
+
+// Heat load of each ECB_THERMAL_PHASE_S, repeated
+static const double gThermalLoad[] = { 10.0, 35.0, 20.0, 55.0 };
+
+typedef struct {
+    uint64_t polls;
+    uint64_t writes;        // Fan speed changes sent
+    uint64_t events;        // THRS notifications that woke the policy
+    double peakK;           // Highest skin temperature
+    double hotSeconds;      // Time spent above RampTemp
+    double duty;            // Mean fan speed as a fraction of FAN_MAX_RPM
+    double energy;          // Mean fan power as a fraction of full speed, cube law
+    double rate;            // Model hours per real second
+} ECB_THERMAL;
+
+/*
+ * Function: ThermalRequest
+ * ----------------------------
+ *  Sends one direct request to the thermal service with the byte layout
+ *  thermal.asl uses, returns the value from x5 or 0 if the request failed.
+ */
+static uint32_t ThermalRequest(ECSIM *sim, const uint8_t *request, size_t length, bool *ok)
+{
+    uint64_t regs[ECSIM_DIRECT_REGS] = { 0 };
+
+    memcpy(regs, request, length);
+    if (EcSimDirectReq2(sim, EcMsgThermalService, regs) != ECSIM_FFA_SUCCESS ||
+        regs[0] != EC_MSG_STATUS_SUCCESS) {
+        *ok = false;
+        return 0;
+    }
+    return (uint32_t)regs[1];
+}
+
+static uint32_t ThermalGetVar(ECSIM *sim, const uint8_t variable[16], bool *ok)
+{
+    uint8_t request[20] = { 0x5, 1, sizeof(uint32_t), 0 };
+
+    memcpy(&request[4], variable, 16);
+    return ThermalRequest(sim, request, sizeof(request), ok);
+}
+
+/*
+ * Function: ThermalRun
+ * ----------------------------
+ *  Runs the fan policy of the Rust thermal service against the plant model
+ *  for ECB_THERMAL_HOURS of model time under a stepped heat load. The policy
+ *  reads _TMP every pollMs and sets the fan speed: off below OnTemp, the
+ *  minimum up to RampTemp, linear up to MaxTemp and the maximum above. With
+ *  thresholds it also arms THRS around each reading and polls as soon as the
+ *  EC reports a crossing. A pollMs of 0 writes the same curve as a fan profile
+ *  once and leaves the fan to the EC.
+ *
+ *  Returns: true if every request succeeded
+ */
+static bool ThermalRun(uint32_t pollMs, bool thresholds, ECB_THERMAL *result)
+{
+    ECSIM *sim = EcSimCreate();
+    ECSIM_PLANT_CONFIG config;
+    ECSIM_PLANT_STATE state;
+    uint64_t endUs = (uint64_t)ECB_THERMAL_HOURS * 3600 * 1000000;
+    uint64_t nextPoll = 0;
+    uint64_t seenEvents = 0;
+    uint32_t rpm = 0;
+    double dutySum = 0.0, energySum = 0.0;
+    bool ok = true;
+
+    if (sim == NULL) {
+        return false;
+    }
+    memset(result, 0, sizeof(*result));
+    EcSimPlantDefaults(&config);
+    config.acceleration = 0;
+    EcSimPlantStart(sim, &config);
+
+    uint32_t onTemp = ThermalGetVar(sim, gVarOnTemp, &ok);
+    uint32_t rampTemp = ThermalGetVar(sim, gVarRampTemp, &ok);
+    uint32_t maxTemp = ThermalGetVar(sim, gVarMaxTemp, &ok);
+    uint32_t minRpm = ThermalGetVar(sim, gVarFanMinRpm, &ok);
+    uint32_t maxRpm = ThermalGetVar(sim, gVarFanMaxRpm, &ok);
+    if (!ok || rampTemp <= onTemp || maxTemp <= rampTemp) {
+        EcSimDestroy(sim);
+        return false;
+    }
+    if (pollMs == 0) {
+        // INST in byte 1, the five values from byte 2
+        uint32_t profile[EC_FAN_PROFILE_VARS] = { onTemp, rampTemp, maxTemp, minRpm, maxRpm };
+        uint8_t setProfile[2 + sizeof(profile)] = { 0x7, 1 };
+
+        memcpy(&setProfile[2], profile, sizeof(profile));
+        ThermalRequest(sim, setProfile, sizeof(setProfile), &ok);
+        result->writes++;
+        nextPoll = endUs;
+    }
+
+    CLOCK::time_point start = CLOCK::now();
+    for (uint64_t now = 0; now < endUs && ok; now += ECB_THERMAL_TICK_US) {
+        EcSimPlantSetHeat(sim, gThermalLoad[(now / 1000000 / ECB_THERMAL_PHASE_S) % (sizeof(gThermalLoad) / sizeof(gThermalLoad[0]))]);
+        EcSimPlantAdvance(sim, ECB_THERMAL_TICK_US);
+        EcSimPlantGetState(sim, &state);
+
+        bool woken = thresholds && state.thresholdEvents != seenEvents;
+        if (now >= nextPoll || woken) {
+            uint8_t getTmp[2] = { 0x1, ECSIM_PLANT_ZONE };
+            uint32_t reading = ThermalRequest(sim, getTmp, sizeof(getTmp), &ok);
+            uint32_t target;
+
+            result->polls++;
+            if (woken) {
+                result->events++;
+                seenEvents = state.thresholdEvents;
+            }
+            if (reading < onTemp) {
+                target = 0;
+            } else if (reading < rampTemp) {
+                target = minRpm;
+            } else if (reading < maxTemp) {
+                target = minRpm + (uint32_t)((uint64_t)(maxRpm - minRpm) * (reading - rampTemp) / (maxTemp - rampTemp));
+            } else {
+                target = maxRpm;
+            }
+            if (target != rpm) {
+                uint8_t setVar[24] = { 0x6, 1, sizeof(uint32_t), 0 };
+
+                memcpy(&setVar[4], gVarFanRpm, 16);
+                memcpy(&setVar[20], &target, sizeof(target));
+                ThermalRequest(sim, setVar, sizeof(setVar), &ok);
+                rpm = target;
+                result->writes++;
+            }
+            if (thresholds) {
+                // Timeout, low and high at bytes 2, 6 and 10
+                uint8_t thrs[14] = { 0x2, ECSIM_PLANT_ZONE };
+                uint32_t timeout = 0, low = reading - ECB_THERMAL_BAND, high = reading + ECB_THERMAL_BAND;
+
+                memcpy(&thrs[2], &timeout, sizeof(timeout));
+                memcpy(&thrs[6], &low, sizeof(low));
+                memcpy(&thrs[10], &high, sizeof(high));
+                ThermalRequest(sim, thrs, sizeof(thrs), &ok);
+            }
+            nextPoll = now + (uint64_t)pollMs * 1000;
+        }
+
+        double duty = state.fanRpm / maxRpm;
+        result->peakK = state.skinK > result->peakK ? state.skinK : result->peakK;
+        if (state.skinK * 10.0 > rampTemp) {
+            result->hotSeconds += ECB_THERMAL_TICK_US / 1e6;
+        }
+        dutySum += duty;
+        energySum += duty * duty * duty;
+    }
+    double elapsed = std::chrono::duration<double>(CLOCK::now() - start).count();
+
+    result->duty = dutySum / (endUs / ECB_THERMAL_TICK_US);
+    result->energy = energySum / (endUs / ECB_THERMAL_TICK_US);
+    result->rate = ECB_THERMAL_HOURS / (elapsed > 0 ? elapsed : 1e-9);
+    EcSimDestroy(sim);
+    return ok;
+}
+
+/*
+ * Function: ThermalTest
+ * ----------------------------
+ *  Closes the loop between the fan policy and the plant model at several poll
+ *  intervals, with and without THRS, each over hours of model time stepped as
+ *  fast as the host allows, and once with the curve written as a fan profile
+ *  so the EC runs it. Fails if the fastest poll lets the skin reach MaxTemp,
+ *  if the load never needs the fan, if THRS does worse than the same poll
+ *  interval without it or if the fan profile does worse than the fastest poll.
+ */
+static bool ThermalTest(void)
+{
+    static const struct {
+        uint32_t pollMs;
+        bool thresholds;
+    } runs[] = { { 100, false }, { 1000, false }, { 5000, false }, { 30000, false }, { 30000, true }, { 0, false } };
+    ECB_THERMAL results[sizeof(runs) / sizeof(runs[0])];
+    bool ok = true;
+
+    printf("thermal   %u hours of model time per run, load %.0f/%.0f/%.0f/%.0f W every %u s\n",
+           ECB_THERMAL_HOURS, gThermalLoad[0], gThermalLoad[1], gThermalLoad[2], gThermalLoad[3], ECB_THERMAL_PHASE_S);
+    printf("        %-10s %8s %7s %7s %8s %8s %6s %7s %10s\n",
+           "poll", "polls", "writes", "events", "peak C", "hot s", "duty", "energy", "model h/s");
+    for (size_t i = 0; i < sizeof(runs) / sizeof(runs[0]); i++) {
+        char name[32];
+
+        ok = ThermalRun(runs[i].pollMs, runs[i].thresholds, &results[i]) && ok;
+        if (runs[i].pollMs == 0) {
+            snprintf(name, sizeof(name), "EC curve");
+        } else {
+            snprintf(name, sizeof(name), "%gs%s", runs[i].pollMs / 1000.0, runs[i].thresholds ? "+THRS" : "");
+        }
+        printf("        %-10s %8llu %7llu %7llu %8.2f %8.0f %5.1f%% %6.1f%% %10.1f\n",
+               name, (unsigned long long)results[i].polls, (unsigned long long)results[i].writes,
+               (unsigned long long)results[i].events, results[i].peakK - 273.15, results[i].hotSeconds,
+               results[i].duty * 100.0, results[i].energy * 100.0, results[i].rate);
+    }
+    if (!ok) {
+        return false;
+    }
+
+    // MaxTemp and OnTemp of the simulator's defaults
+    if (results[0].peakK * 10.0 >= 3630 || results[0].peakK * 10.0 <= 3130) {
+        printf("        peak %.1f K with a 0.1s poll is outside OnTemp..MaxTemp\n", results[0].peakK);
+        ok = false;
+    }
+    if (results[4].peakK > results[3].peakK) {
+        printf("        THRS peaked at %.2f K, above %.2f K without it\n", results[4].peakK, results[3].peakK);
+        ok = false;
+    }
+    // The EC runs the curve at its own step, it should hold as well as the fastest poll
+    if (results[5].polls != 0 || results[5].writes != 1 || results[5].peakK > results[0].peakK + 0.5) {
+        printf("        fan profile peaked at %.2f K after %llu polls and %llu writes\n", results[5].peakK,
+               (unsigned long long)results[5].polls, (unsigned long long)results[5].writes);
+        ok = false;
+    }
+    return ok;
+}
+
+/*
+ * Function: CaptureTest
+ * ----------------------------
+ *  Writes a capture with ectsdb, checking that a sample older than the last
+ *  flushed block is refused, then loads it again with the INDX chunk
+ *  shortened below its header, with empty entry and series counts so nothing
+ *  past the header is needed. A -watch capture cut short or damaged must be
+ *  rejected instead of loading, or reading past the file.
+ */
+static bool CaptureTest(void)
+{
+    char path[] = "/tmp/ecbench-XXXXXX";
+    ECTS_WRITER *writer = NULL;
+    ECTS_READER *reader = NULL;
+    uint32_t series;
+    uint8_t *image = NULL;
+    long size = 0;
+    bool ok = true;
+    int fd;
+    FILE *file;
+
+    printf("capture   %u samples, INDX chunk of 0 to %u bytes\n", ECB_CAPTURE_SAMPLES,
+           (unsigned)sizeof(ECTS_INDEX_HEADER) - 1);
+    fd = mkstemp(path);
+    if (fd < 0) {
+        printf("        no temporary file\n");
+        return false;
+    }
+    close(fd);
+
+    if (EctsWriterOpen(path, 0, &writer) != ECTS_STATUS_SUCCESS ||
+        EctsDefineSeries(writer, ECB_METHOD, ECTS_SERIES_SAMPLE, &series) != ECTS_STATUS_SUCCESS) {
+        printf("        capture not created\n");
+        ok = false;
+    }
+    for (uint32_t i = 0; ok && i < ECB_CAPTURE_SAMPLES; i++) {
+        ok = EctsAppend(writer, series, (int64_t)i * 10000, i % 100) == ECTS_STATUS_SUCCESS;
+    }
+    // A flush starts a new block, an earlier sample must still be refused
+    if (ok && (EctsFlush(writer) != ECTS_STATUS_SUCCESS ||
+               EctsAppend(writer, series, 0, 0) != ECTS_STATUS_INVALID_PARAMETER)) {
+        printf("        sample older than the last block appended\n");
+        ok = false;
+    }
+    if (writer != NULL && EctsWriterClose(writer) != ECTS_STATUS_SUCCESS) {
+        ok = false;
+    }
+    if (ok && EctsReaderOpen(path, &reader) == ECTS_STATUS_SUCCESS) {
+        ok = EctsSeriesCount(reader) == 1;
+        EctsReaderClose(reader);
+    } else {
+        ok = false;
+    }
+
+    file = fopen(path, "rb");
+    if (ok && file != NULL && fseek(file, 0, SEEK_END) == 0 && (size = ftell(file)) > 0) {
+        image = new uint8_t[size];
+        rewind(file);
+        ok = fread(image, 1, size, file) == (size_t)size;
+    } else {
+        ok = false;
+    }
+    if (file != NULL) {
+        fclose(file);
+    }
+
+    for (uint32_t length = 0; ok && length < sizeof(ECTS_INDEX_HEADER); length += 4) {
+        ECTS_TAIL tail;
+        ECTS_CHUNK_HEADER chunk;
+        ECTS_INDEX_HEADER index;
+        int status;
+
+        memset(&index, 0, sizeof(index));
+        memcpy(&tail, image + size - sizeof(tail), sizeof(tail));
+        memcpy(&chunk, image + tail.index_offset, sizeof(chunk));
+        chunk.length = length;
+        file = fopen(path, "wb");
+        ok = file != NULL && fwrite(image, 1, tail.index_offset, file) == tail.index_offset &&
+             fwrite(&chunk, sizeof(chunk), 1, file) == 1 && fwrite(&index, sizeof(index), 1, file) == 1 &&
+             fwrite(image + tail.index_offset + sizeof(chunk) + sizeof(index), 1,
+                    size - tail.index_offset - sizeof(chunk) - sizeof(index), file) ==
+                 size - tail.index_offset - sizeof(chunk) - sizeof(index);
+        if (file != NULL) {
+            fclose(file);
+        }
+
+        status = EctsReaderOpen(path, &reader);
+        if (status == ECTS_STATUS_SUCCESS) {
+            EctsReaderClose(reader);
+        }
+        if (status != ECTS_STATUS_BAD_FORMAT) {
+            printf("        INDX chunk of %u bytes loaded with status %d\n", length, status);
+            ok = false;
+        }
+    }
+
+    delete[] image;
+    unlink(path);
+    return ok;
+}
+
+static void Usage(void)
+{
+    printf("Usage: ecbench [eval|loopback|notify|priority|reactor|rx|send2|share|var|history|subscribe|doorbell|stream|rxmap|static|battery|thermal|capture|all] [-threads N] [-seconds S] [-delay US]\n");
+    printf("  eval      IOCTL_ACPI_EVAL_METHOD_EX through the work item path\n");
+    printf("  loopback  The same, answered from the driver's loopback table\n");
+    printf("  notify    IOCTL_GET_NOTIFICATION pend/complete/cancel under constant notifications\n");
+    printf("  priority  Notification classes with a collector slower than the notifications\n");
+    printf("  reactor   Notification bursts drained from one poll() loop on an eventfd\n");
+    printf("  rx        IOCTL_READ_RX_BUFFER completed inline\n");
+    printf("  send2     IOCTL_FFA_MSG_SEND2 echo and bulk reads through the RX/TX buffers\n");
+    printf("  share     IOCTL_FFA_MEM_SHARE and IOCTL_FFA_MEM_RECLAIM of regions the EC fills\n");
+    printf("  var       Conditional GET_VAR polls of a variable the EC changes every millisecond\n");
+    printf("  history   Bulk fetches of 10kHz sensor history every 5ms\n");
+    printf("  subscribe Deadband subscriptions to a method sampled every millisecond\n");
+    printf("  doorbell  Batches of ASYNC slot queue entries announced with one doorbell each\n");
+    printf("  stream    Batches of small commands packed into the shared memory streams\n");
+    printf("  rxmap     Responses read in place from the RX window mapped read-only\n");
+    printf("  static    IOCTL_GET_STATIC reads of the snapshot firmware writes at boot\n");
+    printf("  battery   Battery status pushed with notifications as the EC sees it change\n");
+    printf("  thermal   Fan policy against the thermal plant model, hours of model time per run\n");
+    printf("  capture   Loading ectest captures whose index footer is damaged\n");
+}
+
+int main(int argc, char **argv)
+{
+    ECB_OPTIONS options;
+    bool ok = true;
+
+    options.test = "all";
+    options.threads = 4;
+    options.seconds = 2.0;
+    options.delayUs = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc) {
+            options.threads = (uint32_t)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-seconds") == 0 && i + 1 < argc) {
+            options.seconds = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-delay") == 0 && i + 1 < argc) {
+            options.delayUs = (uint32_t)atoi(argv[++i]);
+        } else if (argv[i][0] != '-') {
+            options.test = argv[i];
+        } else {
+            Usage();
+            return 1;
+        }
+    }
+    if (options.threads == 0 || options.threads > ECB_MAX_THREADS || options.seconds <= 0) {
+        Usage();
+        return 1;
+    }
+
+    if (strcmp(options.test, "all") == 0) {
+        ok = RunTest("eval", &options) && ok;
+        ok = RunTest("loopback", &options) && ok;
+        ok = RunTest("notify", &options) && ok;
+        ok = RunTest("priority", &options) && ok;
+        ok = RunTest("reactor", &options) && ok;
+        ok = RunTest("rx", &options) && ok;
+        ok = RunTest("send2", &options) && ok;
+        ok = RunTest("share", &options) && ok;
+        ok = RunTest("var", &options) && ok;
+        ok = RunTest("history", &options) && ok;
+        ok = RunTest("subscribe", &options) && ok;
+        ok = RunTest("doorbell", &options) && ok;
+        ok = RunTest("stream", &options) && ok;
+        ok = RunTest("rxmap", &options) && ok;
+        ok = RunTest("static", &options) && ok;
+        ok = RunTest("battery", &options) && ok;
+        ok = ThermalTest() && ok;
+        ok = CaptureTest() && ok;
+    } else if (strcmp(options.test, "thermal") == 0) {
+        ok = ThermalTest();
+    } else if (strcmp(options.test, "capture") == 0) {
+        ok = CaptureTest();
+    } else if (strcmp(options.test, "eval") == 0 || strcmp(options.test, "loopback") == 0 ||
+               strcmp(options.test, "notify") == 0 || strcmp(options.test, "priority") == 0 ||
+               strcmp(options.test, "reactor") == 0 || strcmp(options.test, "rx") == 0 ||
+               strcmp(options.test, "send2") == 0 || strcmp(options.test, "share") == 0 ||
+               strcmp(options.test, "var") == 0 || strcmp(options.test, "history") == 0 ||
+               strcmp(options.test, "subscribe") == 0 || strcmp(options.test, "doorbell") == 0 ||
+               strcmp(options.test, "stream") == 0 || strcmp(options.test, "rxmap") == 0 ||
+               strcmp(options.test, "static") == 0 ||
+               strcmp(options.test, "battery") == 0) {
+        ok = RunTest(options.test, &options);
+    } else {
+        Usage();
+        return 1;
+    }
+
+    printf("%s\n", ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,825 @@
+/*
+MIT License
+
+Copyright (c) 2025 Open Device Partnership
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// User-mode implementation of the EcFw* framework services, see wdfshim.h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+#include "wdfshim.h"
+
+extern "C" {
+    #include "../../kmdf/ecmsg.h"
+    #include "../../uefi/Platforms/QemuSbsaPkg/SbsaQemuPlatformDxe/FfaMemDescriptor.h"
+    #include "../../uefi/Platforms/QemuSbsaPkg/SbsaQemuPlatformDxe/EcStaticSnapshot.h"
+}
+
+#define SHIM_STATIC_PAGE_SIZE   0x1000
+#define SHIM_BATTERY_PAGE_SIZE  0x1000
+#define SHIM_WINDOW_SIZE        (EC_MAP_TX_LENGTH + EC_MAP_RX_LENGTH)
+
+// Request state bits
+#define SHIM_CANCELABLE         0x1 // Marked cancelable by the driver
+#define SHIM_CANCEL_REQUESTED   0x2 // Cancel seen, not yet delivered
+#define SHIM_CANCEL_RUNNING     0x4 // Cancel routine owns the request
+#define SHIM_COMPLETED          0x8
+
+// Transfer method in the low two bits of an IOCTL code
+#define SHIM_METHOD_MASK        0x3
+#define SHIM_METHOD_BUFFERED    0x0
+#define SHIM_METHOD_NEITHER     0x3
+
+#define SHIM_NT_ERROR(Status)   ((uint32_t)(Status) >> 30 == 3)
+
+// Canned ACPI_EVAL_OUTPUT_BUFFER_V1 holding one 64-bit integer
+#define SHIM_ACPI_OUTPUT_SIGNATURE  0x426f6541  // 'BoeA'
+#pragma pack(push, 1)
+typedef struct {
+    uint32_t signature;
+    uint32_t length;
+    uint32_t count;
+    uint16_t type;
+    uint16_t dataLength;
+    uint64_t value;
+} SHIM_ACPI_INTEGER_OUTPUT;
+#pragma pack(pop)
+
+static std::atomic<uint64_t> gViolations(0);
+static std::atomic<uint64_t> gEvaluations(0);
+
+static void Violation(const char *what, const SHIM_REQUEST *request)
+{
+    if (gViolations.fetch_add(1) < 8) {
+        fprintf(stderr, "wdfshim: %s (request %p)\n", what, (const void *)request);
+    }
+}
+
+static SHIM_DEVICE *DeviceFromCore(PEC_CORE core)
+{
+    return (SHIM_DEVICE *)core->Device;
+}
+
+/*
+ * Function: DefaultEvaluate
+ * ----------------------------
+ *  Evaluator used when the device is created without one. Returns the number
+ *  of evaluations so far as a single integer argument.
+ */
+static NTSTATUS DefaultEvaluate(
+    void *context,
+    const void *input,
+    size_t inputLength,
+    void *output,
+    size_t outputLength,
+    ULONG *bytesReturned
+)
+{
+    SHIM_ACPI_INTEGER_OUTPUT rsp;
+
+    (void)context;
+    (void)input;
+    (void)inputLength;
+
+    rsp.signature = SHIM_ACPI_OUTPUT_SIGNATURE;
+    rsp.length = sizeof(rsp);
+    rsp.count = 1;
+    rsp.type = 0;   // ACPI_METHOD_ARGUMENT_INTEGER
+    rsp.dataLength = sizeof(rsp.value);
+    rsp.value = gEvaluations.fetch_add(1, std::memory_order_relaxed);
+
+    if (outputLength < sizeof(rsp)) {
+        *bytesReturned = 0;
+        return STATUS_BUFFER_OVERFLOW;
+    }
+    memcpy(output, &rsp, sizeof(rsp));
+    *bytesReturned = sizeof(rsp);
+    return STATUS_SUCCESS;
+}
+
+/*
+ * Function: WorkerThread
+ * ----------------------------
+ *  Runs queued work items until the device is destroyed.
+ */
+static void WorkerThread(SHIM_DEVICE *device)
+{
+    for (;;) {
+        std::pair<SHIM_REQUEST *, ULONG> item;
+        {
+            std::unique_lock<std::mutex> lock(device->workLock);
+            device->workReady.wait(lock, [device] { return device->stopping || !device->work.empty(); });
+            if (device->work.empty()) {
+                return;
+            }
+            item = device->work.front();
+            device->work.pop_front();
+        }
+        EcCoreWork(&device->core, item.first, item.second);
+    }
+}
+
+/*
+ * Function: SamplerThread
+ * ----------------------------
+ *  Runs EcCoreSample whenever the sampler timer expires, until it is stopped.
+ */
+static void SamplerThread(SHIM_DEVICE *device)
+{
+    std::unique_lock<std::mutex> lock(device->samplerLock);
+
+    for (;;) {
+        if (device->samplerStopping) {
+            return;
+        }
+        if (!device->samplerArmed) {
+            device->samplerWake.wait(lock);
+            continue;
+        }
+        if (std::chrono::steady_clock::now() < device->samplerDue) {
+            std::chrono::steady_clock::time_point due = device->samplerDue;
+            device->samplerWake.wait_until(lock, due);
+            continue;
+        }
+        device->samplerArmed = false;
+        lock.unlock();
+        EcCoreSample(&device->core);
+        lock.lock();
+    }
+}
+
+/*
+ * Function: CreateWindow
+ * ----------------------------
+ *  Allocates the shared memory window. On Linux it lives in a memfd so
+ *  IOCTL_MAP_RX can map its pages again, the RX side without write access,
+ *  as the driver maps the physical pages into a client.
+ */
+static void CreateWindow(SHIM_DEVICE *device)
+{
+    device->windowFile = -1;
+#ifdef __linux__
+    device->windowFile = memfd_create("ecshim-window", 0);
+    if (device->windowFile >= 0 && ftruncate(device->windowFile, SHIM_WINDOW_SIZE) == 0) {
+        void *window = mmap(NULL, SHIM_WINDOW_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, device->windowFile, 0);
+
+        if (window != MAP_FAILED) {
+            device->window = (uint8_t *)window;
+            return;
+        }
+    }
+    if (device->windowFile >= 0) {
+        close(device->windowFile);
+        device->windowFile = -1;
+    }
+#endif
+    device->window = new uint8_t[SHIM_WINDOW_SIZE]();
+}
+
+static void DestroyWindow(SHIM_DEVICE *device)
+{
+#ifdef __linux__
+    for (auto it = device->views.begin(); it != device->views.end(); ++it) {
+        munmap(it->second.first, EC_MAP_TX_LENGTH);
+        munmap(it->second.second, EC_MAP_RX_LENGTH);
+    }
+    if (device->windowFile >= 0) {
+        munmap(device->window, SHIM_WINDOW_SIZE);
+        close(device->windowFile);
+        return;
+    }
+#endif
+    delete[] device->window;
+}
+
+SHIM_DEVICE *ShimDeviceCreate(uint32_t workerThreads, SHIM_EVALUATE evaluate, void *context)
+{
+    SHIM_DEVICE *device = new SHIM_DEVICE();
+
+    EcCoreInitialize(&device->core, device, &device->notificationLock);
+    device->core.Loopback.Lock = &device->loopbackLock;
+    device->core.MessageLock = &device->messageLock;
+    device->stopping = false;
+    device->evaluate = evaluate ? evaluate : DefaultEvaluate;
+    device->evaluateContext = context;
+    device->sharedBuffer = 0;
+    device->sim = EcSimCreate();
+    device->messageTx = new uint8_t[EC_MSG_BUFFER_SIZE]();
+    device->messageRx = new uint8_t[EC_MSG_BUFFER_SIZE]();
+    device->staticPage = new uint8_t[SHIM_STATIC_PAGE_SIZE]();
+    EcSimPublishStatic(device->sim, device->staticPage);
+    CreateWindow(device);
+    device->batteryPage = device->window + (EC_BATTERY_STATUS_BASE - SBSAQEMU_SHARED_MEM_BASE);
+    EcSimAttachBattery(device->sim, device->batteryPage);
+    device->core.Sampling.Lock = &device->samplingLock;
+    device->samplerArmed = false;
+    device->samplerStopping = false;
+    device->sampler = std::thread(SamplerThread, device);
+
+    for (uint32_t i = 0; i < (workerThreads ? workerThreads : 1); i++) {
+        device->workers.emplace_back(WorkerThread, device);
+    }
+    return device;
+}
+
+void ShimDeviceDestroy(SHIM_DEVICE *device)
+{
+    {
+        std::lock_guard<std::mutex> lock(device->workLock);
+        device->stopping = true;
+    }
+    device->workReady.notify_all();
+    for (size_t i = 0; i < device->workers.size(); i++) {
+        device->workers[i].join();
+    }
+    if (device->core.PendingRequest != NULL) {
+        Violation("device destroyed with a pending request", (SHIM_REQUEST *)device->core.PendingRequest);
+    }
+    EcCoreShutdown(&device->core);
+    EcSimDestroy(device->sim);
+    delete[] device->messageTx;
+    delete[] device->messageRx;
+    delete[] device->staticPage;
+    DestroyWindow(device);
+    delete device;
+}
+
+void ShimRequestInit(
+    SHIM_REQUEST *request,
+    ULONG ioControlCode,
+    void *input,
+    size_t inputLength,
+    void *output,
+    size_t outputLength,
+    SHIM_COMPLETION completion,
+    void *context
+)
+{
+    request->ioControlCode = ioControlCode;
+    request->inputBuffer = input;
+    request->inputLength = inputLength;
+    request->outputBuffer = output;
+    request->outputLength = outputLength;
+    request->systemBuffer = NULL;
+    request->status = STATUS_PENDING;
+    request->information = 0;
+    request->core = NULL;
+    request->file = NULL;
+    request->completion = completion;
+    request->completionContext = context;
+    request->state.store(0, std::memory_order_release);
+}
+
+void ShimSubmit(SHIM_DEVICE *device, SHIM_REQUEST *request)
+{
+    size_t length = request->inputLength;
+
+    if ((request->ioControlCode & SHIM_METHOD_MASK) == SHIM_METHOD_BUFFERED && request->outputLength > length) {
+        length = request->outputLength;
+    }
+    if (length != 0 && (request->ioControlCode & SHIM_METHOD_MASK) != SHIM_METHOD_NEITHER) {
+        // Stale bytes past the input, like pool the I/O manager does not clear
+        request->systemBuffer = new uint8_t[length];
+        memset(request->systemBuffer, 0xCD, length);
+        if (request->inputBuffer != NULL) {
+            memcpy(request->systemBuffer, request->inputBuffer, request->inputLength);
+        }
+    }
+    EcCoreDeviceControl(&device->core,
+                        request,
+                        request->outputLength,
+                        request->inputLength,
+                        request->ioControlCode);
+}
+
+void ShimCancel(SHIM_REQUEST *request)
+{
+    uint32_t state = request->state.load(std::memory_order_acquire);
+
+    for (;;) {
+        if (state & (SHIM_COMPLETED | SHIM_CANCEL_RUNNING | SHIM_CANCEL_REQUESTED)) {
+            return;
+        }
+        if (state & SHIM_CANCELABLE) {
+            // Take ownership away from the driver and run its cancel routine
+            uint32_t next = (state & ~SHIM_CANCELABLE) | SHIM_CANCEL_REQUESTED | SHIM_CANCEL_RUNNING;
+            if (request->state.compare_exchange_weak(state, next, std::memory_order_acq_rel)) {
+                EcCoreCancelNotification(request->core, request);
+                return;
+            }
+        } else if (request->state.compare_exchange_weak(state, state | SHIM_CANCEL_REQUESTED, std::memory_order_acq_rel)) {
+            // Delivered when the driver marks it cancelable
+            return;
+        }
+    }
+}
+
+void ShimEventInit(SHIM_EVENT *event)
+{
+    event->set = false;
+    event->references = 0;
+}
+
+bool ShimEventWait(SHIM_EVENT *event, uint32_t timeoutUs)
+{
+    std::unique_lock<std::mutex> lock(event->lock);
+
+    if (!event->signalled.wait_for(lock, std::chrono::microseconds(timeoutUs), [event] { return event->set; })) {
+        return false;
+    }
+    event->set = false;
+    return true;
+}
+
+bool ShimRequestCompleted(const SHIM_REQUEST *request)
+{
+    return (request->state.load(std::memory_order_acquire) & SHIM_COMPLETED) != 0;
+}
+
+void ShimFileCleanup(SHIM_DEVICE *device, void *file)
+{
+    EcCoreFileCleanup(&device->core, file);
+
+    std::lock_guard<std::mutex> lock(device->viewLock);
+    auto found = device->views.find(file);
+
+    if (found != device->views.end()) {
+#ifdef __linux__
+        munmap(found->second.first, EC_MAP_TX_LENGTH);
+        munmap(found->second.second, EC_MAP_RX_LENGTH);
+#endif
+        device->views.erase(found);
+    }
+}
+
+uint64_t ShimViolations()
+{
+    return gViolations.load();
+}
+
+static void TimerThread(SHIM_TIMER *timer, uint32_t periodUs, void (*callback)(void *context), void *context)
+{
+    std::unique_lock<std::mutex> lock(timer->lock);
+
+    while (timer->running) {
+        if (periodUs) {
+            timer->wake.wait_for(lock, std::chrono::microseconds(periodUs));
+            if (!timer->running) {
+                break;
+            }
+        }
+        lock.unlock();
+        callback(context);
+        lock.lock();
+    }
+}
+
+void ShimTimerStart(SHIM_TIMER *timer, uint32_t periodUs, void (*callback)(void *context), void *context)
+{
+    timer->running = true;
+    timer->thread = std::thread(TimerThread, timer, periodUs, callback, context);
+}
+
+void ShimTimerStop(SHIM_TIMER *timer)
+{
+    {
+        std::lock_guard<std::mutex> lock(timer->lock);
+        timer->running = false;
+    }
+    timer->wake.notify_all();
+    timer->thread.join();
+}
+
+//
+// Framework services called by eccore.c
+//
+
+extern "C" {
+
+VOID EcFwLockAcquire(EC_FW_HANDLE Lock)
+{
+    ((std::mutex *)Lock)->lock();
+}
+
+VOID EcFwLockRelease(EC_FW_HANDLE Lock)
+{
+    ((std::mutex *)Lock)->unlock();
+}
+
+/*
+ * Function: MethodNeither
+ * ----------------------------
+ *  KMDF only hands out the buffers of buffered and direct requests, retrieving
+ *  those of a METHOD_NEITHER request fails on the real driver. Counted as a
+ *  violation so a code that decodes to it cannot pass here unnoticed.
+ */
+static bool MethodNeither(const SHIM_REQUEST *request)
+{
+    if ((request->ioControlCode & SHIM_METHOD_MASK) != SHIM_METHOD_NEITHER) {
+        return false;
+    }
+    Violation("retrieving a buffer of a METHOD_NEITHER request", request);
+    return true;
+}
+
+NTSTATUS EcFwRetrieveInputBuffer(EC_FW_REQUEST Request, size_t MinimumRequiredSize, PVOID *Buffer, size_t *Length)
+{
+    SHIM_REQUEST *request = (SHIM_REQUEST *)Request;
+
+    if (MethodNeither(request)) {
+        return STATUS_INVALID_DEVICE_REQUEST;
+    }
+    if (request->inputBuffer == NULL || request->inputLength < MinimumRequiredSize) {
+        return STATUS_BUFFER_OVERFLOW;
+    }
+    *Buffer = request->systemBuffer;
+    *Length = request->inputLength;
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS EcFwRetrieveOutputBuffer(EC_FW_REQUEST Request, size_t MinimumRequiredSize, PVOID *Buffer, size_t *Length)
+{
+    SHIM_REQUEST *request = (SHIM_REQUEST *)Request;
+
+    if (MethodNeither(request)) {
+        return STATUS_INVALID_DEVICE_REQUEST;
+    }
+    if (request->outputBuffer == NULL || request->outputLength < MinimumRequiredSize) {
+        return STATUS_BUFFER_OVERFLOW;
+    }
+    *Buffer = ((request->ioControlCode & SHIM_METHOD_MASK) == SHIM_METHOD_BUFFERED) ? request->systemBuffer : request->outputBuffer;
+    *Length = request->outputLength;
+    return STATUS_SUCCESS;
+}
+
+EC_FW_HANDLE EcFwRequestFile(EC_FW_REQUEST Request)
+{
+    return ((SHIM_REQUEST *)Request)->file;
+}
+
+VOID EcFwRequestComplete(EC_FW_REQUEST Request, NTSTATUS Status, size_t Information)
+{
+    SHIM_REQUEST *request = (SHIM_REQUEST *)Request;
+    uint32_t state;
+
+    if (request->state.load(std::memory_order_acquire) & SHIM_COMPLETED) {
+        Violation("request completed twice", request);
+        return;
+    }
+
+    // The I/O manager copies the output of a buffered request back unless it failed
+    if (request->systemBuffer != NULL) {
+        if ((request->ioControlCode & SHIM_METHOD_MASK) == SHIM_METHOD_BUFFERED && !SHIM_NT_ERROR(Status) &&
+            request->outputBuffer != NULL) {
+            memcpy(request->outputBuffer, request->systemBuffer,
+                   Information < request->outputLength ? Information : request->outputLength);
+        }
+        delete[] request->systemBuffer;
+        request->systemBuffer = NULL;
+    }
+
+    request->status = Status;
+    request->information = Information;
+    state = request->state.fetch_or(SHIM_COMPLETED, std::memory_order_acq_rel);
+    if (state & SHIM_COMPLETED) {
+        Violation("request completed twice", request);
+        return;
+    }
+    if (state & SHIM_CANCELABLE) {
+        Violation("request completed while cancelable", request);
+    }
+    if (request->completion) {
+        request->completion(request, request->completionContext);
+    }
+}
+
+NTSTATUS EcFwRequestMarkCancelable(PEC_CORE Core, EC_FW_REQUEST Request)
+{
+    SHIM_REQUEST *request = (SHIM_REQUEST *)Request;
+    uint32_t state = request->state.load(std::memory_order_acquire);
+
+    request->core = Core;
+    for (;;) {
+        if (state & (SHIM_CANCELABLE | SHIM_COMPLETED)) {
+            Violation("marking a cancelable or completed request", request);
+            return STATUS_INVALID_PARAMETER;
+        }
+        if (state & SHIM_CANCEL_REQUESTED) {
+            // Like WdfRequestMarkCancelableEx, leave completion to the caller
+            return STATUS_CANCELLED;
+        }
+        if (request->state.compare_exchange_weak(state, state | SHIM_CANCELABLE, std::memory_order_acq_rel)) {
+            return STATUS_SUCCESS;
+        }
+    }
+}
+
+NTSTATUS EcFwRequestUnmarkCancelable(EC_FW_REQUEST Request)
+{
+    SHIM_REQUEST *request = (SHIM_REQUEST *)Request;
+    uint32_t state = request->state.load(std::memory_order_acquire);
+
+    for (;;) {
+        if (state & SHIM_COMPLETED) {
+            // The framework has freed it, a cancel routine may have completed it
+            Violation("unmarking a completed request", request);
+            return STATUS_INVALID_PARAMETER;
+        }
+        if (state & SHIM_CANCEL_RUNNING) {
+            return STATUS_CANCELLED;
+        }
+        if (!(state & SHIM_CANCELABLE)) {
+            Violation("unmarking a request that is not cancelable", request);
+            return STATUS_INVALID_PARAMETER;
+        }
+        if (request->state.compare_exchange_weak(state, state & ~SHIM_CANCELABLE, std::memory_order_acq_rel)) {
+            return STATUS_SUCCESS;
+        }
+    }
+}
+
+NTSTATUS EcFwQueueWork(PEC_CORE Core, EC_FW_REQUEST Request, ULONG IoControlCode)
+{
+    SHIM_DEVICE *device = DeviceFromCore(Core);
+
+    {
+        std::lock_guard<std::mutex> lock(device->workLock);
+        device->work.push_back(std::make_pair((SHIM_REQUEST *)Request, IoControlCode));
+    }
+    device->workReady.notify_one();
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS EcFwEvaluateAcpi(
+    PEC_CORE Core,
+    PVOID Input,
+    size_t InputLength,
+    PVOID Output,
+    size_t OutputLength,
+    ULONG *BytesReturned
+)
+{
+    SHIM_DEVICE *device = DeviceFromCore(Core);
+
+    return device->evaluate(device->evaluateContext, Input, InputLength, Output, OutputLength, BytesReturned);
+}
+
+NTSTATUS EcFwReadPhysical64(PEC_CORE Core, UINT64 Address, UINT64 *Value)
+{
+    if (Address != SBSAQEMU_SHARED_MEM_BASE) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    *Value = DeviceFromCore(Core)->sharedBuffer.load(std::memory_order_acquire);
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS EcFwReadPhysical(PEC_CORE Core, UINT64 Address, PVOID Buffer, ULONG Length)
+{
+    SHIM_DEVICE *device = DeviceFromCore(Core);
+
+    if (Address >= EC_BATTERY_STATUS_BASE && Length <= SHIM_BATTERY_PAGE_SIZE &&
+        Address - EC_BATTERY_STATUS_BASE <= SHIM_BATTERY_PAGE_SIZE - Length) {
+        // Written by the EC model while the core reads, like the real shared page
+        const volatile uint8_t *source = device->batteryPage + (Address - EC_BATTERY_STATUS_BASE);
+        for (ULONG i = 0; i < Length; i++) {
+            ((uint8_t *)Buffer)[i] = source[i];
+        }
+        return STATUS_SUCCESS;
+    }
+    if (Address < EC_STATIC_BASE || Length > SHIM_STATIC_PAGE_SIZE ||
+        Address - EC_STATIC_BASE > SHIM_STATIC_PAGE_SIZE - Length) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    memcpy(Buffer, device->staticPage + (Address - EC_STATIC_BASE), Length);
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS EcFwMapShared(PEC_CORE Core, EC_FW_REQUEST Request, UINT64 *Tx, UINT64 *Rx)
+{
+    SHIM_DEVICE *device = DeviceFromCore(Core);
+    SHIM_REQUEST *request = (SHIM_REQUEST *)Request;
+
+#ifdef __linux__
+    if (device->windowFile >= 0) {
+        std::lock_guard<std::mutex> lock(device->viewLock);
+
+        if (request->file == NULL) {
+            return STATUS_INVALID_PARAMETER;
+        }
+        auto found = device->views.find(request->file);
+        if (found != device->views.end()) {
+            *Tx = (UINT64)(uintptr_t)found->second.first;
+            *Rx = (UINT64)(uintptr_t)found->second.second;
+            return STATUS_SUCCESS;
+        }
+
+        void *tx = mmap(NULL, EC_MAP_TX_LENGTH, PROT_READ | PROT_WRITE, MAP_SHARED, device->windowFile, 0);
+        void *rx = mmap(NULL, EC_MAP_RX_LENGTH, PROT_READ, MAP_SHARED, device->windowFile, EC_MAP_TX_LENGTH);
+
+        if (tx != MAP_FAILED && rx != MAP_FAILED) {
+            device->views[request->file] = std::make_pair(tx, rx);
+            *Tx = (UINT64)(uintptr_t)tx;
+            *Rx = (UINT64)(uintptr_t)rx;
+            return STATUS_SUCCESS;
+        }
+        if (tx != MAP_FAILED) {
+            munmap(tx, EC_MAP_TX_LENGTH);
+        }
+        if (rx != MAP_FAILED) {
+            munmap(rx, EC_MAP_RX_LENGTH);
+        }
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+#endif
+    // Handing out the writable window would not show a client writing RX
+    (void)device;
+    (void)request;
+    (void)Tx;
+    (void)Rx;
+    return STATUS_NOT_SUPPORTED;
+}
+
+NTSTATUS EcFwMessageBuffers(PEC_CORE Core, PVOID *Tx, PVOID *Rx, size_t *Size)
+{
+    SHIM_DEVICE *device = DeviceFromCore(Core);
+
+    *Tx = device->messageTx;
+    *Rx = device->messageRx;
+    *Size = EC_MSG_BUFFER_SIZE;
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS EcFwMessageSend(PEC_CORE Core)
+{
+    SHIM_DEVICE *device = DeviceFromCore(Core);
+
+    switch (EcSimMsgSend2(device->sim, device->messageTx, device->messageRx, EC_MSG_BUFFER_SIZE)) {
+    case ECSIM_FFA_SUCCESS:
+        return STATUS_SUCCESS;
+    case ECSIM_FFA_BUSY:
+        return STATUS_DEVICE_BUSY;
+    default:
+        return STATUS_INVALID_PARAMETER;
+    }
+}
+
+VOID EcFwMessageRelease(PEC_CORE Core)
+{
+    SHIM_DEVICE *device = DeviceFromCore(Core);
+
+    ((EC_MSG_RXTX_HEADER *)device->messageRx)->Size = 0;
+    EcSimRxRelease(device->sim);
+}
+
+NTSTATUS EcFwShareAllocate(PEC_CORE Core, UINT32 Pages, PVOID *Buffer, UINT64 *Address)
+{
+    void *buffer;
+
+    (void)Core;
+    // The simulator treats host pointers as physical addresses
+    buffer = aligned_alloc(FFA_MEM_PAGE_SIZE, (size_t)Pages * FFA_MEM_PAGE_SIZE);
+    if (buffer == NULL) {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+    memset(buffer, 0, (size_t)Pages * FFA_MEM_PAGE_SIZE);
+    *Buffer = buffer;
+    *Address = (UINT64)(uintptr_t)buffer;
+    return STATUS_SUCCESS;
+}
+
+VOID EcFwShareFree(PEC_CORE Core, PVOID Buffer, UINT32 Pages)
+{
+    (void)Core;
+    (void)Pages;
+    free(Buffer);
+}
+
+static NTSTATUS MemStatus(int ffaStatus)
+{
+    switch (ffaStatus) {
+    case ECSIM_FFA_SUCCESS:
+        return STATUS_SUCCESS;
+    case ECSIM_FFA_NO_MEMORY:
+        return STATUS_INSUFFICIENT_RESOURCES;
+    case ECSIM_FFA_DENIED:
+        return STATUS_DEVICE_BUSY;
+    default:
+        return STATUS_INVALID_PARAMETER;
+    }
+}
+
+NTSTATUS EcFwMemShare(PEC_CORE Core, UINT32 Length, UINT64 *Handle)
+{
+    SHIM_DEVICE *device = DeviceFromCore(Core);
+
+    return MemStatus(EcSimMemShare(device->sim, device->messageTx, Length, Handle));
+}
+
+NTSTATUS EcFwMemReclaim(PEC_CORE Core, UINT64 Handle)
+{
+    return MemStatus(EcSimMemReclaim(DeviceFromCore(Core)->sim, Handle));
+}
+
+VOID EcFwSamplerSchedule(PEC_CORE Core, ULONG Milliseconds)
+{
+    SHIM_DEVICE *device = DeviceFromCore(Core);
+
+    {
+        std::lock_guard<std::mutex> lock(device->samplerLock);
+        device->samplerDue = std::chrono::steady_clock::now() + std::chrono::milliseconds(Milliseconds);
+        device->samplerArmed = true;
+    }
+    device->samplerWake.notify_one();
+}
+
+VOID EcFwSamplerStop(PEC_CORE Core)
+{
+    SHIM_DEVICE *device = DeviceFromCore(Core);
+
+    {
+        std::lock_guard<std::mutex> lock(device->samplerLock);
+        device->samplerStopping = true;
+        device->samplerArmed = false;
+    }
+    device->samplerWake.notify_one();
+    if (device->sampler.joinable()) {
+        device->sampler.join();
+    }
+}
+
+NTSTATUS EcFwEventReference(PEC_CORE Core, UINT64 Handle, EC_FW_HANDLE *Event)
+{
+    SHIM_EVENT *event = (SHIM_EVENT *)(uintptr_t)Handle;
+
+    (void)Core;
+    if (event == NULL) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    event->references.fetch_add(1);
+    *Event = event;
+    return STATUS_SUCCESS;
+}
+
+VOID EcFwEventSignal(EC_FW_HANDLE Event)
+{
+    SHIM_EVENT *event = (SHIM_EVENT *)Event;
+
+    {
+        std::lock_guard<std::mutex> lock(event->lock);
+        event->set = true;
+    }
+    event->signalled.notify_all();
+}
+
+VOID EcFwEventDereference(EC_FW_HANDLE Event)
+{
+    if (((SHIM_EVENT *)Event)->references.fetch_sub(1) <= 0) {
+        Violation("event dereferenced more often than referenced", NULL);
+    }
+}
+
+LONGLONG EcFwQuerySystemTime(VOID)
+{
+    // 100ns units like KeQuerySystemTimePrecise
+    return (LONGLONG)(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count() / 100);
+}
+
+VOID EcFwDelay(ULONG Microseconds)
+{
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now() + std::chrono::microseconds(Microseconds);
+
+    // Same split as the driver, short delays spin and longer ones sleep
+    if (Microseconds > 50) {
+        std::this_thread::sleep_until(end);
+    }
+    while (std::chrono::steady_clock::now() < end) {
+    }
+}
+
+} // extern "C"
@@ -0,0 +1,179 @@
+/*
+MIT License
+
+Copyright (c) 2025 Open Device Partnership
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// User-mode stand-in for the KMDF services used by kmdf/eccore.c. Requests,
+// the parallel I/O queue, work items, wait locks and timers are implemented on
+// std::thread so the driver's dispatch and notification paths can be run,
+// benchmarked and stress tested on any host. The request state machine follows
+// WDF cancel semantics and counts every contract violation it sees (double
+// completion, completing a cancelable request, unmarking a request that is not
+// cancelable, retrieving the buffers of a METHOD_NEITHER request) instead of
+// bugchecking. FF-A calls reach the EC model in tools/ecsim.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "../ecsim/ecsim.h"
+
+extern "C" {
+    #include "../../kmdf/eccore.h"
+}
+
+struct SHIM_REQUEST;
+
+// Called once when a request completes, on whichever thread completed it
+typedef void (*SHIM_COMPLETION)(SHIM_REQUEST *request, void *context);
+
+// Evaluates an ACPI method on behalf of EcFwEvaluateAcpi
+typedef NTSTATUS (*SHIM_EVALUATE)(
+    void *context,
+    const void *input,
+    size_t inputLength,
+    void *output,
+    size_t outputLength,
+    ULONG *bytesReturned
+);
+
+struct SHIM_REQUEST {
+    ULONG ioControlCode;
+    void *inputBuffer;          // Owned by the submitter
+    size_t inputLength;
+    void *outputBuffer;         // Owned by the submitter
+    size_t outputLength;
+    uint8_t *systemBuffer;      // Copy of the input, also the output of METHOD_BUFFERED requests
+    NTSTATUS status;            // Valid once completed
+    size_t information;
+    PEC_CORE core;              // Set when marked cancelable
+    void *file;                 // File object it was sent on, NULL for none
+    SHIM_COMPLETION completion;
+    void *completionContext;
+    std::atomic<uint32_t> state;
+};
+
+struct SHIM_DEVICE {
+    EC_CORE core;
+    std::mutex notificationLock;
+    std::mutex loopbackLock;
+
+    // Work items queued by EcFwQueueWork, with their IOCTL
+    std::mutex workLock;
+    std::condition_variable workReady;
+    std::deque<std::pair<SHIM_REQUEST *, ULONG> > work;
+    std::vector<std::thread> workers;
+    bool stopping;
+
+    SHIM_EVALUATE evaluate;
+    void *evaluateContext;
+    std::atomic<uint64_t> sharedBuffer; // Backs SBSAQEMU_SHARED_MEM_BASE
+    uint8_t *staticPage;                // Backs EC_STATIC_BASE, written by the EC model at create
+    uint8_t *window;                    // TX, RX and event pages from SBSAQEMU_SHARED_MEM_BASE, as the EC sees them
+    uint8_t *batteryPage;               // Backs EC_BATTERY_STATUS_BASE in window, written by EcSimBatteryUpdate
+    int windowFile;                     // memfd behind window that IOCTL_MAP_RX maps again, -1 if none
+
+    // TX and RX views IOCTL_MAP_RX mapped for each file object, unmapped by
+    // ShimFileCleanup or when the device is destroyed
+    std::mutex viewLock;
+    std::map<void *, std::pair<void *, void *> > views;
+
+    // FF-A endpoint, the EC answers messages in messageRx
+    ECSIM *sim;
+    std::mutex messageLock;
+    uint8_t *messageTx;
+    uint8_t *messageRx;
+
+    // One-shot passive timer armed by EcFwSamplerSchedule
+    std::mutex samplingLock;
+    std::mutex samplerLock;
+    std::condition_variable samplerWake;
+    std::chrono::steady_clock::time_point samplerDue;
+    bool samplerArmed;
+    bool samplerStopping;
+    std::thread sampler;
+};
+
+// Event a subscriber passes by handle, signalled by EcFwEventSignal. The handle
+// is the address of the event
+struct SHIM_EVENT {
+    std::mutex lock;
+    std::condition_variable signalled;
+    bool set;
+    std::atomic<int32_t> references;    // Held by the driver
+};
+
+// Periodic timer, the callback runs on the timer thread
+struct SHIM_TIMER {
+    std::thread thread;
+    std::mutex lock;
+    std::condition_variable wake;
+    bool running;
+};
+
+SHIM_DEVICE *ShimDeviceCreate(uint32_t workerThreads, SHIM_EVALUATE evaluate, void *context);
+void ShimDeviceDestroy(SHIM_DEVICE *device);
+
+void ShimRequestInit(
+    SHIM_REQUEST *request,
+    ULONG ioControlCode,
+    void *input,
+    size_t inputLength,
+    void *output,
+    size_t outputLength,
+    SHIM_COMPLETION completion,
+    void *context
+);
+
+// Dispatches the request on the calling thread, like a parallel default queue.
+// Buffers are handed to the driver as the I/O manager would: the input is copied
+// into a system buffer, which METHOD_BUFFERED requests also return their output
+// in and which is copied back to the output buffer on completion. Direct
+// requests write the output buffer in place
+void ShimSubmit(SHIM_DEVICE *device, SHIM_REQUEST *request);
+
+// Cancels the request as WdfRequestCancelSentRequest would from the I/O manager
+void ShimCancel(SHIM_REQUEST *request);
+
+bool ShimRequestCompleted(const SHIM_REQUEST *request);
+
+// Releases what the device holds for a file object, as EvtFileCleanup does
+// once its last handle is closed
+void ShimFileCleanup(SHIM_DEVICE *device, void *file);
+
+// Contract violations seen since the process started
+uint64_t ShimViolations();
+
+void ShimEventInit(SHIM_EVENT *event);
+
+// Waits for the event and resets it, returns false on timeout
+bool ShimEventWait(SHIM_EVENT *event, uint32_t timeoutUs);
+
+void ShimTimerStart(SHIM_TIMER *timer, uint32_t periodUs, void (*callback)(void *context), void *context);
+void ShimTimerStop(SHIM_TIMER *timer);
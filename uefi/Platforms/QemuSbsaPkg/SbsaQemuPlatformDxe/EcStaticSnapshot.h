@@ -0,0 +1,160 @@
+/** @file
+  Snapshot of static EC facts published by firmware at boot.
+
+  Header only so the same builder and checker are used by SbsaQemuPlatformDxe,
+  which writes the snapshot, by the ectest driver, which hands it to clients
+  with IOCTL_GET_STATIC, and by the host simulator in tools/ecsim. The includer
+  provides UINT8..UINT64 and VOID, from Base.h, the WDK or kmdf/eccore.h.
+
+  The snapshot lives in a page of the reserved region that is not shared with
+  the EC and only holds facts that cannot change before the next boot, so a
+  client reads all of them at once instead of making an FF-A round trip or a
+  method evaluation for each. The UINT32 words of a valid snapshot, checksum
+  included, sum to 0.
+**/
+
+#pragma once
+
+#define EC_STATIC_BASE           0x100600C0000   // After the EC service RX buffer
+#define EC_STATIC_SIGNATURE      0x46534345      // 'ECSF'
+#define EC_STATIC_VERSION        1
+#define EC_STATIC_MAX_SERVICES   4
+#define EC_STATIC_MAX_DSM        4
+
+// EcStaticCheck results
+#define EC_STATIC_VALID          0
+#define EC_STATIC_MISSING        1               // Not written, or by another version
+#define EC_STATIC_CORRUPT        2
+
+#pragma pack(push, 1)
+typedef struct {
+  UINT8     Uuid[16];         // Service UUID in GUID byte order
+  UINT16    PartitionId;      // FF-A ID of the partition serving it
+  UINT16    Reserved[3];
+} EC_STATIC_SERVICE;
+
+typedef struct {
+  UINT8     Uuid[16];         // _DSM UUID in GUID byte order
+  UINT8     Device[4];        // ACPI name of the device under \_SB, not terminated
+  UINT32    Revision;         // Revision passed in Arg1
+  UINT64    Functions;        // Bitmask returned by function 0
+} EC_STATIC_DSM;
+
+typedef struct {
+  UINT32               Signature;
+  UINT16               Version;
+  UINT16               Length;     // Bytes of the snapshot, this header included
+  UINT32               Checksum;
+  UINT32               FwState;    // EC_CAP_GET_FW_STATE as TFWS returns it, 0 if the EC did not answer
+  UINT32               ServiceCount;
+  UINT32               DsmCount;
+  EC_STATIC_SERVICE    Services[EC_STATIC_MAX_SERVICES];
+  EC_STATIC_DSM        Dsm[EC_STATIC_MAX_DSM];
+} EC_STATIC;
+#pragma pack(pop)
+
+//
+// Services and _DSM function 0 results of this platform. Keep the _DSM entries
+// in step with thermal.asl.
+//
+static const EC_STATIC_SERVICE  mEcStaticServices[] = {
+  // 330c1273-fde5-4757-9819-5b6539037502 EC management
+  { { 0x73, 0x12, 0x0c, 0x33, 0xe5, 0xfd, 0x57, 0x47, 0x98, 0x19, 0x5b, 0x65, 0x39, 0x03, 0x75, 0x02 }, 0x8002, { 0 } },
+  // 31f56da7-593c-4d72-a4b3-8fc7171ac073 EC thermal
+  { { 0xa7, 0x6d, 0xf5, 0x31, 0x3c, 0x59, 0x72, 0x4d, 0xa4, 0xb3, 0x8f, 0xc7, 0x17, 0x1a, 0xc0, 0x73 }, 0x8002, { 0 } },
+};
+
+static const EC_STATIC_DSM  mEcStaticDsm[] = {
+  // 1f0849fc-a845-4fcf-865c-4101bf8e8d79 thresholds
+  { { 0xfc, 0x49, 0x08, 0x1f, 0x45, 0xa8, 0xcf, 0x4f, 0x86, 0x5c, 0x41, 0x01, 0xbf, 0x8e, 0x8d, 0x79 }, { 'S', 'K', 'I', 'N' }, 0, 0x3 },
+  // 07ff6382-e29a-47c9-ac87-e79dad71dd82 variable input
+  { { 0x82, 0x63, 0xff, 0x07, 0x9a, 0xe2, 0xc9, 0x47, 0xac, 0x87, 0xe7, 0x9d, 0xad, 0x71, 0xdd, 0x82 }, { 'T', 'H', 'R', 'M' }, 0, 0xf },
+  // d9b9b7f3-2a3e-4064-8841-cb13d317669e variable output
+  { { 0xf3, 0xb7, 0xb9, 0xd9, 0x3e, 0x2a, 0x64, 0x40, 0x88, 0x41, 0xcb, 0x13, 0xd3, 0x17, 0x66, 0x9e }, { 'T', 'H', 'R', 'M' }, 0, 0x1f },
+};
+
+/**
+  Sums the UINT32 words of a snapshot.
+
+  @param[in]  Static  The snapshot.
+
+  @return The sum, 0 for a sealed snapshot.
+**/
+static __inline UINT32
+EcStaticSum (
+  const EC_STATIC  *Static
+  )
+{
+  const UINT32  *Words = (const UINT32 *)Static;
+  UINT32        Sum    = 0;
+  UINT32        Index;
+
+  for (Index = 0; Index < sizeof (EC_STATIC) / sizeof (UINT32); Index++) {
+    Sum += Words[Index];
+  }
+
+  return Sum;
+}
+
+/**
+  Fills a snapshot with the facts of this platform and seals it.
+
+  @param[out] Static   Receives the snapshot.
+  @param[in]  FwState  What EC_CAP_GET_FW_STATE returned, 0 if it failed.
+**/
+static __inline VOID
+EcStaticBuild (
+  EC_STATIC  *Static,
+  UINT32     FwState
+  )
+{
+  UINT8   *Bytes = (UINT8 *)Static;
+  UINT32  Index;
+
+  for (Index = 0; Index < sizeof (EC_STATIC); Index++) {
+    Bytes[Index] = 0;
+  }
+
+  Static->Signature    = EC_STATIC_SIGNATURE;
+  Static->Version      = EC_STATIC_VERSION;
+  Static->Length       = sizeof (EC_STATIC);
+  Static->FwState      = FwState;
+  Static->ServiceCount = sizeof (mEcStaticServices) / sizeof (mEcStaticServices[0]);
+  Static->DsmCount     = sizeof (mEcStaticDsm) / sizeof (mEcStaticDsm[0]);
+  for (Index = 0; Index < Static->ServiceCount; Index++) {
+    Static->Services[Index] = mEcStaticServices[Index];
+  }
+
+  for (Index = 0; Index < Static->DsmCount; Index++) {
+    Static->Dsm[Index] = mEcStaticDsm[Index];
+  }
+
+  Static->Checksum = 0 - EcStaticSum (Static);
+}
+
+/**
+  Checks a snapshot read back from memory before any of it is trusted.
+
+  @param[in]  Static  The snapshot.
+
+  @return EC_STATIC_VALID, EC_STATIC_MISSING or EC_STATIC_CORRUPT.
+**/
+static __inline UINT32
+EcStaticCheck (
+  const EC_STATIC  *Static
+  )
+{
+  if ((Static->Signature != EC_STATIC_SIGNATURE) || (Static->Version != EC_STATIC_VERSION)) {
+    return EC_STATIC_MISSING;
+  }
+
+  if ((Static->Length != sizeof (EC_STATIC)) ||
+      (Static->ServiceCount > EC_STATIC_MAX_SERVICES) ||
+      (Static->DsmCount > EC_STATIC_MAX_DSM) ||
+      (EcStaticSum (Static) != 0))
+  {
+    return EC_STATIC_CORRUPT;
+  }
+
+  return EC_STATIC_VALID;
+}
@@ -0,0 +1,236 @@
+/** @file
+  FF-A memory transaction descriptors used to share memory with the EC service.
+
+  Header only so the same builder and parser are used by SbsaQemuPlatformDxe
+  at boot, by the ectest driver for buffers shared at runtime and by the host
+  simulator in tools/ecsim. The includer provides UINT8..UINT64 and VOID, from
+  Base.h, the WDK or kmdf/eccore.h.
+
+  The layout is one memory access descriptor per receiver followed by a single
+  composite memory region descriptor, as sent with FFA_MEM_SHARE from the TX
+  buffer.
+**/
+
+#pragma once
+
+#define FFA_MEM_SHARE_SMC        0x84000073
+#define FFA_MEM_RECLAIM_SMC      0x84000077
+
+#define FFA_MEM_PAGE_SIZE        0x1000
+#define FFA_MEM_MAX_RANGES       16
+#define FFA_MEM_PERM_RW          0x2    // Data read/write, no instruction access
+#define FFA_MEM_ATTR_NORMAL_WB   0x2F   // Normal memory, write-back cacheable, inner shareable
+
+#pragma pack(push, 1)
+typedef struct {
+  UINT64    Address;
+  UINT32    PageCount;
+  UINT32    Reserved;
+} FFA_MEM_RANGE;
+
+typedef struct {
+  UINT32    TotalPageCount;
+  UINT32    RangeCount;
+  UINT64    Reserved;
+  // Followed by RangeCount FFA_MEM_RANGE
+} FFA_MEM_COMPOSITE;
+
+typedef struct {
+  UINT16    ReceiverId;
+  UINT8     Permissions;
+  UINT8     Flags;
+  UINT32    CompositeOffset;  // From the start of FFA_MEM_REGION, 0 in a retrieve request
+  UINT64    Reserved;
+} FFA_MEM_ACCESS;
+
+typedef struct {
+  UINT16    SenderId;
+  UINT16    Attributes;
+  UINT32    Flags;
+  UINT64    Handle;           // Returned by FFA_MEM_SHARE, 0 when sharing
+  UINT64    Tag;              // Implementation defined, identifies the share to the receiver
+  UINT32    AccessDescSize;
+  UINT32    ReceiverCount;
+  UINT32    ReceiversOffset;
+  UINT32    Reserved[3];
+  // Followed by ReceiverCount FFA_MEM_ACCESS and the FFA_MEM_COMPOSITE
+} FFA_MEM_REGION;
+#pragma pack(pop)
+
+/**
+  Builds an FFA_MEM_SHARE transaction descriptor for a single receiver.
+
+  @param[out] Buffer       Receives the descriptor, normally the TX buffer.
+  @param[in]  BufferSize   Size of Buffer in bytes.
+  @param[in]  Sender       FF-A ID of the owner.
+  @param[in]  Receiver     FF-A ID of the partition the memory is shared with.
+  @param[in]  Attributes   Memory region attributes, FFA_MEM_ATTR_*.
+  @param[in]  Permissions  Access granted to the receiver, FFA_MEM_PERM_*.
+  @param[in]  Tag          Implementation defined tag.
+  @param[in]  Ranges       Physical ranges to share.
+  @param[in]  RangeCount   Number of ranges, at most FFA_MEM_MAX_RANGES.
+
+  @return Length of the descriptor, 0 if it does not fit or a range is empty.
+**/
+static __inline UINT32
+FfaMemBuildShare (
+  VOID                 *Buffer,
+  UINT32               BufferSize,
+  UINT16               Sender,
+  UINT16               Receiver,
+  UINT16               Attributes,
+  UINT8                Permissions,
+  UINT64               Tag,
+  const FFA_MEM_RANGE  *Ranges,
+  UINT32               RangeCount
+  )
+{
+  FFA_MEM_REGION     *Region    = (FFA_MEM_REGION *)Buffer;
+  FFA_MEM_ACCESS     *Access    = (FFA_MEM_ACCESS *)(Region + 1);
+  FFA_MEM_COMPOSITE  *Composite = (FFA_MEM_COMPOSITE *)(Access + 1);
+  FFA_MEM_RANGE      *Range     = (FFA_MEM_RANGE *)(Composite + 1);
+  UINT32             Length;
+  UINT32             Pages = 0;
+  UINT32             Index;
+
+  if ((RangeCount == 0) || (RangeCount > FFA_MEM_MAX_RANGES)) {
+    return 0;
+  }
+
+  Length = sizeof (*Region) + sizeof (*Access) + sizeof (*Composite) + RangeCount * sizeof (*Range);
+  if (Length > BufferSize) {
+    return 0;
+  }
+
+  for (Index = 0; Index < RangeCount; Index++) {
+    if ((Ranges[Index].PageCount == 0) || ((Ranges[Index].Address & (FFA_MEM_PAGE_SIZE - 1)) != 0)) {
+      return 0;
+    }
+
+    Range[Index].Address   = Ranges[Index].Address;
+    Range[Index].PageCount = Ranges[Index].PageCount;
+    Range[Index].Reserved  = 0;
+    Pages                 += Ranges[Index].PageCount;
+  }
+
+  Region->SenderId        = Sender;
+  Region->Attributes      = Attributes;
+  Region->Flags           = 0;
+  Region->Handle          = 0;
+  Region->Tag             = Tag;
+  Region->AccessDescSize  = sizeof (*Access);
+  Region->ReceiverCount   = 1;
+  Region->ReceiversOffset = sizeof (*Region);
+  Region->Reserved[0]     = 0;
+  Region->Reserved[1]     = 0;
+  Region->Reserved[2]     = 0;
+
+  Access->ReceiverId      = Receiver;
+  Access->Permissions     = Permissions;
+  Access->Flags           = 0;
+  Access->CompositeOffset = sizeof (*Region) + sizeof (*Access);
+  Access->Reserved        = 0;
+
+  Composite->TotalPageCount = Pages;
+  Composite->RangeCount     = RangeCount;
+  Composite->Reserved       = 0;
+
+  return Length;
+}
+
+/**
+  Turns a share descriptor into the retrieve request the receiver passes to
+  FFA_MEM_RETRIEVE_REQ, by filling in the handle and dropping the composite
+  offsets. The descriptor keeps its length.
+
+  @param[in,out] Buffer  Descriptor built by FfaMemBuildShare.
+  @param[in]     Handle  Handle returned by FFA_MEM_SHARE.
+**/
+static __inline VOID
+FfaMemBuildRetrieve (
+  VOID    *Buffer,
+  UINT64  Handle
+  )
+{
+  FFA_MEM_REGION  *Region = (FFA_MEM_REGION *)Buffer;
+  FFA_MEM_ACCESS  *Access = (FFA_MEM_ACCESS *)((UINT8 *)Buffer + Region->ReceiversOffset);
+  UINT32          Index;
+
+  Region->Handle = Handle;
+  for (Index = 0; Index < Region->ReceiverCount; Index++) {
+    Access[Index].CompositeOffset = 0;
+  }
+}
+
+/**
+  Validates a share descriptor and finds what it grants to one receiver.
+
+  @param[in]  Buffer       The descriptor.
+  @param[in]  Length       Length of the descriptor in bytes.
+  @param[in]  Receiver     FF-A ID of the receiver to look up.
+  @param[out] Permissions  Receives the access granted to the receiver.
+
+  @return The composite memory region, or NULL if the descriptor is malformed,
+          the receiver is not listed or the page counts do not add up.
+**/
+static __inline const FFA_MEM_COMPOSITE *
+FfaMemParseShare (
+  const VOID  *Buffer,
+  UINT32      Length,
+  UINT16      Receiver,
+  UINT8       *Permissions
+  )
+{
+  const FFA_MEM_REGION     *Region = (const FFA_MEM_REGION *)Buffer;
+  const FFA_MEM_ACCESS     *Access = NULL;
+  const FFA_MEM_COMPOSITE  *Composite;
+  const FFA_MEM_RANGE      *Range;
+  UINT64                   Pages = 0;
+  UINT32                   Index;
+
+  if ((Length < sizeof (*Region)) || (Region->AccessDescSize < sizeof (*Access)) ||
+      (Region->ReceiverCount == 0) || (Region->ReceiversOffset < sizeof (*Region)) ||
+      (Region->ReceiversOffset > Length) ||
+      ((UINT64)Region->ReceiverCount * Region->AccessDescSize > Length - Region->ReceiversOffset))
+  {
+    return NULL;
+  }
+
+  for (Index = 0; Index < Region->ReceiverCount; Index++) {
+    const FFA_MEM_ACCESS  *Entry = (const FFA_MEM_ACCESS *)((const UINT8 *)Buffer + Region->ReceiversOffset +
+                                                            Index * Region->AccessDescSize);
+    if (Entry->ReceiverId == Receiver) {
+      Access = Entry;
+      break;
+    }
+  }
+
+  if ((Access == NULL) || (Access->CompositeOffset < sizeof (*Region)) ||
+      (Access->CompositeOffset > Length - sizeof (*Composite)))
+  {
+    return NULL;
+  }
+
+  Composite = (const FFA_MEM_COMPOSITE *)((const UINT8 *)Buffer + Access->CompositeOffset);
+  if ((Composite->RangeCount == 0) || (Composite->RangeCount > FFA_MEM_MAX_RANGES) ||
+      (Composite->RangeCount * sizeof (*Range) > Length - Access->CompositeOffset - sizeof (*Composite)))
+  {
+    return NULL;
+  }
+
+  Range = (const FFA_MEM_RANGE *)(Composite + 1);
+  for (Index = 0; Index < Composite->RangeCount; Index++) {
+    if ((Range[Index].PageCount == 0) || ((Range[Index].Address & (FFA_MEM_PAGE_SIZE - 1)) != 0)) {
+      return NULL;
+    }
+
+    Pages += Range[Index].PageCount;
+  }
+
+  if (Pages != Composite->TotalPageCount) {
+    return NULL;
+  }
+
+  *Permissions = Access->Permissions;
+  return Composite;
+}
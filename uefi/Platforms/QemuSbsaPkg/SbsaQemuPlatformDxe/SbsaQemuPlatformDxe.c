@@ -65,34 +65,19 @@ SetupSbsaQemuSharedMemory(VOID)
   DEBUG ((DEBUG_ERROR, "    X1 = 0x%x\n", SmcArgs.Arg1));
   DEBUG ((DEBUG_ERROR, "    X2 = 0x%x\n", SmcArgs.Arg2));
 
-  // Populate the request
-  ffa_memory_region_t *mem_req = (ffa_memory_region_t *)SBSAQEMU_TX_BUFFER_BASE; // TX_BUFFER
-  mem_req->sender = 0; // OS VM is 0
-  mem_req->attributes = 0x03; // No share device no cache device memory nonsecure 0b0101 0100
-  mem_req->flags = 0;
-  mem_req->handle = 0x0;
-  mem_req->tag = SBSAQEMU_SHARED_MEM_TAG;
-  mem_req->memory_access_desc_size = sizeof(ffa_memory_access_t);
-  mem_req->receiver_count = 1;
-  mem_req->receivers_offset = sizeof(ffa_memory_region_t);
-  ffa_memory_access_t *memory_access = (ffa_memory_access_t *)((UINT64)mem_req + sizeof(ffa_memory_region_t));
-  DEBUG ((DEBUG_ERROR, "memory_access = 0x%x\n", (UINT64)memory_access));
-
-  memory_access->receiver_permissions.id = EC_SERVICE_VMID;
-  memory_access->receiver_permissions.perm = 2; // 0b0010 no instruction access data RW
-  memory_access->receiver_permissions.flags = 0;
-  memory_access->composite_memory_region_offset = sizeof(ffa_memory_region_t) + sizeof(ffa_memory_access_t);
-  memory_access->reserved_0 = 0;
-  composite_memory_region_t *memory_region = (composite_memory_region_t *)((UINT64)memory_access + sizeof(ffa_memory_access_t));
-  memory_region->total_page_count = 1;
-  memory_region->address_range_count = 1;
-  memory_region->reserved = 0;
-  memory_region->regions[0].address = SBSAQEMU_SHARED_MEM_BASE;
-  memory_region->regions[0].page_count = 1;
+  // Populate the request, one range shared with the EC service
+  FFA_MEM_RANGE SharedRange;
+  SharedRange.Address = SBSAQEMU_SHARED_MEM_BASE;
+  SharedRange.PageCount = 1;
+  SharedRange.Reserved = 0;
+
+  // No share device no cache device memory nonsecure 0b0101 0100
+  VOID *mem_req = (VOID *)SBSAQEMU_TX_BUFFER_BASE; // TX_BUFFER
+  UINT32 len = FfaMemBuildShare(mem_req, EFI_PAGE_SIZE, 0 /* OS VM is 0 */, EC_SERVICE_VMID, 0x03,
+                                FFA_MEM_PERM_RW, SBSAQEMU_SHARED_MEM_TAG, &SharedRange, 1);
 
   // Send FFA request to share this memory
   DEBUG ((DEBUG_INFO, "Send FFA_MEM_SHARE request\n"));
-  UINT32 len = sizeof(ffa_memory_region_t) + sizeof(ffa_memory_access_t) + sizeof(composite_memory_region_t);
 
   // Then register this test app to receive notifications from the Ffa test SP
   ZeroMem(&SmcArgs, sizeof(SmcArgs));
@@ -108,9 +93,6 @@ SetupSbsaQemuSharedMemory(VOID)
   DEBUG ((DEBUG_ERROR, "    X1 = 0x%x\n", SmcArgs.Arg1));
   DEBUG ((DEBUG_ERROR, "    X2 = 0x%x\n", SmcArgs.Arg2));
 
-  // If success the handle is in x2 so save that off
-  mem_req->handle = SmcArgs.Arg2;
-
   // Copy the Memory descriptor over to the TX_BUFFER for SP which it will use to retrieve
   DEBUG ((DEBUG_INFO, "Send request to SP to fetch share memory region\n"));
 
@@ -118,8 +100,8 @@ SetupSbsaQemuSharedMemory(VOID)
   UINT64 *shared_mem = (UINT64 *)SBSAQEMU_SHARED_MEM_BASE;
   *shared_mem = 0xDEADBEEF;
 
-  // Changed fields needed for the SP to retrieve this request
-  memory_access->composite_memory_region_offset = 0x0;
+  // If success the handle is in x2, the SP retrieves with it and no composite offset
+  FfaMemBuildRetrieve(mem_req, SmcArgs.Arg2);
 
   // Copy this into the TX buffer for EC svc so it can directly send
   void *sp_tx_buffer = (void *)EC_SVC_TX_BUFFER_BASE;
@@ -144,6 +126,23 @@ SetupSbsaQemuSharedMemory(VOID)
   DEBUG ((DEBUG_ERROR, "    X2 = 0x%x\n", SmcArgs.Arg2));
 
 
+  // Publish what cannot change before the next boot, so clients do not ask the EC for it
+  DEBUG ((DEBUG_INFO, "Send EC_CAP_GET_FW_STATE request for the static snapshot\n"));
+  ZeroMem(&SmcArgs, sizeof(SmcArgs));
+  SmcArgs.Arg0 = FFA_MSG_SEND_DIRECT_REQ2_SMC;
+  SmcArgs.Arg1 = EC_SERVICE_VMID;
+  SmcArgs.Arg2 = EC_SVC_MANAGEMENT_GUID_LO;
+  SmcArgs.Arg3 = EC_SVC_MANAGEMENT_GUID_HI;
+  SmcArgs.Arg4 = EC_CAP_GET_FW_STATE;
+
+  ArmCallSmc (&SmcArgs);
+  DEBUG ((DEBUG_ERROR, "    X0 = 0x%x\n", SmcArgs.Arg0));
+  DEBUG ((DEBUG_ERROR, "    X5 = 0x%x\n", SmcArgs.Arg5));
+
+  // TFWS reports 0 when the request fails, the snapshot does the same
+  EcStaticBuild((EC_STATIC *)EC_STATIC_BASE,
+                (SmcArgs.Arg0 == FFA_MSG_SEND_DIRECT_RESP2_SMC) ? (UINT32)SmcArgs.Arg5 : 0);
+
   // We need to unmap our RXTX buffers again so the OS can re-set them up again
   DEBUG ((DEBUG_INFO, "Send FFA_RXTX_UNMAP the OS will remap buffers again\n"));
 